@@ -0,0 +1,168 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * bench_common.c -- helpers shared by the benchmarks
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench_common.h"
+
+/*
+ * bench_now -- returns the monotonic time in nanoseconds
+ */
+uint64_t
+bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * bench_parse_size -- parses a size with an optional K, M or G suffix
+ */
+int
+bench_parse_size(const char *str, size_t *size)
+{
+	char *end;
+	errno = 0;
+	unsigned long long val = strtoull(str, &end, 10);
+	if (errno != 0 || end == str)
+		return -1;
+
+	switch (*end) {
+		case 'K':
+		case 'k':
+			val <<= 10;
+			end++;
+			break;
+		case 'M':
+		case 'm':
+			val <<= 20;
+			end++;
+			break;
+		case 'G':
+		case 'g':
+			val <<= 30;
+			end++;
+			break;
+		default:
+			break;
+	}
+
+	if (*end != '\0')
+		return -1;
+
+	*size = (size_t)val;
+	return 0;
+}
+
+/*
+ * bench_parse_sizes -- parses a comma-separated list of at most
+ * BENCH_MAX_VALUES sizes
+ */
+int
+bench_parse_sizes(char *str, size_t *sizes, size_t *nsizes)
+{
+	*nsizes = 0;
+	for (char *tok = strtok(str, ","); tok != NULL;
+		tok = strtok(NULL, ",")) {
+		if (*nsizes == BENCH_MAX_VALUES ||
+			bench_parse_size(tok, &sizes[*nsizes]) != 0)
+			return -1;
+		(*nsizes)++;
+	}
+
+	return *nsizes == 0 ? -1 : 0;
+}
+
+/*
+ * bench_nonzero -- checks whether none of the values is zero
+ */
+int
+bench_nonzero(const size_t *values, size_t nvalues)
+{
+	for (size_t i = 0; i < nvalues; i++) {
+		if (values[i] == 0)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * bench_parse_names -- parses a comma-separated list of names, and sets
+ * the flags of the ones in the list
+ */
+int
+bench_parse_names(char *str, const char *names[], size_t nnames, int *set)
+{
+	memset(set, 0, nnames * sizeof(*set));
+	for (char *tok = strtok(str, ","); tok != NULL;
+		tok = strtok(NULL, ",")) {
+		size_t i;
+		for (i = 0; i < nnames; i++) {
+			if (strcmp(tok, names[i]) == 0)
+				break;
+		}
+		if (i == nnames)
+			return -1;
+		set[i] = 1;
+	}
+
+	return 0;
+}
+
+/*
+ * bench_parse_format -- parses the name of the output format
+ */
+int
+bench_parse_format(const char *str, enum bench_format *format)
+{
+	if (strcmp(str, "csv") == 0)
+		*format = BENCH_FORMAT_CSV;
+	else if (strcmp(str, "json") == 0)
+		*format = BENCH_FORMAT_JSON;
+	else
+		return -1;
+
+	return 0;
+}
+
+/*
+ * bench_cmp -- compares two values for qsort
+ */
+static int
+bench_cmp(const void *a, const void *b)
+{
+	uint64_t va = *(const uint64_t *)a;
+	uint64_t vb = *(const uint64_t *)b;
+
+	return va < vb ? -1 : va > vb;
+}
+
+/*
+ * bench_sort -- sorts the values, e.g. the latencies, in ascending order
+ */
+void
+bench_sort(uint64_t *values, size_t nvalues)
+{
+	qsort(values, nvalues, sizeof(*values), bench_cmp);
+}
+
+/*
+ * bench_percentile -- returns the percentile of the sorted values
+ */
+uint64_t
+bench_percentile(const uint64_t *sorted, size_t nvalues, double p)
+{
+	size_t i = (size_t)(p / 100.0 * (double)(nvalues - 1) + 0.5);
+
+	return sorted[i];
+}
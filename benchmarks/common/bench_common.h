@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * bench_common.h -- helpers shared by the benchmarks
+ */
+
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* the most values in a comma-separated list of an option */
+#define BENCH_MAX_VALUES 32
+
+enum bench_format {
+	BENCH_FORMAT_CSV,
+	BENCH_FORMAT_JSON,
+};
+
+uint64_t bench_now(void);
+int bench_parse_size(const char *str, size_t *size);
+int bench_parse_sizes(char *str, size_t *sizes, size_t *nsizes);
+int bench_nonzero(const size_t *values, size_t nvalues);
+int bench_parse_names(char *str, const char *names[], size_t nnames,
+	int *set);
+int bench_parse_format(const char *str, enum bench_format *format);
+void bench_sort(uint64_t *values, size_t nvalues);
+uint64_t bench_percentile(const uint64_t *sorted, size_t nvalues, double p);
+
+#endif /* BENCH_COMMON_H */
@@ -0,0 +1,575 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * data_mover_bench.c -- throughput and latency benchmark of the data movers
+ *
+ * For every combination of the data mover, the notifier, the number of
+ * threads, the queue depth and the operation size, keeps 'depth' operations
+ * in flight until 'bytes' are moved, and prints one record with the
+ * throughput and the latency percentiles, as CSV or as JSON lines.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libminiasync.h"
+#include "core/util.h"
+#include "bench_common.h"
+
+#ifdef BENCH_DML
+#include "libminiasync-vdm-dml.h"
+#endif
+
+#define BENCH_RINGBUF_SIZE 128
+/* larger queues share the buffers, not to need depth times the op size */
+#define BENCH_POOL_SIZE (256ULL << 20)
+#define BENCH_MIN_OPS 4
+#define BENCH_PATTERN 0x5a
+
+enum bench_mover {
+	BENCH_MOVER_SYNC,
+	BENCH_MOVER_THREADS,
+	BENCH_MOVER_DML,
+	MAX_BENCH_MOVER
+};
+
+static const char *bench_mover_names[] = {
+	[BENCH_MOVER_SYNC] = "sync",
+	[BENCH_MOVER_THREADS] = "threads",
+	[BENCH_MOVER_DML] = "dml",
+};
+
+static const char *bench_notifier_names[] = {
+	[FUTURE_NOTIFIER_NONE] = "none",
+	[FUTURE_NOTIFIER_WAKER] = "waker",
+	[FUTURE_NOTIFIER_POLLER] = "poller",
+};
+
+struct bench_config {
+	int movers[MAX_BENCH_MOVER];
+	int notifiers[FUTURE_NOTIFIER_POLLER + 1];
+	size_t nthreads[BENCH_MAX_VALUES];
+	size_t nnthreads;
+	size_t depths[BENCH_MAX_VALUES];
+	size_t ndepths;
+	size_t min_size;
+	size_t max_size;
+	size_t bytes; /* moved in each run, unless it's under BENCH_MIN_OPS */
+	size_t max_ops;
+	int op_memset; /* memset instead of memcpy */
+	enum bench_format format;
+};
+
+/* one run of the benchmark */
+struct bench_run {
+	enum bench_mover mover;
+	enum future_notifier_type notifier;
+	size_t nthreads;
+	size_t depth;
+	size_t size;
+};
+
+struct bench_result {
+	size_t ops;
+	double seconds;
+	uint64_t *latencies; /* of each operation, in nanoseconds */
+};
+
+struct bench_mover_instance {
+	enum bench_mover type;
+	void *mover;
+	struct vdm *vdm;
+};
+
+/* the futures of a queue depth */
+struct bench_slot {
+	struct vdm_operation_future fut;
+	struct future_notifier notifier;
+	uint64_t woken;
+	uint64_t start;
+	int busy;
+};
+
+/*
+ * bench_mover_new -- creates the data mover of the run
+ */
+static int
+bench_mover_new(struct bench_mover_instance *inst, const struct bench_run *run)
+{
+	inst->type = run->mover;
+
+	switch (run->mover) {
+		case BENCH_MOVER_SYNC: {
+			struct data_mover_sync *dms = data_mover_sync_new();
+			if (dms == NULL)
+				return -1;
+			inst->mover = dms;
+			inst->vdm = data_mover_sync_get_vdm(dms);
+			return 0;
+		}
+		case BENCH_MOVER_THREADS: {
+			size_t ringbuf_size = run->depth > BENCH_RINGBUF_SIZE ?
+				run->depth : BENCH_RINGBUF_SIZE;
+			struct data_mover_threads *dmt =
+				data_mover_threads_new(run->nthreads,
+					ringbuf_size, run->notifier);
+			if (dmt == NULL)
+				return -1;
+			inst->mover = dmt;
+			inst->vdm = data_mover_threads_get_vdm(dmt);
+			return 0;
+		}
+#ifdef BENCH_DML
+		case BENCH_MOVER_DML: {
+			struct data_mover_dml *dmd =
+				data_mover_dml_new(DATA_MOVER_DML_AUTO);
+			if (dmd == NULL)
+				return -1;
+			inst->mover = dmd;
+			inst->vdm = data_mover_dml_get_vdm(dmd);
+			return 0;
+		}
+#endif
+		default:
+			return -1;
+	}
+}
+
+/*
+ * bench_mover_delete -- deletes the data mover of the run
+ */
+static void
+bench_mover_delete(struct bench_mover_instance *inst)
+{
+	switch (inst->type) {
+		case BENCH_MOVER_SYNC:
+			data_mover_sync_delete(inst->mover);
+			break;
+		case BENCH_MOVER_THREADS:
+			data_mover_threads_delete(inst->mover);
+			break;
+#ifdef BENCH_DML
+		case BENCH_MOVER_DML:
+			data_mover_dml_delete(inst->mover);
+			break;
+#endif
+		default:
+			break;
+	}
+}
+
+/*
+ * bench_wake -- marks the slot of the waker as ready to be polled
+ */
+static void
+bench_wake(void *data)
+{
+	struct bench_slot *slot = data;
+	util_atomic_store_explicit64(&slot->woken, 1, memory_order_release);
+}
+
+/*
+ * bench_slot_ready -- checks whether polling the slot can make progress,
+ * as its notifier says
+ */
+static int
+bench_slot_ready(struct bench_slot *slot)
+{
+	uint64_t val;
+
+	switch (slot->notifier.notifier_used) {
+		case FUTURE_NOTIFIER_WAKER:
+			util_atomic_load_explicit64(&slot->woken, &val,
+				memory_order_acquire);
+			return val != 0;
+		case FUTURE_NOTIFIER_POLLER:
+			util_atomic_load_explicit64(
+				slot->notifier.poller.ptr_to_monitor, &val,
+				memory_order_acquire);
+			return val != 0;
+		default:
+			return 1;
+	}
+}
+
+/*
+ * bench_slot_poll -- polls the future of the slot, returns 1 once it
+ * completes
+ */
+static int
+bench_slot_poll(struct bench_slot *slot, enum future_notifier_type notifier)
+{
+	if (!bench_slot_ready(slot))
+		return 0;
+
+	struct future_notifier *n = NULL;
+	if (notifier != FUTURE_NOTIFIER_NONE) {
+		util_atomic_store_explicit64(&slot->woken, 0,
+			memory_order_relaxed);
+		n = &slot->notifier;
+		n->waker.data = slot;
+		n->waker.wake = bench_wake;
+		n->poller.ptr_to_monitor = NULL;
+		n->notifier_used = FUTURE_NOTIFIER_NONE;
+	}
+
+	if (future_poll(FUTURE_AS_RUNNABLE(&slot->fut), n) ==
+		FUTURE_STATE_COMPLETE) {
+		if (FUTURE_OUTPUT(&slot->fut)->result !=
+			VDM_SUCCESS) {
+			fprintf(stderr, "operation failed\n");
+			exit(1);
+		}
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * bench_do_run -- keeps 'depth' operations in flight until 'ops' of them
+ * complete, the first 'warmup' of which are not measured
+ */
+static void
+bench_do_run(struct vdm *vdm, const struct bench_config *cfg,
+	const struct bench_run *run, char *src, char *dst, size_t pool_size,
+	size_t warmup, struct bench_result *res)
+{
+	struct bench_slot *slots = calloc(run->depth, sizeof(*slots));
+	if (slots == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	/* the slots use distinct buffers, as long as they fit in the pool */
+	size_t nbufs = pool_size / run->size;
+	size_t total = res->ops + warmup;
+	size_t submitted = 0;
+	size_t completed = 0;
+	uint64_t start = 0;
+
+	while (completed < total) {
+		for (size_t i = 0; i < run->depth; i++) {
+			struct bench_slot *slot = &slots[i];
+			if (!slot->busy) {
+				if (submitted == total)
+					continue;
+				if (submitted == warmup)
+					start = bench_now();
+
+				size_t off = (i % nbufs) * run->size;
+				slot->fut = cfg->op_memset ?
+					vdm_memset(vdm, dst + off,
+						BENCH_PATTERN, run->size, 0) :
+					vdm_memcpy(vdm, dst + off, src + off,
+						run->size, 0);
+				slot->notifier.notifier_used =
+					FUTURE_NOTIFIER_NONE;
+				slot->start = bench_now();
+				slot->busy = 1;
+				submitted++;
+			}
+
+			if (!bench_slot_poll(slot, run->notifier))
+				continue;
+
+			slot->busy = 0;
+			if (completed >= warmup) {
+				res->latencies[completed - warmup] =
+					bench_now() - slot->start;
+			}
+			completed++;
+		}
+	}
+	res->seconds = (double)(bench_now() - start) / 1e9;
+
+	free(slots);
+}
+
+/*
+ * bench_print_header -- prints the header of the CSV output
+ */
+static void
+bench_print_header(const struct bench_config *cfg)
+{
+	if (cfg->format != BENCH_FORMAT_CSV)
+		return;
+
+	printf("mover,operation,notifier,threads,depth,size,ops,seconds,"
+		"gbps,ops_per_sec,lat_min_ns,lat_avg_ns,lat_p50_ns,"
+		"lat_p90_ns,lat_p99_ns,lat_p999_ns,lat_max_ns\n");
+}
+
+/*
+ * bench_print -- prints the record of the run
+ */
+static void
+bench_print(const struct bench_config *cfg, const struct bench_run *run,
+	struct bench_result *res)
+{
+	bench_sort(res->latencies, res->ops);
+
+	uint64_t sum = 0;
+	for (size_t i = 0; i < res->ops; i++)
+		sum += res->latencies[i];
+
+	double gbps = (double)run->size * (double)res->ops /
+		res->seconds / 1e9;
+	double ops_per_sec = (double)res->ops / res->seconds;
+	const char *op = cfg->op_memset ? "memset" : "memcpy";
+	const char *fmt = cfg->format == BENCH_FORMAT_CSV ?
+		"%s,%s,%s,%zu,%zu,%zu,%zu,%.6f,%.3f,%.1f,"
+		"%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+		",%" PRIu64 ",%" PRIu64 "\n" :
+		"{\"mover\":\"%s\",\"operation\":\"%s\",\"notifier\":\"%s\","
+		"\"threads\":%zu,\"depth\":%zu,\"size\":%zu,\"ops\":%zu,"
+		"\"seconds\":%.6f,\"gbps\":%.3f,\"ops_per_sec\":%.1f,"
+		"\"lat_min_ns\":%" PRIu64 ",\"lat_avg_ns\":%" PRIu64 ","
+		"\"lat_p50_ns\":%" PRIu64 ",\"lat_p90_ns\":%" PRIu64 ","
+		"\"lat_p99_ns\":%" PRIu64 ",\"lat_p999_ns\":%" PRIu64 ","
+		"\"lat_max_ns\":%" PRIu64 "}\n";
+
+	const uint64_t *lat = res->latencies;
+	printf(fmt, bench_mover_names[run->mover], op,
+		bench_notifier_names[run->notifier], run->nthreads,
+		run->depth, run->size, res->ops, res->seconds, gbps,
+		ops_per_sec, lat[0], sum / res->ops,
+		bench_percentile(lat, res->ops, 50.0),
+		bench_percentile(lat, res->ops, 90.0),
+		bench_percentile(lat, res->ops, 99.0),
+		bench_percentile(lat, res->ops, 99.9),
+		lat[res->ops - 1]);
+	fflush(stdout);
+}
+
+/*
+ * bench_run_sizes -- runs the benchmark for each size of the sweep
+ */
+static int
+bench_run_sizes(const struct bench_config *cfg, struct bench_run *run,
+	char *src, char *dst, size_t pool_size, uint64_t *latencies)
+{
+	struct bench_mover_instance inst;
+	if (bench_mover_new(&inst, run) != 0) {
+		fprintf(stderr, "cannot create the %s data mover\n",
+			bench_mover_names[run->mover]);
+		return -1;
+	}
+
+	for (run->size = cfg->min_size; run->size <= cfg->max_size;
+		run->size <<= 1) {
+		struct bench_result res;
+		res.ops = cfg->bytes / run->size;
+		if (res.ops < BENCH_MIN_OPS)
+			res.ops = BENCH_MIN_OPS;
+		if (res.ops > cfg->max_ops)
+			res.ops = cfg->max_ops;
+		res.latencies = latencies;
+
+		bench_do_run(inst.vdm, cfg, run, src, dst, pool_size,
+			run->depth, &res);
+		bench_print(cfg, run, &res);
+
+		if (run->size > SIZE_MAX / 2)
+			break;
+	}
+
+	bench_mover_delete(&inst);
+
+	return 0;
+}
+
+/*
+ * bench_usage -- prints the usage of the benchmark
+ */
+static void
+bench_usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -m movers     sync,threads,dml (all available)\n"
+		"  -n notifiers  none,waker,poller (all)\n"
+		"  -t threads    threads of the threads mover (1,4)\n"
+		"  -q depths     operations in flight (1,8,64)\n"
+		"  -s size       smallest operation size (8)\n"
+		"  -S size       largest operation size (1G)\n"
+		"  -b bytes      bytes moved in each run (256M)\n"
+		"  -i ops        at most this many operations in a run "
+		"(100000)\n"
+		"  -o operation  memcpy or memset (memcpy)\n"
+		"  -f format     csv or json (csv)\n", name);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct bench_config cfg = {
+		.movers = {1, 1, 1},
+		.notifiers = {1, 1, 1},
+		.nthreads = {1, 4},
+		.nnthreads = 2,
+		.depths = {1, 8, 64},
+		.ndepths = 3,
+		.min_size = 8,
+		.max_size = 1ULL << 30,
+		.bytes = 256ULL << 20,
+		.max_ops = 100000,
+		.op_memset = 0,
+		.format = BENCH_FORMAT_CSV,
+	};
+
+#ifndef BENCH_DML
+	cfg.movers[BENCH_MOVER_DML] = 0;
+#endif
+
+	int opt;
+	while ((opt = getopt(argc, argv, "m:n:t:q:s:S:b:i:o:f:h")) != -1) {
+		int ret = 0;
+		switch (opt) {
+			case 'm':
+				ret = bench_parse_names(optarg,
+					bench_mover_names, MAX_BENCH_MOVER,
+					cfg.movers);
+				break;
+			case 'n':
+				ret = bench_parse_names(optarg,
+					bench_notifier_names,
+					FUTURE_NOTIFIER_POLLER + 1,
+					cfg.notifiers);
+				break;
+			case 't':
+				ret = bench_parse_sizes(optarg, cfg.nthreads,
+					&cfg.nnthreads);
+				break;
+			case 'q':
+				ret = bench_parse_sizes(optarg, cfg.depths,
+					&cfg.ndepths);
+				break;
+			case 's':
+				ret = bench_parse_size(optarg, &cfg.min_size);
+				break;
+			case 'S':
+				ret = bench_parse_size(optarg, &cfg.max_size);
+				break;
+			case 'b':
+				ret = bench_parse_size(optarg, &cfg.bytes);
+				break;
+			case 'i':
+				ret = bench_parse_size(optarg, &cfg.max_ops);
+				break;
+			case 'o':
+				if (strcmp(optarg, "memset") == 0)
+					cfg.op_memset = 1;
+				else if (strcmp(optarg, "memcpy") == 0)
+					cfg.op_memset = 0;
+				else
+					ret = -1;
+				break;
+			case 'f':
+				ret = bench_parse_format(optarg, &cfg.format);
+				break;
+			default:
+				ret = -1;
+				break;
+		}
+
+		if (ret != 0) {
+			bench_usage(argv[0]);
+			return 1;
+		}
+	}
+
+#ifndef BENCH_DML
+	if (cfg.movers[BENCH_MOVER_DML]) {
+		fprintf(stderr, "the dml data mover is not compiled in\n");
+		return 1;
+	}
+#endif
+
+	if (cfg.min_size > cfg.max_size ||
+		!bench_nonzero(cfg.nthreads, cfg.nnthreads) ||
+		!bench_nonzero(cfg.depths, cfg.ndepths) ||
+		!bench_nonzero(&cfg.min_size, 1) ||
+		!bench_nonzero(&cfg.bytes, 1) ||
+		!bench_nonzero(&cfg.max_ops, 1)) {
+		bench_usage(argv[0]);
+		return 1;
+	}
+
+	size_t max_depth = 1;
+	for (size_t i = 0; i < cfg.ndepths; i++) {
+		if (cfg.depths[i] > max_depth)
+			max_depth = cfg.depths[i];
+	}
+
+	size_t pool_size = cfg.max_size * max_depth;
+	if (pool_size / max_depth != cfg.max_size ||
+		pool_size > BENCH_POOL_SIZE)
+		pool_size = cfg.max_size > BENCH_POOL_SIZE ?
+			cfg.max_size : BENCH_POOL_SIZE;
+
+	char *src = malloc(pool_size);
+	char *dst = malloc(pool_size);
+	uint64_t *latencies = malloc(cfg.max_ops * sizeof(*latencies));
+	if (src == NULL || dst == NULL || latencies == NULL) {
+		fprintf(stderr, "out of memory\n");
+		free(latencies);
+		free(dst);
+		free(src);
+		return 1;
+	}
+
+	/* the page faults are not what's measured */
+	memset(src, BENCH_PATTERN, pool_size);
+	memset(dst, 0, pool_size);
+
+	bench_print_header(&cfg);
+
+	int ret = 0;
+	struct bench_run run;
+	for (run.mover = 0; run.mover < MAX_BENCH_MOVER; run.mover++) {
+		if (!cfg.movers[run.mover])
+			continue;
+
+		for (run.notifier = FUTURE_NOTIFIER_NONE;
+			run.notifier <= FUTURE_NOTIFIER_POLLER;
+			run.notifier++) {
+			if (!cfg.notifiers[run.notifier])
+				continue;
+
+			/* the synchronous mover only completes inline */
+			if (run.mover == BENCH_MOVER_SYNC &&
+				run.notifier != FUTURE_NOTIFIER_NONE)
+				continue;
+
+			/* only the threads mover has its threads count */
+			size_t nnthreads = run.mover == BENCH_MOVER_THREADS ?
+				cfg.nnthreads : 1;
+			for (size_t t = 0; t < nnthreads; t++) {
+				run.nthreads = run.mover ==
+					BENCH_MOVER_THREADS ?
+					cfg.nthreads[t] : 0;
+
+				for (size_t d = 0; d < cfg.ndepths; d++) {
+					run.depth = cfg.depths[d];
+					ret = bench_run_sizes(&cfg, &run, src,
+						dst, pool_size, latencies);
+					if (ret != 0)
+						goto out;
+				}
+			}
+		}
+	}
+
+out:
+	free(latencies);
+	free(dst);
+	free(src);
+
+	return ret == 0 ? 0 : 1;
+}
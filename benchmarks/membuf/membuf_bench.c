@@ -0,0 +1,341 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * membuf_bench.c -- cross-thread allocation benchmark of the membuf
+ *
+ * Each of the 'pairs' allocating threads allocates 'allocs' objects from
+ * a shared membuf, and hands them over through a ring buffer to its freeing
+ * thread, which frees them:
+ * - inorder: in the order of their allocation,
+ * - outoforder: picking a random one from a window of the last ones,
+ * - longlived: in the order of their allocation, except for the first one,
+ *   which is freed only at the end.
+ * One record with the throughput, the failed allocations and the membuf
+ * statistics describing the reclamation is printed for each run, as CSV
+ * or as JSON lines.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/membuf.h"
+#include "core/ringbuf.h"
+#include "bench_common.h"
+
+#define BENCH_RINGBUF_LENGTH 1024
+/* objects the outoforder freeing threads pick from */
+#define BENCH_WINDOW 64
+
+enum bench_pattern {
+	BENCH_PATTERN_INORDER,
+	BENCH_PATTERN_OUTOFORDER,
+	BENCH_PATTERN_LONGLIVED,
+	MAX_BENCH_PATTERN
+};
+
+static const char *bench_pattern_names[] = {
+	[BENCH_PATTERN_INORDER] = "inorder",
+	[BENCH_PATTERN_OUTOFORDER] = "outoforder",
+	[BENCH_PATTERN_LONGLIVED] = "longlived",
+};
+
+struct bench_config {
+	int patterns[MAX_BENCH_PATTERN];
+	size_t pairs[BENCH_MAX_VALUES];
+	size_t npairs;
+	size_t sizes[BENCH_MAX_VALUES];
+	size_t nsizes;
+	size_t allocs; /* by each allocating thread */
+	size_t buffer_size; /* of the per-thread buffers, 0 for the default */
+	enum bench_format format;
+};
+
+/* one run of the benchmark */
+struct bench_run {
+	enum bench_pattern pattern;
+	size_t npairs;
+	size_t size;
+	size_t allocs;
+	struct membuf *membuf;
+	pthread_barrier_t barrier; /* started together with the clock */
+};
+
+struct bench_pair {
+	struct bench_run *run;
+	struct ringbuf *rbuf; /* from the allocating to the freeing thread */
+	uint64_t failures; /* allocations which failed, and were retried */
+	pthread_t allocator;
+	pthread_t freer;
+};
+
+/*
+ * bench_allocator -- allocates the objects and hands them over
+ */
+static void *
+bench_allocator(void *arg)
+{
+	struct bench_pair *pair = arg;
+	struct bench_run *run = pair->run;
+	pthread_barrier_wait(&run->barrier);
+
+	for (size_t i = 0; i < run->allocs; i++) {
+		void *ptr;
+		while ((ptr = membuf_alloc(run->membuf, run->size)) == NULL) {
+			pair->failures++;
+			sched_yield();
+		}
+		/* touched like the operations are */
+		memset(ptr, 0, sizeof(uint64_t));
+
+		while (ringbuf_tryenqueue(pair->rbuf, ptr) != 0)
+			sched_yield();
+	}
+
+	return NULL;
+}
+
+/*
+ * bench_next -- returns the next object handed over to the freeing thread
+ */
+static void *
+bench_next(struct bench_pair *pair)
+{
+	void *ptr;
+	while ((ptr = ringbuf_trydequeue(pair->rbuf)) == NULL)
+		sched_yield();
+
+	return ptr;
+}
+
+/*
+ * bench_freer -- frees the objects in the order of the pattern
+ */
+static void *
+bench_freer(void *arg)
+{
+	struct bench_pair *pair = arg;
+	struct bench_run *run = pair->run;
+	pthread_barrier_wait(&run->barrier);
+
+	void *window[BENCH_WINDOW];
+	size_t nwindow = 0;
+	void *longlived = NULL;
+	uint64_t seed = (uint64_t)(uintptr_t)pair | 1;
+
+	for (size_t i = 0; i < run->allocs; i++) {
+		void *ptr = bench_next(pair);
+
+		switch (run->pattern) {
+			case BENCH_PATTERN_OUTOFORDER:
+				if (nwindow < BENCH_WINDOW) {
+					window[nwindow++] = ptr;
+					continue;
+				}
+				/* xorshift */
+				seed ^= seed << 13;
+				seed ^= seed >> 7;
+				seed ^= seed << 17;
+				size_t victim = seed % BENCH_WINDOW;
+				membuf_free(window[victim]);
+				window[victim] = ptr;
+				break;
+			case BENCH_PATTERN_LONGLIVED:
+				if (i == 0) {
+					longlived = ptr;
+					continue;
+				}
+				membuf_free(ptr);
+				break;
+			default:
+				membuf_free(ptr);
+				break;
+		}
+	}
+
+	for (size_t i = 0; i < nwindow; i++)
+		membuf_free(window[i]);
+	if (longlived != NULL)
+		membuf_free(longlived);
+
+	return NULL;
+}
+
+/*
+ * bench_do_run -- runs the pairs of threads, and prints the record of the
+ * run
+ */
+static int
+bench_do_run(const struct bench_config *cfg, struct bench_run *run)
+{
+	run->membuf = membuf_new(NULL, cfg->buffer_size, MEMBUF_PAGES_NORMAL);
+	struct bench_pair *pairs = calloc(run->npairs, sizeof(*pairs));
+	if (run->membuf == NULL || pairs == NULL) {
+		fprintf(stderr, "cannot create the membuf\n");
+		exit(1);
+	}
+	pthread_barrier_init(&run->barrier, NULL,
+		(unsigned)run->npairs * 2 + 1);
+
+	for (size_t i = 0; i < run->npairs; i++) {
+		struct bench_pair *pair = &pairs[i];
+		pair->run = run;
+		pair->rbuf = ringbuf_new(BENCH_RINGBUF_LENGTH);
+		if (pair->rbuf == NULL ||
+			pthread_create(&pair->allocator, NULL,
+				bench_allocator, pair) != 0 ||
+			pthread_create(&pair->freer, NULL,
+				bench_freer, pair) != 0) {
+			fprintf(stderr, "cannot create the threads\n");
+			exit(1);
+		}
+	}
+
+	pthread_barrier_wait(&run->barrier);
+	uint64_t start = bench_now();
+
+	uint64_t failures = 0;
+	for (size_t i = 0; i < run->npairs; i++) {
+		pthread_join(pairs[i].allocator, NULL);
+		pthread_join(pairs[i].freer, NULL);
+		failures += pairs[i].failures;
+		ringbuf_delete(pairs[i].rbuf);
+	}
+	double seconds = (double)(bench_now() - start) / 1e9;
+
+	struct vdm_membuf_stats stats;
+	membuf_get_stats(run->membuf, &stats);
+
+	pthread_barrier_destroy(&run->barrier);
+	free(pairs);
+	membuf_delete(run->membuf);
+
+	size_t ops = run->npairs * run->allocs;
+	const char *fmt = cfg->format == BENCH_FORMAT_CSV ?
+		"%s,%zu,%zu,%zu,%.6f,%.1f,%" PRIu64 ",%" PRIu64 ",%" PRIu64
+		",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+		",%" PRIu64 "\n" :
+		"{\"pattern\":\"%s\",\"pairs\":%zu,\"size\":%zu,\"ops\":%zu,"
+		"\"seconds\":%.6f,\"ops_per_sec\":%.1f,"
+		"\"alloc_failures\":%" PRIu64 ",\"buffers\":%" PRIu64 ","
+		"\"buffer_size\":%" PRIu64 ",\"max_bytes_allocated\":%" PRIu64
+		",\"bytes_allocated\":%" PRIu64 ",\"bytes_reusable\":%" PRIu64
+		",\"collections\":%" PRIu64 ",\"collected\":%" PRIu64 ","
+		"\"resets\":%" PRIu64 "}\n";
+
+	printf(fmt, bench_pattern_names[run->pattern], run->npairs, run->size,
+		ops, seconds, (double)ops / seconds, failures, stats.buffers,
+		stats.buffer_size, stats.max_bytes_allocated,
+		stats.bytes_allocated, stats.bytes_reusable,
+		stats.collections, stats.collected, stats.resets);
+	fflush(stdout);
+
+	return 0;
+}
+
+/*
+ * bench_usage -- prints the usage of the benchmark
+ */
+static void
+bench_usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -m patterns  inorder,outoforder,longlived (all)\n"
+		"  -p pairs     pairs of allocating and freeing threads "
+		"(1,2,4)\n"
+		"  -s sizes     sizes of the objects (64,256)\n"
+		"  -i allocs    objects allocated by each thread (1M)\n"
+		"  -b size      size of the per-thread buffers (default)\n"
+		"  -f format    csv or json (csv)\n", name);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct bench_config cfg = {
+		.patterns = {1, 1, 1},
+		.pairs = {1, 2, 4},
+		.npairs = 3,
+		.sizes = {64, 256},
+		.nsizes = 2,
+		.allocs = 1 << 20,
+		.buffer_size = 0,
+		.format = BENCH_FORMAT_CSV,
+	};
+
+	int opt;
+	while ((opt = getopt(argc, argv, "m:p:s:i:b:f:h")) != -1) {
+		int ret = 0;
+		switch (opt) {
+			case 'm':
+				ret = bench_parse_names(optarg,
+					bench_pattern_names,
+					MAX_BENCH_PATTERN, cfg.patterns);
+				break;
+			case 'p':
+				ret = bench_parse_sizes(optarg, cfg.pairs,
+					&cfg.npairs);
+				break;
+			case 's':
+				ret = bench_parse_sizes(optarg, cfg.sizes,
+					&cfg.nsizes);
+				break;
+			case 'i':
+				ret = bench_parse_size(optarg, &cfg.allocs);
+				break;
+			case 'b':
+				ret = bench_parse_size(optarg,
+					&cfg.buffer_size);
+				break;
+			case 'f':
+				ret = bench_parse_format(optarg, &cfg.format);
+				break;
+			default:
+				ret = -1;
+				break;
+		}
+
+		if (ret != 0) {
+			bench_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (!bench_nonzero(cfg.pairs, cfg.npairs) ||
+		!bench_nonzero(cfg.sizes, cfg.nsizes)) {
+		bench_usage(argv[0]);
+		return 1;
+	}
+
+	if (cfg.format == BENCH_FORMAT_CSV) {
+		printf("pattern,pairs,size,ops,seconds,ops_per_sec,"
+			"alloc_failures,buffers,buffer_size,"
+			"max_bytes_allocated,bytes_allocated,bytes_reusable,"
+			"collections,collected,resets\n");
+	}
+
+	struct bench_run run;
+	run.allocs = cfg.allocs;
+	for (run.pattern = 0; run.pattern < MAX_BENCH_PATTERN; run.pattern++) {
+		if (!cfg.patterns[run.pattern])
+			continue;
+
+		for (size_t p = 0; p < cfg.npairs; p++) {
+			run.npairs = cfg.pairs[p];
+			for (size_t s = 0; s < cfg.nsizes; s++) {
+				run.size = cfg.sizes[s];
+				if (bench_do_run(&cfg, &run) != 0)
+					return 1;
+			}
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,325 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * ringbuf_bench.c -- contention benchmark of the ring buffer
+ *
+ * For every combination of the mode, the number of producers, the number
+ * of consumers and the length of the buffer, the producers enqueue 'items'
+ * values in total, which the consumers dequeue. The 'try' mode retries
+ * the try operations, yielding the cpu after each one that failed on a full
+ * or an empty buffer, and the 'blocking' mode waits in the blocking ones.
+ * One record with the throughput and the failed try operations is printed
+ * for each run, as CSV or as JSON lines.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "core/ringbuf.h"
+#include "bench_common.h"
+
+/* tells a consumer there's nothing more to dequeue */
+#define BENCH_SENTINEL ((void *)UINTPTR_MAX)
+
+enum bench_mode {
+	BENCH_MODE_TRY,
+	BENCH_MODE_BLOCKING,
+	MAX_BENCH_MODE
+};
+
+static const char *bench_mode_names[] = {
+	[BENCH_MODE_TRY] = "try",
+	[BENCH_MODE_BLOCKING] = "blocking",
+};
+
+struct bench_config {
+	int modes[MAX_BENCH_MODE];
+	size_t producers[BENCH_MAX_VALUES];
+	size_t nproducers;
+	size_t consumers[BENCH_MAX_VALUES];
+	size_t nconsumers;
+	size_t lengths[BENCH_MAX_VALUES];
+	size_t nlengths;
+	size_t items;
+	enum bench_format format;
+};
+
+/* one run of the benchmark */
+struct bench_run {
+	enum bench_mode mode;
+	size_t nproducers;
+	size_t nconsumers;
+	size_t length;
+	struct ringbuf *rbuf;
+	pthread_barrier_t barrier; /* started together with the clock */
+};
+
+struct bench_worker {
+	struct bench_run *run;
+	size_t items; /* to enqueue, or dequeued */
+	uint64_t retries; /* try operations which failed */
+	pthread_t thread;
+};
+
+/*
+ * bench_enqueue -- enqueues the value, retrying in the try mode
+ */
+static void
+bench_enqueue(struct bench_worker *w, void *value)
+{
+	if (w->run->mode == BENCH_MODE_BLOCKING) {
+		ringbuf_enqueue(w->run->rbuf, value);
+		return;
+	}
+
+	while (ringbuf_tryenqueue(w->run->rbuf, value) != 0) {
+		w->retries++;
+		sched_yield();
+	}
+}
+
+/*
+ * bench_producer -- enqueues the items of the producer
+ */
+static void *
+bench_producer(void *arg)
+{
+	struct bench_worker *w = arg;
+	pthread_barrier_wait(&w->run->barrier);
+
+	for (size_t i = 0; i < w->items; i++)
+		bench_enqueue(w, (void *)(uintptr_t)(i + 1));
+
+	return NULL;
+}
+
+/*
+ * bench_consumer -- dequeues the items until the sentinel
+ */
+static void *
+bench_consumer(void *arg)
+{
+	struct bench_worker *w = arg;
+	struct ringbuf *rbuf = w->run->rbuf;
+	pthread_barrier_wait(&w->run->barrier);
+
+	for (;;) {
+		void *value;
+		if (w->run->mode == BENCH_MODE_BLOCKING) {
+			value = ringbuf_dequeue(rbuf);
+		} else {
+			while ((value = ringbuf_trydequeue(rbuf)) == NULL) {
+				w->retries++;
+				sched_yield();
+			}
+		}
+
+		if (value == BENCH_SENTINEL)
+			break;
+		w->items++;
+	}
+
+	return NULL;
+}
+
+/*
+ * bench_do_run -- runs the producers and the consumers, and prints the
+ * record of the run
+ */
+static int
+bench_do_run(const struct bench_config *cfg, struct bench_run *run)
+{
+	run->rbuf = run->mode == BENCH_MODE_BLOCKING ?
+		ringbuf_new_blocking((unsigned)run->length) :
+		ringbuf_new((unsigned)run->length);
+	if (run->rbuf == NULL) {
+		fprintf(stderr, "the length has to be a power of two\n");
+		return -1;
+	}
+
+	size_t nworkers = run->nproducers + run->nconsumers;
+	struct bench_worker *workers = calloc(nworkers, sizeof(*workers));
+	if (workers == NULL) {
+		ringbuf_delete(run->rbuf);
+		return -1;
+	}
+	pthread_barrier_init(&run->barrier, NULL, (unsigned)nworkers + 1);
+
+	for (size_t i = 0; i < nworkers; i++) {
+		struct bench_worker *w = &workers[i];
+		w->run = run;
+		int producer = i < run->nproducers;
+		if (producer) {
+			/* the first producers take the remainder */
+			w->items = cfg->items / run->nproducers +
+				(i < cfg->items % run->nproducers);
+		}
+		if (pthread_create(&w->thread, NULL, producer ?
+			bench_producer : bench_consumer, w) != 0) {
+			fprintf(stderr, "cannot create the threads\n");
+			exit(1);
+		}
+	}
+
+	pthread_barrier_wait(&run->barrier);
+	uint64_t start = bench_now();
+
+	for (size_t i = 0; i < run->nproducers; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	/* the consumers stop once everything before is dequeued */
+	struct bench_worker main_worker = {.run = run};
+	for (size_t i = 0; i < run->nconsumers; i++)
+		bench_enqueue(&main_worker, BENCH_SENTINEL);
+
+	size_t dequeued = 0;
+	for (size_t i = run->nproducers; i < nworkers; i++) {
+		pthread_join(workers[i].thread, NULL);
+		dequeued += workers[i].items;
+	}
+	double seconds = (double)(bench_now() - start) / 1e9;
+
+	uint64_t enqueue_retries = 0;
+	uint64_t dequeue_retries = 0;
+	for (size_t i = 0; i < nworkers; i++) {
+		if (i < run->nproducers)
+			enqueue_retries += workers[i].retries;
+		else
+			dequeue_retries += workers[i].retries;
+	}
+
+	pthread_barrier_destroy(&run->barrier);
+	free(workers);
+	ringbuf_delete(run->rbuf);
+
+	if (dequeued != cfg->items) {
+		fprintf(stderr, "dequeued %zu of %zu items\n", dequeued,
+			cfg->items);
+		return -1;
+	}
+
+	const char *fmt = cfg->format == BENCH_FORMAT_CSV ?
+		"%s,%zu,%zu,%zu,%zu,%.6f,%.1f,%" PRIu64 ",%" PRIu64 "\n" :
+		"{\"mode\":\"%s\",\"producers\":%zu,\"consumers\":%zu,"
+		"\"length\":%zu,\"items\":%zu,\"seconds\":%.6f,"
+		"\"ops_per_sec\":%.1f,\"enqueue_retries\":%" PRIu64 ","
+		"\"dequeue_retries\":%" PRIu64 "}\n";
+
+	printf(fmt, bench_mode_names[run->mode], run->nproducers,
+		run->nconsumers, run->length, cfg->items, seconds,
+		(double)cfg->items / seconds, enqueue_retries,
+		dequeue_retries);
+	fflush(stdout);
+
+	return 0;
+}
+
+/*
+ * bench_usage -- prints the usage of the benchmark
+ */
+static void
+bench_usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -m modes      try,blocking (all)\n"
+		"  -p producers  producer threads (1,2,4)\n"
+		"  -c consumers  consumer threads (1,2,4)\n"
+		"  -l lengths    lengths of the buffer, powers of two "
+		"(64,1024)\n"
+		"  -i items      items moved through the buffer in a run "
+		"(1M)\n"
+		"  -f format     csv or json (csv)\n", name);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct bench_config cfg = {
+		.modes = {1, 1},
+		.producers = {1, 2, 4},
+		.nproducers = 3,
+		.consumers = {1, 2, 4},
+		.nconsumers = 3,
+		.lengths = {64, 1024},
+		.nlengths = 2,
+		.items = 1 << 20,
+		.format = BENCH_FORMAT_CSV,
+	};
+
+	int opt;
+	while ((opt = getopt(argc, argv, "m:p:c:l:i:f:h")) != -1) {
+		int ret = 0;
+		switch (opt) {
+			case 'm':
+				ret = bench_parse_names(optarg,
+					bench_mode_names, MAX_BENCH_MODE,
+					cfg.modes);
+				break;
+			case 'p':
+				ret = bench_parse_sizes(optarg, cfg.producers,
+					&cfg.nproducers);
+				break;
+			case 'c':
+				ret = bench_parse_sizes(optarg, cfg.consumers,
+					&cfg.nconsumers);
+				break;
+			case 'l':
+				ret = bench_parse_sizes(optarg, cfg.lengths,
+					&cfg.nlengths);
+				break;
+			case 'i':
+				ret = bench_parse_size(optarg, &cfg.items);
+				break;
+			case 'f':
+				ret = bench_parse_format(optarg, &cfg.format);
+				break;
+			default:
+				ret = -1;
+				break;
+		}
+
+		if (ret != 0) {
+			bench_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (!bench_nonzero(cfg.producers, cfg.nproducers) ||
+		!bench_nonzero(cfg.consumers, cfg.nconsumers) ||
+		!bench_nonzero(cfg.lengths, cfg.nlengths)) {
+		bench_usage(argv[0]);
+		return 1;
+	}
+
+	if (cfg.format == BENCH_FORMAT_CSV) {
+		printf("mode,producers,consumers,length,items,seconds,"
+			"ops_per_sec,enqueue_retries,dequeue_retries\n");
+	}
+
+	struct bench_run run;
+	for (run.mode = 0; run.mode < MAX_BENCH_MODE; run.mode++) {
+		if (!cfg.modes[run.mode])
+			continue;
+
+		for (size_t l = 0; l < cfg.nlengths; l++) {
+			run.length = cfg.lengths[l];
+			for (size_t p = 0; p < cfg.nproducers; p++) {
+				run.nproducers = cfg.producers[p];
+				for (size_t c = 0; c < cfg.nconsumers; c++) {
+					run.nconsumers = cfg.consumers[c];
+					if (bench_do_run(&cfg, &run) != 0)
+						return 1;
+				}
+			}
+		}
+	}
+
+	return 0;
+}
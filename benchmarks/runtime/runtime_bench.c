@@ -0,0 +1,561 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * runtime_bench.c -- overhead microbenchmarks of the futures and the runtime
+ *
+ * Measures, without any data mover:
+ * - poll: the cost of future_poll() on a trivial running future,
+ * - chain: the cost of async_chain_impl() per entry, as the chain grows,
+ * - wait_multiple: the cost of runtime_wait_multiple() per future,
+ *   as the number of futures grows,
+ * - wake: the latency from waking a future up to it being polled again,
+ *   while the runtime is spinning or sleeping.
+ *
+ * Each benchmark is run a number of samples for each of its parameters,
+ * and one record with the percentiles of the nanoseconds per operation
+ * among the samples is printed, as CSV or as JSON lines.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libminiasync.h"
+#include "core/util.h"
+#include "bench_common.h"
+
+/* polls of the counting futures of the chain and wait_multiple benchmarks */
+#define BENCH_COUNT_POLLS 2
+
+enum bench_type {
+	BENCH_POLL,
+	BENCH_CHAIN,
+	BENCH_WAIT_MULTIPLE,
+	BENCH_WAKE,
+	MAX_BENCH
+};
+
+static const char *bench_names[] = {
+	[BENCH_POLL] = "poll",
+	[BENCH_CHAIN] = "chain",
+	[BENCH_WAIT_MULTIPLE] = "wait_multiple",
+	[BENCH_WAKE] = "wake",
+};
+
+struct bench_config {
+	int benchmarks[MAX_BENCH];
+	size_t lengths[BENCH_MAX_VALUES]; /* of the chains */
+	size_t nlengths;
+	size_t nfuts[BENCH_MAX_VALUES]; /* waited for together */
+	size_t nnfuts;
+	size_t delays[BENCH_MAX_VALUES]; /* before the wake, in microseconds */
+	size_t ndelays;
+	size_t samples;
+	size_t ops; /* per sample of the poll and chain benchmarks */
+	enum bench_format format;
+};
+
+/*
+ * BEGIN of bench_count future, running until it's polled 'polls' times
+ */
+struct bench_count_data {
+	uint64_t polls;
+};
+
+struct bench_count_output {
+	uint64_t polled;
+};
+
+FUTURE(bench_count_fut, struct bench_count_data, struct bench_count_output);
+
+static enum future_state
+bench_count_impl(struct future_context *ctx, struct future_notifier *notifier)
+{
+	if (notifier)
+		notifier->notifier_used = FUTURE_NOTIFIER_NONE;
+
+	struct bench_count_data *data = future_context_get_data(ctx);
+	struct bench_count_output *output = future_context_get_output(ctx);
+
+	output->polled++;
+
+	return --data->polls == 0 ?
+		FUTURE_STATE_COMPLETE : FUTURE_STATE_RUNNING;
+}
+
+static void
+bench_count_init(struct bench_count_fut *fut, uint64_t polls)
+{
+	FUTURE_INIT(fut, bench_count_impl);
+	fut->data.polls = polls;
+	fut->output.polled = 0;
+}
+/*
+ * END of bench_count future
+ */
+
+/*
+ * BEGIN of bench_wake future, running until it's woken up by another thread
+ */
+struct bench_wake_shared {
+	struct future_waker waker;
+	uint64_t armed; /* the waker is set */
+	uint64_t woken_at;
+	uint64_t done; /* the waker returned */
+	uint64_t delay; /* in nanoseconds */
+	size_t samples;
+};
+
+struct bench_wake_data {
+	struct bench_wake_shared *shared;
+	int armed;
+};
+
+struct bench_wake_output {
+	uint64_t latency;
+};
+
+FUTURE(bench_wake_fut, struct bench_wake_data, struct bench_wake_output);
+
+static enum future_state
+bench_wake_impl(struct future_context *ctx, struct future_notifier *notifier)
+{
+	struct bench_wake_data *data = future_context_get_data(ctx);
+	struct bench_wake_output *output = future_context_get_output(ctx);
+	struct bench_wake_shared *shared = data->shared;
+
+	uint64_t woken_at;
+	util_atomic_load_explicit64(&shared->woken_at, &woken_at,
+		memory_order_acquire);
+	if (woken_at != 0) {
+		output->latency = bench_now() - woken_at;
+		if (notifier)
+			notifier->notifier_used = FUTURE_NOTIFIER_NONE;
+		return FUTURE_STATE_COMPLETE;
+	}
+
+	if (notifier == NULL) {
+		fprintf(stderr, "the wake future needs a waker\n");
+		exit(1);
+	}
+
+	if (!data->armed) {
+		shared->waker = notifier->waker;
+		util_atomic_store_explicit64(&shared->armed, 1,
+			memory_order_release);
+		data->armed = 1;
+	}
+	notifier->notifier_used = FUTURE_NOTIFIER_WAKER;
+
+	return FUTURE_STATE_RUNNING;
+}
+/*
+ * END of bench_wake future
+ */
+
+/*
+ * bench_wake_thread -- wakes the future up, once it's armed, after the delay
+ */
+static void *
+bench_wake_thread(void *arg)
+{
+	struct bench_wake_shared *shared = arg;
+
+	for (size_t i = 0; i < shared->samples; i++) {
+		uint64_t armed;
+		do {
+			util_atomic_load_explicit64(&shared->armed, &armed,
+				memory_order_acquire);
+		} while (!armed);
+		util_atomic_store_explicit64(&shared->armed, 0,
+			memory_order_relaxed);
+
+		if (shared->delay != 0) {
+			struct timespec ts = {
+				.tv_sec = (time_t)(shared->delay / 1000000000),
+				.tv_nsec = (long)(shared->delay % 1000000000),
+			};
+			nanosleep(&ts, NULL);
+		}
+
+		util_atomic_store_explicit64(&shared->woken_at, bench_now(),
+			memory_order_release);
+		FUTURE_WAKER_WAKE(&shared->waker);
+		util_atomic_store_explicit64(&shared->done, 1,
+			memory_order_release);
+	}
+
+	return NULL;
+}
+
+/*
+ * bench_noop_map -- the map function of the chain entries
+ */
+static void
+bench_noop_map(struct future_context *lhs, struct future_context *rhs,
+	void *arg)
+{
+	(void) lhs;
+	(void) rhs;
+	(void) arg;
+}
+
+/*
+ * bench_poll -- measures a sample of future_poll() calls on a running future
+ */
+static uint64_t
+bench_poll(const struct bench_config *cfg, size_t param, size_t *ops)
+{
+	(void) param;
+
+	struct bench_count_fut fut;
+	bench_count_init(&fut, UINT64_MAX);
+
+	uint64_t start = bench_now();
+	for (size_t i = 0; i < cfg->ops; i++)
+		future_poll(FUTURE_AS_RUNNABLE(&fut), NULL);
+	uint64_t end = bench_now();
+
+	if (fut.output.polled != cfg->ops) {
+		fprintf(stderr, "the future was not polled\n");
+		exit(1);
+	}
+
+	*ops = cfg->ops;
+	return end - start;
+}
+
+/*
+ * bench_chain -- measures a sample of polls of the chains of the length,
+ * built in an arena
+ */
+static uint64_t
+bench_chain(const struct bench_config *cfg, size_t length, size_t *ops)
+{
+	struct bench_count_fut fut;
+	bench_count_init(&fut, BENCH_COUNT_POLLS);
+
+	size_t size = sizeof(struct future) +
+		length * (sizeof(struct future_chain_entry) + sizeof(fut));
+	void *buf = malloc(size);
+	if (buf == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	size_t nchains = cfg->ops / length;
+	if (nchains == 0)
+		nchains = 1;
+
+	uint64_t elapsed = 0;
+	for (size_t c = 0; c < nchains; c++) {
+		struct future_chain_arena arena;
+		if (future_chain_arena_init(&arena, buf, size) != 0)
+			goto fail;
+		for (size_t i = 0; i < length; i++) {
+			if (FUTURE_CHAIN_ARENA_APPEND(&arena, &fut,
+				bench_noop_map, NULL) == NULL)
+				goto fail;
+		}
+
+		uint64_t start = bench_now();
+		while (future_poll(arena.chain, NULL) !=
+			FUTURE_STATE_COMPLETE)
+			;
+		elapsed += bench_now() - start;
+	}
+
+	free(buf);
+
+	*ops = nchains * length;
+	return elapsed;
+
+fail:
+	fprintf(stderr, "the chain does not fit in the arena\n");
+	exit(1);
+}
+
+/*
+ * bench_wait_multiple -- measures a runtime_wait_multiple() call on nfuts
+ * futures
+ */
+static uint64_t
+bench_wait_multiple(struct runtime *r, size_t nfuts, size_t *ops)
+{
+	struct bench_count_fut *futs = malloc(nfuts * sizeof(*futs));
+	struct future **ptrs = malloc(nfuts * sizeof(*ptrs));
+	if (futs == NULL || ptrs == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	for (size_t i = 0; i < nfuts; i++) {
+		bench_count_init(&futs[i], BENCH_COUNT_POLLS);
+		ptrs[i] = FUTURE_AS_RUNNABLE(&futs[i]);
+	}
+
+	uint64_t start = bench_now();
+	runtime_wait_multiple(r, ptrs, nfuts);
+	uint64_t elapsed = bench_now() - start;
+
+	free(ptrs);
+	free(futs);
+
+	*ops = nfuts;
+	return elapsed;
+}
+
+/*
+ * bench_wake -- measures the latencies of the wakes after the delay
+ */
+static int
+bench_wake(const struct bench_config *cfg, struct runtime *r,
+	size_t delay_us, uint64_t *latencies)
+{
+	struct bench_wake_shared shared;
+	memset(&shared, 0, sizeof(shared));
+	shared.delay = (uint64_t)delay_us * 1000;
+	shared.samples = cfg->samples;
+
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, bench_wake_thread, &shared) != 0)
+		return -1;
+
+	for (size_t i = 0; i < cfg->samples; i++) {
+		struct bench_wake_fut fut;
+		FUTURE_INIT(&fut, bench_wake_impl);
+		fut.data.shared = &shared;
+		fut.data.armed = 0;
+		fut.output.latency = 0;
+
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+		latencies[i] = fut.output.latency;
+
+		/* the waker is not called on a future that's gone */
+		uint64_t done;
+		do {
+			util_atomic_load_explicit64(&shared.done, &done,
+				memory_order_acquire);
+		} while (!done);
+		util_atomic_store_explicit64(&shared.done, 0,
+			memory_order_relaxed);
+		util_atomic_store_explicit64(&shared.woken_at, 0,
+			memory_order_relaxed);
+	}
+
+	pthread_join(thread, NULL);
+
+	return 0;
+}
+
+/*
+ * bench_print_header -- prints the header of the CSV output
+ */
+static void
+bench_print_header(const struct bench_config *cfg)
+{
+	if (cfg->format != BENCH_FORMAT_CSV)
+		return;
+
+	printf("benchmark,param,samples,ops,ns_min,ns_p50,ns_p90,ns_p99,"
+		"ns_max,ops_per_sec\n");
+}
+
+/*
+ * bench_print -- prints the record of the nanoseconds per operation of
+ * the samples
+ */
+static void
+bench_print(const struct bench_config *cfg, enum bench_type type,
+	size_t param, size_t ops, uint64_t *ns, size_t nsamples)
+{
+	bench_sort(ns, nsamples);
+
+	uint64_t p50 = bench_percentile(ns, nsamples, 50.0);
+	double ops_per_sec = p50 == 0 ? 0.0 : 1e9 / (double)p50;
+	const char *fmt = cfg->format == BENCH_FORMAT_CSV ?
+		"%s,%zu,%zu,%zu,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+		",%" PRIu64 ",%.1f\n" :
+		"{\"benchmark\":\"%s\",\"param\":%zu,\"samples\":%zu,"
+		"\"ops\":%zu,\"ns_min\":%" PRIu64 ",\"ns_p50\":%" PRIu64 ","
+		"\"ns_p90\":%" PRIu64 ",\"ns_p99\":%" PRIu64 ","
+		"\"ns_max\":%" PRIu64 ",\"ops_per_sec\":%.1f}\n";
+
+	printf(fmt, bench_names[type], param, nsamples, ops, ns[0], p50,
+		bench_percentile(ns, nsamples, 90.0),
+		bench_percentile(ns, nsamples, 99.0), ns[nsamples - 1],
+		ops_per_sec);
+	fflush(stdout);
+}
+
+/*
+ * bench_run -- runs the samples of the benchmark with the parameter
+ */
+static int
+bench_run(const struct bench_config *cfg, struct runtime *r,
+	enum bench_type type, size_t param, uint64_t *ns)
+{
+	if (type == BENCH_WAKE) {
+		if (bench_wake(cfg, r, param, ns) != 0)
+			return -1;
+		bench_print(cfg, type, param, 1, ns, cfg->samples);
+		return 0;
+	}
+
+	size_t ops = 0;
+	for (size_t i = 0; i < cfg->samples; i++) {
+		uint64_t elapsed;
+		switch (type) {
+			case BENCH_POLL:
+				elapsed = bench_poll(cfg, param, &ops);
+				break;
+			case BENCH_CHAIN:
+				elapsed = bench_chain(cfg, param, &ops);
+				break;
+			case BENCH_WAIT_MULTIPLE:
+				elapsed = bench_wait_multiple(r, param, &ops);
+				break;
+			default:
+				return -1;
+		}
+		ns[i] = elapsed / ops;
+	}
+	bench_print(cfg, type, param, ops, ns, cfg->samples);
+
+	return 0;
+}
+
+/*
+ * bench_usage -- prints the usage of the benchmark
+ */
+static void
+bench_usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -b benchmarks  poll,chain,wait_multiple,wake (all)\n"
+		"  -c lengths     lengths of the chains (1,4,16,64,256,1024)\n"
+		"  -w nfuts       futures waited for together "
+		"(1,10,100,1K,10K,100K)\n"
+		"  -d delays      microseconds before the wakes (0,1000)\n"
+		"  -n samples     samples of each parameter (100)\n"
+		"  -i ops         operations in a sample of the poll and chain "
+		"benchmarks (100000)\n"
+		"  -f format      csv or json (csv)\n", name);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct bench_config cfg = {
+		.benchmarks = {1, 1, 1, 1},
+		.lengths = {1, 4, 16, 64, 256, 1024},
+		.nlengths = 6,
+		.nfuts = {1, 10, 100, 1000, 10000, 100000},
+		.nnfuts = 6,
+		.delays = {0, 1000},
+		.ndelays = 2,
+		.samples = 100,
+		.ops = 100000,
+		.format = BENCH_FORMAT_CSV,
+	};
+
+	int opt;
+	while ((opt = getopt(argc, argv, "b:c:w:d:n:i:f:h")) != -1) {
+		int ret = 0;
+		switch (opt) {
+			case 'b':
+				ret = bench_parse_names(optarg, bench_names,
+					MAX_BENCH, cfg.benchmarks);
+				break;
+			case 'c':
+				ret = bench_parse_sizes(optarg, cfg.lengths,
+					&cfg.nlengths);
+				break;
+			case 'w':
+				ret = bench_parse_sizes(optarg, cfg.nfuts,
+					&cfg.nnfuts);
+				break;
+			case 'd':
+				ret = bench_parse_sizes(optarg, cfg.delays,
+					&cfg.ndelays);
+				break;
+			case 'n':
+				ret = bench_parse_size(optarg, &cfg.samples);
+				break;
+			case 'i':
+				ret = bench_parse_size(optarg, &cfg.ops);
+				break;
+			case 'f':
+				ret = bench_parse_format(optarg, &cfg.format);
+				break;
+			default:
+				ret = -1;
+				break;
+		}
+
+		if (ret != 0) {
+			bench_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (!bench_nonzero(cfg.lengths, cfg.nlengths) ||
+		!bench_nonzero(cfg.nfuts, cfg.nnfuts) ||
+		!bench_nonzero(&cfg.samples, 1) ||
+		!bench_nonzero(&cfg.ops, 1)) {
+		bench_usage(argv[0]);
+		return 1;
+	}
+
+	uint64_t *ns = malloc(cfg.samples * sizeof(*ns));
+	struct runtime *r = runtime_new();
+	if (ns == NULL || r == NULL) {
+		fprintf(stderr, "cannot create the runtime\n");
+		free(ns);
+		return 1;
+	}
+
+	bench_print_header(&cfg);
+
+	int ret = 0;
+	for (enum bench_type type = 0; type < MAX_BENCH; type++) {
+		if (!cfg.benchmarks[type])
+			continue;
+
+		const size_t *params = NULL;
+		size_t nparams = 1;
+		if (type == BENCH_CHAIN) {
+			params = cfg.lengths;
+			nparams = cfg.nlengths;
+		} else if (type == BENCH_WAIT_MULTIPLE) {
+			params = cfg.nfuts;
+			nparams = cfg.nnfuts;
+		} else if (type == BENCH_WAKE) {
+			params = cfg.delays;
+			nparams = cfg.ndelays;
+		}
+
+		for (size_t i = 0; i < nparams; i++) {
+			ret = bench_run(&cfg, r, type,
+				params != NULL ? params[i] : 0, ns);
+			if (ret != 0) {
+				fprintf(stderr, "cannot run the %s benchmark\n",
+					bench_names[type]);
+				goto out;
+			}
+		}
+	}
+
+out:
+	runtime_delete(r);
+	free(ns);
+
+	return ret == 0 ? 0 : 1;
+}
@@ -90,17 +90,6 @@ memcpy_to_print_map(struct future_context *memcpy_ctx,
 	assert(arg == (void *)0xd);
 }
 
-static void
-print_to_output_map(struct future_context *print_ctx,
-		    struct future_context *chained_ctx, void *arg)
-{
-	struct async_print_output *print = future_context_get_output(print_ctx);
-	struct async_memcpy_print_output *chained =
-		future_context_get_output(chained_ctx);
-
-	chained->return_code = print->return_code;
-}
-
 /* It defines how to create 'async_memcpy_print_fut' future */
 static struct async_memcpy_print_fut
 async_memcpy_print(struct vdm *vdm, void *dest, void *src, size_t n)
@@ -110,7 +99,9 @@ async_memcpy_print(struct vdm *vdm, void *dest, void *src, size_t n)
 				vdm_memcpy(vdm, dest, src, n, 0),
 				memcpy_to_print_map, (void *)0xd);
 	FUTURE_CHAIN_ENTRY_INIT(&chain.data.print, async_print(NULL),
-				print_to_output_map, NULL);
+				NULL, NULL);
+	/* the output of 'print' is the output of the whole chain */
+	FUTURE_CHAIN_ENTRY_BIND_OUTPUT(&chain.data.print, &chain, return_code);
 
 	FUTURE_CHAIN_INIT(&chain);
 
@@ -5,9 +5,15 @@
 #include <libminiasync.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "core/fileops.h"
 #include "core/membuf.h"
+#include "core/memops.h"
+#include "core/os.h"
+#include "core/os_thread.h"
 #include "core/out.h"
+#include "core/util.h"
 #include "libminiasync-vdm-dml.h"
 
 #define SUPPORTED_FLAGS VDM_F_MEM_DURABLE | VDM_F_NO_CACHE_HINT
@@ -18,12 +24,110 @@
  */
 #define DSA_F_DESTINATION_READBACK (1 < 14)
 
+/* the deleted operations kept by a thread, with their jobs initialized */
+#define DATA_MOVER_DML_POOL_SIZE 64
+
+/* the sizes of the copies timed by the calibration of the cpu threshold */
+#define DATA_MOVER_DML_CALIBRATE_MIN 64
+#define DATA_MOVER_DML_CALIBRATE_MAX ((size_t)1 << 18)
+#define DATA_MOVER_DML_CALIBRATE_ROUNDS 16
+
+/* the buffers are touched at this stride, no page is smaller */
+#define DATA_MOVER_DML_PREFAULT_STRIDE 4096
+
+/* how long the waker thread sleeps between the checks of the jobs */
+#define DATA_MOVER_DML_WAKER_SLEEP_MIN 1000 /* ns */
+#define DATA_MOVER_DML_WAKER_SLEEP_MAX 100000 /* ns */
+
+struct data_mover_dml_data;
+
+/*
+ * Initializing and finalizing a job costs more than a small copy, so
+ * the operations allocated by op_new aren't freed when they're deleted,
+ * but reused by the next op_new of the same thread. Each thread has a pool
+ * of its own, only the list of all of them is shared.
+ */
+struct data_mover_dml_pool {
+	struct data_mover_dml_data *head;
+	size_t n;
+	struct data_mover_dml_pool *next;
+};
+
 struct data_mover_dml {
 	struct vdm base; /* must be first */
 	dml_path_t path;
+	uint32_t job_size; /* 0 - unknown, the operations can't be created */
 	struct membuf *membuf;
+
+	/*
+	 * The jobs go to the devices of the NUMA node of the submitting thread,
+	 * or round-robin to the ones of the selected nodes. DML balances
+	 * them among the work queues of the devices of the node.
+	 */
+	int nodes[DATA_MOVER_DML_MAX_NODES];
+	uint64_t nnodes; /* 0 - the node of the submitting thread */
+	uint64_t next_node;
+
+	/* smaller operations are performed on the cpu, no job is submitted */
+	size_t cpu_threshold;
+	enum data_mover_dml_fault_policy fault_policy;
+	uint64_t fault_flags; /* added to the flags of every job and task */
+
+	os_tls_key_t pool_key; /* pool of the calling thread */
+	os_mutex_t pools_lock;
+	struct data_mover_dml_pool *pools;
+
+	/*
+	 * The jobs of the operations of at least waker_threshold bytes are
+	 * checked by the waker thread, which wakes their futures once they
+	 * complete, so that the runtime can sleep meanwhile.
+	 */
+	size_t waker_threshold; /* 0 - the futures aren't woken */
+	int waker_running;
+	int waker_stop;
+	os_thread_t waker_thread;
+	os_mutex_t waker_lock;
+	os_cond_t waker_cond;
+	struct data_mover_dml_data *waiting; /* checked by the waker thread */
+};
+
+/*
+ * The memory moves started together are submitted as the tasks of a single
+ * batch job, which completes all of them at once. The batch job and its task
+ * descriptors are shared by the operations, the last one deleted frees them.
+ */
+struct data_mover_dml_batch {
+	uint64_t nrefs;
+	dml_job_t *job; /* in the next cache line, followed by the tasks */
+};
+
+/*
+ * The job of an operation follows its data, in the next cache line. Jobs
+ * which can't be offloaded, or are below the cpu threshold, are performed
+ * on the cpu when started, their output is kept for the deletion of
+ * the operation and the job is left a no-op, which isn't submitted.
+ */
+struct data_mover_dml_data {
+	struct data_mover_dml *dmd;
+	int in_membuf; /* allocated by op_new, not in the caller's storage */
+	dml_job_t *job;
+	union {
+		/* submitted instead of the job, if not NULL */
+		struct data_mover_dml_batch *batch;
+		struct data_mover_dml_data *next_pooled; /* while pooled */
+	} u;
+	uint32_t crc; /* seed and result of the CRC-32C job */
+	int on_cpu; /* performed on the cpu, the job isn't submitted */
+	struct vdm_operation_output output; /* of the cpu operations */
+	int watched; /* the future is woken by the waker thread */
+	int waiting; /* on the waiting list, under the waker lock */
+	struct data_mover_dml_data *next_waiting;
+	struct future_waker waker;
 };
 
+#define DATA_MOVER_DML_DATA_SIZE ALIGN_UP(sizeof(struct data_mover_dml_data), \
+	(size_t)MEMBUF_CACHELINE_SIZE)
+
 /*
  * data_mover_dml_translate_flags -- translate miniasync-vdm-dml flags
  */
@@ -58,6 +162,17 @@ data_mover_dml_translate_flags(uint64_t flags, uint64_t *dml_flags)
 	}
 }
 
+/*
+ * data_mover_dml_memops_flags -- (internal) translates the vdm operation
+ * flags for the cpu routines
+ */
+static unsigned
+data_mover_dml_memops_flags(uint64_t flags)
+{
+	return ((flags & VDM_F_MEM_DURABLE) ? MEMOPS_F_DURABLE : 0) |
+		((flags & VDM_F_NO_CACHE_HINT) ? MEMOPS_F_NO_CACHE : 0);
+}
+
 /*
  * data_mover_dml_memcpy_job_init -- initializes new memcpy dml job
  */
@@ -145,6 +260,540 @@ data_mover_dml_flush_job_init(dml_job_t *dml_job,
 	return dml_job;
 }
 
+/*
+ * data_mover_dml_memcpy_v_job_init -- initializes new dml batch job, with
+ * one memory move task per fragment of the vectored memcpy, returns NULL
+ * if the batch can't be created
+ */
+static dml_job_t *
+data_mover_dml_memcpy_v_job_init(struct data_mover_dml_data *ddata,
+	const struct vdm_operation_data_memcpy_v *mdata)
+{
+	struct data_mover_dml *vdm_dml = ddata->dmd;
+	dml_job_t *dml_job = ddata->job;
+
+	/* a batch has at least two tasks, a single fragment doesn't need it */
+	if (mdata->cnt == 1) {
+		size_t n = mdata->src[0].iov_len < mdata->dest[0].iov_len ?
+			mdata->src[0].iov_len : mdata->dest[0].iov_len;
+		return data_mover_dml_memcpy_job_init(dml_job,
+			mdata->dest[0].iov_base, mdata->src[0].iov_base, n,
+			mdata->flags);
+	}
+
+	dml_job->operation = DML_OP_NOP;
+	dml_job->flags = 0;
+	if (mdata->cnt == 0)
+		return dml_job;
+	if (mdata->cnt > UINT32_MAX)
+		return NULL;
+
+	uint32_t batch_size;
+	if (dml_get_batch_size(dml_job, (uint32_t)mdata->cnt,
+			&batch_size) != DML_STATUS_OK)
+		return NULL;
+
+	uint8_t *batch = membuf_alloc_aligned(vdm_dml->membuf, batch_size,
+		MEMBUF_CACHELINE_SIZE);
+	if (batch == NULL)
+		return NULL;
+
+	uint64_t dml_flags = 0;
+	data_mover_dml_translate_flags(mdata->flags, &dml_flags);
+	dml_flags |= vdm_dml->fault_flags;
+
+	dml_job->operation = DML_OP_BATCH;
+	dml_job->destination_first_ptr = batch;
+	dml_job->destination_length = batch_size;
+	dml_job->flags = 0;
+
+	for (uint32_t i = 0; i < (uint32_t)mdata->cnt; ++i) {
+		size_t n = mdata->src[i].iov_len < mdata->dest[i].iov_len ?
+			mdata->src[i].iov_len : mdata->dest[i].iov_len;
+		if (n > UINT32_MAX ||
+		    dml_batch_set_mem_move_by_index(dml_job, i,
+				(uint8_t *)mdata->src[i].iov_base,
+				(uint8_t *)mdata->dest[i].iov_base,
+				(uint32_t)n, DML_FLAG_COPY_ONLY | dml_flags) !=
+				DML_STATUS_OK) {
+			dml_job->operation = DML_OP_NOP;
+			membuf_free(batch);
+			return NULL;
+		}
+	}
+
+	return dml_job;
+}
+
+/*
+ * data_mover_dml_memcpy_v_fallback -- performs the vectored memcpy on
+ * the cpu, if it can't be offloaded, the job is left to be a no-op
+ */
+static void
+data_mover_dml_memcpy_v_fallback(
+	const struct vdm_operation_data_memcpy_v *mdata)
+{
+	unsigned flags = data_mover_dml_memops_flags(mdata->flags);
+
+	for (size_t i = 0; i < mdata->cnt; ++i) {
+		size_t n = mdata->src[i].iov_len < mdata->dest[i].iov_len ?
+			mdata->src[i].iov_len : mdata->dest[i].iov_len;
+		memops_memcpy(mdata->dest[i].iov_base, mdata->src[i].iov_base,
+			n, flags);
+	}
+}
+
+/*
+ * data_mover_dml_compare_job_init -- initializes new compare dml job
+ */
+static dml_job_t *
+data_mover_dml_compare_job_init(dml_job_t *dml_job,
+	const struct vdm_operation_data_compare *mdata)
+{
+	uint64_t dml_flags = 0;
+	data_mover_dml_translate_flags(mdata->flags, &dml_flags);
+
+	dml_job->operation = DML_OP_COMPARE;
+	dml_job->source_first_ptr = (uint8_t *)mdata->src1;
+	dml_job->source_second_ptr = (uint8_t *)mdata->src2;
+	dml_job->source_length = mdata->n;
+	dml_job->flags = dml_flags;
+
+	return dml_job;
+}
+
+/*
+ * data_mover_dml_compare_pattern_job_init -- initializes new compare
+ * pattern dml job
+ */
+static dml_job_t *
+data_mover_dml_compare_pattern_job_init(dml_job_t *dml_job,
+	const struct vdm_operation_data_compare_pattern *mdata)
+{
+	uint64_t dml_flags = 0;
+	data_mover_dml_translate_flags(mdata->flags, &dml_flags);
+
+	dml_job->operation = DML_OP_COMPARE_PATTERN;
+	dml_job->source_first_ptr = (uint8_t *)mdata->src;
+	dml_job->source_length = mdata->n;
+	dml_job->flags = dml_flags;
+	memcpy(dml_job->pattern, &mdata->pattern, sizeof(mdata->pattern));
+
+	return dml_job;
+}
+
+/*
+ * data_mover_dml_crc32c_job_init -- initializes new CRC-32C dml job,
+ * the checksum is continued from the seed, like the cpu one
+ */
+static dml_job_t *
+data_mover_dml_crc32c_job_init(struct data_mover_dml_data *ddata,
+	const struct vdm_operation_data_crc32c *mdata)
+{
+	dml_job_t *dml_job = ddata->job;
+	uint64_t dml_flags = 0;
+	data_mover_dml_translate_flags(mdata->flags, &dml_flags);
+
+	ddata->crc = mdata->seed;
+	dml_job->operation = DML_OP_CRC;
+	dml_job->source_first_ptr = (uint8_t *)mdata->src;
+	dml_job->source_length = mdata->n;
+	dml_job->crc_checksum_ptr = &ddata->crc;
+	dml_job->flags = dml_flags | DML_FLAG_CRC_READ_SEED;
+
+	return dml_job;
+}
+
+/*
+ * data_mover_dml_nop_job_init -- initializes new no-op dml job, for
+ * the operations already performed on the cpu
+ */
+static dml_job_t *
+data_mover_dml_nop_job_init(struct data_mover_dml_data *ddata,
+	enum vdm_operation_result result)
+{
+	ddata->on_cpu = 1;
+	ddata->output.result = result;
+	ddata->job->operation = DML_OP_NOP;
+	ddata->job->flags = 0;
+
+	return ddata->job;
+}
+
+/*
+ * data_mover_dml_dualcast_job_init -- initializes new dualcast dml job,
+ * the destinations which DSA can't write at once are copied on the cpu
+ */
+static dml_job_t *
+data_mover_dml_dualcast_job_init(struct data_mover_dml_data *ddata,
+	const struct vdm_operation_data_dualcast *mdata)
+{
+	dml_job_t *dml_job = ddata->job;
+	uint64_t dml_flags = 0;
+	data_mover_dml_translate_flags(mdata->flags, &dml_flags);
+
+	/* both destinations have to be at the same offset within a page */
+	uintptr_t offsets = (uintptr_t)mdata->dest1 ^ (uintptr_t)mdata->dest2;
+	if ((offsets & 0xfff) != 0) {
+		unsigned flags = data_mover_dml_memops_flags(mdata->flags);
+		memops_memcpy(mdata->dest1, mdata->src, mdata->n, flags);
+		memops_memcpy(mdata->dest2, mdata->src, mdata->n, flags);
+		ddata->output.output.dualcast.dest1 = mdata->dest1;
+		ddata->output.output.dualcast.dest2 = mdata->dest2;
+		return data_mover_dml_nop_job_init(ddata, VDM_SUCCESS);
+	}
+
+	dml_job->operation = DML_OP_DUALCAST;
+	dml_job->source_first_ptr = (uint8_t *)mdata->src;
+	dml_job->destination_first_ptr = (uint8_t *)mdata->dest1;
+	dml_job->destination_second_ptr = (uint8_t *)mdata->dest2;
+	dml_job->source_length = mdata->n;
+	dml_job->flags = dml_flags;
+
+	return dml_job;
+}
+
+/*
+ * data_mover_dml_delta_create_job_init -- initializes new delta record
+ * create dml job, the buffers DSA doesn't accept fail the operation
+ */
+static dml_job_t *
+data_mover_dml_delta_create_job_init(struct data_mover_dml_data *ddata,
+	const struct vdm_operation_data_delta_create *mdata)
+{
+	dml_job_t *dml_job = ddata->job;
+	uint64_t dml_flags = 0;
+	data_mover_dml_translate_flags(mdata->flags, &dml_flags);
+
+	if (mdata->n % sizeof(uint64_t) != 0 || mdata->n > VDM_DELTA_MAX_SIZE) {
+		ddata->output.output.delta_create.result = VDM_DELTA_EQUAL;
+		ddata->output.output.delta_create.delta_size = 0;
+		return data_mover_dml_nop_job_init(ddata,
+			VDM_ERROR_JOB_CORRUPTED);
+	}
+
+	dml_job->operation = DML_OP_DELTA_CREATE;
+	dml_job->source_first_ptr = (uint8_t *)mdata->original;
+	dml_job->source_second_ptr = (uint8_t *)mdata->modified;
+	dml_job->source_length = mdata->n;
+	dml_job->destination_first_ptr = (uint8_t *)mdata->delta;
+	/* DSA writes whole entries only */
+	dml_job->destination_length = mdata->delta_max -
+		mdata->delta_max % VDM_DELTA_ENTRY_SIZE;
+	dml_job->flags = dml_flags;
+
+	return dml_job;
+}
+
+/*
+ * data_mover_dml_delta_apply_job_init -- initializes new delta record
+ * apply dml job, the records DSA doesn't accept fail the operation
+ */
+static dml_job_t *
+data_mover_dml_delta_apply_job_init(struct data_mover_dml_data *ddata,
+	const struct vdm_operation_data_delta_apply *mdata)
+{
+	dml_job_t *dml_job = ddata->job;
+	uint64_t dml_flags = 0;
+	data_mover_dml_translate_flags(mdata->flags, &dml_flags);
+
+	if (mdata->delta_size % VDM_DELTA_ENTRY_SIZE != 0 ||
+	    mdata->n > VDM_DELTA_MAX_SIZE) {
+		ddata->output.output.delta_apply.dest = mdata->dest;
+		return data_mover_dml_nop_job_init(ddata,
+			VDM_ERROR_JOB_CORRUPTED);
+	}
+
+	dml_job->operation = DML_OP_DELTA_APPLY;
+	dml_job->source_first_ptr = (uint8_t *)mdata->delta;
+	dml_job->source_length = mdata->delta_size;
+	dml_job->destination_first_ptr = (uint8_t *)mdata->dest;
+	dml_job->destination_length = mdata->n;
+	dml_job->flags = dml_flags;
+
+	return dml_job;
+}
+
+/*
+ * data_mover_dml_memfill_job_init -- initializes new memfill dml job,
+ * the patterns wider than the 8 bytes of the DSA ones are filled on the cpu
+ */
+static dml_job_t *
+data_mover_dml_memfill_job_init(struct data_mover_dml_data *ddata,
+	const struct vdm_operation_data_memfill *mdata)
+{
+	dml_job_t *dml_job = ddata->job;
+	uint64_t dml_flags = 0;
+	data_mover_dml_translate_flags(mdata->flags, &dml_flags);
+
+	ddata->output.output.memfill.dest = mdata->dest;
+	if (!util_is_pow2(mdata->pattern_len) ||
+	    mdata->pattern_len > VDM_MEMFILL_MAX_PATTERN)
+		return data_mover_dml_nop_job_init(ddata,
+			VDM_ERROR_JOB_CORRUPTED);
+
+	if (mdata->pattern_len > sizeof(dml_job->pattern)) {
+		unsigned flags = data_mover_dml_memops_flags(mdata->flags);
+		memops_memfill(mdata->dest, mdata->pattern,
+			mdata->pattern_len, mdata->n, flags);
+		return data_mover_dml_nop_job_init(ddata, VDM_SUCCESS);
+	}
+
+	dml_job->operation = DML_OP_FILL;
+	dml_job->destination_first_ptr = (uint8_t *)mdata->dest;
+	dml_job->destination_length = mdata->n;
+	dml_job->flags = dml_flags;
+
+	/* the shorter patterns are repeated in the 8-byte one */
+	const uint8_t *pattern = mdata->pattern;
+	for (size_t i = 0; i < sizeof(dml_job->pattern); i++)
+		dml_job->pattern[i] = pattern[i % mdata->pattern_len];
+
+	return dml_job;
+}
+
+/*
+ * data_mover_dml_cpu_perform -- (internal) performs the operation on the cpu
+ * and leaves the job a no-op, returns -1 for the delta record ones, which
+ * are always offloaded
+ */
+static int
+data_mover_dml_cpu_perform(struct data_mover_dml_data *ddata,
+	const struct vdm_operation *operation)
+{
+	struct vdm_operation_output *output = &ddata->output;
+
+	switch (operation->type) {
+		case VDM_OPERATION_MEMCPY: {
+			const struct vdm_operation_data_memcpy *mdata =
+				&operation->data.memcpy;
+			memops_memcpy(mdata->dest, mdata->src, mdata->n,
+				data_mover_dml_memops_flags(mdata->flags));
+			output->output.memcpy.dest = mdata->dest;
+		} break;
+		case VDM_OPERATION_MEMMOVE: {
+			const struct vdm_operation_data_memmove *mdata =
+				&operation->data.memmove;
+			memops_memmove(mdata->dest, mdata->src, mdata->n,
+				data_mover_dml_memops_flags(mdata->flags));
+			output->output.memmove.dest = mdata->dest;
+		} break;
+		case VDM_OPERATION_MEMSET: {
+			const struct vdm_operation_data_memset *mdata =
+				&operation->data.memset;
+			memops_memset(mdata->str, mdata->c, mdata->n,
+				data_mover_dml_memops_flags(mdata->flags));
+			output->output.memset.str = mdata->str;
+		} break;
+		case VDM_OPERATION_FLUSH:
+			memops_flush(operation->data.flush.dest,
+				operation->data.flush.n);
+			output->output.flush.unused = 0;
+			break;
+		case VDM_OPERATION_MEMCPY_V:
+			data_mover_dml_memcpy_v_fallback(
+				&operation->data.memcpy_v);
+			output->output.memcpy_v.n =
+				vdm_memcpy_v_size(&operation->data.memcpy_v);
+			break;
+		case VDM_OPERATION_COMPARE: {
+			const struct vdm_operation_data_compare *mdata =
+				&operation->data.compare;
+			output->output.compare.offset = memops_compare(
+				mdata->src1, mdata->src2, mdata->n);
+			output->output.compare.result =
+				output->output.compare.offset != mdata->n;
+		} break;
+		case VDM_OPERATION_COMPARE_PATTERN: {
+			const struct vdm_operation_data_compare_pattern *mdata =
+				&operation->data.compare_pattern;
+			output->output.compare_pattern.offset =
+				memops_compare_pattern(mdata->src,
+					mdata->pattern, mdata->n);
+			output->output.compare_pattern.result =
+				output->output.compare_pattern.offset !=
+				mdata->n;
+		} break;
+		case VDM_OPERATION_CRC32C: {
+			const struct vdm_operation_data_crc32c *mdata =
+				&operation->data.crc32c;
+			output->output.crc32c.crc = memops_crc32c(mdata->seed,
+				mdata->src, mdata->n);
+		} break;
+		case VDM_OPERATION_DUALCAST: {
+			const struct vdm_operation_data_dualcast *mdata =
+				&operation->data.dualcast;
+			unsigned flags =
+				data_mover_dml_memops_flags(mdata->flags);
+			memops_memcpy(mdata->dest1, mdata->src, mdata->n,
+				flags);
+			memops_memcpy(mdata->dest2, mdata->src, mdata->n,
+				flags);
+			output->output.dualcast.dest1 = mdata->dest1;
+			output->output.dualcast.dest2 = mdata->dest2;
+		} break;
+		case VDM_OPERATION_MEMFILL: {
+			const struct vdm_operation_data_memfill *mdata =
+				&operation->data.memfill;
+			output->output.memfill.dest = mdata->dest;
+			if (memops_memfill(mdata->dest, mdata->pattern,
+					mdata->pattern_len, mdata->n,
+					data_mover_dml_memops_flags(
+					mdata->flags)) != 0) {
+				data_mover_dml_nop_job_init(ddata,
+					VDM_ERROR_JOB_CORRUPTED);
+				return 0;
+			}
+		} break;
+		case VDM_OPERATION_PREAD:
+		case VDM_OPERATION_PWRITE:
+			output->result = VDM_SUCCESS;
+			fileops_perform(operation, output);
+			data_mover_dml_nop_job_init(ddata, output->result);
+			return 0;
+		default:
+			return -1;
+	}
+
+	data_mover_dml_nop_job_init(ddata, VDM_SUCCESS);
+
+	return 0;
+}
+
+/*
+ * data_mover_dml_prefault_range -- (internal) touches every page
+ * of the buffer, the ones to be written by the job are written
+ */
+static void
+data_mover_dml_prefault_range(const void *addr, size_t n, int write)
+{
+	if (n == 0)
+		return;
+
+	volatile char *p = (volatile char *)addr;
+	for (size_t off = 0; off < n; off += DATA_MOVER_DML_PREFAULT_STRIDE) {
+		char c = p[off];
+		if (write)
+			p[off] = c;
+	}
+	char c = p[n - 1];
+	if (write)
+		p[n - 1] = c;
+}
+
+/*
+ * data_mover_dml_prefault -- (internal) faults in the pages of the buffers
+ * of the operation, so that the device doesn't have to
+ */
+static void
+data_mover_dml_prefault(const struct vdm_operation *op)
+{
+	switch (op->type) {
+		case VDM_OPERATION_MEMCPY:
+			data_mover_dml_prefault_range(op->data.memcpy.src,
+				op->data.memcpy.n, 0);
+			data_mover_dml_prefault_range(op->data.memcpy.dest,
+				op->data.memcpy.n, 1);
+			break;
+		case VDM_OPERATION_MEMMOVE:
+			data_mover_dml_prefault_range(op->data.memmove.src,
+				op->data.memmove.n, 0);
+			data_mover_dml_prefault_range(op->data.memmove.dest,
+				op->data.memmove.n, 1);
+			break;
+		case VDM_OPERATION_MEMSET:
+			data_mover_dml_prefault_range(op->data.memset.str,
+				op->data.memset.n, 1);
+			break;
+		case VDM_OPERATION_FLUSH:
+			data_mover_dml_prefault_range(op->data.flush.dest,
+				op->data.flush.n, 0);
+			break;
+		case VDM_OPERATION_MEMCPY_V:
+			for (size_t i = 0; i < op->data.memcpy_v.cnt; ++i) {
+				data_mover_dml_prefault_range(
+					op->data.memcpy_v.src[i].iov_base,
+					op->data.memcpy_v.src[i].iov_len, 0);
+				data_mover_dml_prefault_range(
+					op->data.memcpy_v.dest[i].iov_base,
+					op->data.memcpy_v.dest[i].iov_len, 1);
+			}
+			break;
+		case VDM_OPERATION_COMPARE:
+			data_mover_dml_prefault_range(op->data.compare.src1,
+				op->data.compare.n, 0);
+			data_mover_dml_prefault_range(op->data.compare.src2,
+				op->data.compare.n, 0);
+			break;
+		case VDM_OPERATION_COMPARE_PATTERN:
+			data_mover_dml_prefault_range(
+				op->data.compare_pattern.src,
+				op->data.compare_pattern.n, 0);
+			break;
+		case VDM_OPERATION_CRC32C:
+			data_mover_dml_prefault_range(op->data.crc32c.src,
+				op->data.crc32c.n, 0);
+			break;
+		case VDM_OPERATION_DUALCAST:
+			data_mover_dml_prefault_range(op->data.dualcast.src,
+				op->data.dualcast.n, 0);
+			data_mover_dml_prefault_range(op->data.dualcast.dest1,
+				op->data.dualcast.n, 1);
+			data_mover_dml_prefault_range(op->data.dualcast.dest2,
+				op->data.dualcast.n, 1);
+			break;
+		case VDM_OPERATION_DELTA_CREATE:
+			data_mover_dml_prefault_range(
+				op->data.delta_create.original,
+				op->data.delta_create.n, 0);
+			data_mover_dml_prefault_range(
+				op->data.delta_create.modified,
+				op->data.delta_create.n, 0);
+			data_mover_dml_prefault_range(
+				op->data.delta_create.delta,
+				op->data.delta_create.delta_max, 1);
+			break;
+		case VDM_OPERATION_DELTA_APPLY:
+			data_mover_dml_prefault_range(
+				op->data.delta_apply.delta,
+				op->data.delta_apply.delta_size, 0);
+			data_mover_dml_prefault_range(op->data.delta_apply.dest,
+				op->data.delta_apply.n, 1);
+			break;
+		case VDM_OPERATION_MEMFILL:
+			data_mover_dml_prefault_range(op->data.memfill.dest,
+				op->data.memfill.n, 1);
+			break;
+		default:
+			ASSERT(0);
+	}
+}
+
+/*
+ * data_mover_dml_recoverable -- (internal) returns if the operation can be
+ * performed again on the cpu, after its job failed part way through
+ */
+static int
+data_mover_dml_recoverable(const struct vdm_operation *operation)
+{
+	switch (operation->type) {
+		case VDM_OPERATION_MEMMOVE: {
+			/* the overlapping source may be already overwritten */
+			const struct vdm_operation_data_memmove *mdata =
+				&operation->data.memmove;
+			uintptr_t dest = (uintptr_t)mdata->dest;
+			uintptr_t src = (uintptr_t)mdata->src;
+			size_t n = mdata->n;
+			return !(dest < src + n && src < dest + n);
+		}
+		case VDM_OPERATION_DELTA_CREATE:
+		case VDM_OPERATION_DELTA_APPLY:
+			return 0;
+		default:
+			return 1;
+	}
+}
+
 /*
  * data_mover_dml_job_delete -- delete job struct
  */
@@ -154,6 +803,28 @@ data_mover_dml_job_delete(dml_job_t **dml_job)
 	dml_finalize_job(*dml_job);
 }
 
+/*
+ * data_mover_dml_node -- (internal) returns the NUMA node of the devices,
+ * to which the next job of the calling thread is submitted
+ */
+static uint32_t
+data_mover_dml_node(struct data_mover_dml *vdm_dml)
+{
+	uint64_t nnodes;
+	util_atomic_load_explicit64(&vdm_dml->nnodes, &nnodes,
+		memory_order_acquire);
+	if (nnodes == 0) {
+		int node = util_numa_node_current();
+		return node < 0 ? 0 : (uint32_t)node;
+	}
+	if (nnodes == 1)
+		return (uint32_t)vdm_dml->nodes[0];
+
+	uint64_t next = util_fetch_and_add64(&vdm_dml->next_node, 1);
+
+	return (uint32_t)vdm_dml->nodes[next % nnodes];
+}
+
 /*
  * data_mover_dml_memory_op_job_submit -- submit job for memory operations,
  * which include memcpy and memmove (nonblocking)
@@ -167,6 +838,68 @@ data_mover_dml_memory_op_job_submit(dml_job_t *dml_job)
 	return status == DML_STATUS_OK ? dml_job->destination_first_ptr : NULL;
 }
 
+/*
+ * data_mover_dml_operation_prepare -- (internal) initializes the data
+ * and the job of a new operation
+ */
+static int
+data_mover_dml_operation_prepare(struct data_mover_dml *vdm_dml,
+	struct data_mover_dml_data *ddata)
+{
+	ddata->dmd = vdm_dml;
+	ddata->job = (dml_job_t *)((char *)ddata + DATA_MOVER_DML_DATA_SIZE);
+	ddata->u.batch = NULL;
+	ddata->on_cpu = 0;
+	ddata->watched = 0;
+
+	return dml_init_job(vdm_dml->path, ddata->job) == DML_STATUS_OK ?
+		0 : -1;
+}
+
+/*
+ * data_mover_dml_pool -- (internal) returns the pool of the calling thread,
+ * creating it if needed, or NULL if it can't be created
+ */
+static struct data_mover_dml_pool *
+data_mover_dml_pool(struct data_mover_dml *vdm_dml)
+{
+	struct data_mover_dml_pool *pool = os_tls_get(vdm_dml->pool_key);
+	if (pool != NULL)
+		return pool;
+
+	pool = malloc(sizeof(struct data_mover_dml_pool));
+	if (pool == NULL)
+		return NULL;
+	if (os_tls_set(vdm_dml->pool_key, pool) != 0) {
+		free(pool);
+		return NULL;
+	}
+
+	pool->head = NULL;
+	pool->n = 0;
+	os_mutex_lock(&vdm_dml->pools_lock);
+	pool->next = vdm_dml->pools;
+	vdm_dml->pools = pool;
+	os_mutex_unlock(&vdm_dml->pools_lock);
+
+	return pool;
+}
+
+/*
+ * data_mover_dml_pool_drain -- (internal) frees the operations of the pool
+ */
+static void
+data_mover_dml_pool_drain(struct data_mover_dml_pool *pool)
+{
+	while (pool->head != NULL) {
+		struct data_mover_dml_data *ddata = pool->head;
+		pool->head = ddata->u.next_pooled;
+		dml_finalize_job(ddata->job);
+		membuf_free(ddata);
+	}
+	pool->n = 0;
+}
+
 /*
  * data_mover_dml_operation_new -- create a new DML job
  */
@@ -175,36 +908,124 @@ data_mover_dml_operation_new(struct vdm *vdm,
 	const enum vdm_operation_type type)
 {
 	struct data_mover_dml *vdm_dml = (struct data_mover_dml *)vdm;
-	dml_status_t status;
-	uint32_t job_size;
-	dml_job_t *dml_job;
+	struct data_mover_dml_data *ddata;
 
 	switch (type) {
 		case VDM_OPERATION_MEMCPY:
 		case VDM_OPERATION_MEMMOVE:
 		case VDM_OPERATION_MEMSET:
 		case VDM_OPERATION_FLUSH:
+		case VDM_OPERATION_MEMCPY_V:
+		case VDM_OPERATION_COMPARE:
+		case VDM_OPERATION_COMPARE_PATTERN:
+		case VDM_OPERATION_CRC32C:
+		case VDM_OPERATION_DUALCAST:
+		case VDM_OPERATION_DELTA_CREATE:
+		case VDM_OPERATION_DELTA_APPLY:
+		case VDM_OPERATION_MEMFILL:
+		case VDM_OPERATION_PREAD:
+		case VDM_OPERATION_PWRITE:
 			break;
 		default:
 			ASSERT(0); /* unreachable */
 	}
 
-	status = dml_get_job_size(vdm_dml->path, &job_size);
-	if (status != DML_STATUS_OK)
+	if (vdm_dml->job_size == 0)
 		return NULL;
 
-	dml_job = membuf_alloc(vdm_dml->membuf, job_size);
-	if (dml_job == NULL)
+	/* the job of a pooled operation is reset by op_start */
+	struct data_mover_dml_pool *pool = data_mover_dml_pool(vdm_dml);
+	if (pool != NULL && pool->head != NULL) {
+		ddata = pool->head;
+		pool->head = ddata->u.next_pooled;
+		pool->n--;
+		ddata->u.batch = NULL;
+		ddata->on_cpu = 0;
+		ddata->watched = 0;
+		/* an operation deleted unstarted mustn't see the old job */
+		ddata->job->operation = DML_OP_NOP;
+		return ddata;
+	}
+
+	/* the hardware path writes descriptors and completion records */
+	ddata = membuf_alloc_aligned(vdm_dml->membuf,
+		DATA_MOVER_DML_DATA_SIZE + vdm_dml->job_size,
+		MEMBUF_CACHELINE_SIZE);
+	if (ddata == NULL)
 		return NULL;
 
-	dml_status_t job_status =
-		dml_init_job(vdm_dml->path, dml_job);
-	if (job_status != DML_STATUS_OK) {
-		membuf_free(dml_job);
+	if (data_mover_dml_operation_prepare(vdm_dml, ddata) != 0) {
+		membuf_free(ddata);
 		return NULL;
 	}
+	ddata->in_membuf = 1;
 
-	return dml_job;
+	return ddata;
+}
+
+/*
+ * data_mover_dml_operation_init -- create a new DML job in the storage
+ * provided by the caller
+ */
+static void *
+data_mover_dml_operation_init(struct vdm *vdm,
+	const enum vdm_operation_type type, void *storage)
+{
+	SUPPRESS_UNUSED(type);
+
+	struct data_mover_dml *vdm_dml = (struct data_mover_dml *)vdm;
+	struct data_mover_dml_data *ddata = storage;
+	ASSERTeq((uintptr_t)ddata % VDM_OP_STORAGE_ALIGN, 0);
+
+	if (data_mover_dml_operation_prepare(vdm_dml, ddata) != 0)
+		return NULL;
+	ddata->in_membuf = 0;
+
+	return ddata;
+}
+
+/*
+ * data_mover_dml_batch_release -- (internal) drops the reference of a deleted
+ * operation to the batch job, the last one frees it
+ */
+static void
+data_mover_dml_batch_release(struct data_mover_dml_batch *batch)
+{
+	if (util_fetch_and_sub64(&batch->nrefs, 1) != 1)
+		return;
+
+	data_mover_dml_job_delete(&batch->job);
+	membuf_free(batch);
+}
+
+/*
+ * data_mover_dml_status -- (internal) returns the status of the job of
+ * the operation, the failed ones, e.g. left part way through on a page
+ * fault, are performed again on the cpu, if it's safe
+ *
+ * DML doesn't report how many bytes the device completed, so the whole
+ * operation is performed again.
+ */
+static dml_status_t
+data_mover_dml_status(struct data_mover_dml_data *ddata,
+	const struct vdm_operation *operation)
+{
+	dml_job_t *job = ddata->job;
+	dml_status_t status = dml_check_job(ddata->u.batch != NULL ?
+		ddata->u.batch->job : job);
+	if (status == DML_STATUS_OK || status == DML_STATUS_BEING_PROCESSED)
+		return status;
+	if (!data_mover_dml_recoverable(operation))
+		return DML_STATUS_JOB_CORRUPTED;
+
+	/* the tasks of the vectored memcpy aren't freed by the cpu one */
+	if (operation->type == VDM_OPERATION_MEMCPY_V &&
+	    job->operation == DML_OP_BATCH)
+		membuf_free(job->destination_first_ptr);
+	if (data_mover_dml_cpu_perform(ddata, operation) != 0)
+		return DML_STATUS_JOB_CORRUPTED;
+
+	return DML_STATUS_OK;
 }
 
 /*
@@ -215,8 +1036,21 @@ data_mover_dml_operation_delete(void *data,
 	const struct vdm_operation *operation,
 	struct vdm_operation_output *output)
 {
-	dml_job_t *job = (dml_job_t *)data;
-	dml_status_t status = dml_check_job(job);
+	struct data_mover_dml_data *ddata = data;
+	dml_job_t *job = ddata->job;
+	if (ddata->on_cpu) {
+		*output = ddata->output;
+		output->type = operation->type;
+		goto out;
+	}
+
+	dml_status_t status = data_mover_dml_status(ddata, operation);
+	if (ddata->on_cpu) {
+		*output = ddata->output;
+		output->type = operation->type;
+		goto out;
+	}
+
 	switch (status) {
 		case DML_STATUS_BEING_PROCESSED:
 			ASSERT(0 && "dml job being deleted during processing");
@@ -230,32 +1064,89 @@ data_mover_dml_operation_delete(void *data,
 			ASSERT(0);
 	}
 
-	switch (job->operation) {
-		case DML_OP_MEM_MOVE:
-			if (job->flags & DML_FLAG_COPY_ONLY) {
-				output->type = VDM_OPERATION_MEMCPY;
-				output->output.memcpy.dest =
-					job->destination_first_ptr;
-			} else {
-				output->type = VDM_OPERATION_MEMMOVE;
-				output->output.memmove.dest =
-					job->destination_first_ptr;
-			}
+	output->type = operation->type;
+	switch (operation->type) {
+		case VDM_OPERATION_MEMCPY:
+			output->output.memcpy.dest =
+				operation->data.memcpy.dest;
 			break;
-		case DML_OP_FILL:
-			output->type = VDM_OPERATION_MEMSET;
+		case VDM_OPERATION_MEMMOVE:
+			output->output.memmove.dest =
+				operation->data.memmove.dest;
+			break;
+		case VDM_OPERATION_MEMSET:
 			output->output.memset.str = job->destination_first_ptr;
 			break;
-		case DML_OP_CACHE_FLUSH:
-			output->type = VDM_OPERATION_FLUSH;
+		case VDM_OPERATION_FLUSH:
+			output->output.flush.unused = 0;
+			break;
+		case VDM_OPERATION_MEMCPY_V:
+			/* the vectored memcpy can be performed by any job */
+			output->output.memcpy_v.n =
+				vdm_memcpy_v_size(&operation->data.memcpy_v);
+			if (job->operation == DML_OP_BATCH)
+				membuf_free(job->destination_first_ptr);
+			break;
+		case VDM_OPERATION_COMPARE:
+			output->output.compare.result = job->result != 0;
+			output->output.compare.offset = job->result != 0 ?
+				job->offset : operation->data.compare.n;
+			break;
+		case VDM_OPERATION_COMPARE_PATTERN:
+			output->output.compare_pattern.result =
+				job->result != 0;
+			output->output.compare_pattern.offset =
+				job->result != 0 ? job->offset :
+				operation->data.compare_pattern.n;
+			break;
+		case VDM_OPERATION_CRC32C:
+			output->output.crc32c.crc = ddata->crc;
+			break;
+		case VDM_OPERATION_DUALCAST:
+			output->output.dualcast.dest1 =
+				operation->data.dualcast.dest1;
+			output->output.dualcast.dest2 =
+				operation->data.dualcast.dest2;
+			break;
+		case VDM_OPERATION_DELTA_CREATE:
+			/* DML replaces the buffer size with the record one */
+			output->output.delta_create.result =
+				(enum vdm_delta_result)job->result;
+			output->output.delta_create.delta_size =
+				job->result == VDM_DELTA_EQUAL ?
+				0 : job->destination_length;
+			break;
+		case VDM_OPERATION_DELTA_APPLY:
+			output->output.delta_apply.dest =
+				operation->data.delta_apply.dest;
+			break;
+		case VDM_OPERATION_MEMFILL:
+			output->output.memfill.dest =
+				operation->data.memfill.dest;
 			break;
 		default:
 			ASSERT(0);
 	}
 
+out:
+	if (ddata->u.batch != NULL)
+		data_mover_dml_batch_release(ddata->u.batch);
+
+	if (ddata->in_membuf) {
+		struct data_mover_dml_pool *pool =
+			data_mover_dml_pool(ddata->dmd);
+		if (pool != NULL && pool->n < DATA_MOVER_DML_POOL_SIZE) {
+			ddata->u.next_pooled = pool->head;
+			pool->head = ddata;
+			pool->n++;
+			return;
+		}
+	}
+
 	data_mover_dml_job_delete(&job);
 
-	membuf_free(data);
+	if (ddata->in_membuf)
+		membuf_free(data);
 }
 
 /*
@@ -265,11 +1156,21 @@ enum future_state
 data_mover_dml_operation_check(void *data,
 	const struct vdm_operation *operation)
 {
-	SUPPRESS_UNUSED(operation);
+	struct data_mover_dml_data *ddata = data;
+	if (ddata->on_cpu)
+		return FUTURE_STATE_COMPLETE;
 
-	dml_job_t *job = (dml_job_t *)data;
+	/* the job isn't checked by two threads at once */
+	if (ddata->watched) {
+		struct data_mover_dml *vdm_dml = ddata->dmd;
+		os_mutex_lock(&vdm_dml->waker_lock);
+		int waiting = ddata->waiting;
+		os_mutex_unlock(&vdm_dml->waker_lock);
+		if (waiting)
+			return FUTURE_STATE_RUNNING;
+	}
 
-	dml_status_t status = dml_check_job(job);
+	dml_status_t status = data_mover_dml_status(ddata, operation);
 	switch (status) {
 		case DML_STATUS_BEING_PROCESSED:
 			return FUTURE_STATE_RUNNING;
@@ -281,6 +1182,79 @@ data_mover_dml_operation_check(void *data,
 	}
 }
 
+/*
+ * data_mover_dml_watch -- (internal) hands the running operation over
+ * to the waker thread
+ */
+static void
+data_mover_dml_watch(struct data_mover_dml *vdm_dml,
+	struct data_mover_dml_data *ddata)
+{
+	os_mutex_lock(&vdm_dml->waker_lock);
+	ddata->waiting = 1;
+	ddata->next_waiting = vdm_dml->waiting;
+	vdm_dml->waiting = ddata;
+	os_cond_signal(&vdm_dml->waker_cond);
+	os_mutex_unlock(&vdm_dml->waker_lock);
+}
+
+/*
+ * data_mover_dml_waker -- (internal) the thread checking the jobs
+ * of the waiting operations and waking their futures, once they complete
+ */
+static void *
+data_mover_dml_waker(void *arg)
+{
+	struct data_mover_dml *vdm_dml = arg;
+	uint64_t sleep_nsec = DATA_MOVER_DML_WAKER_SLEEP_MIN;
+
+	os_mutex_lock(&vdm_dml->waker_lock);
+	while (!vdm_dml->waker_stop) {
+		if (vdm_dml->waiting == NULL) {
+			os_cond_wait(&vdm_dml->waker_cond,
+				&vdm_dml->waker_lock);
+			sleep_nsec = DATA_MOVER_DML_WAKER_SLEEP_MIN;
+			continue;
+		}
+
+		int woken = 0;
+		struct data_mover_dml_data **prev = &vdm_dml->waiting;
+		while (*prev != NULL) {
+			struct data_mover_dml_data *ddata = *prev;
+			dml_job_t *job = ddata->u.batch != NULL ?
+				ddata->u.batch->job : ddata->job;
+			if (dml_check_job(job) == DML_STATUS_BEING_PROCESSED) {
+				prev = &ddata->next_waiting;
+				continue;
+			}
+
+			/* the operation isn't deleted until it's checked */
+			*prev = ddata->next_waiting;
+			ddata->waiting = 0;
+			FUTURE_WAKER_WAKE(&ddata->waker);
+			woken = 1;
+		}
+		if (woken) {
+			sleep_nsec = DATA_MOVER_DML_WAKER_SLEEP_MIN;
+			continue;
+		}
+
+		/* the longer the jobs run, the less often they're checked */
+		struct timespec ts;
+		os_clock_gettime(CLOCK_REALTIME, &ts);
+		uint64_t nsec = (uint64_t)ts.tv_nsec + sleep_nsec;
+		ts.tv_sec += (time_t)(nsec / 1000000000);
+		ts.tv_nsec = (long)(nsec % 1000000000);
+		os_cond_timedwait(&vdm_dml->waker_cond, &vdm_dml->waker_lock,
+			&ts);
+		if (sleep_nsec < DATA_MOVER_DML_WAKER_SLEEP_MAX)
+			sleep_nsec *= 2;
+	}
+	os_mutex_unlock(&vdm_dml->waker_lock);
+
+	return NULL;
+}
+
 /*
  * data_mover_dml_operation_start -- start ('submit') asynchronous dml job
  */
@@ -288,11 +1262,28 @@ int
 data_mover_dml_operation_start(void *data,
 	const struct vdm_operation *operation, struct future_notifier *n)
 {
+	/*
+	 * XXX: The completion record of the job, written by the device, could
+	 * be monitored by a poller notifier, but DML keeps it in the internal
+	 * state of the job and doesn't expose its address.
+	 */
 	if (n) {
 		n->notifier_used = FUTURE_NOTIFIER_NONE;
 	}
 
-	dml_job_t *job = (dml_job_t *)data;
+	struct data_mover_dml_data *ddata = data;
+	dml_job_t *job = ddata->job;
+
+	/*
+	 * For the small ones, the submission costs more than the cpu copy.
+	 * DML has no file operations, they're always performed on the cpu.
+	 */
+	int file = operation->type == VDM_OPERATION_PREAD ||
+		operation->type == VDM_OPERATION_PWRITE;
+	if ((file || vdm_operation_size(operation) <
+	    ddata->dmd->cpu_threshold) &&
+	    data_mover_dml_cpu_perform(ddata, operation) == 0)
+		return 0;
 
 	switch (operation->type) {
 		case VDM_OPERATION_MEMCPY:
@@ -301,7 +1292,6 @@ data_mover_dml_operation_start(void *data,
 					operation->data.memcpy.src,
 					operation->data.memcpy.n,
 					operation->data.memcpy.flags);
-				data_mover_dml_memory_op_job_submit(job);
 				break;
 		case VDM_OPERATION_MEMMOVE:
 				data_mover_dml_memmove_job_init(job,
@@ -309,7 +1299,6 @@ data_mover_dml_operation_start(void *data,
 					operation->data.memmove.src,
 					operation->data.memmove.n,
 					operation->data.memmove.flags);
-				data_mover_dml_memory_op_job_submit(job);
 			break;
 		case VDM_OPERATION_MEMSET:
 				data_mover_dml_memset_job_init(job,
@@ -317,22 +1306,214 @@ data_mover_dml_operation_start(void *data,
 					operation->data.memset.c,
 					operation->data.memset.n,
 					operation->data.memset.flags);
-				data_mover_dml_memory_op_job_submit(job);
 			break;
 		case VDM_OPERATION_FLUSH:
 				data_mover_dml_flush_job_init(job,
 					operation->data.flush.dest,
 					operation->data.flush.n,
 					operation->data.flush.flags);
-				data_mover_dml_memory_op_job_submit(job);
+			break;
+		case VDM_OPERATION_MEMCPY_V: {
+				const struct vdm_operation_data_memcpy_v *mdata
+					= &operation->data.memcpy_v;
+				if (data_mover_dml_memcpy_v_job_init(ddata,
+						mdata) == NULL)
+					data_mover_dml_memcpy_v_fallback(mdata);
+			} break;
+		case VDM_OPERATION_COMPARE:
+				data_mover_dml_compare_job_init(job,
+					&operation->data.compare);
+			break;
+		case VDM_OPERATION_COMPARE_PATTERN:
+				data_mover_dml_compare_pattern_job_init(job,
+					&operation->data.compare_pattern);
+			break;
+		case VDM_OPERATION_CRC32C:
+				data_mover_dml_crc32c_job_init(ddata,
+					&operation->data.crc32c);
+			break;
+		case VDM_OPERATION_DUALCAST:
+				data_mover_dml_dualcast_job_init(ddata,
+					&operation->data.dualcast);
+			break;
+		case VDM_OPERATION_DELTA_CREATE:
+				data_mover_dml_delta_create_job_init(ddata,
+					&operation->data.delta_create);
+			break;
+		case VDM_OPERATION_DELTA_APPLY:
+				data_mover_dml_delta_apply_job_init(ddata,
+					&operation->data.delta_apply);
+			break;
+		case VDM_OPERATION_MEMFILL:
+				data_mover_dml_memfill_job_init(ddata,
+					&operation->data.memfill);
 			break;
 		default:
 			ASSERT(0);
 	}
+	if (ddata->on_cpu)
+		return 0;
+
+	if (ddata->dmd->fault_policy == DATA_MOVER_DML_FAULT_PREFAULT)
+		data_mover_dml_prefault(operation);
+	job->flags |= ddata->dmd->fault_flags;
+	job->numa_id = data_mover_dml_node(ddata->dmd);
+	if (data_mover_dml_memory_op_job_submit(job) == NULL)
+		return 0;
+
+	struct data_mover_dml *vdm_dml = ddata->dmd;
+	if (n != NULL && vdm_dml->waker_threshold != 0 &&
+	    vdm_operation_size(operation) >= vdm_dml->waker_threshold) {
+		n->notifier_used = FUTURE_NOTIFIER_WAKER;
+		ddata->watched = 1;
+		ddata->waker = n->waker;
+		data_mover_dml_watch(vdm_dml, ddata);
+	}
 
 	return 0;
 }
 
+/*
+ * data_mover_dml_batchable -- (internal) returns if the operation can be
+ * a task of a batch job
+ */
+static int
+data_mover_dml_batchable(struct data_mover_dml *vdm_dml,
+	const struct vdm_operation *operation)
+{
+	/* the operations below the cpu threshold aren't submitted at all */
+	if (vdm_operation_size(operation) < vdm_dml->cpu_threshold)
+		return 0;
+
+	switch (operation->type) {
+		case VDM_OPERATION_MEMCPY:
+			return operation->data.memcpy.n <= UINT32_MAX;
+		case VDM_OPERATION_MEMMOVE:
+			return operation->data.memmove.n <= UINT32_MAX;
+		default:
+			return 0;
+	}
+}
+
+/*
+ * data_mover_dml_batch_task -- (internal) sets the memory move task
+ * of the operation in the batch job
+ */
+static dml_status_t
+data_mover_dml_batch_task(struct data_mover_dml *vdm_dml, dml_job_t *dml_job,
+	uint32_t i, const struct vdm_operation *operation)
+{
+	uint64_t dml_flags = 0;
+	if (operation->type == VDM_OPERATION_MEMCPY) {
+		const struct vdm_operation_data_memcpy *mdata =
+			&operation->data.memcpy;
+		data_mover_dml_translate_flags(mdata->flags, &dml_flags);
+		dml_flags |= vdm_dml->fault_flags;
+		return dml_batch_set_mem_move_by_index(dml_job, i,
+			(uint8_t *)mdata->src, (uint8_t *)mdata->dest,
+			(uint32_t)mdata->n, DML_FLAG_COPY_ONLY | dml_flags);
+	}
+
+	const struct vdm_operation_data_memmove *mdata =
+		&operation->data.memmove;
+	data_mover_dml_translate_flags(mdata->flags, &dml_flags);
+	dml_flags |= vdm_dml->fault_flags;
+	return dml_batch_set_mem_move_by_index(dml_job, i,
+		(uint8_t *)mdata->src, (uint8_t *)mdata->dest,
+		(uint32_t)mdata->n, dml_flags);
+}
+
+/*
+ * data_mover_dml_batch_submit -- (internal) submits the n memory moves
+ * as a single batch job, returns -1 if it can't be created
+ */
+static int
+data_mover_dml_batch_submit(struct data_mover_dml *vdm_dml, void *data[],
+	const struct vdm_operation *operations[], size_t n)
+{
+	struct data_mover_dml_data *first = data[0];
+	uint32_t batch_size;
+	if (dml_get_batch_size(first->job, (uint32_t)n, &batch_size) !=
+	    DML_STATUS_OK)
+		return -1;
+
+	size_t job_offset = ALIGN_UP(sizeof(struct data_mover_dml_batch),
+		(size_t)MEMBUF_CACHELINE_SIZE);
+	size_t tasks_offset = job_offset + ALIGN_UP((size_t)vdm_dml->job_size,
+		(size_t)MEMBUF_CACHELINE_SIZE);
+	struct data_mover_dml_batch *batch = membuf_alloc_aligned(
+		vdm_dml->membuf, tasks_offset + batch_size,
+		MEMBUF_CACHELINE_SIZE);
+	if (batch == NULL)
+		return -1;
+
+	dml_job_t *dml_job = (dml_job_t *)((char *)batch + job_offset);
+	if (dml_init_job(vdm_dml->path, dml_job) != DML_STATUS_OK)
+		goto init_failed;
+
+	dml_job->operation = DML_OP_BATCH;
+	dml_job->destination_first_ptr = (uint8_t *)batch + tasks_offset;
+	dml_job->destination_length = batch_size;
+	dml_job->flags = vdm_dml->fault_flags;
+	for (size_t i = 0; i < n; ++i) {
+		if (data_mover_dml_batch_task(vdm_dml, dml_job, (uint32_t)i,
+				operations[i]) != DML_STATUS_OK)
+			goto submit_failed;
+		if (vdm_dml->fault_policy == DATA_MOVER_DML_FAULT_PREFAULT)
+			data_mover_dml_prefault(operations[i]);
+	}
+
+	batch->job = dml_job;
+	batch->nrefs = n;
+	dml_job->numa_id = data_mover_dml_node(vdm_dml);
+	if (dml_submit_job(dml_job) != DML_STATUS_OK)
+		goto submit_failed;
+
+	for (size_t i = 0; i < n; ++i)
+		((struct data_mover_dml_data *)data[i])->u.batch = batch;
+
+	return 0;
+
+submit_failed:
+	dml_finalize_job(dml_job);
+init_failed:
+	membuf_free(batch);
+	return -1;
+}
+
+/*
+ * data_mover_dml_operation_start_batch -- start the DML jobs, the runs
+ * of the memory moves submitted as batch jobs
+ */
+static size_t
+data_mover_dml_operation_start_batch(struct vdm *vdm, void *data[],
+	const struct vdm_operation *operations[], size_t n)
+{
+	struct data_mover_dml *vdm_dml = (struct data_mover_dml *)vdm;
+
+	size_t i = 0;
+	while (i < n) {
+		size_t nrun = 0;
+		while (i + nrun < n && data_mover_dml_batchable(vdm_dml,
+				operations[i + nrun]))
+			nrun++;
+
+		/* a batch has at least two tasks */
+		if (nrun >= 2 && data_mover_dml_batch_submit(vdm_dml, &data[i],
+				&operations[i], nrun) == 0) {
+			i += nrun;
+			continue;
+		}
+
+		size_t end = i + (nrun > 0 ? nrun : 1);
+		for (; i < end; ++i)
+			data_mover_dml_operation_start(data[i], operations[i],
+				NULL);
+	}
+
+	return n;
+}
+
 int
 has_property_dmd(void *fut, enum future_property property)
 {
@@ -351,6 +1532,8 @@ static struct vdm data_mover_dml_vdm = {
 	.op_start = data_mover_dml_operation_start,
 	.capabilities = SUPPORTED_FLAGS,
 	.has_property = has_property_dmd,
+	.op_start_batch = data_mover_dml_operation_start_batch,
+	.op_init = data_mover_dml_operation_init,
 };
 
 /*
@@ -363,7 +1546,27 @@ data_mover_dml_new(enum data_mover_dml_type type)
 	if (vdm_dml == NULL)
 		return NULL;
 
-	vdm_dml->membuf = membuf_new(vdm_dml);
+	vdm_dml->membuf = membuf_new(vdm_dml, 0, MEMBUF_PAGES_NORMAL);
+	if (vdm_dml->membuf == NULL)
+		goto membuf_failed;
+	if (os_tls_key_create(&vdm_dml->pool_key, NULL) != 0)
+		goto pool_key_failed;
+	if (os_mutex_init(&vdm_dml->pools_lock) != 0)
+		goto pools_lock_failed;
+	if (os_mutex_init(&vdm_dml->waker_lock) != 0)
+		goto waker_lock_failed;
+	if (os_cond_init(&vdm_dml->waker_cond) != 0)
+		goto waker_cond_failed;
+	vdm_dml->waker_threshold = 0;
+	vdm_dml->waker_running = 0;
+	vdm_dml->waker_stop = 0;
+	vdm_dml->waiting = NULL;
+	vdm_dml->pools = NULL;
+	vdm_dml->nnodes = 0;
+	vdm_dml->next_node = 0;
+	vdm_dml->cpu_threshold = 0;
+	vdm_dml->fault_policy = DATA_MOVER_DML_FAULT_CPU;
+	vdm_dml->fault_flags = 0;
 	vdm_dml->base = data_mover_dml_vdm;
 	switch (type) {
 		case DATA_MOVER_DML_HARDWARE:
@@ -379,7 +1582,169 @@ data_mover_dml_new(enum data_mover_dml_type type)
 			ASSERT(0);
 	}
 
+	/* the operations fit the caller's storage only with a known job size */
+	uint32_t job_size;
+	if (dml_get_job_size(vdm_dml->path, &job_size) == DML_STATUS_OK) {
+		vdm_dml->job_size = job_size;
+		vdm_dml->base.op_storage_size = ALIGN_UP(
+			DATA_MOVER_DML_DATA_SIZE + job_size,
+			(size_t)VDM_OP_STORAGE_ALIGN);
+	} else {
+		vdm_dml->job_size = 0;
+		vdm_dml->base.op_init = NULL;
+	}
+
 	return vdm_dml;
+
+waker_cond_failed:
+	os_mutex_destroy(&vdm_dml->waker_lock);
+waker_lock_failed:
+	os_mutex_destroy(&vdm_dml->pools_lock);
+pools_lock_failed:
+	os_tls_key_delete(vdm_dml->pool_key);
+pool_key_failed:
+	membuf_delete(vdm_dml->membuf);
+membuf_failed:
+	free(vdm_dml);
+	return NULL;
+}
+
+/*
+ * data_mover_dml_set_nodes -- selects the NUMA nodes, to the devices
+ * of which the jobs are submitted round-robin, none for the node of
+ * the submitting thread, returns -1 if any of the nodes is invalid
+ *
+ * It has to be called before any operation is started.
+ */
+int
+data_mover_dml_set_nodes(struct data_mover_dml *dmd, const int nodes[],
+	size_t nnodes)
+{
+	if (nnodes > DATA_MOVER_DML_MAX_NODES)
+		return -1;
+	for (size_t i = 0; i < nnodes; ++i) {
+		if (nodes[i] < 0)
+			return -1;
+	}
+
+	for (size_t i = 0; i < nnodes; ++i)
+		dmd->nodes[i] = nodes[i];
+	util_atomic_store_explicit64(&dmd->nnodes, (uint64_t)nnodes,
+		memory_order_release);
+
+	return 0;
+}
+
+/*
+ * data_mover_dml_calibrate -- (internal) times the copies of growing sizes
+ * on the cpu and as DML jobs, returns the smallest size, at which the job
+ * wasn't slower, 0 if the jobs can't be created
+ */
+static size_t
+data_mover_dml_calibrate(struct data_mover_dml *vdm_dml)
+{
+	size_t threshold = 0;
+	if (vdm_dml->job_size == 0)
+		return 0;
+
+	dml_job_t *job = malloc(vdm_dml->job_size);
+	if (job == NULL)
+		return 0;
+	if (dml_init_job(vdm_dml->path, job) != DML_STATUS_OK)
+		goto init_failed;
+
+	char *src = calloc(1, DATA_MOVER_DML_CALIBRATE_MAX);
+	char *dest = calloc(1, DATA_MOVER_DML_CALIBRATE_MAX);
+	if (src == NULL || dest == NULL)
+		goto out;
+
+	/* if the cpu always wins, the job is used only beyond the last size */
+	threshold = DATA_MOVER_DML_CALIBRATE_MAX * 2;
+	for (size_t n = DATA_MOVER_DML_CALIBRATE_MIN;
+	    n <= DATA_MOVER_DML_CALIBRATE_MAX; n *= 2) {
+		uint64_t start = runtime_clock_now();
+		for (int i = 0; i < DATA_MOVER_DML_CALIBRATE_ROUNDS; ++i)
+			memops_memcpy(dest, src, n, 0);
+		uint64_t cpu_time = runtime_clock_now() - start;
+
+		start = runtime_clock_now();
+		for (int i = 0; i < DATA_MOVER_DML_CALIBRATE_ROUNDS; ++i) {
+			data_mover_dml_memcpy_job_init(job, dest, src, n, 0);
+			job->numa_id = data_mover_dml_node(vdm_dml);
+			if (dml_execute_job(job) != DML_STATUS_OK)
+				goto out;
+		}
+		uint64_t dml_time = runtime_clock_now() - start;
+
+		if (dml_time <= cpu_time) {
+			threshold = n;
+			break;
+		}
+	}
+
+out:
+	free(dest);
+	free(src);
+	dml_finalize_job(job);
+init_failed:
+	free(job);
+	return threshold;
+}
+
+/*
+ * data_mover_dml_set_cpu_threshold -- sets the size, below which
+ * the operations are performed on the cpu, 0 disables it, or measures it
+ * for DATA_MOVER_DML_CPU_THRESHOLD_AUTO, returns the threshold set
+ *
+ * It has to be called before any operation is started.
+ */
+size_t
+data_mover_dml_set_cpu_threshold(struct data_mover_dml *dmd, size_t threshold)
+{
+	if (threshold == DATA_MOVER_DML_CPU_THRESHOLD_AUTO)
+		threshold = data_mover_dml_calibrate(dmd);
+
+	dmd->cpu_threshold = threshold;
+
+	return threshold;
+}
+
+/*
+ * data_mover_dml_set_fault_policy -- sets how the jobs deal with the pages,
+ * which aren't mapped yet
+ *
+ * It has to be called before any operation is started.
+ */
+void
+data_mover_dml_set_fault_policy(struct data_mover_dml *dmd,
+	enum data_mover_dml_fault_policy policy)
+{
+	dmd->fault_policy = policy;
+	dmd->fault_flags = policy == DATA_MOVER_DML_FAULT_BLOCK ?
+		DML_FLAG_BLOCK_ON_FAULT : 0;
+}
+
+/*
+ * data_mover_dml_set_waker_threshold -- sets the size, from which
+ * the futures of the operations are woken by the waker thread, once their
+ * jobs complete, 0 disables it, returns -1 if the thread can't be created
+ *
+ * It has to be called before any operation is started.
+ */
+int
+data_mover_dml_set_waker_threshold(struct data_mover_dml *dmd,
+	size_t threshold)
+{
+	if (threshold != 0 && !dmd->waker_running) {
+		if (os_thread_create(&dmd->waker_thread, NULL,
+				data_mover_dml_waker, dmd) != 0)
+			return -1;
+		dmd->waker_running = 1;
+	}
+
+	dmd->waker_threshold = threshold;
+
+	return 0;
 }
 
 /*
@@ -391,12 +1756,42 @@ data_mover_dml_get_vdm(struct data_mover_dml *dmd)
 	return &dmd->base;
 }
 
+/*
+ * data_mover_dml_get_membuf_stats -- returns the statistics of the buffers
+ * the operations are allocated from
+ */
+void
+data_mover_dml_get_membuf_stats(struct data_mover_dml *dmd,
+	struct vdm_membuf_stats *stats)
+{
+	membuf_get_stats(dmd->membuf, stats);
+}
+
 /*
  * data_mover_dml_delete -- deletes a vdm_dml instance
  */
 void
 data_mover_dml_delete(struct data_mover_dml *dmd)
 {
+	if (dmd->waker_running) {
+		os_mutex_lock(&dmd->waker_lock);
+		dmd->waker_stop = 1;
+		os_cond_signal(&dmd->waker_cond);
+		os_mutex_unlock(&dmd->waker_lock);
+		os_thread_join(&dmd->waker_thread, NULL);
+	}
+	os_cond_destroy(&dmd->waker_cond);
+	os_mutex_destroy(&dmd->waker_lock);
+
+	while (dmd->pools != NULL) {
+		struct data_mover_dml_pool *pool = dmd->pools;
+		dmd->pools = pool->next;
+		data_mover_dml_pool_drain(pool);
+		free(pool);
+	}
+	os_mutex_destroy(&dmd->pools_lock);
+	os_tls_key_delete(dmd->pool_key);
+
 	membuf_delete(dmd->membuf);
 	free(dmd);
 }
@@ -19,8 +19,35 @@ enum data_mover_dml_type {
 	DATA_MOVER_DML_AUTO,
 };
 
+/*
+ * The jobs which fail, e.g. on a page fault, are performed again on the cpu,
+ * unless that would be wrong, whatever the policy. The policies make it
+ * less likely to happen.
+ */
+enum data_mover_dml_fault_policy {
+	DATA_MOVER_DML_FAULT_CPU, /* only perform the failed jobs on the cpu */
+	DATA_MOVER_DML_FAULT_BLOCK, /* the device waits for the faults */
+	DATA_MOVER_DML_FAULT_PREFAULT, /* the pages are touched beforehand */
+};
+
+/* the jobs are spread over the devices of at most this many NUMA nodes */
+#define DATA_MOVER_DML_MAX_NODES 16
+
+/* makes data_mover_dml_set_cpu_threshold() measure the threshold */
+#define DATA_MOVER_DML_CPU_THRESHOLD_AUTO SIZE_MAX
+
 struct data_mover_dml *data_mover_dml_new(enum data_mover_dml_type type);
+int data_mover_dml_set_nodes(struct data_mover_dml *dmd, const int nodes[],
+	size_t nnodes);
+size_t data_mover_dml_set_cpu_threshold(struct data_mover_dml *dmd,
+	size_t threshold);
+void data_mover_dml_set_fault_policy(struct data_mover_dml *dmd,
+	enum data_mover_dml_fault_policy policy);
+int data_mover_dml_set_waker_threshold(struct data_mover_dml *dmd,
+	size_t threshold);
 struct vdm *data_mover_dml_get_vdm(struct data_mover_dml *dmd);
+void data_mover_dml_get_membuf_stats(struct data_mover_dml *dmd,
+	struct vdm_membuf_stats *stats);
 void data_mover_dml_delete(struct data_mover_dml *dmd);
 
 #ifdef __cplusplus
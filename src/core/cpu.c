@@ -36,9 +36,22 @@ cpuid(unsigned func, unsigned subfunc, unsigned cpuinfo[4])
 			cpuinfo[ECX_IDX], cpuinfo[EDX_IDX]);
 }
 
+static inline uint64_t
+xgetbv(unsigned xcr)
+{
+	uint32_t lo;
+	uint32_t hi;
+	/* xgetbv */
+	__asm__ volatile(".byte 0x0f, 0x01, 0xd0"
+		: "=a"(lo), "=d"(hi) : "c"(xcr));
+
+	return ((uint64_t)hi << 32) | lo;
+}
+
 #elif defined(_M_X64) || defined(_M_AMD64)
 
 #include <intrin.h>
+#include <immintrin.h>
 
 static inline void
 cpuid(unsigned func, unsigned subfunc, unsigned cpuinfo[4])
@@ -46,12 +59,54 @@ cpuid(unsigned func, unsigned subfunc, unsigned cpuinfo[4])
 	__cpuidex((int *)cpuinfo, (int)func, (int)subfunc);
 }
 
+static inline uint64_t
+xgetbv(unsigned xcr)
+{
+	return _xgetbv(xcr);
+}
+
 #endif
 
 #ifndef bit_MOVDIR64B
 #define bit_MOVDIR64B (1 << 28)
 #endif
 
+#ifndef bit_ENQCMD
+#define bit_ENQCMD (1 << 29)
+#endif
+
+#ifndef bit_WAITPKG
+#define bit_WAITPKG (1 << 5)
+#endif
+
+#ifndef bit_OSXSAVE
+#define bit_OSXSAVE (1 << 27)
+#endif
+
+#ifndef bit_AVX2
+#define bit_AVX2 (1 << 5)
+#endif
+
+#ifndef bit_AVX512F
+#define bit_AVX512F (1 << 16)
+#endif
+
+#ifndef bit_CLFLUSHOPT
+#define bit_CLFLUSHOPT (1 << 23)
+#endif
+
+#ifndef bit_CLWB
+#define bit_CLWB (1 << 24)
+#endif
+
+#ifndef bit_SSE4_2
+#define bit_SSE4_2 (1 << 20)
+#endif
+
+/* register state saved by the OS: SSE and AVX, plus the AVX-512 one */
+#define XCR0_AVX 0x6
+#define XCR0_AVX512 0xe6
+
 /*
  * is_cpu_feature_present -- (internal) checks if CPU feature is supported
  */
@@ -69,6 +124,19 @@ is_cpu_feature_present(unsigned func, unsigned reg, unsigned bit)
 	return (cpuinfo[reg] & bit) != 0;
 }
 
+/*
+ * is_os_state_enabled -- (internal) checks if the OS saves the given
+ * extended register state on context switches
+ */
+static int
+is_os_state_enabled(uint64_t mask)
+{
+	if (!is_cpu_feature_present(0x1, ECX_IDX, bit_OSXSAVE))
+		return 0;
+
+	return (xgetbv(0) & mask) == mask;
+}
+
 /*
  * is_cpu_movdir64b_present -- checks if movdir64b instruction is supported
  */
@@ -78,6 +146,215 @@ is_cpu_movdir64b_present(void)
 	return is_cpu_feature_present(0x7, ECX_IDX, bit_MOVDIR64B);
 }
 
+/*
+ * is_cpu_enqcmd_present -- checks if enqcmd instruction is supported
+ */
+int
+is_cpu_enqcmd_present(void)
+{
+	return is_cpu_feature_present(0x7, ECX_IDX, bit_ENQCMD);
+}
+
+/*
+ * is_cpu_waitpkg_present -- checks if umonitor, umwait and tpause
+ * instructions are supported
+ */
+int
+is_cpu_waitpkg_present(void)
+{
+	return is_cpu_feature_present(0x7, ECX_IDX, bit_WAITPKG);
+}
+
+/*
+ * is_cpu_avx2_present -- checks if AVX2 instructions are supported
+ * and enabled by the OS
+ */
+int
+is_cpu_avx2_present(void)
+{
+	return is_cpu_feature_present(0x7, EBX_IDX, bit_AVX2) &&
+		is_os_state_enabled(XCR0_AVX);
+}
+
+/*
+ * is_cpu_avx512f_present -- checks if AVX-512 foundation instructions
+ * are supported and enabled by the OS
+ */
+int
+is_cpu_avx512f_present(void)
+{
+	return is_cpu_feature_present(0x7, EBX_IDX, bit_AVX512F) &&
+		is_os_state_enabled(XCR0_AVX512);
+}
+
+/*
+ * is_cpu_clflushopt_present -- checks if clflushopt instruction
+ * is supported
+ */
+int
+is_cpu_clflushopt_present(void)
+{
+	return is_cpu_feature_present(0x7, EBX_IDX, bit_CLFLUSHOPT);
+}
+
+/*
+ * is_cpu_clwb_present -- checks if clwb instruction is supported
+ */
+int
+is_cpu_clwb_present(void)
+{
+	return is_cpu_feature_present(0x7, EBX_IDX, bit_CLWB);
+}
+
+/*
+ * is_cpu_sse42_present -- checks if SSE4.2 instructions, crc32 among them,
+ * are supported
+ */
+int
+is_cpu_sse42_present(void)
+{
+	return is_cpu_feature_present(0x1, ECX_IDX, bit_SSE4_2);
+}
+
+#if defined(__x86_64__) || defined(__amd64__)
+
+/*
+ * The instructions are emitted as raw bytes, so that building the library
+ * doesn't require an assembler (and compiler flags) with waitpkg support.
+ */
+
+/*
+ * cpu_umonitor -- arms address monitoring hardware for the given address
+ */
+void
+cpu_umonitor(const volatile void *addr)
+{
+	/* umonitor %rdi */
+	__asm__ volatile(".byte 0xf3, 0x0f, 0xae, 0xf7"
+		: : "D"(addr) : "memory");
+}
+
+/*
+ * cpu_umwait -- waits until the monitored address is written to or until
+ * the TSC reaches the deadline, returns 1 if the deadline was reached
+ */
+int
+cpu_umwait(unsigned ctrl, uint64_t tsc_deadline)
+{
+	uint8_t timeout;
+	/* umwait %edi */
+	__asm__ volatile(".byte 0xf2, 0x0f, 0xae, 0xf7; setc %0"
+		: "=r"(timeout)
+		: "D"(ctrl), "a"((uint32_t)tsc_deadline),
+		"d"((uint32_t)(tsc_deadline >> 32))
+		: "memory", "cc");
+
+	return timeout;
+}
+
+/*
+ * cpu_tpause -- waits until the TSC reaches the deadline, returns 1 if
+ * the deadline was reached
+ */
+int
+cpu_tpause(unsigned ctrl, uint64_t tsc_deadline)
+{
+	uint8_t timeout;
+	/* tpause %edi */
+	__asm__ volatile(".byte 0x66, 0x0f, 0xae, 0xf7; setc %0"
+		: "=r"(timeout)
+		: "D"(ctrl), "a"((uint32_t)tsc_deadline),
+		"d"((uint32_t)(tsc_deadline >> 32))
+		: "memory", "cc");
+
+	return timeout;
+}
+
+/*
+ * cpu_rdtsc -- returns the current value of the time-stamp counter
+ */
+uint64_t
+cpu_rdtsc(void)
+{
+	uint32_t lo;
+	uint32_t hi;
+	__asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+
+	return ((uint64_t)hi << 32) | lo;
+}
+
+/*
+ * cpu_movdir64b -- writes the 64-byte descriptor to the portal of
+ * a dedicated work queue, after the preceding stores
+ */
+void
+cpu_movdir64b(void *portal, const void *desc)
+{
+	/* sfence; movdir64b (%rdx), %rax */
+	__asm__ volatile("sfence; .byte 0x66, 0x0f, 0x38, 0xf8, 0x02"
+		: : "a"(portal), "d"(desc) : "memory");
+}
+
+/*
+ * cpu_enqcmd -- writes the 64-byte descriptor to the portal of a shared
+ * work queue, after the preceding stores, returns 1 if the queue
+ * didn't accept it
+ */
+int
+cpu_enqcmd(void *portal, const void *desc)
+{
+	uint8_t retry;
+	/* sfence; enqcmd (%rdx), %rax */
+	__asm__ volatile("sfence; .byte 0xf2, 0x0f, 0x38, 0xf8, 0x02; setz %0"
+		: "=r"(retry)
+		: "a"(portal), "d"(desc)
+		: "memory", "cc");
+
+	return retry;
+}
+
+#else
+
+void
+cpu_umonitor(const volatile void *addr)
+{
+	_umonitor((void *)addr);
+}
+
+int
+cpu_umwait(unsigned ctrl, uint64_t tsc_deadline)
+{
+	return _umwait(ctrl, tsc_deadline);
+}
+
+int
+cpu_tpause(unsigned ctrl, uint64_t tsc_deadline)
+{
+	return _tpause(ctrl, tsc_deadline);
+}
+
+uint64_t
+cpu_rdtsc(void)
+{
+	return __rdtsc();
+}
+
+void
+cpu_movdir64b(void *portal, const void *desc)
+{
+	_mm_sfence();
+	_movdir64b(portal, desc);
+}
+
+int
+cpu_enqcmd(void *portal, const void *desc)
+{
+	_mm_sfence();
+	return _enqcmd(portal, desc);
+}
+
+#endif
+
 #else
 
 /*
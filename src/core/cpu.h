@@ -8,10 +8,31 @@
  * cpu.h -- definitions for "cpu" module
  */
 
+#include <stdint.h>
+
 #if defined(__x86_64__) || defined(__amd64__) || defined(_M_X64) || \
 	defined(_M_AMD64)
 
 int is_cpu_movdir64b_present(void);
+int is_cpu_enqcmd_present(void);
+int is_cpu_waitpkg_present(void);
+int is_cpu_avx2_present(void);
+int is_cpu_avx512f_present(void);
+int is_cpu_clflushopt_present(void);
+int is_cpu_clwb_present(void);
+int is_cpu_sse42_present(void);
+
+/* umwait/tpause control: 0 - C0.2 (deeper) state, 1 - C0.1 state */
+#define CPU_WAIT_C02 0
+#define CPU_WAIT_C01 1
+
+void cpu_umonitor(const volatile void *addr);
+int cpu_umwait(unsigned ctrl, uint64_t tsc_deadline);
+int cpu_tpause(unsigned ctrl, uint64_t tsc_deadline);
+uint64_t cpu_rdtsc(void);
+
+void cpu_movdir64b(void *portal, const void *desc);
+int cpu_enqcmd(void *portal, const void *desc);
 
 #endif
 
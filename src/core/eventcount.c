@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * eventcount.c -- eventcount implementation on top of the futex primitives,
+ * or the queue of the wakeups for the LIFO one
+ */
+
+#include <errno.h>
+
+#include "eventcount.h"
+#include "os_thread.h"
+#include "util.h"
+
+/*
+ * eventcount_init -- initializes the eventcount
+ */
+void
+eventcount_init(struct eventcount *ec)
+{
+	ec->epoch = 0;
+	ec->nwaiters = 0;
+	ec->wakeq = NULL;
+}
+
+/*
+ * eventcount_init_lifo -- initializes the eventcount, which wakes up its
+ * waiters in LIFO order where the os supports it, returns -1 on failure
+ */
+int
+eventcount_init_lifo(struct eventcount *ec)
+{
+	eventcount_init(ec);
+
+	ec->wakeq = os_wakeq_new();
+	if (ec->wakeq == NULL && errno != ENOTSUP)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * eventcount_fini -- releases the resources of the eventcount, which must
+ * have no waiters
+ */
+void
+eventcount_fini(struct eventcount *ec)
+{
+	if (ec->wakeq != NULL)
+		os_wakeq_delete(ec->wakeq);
+}
+
+/*
+ * eventcount_prepare -- registers the calling thread as a waiter, returns
+ * the key to be passed to eventcount_wait()
+ */
+uint32_t
+eventcount_prepare(struct eventcount *ec)
+{
+	/* full barrier, pairs with the one in eventcount_notify_* */
+	util_fetch_and_add32(&ec->nwaiters, 1);
+
+	uint32_t key;
+	util_atomic_load_explicit32(&ec->epoch, &key, memory_order_acquire);
+
+	return key;
+}
+
+/*
+ * eventcount_cancel -- unregisters the waiter, whose condition became true
+ */
+void
+eventcount_cancel(struct eventcount *ec)
+{
+	util_fetch_and_sub32(&ec->nwaiters, 1);
+}
+
+/*
+ * eventcount_wait -- blocks until a notification arrives after the key was
+ * obtained, or until the relative timeout (if not NULL) expires.
+ * Returns -1 on timeout.
+ */
+int
+eventcount_wait(struct eventcount *ec, uint32_t key,
+	const struct timespec *timeout)
+{
+	/* the notifications after the key was obtained stay in the queue */
+	int ret = ec->wakeq != NULL ? os_wakeq_wait(ec->wakeq, timeout) :
+		os_futex_wait(&ec->epoch, key, timeout);
+	util_fetch_and_sub32(&ec->nwaiters, 1);
+
+	return ret;
+}
+
+/*
+ * eventcount_advance -- (internal) bumps the epoch if there are waiters,
+ * returns the number of the waiters to be woken up
+ */
+static uint32_t
+eventcount_advance(struct eventcount *ec)
+{
+	/* the condition change has to be visible before nwaiters is read */
+	util_synchronize();
+
+	uint32_t nwaiters;
+	util_atomic_load_explicit32(&ec->nwaiters, &nwaiters,
+		memory_order_relaxed);
+	if (nwaiters == 0)
+		return 0;
+
+	util_fetch_and_add32(&ec->epoch, 1);
+
+	return nwaiters;
+}
+
+/*
+ * eventcount_notify_one -- wakes up one of the waiters
+ */
+void
+eventcount_notify_one(struct eventcount *ec)
+{
+	if (eventcount_advance(ec) == 0)
+		return;
+
+	if (ec->wakeq != NULL)
+		os_wakeq_post(ec->wakeq, 1);
+	else
+		os_futex_wake_one(&ec->epoch);
+}
+
+/*
+ * eventcount_notify_all -- wakes up all the waiters
+ */
+void
+eventcount_notify_all(struct eventcount *ec)
+{
+	uint32_t nwaiters = eventcount_advance(ec);
+	if (nwaiters == 0)
+		return;
+
+	if (ec->wakeq != NULL)
+		os_wakeq_post(ec->wakeq, nwaiters);
+	else
+		os_futex_wake_all(&ec->epoch);
+}
@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * eventcount.h -- internal definitions for the eventcount, a condition
+ * variable for lock-free code
+ *
+ * A waiter announces itself with eventcount_prepare(), re-checks its
+ * condition and then either calls eventcount_cancel() or blocks in
+ * eventcount_wait(). A notifier changes the condition first and then calls
+ * one of the notify functions, which only enter the kernel if there is
+ * a waiter.
+ *
+ * An eventcount initialized with eventcount_init_lifo() wakes up the waiter,
+ * which blocked last, first, so that the thread with the warmest cache runs.
+ * Where the os supports it, the notifications are then queued instead,
+ * and the ones no waiter blocked for end up as spurious wakeups later.
+ */
+
+#ifndef EVENTCOUNT_H
+#define EVENTCOUNT_H 1
+
+#include <stdint.h>
+#include <time.h>
+
+struct os_wakeq;
+
+struct eventcount {
+	uint32_t epoch; /* incremented by every notification with waiters */
+	uint32_t nwaiters;
+	struct os_wakeq *wakeq; /* of the LIFO eventcount, or NULL */
+};
+
+void eventcount_init(struct eventcount *ec);
+int eventcount_init_lifo(struct eventcount *ec);
+void eventcount_fini(struct eventcount *ec);
+uint32_t eventcount_prepare(struct eventcount *ec);
+void eventcount_cancel(struct eventcount *ec);
+int eventcount_wait(struct eventcount *ec, uint32_t key,
+	const struct timespec *timeout);
+void eventcount_notify_one(struct eventcount *ec);
+void eventcount_notify_all(struct eventcount *ec);
+
+#endif
@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * fileops.c -- file operations performed on the cpu
+ */
+
+#include <errno.h>
+
+#include "fileops.h"
+#include "os.h"
+#include "out.h"
+#include "util.h"
+
+/*
+ * fileops_pread -- reads n bytes of the file at the offset, returns -1
+ * with errno set on failure, the bytes read are returned in done
+ */
+int
+fileops_pread(int fd, void *buf, size_t n, uint64_t offset, size_t *done)
+{
+	*done = 0;
+	while (*done < n) {
+		ssize_t ret = os_pread(fd, (char *)buf + *done, n - *done,
+			offset + *done);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (ret == 0)
+			break; /* the end of the file */
+		*done += (size_t)ret;
+	}
+
+	return 0;
+}
+
+/*
+ * fileops_pwrite -- writes n bytes to the file at the offset, returns -1
+ * with errno set on failure, the bytes written are returned in done
+ */
+int
+fileops_pwrite(int fd, const void *buf, size_t n, uint64_t offset,
+	unsigned flags, size_t *done)
+{
+	*done = 0;
+	while (*done < n) {
+		ssize_t ret = os_pwrite(fd, (const char *)buf + *done,
+			n - *done, offset + *done);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		*done += (size_t)ret;
+	}
+
+	if ((flags & FILEOPS_F_DURABLE) && os_fdatasync(fd) != 0)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * fileops_perform -- performs the file operation, fills its output
+ */
+void
+fileops_perform(const struct vdm_operation *operation,
+	struct vdm_operation_output *output)
+{
+	switch (operation->type) {
+		case VDM_OPERATION_PREAD: {
+			const struct vdm_operation_data_pread *mdata =
+				&operation->data.pread;
+			struct vdm_operation_output_pread *out =
+				&output->output.pread;
+			out->error = 0;
+			if (fileops_pread(mdata->fd, mdata->buf, mdata->n,
+					mdata->offset, &out->n) != 0) {
+				output->result = VDM_ERROR_IO;
+				out->error = errno;
+			}
+		} break;
+		case VDM_OPERATION_PWRITE: {
+			const struct vdm_operation_data_pwrite *mdata =
+				&operation->data.pwrite;
+			struct vdm_operation_output_pwrite *out =
+				&output->output.pwrite;
+			unsigned flags = (mdata->flags & VDM_F_MEM_DURABLE) ?
+				FILEOPS_F_DURABLE : 0;
+			out->error = 0;
+			if (fileops_pwrite(mdata->fd, mdata->buf, mdata->n,
+					mdata->offset, flags, &out->n) != 0) {
+				output->result = VDM_ERROR_IO;
+				out->error = errno;
+			}
+		} break;
+		default:
+			ASSERT(0);
+	}
+}
@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * fileops.h -- internal definitions for the file operations performed
+ * on the cpu, by the data movers without a file I/O engine
+ *
+ * The reads and writes are repeated until the whole buffer is transferred,
+ * the read stops short only at the end of the file.
+ */
+
+#ifndef FILEOPS_H
+#define FILEOPS_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libminiasync/vdm.h"
+
+#define FILEOPS_F_DURABLE (1U << 0) /* synced when the routine returns */
+
+int fileops_pread(int fd, void *buf, size_t n, uint64_t offset,
+	size_t *done);
+int fileops_pwrite(int fd, const void *buf, size_t n, uint64_t offset,
+	unsigned flags, size_t *done);
+void fileops_perform(const struct vdm_operation *operation,
+	struct vdm_operation_output *output);
+
+#endif /* FILEOPS_H */
@@ -8,24 +8,61 @@
 #include "membuf.h"
 #include "core/os_thread.h"
 #include "core/out.h"
+#include "core/tracepoint.h"
 
-#define MEMBUF_ALIGNMENT (1 << 21) /* 2MB */
-#define MEMBUF_LEN (1 << 21) /* 2MB */
+#define MEMBUF_LEN (1 << 21) /* 2MB, the default */
+#define MEMBUF_MIN_LEN (1 << 12) /* 4KB */
+#define MEMBUF_MAX_LEN ((size_t)1 << 31) /* the largest size class */
+#define MEMBUF_HUGE_PAGE_LEN (1 << 21) /* 2MB */
+#define MEMBUF_MAX_THREADBUFS 8 /* chained per thread, the default */
+
+/*
+ * Freed entries are reused by allocations of the same size class, in any
+ * order, so a long-lived entry doesn't prevent the reuse of the ones after it.
+ * Entries up to MEMBUF_SMALL_MAX bytes are rounded up to a multiple of
+ * MEMBUF_GRANULE, the larger ones to a power of two.
+ */
+#define MEMBUF_GRANULE 64
+#define MEMBUF_SMALL_MAX (1 << 12) /* 4KB */
+#define MEMBUF_NSMALL_CLASSES (MEMBUF_SMALL_MAX / MEMBUF_GRANULE)
+#define MEMBUF_NCLASSES (MEMBUF_NSMALL_CLASSES + 31 - 12)
+
+struct membuf_entry;
 
 struct threadbuf {
 	struct threadbuf *next; /* next threadbuf */
 	struct threadbuf *unused_next; /* next unused threadbuf */
+	struct threadbuf *chain_next; /* next threadbuf of the same thread */
 
 	struct membuf *membuf;
 
 	void *user_data; /* user-specified pointer */
+	size_t len; /* length of the whole threadbuf, also its alignment */
+	enum membuf_pages pages; /* pages the threadbuf was allocated from */
+	int node; /* NUMA node preferred by the pages, -1 - any */
 	size_t size; /* size of the buf variable */
-	size_t offset; /* current allocation offset */
-	size_t available; /* free space available in front of the offset */
-	size_t leftovers; /* space left unused on wraparound */
-	char buf[]; /* buffer with data */
+	size_t offset; /* offset of the memory never allocated from */
+	uint64_t nlive; /* entries not known to be freed yet */
+
+	/* entries freed by any thread, collected by the owner of threadbuf */
+	struct membuf_entry *freed;
+
+	/* entries ready for reuse by the owner of threadbuf, per size class */
+	struct membuf_entry *reusable[MEMBUF_NCLASSES];
+
+	/* the counters and bytes of the threadbuf, written only by its owner */
+	struct vdm_membuf_stats stats;
+
+	/* followed by the buffer with data, at MEMBUF_THREADBUF_HEADER */
 };
 
+/* the blocks of entries start at multiples of MEMBUF_GRANULE */
+#define MEMBUF_THREADBUF_HEADER\
+	ALIGN_UP(sizeof(struct threadbuf), (size_t)MEMBUF_GRANULE)
+
+/* the offset of an entry in its block has to fit into 16 bits */
+#define MEMBUF_MAX_ALIGNMENT (1 << 15)
+
 struct membuf {
 	os_mutex_t lists_lock; /* protects both lists */
 	struct threadbuf *tbuf_first; /* linked-list of threadbufs, cleanup */
@@ -33,11 +70,23 @@ struct membuf {
 
 	os_tls_key_t bufkey; /* TLS key for threadbuf */
 	void *user_data; /* user-provided buffer data */
+	size_t tbuf_len; /* length of each threadbuf */
+	size_t max_tbufs; /* threadbufs chained per thread */
+	enum membuf_pages pages; /* requested pages for the threadbufs */
+	int node; /* requested NUMA node for the threadbufs */
+	struct vdm_membuf_stats released; /* counters of released threadbufs */
 };
 
+/*
+ * The header of an entry directly precedes its data, which is aligned
+ * as requested, so it can start further in its block. The blocks on
+ * the lists of freed entries begin with the header.
+ */
 struct membuf_entry {
-	int32_t allocated; /* 1 - allocated, 0 - unused */
-	uint32_t size; /* size of the entry */
+	uint32_t size_class; /* size class of the entry */
+	uint16_t alignment_shift; /* log2 of the alignment of the threadbuf */
+	uint16_t offset; /* offset of the entry from the start of its block */
+	struct membuf_entry *next; /* next freed block */
 	char data[]; /* user data */
 };
 
@@ -52,28 +101,53 @@ membuf_key_destructor(void *data)
 	 * the Windows FLS implementation also calls it when the key itself
 	 * is destroyed. To handle this difference, membuf only actually
 	 * deallocates thread buffers on module delete and this callback
-	 * puts the now unused thread buffer on a list to be reused.
+	 * puts the now unused thread buffers on a list to be reused.
 	 */
 	struct threadbuf *tbuf = data;
 	struct membuf *membuf = tbuf->membuf;
 
 	os_mutex_lock(&membuf->lists_lock);
-	tbuf->unused_next = membuf->tbuf_unused_first;
-	membuf->tbuf_unused_first = tbuf;
+	while (tbuf != NULL) {
+		struct threadbuf *chain_next = tbuf->chain_next;
+		tbuf->chain_next = NULL;
+		tbuf->unused_next = membuf->tbuf_unused_first;
+		membuf->tbuf_unused_first = tbuf;
+		tbuf = chain_next;
+	}
 	os_mutex_unlock(&membuf->lists_lock);
 }
 
 /*
- * membuf_new -- allocates and initializes a new membuf instance
+ * membuf_new -- allocates and initializes a new membuf instance, with
+ * thread buffers of the given size (0 for the default) rounded up
+ * to a power of two
  */
 struct membuf *
-membuf_new(void *user_data)
+membuf_new(void *user_data, size_t size, enum membuf_pages pages)
 {
+	if (size == 0)
+		size = MEMBUF_LEN;
+	if (size > MEMBUF_MAX_LEN)
+		return NULL;
+
+	/* a smaller buffer would only waste the rest of the huge page */
+	size_t min_len = pages == MEMBUF_PAGES_NORMAL ?
+		MEMBUF_MIN_LEN : MEMBUF_HUGE_PAGE_LEN;
+	if (size < min_len)
+		size = min_len;
+	if (!util_is_pow2(size))
+		size = (size_t)1 << (util_mssb_index64(size) + 1);
+
 	struct membuf *membuf = malloc(sizeof(struct membuf));
 	if (membuf == NULL)
 		return NULL;
 
 	membuf->user_data = user_data;
+	membuf->tbuf_len = size;
+	membuf->max_tbufs = MEMBUF_MAX_THREADBUFS;
+	membuf->node = MEMBUF_NODE_LOCAL;
+	memset(&membuf->released, 0, sizeof(membuf->released));
+	membuf->pages = pages;
 	membuf->tbuf_first = NULL;
 	membuf->tbuf_unused_first = NULL;
 	os_mutex_init(&membuf->lists_lock);
@@ -83,6 +157,88 @@ membuf_new(void *user_data)
 	return membuf;
 }
 
+/*
+ * membuf_set_max_threadbufs -- sets the number of thread buffers a thread
+ * can allocate from, additional ones are chained when the previous ones are
+ * exhausted
+ */
+void
+membuf_set_max_threadbufs(struct membuf *membuf, size_t max_tbufs)
+{
+	membuf->max_tbufs = max_tbufs == 0 ? 1 : max_tbufs;
+}
+
+/*
+ * membuf_set_node -- sets the NUMA node the thread buffers allocated from
+ * now on prefer, MEMBUF_NODE_LOCAL for the node of the thread allocating
+ * from them or MEMBUF_NODE_ANY for no preference
+ */
+void
+membuf_set_node(struct membuf *membuf, int node)
+{
+	membuf->node = node;
+}
+
+/*
+ * membuf_threadbuf_alloc -- (internal) allocates a threadbuf aligned to its
+ * length from the requested pages, falls back to the transparent huge pages
+ * if the reserved ones are exhausted or misaligned. The pages prefer
+ * the given NUMA node, if it's not negative.
+ */
+static struct threadbuf *
+membuf_threadbuf_alloc(struct membuf *membuf, int node)
+{
+	size_t len = membuf->tbuf_len;
+	enum membuf_pages pages = membuf->pages;
+	struct threadbuf *tbuf = NULL;
+
+	if (pages == MEMBUF_PAGES_HUGETLB) {
+		/* huge pages are only aligned to their own size */
+		tbuf = util_huge_pages_map(len);
+		if (tbuf != NULL && ALIGN_DOWN((uintptr_t)tbuf, len) !=
+				(uintptr_t)tbuf) {
+			util_huge_pages_unmap(tbuf, len);
+			tbuf = NULL;
+		}
+		if (tbuf == NULL)
+			pages = MEMBUF_PAGES_TRANSPARENT_HUGE;
+	}
+
+	if (tbuf == NULL) {
+		tbuf = util_aligned_malloc(len, len);
+		if (tbuf == NULL)
+			return NULL;
+
+		/* only a hint, the kernel may have them disabled */
+		if (pages == MEMBUF_PAGES_TRANSPARENT_HUGE)
+			(void) util_transparent_huge_pages(tbuf, len);
+	}
+
+	/* also just a hint, without NUMA support the pages go anywhere */
+	if (node >= 0 && util_numa_prefer_node(tbuf, len, node) != 0)
+		node = -1;
+
+	tbuf->len = len;
+	tbuf->pages = pages;
+	tbuf->node = node;
+	memset(&tbuf->stats, 0, sizeof(tbuf->stats));
+
+	return tbuf;
+}
+
+/*
+ * membuf_threadbuf_free -- (internal) frees a threadbuf the way it was
+ * allocated
+ */
+static void
+membuf_threadbuf_free(struct threadbuf *tbuf)
+{
+	if (tbuf->pages == MEMBUF_PAGES_HUGETLB)
+		util_huge_pages_unmap(tbuf, tbuf->len);
+	else
+		util_aligned_free(tbuf);
+}
+
 /*
  * membuf_delete -- deallocates and cleans up a membuf instance
  */
@@ -92,7 +248,7 @@ membuf_delete(struct membuf *membuf)
 	os_tls_key_delete(membuf->bufkey);
 	for (struct threadbuf *tbuf = membuf->tbuf_first; tbuf != NULL; ) {
 		struct threadbuf *next = tbuf->next;
-		util_aligned_free(tbuf);
+		membuf_threadbuf_free(tbuf);
 		tbuf = next;
 	}
 	os_mutex_destroy(&membuf->lists_lock);
@@ -100,59 +256,124 @@ membuf_delete(struct membuf *membuf)
 }
 
 /*
- * membuf_entry_get_size -- returns the size of an entry
+ * membuf_size_class -- (internal) returns the size class of an entry
  */
-static size_t
-membuf_entry_get_size(void *real_ptr)
+static unsigned
+membuf_size_class(size_t real_size)
 {
-	struct membuf_entry *entry = real_ptr;
+	if (real_size <= MEMBUF_SMALL_MAX)
+		return (unsigned)((real_size - 1) / MEMBUF_GRANULE);
+
+	/* the smallest power of two, which is larger than MEMBUF_SMALL_MAX */
+	return MEMBUF_NSMALL_CLASSES - 12 + util_mssb_index64(real_size - 1);
+}
 
-	uint32_t size;
-	util_atomic_load_explicit32(&entry->size, &size, memory_order_acquire);
+/*
+ * membuf_class_size -- (internal) returns the size of entries of the class
+ */
+static size_t
+membuf_class_size(unsigned size_class)
+{
+	if (size_class < MEMBUF_NSMALL_CLASSES)
+		return (size_t)(size_class + 1) * MEMBUF_GRANULE;
 
-	return size;
+	return (size_t)1 << (size_class - MEMBUF_NSMALL_CLASSES + 13);
 }
 
 /*
- * membuf_entry_is_allocated -- checks whether the entry is allocated
+ * membuf_threadbuf_class_size -- (internal) returns the size of entries of
+ * the class in the buffer, an entry of a class larger than the buffer takes
+ * all of it
  */
-static int
-membuf_entry_is_allocated(void *real_ptr)
+static size_t
+membuf_threadbuf_class_size(struct threadbuf *tbuf, unsigned size_class)
 {
-	struct membuf_entry *entry = real_ptr;
-	int32_t allocated;
-	util_atomic_load_explicit32(&entry->allocated,
-		&allocated, memory_order_acquire);
+	size_t size = membuf_class_size(size_class);
 
-	return allocated;
+	return size < tbuf->size ? size : tbuf->size;
 }
 
 /*
- * membuf_threadbuf_prune -- reclaims available buffer space
+ * membuf_threadbuf_reset -- (internal) makes the whole buffer available
+ * for allocations, no entry can be allocated
  */
 static void
-membuf_threadbuf_prune(struct membuf *membuf,
-	struct threadbuf *tbuf)
+membuf_threadbuf_reset(struct threadbuf *tbuf)
 {
-	while (tbuf->available != tbuf->size) {
-		/* reuse leftovers after a wraparound */
-		if (tbuf->leftovers != 0 &&
-			(tbuf->size - (tbuf->offset + tbuf->available))
-				== tbuf->leftovers) {
-			tbuf->available += tbuf->leftovers;
-			tbuf->leftovers = 0;
-
-			continue;
-		}
+	tbuf->offset = 0;
+	tbuf->nlive = 0;
+	tbuf->freed = NULL;
+	for (unsigned i = 0; i < MEMBUF_NCLASSES; ++i)
+		tbuf->reusable[i] = NULL;
+	tbuf->stats.bytes_allocated = 0;
+	tbuf->stats.bytes_reusable = 0;
+}
+
+/*
+ * membuf_threadbuf_collect -- (internal) takes over the entries freed since
+ * the last collection for reuse
+ */
+static void
+membuf_threadbuf_collect(struct threadbuf *tbuf)
+{
+	struct membuf_entry *entry;
+	do {
+		util_atomic_load_explicit64(&tbuf->freed, &entry,
+			memory_order_acquire);
+	} while (entry != NULL &&
+		!util_bool_compare_and_swap64(&tbuf->freed, entry, NULL));
+
+	if (entry == NULL)
+		return;
+
+	tbuf->stats.collections++;
+	while (entry != NULL) {
+		struct membuf_entry *next = entry->next;
+		size_t size = membuf_threadbuf_class_size(tbuf,
+			entry->size_class);
+		entry->next = tbuf->reusable[entry->size_class];
+		tbuf->reusable[entry->size_class] = entry;
+		tbuf->nlive--;
+		tbuf->stats.collected++;
+		tbuf->stats.bytes_allocated -= size;
+		tbuf->stats.bytes_reusable += size;
+		entry = next;
+	}
+}
+
+/*
+ * membuf_threadbuf_get_entry -- (internal) returns a freed entry of the size
+ * class, or a new one from the memory never allocated from
+ */
+static struct membuf_entry *
+membuf_threadbuf_get_entry(struct threadbuf *tbuf, unsigned size_class)
+{
+	struct membuf_entry *entry = tbuf->reusable[size_class];
+	if (entry == NULL) {
+		membuf_threadbuf_collect(tbuf);
+		entry = tbuf->reusable[size_class];
+	}
 
-		/* check the next object after the available memory */
-		size_t next_loc = (tbuf->offset + tbuf->available) % tbuf->size;
-		void *next = &tbuf->buf[next_loc];
-		if (membuf_entry_is_allocated(next))
-			return;
+	size_t size = membuf_threadbuf_class_size(tbuf, size_class);
+	if (entry != NULL) {
+		tbuf->reusable[size_class] = entry->next;
+		tbuf->stats.bytes_reusable -= size;
+		return entry;
+	}
 
-		tbuf->available += membuf_entry_get_size(next);
+	if (tbuf->offset + size > tbuf->size) {
+		/* start over, so that other size classes can be allocated */
+		if (tbuf->nlive != 0)
+			return NULL;
+		membuf_threadbuf_reset(tbuf);
+		tbuf->stats.resets++;
 	}
+
+	entry = (struct membuf_entry *)((char *)tbuf +
+		MEMBUF_THREADBUF_HEADER + tbuf->offset);
+	tbuf->offset += size;
+
+	return entry;
 }
 
 /*
@@ -162,31 +383,37 @@ membuf_threadbuf_prune(struct membuf *membuf,
 static int
 tbuf_check_safe_for_reuse(struct threadbuf *tbuf)
 {
-	membuf_threadbuf_prune(tbuf->membuf, tbuf);
-	return tbuf->available == tbuf->size;
+	membuf_threadbuf_collect(tbuf);
+	return tbuf->nlive == 0;
 }
 
 /*
- * membuf_get_threadbuf -- returns thread-local buffer for allocations
+ * membuf_threadbuf_acquire -- (internal) returns an unused threadbuf on
+ * the requested NUMA node or a new one, ready for allocations
  */
 static struct threadbuf *
-membuf_get_threadbuf(struct membuf *membuf)
+membuf_threadbuf_acquire(struct membuf *membuf)
 {
-	struct threadbuf *tbuf = os_tls_get(membuf->bufkey);
-	if (tbuf != NULL)
-		return tbuf;
+	int node = membuf->node == MEMBUF_NODE_LOCAL ?
+		util_numa_node_current() : membuf->node;
 
 	os_mutex_lock(&membuf->lists_lock);
 
-	tbuf = membuf->tbuf_unused_first;
-	if (tbuf != NULL && tbuf_check_safe_for_reuse(tbuf)) {
-		membuf->tbuf_unused_first = tbuf->unused_next;
+	struct threadbuf **prev = &membuf->tbuf_unused_first;
+	while (*prev != NULL && !((node < 0 || (*prev)->node == node) &&
+			tbuf_check_safe_for_reuse(*prev)))
+		prev = &(*prev)->unused_next;
+
+	struct threadbuf *tbuf = *prev;
+	if (tbuf != NULL) {
+		*prev = tbuf->unused_next;
 	} else {
 		/*
-		 * Make sure buffer is aligned to 2MB so that we can align down
-		 * from contained pointers to access metadata (like user_data).
+		 * The buffer is aligned to its length so that we can align
+		 * down from contained pointers to access metadata (like
+		 * user_data).
 		 */
-		tbuf = util_aligned_malloc(MEMBUF_ALIGNMENT, MEMBUF_LEN);
+		tbuf = membuf_threadbuf_alloc(membuf, node);
 		if (tbuf == NULL) {
 			os_mutex_unlock(&membuf->lists_lock);
 			return NULL;
@@ -196,14 +423,12 @@ membuf_get_threadbuf(struct membuf *membuf)
 		membuf->tbuf_first = tbuf;
 	}
 
-	tbuf->size = MEMBUF_LEN - sizeof(*tbuf);
-	tbuf->offset = 0;
-	tbuf->leftovers = 0;
+	tbuf->size = tbuf->len - MEMBUF_THREADBUF_HEADER;
+	membuf_threadbuf_reset(tbuf);
 	tbuf->unused_next = NULL;
+	tbuf->chain_next = NULL;
 	tbuf->membuf = membuf;
-	tbuf->available = tbuf->size;
 	tbuf->user_data = membuf->user_data;
-	os_tls_set(membuf->bufkey, tbuf);
 
 	os_mutex_unlock(&membuf->lists_lock);
 
@@ -211,59 +436,187 @@ membuf_get_threadbuf(struct membuf *membuf)
 }
 
 /*
- * membuf_alloc -- allocate linearly from the available memory location.
+ * membuf_threadbuf_release -- (internal) deallocates a threadbuf without
+ * any live allocations
  */
-void *
-membuf_alloc(struct membuf *membuf, size_t size)
+static void
+membuf_threadbuf_release(struct membuf *membuf, struct threadbuf *tbuf)
 {
-	struct threadbuf *tbuf = membuf_get_threadbuf(membuf);
-	if (tbuf == NULL)
-		return NULL;
+	os_mutex_lock(&membuf->lists_lock);
+	struct threadbuf **prev = &membuf->tbuf_first;
+	while (*prev != tbuf)
+		prev = &(*prev)->next;
+	*prev = tbuf->next;
+
+	membuf->released.collections += tbuf->stats.collections;
+	membuf->released.collected += tbuf->stats.collected;
+	membuf->released.resets += tbuf->stats.resets;
+	membuf->released.failures += tbuf->stats.failures;
+	os_mutex_unlock(&membuf->lists_lock);
 
-	size_t real_size = size + sizeof(struct membuf_entry);
+	membuf_threadbuf_free(tbuf);
+}
 
-	if (real_size > tbuf->size)
-		return NULL;
+/*
+ * membuf_get_threadbuf -- returns the first thread-local buffer for
+ * allocations
+ */
+static struct threadbuf *
+membuf_get_threadbuf(struct membuf *membuf)
+{
+	struct threadbuf *tbuf = os_tls_get(membuf->bufkey);
+	if (tbuf != NULL)
+		return tbuf;
 
-	if (tbuf->offset + real_size > tbuf->size) {
-		tbuf->leftovers = tbuf->available;
-		tbuf->offset = 0;
-		tbuf->available = 0;
+	tbuf = membuf_threadbuf_acquire(membuf);
+	if (tbuf != NULL)
+		os_tls_set(membuf->bufkey, tbuf);
+
+	return tbuf;
+}
+
+/*
+ * membuf_release_drained -- (internal) releases the last threadbuf chained
+ * after the given one, if all of its allocations are freed
+ */
+static void
+membuf_release_drained(struct membuf *membuf, struct threadbuf *tbuf)
+{
+	struct threadbuf *prev = tbuf;
+	while (prev->chain_next->chain_next != NULL)
+		prev = prev->chain_next;
+
+	struct threadbuf *last = prev->chain_next;
+	if (tbuf_check_safe_for_reuse(last)) {
+		prev->chain_next = NULL;
+		membuf_threadbuf_release(membuf, last);
 	}
+}
 
-	/* wait until enough memory becomes available */
-	if (real_size > tbuf->available) {
-		membuf_threadbuf_prune(membuf, tbuf);
-		/*
-		 * Fail if not enough space was reclaimed and no
-		 * memory is available for further reclamation.
-		 */
-		if (real_size > tbuf->available)
-			return NULL;
+/*
+ * membuf_alloc_aligned -- allocate a freed entry of the same size class,
+ * or linearly from the available memory location, in the first thread buffer
+ * that has space for it. Another buffer is chained when all of them are
+ * exhausted. The returned pointer is a multiple of alignment, which has to be
+ * a power of two.
+ */
+void *
+membuf_alloc_aligned(struct membuf *membuf, size_t size, size_t alignment)
+{
+	struct threadbuf *first = membuf_get_threadbuf(membuf);
+	if (first == NULL)
+		return NULL;
+
+	if (!util_is_pow2(alignment) || alignment > MEMBUF_MAX_ALIGNMENT)
+		goto failed;
+
+	/*
+	 * Blocks start at multiples of MEMBUF_GRANULE, larger alignments
+	 * may need up to the whole alignment in front of the data.
+	 */
+	size_t padding = alignment <= MEMBUF_GRANULE ?
+		ALIGN_UP(sizeof(struct membuf_entry), alignment) : alignment;
+	size_t real_size = size + padding;
+
+	if (real_size > first->size)
+		goto failed;
+
+	unsigned size_class = membuf_size_class(real_size);
+	struct threadbuf *tbuf = first;
+	struct threadbuf *chained = NULL; /* the last one before this call */
+	struct membuf_entry *block;
+	size_t ntbufs = 1;
+	while ((block = membuf_threadbuf_get_entry(tbuf, size_class)) == NULL) {
+		if (tbuf->chain_next == NULL) {
+			if (ntbufs >= membuf->max_tbufs)
+				goto failed_chained;
+			if (chained == NULL)
+				chained = tbuf;
+			tbuf->chain_next = membuf_threadbuf_acquire(membuf);
+			if (tbuf->chain_next == NULL)
+				goto failed_chained;
+		}
+		tbuf = tbuf->chain_next;
+		ntbufs++;
 	}
 
-	size_t pos = tbuf->offset;
-	tbuf->offset += real_size;
-	tbuf->available -= real_size;
+	/* the earlier buffers suffice again, don't hold on to the others */
+	if (tbuf->chain_next != NULL)
+		membuf_release_drained(membuf, tbuf);
 
-	struct membuf_entry *entry = (struct membuf_entry *)&tbuf->buf[pos];
-	entry->size = (uint32_t)real_size;
-	entry->allocated = 1;
+	tbuf->nlive++;
+	tbuf->stats.bytes_allocated += membuf_threadbuf_class_size(tbuf,
+		size_class);
+
+	uintptr_t data = ALIGN_UP((uintptr_t)block +
+		sizeof(struct membuf_entry), alignment);
+	struct membuf_entry *entry = (struct membuf_entry *)
+		(data - sizeof(struct membuf_entry));
+	entry->size_class = size_class;
+	entry->alignment_shift = util_mssb_index64(tbuf->len);
+	entry->offset = (uint16_t)((uintptr_t)entry - (uintptr_t)block);
 
 	return &entry->data;
+
+failed_chained:
+	/* the buffers chained for this allocation have nothing allocated */
+	if (chained != NULL) {
+		tbuf = chained->chain_next;
+		chained->chain_next = NULL;
+		while (tbuf != NULL) {
+			struct threadbuf *next = tbuf->chain_next;
+			membuf_threadbuf_release(membuf, tbuf);
+			tbuf = next;
+		}
+	}
+failed:
+	TRACEPOINT(membuf_alloc_failed, membuf, size, alignment);
+	first->stats.failures++;
+	return NULL;
+}
+
+/*
+ * membuf_alloc -- allocate an entry without any particular alignment
+ */
+void *
+membuf_alloc(struct membuf *membuf, size_t size)
+{
+	return membuf_alloc_aligned(membuf, size, 1);
+}
+
+/*
+ * membuf_ptr_threadbuf -- (internal) returns the threadbuf containing
+ * the entry
+ */
+static struct threadbuf *
+membuf_ptr_threadbuf(struct membuf_entry *entry)
+{
+	return (struct threadbuf *)ALIGN_DOWN((uintptr_t)entry,
+		(uintptr_t)1 << entry->alignment_shift);
 }
 
 /*
- * membuf_free -- deallocates an entry
+ * membuf_free -- deallocates an entry, which can be reused as soon as
+ * the thread owning its buffer collects it
  */
 void
 membuf_free(void *ptr)
 {
 	struct membuf_entry *entry = (struct membuf_entry *)
 		((uintptr_t)ptr - sizeof(struct membuf_entry));
-
-	util_atomic_store_explicit64(&entry->allocated, 0,
-		memory_order_release);
+	struct threadbuf *tbuf = membuf_ptr_threadbuf(entry);
+
+	/* the header of the block may overlap the data */
+	struct membuf_entry *block = (struct membuf_entry *)
+		((uintptr_t)entry - entry->offset);
+	block->size_class = entry->size_class;
+
+	struct membuf_entry *next;
+	do {
+		util_atomic_load_explicit64(&tbuf->freed, &next,
+			memory_order_relaxed);
+		block->next = next;
+	} while (!util_bool_compare_and_swap64(&tbuf->freed, next, block));
 }
 
 /*
@@ -273,8 +626,59 @@ membuf_free(void *ptr)
 void *
 membuf_ptr_user_data(void *ptr)
 {
-	struct threadbuf *tbuf = (struct threadbuf *)ALIGN_DOWN((ptrdiff_t)ptr,
-		MEMBUF_ALIGNMENT);
+	struct membuf_entry *entry = (struct membuf_entry *)
+		((uintptr_t)ptr - sizeof(struct membuf_entry));
+
+	return membuf_ptr_threadbuf(entry)->user_data;
+}
+
+/*
+ * membuf_stats_load -- (internal) reads a counter updated by the owner
+ * of a threadbuf
+ */
+static uint64_t
+membuf_stats_load(const uint64_t *counter)
+{
+	uint64_t value;
+	util_atomic_load_explicit64(counter, &value, memory_order_relaxed);
+
+	return value;
+}
+
+/*
+ * membuf_get_stats -- sums up the statistics of all threadbufs, they are
+ * updated concurrently, so it's not an atomic snapshot
+ */
+void
+membuf_get_stats(struct membuf *membuf, struct vdm_membuf_stats *stats)
+{
+	os_mutex_lock(&membuf->lists_lock);
 
-	return tbuf->user_data;
+	*stats = membuf->released;
+	stats->buffers = 0;
+	stats->buffer_size = membuf->tbuf_len - MEMBUF_THREADBUF_HEADER;
+	stats->bytes_allocated = 0;
+	stats->bytes_available = 0;
+	stats->bytes_reusable = 0;
+	stats->max_bytes_allocated = 0;
+
+	for (struct threadbuf *tbuf = membuf->tbuf_first; tbuf != NULL;
+			tbuf = tbuf->next) {
+		struct vdm_membuf_stats *t = &tbuf->stats;
+		uint64_t allocated = membuf_stats_load(&t->bytes_allocated);
+
+		stats->buffers++;
+		stats->bytes_allocated += allocated;
+		stats->bytes_available += stats->buffer_size - allocated;
+		stats->bytes_reusable += membuf_stats_load(&t->bytes_reusable);
+		if (allocated > stats->max_bytes_allocated)
+			stats->max_bytes_allocated = allocated;
+
+		stats->collections += membuf_stats_load(&t->collections);
+		stats->collected += membuf_stats_load(&t->collected);
+		stats->resets += membuf_stats_load(&t->resets);
+		stats->failures += membuf_stats_load(&t->failures);
+	}
+
+	os_mutex_unlock(&membuf->lists_lock);
 }
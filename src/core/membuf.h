@@ -7,9 +7,15 @@
  * Membuf is a circular object buffer. Each instance uses an internal
  * per-thread buffer to avoid heavyweight synchronization.
  *
- * Allocation is linear and very cheap. The expectation is that objects within
- * the buffer will be reclaimable long before the linear allocator might need
- * to wraparound to reuse memory.
+ * Allocation is linear and very cheap. Freed objects are reused by later
+ * allocations of a similar size, in whatever order they were freed, so
+ * a long-lived object doesn't prevent the reuse of the other ones.
+ * A thread, which exhausts its buffer, chains additional ones, which are
+ * released once they are no longer needed. By default, the buffers prefer
+ * the NUMA node of the thread which first allocates from them.
+ *
+ * The per-thread buffers are aligned to their power-of-two size, so that
+ * the buffer of an allocation is found by aligning its address down.
  */
 
 #ifndef MEMBUF_H
@@ -17,14 +23,37 @@
 
 #include <stddef.h>
 
+#include "libminiasync/vdm.h"
+
 struct membuf;
 
-struct membuf *membuf_new(void *user_data);
+/* the kind of pages backing the per-thread buffers */
+enum membuf_pages {
+	MEMBUF_PAGES_NORMAL, /* regular pages of the heap */
+	MEMBUF_PAGES_TRANSPARENT_HUGE, /* transparent huge pages, if enabled */
+	MEMBUF_PAGES_HUGETLB, /* reserved huge pages, if there are enough */
+};
+
+/* the NUMA node preferred by the per-thread buffers */
+#define MEMBUF_NODE_ANY (-1) /* wherever the allocator puts them */
+#define MEMBUF_NODE_LOCAL (-2) /* the node of the thread using them */
+
+struct membuf *membuf_new(void *user_data, size_t size,
+	enum membuf_pages pages);
 void membuf_delete(struct membuf *membuf);
+void membuf_set_max_threadbufs(struct membuf *membuf, size_t max_tbufs);
+void membuf_set_node(struct membuf *membuf, int node);
+
+/* aligning to it keeps the objects out of the cache lines of the others */
+#define MEMBUF_CACHELINE_SIZE 64
 
 void *membuf_alloc(struct membuf *membuf, size_t size);
+void *membuf_alloc_aligned(struct membuf *membuf, size_t size,
+	size_t alignment);
 void membuf_free(void *ptr);
 
 void *membuf_ptr_user_data(void *ptr);
 
+void membuf_get_stats(struct membuf *membuf, struct vdm_membuf_stats *stats);
+
 #endif
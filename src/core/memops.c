@@ -0,0 +1,608 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * memops.c -- memory copy and fill kernels with non-temporal stores
+ *
+ * Every kernel stores the unaligned head and the tail of the destination
+ * with the libc routines and streams the cache lines in between. The best
+ * kernel supported by the cpu is selected once, on the first use, together
+ * with the best instruction writing back the cache lines.
+ *
+ * On platforms whose persistence domain includes the cpu caches (eADR),
+ * the stored cache lines don't have to be written back to be durable,
+ * so the durable operations only order their stores with a fence.
+ * Elsewhere (ADR), the durable operations of a few cache lines and more
+ * stream their stores past the cache, which leaves only the edges of
+ * the destination to write back, instead of copying and writing back
+ * every line afterwards.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <glob.h>
+#endif
+
+#include "cpu.h"
+#include "memops.h"
+#include "os.h"
+#include "os_thread.h"
+#include "util.h"
+
+/*
+ * memops_supported -- (internal) reports the kernel as always supported
+ */
+static int
+memops_supported(void)
+{
+	return 1;
+}
+
+/*
+ * memops_generic_memcpy_nt -- (internal) copies memory through the cache
+ */
+static void
+memops_generic_memcpy_nt(void *dst, const void *src, size_t n)
+{
+	memcpy(dst, src, n);
+}
+
+/*
+ * memops_generic_memset_nt -- (internal) fills memory through the cache
+ */
+static void
+memops_generic_memset_nt(void *dst, int c, size_t n)
+{
+	memset(dst, c, n);
+}
+
+/*
+ * Fills of cached memory copy the already filled part of the destination,
+ * in chunks small enough to be read from the L1 cache.
+ */
+#define MEMOPS_FILL_CHUNK 4096
+
+/*
+ * memops_generic_memfill_nt -- (internal) fills memory with the line
+ * of the pattern through the cache
+ */
+static void
+memops_generic_memfill_nt(void *dst, const void *line, size_t n)
+{
+	char *d = dst;
+	size_t filled = n < MEMOPS_FILL_LINE ? n : MEMOPS_FILL_LINE;
+	memcpy(d, line, filled);
+
+	/* the filled part is a multiple of the line, until the last chunk */
+	while (filled < n) {
+		size_t chunk = filled < MEMOPS_FILL_CHUNK ?
+			filled : MEMOPS_FILL_CHUNK;
+		if (chunk > n - filled)
+			chunk = n - filled;
+		memcpy(d + filled, d, chunk);
+		filled += chunk;
+	}
+}
+
+#ifndef MEMOPS_FLUSH_SUPPORTED
+/*
+ * memops_generic_flush -- (internal) the cache lines can't be written back
+ */
+static void
+memops_generic_flush(const void *addr, size_t n)
+{
+	SUPPRESS_UNUSED(addr, n);
+}
+#endif
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(_M_X64) || \
+	defined(_M_AMD64)
+
+#include <immintrin.h>
+
+/* the kernels are built for their instruction set, whatever the flags */
+#if defined(__GNUC__) || defined(__clang__)
+#define MEMOPS_TARGET(isa) __attribute__((target(isa)))
+#else
+#define MEMOPS_TARGET(isa)
+#endif
+
+#define MEMOPS_LINE 64
+
+/*
+ * memops_head -- (internal) returns the number of bytes in front of
+ * the first cache line aligned address of the destination
+ */
+static size_t
+memops_head(const void *dst, size_t n)
+{
+	size_t head = (size_t)((0 - (uintptr_t)dst) & (MEMOPS_LINE - 1));
+
+	return head < n ? head : n;
+}
+
+/*
+ * memops_rotate_line -- (internal) rotates the line of the pattern,
+ * so that it starts off bytes further
+ */
+static void
+memops_rotate_line(char *rotated, const char *line, size_t off)
+{
+	memcpy(rotated, line + off, MEMOPS_LINE - off);
+	memcpy(rotated + MEMOPS_LINE - off, line, off);
+}
+
+/*
+ * MEMOPS_KERNELS -- defines the copy and fill kernels, which stream
+ * whole cache lines with the line_copy and line_fill routines of the isa
+ */
+#define MEMOPS_KERNELS(isa, target)\
+static MEMOPS_TARGET(target) void \
+memops_##isa##_memcpy_nt(void *dst, const void *src, size_t n)\
+{\
+	char *d = dst;\
+	const char *s = src;\
+	size_t head = memops_head(d, n);\
+	memcpy(d, s, head);\
+	d += head;\
+	s += head;\
+	n -= head;\
+	for (; n >= MEMOPS_LINE; n -= MEMOPS_LINE) {\
+		memops_##isa##_line_copy(d, s);\
+		d += MEMOPS_LINE;\
+		s += MEMOPS_LINE;\
+	}\
+	_mm_sfence();\
+	memcpy(d, s, n);\
+}\
+static MEMOPS_TARGET(target) void \
+memops_##isa##_memset_nt(void *dst, int c, size_t n)\
+{\
+	char *d = dst;\
+	size_t head = memops_head(d, n);\
+	memset(d, c, head);\
+	d += head;\
+	n -= head;\
+	for (; n >= MEMOPS_LINE; n -= MEMOPS_LINE) {\
+		memops_##isa##_line_fill(d, c);\
+		d += MEMOPS_LINE;\
+	}\
+	_mm_sfence();\
+	memset(d, c, n);\
+}\
+static MEMOPS_TARGET(target) void \
+memops_##isa##_memfill_nt(void *dst, const void *line, size_t n)\
+{\
+	char *d = dst;\
+	size_t head = memops_head(d, n);\
+	memcpy(d, line, head);\
+	d += head;\
+	n -= head;\
+	char rotated[MEMOPS_LINE];\
+	memops_rotate_line(rotated, line, head);\
+	for (; n >= MEMOPS_LINE; n -= MEMOPS_LINE) {\
+		memops_##isa##_line_copy(d, rotated);\
+		d += MEMOPS_LINE;\
+	}\
+	_mm_sfence();\
+	memcpy(d, rotated, n);\
+}
+
+/*
+ * memops_sse2_line_copy -- (internal) streams a cache line with SSE2
+ */
+static inline MEMOPS_TARGET("sse2") void
+memops_sse2_line_copy(char *d, const char *s)
+{
+	__m128i *dl = (__m128i *)d;
+	const __m128i *sl = (const __m128i *)s;
+	__m128i x0 = _mm_loadu_si128(sl + 0);
+	__m128i x1 = _mm_loadu_si128(sl + 1);
+	__m128i x2 = _mm_loadu_si128(sl + 2);
+	__m128i x3 = _mm_loadu_si128(sl + 3);
+	_mm_stream_si128(dl + 0, x0);
+	_mm_stream_si128(dl + 1, x1);
+	_mm_stream_si128(dl + 2, x2);
+	_mm_stream_si128(dl + 3, x3);
+}
+
+/*
+ * memops_sse2_line_fill -- (internal) fills a cache line with SSE2
+ */
+static inline MEMOPS_TARGET("sse2") void
+memops_sse2_line_fill(char *d, int c)
+{
+	__m128i *dl = (__m128i *)d;
+	__m128i x = _mm_set1_epi8((char)c);
+	_mm_stream_si128(dl + 0, x);
+	_mm_stream_si128(dl + 1, x);
+	_mm_stream_si128(dl + 2, x);
+	_mm_stream_si128(dl + 3, x);
+}
+
+MEMOPS_KERNELS(sse2, "sse2")
+
+/*
+ * memops_avx2_line_copy -- (internal) streams a cache line with AVX2
+ */
+static inline MEMOPS_TARGET("avx2") void
+memops_avx2_line_copy(char *d, const char *s)
+{
+	__m256i *dl = (__m256i *)d;
+	const __m256i *sl = (const __m256i *)s;
+	__m256i y0 = _mm256_loadu_si256(sl + 0);
+	__m256i y1 = _mm256_loadu_si256(sl + 1);
+	_mm256_stream_si256(dl + 0, y0);
+	_mm256_stream_si256(dl + 1, y1);
+}
+
+/*
+ * memops_avx2_line_fill -- (internal) fills a cache line with AVX2
+ */
+static inline MEMOPS_TARGET("avx2") void
+memops_avx2_line_fill(char *d, int c)
+{
+	__m256i *dl = (__m256i *)d;
+	__m256i y = _mm256_set1_epi8((char)c);
+	_mm256_stream_si256(dl + 0, y);
+	_mm256_stream_si256(dl + 1, y);
+}
+
+MEMOPS_KERNELS(avx2, "avx2")
+
+/*
+ * memops_avx512f_line_copy -- (internal) streams a cache line with AVX-512
+ */
+static inline MEMOPS_TARGET("avx512f") void
+memops_avx512f_line_copy(char *d, const char *s)
+{
+	_mm512_stream_si512((void *)d, _mm512_loadu_si512((const void *)s));
+}
+
+/*
+ * memops_avx512f_line_fill -- (internal) fills a cache line with AVX-512
+ */
+static inline MEMOPS_TARGET("avx512f") void
+memops_avx512f_line_fill(char *d, int c)
+{
+	/* byte broadcast needs AVX-512BW, the foundation has only dwords */
+	int dword = (int)((unsigned char)c * 0x01010101U);
+	_mm512_stream_si512((void *)d, _mm512_set1_epi32(dword));
+}
+
+MEMOPS_KERNELS(avx512f, "avx512f")
+
+/*
+ * memops_movdir64b_line_copy -- (internal) stores a cache line with
+ * a single 64-byte direct store
+ */
+static inline void
+memops_movdir64b_line_copy(char *d, const char *s)
+{
+#if defined(__x86_64__) || defined(__amd64__)
+	/*
+	 * movdir64b (%rsi), %rdi -- the instruction is emitted as raw bytes,
+	 * like the waitpkg ones in cpu.c
+	 */
+	__asm__ volatile(".byte 0x66, 0x0f, 0x38, 0xf8, 0x3e"
+		: : "D"(d), "S"(s) : "memory");
+#else
+	_movdir64b(d, s);
+#endif
+}
+
+/*
+ * memops_movdir64b_line_fill -- (internal) fills a cache line with
+ * a single 64-byte direct store
+ */
+static inline void
+memops_movdir64b_line_fill(char *d, int c)
+{
+	char line[MEMOPS_LINE];
+	memset(line, c, sizeof(line));
+	memops_movdir64b_line_copy(d, line);
+}
+
+MEMOPS_KERNELS(movdir64b, "sse2")
+
+/*
+ * MEMOPS_FLUSH -- defines the routine writing back all the cache lines
+ * of the range with the given instruction
+ */
+#define MEMOPS_FLUSH(insn, target)\
+static MEMOPS_TARGET(target) void \
+memops_##insn##_flush(const void *addr, size_t n)\
+{\
+	uintptr_t line = (uintptr_t)addr & ~(uintptr_t)(MEMOPS_LINE - 1);\
+	uintptr_t end = (uintptr_t)addr + n;\
+	for (; line < end; line += MEMOPS_LINE)\
+		_mm_##insn((void *)line);\
+	_mm_sfence();\
+}
+
+/* clwb keeps the lines in the cache, the other ones evict them */
+MEMOPS_FLUSH(clwb, "clwb")
+MEMOPS_FLUSH(clflushopt, "clflushopt")
+/* part of the x86-64 baseline, but serialized with the other flushes */
+MEMOPS_FLUSH(clflush, "sse2")
+
+/*
+ * memops_fence_flush -- (internal) orders the stores to the range, which
+ * are durable once they reach the cache
+ */
+static void
+memops_fence_flush(const void *addr, size_t n)
+{
+	SUPPRESS_UNUSED(addr, n);
+	_mm_sfence();
+}
+
+#ifdef __linux__
+#define MEMOPS_PERSISTENCE_DOMAINS \
+	"/sys/bus/nd/devices/region*/persistence_domain"
+
+/*
+ * memops_cache_persistent -- (internal) checks whether the persistence
+ * domain of all the pmem regions of the platform includes the cpu caches
+ */
+static int
+memops_cache_persistent(void)
+{
+	glob_t domains;
+	if (glob(MEMOPS_PERSISTENCE_DOMAINS, 0, NULL, &domains) != 0)
+		return 0;
+
+	int persistent = 1;
+	for (size_t i = 0; persistent && i < domains.gl_pathc; ++i) {
+		char domain[32] = "";
+		FILE *f = os_fopen(domains.gl_pathv[i], "r");
+		if (f == NULL) {
+			persistent = 0;
+			break;
+		}
+		if (fgets(domain, sizeof(domain), f) == NULL)
+			domain[0] = '\0';
+		fclose(f);
+
+		persistent = strncmp(domain, "cpu_cache", 9) == 0;
+	}
+	globfree(&domains);
+
+	return persistent;
+}
+#else
+/*
+ * memops_cache_persistent -- (internal) the persistence domain of
+ * the platform is assumed not to include the cpu caches
+ */
+static int
+memops_cache_persistent(void)
+{
+	return 0;
+}
+#endif
+
+#endif
+
+/* kernels in the order of preference */
+static const struct memops memops_kernels[] = {
+#if defined(__x86_64__) || defined(__amd64__) || defined(_M_X64) || \
+	defined(_M_AMD64)
+	/* every line is written at once, never partially */
+	{"movdir64b", is_cpu_movdir64b_present,
+		memops_movdir64b_memcpy_nt, memops_movdir64b_memset_nt,
+		memops_movdir64b_memfill_nt},
+	{"avx512f", is_cpu_avx512f_present,
+		memops_avx512f_memcpy_nt, memops_avx512f_memset_nt,
+		memops_avx512f_memfill_nt},
+	{"avx2", is_cpu_avx2_present,
+		memops_avx2_memcpy_nt, memops_avx2_memset_nt,
+		memops_avx2_memfill_nt},
+	/* part of the x86-64 baseline */
+	{"sse2", memops_supported,
+		memops_sse2_memcpy_nt, memops_sse2_memset_nt,
+		memops_sse2_memfill_nt},
+#endif
+	{"generic", memops_supported,
+		memops_generic_memcpy_nt, memops_generic_memset_nt,
+		memops_generic_memfill_nt},
+};
+
+#define MEMOPS_NKERNELS (sizeof(memops_kernels) / sizeof(memops_kernels[0]))
+
+static os_once_t memops_once = OS_ONCE_INIT;
+static const struct memops *memops_selected;
+static void (*memops_flush_selected)(const void *addr, size_t n);
+static int memops_no_flush; /* the caches are in the persistence domain */
+
+/*
+ * memops_select -- (internal) selects the first supported kernel and
+ * the best instruction writing back the cache lines, unless the caches
+ * are in the persistence domain, which can be forced either way with
+ * the MINIASYNC_NO_FLUSH environment variable
+ */
+static void
+memops_select(void)
+{
+	for (size_t i = 0; i < MEMOPS_NKERNELS; ++i) {
+		if (memops_kernels[i].is_supported()) {
+			memops_selected = &memops_kernels[i];
+			break;
+		}
+	}
+
+#ifdef MEMOPS_FLUSH_SUPPORTED
+	char *no_flush = os_getenv("MINIASYNC_NO_FLUSH");
+	if (no_flush != NULL && (no_flush[0] == '0' || no_flush[0] == '1'))
+		memops_no_flush = no_flush[0] == '1';
+	else
+		memops_no_flush = memops_cache_persistent();
+
+	if (memops_no_flush)
+		memops_flush_selected = memops_fence_flush;
+	else if (is_cpu_clwb_present())
+		memops_flush_selected = memops_clwb_flush;
+	else if (is_cpu_clflushopt_present())
+		memops_flush_selected = memops_clflushopt_flush;
+	else
+		memops_flush_selected = memops_clflush_flush;
+#else
+	memops_flush_selected = memops_generic_flush;
+#endif
+}
+
+/*
+ * memops_get -- returns the i-th kernel in the order of preference,
+ * or NULL if there are fewer kernels, whether it's supported or not
+ */
+const struct memops *
+memops_get(size_t i)
+{
+	return i < MEMOPS_NKERNELS ? &memops_kernels[i] : NULL;
+}
+
+/*
+ * memops_best -- returns the most preferred kernel supported by the cpu
+ */
+const struct memops *
+memops_best(void)
+{
+	os_once(&memops_once, memops_select);
+
+	return memops_selected;
+}
+
+/*
+ * memops_flush -- writes back the cache lines of the range to memory,
+ * or only orders the stores, if the caches are in the persistence domain
+ */
+void
+memops_flush(const void *addr, size_t n)
+{
+	os_once(&memops_once, memops_select);
+
+	memops_flush_selected(addr, n);
+}
+
+/*
+ * memops_flush_edges -- (internal) writes back the first and the last
+ * cache line of the range, which the kernels store through the cache
+ */
+static void
+memops_flush_edges(const void *addr, size_t n)
+{
+	if (n == 0)
+		return;
+
+	memops_flush(addr, 1);
+	memops_flush((const char *)addr + n - 1, 1);
+}
+
+/*
+ * memops_nt -- (internal) checks whether the operation bypasses the cache
+ */
+static int
+memops_nt(size_t n, unsigned flags)
+{
+	if ((flags & MEMOPS_F_NO_CACHE) || n >= MEMOPS_NT_THRESHOLD)
+		return 1;
+
+	os_once(&memops_once, memops_select);
+
+	/* streaming the lines is cheaper than writing them back afterwards */
+	return (flags & MEMOPS_F_DURABLE) && !memops_no_flush &&
+		n >= MEMOPS_DURABLE_NT_THRESHOLD;
+}
+
+/*
+ * memops_memcpy -- copies memory, bypassing the cache if the operation is
+ * large, durable, or if it's requested
+ */
+void
+memops_memcpy(void *dst, const void *src, size_t n, unsigned flags)
+{
+	if (memops_nt(n, flags)) {
+		memops_best()->memcpy_nt(dst, src, n);
+		if (flags & MEMOPS_F_DURABLE)
+			memops_flush_edges(dst, n);
+		return;
+	}
+
+	memcpy(dst, src, n);
+	if (flags & MEMOPS_F_DURABLE)
+		memops_flush(dst, n);
+}
+
+/*
+ * memops_memmove -- moves memory like memops_memcpy, overlapping buffers
+ * are moved through the cache
+ */
+void
+memops_memmove(void *dst, const void *src, size_t n, unsigned flags)
+{
+	uintptr_t d = (uintptr_t)dst;
+	uintptr_t s = (uintptr_t)src;
+	if (d >= s + n || s >= d + n) {
+		memops_memcpy(dst, src, n, flags);
+		return;
+	}
+
+	memmove(dst, src, n);
+	if (flags & MEMOPS_F_DURABLE)
+		memops_flush(dst, n);
+}
+
+/*
+ * memops_memset -- fills memory, bypassing the cache if the operation is
+ * large, durable, or if it's requested
+ */
+void
+memops_memset(void *dst, int c, size_t n, unsigned flags)
+{
+	if (memops_nt(n, flags)) {
+		memops_best()->memset_nt(dst, c, n);
+		if (flags & MEMOPS_F_DURABLE)
+			memops_flush_edges(dst, n);
+		return;
+	}
+
+	memset(dst, c, n);
+	if (flags & MEMOPS_F_DURABLE)
+		memops_flush(dst, n);
+}
+
+/*
+ * memops_memfill -- fills memory with the pattern of pattern_len bytes,
+ * repeated from the beginning of dst, bypassing the cache if the operation
+ * is large, durable, or if it's requested, returns -1 if pattern_len isn't
+ * a power of two up to MEMOPS_FILL_MAX_PATTERN
+ */
+int
+memops_memfill(void *dst, const void *pattern, size_t pattern_len, size_t n,
+	unsigned flags)
+{
+	if (!util_is_pow2(pattern_len) ||
+	    pattern_len > MEMOPS_FILL_MAX_PATTERN)
+		return -1;
+
+	char line[MEMOPS_FILL_LINE];
+	memcpy(line, pattern, pattern_len);
+	for (size_t len = pattern_len; len < MEMOPS_FILL_LINE; len *= 2)
+		memcpy(line + len, line, len);
+
+	if (memops_nt(n, flags)) {
+		memops_best()->memfill_nt(dst, line, n);
+		if (flags & MEMOPS_F_DURABLE)
+			memops_flush_edges(dst, n);
+		return 0;
+	}
+
+	memops_generic_memfill_nt(dst, line, n);
+	if (flags & MEMOPS_F_DURABLE)
+		memops_flush(dst, n);
+
+	return 0;
+}
@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * memops.h -- internal definitions for the memory copy and fill kernels
+ *
+ * The kernels bypass the cache with non-temporal stores, so that large
+ * streaming operations don't evict the working set of the application.
+ * Their stores are ordered with a store fence before they return.
+ *
+ * The fills with wider patterns stream the cache lines of the repeated
+ * pattern with the copy instructions of the kernels.
+ *
+ * The memops_mem* routines use them for large operations, durable ones and
+ * on request, and write back the stored cache lines, if the result has to
+ * be durable and the caches aren't in the persistence domain.
+ *
+ * The compare, checksum and delta record kernels are the cpu counterparts
+ * of the other DSA operations.
+ */
+
+#ifndef MEMOPS_H
+#define MEMOPS_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Operations this large would evict a big part of the cache of the core
+ * performing them, smaller ones are left to the libc routines.
+ */
+#define MEMOPS_NT_THRESHOLD ((size_t)1 << 20)
+
+/*
+ * Durable operations this large are cheaper to stream past the cache, than
+ * to write back line by line, unless the caches are in the persistence
+ * domain.
+ */
+#define MEMOPS_DURABLE_NT_THRESHOLD ((size_t)256)
+
+/* cache lines can be written back to memory on this architecture */
+#if defined(__x86_64__) || defined(__amd64__) || defined(_M_X64) || \
+	defined(_M_AMD64)
+#define MEMOPS_FLUSH_SUPPORTED 1
+#endif
+
+#define MEMOPS_F_DURABLE (1U << 0) /* written back when the routine returns */
+#define MEMOPS_F_NO_CACHE (1U << 1) /* bypass the cache, whatever the size */
+
+struct memops {
+	const char *name;
+	int (*is_supported)(void);
+	void (*memcpy_nt)(void *dst, const void *src, size_t n);
+	void (*memset_nt)(void *dst, int c, size_t n);
+	/* the line is the pattern repeated from the beginning of dst */
+	void (*memfill_nt)(void *dst, const void *line, size_t n);
+};
+
+/* the fill patterns are powers of two, which divide a cache line */
+#define MEMOPS_FILL_LINE 64
+#define MEMOPS_FILL_MAX_PATTERN MEMOPS_FILL_LINE
+
+const struct memops *memops_get(size_t i);
+const struct memops *memops_best(void);
+
+void memops_flush(const void *addr, size_t n);
+void memops_memcpy(void *dst, const void *src, size_t n, unsigned flags);
+void memops_memmove(void *dst, const void *src, size_t n, unsigned flags);
+void memops_memset(void *dst, int c, size_t n, unsigned flags);
+int memops_memfill(void *dst, const void *pattern, size_t pattern_len,
+	size_t n, unsigned flags);
+
+/* an entry of a delta record is a 2-byte word index and the 8-byte word */
+#define MEMOPS_DELTA_ENTRY_SIZE 10
+#define MEMOPS_DELTA_MAX_SIZE ((size_t)1 << 19) /* all words can be indexed */
+
+#define MEMOPS_DELTA_EQUAL 0 /* no differences, the record is empty */
+#define MEMOPS_DELTA_CREATED 1 /* the record holds all the differences */
+#define MEMOPS_DELTA_OVERFLOW 2 /* not all the differences fit the record */
+
+size_t memops_compare(const void *s1, const void *s2, size_t n);
+size_t memops_compare_pattern(const void *s, uint64_t pattern, size_t n);
+uint32_t memops_crc32c(uint32_t crc, const void *s, size_t n);
+int memops_delta_create(const void *original, const void *modified, size_t n,
+	void *delta, size_t delta_max, size_t *delta_size);
+int memops_delta_apply(void *dst, size_t n, const void *delta,
+	size_t delta_size, unsigned flags);
+
+#endif /* MEMOPS_H */
@@ -0,0 +1,244 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * memops_compare.c -- memory compare, checksum and delta record kernels
+ *
+ * These are the cpu implementations of the operations, which DSA performs
+ * besides copying and filling memory. The delta records have the format
+ * of the DSA ones, so that a record created by one data mover can be
+ * applied by any other.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "memops.h"
+#include "os_thread.h"
+#include "util.h"
+
+/* the buffers are compared with memcmp in blocks of this size */
+#define MEMOPS_COMPARE_BLOCK 4096
+
+/*
+ * memops_compare -- returns the offset of the first byte, which differs
+ * in the two buffers, or n if they are equal
+ */
+size_t
+memops_compare(const void *s1, const void *s2, size_t n)
+{
+	const char *a = s1;
+	const char *b = s2;
+
+	size_t off = 0;
+	/* memcmp doesn't report where the difference is, only if there's one */
+	while (off < n) {
+		size_t len = n - off < MEMOPS_COMPARE_BLOCK ?
+			n - off : MEMOPS_COMPARE_BLOCK;
+		if (memcmp(a + off, b + off, len) != 0)
+			break;
+		off += len;
+	}
+
+	while (off < n && a[off] == b[off])
+		++off;
+
+	return off;
+}
+
+/*
+ * memops_compare_pattern -- returns the offset of the first byte, which
+ * differs from the 8-byte pattern repeated from the beginning of the buffer,
+ * or n if there's no such byte
+ */
+size_t
+memops_compare_pattern(const void *s, uint64_t pattern, size_t n)
+{
+	const char *a = s;
+	const char *p = (const char *)&pattern;
+
+	size_t off = 0;
+	for (; off + sizeof(pattern) <= n; off += sizeof(pattern)) {
+		uint64_t word;
+		memcpy(&word, a + off, sizeof(word));
+		if (word != pattern)
+			break;
+	}
+
+	while (off < n && a[off] == p[off % sizeof(pattern)])
+		++off;
+
+	return off;
+}
+
+/* reversed Castagnoli polynomial */
+#define MEMOPS_CRC32C_POLY 0x82f63b78U
+
+static os_once_t memops_crc32c_once = OS_ONCE_INIT;
+static uint32_t (*memops_crc32c_selected)(uint32_t crc, const char *s,
+	size_t n);
+static uint32_t memops_crc32c_table[256];
+
+/*
+ * memops_generic_crc32c -- (internal) updates the inverted crc with
+ * the lookup table, one byte at a time
+ */
+static uint32_t
+memops_generic_crc32c(uint32_t crc, const char *s, size_t n)
+{
+	for (size_t i = 0; i < n; ++i) {
+		crc = memops_crc32c_table[(crc ^ (uint8_t)s[i]) & 0xff] ^
+			(crc >> 8);
+	}
+
+	return crc;
+}
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(_M_X64) || \
+	defined(_M_AMD64)
+
+#include <immintrin.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MEMOPS_TARGET(isa) __attribute__((target(isa)))
+#else
+#define MEMOPS_TARGET(isa)
+#endif
+
+/*
+ * memops_sse42_crc32c -- (internal) updates the inverted crc eight bytes
+ * at a time, using the crc32 instruction
+ */
+static MEMOPS_TARGET("sse4.2") uint32_t
+memops_sse42_crc32c(uint32_t crc, const char *s, size_t n)
+{
+	uint64_t crc64 = crc;
+	size_t i = 0;
+	for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, s + i, sizeof(word));
+		crc64 = _mm_crc32_u64(crc64, word);
+	}
+
+	crc = (uint32_t)crc64;
+	for (; i < n; ++i)
+		crc = _mm_crc32_u8(crc, (uint8_t)s[i]);
+
+	return crc;
+}
+
+#endif
+
+/*
+ * memops_crc32c_select -- (internal) fills the lookup table and selects
+ * the crc32 instruction, if the cpu supports it
+ */
+static void
+memops_crc32c_select(void)
+{
+	for (uint32_t i = 0; i < 256; ++i) {
+		uint32_t crc = i;
+		for (int j = 0; j < 8; ++j)
+			crc = (crc >> 1) ^ ((crc & 1) ? MEMOPS_CRC32C_POLY : 0);
+		memops_crc32c_table[i] = crc;
+	}
+
+	memops_crc32c_selected = memops_generic_crc32c;
+#if defined(__x86_64__) || defined(__amd64__) || defined(_M_X64) || \
+	defined(_M_AMD64)
+	if (is_cpu_sse42_present())
+		memops_crc32c_selected = memops_sse42_crc32c;
+#endif
+}
+
+/*
+ * memops_crc32c -- continues the CRC-32C checksum crc, 0 for a new one,
+ * with n more bytes
+ */
+uint32_t
+memops_crc32c(uint32_t crc, const void *s, size_t n)
+{
+	os_once(&memops_crc32c_once, memops_crc32c_select);
+
+	return ~memops_crc32c_selected(~crc, s, n);
+}
+
+/*
+ * A delta record entry is the index of the 8-byte word, which differs,
+ * followed by the word of the modified buffer.
+ */
+#define MEMOPS_DELTA_WORD sizeof(uint64_t)
+
+/*
+ * memops_delta_create -- compares the two buffers, 8 bytes at a time,
+ * and writes the words of the modified buffer, which differ from the original
+ * ones, into the delta record of at most delta_max bytes
+ *
+ * Returns MEMOPS_DELTA_EQUAL, MEMOPS_DELTA_CREATED or MEMOPS_DELTA_OVERFLOW,
+ * the size of the record is stored in delta_size. Returns -1 if n isn't
+ * a multiple of 8 or is larger than MEMOPS_DELTA_MAX_SIZE.
+ */
+int
+memops_delta_create(const void *original, const void *modified, size_t n,
+	void *delta, size_t delta_max, size_t *delta_size)
+{
+	*delta_size = 0;
+	if (n % MEMOPS_DELTA_WORD != 0 || n > MEMOPS_DELTA_MAX_SIZE)
+		return -1;
+
+	const char *a = original;
+	const char *b = modified;
+	char *d = delta;
+
+	size_t size = 0;
+	size_t off = 0;
+	while ((off = memops_compare(a + off, b + off, n - off) + off) < n) {
+		off -= off % MEMOPS_DELTA_WORD;
+		if (size + MEMOPS_DELTA_ENTRY_SIZE > delta_max)
+			return MEMOPS_DELTA_OVERFLOW;
+
+		uint16_t index = (uint16_t)(off / MEMOPS_DELTA_WORD);
+		d[size] = (char)(index & 0xff);
+		d[size + 1] = (char)(index >> 8);
+		memcpy(d + size + sizeof(index), b + off, MEMOPS_DELTA_WORD);
+		size += MEMOPS_DELTA_ENTRY_SIZE;
+		*delta_size = size;
+
+		off += MEMOPS_DELTA_WORD;
+	}
+
+	return size == 0 ? MEMOPS_DELTA_EQUAL : MEMOPS_DELTA_CREATED;
+}
+
+/*
+ * memops_delta_apply -- writes the words of the delta record into
+ * the n bytes long buffer, returns -1 if the record is malformed or doesn't
+ * fit the buffer, the words before the malformed entry are written
+ */
+int
+memops_delta_apply(void *dst, size_t n, const void *delta, size_t delta_size,
+	unsigned flags)
+{
+	if (delta_size % MEMOPS_DELTA_ENTRY_SIZE != 0)
+		return -1;
+
+	char *a = dst;
+	const uint8_t *d = delta;
+
+	int ret = 0;
+	for (size_t i = 0; i < delta_size; i += MEMOPS_DELTA_ENTRY_SIZE) {
+		size_t index = (size_t)d[i] | (size_t)d[i + 1] << 8;
+		size_t off = index * MEMOPS_DELTA_WORD;
+		if (off + MEMOPS_DELTA_WORD > n) {
+			ret = -1;
+			break;
+		}
+
+		memcpy(a + off, d + i + 2, MEMOPS_DELTA_WORD);
+		if (flags & MEMOPS_F_DURABLE)
+			memops_flush(a + off, MEMOPS_DELTA_WORD);
+	}
+
+	return ret;
+}
@@ -10,6 +10,7 @@
 
 #include <sys/stat.h>
 #include <stdio.h>
+#include <stdint.h>
 
 #include "errno_freebsd.h"
 
@@ -81,6 +82,9 @@ int os_mkstemp(char *temp);
 int os_ftruncate(int fd, os_off_t length);
 int os_flock(int fd, int operation);
 ssize_t os_writev(int fd, const struct iovec *iov, int iovcnt);
+ssize_t os_pread(int fd, void *buf, size_t count, uint64_t offset);
+ssize_t os_pwrite(int fd, const void *buf, size_t count, uint64_t offset);
+int os_fdatasync(int fd);
 int os_clock_gettime(int id, struct timespec *ts);
 unsigned os_rand_r(unsigned *seedp);
 int os_unsetenv(const char *name);
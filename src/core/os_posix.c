@@ -116,6 +116,37 @@ os_writev(int fd, const struct iovec *iov, int iovcnt)
 	return writev(fd, iov, iovcnt);
 }
 
+/*
+ * os_pread -- pread abstraction layer
+ */
+ssize_t
+os_pread(int fd, void *buf, size_t count, uint64_t offset)
+{
+	return pread(fd, buf, count, (off_t)offset);
+}
+
+/*
+ * os_pwrite -- pwrite abstraction layer
+ */
+ssize_t
+os_pwrite(int fd, const void *buf, size_t count, uint64_t offset)
+{
+	return pwrite(fd, buf, count, (off_t)offset);
+}
+
+/*
+ * os_fdatasync -- fdatasync abstraction layer
+ */
+int
+os_fdatasync(int fd)
+{
+#ifdef __APPLE__
+	return fsync(fd);
+#else
+	return fdatasync(fd);
+#endif
+}
+
 /*
  * os_clock_gettime -- clock_gettime abstraction layer
  */
@@ -161,6 +161,8 @@ int os_thread_join(os_thread_t *thread, void **result);
 
 void os_thread_self(os_thread_t *thread);
 
+void os_thread_yield(void);
+
 /* thread affinity */
 
 int os_thread_setaffinity_np(os_thread_t *thread, size_t set_size,
@@ -175,6 +177,25 @@ int os_semaphore_wait(os_semaphore_t *sem);
 int os_semaphore_trywait(os_semaphore_t *sem);
 int os_semaphore_post(os_semaphore_t *sem);
 
+/* waiting on the value of a 32-bit word (futex) */
+
+int os_futex_wait(uint32_t *addr, uint32_t expected,
+	const struct timespec *timeout);
+void os_futex_wake_one(uint32_t *addr);
+void os_futex_wake_all(uint32_t *addr);
+
+/*
+ * queue of the wakeups, which are kept until a thread waits for them and
+ * are handed out to the waiting threads in LIFO order (Windows only)
+ */
+
+struct os_wakeq;
+
+struct os_wakeq *os_wakeq_new(void);
+void os_wakeq_delete(struct os_wakeq *q);
+int os_wakeq_wait(struct os_wakeq *q, const struct timespec *timeout);
+void os_wakeq_post(struct os_wakeq *q, unsigned n);
+
 #ifdef __cplusplus
 }
 #endif
@@ -12,7 +12,18 @@
 #ifdef __FreeBSD__
 #include <pthread_np.h>
 #endif
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
 #include <semaphore.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(__FreeBSD__)
+#include <sys/types.h>
+#include <sys/umtx.h>
+#endif
 
 #include "os_thread.h"
 #include "util.h"
@@ -349,6 +360,15 @@ os_thread_self(os_thread_t *thread)
 	thread_info->thread = pthread_self();
 }
 
+/*
+ * os_thread_yield -- sched_yield abstraction layer
+ */
+void
+os_thread_yield(void)
+{
+	sched_yield();
+}
+
 /*
  * os_thread_atfork -- pthread_atfork abstraction layer
  */
@@ -436,3 +456,102 @@ os_semaphore_post(os_semaphore_t *sem)
 {
 	return sem_post((sem_t *)sem);
 }
+
+/*
+ * os_futex_wait -- blocks as long as the word pointed by addr contains
+ * the expected value, but no longer than the relative timeout (if not NULL).
+ * Spurious wakeups are possible. Returns -1 if the timeout was reached.
+ */
+int
+os_futex_wait(uint32_t *addr, uint32_t expected,
+	const struct timespec *timeout)
+{
+#ifdef __linux__
+	long ret = syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected,
+		timeout, NULL, 0);
+
+	return ret != 0 && errno == ETIMEDOUT ? -1 : 0;
+#elif defined(__FreeBSD__)
+	/* a NULL size makes the kernel treat the timeout as relative */
+	int ret = _umtx_op(addr, UMTX_OP_WAIT_UINT_PRIVATE, expected,
+		NULL, (void *)timeout);
+
+	return ret != 0 && errno == ETIMEDOUT ? -1 : 0;
+#else
+	SUPPRESS_UNUSED(addr, expected, timeout);
+	sched_yield();
+
+	return 0;
+#endif
+}
+
+/*
+ * os_futex_wake_one -- wakes up one thread waiting on the address
+ */
+void
+os_futex_wake_one(uint32_t *addr)
+{
+#ifdef __linux__
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#elif defined(__FreeBSD__)
+	_umtx_op(addr, UMTX_OP_WAKE_PRIVATE, 1, NULL, NULL);
+#else
+	SUPPRESS_UNUSED(addr);
+#endif
+}
+
+/*
+ * os_futex_wake_all -- wakes up all threads waiting on the address
+ */
+void
+os_futex_wake_all(uint32_t *addr)
+{
+#ifdef __linux__
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#elif defined(__FreeBSD__)
+	_umtx_op(addr, UMTX_OP_WAKE_PRIVATE, INT_MAX, NULL, NULL);
+#else
+	SUPPRESS_UNUSED(addr);
+#endif
+}
+
+/*
+ * os_wakeq_new -- the LIFO wakeups aren't supported, the futexes are used
+ * instead
+ */
+struct os_wakeq *
+os_wakeq_new(void)
+{
+	errno = ENOTSUP;
+
+	return NULL;
+}
+
+/*
+ * os_wakeq_delete -- never called, as the queue can't be created
+ */
+void
+os_wakeq_delete(struct os_wakeq *q)
+{
+	SUPPRESS_UNUSED(q);
+}
+
+/*
+ * os_wakeq_wait -- never called, as the queue can't be created
+ */
+int
+os_wakeq_wait(struct os_wakeq *q, const struct timespec *timeout)
+{
+	SUPPRESS_UNUSED(q, timeout);
+
+	return 0;
+}
+
+/*
+ * os_wakeq_post -- never called, as the queue can't be created
+ */
+void
+os_wakeq_post(struct os_wakeq *q, unsigned n)
+{
+	SUPPRESS_UNUSED(q, n);
+}
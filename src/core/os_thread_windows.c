@@ -547,6 +547,15 @@ os_thread_self(os_thread_t *thread)
 	internal_thread->thread_handle = GetCurrentThread();
 }
 
+/*
+ * os_thread_yield -- yields the processor to another ready thread
+ */
+void
+os_thread_yield(void)
+{
+	SwitchToThread();
+}
+
 /*
  * os_cpu_zero -- clears cpu set
  */
@@ -667,3 +676,107 @@ os_semaphore_post(os_semaphore_t *sem)
 	BOOL ret = ReleaseSemaphore(internal_sem->handle, 1, NULL);
 	return ret ? 0 : -1;
 }
+
+/*
+ * get_timeout_ms -- (internal) converts the relative timeout to windows
+ * timeout, rounded up
+ */
+static DWORD
+get_timeout_ms(const struct timespec *timeout)
+{
+	if (timeout == NULL)
+		return INFINITE;
+
+	return (DWORD)(timeout->tv_sec * 1000 +
+		(timeout->tv_nsec + 999999) / 1000000);
+}
+
+/*
+ * os_futex_wait -- blocks as long as the word pointed by addr contains
+ * the expected value, but no longer than the relative timeout (if not NULL).
+ * Spurious wakeups are possible. Returns -1 if the timeout was reached.
+ */
+int
+os_futex_wait(uint32_t *addr, uint32_t expected,
+	const struct timespec *timeout)
+{
+	DWORD ms = get_timeout_ms(timeout);
+
+	if (WaitOnAddress(addr, &expected, sizeof(expected), ms))
+		return 0;
+
+	return GetLastError() == ERROR_TIMEOUT ? -1 : 0;
+}
+
+/*
+ * os_futex_wake_one -- wakes up one thread waiting on the address
+ */
+void
+os_futex_wake_one(uint32_t *addr)
+{
+	WakeByAddressSingle(addr);
+}
+
+/*
+ * os_futex_wake_all -- wakes up all threads waiting on the address
+ */
+void
+os_futex_wake_all(uint32_t *addr)
+{
+	WakeByAddressAll(addr);
+}
+
+/*
+ * os_wakeq_new -- creates the queue of the wakeups, an I/O completion port,
+ * which releases the thread that waited last first
+ */
+struct os_wakeq *
+os_wakeq_new(void)
+{
+	/* the waiting threads aren't throttled by the port */
+	HANDLE port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0,
+		MAXDWORD);
+	if (port == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	return (struct os_wakeq *)port;
+}
+
+/*
+ * os_wakeq_delete -- closes the port of the queue
+ */
+void
+os_wakeq_delete(struct os_wakeq *q)
+{
+	CloseHandle((HANDLE)q);
+}
+
+/*
+ * os_wakeq_wait -- takes a wakeup from the queue, blocks until one is posted
+ * but no longer than the relative timeout (if not NULL). Returns -1 if
+ * the timeout was reached.
+ */
+int
+os_wakeq_wait(struct os_wakeq *q, const struct timespec *timeout)
+{
+	DWORD n;
+	ULONG_PTR key;
+	OVERLAPPED *ov;
+	if (GetQueuedCompletionStatus((HANDLE)q, &n, &key, &ov,
+			get_timeout_ms(timeout)))
+		return 0;
+
+	return GetLastError() == WAIT_TIMEOUT ? -1 : 0;
+}
+
+/*
+ * os_wakeq_post -- posts n wakeups to the queue
+ */
+void
+os_wakeq_post(struct os_wakeq *q, unsigned n)
+{
+	for (unsigned i = 0; i < n; i++)
+		PostQueuedCompletionStatus((HANDLE)q, 0, 0, NULL);
+}
@@ -325,6 +325,71 @@ os_writev(int fd, const struct iovec *iov, int iovcnt)
 	return written;
 }
 
+/*
+ * os_pread -- windows version of pread function, it moves the file pointer
+ *
+ * XXX: ReadFile is 32 bit, larger reads are shortened
+ */
+ssize_t
+os_pread(int fd, void *buf, size_t count, uint64_t offset)
+{
+	HANDLE handle = (HANDLE)_get_osfhandle(fd);
+	if (handle == INVALID_HANDLE_VALUE) {
+		errno = EBADF;
+		return -1;
+	}
+
+	OVERLAPPED ov = {0};
+	ov.Offset = (DWORD)offset;
+	ov.OffsetHigh = (DWORD)(offset >> 32);
+	DWORD len = count >= MAXDWORD ? MAXDWORD : (DWORD)count;
+	DWORD nread;
+	if (!ReadFile(handle, buf, len, &nread, &ov)) {
+		if (GetLastError() == ERROR_HANDLE_EOF)
+			return 0;
+		errno = EIO;
+		return -1;
+	}
+
+	return (ssize_t)nread;
+}
+
+/*
+ * os_pwrite -- windows version of pwrite function, it moves the file pointer
+ *
+ * XXX: WriteFile is 32 bit, larger writes are shortened
+ */
+ssize_t
+os_pwrite(int fd, const void *buf, size_t count, uint64_t offset)
+{
+	HANDLE handle = (HANDLE)_get_osfhandle(fd);
+	if (handle == INVALID_HANDLE_VALUE) {
+		errno = EBADF;
+		return -1;
+	}
+
+	OVERLAPPED ov = {0};
+	ov.Offset = (DWORD)offset;
+	ov.OffsetHigh = (DWORD)(offset >> 32);
+	DWORD len = count >= MAXDWORD ? MAXDWORD : (DWORD)count;
+	DWORD nwritten;
+	if (!WriteFile(handle, buf, len, &nwritten, &ov)) {
+		errno = EIO;
+		return -1;
+	}
+
+	return (ssize_t)nwritten;
+}
+
+/*
+ * os_fdatasync -- windows version of fdatasync function
+ */
+int
+os_fdatasync(int fd)
+{
+	return _commit(fd);
+}
+
 #define NSEC_IN_SEC 1000000000ull
 /* number of useconds between 1970-01-01T00:00:00Z and 1601-01-01T00:00:00Z */
 #define DELTA_WIN2UNIX (11644473600000000ull)
@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * reactor.h -- internal definitions for the reactor, which reports
+ * the readiness of file descriptors
+ *
+ * A descriptor is armed for a single report of readiness, which carries
+ * the key given when arming. The reactor is thread-safe, but it doesn't
+ * serialize reports with disarming, so a report can refer to a key that
+ * has been disarmed meanwhile.
+ */
+
+#ifndef REACTOR_H
+#define REACTOR_H 1
+
+#include <stdint.h>
+#include <time.h>
+
+#define REACTOR_READABLE (1U << 0)
+#define REACTOR_WRITABLE (1U << 1)
+#define REACTOR_ERROR (1U << 2) /* reported only, error or hang up */
+
+struct reactor;
+
+struct reactor_event {
+	uint64_t key;
+	unsigned events;
+};
+
+struct reactor *reactor_new(void);
+void reactor_delete(struct reactor *reactor);
+int reactor_arm(struct reactor *reactor, int fd, unsigned events,
+	uint64_t key, int *handle);
+void reactor_disarm(struct reactor *reactor, int fd, int handle);
+int reactor_wait(struct reactor *reactor, struct reactor_event *events,
+	int nevents, const struct timespec *timeout);
+void reactor_interrupt(struct reactor *reactor);
+int reactor_check(int fd, unsigned events, unsigned *revents);
+
+#endif
@@ -0,0 +1,241 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * reactor_linux.c -- reactor implementation based on epoll
+ *
+ * Descriptors are registered with EPOLLONESHOT, so that every arming
+ * produces at most one event. Epoll allows only one registration of
+ * a descriptor, the descriptors armed again before being disarmed are
+ * duplicated and registered under the new number. An eventfd, which
+ * is always registered, interrupts reactor_wait().
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "reactor.h"
+#include "util.h"
+
+#define REACTOR_MAX_EVENTS 64
+#define REACTOR_INTERRUPT_KEY UINT64_MAX
+
+struct reactor {
+	int epfd;
+	int evfd;
+};
+
+/*
+ * reactor_new -- creates the reactor, returns NULL on failure
+ */
+struct reactor *
+reactor_new(void)
+{
+	struct reactor *reactor = malloc(sizeof(struct reactor));
+	if (reactor == NULL)
+		return NULL;
+
+	reactor->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (reactor->epfd < 0)
+		goto err_free;
+
+	reactor->evfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (reactor->evfd < 0)
+		goto err_epfd;
+
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.u64 = REACTOR_INTERRUPT_KEY;
+	if (epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, reactor->evfd, &ev) != 0)
+		goto err_evfd;
+
+	return reactor;
+
+err_evfd:
+	close(reactor->evfd);
+err_epfd:
+	close(reactor->epfd);
+err_free:
+	free(reactor);
+	return NULL;
+}
+
+/*
+ * reactor_delete -- deletes the reactor
+ */
+void
+reactor_delete(struct reactor *reactor)
+{
+	close(reactor->evfd);
+	close(reactor->epfd);
+	free(reactor);
+}
+
+/*
+ * reactor_arm -- arms the descriptor for a single report of the events.
+ * The handle, which has to be passed to reactor_disarm(), is stored at
+ * *handle. Returns -1 and sets errno on failure, EPERM means that
+ * the descriptor doesn't support polling.
+ */
+int
+reactor_arm(struct reactor *reactor, int fd, unsigned events,
+	uint64_t key, int *handle)
+{
+	struct epoll_event ev;
+	ev.events = EPOLLONESHOT;
+	if (events & REACTOR_READABLE)
+		ev.events |= EPOLLIN | EPOLLRDHUP;
+	if (events & REACTOR_WRITABLE)
+		ev.events |= EPOLLOUT;
+	ev.data.u64 = key;
+
+	if (epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, fd, &ev) == 0) {
+		*handle = fd;
+		return 0;
+	}
+	if (errno != EEXIST)
+		return -1;
+
+	/* the descriptor is armed already, register a duplicate */
+	int dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	if (dup_fd < 0)
+		return -1;
+
+	if (epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, dup_fd, &ev) != 0) {
+		int oerrno = errno;
+		close(dup_fd);
+		errno = oerrno;
+		return -1;
+	}
+	*handle = dup_fd;
+
+	return 0;
+}
+
+/*
+ * reactor_disarm -- removes the descriptor armed under the handle
+ */
+void
+reactor_disarm(struct reactor *reactor, int fd, int handle)
+{
+	epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, handle, NULL);
+	if (handle != fd)
+		close(handle);
+}
+
+/*
+ * reactor_events -- (internal) translates the epoll events
+ */
+static unsigned
+reactor_events(uint32_t events)
+{
+	unsigned revents = 0;
+	if (events & (EPOLLIN | EPOLLRDHUP))
+		revents |= REACTOR_READABLE;
+	if (events & EPOLLOUT)
+		revents |= REACTOR_WRITABLE;
+	if (events & (EPOLLERR | EPOLLHUP))
+		revents |= REACTOR_ERROR;
+
+	return revents;
+}
+
+/*
+ * reactor_wait -- waits at most the timeout, forever if it's NULL, until
+ * some of the armed descriptors are ready or the reactor is interrupted.
+ * Stores up to nevents reports and returns their number, or -1 with errno
+ * set on failure.
+ */
+int
+reactor_wait(struct reactor *reactor, struct reactor_event *events,
+	int nevents, const struct timespec *timeout)
+{
+	int ms = -1;
+	if (timeout != NULL) {
+		/* round up, so that the wait doesn't end before the timeout */
+		uint64_t total = (uint64_t)timeout->tv_sec * 1000 +
+			((uint64_t)timeout->tv_nsec + 999999) / 1000000;
+		ms = total > INT32_MAX ? INT32_MAX : (int)total;
+	}
+
+	struct epoll_event evs[REACTOR_MAX_EVENTS];
+	if (nevents > REACTOR_MAX_EVENTS)
+		nevents = REACTOR_MAX_EVENTS;
+
+	int n = epoll_wait(reactor->epfd, evs, nevents, ms);
+	if (n < 0)
+		return errno == EINTR ? 0 : -1;
+
+	int nready = 0;
+	for (int i = 0; i < n; ++i) {
+		if (evs[i].data.u64 == REACTOR_INTERRUPT_KEY) {
+			uint64_t value;
+			/* fails if another waiter has already drained it */
+			ssize_t ret = read(reactor->evfd, &value,
+				sizeof(value));
+			SUPPRESS_UNUSED(ret);
+			continue;
+		}
+		events[nready].key = evs[i].data.u64;
+		events[nready].events = reactor_events(evs[i].events);
+		nready++;
+	}
+
+	return nready;
+}
+
+/*
+ * reactor_interrupt -- makes one of the threads blocked in reactor_wait()
+ * return
+ */
+void
+reactor_interrupt(struct reactor *reactor)
+{
+	uint64_t value = 1;
+	/* fails only if the counter would overflow, then it's signaled */
+	ssize_t ret = write(reactor->evfd, &value, sizeof(value));
+	SUPPRESS_UNUSED(ret);
+}
+
+/*
+ * reactor_check -- checks the readiness of the descriptor without arming
+ * it, stores the ready events at *revents. Returns -1 and sets errno on
+ * failure.
+ */
+int
+reactor_check(int fd, unsigned events, unsigned *revents)
+{
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = 0;
+	if (events & REACTOR_READABLE)
+		pfd.events |= POLLIN | POLLRDHUP;
+	if (events & REACTOR_WRITABLE)
+		pfd.events |= POLLOUT;
+	pfd.revents = 0;
+
+	if (poll(&pfd, 1, 0) < 0)
+		return -1;
+
+	if (pfd.revents & POLLNVAL) {
+		errno = EBADF;
+		return -1;
+	}
+
+	*revents = 0;
+	if (pfd.revents & (POLLIN | POLLRDHUP))
+		*revents |= REACTOR_READABLE;
+	if (pfd.revents & POLLOUT)
+		*revents |= REACTOR_WRITABLE;
+	if (pfd.revents & (POLLERR | POLLHUP))
+		*revents |= REACTOR_ERROR;
+
+	return 0;
+}
@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * reactor_none.c -- reactor stubs for the platforms without
+ * an implementation, all the operations fail with ENOTSUP
+ */
+
+#include <errno.h>
+
+#include "reactor.h"
+#include "util.h"
+
+struct reactor *
+reactor_new(void)
+{
+	errno = ENOTSUP;
+	return NULL;
+}
+
+void
+reactor_delete(struct reactor *reactor)
+{
+	SUPPRESS_UNUSED(reactor);
+}
+
+int
+reactor_arm(struct reactor *reactor, int fd, unsigned events,
+	uint64_t key, int *handle)
+{
+	SUPPRESS_UNUSED(reactor, fd, events, key, handle);
+
+	errno = ENOTSUP;
+	return -1;
+}
+
+void
+reactor_disarm(struct reactor *reactor, int fd, int handle)
+{
+	SUPPRESS_UNUSED(reactor, fd, handle);
+}
+
+int
+reactor_wait(struct reactor *reactor, struct reactor_event *events,
+	int nevents, const struct timespec *timeout)
+{
+	SUPPRESS_UNUSED(reactor, events, nevents, timeout);
+
+	errno = ENOTSUP;
+	return -1;
+}
+
+void
+reactor_interrupt(struct reactor *reactor)
+{
+	SUPPRESS_UNUSED(reactor);
+}
+
+int
+reactor_check(int fd, unsigned events, unsigned *revents)
+{
+	SUPPRESS_UNUSED(fd, events, revents);
+
+	errno = ENOTSUP;
+	return -1;
+}
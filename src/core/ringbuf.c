@@ -3,8 +3,10 @@
 
 /*
  * ringbuf.c -- implementation of a simple multi-producer/multi-consumer (MPMC)
- * ring buffer. It uses atomic instructions for correctness and semaphores for
- * waiting.
+ * ring buffer. Every slot carries a sequence number, which tells producers
+ * and consumers whose turn it is to use the slot, so that a try operation is
+ * a single compare-and-swap of the position. Blocking is opt-in, the blocking
+ * ring buffers wait on eventcounts.
  */
 
 /* disable conditional expression is const warning */
@@ -15,48 +17,89 @@
 #include "core/valgrind_internal.h"
 
 #include "ringbuf.h"
+#include "eventcount.h"
 #include "util.h"
 #include "out.h"
 #include "os.h"
 #include "os_thread.h"
 #include "sys_util.h"
+#include "tracepoint.h"
 
-#ifdef _WIN32
-#define __sync_synchronize() MemoryBarrier()
-#endif
-
-#if 1
-/*
- * This number defines by how much the relevant semaphore will be increased to
- * unlock waiting threads and thus defines how many threads can wait on
- *  the ring buffer at the same time.
- */
-#define RINGBUF_MAX_CONSUMER_THREADS 1024
-#endif
+/* attempts to dequeue from a ring buffer shared with untrusted processes */
+#define RINGBUF_SHARED_MAX_ATTEMPTS 64
 
 /* avoid false sharing by padding the variable */
 #define CACHELINE_PADDING(type, name)\
 union { type name; uint64_t name##_padding[8]; } name##_padded
 
+/*
+ * A slot at position pos is free for the producer of that position if its
+ * sequence number equals 2 * pos and is filled for the consumer if it equals
+ * 2 * pos + 1. The consumer frees it for the next lap by setting it to
+ * 2 * (pos + len). Doubling the positions keeps both states distinct even
+ * in a buffer with a single slot.
+ */
+struct ringbuf_slot {
+	uint64_t seq;
+	void *data;
+};
+
 struct ringbuf {
 	CACHELINE_PADDING(uint64_t, read_pos);
 	CACHELINE_PADDING(uint64_t, write_pos);
 
-	CACHELINE_PADDING(os_semaphore_t, nfree);
-	CACHELINE_PADDING(os_semaphore_t, nused);
+	/* only used by the blocking ring buffers */
+	CACHELINE_PADDING(struct eventcount, nfree);
+	CACHELINE_PADDING(struct eventcount, nused);
 
 	uint64_t len_mask;
 	unsigned len;
 	int running;
+	int blocking;
 
-	void *data[];
+	struct ringbuf_slot slots[];
 };
 
 /*
- * ringbuf_new -- creates a new ring buffer instance
+ * ringbuf_slots -- (internal) returns the number of slots of the ring buffer
+ *	of the given length
  */
-struct ringbuf *
-ringbuf_new(unsigned length)
+static unsigned
+ringbuf_slots(unsigned length)
+{
+	/* an empty buffer has a slot, which is neither free nor filled */
+	return length == 0 ? 1 : length;
+}
+
+/*
+ * ringbuf_setup -- (internal) initializes the ring buffer in its memory
+ */
+static void
+ringbuf_setup(struct ringbuf *rbuf, unsigned length, int blocking)
+{
+	unsigned nslots = ringbuf_slots(length);
+	for (unsigned i = 0; i < nslots; ++i) {
+		rbuf->slots[i].seq = length == 0 ? UINT64_MAX : 2 * (uint64_t)i;
+		rbuf->slots[i].data = NULL;
+	}
+
+	eventcount_init(&rbuf->nfree_padded.nfree);
+	eventcount_init(&rbuf->nused_padded.nused);
+
+	rbuf->read_pos_padded.read_pos = 0;
+	rbuf->write_pos_padded.write_pos = 0;
+
+	rbuf->len = length;
+	rbuf->len_mask = nslots - 1;
+	rbuf->running = 1;
+	rbuf->blocking = blocking;
+}
+
+/*
+ * ringbuf_create -- (internal) creates a new ring buffer instance
+ */
+static struct ringbuf *
+ringbuf_create(unsigned length, int blocking)
 {
 	LOG(4, NULL);
 
@@ -64,32 +107,69 @@ ringbuf_new(unsigned length)
 	if (util_popcount(length) > 1)
 		return NULL;
 
-	struct ringbuf *rbuf =
-		calloc(length * sizeof(void *), sizeof(*rbuf));
+	struct ringbuf *rbuf = malloc(ringbuf_size(length));
 	if (rbuf == NULL)
 		return NULL;
 
-	if (os_semaphore_init(&rbuf->nfree_padded.nfree, length)) {
-		free(rbuf);
-		return NULL;
-	}
+	ringbuf_setup(rbuf, length, blocking);
 
-	if (os_semaphore_init(&rbuf->nused_padded.nused, 0)) {
-		util_semaphore_destroy(&rbuf->nfree_padded.nfree);
-		free(rbuf);
-		return NULL;
-	}
+	return rbuf;
+}
 
-	rbuf->read_pos_padded.read_pos = 0;
-	rbuf->write_pos_padded.write_pos = 0;
+/*
+ * ringbuf_size -- returns the size of the memory of the ring buffer
+ *	of the given length
+ */
+size_t
+ringbuf_size(unsigned length)
+{
+	return sizeof(struct ringbuf) +
+		ringbuf_slots(length) * sizeof(struct ringbuf_slot);
+}
 
-	rbuf->len = length;
-	rbuf->len_mask = length - 1;
-	rbuf->running = 1;
+/*
+ * ringbuf_init -- initializes a ring buffer, which supports only the try
+ *	operations, in the memory of ringbuf_size(length) bytes provided by
+ *	the caller, which must not be passed to ringbuf_delete()
+ *
+ * The ring buffer doesn't point to any memory of its own, so it can be
+ * placed in a memory shared by the processes, which map it at different
+ * addresses, as long as its values mean the same to all of them.
+ */
+struct ringbuf *
+ringbuf_init(void *addr, unsigned length)
+{
+	LOG(4, NULL);
+
+	if (util_popcount(length) > 1)
+		return NULL;
+
+	struct ringbuf *rbuf = addr;
+	ringbuf_setup(rbuf, length, 0);
 
 	return rbuf;
 }
 
+/*
+ * ringbuf_new -- creates a new ring buffer instance, which supports only
+ *	the try operations
+ */
+struct ringbuf *
+ringbuf_new(unsigned length)
+{
+	return ringbuf_create(length, 0);
+}
+
+/*
+ * ringbuf_new_blocking -- creates a new ring buffer instance, which also
+ *	supports the blocking operations
+ */
+struct ringbuf *
+ringbuf_new_blocking(unsigned length)
+{
+	return ringbuf_create(length, 1);
+}
+
 #if 1
 /*
  * ringbuf_length -- returns the length of the ring buffer
@@ -102,6 +182,47 @@ ringbuf_length(struct ringbuf *rbuf)
 	return rbuf->len;
 }
 
+/*
+ * ringbuf_count -- returns the number of values in the ring buffer, which
+ *	can be outdated by the time it's used
+ */
+unsigned
+ringbuf_count(struct ringbuf *rbuf)
+{
+	LOG(4, NULL);
+
+	uint64_t read_pos;
+	uint64_t write_pos;
+	util_atomic_load_explicit64(&rbuf->read_pos_padded.read_pos, &read_pos,
+		memory_order_relaxed);
+	util_atomic_load_explicit64(&rbuf->write_pos_padded.write_pos,
+		&write_pos, memory_order_relaxed);
+
+	/* the positions are read at different times */
+	if (write_pos < read_pos)
+		return 0;
+	uint64_t count = write_pos - read_pos;
+
+	return count > rbuf->len ? rbuf->len : (unsigned)count;
+}
+
+/*
+ * ringbuf_drained -- (internal) checks if all the enqueued values were
+ *	claimed by the consumers
+ */
+static int
+ringbuf_drained(struct ringbuf *rbuf)
+{
+	uint64_t read_pos;
+	uint64_t write_pos;
+	util_atomic_load_explicit64(&rbuf->read_pos_padded.read_pos,
+		&read_pos, memory_order_acquire);
+	util_atomic_load_explicit64(&rbuf->write_pos_padded.write_pos,
+		&write_pos, memory_order_acquire);
+
+	return read_pos == write_pos;
+}
+
 /*
  * ringbuf_stop -- if there are any threads stuck waiting on dequeue, unblocks
  *	them. Those threads, if there are no new elements, will return NULL.
@@ -112,16 +233,27 @@ ringbuf_stop(struct ringbuf *rbuf)
 	LOG(4, NULL);
 
 	/* wait for the buffer to become empty */
-	while (rbuf->read_pos_padded.read_pos !=
-		rbuf->write_pos_padded.write_pos)
-		__sync_synchronize();
+	while (!ringbuf_drained(rbuf)) {
+		if (!rbuf->blocking) {
+			util_synchronize();
+			continue;
+		}
+		/* the consumer which drains the buffer wakes all the waiters */
+		uint32_t key = eventcount_prepare(&rbuf->nfree_padded.nfree);
+		if (ringbuf_drained(rbuf)) {
+			eventcount_cancel(&rbuf->nfree_padded.nfree);
+			break;
+		}
+		eventcount_wait(&rbuf->nfree_padded.nfree, key, NULL);
+	}
 
-	int ret = util_bool_compare_and_swap64(&rbuf->running, 1, 0);
+	int ret = util_bool_compare_and_swap32(&rbuf->running, 1, 0);
 	ASSERTeq(ret, 1);
 
-	/* XXX just unlock all waiting threads somehow... */
-	for (int64_t i = 0; i < RINGBUF_MAX_CONSUMER_THREADS; ++i)
-		util_semaphore_post(&rbuf->nused_padded.nused);
+	if (rbuf->blocking) {
+		eventcount_notify_all(&rbuf->nused_padded.nused);
+		eventcount_notify_all(&rbuf->nfree_padded.nfree);
+	}
 }
 #endif
 
@@ -135,52 +267,77 @@ ringbuf_delete(struct ringbuf *rbuf)
 
 	ASSERTeq(rbuf->read_pos_padded.read_pos,
 		rbuf->write_pos_padded.write_pos);
-	util_semaphore_destroy(&rbuf->nfree_padded.nfree);
-	util_semaphore_destroy(&rbuf->nused_padded.nused);
 	free(rbuf);
 }
 
 /*
  * ringbuf_enqueue_atomic -- (internal) performs the lockfree insert of
- * an element into the ringbuf data array
+ * an element into the ringbuf slots, fails if the buffer is full
  */
-static void
+static int
 ringbuf_enqueue_atomic(struct ringbuf *rbuf, void *data)
 {
 	LOG(4, NULL);
 
-	size_t w = util_fetch_and_add64(&rbuf->write_pos_padded.write_pos, 1)
-		& rbuf->len_mask;
-
 	ASSERT(rbuf->running);
 
-	/*
-	 * In most cases, this won't loop even once, but sometimes if
-	 * the semaphore is incremented concurrently in dequeue,
-	 * we need to wait.
-	 */
-	while (!util_bool_compare_and_swap64(&rbuf->data[w], NULL, data))
-		;
+	uint64_t pos;
+	util_atomic_load_explicit64(&rbuf->write_pos_padded.write_pos, &pos,
+		memory_order_relaxed);
+
+	struct ringbuf_slot *slot;
+	for (;;) {
+		slot = &rbuf->slots[pos & rbuf->len_mask];
+		uint64_t seq;
+		util_atomic_load_explicit64(&slot->seq, &seq,
+			memory_order_acquire);
+		int64_t diff = (int64_t)(seq - 2 * pos);
+		if (diff == 0) {
+			if (util_bool_compare_and_swap64(
+			    &rbuf->write_pos_padded.write_pos, pos, pos + 1))
+				break;
+		} else if (diff < 0) {
+			/* not consumed since the previous lap */
+			TRACEPOINT(ringbuf_full, rbuf, pos);
+			return -1;
+		}
+		util_atomic_load_explicit64(&rbuf->write_pos_padded.write_pos,
+			&pos, memory_order_relaxed);
+	}
+
+	slot->data = data;
+	VALGRIND_ANNOTATE_HAPPENS_BEFORE(&slot->seq);
+	util_atomic_store_explicit64(&slot->seq, 2 * pos + 1,
+		memory_order_release);
 
-	VALGRIND_ANNOTATE_HAPPENS_BEFORE(&rbuf->data[w]);
+	if (rbuf->blocking)
+		eventcount_notify_one(&rbuf->nused_padded.nused);
+
+	return 0;
 }
 
 #if 1
 /*
  * ringbuf_enqueue -- places a new value into the collection
  *
- * This function blocks if there's no space in the buffer.
+ * This function blocks if there's no space in the buffer. Only the ring
+ * buffers created by ringbuf_new_blocking() support it.
  */
 int
 ringbuf_enqueue(struct ringbuf *rbuf, void *data)
 {
 	LOG(4, NULL);
 
-	util_semaphore_wait(&rbuf->nfree_padded.nfree);
+	ASSERT(rbuf->blocking);
 
-	ringbuf_enqueue_atomic(rbuf, data);
-
-	util_semaphore_post(&rbuf->nused_padded.nused);
+	while (ringbuf_enqueue_atomic(rbuf, data) != 0) {
+		uint32_t key = eventcount_prepare(&rbuf->nfree_padded.nfree);
+		if (ringbuf_enqueue_atomic(rbuf, data) == 0) {
+			eventcount_cancel(&rbuf->nfree_padded.nfree);
+			break;
+		}
+		eventcount_wait(&rbuf->nfree_padded.nfree, key, NULL);
+	}
 
 	return 0;
 }
@@ -196,62 +353,205 @@ ringbuf_tryenqueue(struct ringbuf *rbuf, void *data)
 {
 	LOG(4, NULL);
 
-	if (util_semaphore_trywait(&rbuf->nfree_padded.nfree) != 0)
-		return -1;
-
-	ringbuf_enqueue_atomic(rbuf, data);
-
-	util_semaphore_post(&rbuf->nused_padded.nused);
-
-	return 0;
+	return ringbuf_enqueue_atomic(rbuf, data);
 }
 
 /*
- * ringbuf_dequeue_atomic -- performs a lockfree retrieval of data from ringbuf
+ * ringbuf_dequeue_atomic -- performs a lockfree retrieval of data from
+ * ringbuf, returns NULL if the buffer is empty
  */
 static void *
 ringbuf_dequeue_atomic(struct ringbuf *rbuf)
 {
 	LOG(4, NULL);
 
-	size_t r = util_fetch_and_add64(&rbuf->read_pos_padded.read_pos, 1)
-		& rbuf->len_mask;
-	/*
-	 * Again, in most cases, there won't be even a single loop, but if one
-	 * thread stalls while others perform work, it might happen that two
-	 * threads get the same read position.
-	 */
-	void *data = NULL;
-
-	VALGRIND_ANNOTATE_HAPPENS_AFTER(&rbuf->data[r]);
-	do {
-		do {
-			util_atomic_load64(&rbuf->data[r], &data);
-		} while (data == NULL);
-	} while (!util_bool_compare_and_swap64(&rbuf->data[r], data, NULL));
+	uint64_t pos;
+	util_atomic_load_explicit64(&rbuf->read_pos_padded.read_pos, &pos,
+		memory_order_relaxed);
+
+	struct ringbuf_slot *slot;
+	for (;;) {
+		slot = &rbuf->slots[pos & rbuf->len_mask];
+		uint64_t seq;
+		util_atomic_load_explicit64(&slot->seq, &seq,
+			memory_order_acquire);
+		int64_t diff = (int64_t)(seq - (2 * pos + 1));
+		if (diff == 0) {
+			if (util_bool_compare_and_swap64(
+			    &rbuf->read_pos_padded.read_pos, pos, pos + 1))
+				break;
+		} else if (diff < 0) {
+			/* not produced yet */
+			TRACEPOINT(ringbuf_empty, rbuf, pos);
+			return NULL;
+		}
+		util_atomic_load_explicit64(&rbuf->read_pos_padded.read_pos,
+			&pos, memory_order_relaxed);
+	}
+
+	VALGRIND_ANNOTATE_HAPPENS_AFTER(&slot->seq);
+	void *data = slot->data;
+	util_atomic_store_explicit64(&slot->seq, 2 * (pos + rbuf->len),
+		memory_order_release);
+
+	if (rbuf->blocking) {
+		/* ringbuf_stop() might be waiting for the last free slot */
+		if (ringbuf_drained(rbuf))
+			eventcount_notify_all(&rbuf->nfree_padded.nfree);
+		else
+			eventcount_notify_one(&rbuf->nfree_padded.nfree);
+	}
 
 	return data;
 }
 
-#if 1
 /*
- * ringbuf_dequeue -- retrieves one value from the collection
+ * ringbuf_seq -- (internal) returns the sequence number of the slot at
+ * the given position
+ */
+static uint64_t
+ringbuf_seq(struct ringbuf *rbuf, uint64_t pos)
+{
+	uint64_t seq;
+	util_atomic_load_explicit64(&rbuf->slots[pos & rbuf->len_mask].seq,
+		&seq, memory_order_acquire);
+
+	return seq;
+}
+
+/*
+ * ringbuf_enqueue_bulk -- places up to n values from the items array into
+ * the collection, reserving the slots with a single atomic operation
  *
- * This function blocks if there are no values in the buffer.
+ * This function doesn't block, it returns the number of values enqueued,
+ * which are the first ones of the array.
  */
-void *
-ringbuf_dequeue(struct ringbuf *rbuf)
+size_t
+ringbuf_enqueue_bulk(struct ringbuf *rbuf, void **items, size_t n)
 {
 	LOG(4, NULL);
 
-	util_semaphore_wait(&rbuf->nused_padded.nused);
+	ASSERT(rbuf->running);
+
+	uint64_t pos;
+	util_atomic_load_explicit64(&rbuf->write_pos_padded.write_pos, &pos,
+		memory_order_relaxed);
+
+	size_t nfree;
+	for (;;) {
+		/* the slots stay free until their producer claims them */
+		for (nfree = 0; nfree < n && nfree < rbuf->len; ++nfree) {
+			if (ringbuf_seq(rbuf, pos + nfree) != 2 * (pos + nfree))
+				break;
+		}
+		if (nfree == 0) {
+			/* not consumed since the previous lap */
+			if ((int64_t)(ringbuf_seq(rbuf, pos) - 2 * pos) < 0)
+				return 0;
+		} else if (util_bool_compare_and_swap64(
+		    &rbuf->write_pos_padded.write_pos, pos, pos + nfree)) {
+			break;
+		}
+		util_atomic_load_explicit64(&rbuf->write_pos_padded.write_pos,
+			&pos, memory_order_relaxed);
+	}
+
+	for (size_t i = 0; i < nfree; ++i) {
+		struct ringbuf_slot *slot =
+			&rbuf->slots[(pos + i) & rbuf->len_mask];
+		slot->data = items[i];
+		VALGRIND_ANNOTATE_HAPPENS_BEFORE(&slot->seq);
+		util_atomic_store_explicit64(&slot->seq, 2 * (pos + i) + 1,
+			memory_order_release);
+	}
+
+	if (rbuf->blocking)
+		eventcount_notify_all(&rbuf->nused_padded.nused);
+
+	return nfree;
+}
+
+/*
+ * ringbuf_dequeue_bulk -- retrieves up to max values from the collection
+ * into the out array, claiming the slots with a single atomic operation
+ *
+ * This function doesn't block, it returns the number of values retrieved.
+ */
+size_t
+ringbuf_dequeue_bulk(struct ringbuf *rbuf, void **out, size_t max)
+{
+	LOG(4, NULL);
 
 	if (!rbuf->running)
-		return NULL;
+		return 0;
+
+	uint64_t pos;
+	util_atomic_load_explicit64(&rbuf->read_pos_padded.read_pos, &pos,
+		memory_order_relaxed);
+
+	size_t nused;
+	for (;;) {
+		/* the slots stay filled until their consumer claims them */
+		for (nused = 0; nused < max && nused < rbuf->len; ++nused) {
+			uint64_t seq = ringbuf_seq(rbuf, pos + nused);
+			if (seq != 2 * (pos + nused) + 1)
+				break;
+		}
+		if (nused == 0) {
+			/* not produced yet */
+			uint64_t seq = ringbuf_seq(rbuf, pos);
+			if ((int64_t)(seq - (2 * pos + 1)) < 0)
+				return 0;
+		} else if (util_bool_compare_and_swap64(
+		    &rbuf->read_pos_padded.read_pos, pos, pos + nused)) {
+			break;
+		}
+		util_atomic_load_explicit64(&rbuf->read_pos_padded.read_pos,
+			&pos, memory_order_relaxed);
+	}
+
+	for (size_t i = 0; i < nused; ++i) {
+		struct ringbuf_slot *slot =
+			&rbuf->slots[(pos + i) & rbuf->len_mask];
+		VALGRIND_ANNOTATE_HAPPENS_AFTER(&slot->seq);
+		out[i] = slot->data;
+		util_atomic_store_explicit64(&slot->seq,
+			2 * (pos + i + rbuf->len), memory_order_release);
+	}
 
-	void *data = ringbuf_dequeue_atomic(rbuf);
+	if (rbuf->blocking)
+		eventcount_notify_all(&rbuf->nfree_padded.nfree);
+
+	return nused;
+}
+
+#if 1
+/*
+ * ringbuf_dequeue -- retrieves one value from the collection
+ *
+ * This function blocks if there are no values in the buffer. Only the ring
+ * buffers created by ringbuf_new_blocking() support it.
+ */
+void *
+ringbuf_dequeue(struct ringbuf *rbuf)
+{
+	LOG(4, NULL);
 
-	util_semaphore_post(&rbuf->nfree_padded.nfree);
+	ASSERT(rbuf->blocking);
+
+	void *data;
+	while ((data = ringbuf_trydequeue(rbuf)) == NULL) {
+		uint32_t key = eventcount_prepare(&rbuf->nused_padded.nused);
+		int running;
+		util_atomic_load_explicit32(&rbuf->running, &running,
+			memory_order_acquire);
+		if (!running ||
+		    (data = ringbuf_trydequeue(rbuf)) != NULL) {
+			eventcount_cancel(&rbuf->nused_padded.nused);
+			break;
+		}
+		eventcount_wait(&rbuf->nused_padded.nused, key, NULL);
+	}
 
 	return data;
 }
@@ -267,15 +567,59 @@ ringbuf_trydequeue(struct ringbuf *rbuf)
 {
 	LOG(4, NULL);
 
-	if (util_semaphore_trywait(&rbuf->nused_padded.nused) != 0)
-		return NULL;
-
 	if (!rbuf->running)
 		return NULL;
 
-	void *data = ringbuf_dequeue_atomic(rbuf);
+	return ringbuf_dequeue_atomic(rbuf);
+}
+
+/*
+ * ringbuf_trydequeue_shared -- retrieves one value from the collection,
+ *	placed in the memory shared with the untrusted processes by
+ *	ringbuf_init(), whose length is passed by the caller
+ *
+ * Whatever the positions and the sequence numbers in the shared memory say,
+ * only the slots of the buffer of the given length are accessed, and after
+ * a few attempts the function gives up, so it can fail even if the buffer
+ * isn't empty.
+ */
+void *
+ringbuf_trydequeue_shared(struct ringbuf *rbuf, unsigned length)
+{
+	LOG(4, NULL);
+
+	ASSERT(util_is_pow2(length));
+
+	uint64_t mask = (uint64_t)length - 1;
+	uint64_t pos;
+	util_atomic_load_explicit64(&rbuf->read_pos_padded.read_pos, &pos,
+		memory_order_relaxed);
+
+	struct ringbuf_slot *slot;
+	for (unsigned i = 0; ; ++i) {
+		if (i == RINGBUF_SHARED_MAX_ATTEMPTS)
+			return NULL;
+
+		slot = &rbuf->slots[pos & mask];
+		uint64_t seq;
+		util_atomic_load_explicit64(&slot->seq, &seq,
+			memory_order_acquire);
+		int64_t diff = (int64_t)(seq - (2 * pos + 1));
+		if (diff == 0) {
+			if (util_bool_compare_and_swap64(
+			    &rbuf->read_pos_padded.read_pos, pos, pos + 1))
+				break;
+		} else if (diff < 0) {
+			return NULL;
+		}
+		util_atomic_load_explicit64(&rbuf->read_pos_padded.read_pos,
+			&pos, memory_order_relaxed);
+	}
 
-	util_semaphore_post(&rbuf->nfree_padded.nfree);
+	VALGRIND_ANNOTATE_HAPPENS_AFTER(&slot->seq);
+	void *data = slot->data;
+	util_atomic_store_explicit64(&slot->seq, 2 * (pos + length),
+		memory_order_release);
 
 	return data;
 }
@@ -20,14 +20,21 @@
 struct ringbuf;
 
 struct ringbuf *ringbuf_new(unsigned length);
+struct ringbuf *ringbuf_new_blocking(unsigned length);
+size_t ringbuf_size(unsigned length);
+struct ringbuf *ringbuf_init(void *addr, unsigned length);
 void ringbuf_delete(struct ringbuf *rbuf);
 unsigned ringbuf_length(struct ringbuf *rbuf);
+unsigned ringbuf_count(struct ringbuf *rbuf);
 void ringbuf_stop(struct ringbuf *rbuf);
 
 int ringbuf_enqueue(struct ringbuf *rbuf, void *data);
 int ringbuf_tryenqueue(struct ringbuf *rbuf, void *data);
 void *ringbuf_dequeue(struct ringbuf *rbuf);
 void *ringbuf_trydequeue(struct ringbuf *rbuf);
+void *ringbuf_trydequeue_shared(struct ringbuf *rbuf, unsigned length);
+size_t ringbuf_enqueue_bulk(struct ringbuf *rbuf, void **items, size_t n);
+size_t ringbuf_dequeue_bulk(struct ringbuf *rbuf, void **out, size_t max);
 void *ringbuf_dequeue_s(struct ringbuf *rbuf, size_t data_size);
 void *ringbuf_trydequeue_s(struct ringbuf *rbuf, size_t data_size);
 
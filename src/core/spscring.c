@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * spscring.c -- implementation of a single-producer/single-consumer (SPSC)
+ * ring buffer. Each side owns its position and publishes it with a release
+ * store, the other side reads it with an acquire load only when its cached
+ * copy says the buffer is full or empty.
+ */
+
+#include <stdlib.h>
+
+#include "spscring.h"
+#include "util.h"
+#include "out.h"
+
+/* avoid false sharing by padding the variable */
+#define CACHELINE_PADDING(type, name)\
+union { type name; uint64_t name##_padding[8]; } name##_padded
+
+/* the variables written by one side share a cache line */
+struct spscring_side {
+	uint64_t pos; /* written by the owning side only */
+	uint64_t other_pos; /* cached position of the other side */
+};
+
+struct spscring {
+	CACHELINE_PADDING(struct spscring_side, producer);
+	CACHELINE_PADDING(struct spscring_side, consumer);
+
+	uint64_t len_mask;
+	unsigned len;
+
+	void *data[];
+};
+
+/*
+ * spscring_new -- creates a new ring buffer instance
+ */
+struct spscring *
+spscring_new(unsigned length)
+{
+	LOG(4, NULL);
+
+	/* length must be a power of two due to masking */
+	if (length == 0 || util_popcount(length) > 1)
+		return NULL;
+
+	struct spscring *ring = malloc(sizeof(*ring) + length * sizeof(void *));
+	if (ring == NULL)
+		return NULL;
+
+	ring->producer_padded.producer.pos = 0;
+	ring->producer_padded.producer.other_pos = 0;
+	ring->consumer_padded.consumer.pos = 0;
+	ring->consumer_padded.consumer.other_pos = 0;
+
+	ring->len = length;
+	ring->len_mask = length - 1;
+
+	return ring;
+}
+
+/*
+ * spscring_delete -- destroys an existing ring buffer instance
+ */
+void
+spscring_delete(struct spscring *ring)
+{
+	LOG(4, NULL);
+
+	ASSERTeq(ring->producer_padded.producer.pos,
+		ring->consumer_padded.consumer.pos);
+	free(ring);
+}
+
+/*
+ * spscring_length -- returns the length of the ring buffer
+ */
+unsigned
+spscring_length(struct spscring *ring)
+{
+	return ring->len;
+}
+
+/*
+ * spscring_tryenqueue -- places a new value into the collection, can only be
+ * called by the producer
+ *
+ * This function fails if there's no space in the buffer.
+ */
+int
+spscring_tryenqueue(struct spscring *ring, void *data)
+{
+	struct spscring_side *p = &ring->producer_padded.producer;
+
+	if (p->pos - p->other_pos == ring->len) {
+		/* the consumer has finished reading the slots it released */
+		util_atomic_load_explicit64(&ring->consumer_padded.consumer.pos,
+			&p->other_pos, memory_order_acquire);
+		if (p->pos - p->other_pos == ring->len)
+			return -1;
+	}
+
+	ring->data[p->pos & ring->len_mask] = data;
+	util_atomic_store_explicit64(&p->pos, p->pos + 1,
+		memory_order_release);
+
+	return 0;
+}
+
+/*
+ * spscring_trydequeue -- retrieves one value from the collection, can only be
+ * called by the consumer
+ *
+ * This function fails if there are no values in the buffer.
+ */
+void *
+spscring_trydequeue(struct spscring *ring)
+{
+	struct spscring_side *c = &ring->consumer_padded.consumer;
+
+	if (c->pos == c->other_pos) {
+		/* the producer has finished writing the slots it published */
+		util_atomic_load_explicit64(&ring->producer_padded.producer.pos,
+			&c->other_pos, memory_order_acquire);
+		if (c->pos == c->other_pos)
+			return NULL;
+	}
+
+	void *data = ring->data[c->pos & ring->len_mask];
+	util_atomic_store_explicit64(&c->pos, c->pos + 1,
+		memory_order_release);
+
+	return data;
+}
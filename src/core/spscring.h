@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * spscring.h -- internal definitions for the single-producer/single-consumer
+ * ring buffer
+ *
+ * Only one thread at a time may enqueue and only one thread at a time may
+ * dequeue, in exchange neither needs an atomic read-modify-write.
+ */
+
+#ifndef SPSCRING_H
+#define SPSCRING_H 1
+
+struct spscring;
+
+struct spscring *spscring_new(unsigned length);
+void spscring_delete(struct spscring *ring);
+unsigned spscring_length(struct spscring *ring);
+
+int spscring_tryenqueue(struct spscring *ring, void *data);
+void *spscring_trydequeue(struct spscring *ring);
+
+#endif
@@ -0,0 +1,224 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * timerwheel.c -- hierarchical timer wheel implementation
+ *
+ * Every level consists of 64 slots and covers 6 bits of the expiration time.
+ * An entry is placed on the level of the most significant 6-bit digit in
+ * which its expiration time differs from the current time, in the slot
+ * indexed by that digit. Hence, all entries (apart from the expired ones)
+ * share the digits above their level with the current time, and
+ * the digit of their level is greater. Entries on lower levels always expire
+ * before the entries on higher levels.
+ *
+ * When the time advances, the slots which were passed on each level are
+ * emptied and their entries are either expired or re-inserted, cascading
+ * down to lower levels.
+ */
+
+#include <stddef.h>
+
+#include "timerwheel.h"
+#include "util.h"
+
+#define TIMERWHEEL_SLOT_MASK (TIMERWHEEL_SLOTS - 1)
+
+/*
+ * timerwheel_digit -- (internal) returns the digit of the time on the level
+ */
+static inline unsigned
+timerwheel_digit(uint64_t time, unsigned level)
+{
+	return (unsigned)(time >> (level * TIMERWHEEL_SLOT_BITS)) &
+		TIMERWHEEL_SLOT_MASK;
+}
+
+/*
+ * timerwheel_prefix -- (internal) returns the digits above the level
+ */
+static inline uint64_t
+timerwheel_prefix(uint64_t time, unsigned level)
+{
+	unsigned shift = (level + 1) * TIMERWHEEL_SLOT_BITS;
+
+	return shift >= 64 ? 0 : time >> shift;
+}
+
+/*
+ * timerwheel_link -- (internal) adds the entry at the head of the list
+ */
+static void
+timerwheel_link(struct timerwheel_entry **head,
+	struct timerwheel_entry *entry)
+{
+	entry->next = *head;
+	if (entry->next != NULL)
+		entry->next->pprev = &entry->next;
+	entry->pprev = head;
+	*head = entry;
+}
+
+/*
+ * timerwheel_init -- initializes an empty wheel
+ */
+void
+timerwheel_init(struct timerwheel *tw, uint64_t now)
+{
+	tw->now = now;
+	for (unsigned l = 0; l < TIMERWHEEL_LEVELS; ++l) {
+		tw->occupied[l] = 0;
+		for (unsigned s = 0; s < TIMERWHEEL_SLOTS; ++s)
+			tw->slots[l][s] = NULL;
+	}
+	tw->expired = NULL;
+	tw->nentries = 0;
+}
+
+/*
+ * timerwheel_place -- (internal) links the entry in the slot matching its
+ * expiration time
+ */
+static void
+timerwheel_place(struct timerwheel *tw, struct timerwheel_entry *entry)
+{
+	if (entry->expires <= tw->now) {
+		entry->level = TIMERWHEEL_LEVELS;
+		timerwheel_link(&tw->expired, entry);
+		return;
+	}
+
+	unsigned level = util_mssb_index64(entry->expires ^ tw->now) /
+		TIMERWHEEL_SLOT_BITS;
+	unsigned slot = timerwheel_digit(entry->expires, level);
+
+	entry->level = level;
+	entry->slot = slot;
+	timerwheel_link(&tw->slots[level][slot], entry);
+	tw->occupied[level] |= 1ULL << slot;
+}
+
+/*
+ * timerwheel_insert -- inserts the entry, which expires at the given time
+ */
+void
+timerwheel_insert(struct timerwheel *tw, struct timerwheel_entry *entry,
+	uint64_t expires)
+{
+	entry->expires = expires;
+	timerwheel_place(tw, entry);
+	tw->nentries++;
+}
+
+/*
+ * timerwheel_remove -- removes the entry from the wheel
+ */
+void
+timerwheel_remove(struct timerwheel *tw, struct timerwheel_entry *entry)
+{
+	if (!timerwheel_entry_inserted(entry))
+		return;
+
+	*entry->pprev = entry->next;
+	if (entry->next != NULL)
+		entry->next->pprev = entry->pprev;
+
+	if (entry->level < TIMERWHEEL_LEVELS &&
+	    tw->slots[entry->level][entry->slot] == NULL)
+		tw->occupied[entry->level] &= ~(1ULL << entry->slot);
+
+	entry->next = NULL;
+	entry->pprev = NULL;
+	tw->nentries--;
+}
+
+/*
+ * timerwheel_advance -- moves the current time forward and returns the list
+ * (linked through the next field) of entries that expired, which are no
+ * longer in the wheel
+ */
+struct timerwheel_entry *
+timerwheel_advance(struct timerwheel *tw, uint64_t now)
+{
+	struct timerwheel_entry *pending = NULL;
+
+	for (unsigned l = 0; now > tw->now && l < TIMERWHEEL_LEVELS; ++l) {
+		uint64_t mask;
+		uint64_t prefix = timerwheel_prefix(now, l);
+		if (prefix != timerwheel_prefix(tw->now, l)) {
+			/* the whole level was passed */
+			mask = ~0ULL;
+		} else {
+			unsigned from = timerwheel_digit(tw->now, l);
+			unsigned to = timerwheel_digit(now, l);
+			/* same digits on this level imply the same above */
+			if (from == to)
+				break;
+			/* slots (from, to] */
+			mask = ((2ULL << to) - 1) & ~((2ULL << from) - 1);
+		}
+
+		uint64_t slots = tw->occupied[l] & mask;
+		while (slots != 0) {
+			unsigned s = util_lssb_index64(slots);
+			slots &= slots - 1;
+
+			struct timerwheel_entry *e = tw->slots[l][s];
+			while (e != NULL) {
+				struct timerwheel_entry *next = e->next;
+				timerwheel_link(&pending, e);
+				e = next;
+			}
+			tw->slots[l][s] = NULL;
+		}
+		tw->occupied[l] &= ~mask;
+	}
+
+	if (now > tw->now)
+		tw->now = now;
+
+	/* expire or cascade the entries from the passed slots */
+	while (pending != NULL) {
+		struct timerwheel_entry *e = pending;
+		pending = e->next;
+		timerwheel_place(tw, e);
+	}
+
+	struct timerwheel_entry *expired = tw->expired;
+	tw->expired = NULL;
+	for (struct timerwheel_entry *e = expired; e != NULL; e = e->next) {
+		e->pprev = NULL;
+		tw->nentries--;
+	}
+
+	return expired;
+}
+
+/*
+ * timerwheel_next -- finds the earliest time at which an entry may expire,
+ * returns 0 if the wheel is empty. The returned time is exact for entries
+ * expiring soon and a lower bound for the ones further in the future.
+ */
+int
+timerwheel_next(struct timerwheel *tw, uint64_t *expires)
+{
+	if (tw->expired != NULL) {
+		*expires = tw->now;
+		return 1;
+	}
+
+	for (unsigned l = 0; l < TIMERWHEEL_LEVELS; ++l) {
+		if (tw->occupied[l] == 0)
+			continue;
+
+		unsigned shift = l * TIMERWHEEL_SLOT_BITS;
+		unsigned s = util_lssb_index64(tw->occupied[l]);
+		uint64_t prefix = timerwheel_prefix(tw->now, l);
+		*expires = (shift + TIMERWHEEL_SLOT_BITS >= 64 ? 0 :
+			prefix << (shift + TIMERWHEEL_SLOT_BITS)) |
+			((uint64_t)s << shift);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * timerwheel.h -- internal definitions for the hierarchical timer wheel
+ *
+ * The wheel doesn't know about the units of time, nor does it read any
+ * clock. Entries are intrusive and have to stay in place while inserted.
+ * The wheel isn't thread-safe.
+ */
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H 1
+
+#include <stdint.h>
+
+#define TIMERWHEEL_SLOT_BITS 6
+#define TIMERWHEEL_SLOTS (1 << TIMERWHEEL_SLOT_BITS)
+#define TIMERWHEEL_LEVELS ((64 + TIMERWHEEL_SLOT_BITS - 1) /\
+	TIMERWHEEL_SLOT_BITS)
+
+struct timerwheel_entry {
+	struct timerwheel_entry *next;
+	struct timerwheel_entry **pprev; /* NULL if not inserted */
+	uint64_t expires;
+	unsigned level;
+	unsigned slot;
+};
+
+struct timerwheel {
+	uint64_t now;
+	uint64_t occupied[TIMERWHEEL_LEVELS]; /* bitmaps of non-empty slots */
+	struct timerwheel_entry *slots[TIMERWHEEL_LEVELS][TIMERWHEEL_SLOTS];
+	struct timerwheel_entry *expired; /* entries inserted in the past */
+	uint64_t nentries;
+};
+
+void timerwheel_init(struct timerwheel *tw, uint64_t now);
+void timerwheel_insert(struct timerwheel *tw, struct timerwheel_entry *entry,
+	uint64_t expires);
+void timerwheel_remove(struct timerwheel *tw, struct timerwheel_entry *entry);
+struct timerwheel_entry *timerwheel_advance(struct timerwheel *tw,
+	uint64_t now);
+int timerwheel_next(struct timerwheel *tw, uint64_t *expires);
+
+/*
+ * timerwheel_entry_inserted -- returns 1 if the entry is in the wheel
+ */
+static inline int
+timerwheel_entry_inserted(struct timerwheel_entry *entry)
+{
+	return entry->pprev != NULL;
+}
+
+#endif
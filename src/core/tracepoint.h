@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * tracepoint.h -- static tracepoints of the library
+ *
+ * When the library is built with MINIASYNC_TRACEPOINTS, which requires
+ * <sys/sdt.h>, the tracepoints are USDT probes of the "miniasync" provider.
+ * Until a tracer attaches to it, a probe is a single nop instruction, so
+ * they are left in the production builds and can be traced live, e.g.:
+ *
+ *	bpftrace -e 'usdt:libminiasync.so:miniasync:threads_op_start
+ *		{ @start[arg0] = nsecs; }'
+ *
+ * The arguments of a probe are the ones of the TRACEPOINT() after its name.
+ * They shouldn't have side effects, as the tracepoints compile to nothing
+ * otherwise, without evaluating them.
+ */
+
+#ifndef MINIASYNC_TRACEPOINT_H
+#define MINIASYNC_TRACEPOINT_H 1
+
+#ifdef MINIASYNC_TRACEPOINTS
+#include <sys/sdt.h>
+
+#define TRACEPOINT(...) STAP_PROBEV(miniasync, __VA_ARGS__)
+#else
+#define TRACEPOINT(...) do {} while (0)
+#endif
+
+#endif /* MINIASYNC_TRACEPOINT_H */
@@ -91,6 +91,11 @@ extern unsigned long long Mmap_align;
 	int util_tmpfile(const char *dir, const char *templ, int flags);
 	void *util_aligned_malloc(size_t alignment, size_t size);
 	void util_aligned_free(void *ptr);
+	void *util_huge_pages_map(size_t size);
+	void util_huge_pages_unmap(void *addr, size_t size);
+	int util_transparent_huge_pages(void *addr, size_t size);
+	int util_numa_node_current(void);
+	int util_numa_prefer_node(void *addr, size_t size, int node);
 	struct tm *util_localtime(const time_t *timep, struct tm *tm);
 	int util_safe_strcpy(char *dst, const char *src, size_t max_length);
 	void util_emit_log(const char *lib, const char *func, int order);
@@ -213,6 +218,7 @@ extern unsigned long long Mmap_align;
 	 *			undefined on zero
 	 * util_mssb_index -- return index of most significant set bit
 	 *			undefined on zero
+	 * util_prefetch -- hint that the cache line of addr is read soon
 	 *
 	 * XXX assertions needed on (value != 0) in both versions of bitscans
 	 *
@@ -286,6 +292,7 @@ extern unsigned long long Mmap_align;
 #define util_lssb_index64(value) ((unsigned char)__builtin_ctzll(value))
 #define util_mssb_index(value) ((unsigned char)(31 - __builtin_clz(value)))
 #define util_mssb_index64(value) ((unsigned char)(63 - __builtin_clzll(value)))
+#define util_prefetch(addr) __builtin_prefetch(addr)
 
 #else
 
@@ -432,6 +439,7 @@ extern unsigned long long Mmap_align;
 
 #define util_popcount(value) (unsigned char)__popcnt(value)
 #define util_popcount64(value) (unsigned char)__popcnt64(value)
+#define util_prefetch(addr) _mm_prefetch((const char *)(addr), _MM_HINT_T0)
 
 	static __inline unsigned char
 		util_lssb_index(int value)
@@ -11,7 +11,12 @@
 #include <limits.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include <errno.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 #include "os.h"
 #include "out.h"
 #include "util.h"
@@ -144,6 +149,102 @@ util_aligned_free(void *ptr)
 	free(ptr);
 }
 
+/*
+ * util_huge_pages_map -- map anonymous memory backed by explicitly reserved
+ * huge pages, returns NULL if there are not enough of them
+ */
+void *
+util_huge_pages_map(size_t size)
+{
+#ifdef MAP_HUGETLB
+	void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+	return addr == MAP_FAILED ? NULL : addr;
+#else
+	SUPPRESS_UNUSED(size);
+	errno = ENOTSUP;
+	return NULL;
+#endif
+}
+
+/*
+ * util_huge_pages_unmap -- unmap memory mapped by util_huge_pages_map
+ */
+void
+util_huge_pages_unmap(void *addr, size_t size)
+{
+	munmap(addr, size);
+}
+
+/*
+ * util_transparent_huge_pages -- ask the kernel to back the memory range
+ * with transparent huge pages
+ */
+int
+util_transparent_huge_pages(void *addr, size_t size)
+{
+#ifdef MADV_HUGEPAGE
+	return os_madvise(addr, size, MADV_HUGEPAGE);
+#else
+	SUPPRESS_UNUSED(addr, size);
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
+
+#define UTIL_NUMA_MAX_NODES 1024
+#define UTIL_MPOL_PREFERRED 1 /* from linux/mempolicy.h */
+#define UTIL_MPOL_MF_MOVE (1 << 1)
+
+/*
+ * util_numa_node_current -- returns the NUMA node of the cpu the calling
+ * thread runs on, or -1 if it's unknown
+ */
+int
+util_numa_node_current(void)
+{
+#if defined(__linux__) && defined(SYS_getcpu)
+	unsigned cpu;
+	unsigned node;
+	if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+		return -1;
+
+	return node < UTIL_NUMA_MAX_NODES ? (int)node : -1;
+#else
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
+
+/*
+ * util_numa_prefer_node -- asks the kernel to allocate the pages of
+ * the memory range from the NUMA node, moving the ones already allocated
+ */
+int
+util_numa_prefer_node(void *addr, size_t size, int node)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+	if (node < 0 || node >= UTIL_NUMA_MAX_NODES) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	unsigned long mask[UTIL_NUMA_MAX_NODES / (8 * sizeof(unsigned long))];
+	memset(mask, 0, sizeof(mask));
+	mask[(unsigned)node / (8 * sizeof(unsigned long))] |=
+		1UL << ((unsigned)node % (8 * sizeof(unsigned long)));
+
+	/* the kernel reads one bit less than maxnode */
+	return (int)syscall(SYS_mbind, addr, size, UTIL_MPOL_PREFERRED, mask,
+		UTIL_NUMA_MAX_NODES + 1, UTIL_MPOL_MF_MOVE);
+#else
+	SUPPRESS_UNUSED(addr, size, node);
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
+
 /*
  * util_getexecname -- return name of current executable
  */
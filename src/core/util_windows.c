@@ -177,6 +177,67 @@ util_aligned_free(void *ptr)
 	_aligned_free(ptr);
 }
 
+/*
+ * util_huge_pages_map -- large pages require a privilege on Windows,
+ * they are not used
+ */
+void *
+util_huge_pages_map(size_t size)
+{
+	SUPPRESS_UNUSED(size);
+	errno = ENOTSUP;
+	return NULL;
+}
+
+/*
+ * util_huge_pages_unmap -- never called, nothing is mapped
+ */
+void
+util_huge_pages_unmap(void *addr, size_t size)
+{
+	SUPPRESS_UNUSED(addr, size);
+}
+
+/*
+ * util_numa_node_current -- returns the NUMA node of the cpu the calling
+ * thread runs on, or -1 if it's unknown
+ */
+int
+util_numa_node_current(void)
+{
+	PROCESSOR_NUMBER cpu;
+	USHORT node;
+
+	GetCurrentProcessorNumberEx(&cpu);
+	if (!GetNumaProcessorNodeEx(&cpu, &node))
+		return -1;
+
+	return node;
+}
+
+/*
+ * util_numa_prefer_node -- node preferences are only set by allocating
+ * with VirtualAllocExNuma, existing memory can't be moved
+ */
+int
+util_numa_prefer_node(void *addr, size_t size, int node)
+{
+	SUPPRESS_UNUSED(addr, size, node);
+	errno = ENOTSUP;
+	return -1;
+}
+
+/*
+ * util_transparent_huge_pages -- not available on Windows
+ */
+int
+util_transparent_huge_pages(void *addr, size_t size)
+{
+	SUPPRESS_UNUSED(addr, size);
+	errno = ENOTSUP;
+	return -1;
+}
+
 /*
  * util_toUTF8 -- allocating conversion from wide char string to UTF8
  */
@@ -0,0 +1,873 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * data_mover_dsa.c -- data mover submitting the descriptors of its operations
+ * straight to a work queue of a DSA device, opened through the idxd driver
+ *
+ * The descriptors of a dedicated work queue are written to its portal with
+ * movdir64b, the ones of a shared work queue with enqcmd. The device writes
+ * the completion record of the descriptor, which is checked by op_check.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/idxd.h>
+#include <sys/mman.h>
+
+#include "libminiasync/vdm.h"
+#include "libminiasync/data_mover_dsa.h"
+#include "core/cpu.h"
+#include "core/fileops.h"
+#include "core/membuf.h"
+#include "core/memops.h"
+#include "core/out.h"
+#include "core/util.h"
+
+#define SUPPORTED_FLAGS (VDM_F_MEM_DURABLE | VDM_F_NO_CACHE_HINT)
+
+#define DSA_DEV_DIR "/dev/dsa"
+#define DSA_SYSFS_DIR "/sys/bus/dsa/devices"
+#define DSA_PORTAL_SIZE 4096
+
+/* the attempts to enqueue a descriptor, before the shared queue is busy */
+#define DSA_ENQCMD_RETRIES 8
+
+/* the largest transfer, if the work queue doesn't tell */
+#define DSA_DEFAULT_MAX_TRANSFER ((size_t)1 << 21)
+
+/* both destinations of dualcast have to be at the same offset in a page */
+#define DSA_DUALCAST_MASK 0xfff
+
+struct data_mover_dsa {
+	struct vdm base; /* must be first */
+	struct membuf *membuf;
+
+	int fd;
+	void *portal;
+	int shared; /* enqueued descriptors, the queue may refuse them */
+	size_t max_transfer;
+	uint64_t wq_size; /* the descriptors a dedicated queue can hold */
+	uint64_t inflight; /* submitted to the dedicated queue */
+};
+
+/*
+ * The descriptor and the completion record, which the device writes, take
+ * the first cache line and a half of the operation. An operation larger than
+ * the largest transfer, or interrupted by a page fault, is submitted again
+ * for what remains of it, [lo, hi). The overlapping memmove onto the higher
+ * addresses is copied from the end.
+ */
+struct data_mover_dsa_data {
+	struct dsa_hw_desc desc;
+	struct dsa_completion_record comp;
+	struct data_mover_dsa *dsa;
+	int in_membuf; /* allocated by op_new, not in the caller's storage */
+	int on_cpu; /* performed on the cpu, nothing was submitted */
+	int submitted; /* the descriptor was accepted by the work queue */
+	int backward; /* the remainder shrinks from its end */
+	size_t lo;
+	size_t hi;
+	uint32_t crc; /* seed of the next part of the CRC-32C */
+	struct vdm_operation_output output;
+};
+
+#define DATA_MOVER_DSA_DATA_SIZE ALIGN_UP(sizeof(struct data_mover_dsa_data), \
+	(size_t)VDM_OP_STORAGE_ALIGN)
+
+/*
+ * data_mover_dsa_memops_flags -- (internal) translates the vdm operation
+ * flags for the cpu routines
+ */
+static unsigned
+data_mover_dsa_memops_flags(uint64_t flags)
+{
+	return ((flags & VDM_F_MEM_DURABLE) ? MEMOPS_F_DURABLE : 0) |
+		((flags & VDM_F_NO_CACHE_HINT) ? MEMOPS_F_NO_CACHE : 0);
+}
+
+/*
+ * data_mover_dsa_write_flags -- (internal) translates the vdm operation
+ * flags for the descriptors of the operations writing the destination
+ */
+static uint32_t
+data_mover_dsa_write_flags(uint64_t flags)
+{
+	if (flags & VDM_F_MEM_DURABLE)
+		return IDXD_OP_FLAG_DRDBK;
+	if (flags & VDM_F_NO_CACHE_HINT)
+		return 0;
+
+	return IDXD_OP_FLAG_CC;
+}
+
+/*
+ * data_mover_dsa_pattern -- (internal) returns the 8-byte pattern, which
+ * continues the pattern of len bytes at the offset
+ */
+static uint64_t
+data_mover_dsa_pattern(const void *pattern, size_t len, size_t offset)
+{
+	const uint8_t *p = pattern;
+	uint8_t shifted[sizeof(uint64_t)];
+	for (size_t i = 0; i < sizeof(shifted); ++i)
+		shifted[i] = p[(offset + i) % len];
+
+	uint64_t ret;
+	memcpy(&ret, shifted, sizeof(ret));
+
+	return ret;
+}
+
+/*
+ * data_mover_dsa_cpu_perform -- (internal) performs the operation, which
+ * isn't offloaded, on the cpu
+ */
+static void
+data_mover_dsa_cpu_perform(struct data_mover_dsa_data *ddata,
+	const struct vdm_operation *operation)
+{
+	struct vdm_operation_output *output = &ddata->output;
+
+	switch (operation->type) {
+		case VDM_OPERATION_MEMCPY: {
+			const struct vdm_operation_data_memcpy *mdata =
+				&operation->data.memcpy;
+			memops_memcpy(mdata->dest, mdata->src, mdata->n,
+				data_mover_dsa_memops_flags(mdata->flags));
+		} break;
+		case VDM_OPERATION_MEMMOVE: {
+			const struct vdm_operation_data_memmove *mdata =
+				&operation->data.memmove;
+			memops_memmove(mdata->dest, mdata->src, mdata->n,
+				data_mover_dsa_memops_flags(mdata->flags));
+		} break;
+		case VDM_OPERATION_MEMSET: {
+			const struct vdm_operation_data_memset *mdata =
+				&operation->data.memset;
+			memops_memset(mdata->str, mdata->c, mdata->n,
+				data_mover_dsa_memops_flags(mdata->flags));
+		} break;
+		case VDM_OPERATION_FLUSH:
+			memops_flush(operation->data.flush.dest,
+				operation->data.flush.n);
+			break;
+		case VDM_OPERATION_MEMCPY_V: {
+			const struct vdm_operation_data_memcpy_v *mdata =
+				&operation->data.memcpy_v;
+			unsigned flags =
+				data_mover_dsa_memops_flags(mdata->flags);
+			for (size_t i = 0; i < mdata->cnt; ++i) {
+				size_t len = mdata->src[i].iov_len;
+				if (mdata->dest[i].iov_len < len)
+					len = mdata->dest[i].iov_len;
+				memops_memcpy(mdata->dest[i].iov_base,
+					mdata->src[i].iov_base, len, flags);
+			}
+		} break;
+		case VDM_OPERATION_COMPARE: {
+			const struct vdm_operation_data_compare *mdata =
+				&operation->data.compare;
+			struct vdm_operation_output_compare *out =
+				&output->output.compare;
+			out->offset = memops_compare(mdata->src1, mdata->src2,
+				mdata->n);
+			out->result = out->offset != mdata->n;
+		} break;
+		case VDM_OPERATION_COMPARE_PATTERN: {
+			const struct vdm_operation_data_compare_pattern *mdata =
+				&operation->data.compare_pattern;
+			struct vdm_operation_output_compare_pattern *out =
+				&output->output.compare_pattern;
+			out->offset = memops_compare_pattern(mdata->src,
+				mdata->pattern, mdata->n);
+			out->result = out->offset != mdata->n;
+		} break;
+		case VDM_OPERATION_CRC32C: {
+			const struct vdm_operation_data_crc32c *mdata =
+				&operation->data.crc32c;
+			output->output.crc32c.crc = memops_crc32c(mdata->seed,
+				mdata->src, mdata->n);
+		} break;
+		case VDM_OPERATION_DUALCAST: {
+			const struct vdm_operation_data_dualcast *mdata =
+				&operation->data.dualcast;
+			unsigned flags =
+				data_mover_dsa_memops_flags(mdata->flags);
+			memops_memcpy(mdata->dest1, mdata->src, mdata->n,
+				flags);
+			memops_memcpy(mdata->dest2, mdata->src, mdata->n,
+				flags);
+		} break;
+		case VDM_OPERATION_DELTA_CREATE: {
+			const struct vdm_operation_data_delta_create *mdata =
+				&operation->data.delta_create;
+			struct vdm_operation_output_delta_create *out =
+				&output->output.delta_create;
+			int ret = memops_delta_create(mdata->original,
+				mdata->modified, mdata->n, mdata->delta,
+				mdata->delta_max, &out->delta_size);
+			if (ret < 0)
+				output->result = VDM_ERROR_JOB_CORRUPTED;
+			else
+				out->result = (enum vdm_delta_result)ret;
+		} break;
+		case VDM_OPERATION_DELTA_APPLY: {
+			const struct vdm_operation_data_delta_apply *mdata =
+				&operation->data.delta_apply;
+			if (memops_delta_apply(mdata->dest, mdata->n,
+					mdata->delta, mdata->delta_size,
+					data_mover_dsa_memops_flags(
+					mdata->flags)) != 0)
+				output->result = VDM_ERROR_JOB_CORRUPTED;
+			output->output.delta_apply.dest = mdata->dest;
+		} break;
+		case VDM_OPERATION_MEMFILL: {
+			const struct vdm_operation_data_memfill *mdata =
+				&operation->data.memfill;
+			if (memops_memfill(mdata->dest, mdata->pattern,
+					mdata->pattern_len, mdata->n,
+					data_mover_dsa_memops_flags(
+					mdata->flags)) != 0)
+				output->result = VDM_ERROR_JOB_CORRUPTED;
+		} break;
+		case VDM_OPERATION_PREAD:
+		case VDM_OPERATION_PWRITE:
+			fileops_perform(operation, output);
+			break;
+		default:
+			ASSERT(0);
+	}
+
+	ddata->on_cpu = 1;
+}
+
+/*
+ * data_mover_dsa_offloaded -- (internal) returns if the operation can be
+ * performed by the device, sets up what remains of it
+ */
+static int
+data_mover_dsa_offloaded(struct data_mover_dsa_data *ddata,
+	const struct vdm_operation *operation)
+{
+	size_t n = vdm_operation_size(operation);
+	if (n == 0)
+		return 0;
+
+	ddata->lo = 0;
+	ddata->hi = n;
+	ddata->backward = 0;
+
+	switch (operation->type) {
+		case VDM_OPERATION_MEMMOVE: {
+			const struct vdm_operation_data_memmove *mdata =
+				&operation->data.memmove;
+			uintptr_t dest = (uintptr_t)mdata->dest;
+			uintptr_t src = (uintptr_t)mdata->src;
+			ddata->backward = dest > src && dest < src + n;
+		} return 1;
+		case VDM_OPERATION_CRC32C:
+			ddata->crc = operation->data.crc32c.seed;
+			return 1;
+		case VDM_OPERATION_DUALCAST: {
+			uintptr_t offsets =
+				(uintptr_t)operation->data.dualcast.dest1 ^
+				(uintptr_t)operation->data.dualcast.dest2;
+			return (offsets & DSA_DUALCAST_MASK) == 0;
+		}
+		case VDM_OPERATION_MEMFILL: {
+			size_t len = operation->data.memfill.pattern_len;
+			return util_is_pow2(len) && len <= sizeof(uint64_t);
+		}
+		case VDM_OPERATION_MEMCPY_V:
+		case VDM_OPERATION_DELTA_CREATE:
+		case VDM_OPERATION_DELTA_APPLY:
+		case VDM_OPERATION_PREAD:
+		case VDM_OPERATION_PWRITE:
+			return 0;
+		default:
+			return 1;
+	}
+}
+
+/*
+ * data_mover_dsa_desc_init -- (internal) prepares the descriptor of the next
+ * part of the operation, at most the largest transfer
+ */
+static void
+data_mover_dsa_desc_init(struct data_mover_dsa_data *ddata,
+	const struct vdm_operation *operation)
+{
+	size_t len = ddata->hi - ddata->lo;
+	if (len > ddata->dsa->max_transfer)
+		len = ddata->dsa->max_transfer;
+	size_t off = ddata->backward ? ddata->hi - len : ddata->lo;
+
+	struct dsa_hw_desc *desc = &ddata->desc;
+	memset(desc, 0, sizeof(*desc));
+	memset(&ddata->comp, 0, sizeof(ddata->comp));
+	desc->flags = IDXD_OP_FLAG_RCR | IDXD_OP_FLAG_CRAV;
+	desc->completion_addr = (uintptr_t)&ddata->comp;
+	desc->xfer_size = (uint32_t)len;
+
+	switch (operation->type) {
+		case VDM_OPERATION_MEMCPY: {
+			const struct vdm_operation_data_memcpy *mdata =
+				&operation->data.memcpy;
+			desc->opcode = DSA_OPCODE_MEMMOVE;
+			desc->flags |= data_mover_dsa_write_flags(mdata->flags);
+			desc->src_addr = (uintptr_t)mdata->src + off;
+			desc->dst_addr = (uintptr_t)mdata->dest + off;
+		} break;
+		case VDM_OPERATION_MEMMOVE: {
+			const struct vdm_operation_data_memmove *mdata =
+				&operation->data.memmove;
+			desc->opcode = DSA_OPCODE_MEMMOVE;
+			desc->flags |= data_mover_dsa_write_flags(mdata->flags);
+			desc->src_addr = (uintptr_t)mdata->src + off;
+			desc->dst_addr = (uintptr_t)mdata->dest + off;
+		} break;
+		case VDM_OPERATION_MEMSET: {
+			const struct vdm_operation_data_memset *mdata =
+				&operation->data.memset;
+			unsigned char c = (unsigned char)mdata->c;
+			desc->opcode = DSA_OPCODE_MEMFILL;
+			desc->flags |= data_mover_dsa_write_flags(mdata->flags);
+			desc->pattern = data_mover_dsa_pattern(&c, 1, 0);
+			desc->dst_addr = (uintptr_t)mdata->str + off;
+		} break;
+		case VDM_OPERATION_FLUSH:
+			desc->opcode = DSA_OPCODE_CFLUSH;
+			desc->dst_addr =
+				(uintptr_t)operation->data.flush.dest + off;
+			break;
+		case VDM_OPERATION_COMPARE: {
+			const struct vdm_operation_data_compare *mdata =
+				&operation->data.compare;
+			desc->opcode = DSA_OPCODE_COMPARE;
+			desc->src_addr = (uintptr_t)mdata->src1 + off;
+			desc->src2_addr = (uintptr_t)mdata->src2 + off;
+		} break;
+		case VDM_OPERATION_COMPARE_PATTERN: {
+			const struct vdm_operation_data_compare_pattern *mdata =
+				&operation->data.compare_pattern;
+			desc->opcode = DSA_OPCODE_COMPVAL;
+			desc->src_addr = (uintptr_t)mdata->src + off;
+			desc->comp_pattern = data_mover_dsa_pattern(
+				&mdata->pattern, sizeof(mdata->pattern), off);
+		} break;
+		case VDM_OPERATION_CRC32C:
+			desc->opcode = DSA_OPCODE_CRCGEN;
+			desc->src_addr =
+				(uintptr_t)operation->data.crc32c.src + off;
+			desc->crc_seed = ddata->crc;
+			break;
+		case VDM_OPERATION_DUALCAST: {
+			const struct vdm_operation_data_dualcast *mdata =
+				&operation->data.dualcast;
+			desc->opcode = DSA_OPCODE_DUALCAST;
+			desc->flags |= data_mover_dsa_write_flags(mdata->flags);
+			desc->src_addr = (uintptr_t)mdata->src + off;
+			desc->dst_addr = (uintptr_t)mdata->dest1 + off;
+			desc->dest2 = (uintptr_t)mdata->dest2 + off;
+		} break;
+		case VDM_OPERATION_MEMFILL: {
+			const struct vdm_operation_data_memfill *mdata =
+				&operation->data.memfill;
+			desc->opcode = DSA_OPCODE_MEMFILL;
+			desc->flags |= data_mover_dsa_write_flags(mdata->flags);
+			desc->pattern = data_mover_dsa_pattern(mdata->pattern,
+				mdata->pattern_len, off);
+			desc->dst_addr = (uintptr_t)mdata->dest + off;
+		} break;
+		default:
+			ASSERT(0);
+	}
+}
+
+/*
+ * data_mover_dsa_submit -- (internal) submits the descriptor of the operation,
+ * returns -1 if the work queue is full
+ */
+static int
+data_mover_dsa_submit(struct data_mover_dsa_data *ddata)
+{
+	struct data_mover_dsa *dsa = ddata->dsa;
+
+	if (dsa->shared) {
+		for (int i = 0; i < DSA_ENQCMD_RETRIES; ++i) {
+			if (cpu_enqcmd(dsa->portal, &ddata->desc) == 0) {
+				ddata->submitted = 1;
+				return 0;
+			}
+		}
+		goto busy;
+	}
+
+	/* the descriptors written to a full dedicated queue are dropped */
+	if (util_fetch_and_add64(&dsa->inflight, 1) >= dsa->wq_size) {
+		util_fetch_and_sub64(&dsa->inflight, 1);
+		goto busy;
+	}
+	cpu_movdir64b(dsa->portal, &ddata->desc);
+	ddata->submitted = 1;
+
+	return 0;
+
+busy:
+	/* the monitored record mustn't look like a running descriptor */
+	ddata->comp.rsvd = 1;
+	return -1;
+}
+
+/*
+ * data_mover_dsa_fault_in -- (internal) touches the page, on which
+ * the device faulted, the way the device accessed it
+ */
+static void
+data_mover_dsa_fault_in(const struct dsa_completion_record *comp)
+{
+	volatile char *addr = (volatile char *)(uintptr_t)comp->fault_addr;
+	char c = *addr;
+	if (comp->status & DSA_COMP_STATUS_WRITE)
+		*addr = c;
+}
+
+/*
+ * data_mover_dsa_complete -- (internal) accounts the completed descriptor
+ * of the operation, returns 1 if the whole operation is complete
+ */
+static int
+data_mover_dsa_complete(struct data_mover_dsa_data *ddata,
+	const struct vdm_operation *operation)
+{
+	const struct dsa_completion_record *comp = &ddata->comp;
+	uint8_t status = comp->status & DSA_COMP_STATUS_MASK;
+	size_t done;
+
+	switch (status) {
+		case DSA_COMP_SUCCESS:
+			done = ddata->desc.xfer_size;
+			break;
+		case DSA_COMP_PAGE_FAULT_NOBOF:
+			done = comp->bytes_completed;
+			/* a backward part copied forward is copied again */
+			if (ddata->backward && (comp->result & 1) == 0)
+				done = 0;
+			data_mover_dsa_fault_in(comp);
+			break;
+		default:
+			ddata->output.result = VDM_ERROR_JOB_CORRUPTED;
+			return 1;
+	}
+
+	size_t off = ddata->lo;
+	switch (operation->type) {
+		case VDM_OPERATION_COMPARE:
+			if (status == DSA_COMP_SUCCESS && comp->result != 0) {
+				ddata->output.output.compare.result = 1;
+				ddata->output.output.compare.offset =
+					off + comp->bytes_completed;
+				return 1;
+			}
+			break;
+		case VDM_OPERATION_COMPARE_PATTERN:
+			if (status == DSA_COMP_SUCCESS && comp->result != 0) {
+				ddata->output.output.compare_pattern.result = 1;
+				ddata->output.output.compare_pattern.offset =
+					off + comp->bytes_completed;
+				return 1;
+			}
+			break;
+		case VDM_OPERATION_CRC32C:
+			ddata->crc = (uint32_t)comp->crc_val;
+			ddata->output.output.crc32c.crc = ddata->crc;
+			break;
+		default:
+			break;
+	}
+
+	if (ddata->backward)
+		ddata->hi -= done;
+	else
+		ddata->lo += done;
+
+	return ddata->lo == ddata->hi;
+}
+
+/*
+ * data_mover_dsa_operation_new -- creates a new dsa operation
+ */
+static void *
+data_mover_dsa_operation_new(struct vdm *vdm,
+	const enum vdm_operation_type type)
+{
+	SUPPRESS_UNUSED(type);
+
+	struct data_mover_dsa *dsa = (struct data_mover_dsa *)vdm;
+
+	/* the device writes the completion record */
+	struct data_mover_dsa_data *ddata = membuf_alloc_aligned(dsa->membuf,
+		sizeof(struct data_mover_dsa_data), MEMBUF_CACHELINE_SIZE);
+	if (ddata == NULL)
+		return NULL;
+
+	ddata->dsa = dsa;
+	ddata->in_membuf = 1;
+
+	return ddata;
+}
+
+/*
+ * data_mover_dsa_operation_init -- creates a new dsa operation
+ * in the storage provided by the caller
+ */
+static void *
+data_mover_dsa_operation_init(struct vdm *vdm,
+	const enum vdm_operation_type type, void *storage)
+{
+	SUPPRESS_UNUSED(type);
+
+	struct data_mover_dsa_data *ddata = storage;
+	ASSERTeq((uintptr_t)ddata % VDM_OP_STORAGE_ALIGN, 0);
+
+	ddata->dsa = (struct data_mover_dsa *)vdm;
+	ddata->in_membuf = 0;
+
+	return ddata;
+}
+
+/*
+ * data_mover_dsa_operation_delete -- deletes a dsa operation
+ */
+static void
+data_mover_dsa_operation_delete(void *data,
+	const struct vdm_operation *operation,
+	struct vdm_operation_output *output)
+{
+	struct data_mover_dsa_data *ddata = data;
+
+	*output = ddata->output;
+	output->type = operation->type;
+
+	if (ddata->in_membuf)
+		membuf_free(data);
+}
+
+/*
+ * data_mover_dsa_operation_check -- checks the completion record
+ * of the operation, submits what remains of it
+ */
+static enum future_state
+data_mover_dsa_operation_check(void *data,
+	const struct vdm_operation *operation)
+{
+	struct data_mover_dsa_data *ddata = data;
+	if (ddata->on_cpu)
+		return FUTURE_STATE_COMPLETE;
+
+	/* the next part wasn't accepted by the work queue yet */
+	if (!ddata->submitted) {
+		data_mover_dsa_submit(ddata);
+		return FUTURE_STATE_RUNNING;
+	}
+
+	if (ddata->comp.status == DSA_COMP_NONE)
+		return FUTURE_STATE_RUNNING;
+
+	ddata->submitted = 0;
+	if (!ddata->dsa->shared)
+		util_fetch_and_sub64(&ddata->dsa->inflight, 1);
+
+	if (data_mover_dsa_complete(ddata, operation))
+		return FUTURE_STATE_COMPLETE;
+
+	data_mover_dsa_desc_init(ddata, operation);
+	data_mover_dsa_submit(ddata);
+
+	return FUTURE_STATE_RUNNING;
+}
+
+/*
+ * data_mover_dsa_operation_start -- submits the first descriptor
+ * of the operation, returns -1 if the work queue is full
+ */
+static int
+data_mover_dsa_operation_start(void *data,
+	const struct vdm_operation *operation, struct future_notifier *n)
+{
+	struct data_mover_dsa_data *ddata = data;
+	struct vdm_operation_output *output = &ddata->output;
+
+	if (n)
+		n->notifier_used = FUTURE_NOTIFIER_NONE;
+
+	ddata->on_cpu = 0;
+	ddata->submitted = 0;
+	output->result = VDM_SUCCESS;
+
+	switch (operation->type) {
+		case VDM_OPERATION_MEMCPY:
+			output->output.memcpy.dest =
+				operation->data.memcpy.dest;
+			break;
+		case VDM_OPERATION_MEMMOVE:
+			output->output.memmove.dest =
+				operation->data.memmove.dest;
+			break;
+		case VDM_OPERATION_MEMSET:
+			output->output.memset.str = operation->data.memset.str;
+			break;
+		case VDM_OPERATION_FLUSH:
+			output->output.flush.unused = 0;
+			break;
+		case VDM_OPERATION_MEMCPY_V:
+			output->output.memcpy_v.n =
+				vdm_memcpy_v_size(&operation->data.memcpy_v);
+			break;
+		case VDM_OPERATION_COMPARE:
+			output->output.compare.result = 0;
+			output->output.compare.offset =
+				operation->data.compare.n;
+			break;
+		case VDM_OPERATION_COMPARE_PATTERN:
+			output->output.compare_pattern.result = 0;
+			output->output.compare_pattern.offset =
+				operation->data.compare_pattern.n;
+			break;
+		case VDM_OPERATION_CRC32C:
+			output->output.crc32c.crc =
+				operation->data.crc32c.seed;
+			break;
+		case VDM_OPERATION_DUALCAST:
+			output->output.dualcast.dest1 =
+				operation->data.dualcast.dest1;
+			output->output.dualcast.dest2 =
+				operation->data.dualcast.dest2;
+			break;
+		case VDM_OPERATION_DELTA_CREATE:
+		case VDM_OPERATION_DELTA_APPLY:
+			break;
+		case VDM_OPERATION_MEMFILL:
+			output->output.memfill.dest =
+				operation->data.memfill.dest;
+			break;
+		case VDM_OPERATION_PREAD:
+		case VDM_OPERATION_PWRITE:
+			break;
+		default:
+			ASSERT(0);
+	}
+
+	if (!data_mover_dsa_offloaded(ddata, operation)) {
+		data_mover_dsa_cpu_perform(ddata, operation);
+		return 0;
+	}
+
+	data_mover_dsa_desc_init(ddata, operation);
+	if (data_mover_dsa_submit(ddata) != 0)
+		return -1;
+
+	/* zero until the device writes the status of the descriptor */
+	if (n) {
+		n->notifier_used = FUTURE_NOTIFIER_POLLER;
+		n->poller.ptr_to_monitor = (uint64_t *)&ddata->comp;
+	}
+
+	return 0;
+}
+
+/*
+ * data_mover_dsa_has_property -- the operations of the dsa mover
+ * are asynchronous
+ */
+static int
+data_mover_dsa_has_property(void *fut, enum future_property property)
+{
+	SUPPRESS_UNUSED(fut);
+
+	return property == FUTURE_PROPERTY_ASYNC;
+}
+
+static struct vdm data_mover_dsa_vdm = {
+	.op_new = data_mover_dsa_operation_new,
+	.op_delete = data_mover_dsa_operation_delete,
+	.op_check = data_mover_dsa_operation_check,
+	.op_start = data_mover_dsa_operation_start,
+	.capabilities = SUPPORTED_FLAGS,
+	.has_property = data_mover_dsa_has_property,
+	.op_init = data_mover_dsa_operation_init,
+	.op_storage_size = DATA_MOVER_DSA_DATA_SIZE,
+};
+
+/*
+ * data_mover_dsa_wq_attr -- (internal) reads the sysfs attribute of the work
+ * queue, without the trailing newline, returns -1 if it can't be read
+ */
+static int
+data_mover_dsa_wq_attr(const char *wq, const char *attr, char *buf,
+	size_t size)
+{
+	char path[PATH_MAX];
+	if (snprintf(path, sizeof(path), DSA_SYSFS_DIR "/%s/%s", wq, attr) >=
+	    (int)sizeof(path))
+		return -1;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	ssize_t len = read(fd, buf, size - 1);
+	close(fd);
+	if (len <= 0)
+		return -1;
+
+	if (buf[len - 1] == '\n')
+		len--;
+	buf[len] = '\0';
+
+	return 0;
+}
+
+/*
+ * data_mover_dsa_wq_open -- (internal) opens the work queue, maps its portal
+ * and reads its configuration, returns -1 if it can't be used
+ */
+static int
+data_mover_dsa_wq_open(struct data_mover_dsa *dsa, const char *wq_path)
+{
+	const char *wq = strrchr(wq_path, '/');
+	wq = wq != NULL ? wq + 1 : wq_path;
+
+	char buf[64];
+	dsa->shared = data_mover_dsa_wq_attr(wq, "mode", buf,
+		sizeof(buf)) == 0 && strcmp(buf, "shared") == 0;
+	if (dsa->shared ? !is_cpu_enqcmd_present() :
+	    !is_cpu_movdir64b_present())
+		return -1;
+
+	dsa->max_transfer = DSA_DEFAULT_MAX_TRANSFER;
+	if (data_mover_dsa_wq_attr(wq, "max_transfer_size", buf,
+			sizeof(buf)) == 0)
+		dsa->max_transfer = strtoull(buf, NULL, 0);
+	if (dsa->max_transfer == 0 || dsa->max_transfer > UINT32_MAX)
+		dsa->max_transfer = DSA_DEFAULT_MAX_TRANSFER;
+
+	dsa->wq_size = 1;
+	if (data_mover_dsa_wq_attr(wq, "size", buf, sizeof(buf)) == 0)
+		dsa->wq_size = strtoull(buf, NULL, 0);
+	if (dsa->wq_size == 0)
+		return -1;
+
+	dsa->fd = open(wq_path, O_RDWR);
+	if (dsa->fd < 0)
+		return -1;
+
+	dsa->portal = mmap(NULL, DSA_PORTAL_SIZE, PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, dsa->fd, 0);
+	if (dsa->portal == MAP_FAILED) {
+		close(dsa->fd);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * data_mover_dsa_wq_find -- (internal) opens the first work queue,
+ * which can be used, returns -1 if there is none
+ */
+static int
+data_mover_dsa_wq_find(struct data_mover_dsa *dsa)
+{
+	DIR *dir = opendir(DSA_DEV_DIR);
+	if (dir == NULL)
+		return -1;
+
+	int ret = -1;
+	struct dirent *d;
+	while (ret != 0 && (d = readdir(dir)) != NULL) {
+		if (strncmp(d->d_name, "wq", 2) != 0)
+			continue;
+
+		char path[PATH_MAX];
+		if (snprintf(path, sizeof(path), DSA_DEV_DIR "/%s",
+				d->d_name) >= (int)sizeof(path))
+			continue;
+		ret = data_mover_dsa_wq_open(dsa, path);
+	}
+	closedir(dir);
+
+	return ret;
+}
+
+/*
+ * data_mover_dsa_new -- creates a new dsa data mover submitting
+ * to the work queue of the given device file, e.g. /dev/dsa/wq0.0,
+ * or to the first one, which can be used, if it's NULL
+ */
+struct data_mover_dsa *
+data_mover_dsa_new(const char *wq_path)
+{
+	COMPILE_ERROR_ON(sizeof(struct dsa_hw_desc) != 64);
+	COMPILE_ERROR_ON(offsetof(struct data_mover_dsa_data, comp) % 32 != 0);
+
+	struct data_mover_dsa *dsa = malloc(sizeof(struct data_mover_dsa));
+	if (dsa == NULL)
+		return NULL;
+
+	dsa->base = data_mover_dsa_vdm;
+	dsa->inflight = 0;
+	if ((wq_path != NULL ? data_mover_dsa_wq_open(dsa, wq_path) :
+	    data_mover_dsa_wq_find(dsa)) != 0)
+		goto wq_failed;
+
+	dsa->membuf = membuf_new(dsa, 0, MEMBUF_PAGES_NORMAL);
+	if (dsa->membuf == NULL)
+		goto membuf_failed;
+
+	return dsa;
+
+membuf_failed:
+	munmap(dsa->portal, DSA_PORTAL_SIZE);
+	close(dsa->fd);
+wq_failed:
+	free(dsa);
+	return NULL;
+}
+
+/*
+ * data_mover_dsa_get_vdm -- returns the vdm operations for the dsa mover
+ */
+struct vdm *
+data_mover_dsa_get_vdm(struct data_mover_dsa *dsa)
+{
+	return &dsa->base;
+}
+
+/*
+ * data_mover_dsa_get_membuf_stats -- returns the statistics of the buffers
+ * the operations are allocated from
+ */
+void
+data_mover_dsa_get_membuf_stats(struct data_mover_dsa *dsa,
+	struct vdm_membuf_stats *stats)
+{
+	membuf_get_stats(dsa->membuf, stats);
+}
+
+/*
+ * data_mover_dsa_delete -- deletes a dsa data mover
+ */
+void
+data_mover_dsa_delete(struct data_mover_dsa *dsa)
+{
+	membuf_delete(dsa->membuf);
+	munmap(dsa->portal, DSA_PORTAL_SIZE);
+	close(dsa->fd);
+	free(dsa);
+}
@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * data_mover_dsa_none.c -- dsa data mover stubs for the platforms without
+ * the idxd driver, the mover can't be created
+ */
+
+#include <errno.h>
+#include <stddef.h>
+
+#include "libminiasync/data_mover_dsa.h"
+#include "core/util.h"
+
+struct data_mover_dsa *
+data_mover_dsa_new(const char *wq_path)
+{
+	SUPPRESS_UNUSED(wq_path);
+
+	errno = ENOTSUP;
+	return NULL;
+}
+
+struct vdm *
+data_mover_dsa_get_vdm(struct data_mover_dsa *dsa)
+{
+	SUPPRESS_UNUSED(dsa);
+
+	return NULL;
+}
+
+void
+data_mover_dsa_get_membuf_stats(struct data_mover_dsa *dsa,
+	struct vdm_membuf_stats *stats)
+{
+	SUPPRESS_UNUSED(dsa, stats);
+}
+
+void
+data_mover_dsa_delete(struct data_mover_dsa *dsa)
+{
+	SUPPRESS_UNUSED(dsa);
+}
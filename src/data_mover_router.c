@@ -0,0 +1,421 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * data_mover_router.c -- virtual data mover, which hands the operations
+ * over to one of several other data movers, depending on their size
+ * and flags
+ *
+ * The data mover of an operation is selected when it's started, because
+ * op_new only knows the type of the operation. The operations routed
+ * to the same data mover by one batched submission are started together.
+ */
+
+#include "core/util.h"
+#ifdef _WIN32
+#pragma warning(disable : 4127)
+#endif
+
+#include "libminiasync/data_mover_router.h"
+#include "core/membuf.h"
+#include "core/out.h"
+
+struct data_mover_router_route {
+	struct vdm *vdm;
+	size_t min_size; /* the smallest operation routed here */
+	size_t max_inflight; /* 0 - no limit */
+	uint64_t ninflight; /* routed here and not deleted yet */
+};
+
+struct data_mover_router {
+	struct vdm base; /* must be first */
+
+	struct membuf *membuf;
+	/* sorted by min_size, the largest first */
+	struct data_mover_router_route routes[DATA_MOVER_ROUTER_MAX_ROUTES];
+	size_t nroutes;
+};
+
+struct data_mover_router_data {
+	struct data_mover_router_route *route; /* NULL until started */
+	void *data; /* of the operation of the selected data mover */
+};
+
+/*
+ * data_mover_router_select -- (internal) selects the data mover
+ * of the operation and creates the operation there, if not done yet
+ *
+ * The data movers, which support the flags of the operation, are preferred
+ * over the ones, which are meant for its size, and those over the ones
+ * below their limit of the operations in flight. Of the equally good ones
+ * the one for the largest operations is selected.
+ */
+static int
+data_mover_router_select(struct data_mover_router *dmr,
+	struct data_mover_router_data *rdata,
+	const struct vdm_operation *operation)
+{
+	if (rdata->route != NULL)
+		return 0;
+
+	size_t size = vdm_operation_size(operation);
+	unsigned flags = (unsigned)(vdm_operation_flags(operation) &
+		VDM_F_VALID_FLAGS);
+
+	struct data_mover_router_route *best = NULL;
+	int best_score = -1;
+	for (size_t i = 0; i < dmr->nroutes; ++i) {
+		struct data_mover_router_route *route = &dmr->routes[i];
+
+		uint64_t ninflight;
+		util_atomic_load_explicit64(&route->ninflight, &ninflight,
+			memory_order_relaxed);
+
+		int score = 0;
+		if (vdm_is_supported(route->vdm, flags))
+			score |= 4;
+		if (size >= route->min_size)
+			score |= 2;
+		if (route->max_inflight == 0 ||
+		    ninflight < route->max_inflight)
+			score |= 1;
+
+		if (score > best_score) {
+			best = route;
+			best_score = score;
+		}
+	}
+	ASSERTne(best, NULL);
+
+	rdata->data = best->vdm->op_new(best->vdm, operation->type);
+	if (rdata->data == NULL)
+		return -1;
+
+	util_fetch_and_add64(&best->ninflight, 1);
+	rdata->route = best;
+
+	return 0;
+}
+
+/*
+ * data_mover_router_operation_new -- create a new router operation
+ */
+static void *
+data_mover_router_operation_new(struct vdm *vdm,
+	const enum vdm_operation_type type)
+{
+	SUPPRESS_UNUSED(type);
+
+	struct data_mover_router *dmr = (struct data_mover_router *)vdm;
+	if (dmr->nroutes == 0)
+		return NULL;
+
+	struct data_mover_router_data *rdata = membuf_alloc(dmr->membuf,
+		sizeof(struct data_mover_router_data));
+	if (rdata == NULL)
+		return NULL;
+
+	rdata->route = NULL;
+	rdata->data = NULL;
+
+	return rdata;
+}
+
+/*
+ * data_mover_router_operation_delete -- delete a router operation
+ * and the operation of the data mover it was routed to
+ */
+static void
+data_mover_router_operation_delete(void *data,
+	const struct vdm_operation *operation,
+	struct vdm_operation_output *output)
+{
+	struct data_mover_router_data *rdata = data;
+	struct data_mover_router_route *route = rdata->route;
+
+	if (route != NULL) {
+		route->vdm->op_delete(rdata->data, operation, output);
+		util_fetch_and_sub64(&route->ninflight, 1);
+	}
+
+	membuf_free(rdata);
+}
+
+/*
+ * data_mover_router_operation_check -- checks the status of the operation
+ * in the data mover it was routed to
+ */
+static enum future_state
+data_mover_router_operation_check(void *data,
+	const struct vdm_operation *operation)
+{
+	struct data_mover_router_data *rdata = data;
+	struct data_mover_router_route *route = rdata->route;
+
+	if (route == NULL)
+		return FUTURE_STATE_IDLE;
+
+	return route->vdm->op_check(rdata->data, operation);
+}
+
+/*
+ * data_mover_router_operation_start -- starts the operation in the data
+ * mover selected for it
+ */
+static int
+data_mover_router_operation_start(void *data,
+	const struct vdm_operation *operation, struct future_notifier *n)
+{
+	struct data_mover_router_data *rdata = data;
+	struct data_mover_router *dmr = membuf_ptr_user_data(rdata);
+
+	if (data_mover_router_select(dmr, rdata, operation) != 0)
+		return -1;
+
+	struct vdm *vdm = rdata->route->vdm;
+
+	return vdm->op_start(rdata->data, operation, n);
+}
+
+/*
+ * data_mover_router_operation_start_cb -- starts the operation in the data
+ * mover selected for it, with the completion callback, if that mover
+ * supports them
+ */
+static int
+data_mover_router_operation_start_cb(void *data,
+	const struct vdm_operation *operation, vdm_complete_fn fn, void *arg)
+{
+	struct data_mover_router_data *rdata = data;
+	struct data_mover_router *dmr = membuf_ptr_user_data(rdata);
+
+	if (data_mover_router_select(dmr, rdata, operation) != 0)
+		return -1;
+
+	struct vdm *vdm = rdata->route->vdm;
+	if (vdm->op_start_cb == NULL)
+		return -1;
+
+	return vdm->op_start_cb(rdata->data, operation, fn, arg);
+}
+
+/*
+ * data_mover_router_operation_cancel -- requests the cancellation
+ * of the operation in the data mover it was routed to
+ */
+static int
+data_mover_router_operation_cancel(void *data,
+	const struct vdm_operation *operation)
+{
+	struct data_mover_router_data *rdata = data;
+	struct data_mover_router_route *route = rdata->route;
+
+	if (route == NULL || route->vdm->op_cancel == NULL)
+		return -1;
+
+	return route->vdm->op_cancel(rdata->data, operation);
+}
+
+/*
+ * data_mover_router_start_run -- (internal) starts the n operations routed
+ * to the same data mover, returns the number of the started ones
+ */
+static size_t
+data_mover_router_start_run(struct vdm *vdm, void *data[],
+	const struct vdm_operation *operations[], size_t n)
+{
+	if (vdm->op_start_batch != NULL)
+		return vdm->op_start_batch(vdm, data, operations, n);
+
+	size_t nstarted = 0;
+	while (nstarted < n &&
+	    vdm->op_start(data[nstarted], operations[nstarted], NULL) == 0)
+		nstarted++;
+
+	return nstarted;
+}
+
+/*
+ * data_mover_router_operation_start_batch -- starts the operations
+ * in the data movers selected for them, the consecutive ones routed
+ * to the same data mover together
+ */
+static size_t
+data_mover_router_operation_start_batch(struct vdm *vdm, void *data[],
+	const struct vdm_operation *operations[], size_t n)
+{
+	struct data_mover_router *dmr = (struct data_mover_router *)vdm;
+
+	void *run[VDM_SUBMIT_BATCH_SIZE];
+	size_t nstarted = 0;
+	while (nstarted < n) {
+		struct data_mover_router_data *first = data[nstarted];
+		if (data_mover_router_select(dmr, first,
+				operations[nstarted]) != 0)
+			break;
+		run[0] = first->data;
+
+		size_t nrun = 1;
+		for (; nstarted + nrun < n && nrun < VDM_SUBMIT_BATCH_SIZE;
+				++nrun) {
+			struct data_mover_router_data *rdata =
+				data[nstarted + nrun];
+			/* a selected operation starts the next run */
+			if (data_mover_router_select(dmr, rdata,
+					operations[nstarted + nrun]) != 0 ||
+			    rdata->route != first->route)
+				break;
+			run[nrun] = rdata->data;
+		}
+
+		size_t nrun_started = data_mover_router_start_run(
+			first->route->vdm, run, &operations[nstarted], nrun);
+		nstarted += nrun_started;
+		if (nrun_started != nrun)
+			break;
+	}
+
+	return nstarted;
+}
+
+/*
+ * data_mover_router_has_property -- returns if any of the data movers,
+ * to which the operation can be routed, has the property
+ */
+static int
+data_mover_router_has_property(void *fut, enum future_property property)
+{
+	struct vdm_operation_future *future = fut;
+	struct data_mover_router *dmr =
+		(struct data_mover_router *)future->data.vdm;
+
+	/* each route sees its own vdm, the future might be a compact one */
+	struct vdm_compact_future routed;
+	memcpy(&routed, fut, sizeof(routed));
+	for (size_t i = 0; i < dmr->nroutes; ++i) {
+		struct vdm *vdm = dmr->routes[i].vdm;
+		routed.data.vdm = vdm;
+		if (vdm->has_property != NULL &&
+		    vdm->has_property(&routed, property))
+			return 1;
+	}
+
+	return 0;
+}
+
+static struct vdm data_mover_router_vdm = {
+	.op_new = data_mover_router_operation_new,
+	.op_delete = data_mover_router_operation_delete,
+	.op_check = data_mover_router_operation_check,
+	.op_start = data_mover_router_operation_start,
+	.capabilities = 0,
+	.has_property = data_mover_router_has_property,
+	.op_start_batch = data_mover_router_operation_start_batch,
+	.op_start_cb = data_mover_router_operation_start_cb,
+	.op_cancel = data_mover_router_operation_cancel,
+};
+
+/*
+ * data_mover_router_new -- creates a new data mover without any routes
+ */
+struct data_mover_router *
+data_mover_router_new(void)
+{
+	struct data_mover_router *dmr =
+		malloc(sizeof(struct data_mover_router));
+	if (dmr == NULL)
+		return NULL;
+
+	dmr->base = data_mover_router_vdm;
+	dmr->nroutes = 0;
+	dmr->membuf = membuf_new(dmr, 0, MEMBUF_PAGES_NORMAL);
+	if (dmr->membuf == NULL)
+		goto membuf_failed;
+
+	return dmr;
+
+membuf_failed:
+	free(dmr);
+	return NULL;
+}
+
+/*
+ * data_mover_router_add -- adds the data mover for the operations of at least
+ * min_size bytes, to which at most max_inflight operations are routed
+ * at a time (0 - no limit), has to be called before any operation is created
+ */
+int
+data_mover_router_add(struct data_mover_router *dmr, struct vdm *vdm,
+	size_t min_size, size_t max_inflight)
+{
+	if (vdm == NULL || dmr->nroutes == DATA_MOVER_ROUTER_MAX_ROUTES)
+		return -1;
+
+	size_t i = dmr->nroutes;
+	for (; i > 0 && dmr->routes[i - 1].min_size < min_size; --i)
+		dmr->routes[i] = dmr->routes[i - 1];
+
+	dmr->routes[i].vdm = vdm;
+	dmr->routes[i].min_size = min_size;
+	dmr->routes[i].max_inflight = max_inflight;
+	dmr->routes[i].ninflight = 0;
+	dmr->nroutes++;
+
+	/* the flags are honored, if any of the data movers supports them */
+	dmr->base.capabilities |= vdm->capabilities;
+
+	return 0;
+}
+
+/*
+ * data_mover_router_get_vdm -- returns the vdm operations for the router
+ */
+struct vdm *
+data_mover_router_get_vdm(struct data_mover_router *dmr)
+{
+	return &dmr->base;
+}
+
+/*
+ * data_mover_router_get_inflight -- returns the number of the operations
+ * routed to the data mover, which weren't deleted yet
+ */
+size_t
+data_mover_router_get_inflight(struct data_mover_router *dmr,
+	struct vdm *vdm)
+{
+	size_t ninflight = 0;
+	for (size_t i = 0; i < dmr->nroutes; ++i) {
+		if (dmr->routes[i].vdm != vdm)
+			continue;
+
+		uint64_t n;
+		util_atomic_load_explicit64(&dmr->routes[i].ninflight, &n,
+			memory_order_relaxed);
+		ninflight += n;
+	}
+
+	return ninflight;
+}
+
+/*
+ * data_mover_router_get_membuf_stats -- returns the statistics of the buffers
+ * the router operations are allocated from
+ */
+void
+data_mover_router_get_membuf_stats(struct data_mover_router *dmr,
+	struct vdm_membuf_stats *stats)
+{
+	membuf_get_stats(dmr->membuf, stats);
+}
+
+/*
+ * data_mover_router_delete -- deletes the router, the data movers of its
+ * routes are left intact
+ */
+void
+data_mover_router_delete(struct data_mover_router *dmr)
+{
+	membuf_delete(dmr->membuf);
+	free(dmr);
+}
@@ -0,0 +1,799 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * data_mover_shm.c -- data mover whose memory operations are performed by
+ * the worker threads of a service, shared by the processes of the host
+ *
+ * The service creates a segment in a shared file, which holds the queues
+ * of the descriptors, the descriptors themselves and a data area. The data
+ * movers of the client processes map the segment and submit the operations
+ * on the data area to the service, which performs them with its workers,
+ * pinned to the cpus meant for moving the data. The queues are ring buffers
+ * of the descriptor indexes, and the descriptors address the data area by
+ * offsets, so that the processes can map the segment at any address.
+ *
+ * A client takes a descriptor from the queue of the free ones, fills it in
+ * and puts it in the submission queue. A worker of the service performs it
+ * and sets its completion flag, which is monitored by the poller notifier of
+ * the future. The client returns the descriptor to the free queue once it
+ * sees the flag. The operations, which the service can't perform, are
+ * performed on the client's cpu by the synchronous data mover.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "libminiasync/vdm.h"
+#include "libminiasync/data_mover_sync.h"
+#include "libminiasync/data_mover_shm.h"
+#include "core/membuf.h"
+#include "core/memops.h"
+#include "core/os_thread.h"
+#include "core/out.h"
+#include "core/ringbuf.h"
+#include "core/util.h"
+
+#define SUPPORTED_FLAGS (VDM_F_MEM_DURABLE | VDM_F_NO_CACHE_HINT)
+
+/* "MASYNSHM", followed by the version of the layout of the segment */
+#define DATA_MOVER_SHM_MAGIC 0x4d48534e5953414dULL
+#define DATA_MOVER_SHM_VERSION 1
+
+#define DATA_MOVER_SHM_CACHELINE 64
+#define DATA_MOVER_SHM_PAGE 4096
+
+/* polls of the empty submission queue before a worker starts to sleep */
+#define DATA_MOVER_SHM_SPINS (1U << 14)
+#define DATA_MOVER_SHM_IDLE_SLEEP_NS 50000
+
+/* the queues and the descriptors are at the offsets from the segment */
+struct data_mover_shm_segment {
+	uint64_t magic; /* stored last, once the segment is initialized */
+	uint64_t version;
+	uint64_t size;
+	uint64_t free_off; /* queue of the indexes of the free descriptors */
+	uint64_t sq_off; /* queue of the indexes of the submitted ones */
+	uint64_t descs_off;
+	uint64_t data_off;
+	uint64_t data_size;
+	uint32_t nslots;
+	uint32_t running; /* cleared when the service stops */
+};
+
+/* the ranges of the operation are the offsets in the data area */
+struct data_mover_shm_desc {
+	uint64_t complete; /* set by the service, monitored by the pollers */
+	uint32_t type;
+	uint32_t result;
+	uint64_t dest;
+	uint64_t src;
+	uint64_t n;
+	uint64_t flags;
+	int32_t c;
+	uint8_t padding[DATA_MOVER_SHM_CACHELINE - 52];
+};
+
+struct data_mover_shm_service {
+	char *path;
+	struct data_mover_shm_segment *seg;
+	struct ringbuf *sq;
+	struct data_mover_shm_desc *descs;
+	char *data;
+
+	/* the segment is writable by the clients, so its layout is kept here */
+	uint64_t size;
+	uint64_t data_size;
+	uint32_t nslots;
+
+	os_thread_t *workers;
+	size_t nworkers;
+	int stop;
+};
+
+struct data_mover_shm {
+	struct vdm base; /* must be first */
+	struct membuf *membuf;
+	struct data_mover_sync *dms; /* performs the operations on the cpu */
+
+	struct data_mover_shm_segment *seg;
+	struct ringbuf *free;
+	struct ringbuf *sq;
+	struct data_mover_shm_desc *descs;
+	char *data;
+};
+
+struct data_mover_shm_data {
+	struct data_mover_shm *shm;
+	int in_membuf; /* allocated by op_new, not in the caller's storage */
+	void *cpu_data; /* of the operation performed on the cpu */
+	uint32_t desc; /* index of the submitted descriptor plus one, or 0 */
+	struct vdm_operation_output output;
+};
+
+/*
+ * data_mover_shm_memops_flags -- (internal) translates the vdm operation
+ * flags for the memory routines
+ */
+static unsigned
+data_mover_shm_memops_flags(uint64_t flags)
+{
+	return ((flags & VDM_F_MEM_DURABLE) ? MEMOPS_F_DURABLE : 0) |
+		((flags & VDM_F_NO_CACHE_HINT) ? MEMOPS_F_NO_CACHE : 0);
+}
+
+/*
+ * data_mover_shm_in_data -- (internal) returns if the range lies within
+ * the data area of data_size bytes
+ */
+static int
+data_mover_shm_in_data(uint64_t data_size, uint64_t off, uint64_t n)
+{
+	return off <= data_size && n <= data_size - off;
+}
+
+/*
+ * data_mover_shm_perform -- (internal) performs the operation of
+ * the descriptor, then sets its completion flag
+ */
+static void
+data_mover_shm_perform(struct data_mover_shm_service *svc,
+	struct data_mover_shm_desc *desc)
+{
+	/*
+	 * The descriptors of the clients aren't trusted, and can be rewritten
+	 * while they are performed, so the copy is validated and performed.
+	 */
+	struct data_mover_shm_desc d;
+	memcpy(&d, desc, sizeof(d));
+	compiler_barrier();
+
+	uint64_t data_size = svc->data_size;
+	char *data = svc->data;
+	unsigned flags = data_mover_shm_memops_flags(d.flags);
+
+	int valid = data_mover_shm_in_data(data_size, d.dest, d.n);
+	switch (d.type) {
+		case VDM_OPERATION_MEMCPY:
+			valid = valid && data_mover_shm_in_data(data_size,
+				d.src, d.n);
+			if (valid) {
+				memops_memcpy(data + d.dest, data + d.src,
+					d.n, flags);
+			}
+			break;
+		case VDM_OPERATION_MEMMOVE:
+			valid = valid && data_mover_shm_in_data(data_size,
+				d.src, d.n);
+			if (valid) {
+				memops_memmove(data + d.dest, data + d.src,
+					d.n, flags);
+			}
+			break;
+		case VDM_OPERATION_MEMSET:
+			if (valid)
+				memops_memset(data + d.dest, d.c, d.n, flags);
+			break;
+		case VDM_OPERATION_FLUSH:
+			if (valid)
+				memops_flush(data + d.dest, d.n);
+			break;
+		default:
+			valid = 0;
+	}
+
+	desc->result = valid ? VDM_SUCCESS : VDM_ERROR_JOB_CORRUPTED;
+	util_atomic_store_explicit64(&desc->complete, 1,
+		memory_order_release);
+}
+
+/*
+ * data_mover_shm_worker -- (internal) the worker thread of the service,
+ * performs the submitted operations until the service stops
+ */
+static void *
+data_mover_shm_worker(void *arg)
+{
+	struct data_mover_shm_service *svc = arg;
+	struct timespec idle = {0, DATA_MOVER_SHM_IDLE_SLEEP_NS};
+
+	unsigned spins = 0;
+	for (;;) {
+		/* the queue is in the segment, only its length is trusted */
+		uintptr_t index = (uintptr_t)ringbuf_trydequeue_shared(svc->sq,
+			svc->nslots);
+		if (index != 0) {
+			if (index <= svc->nslots) {
+				data_mover_shm_perform(svc,
+					&svc->descs[index - 1]);
+			}
+			spins = 0;
+			continue;
+		}
+
+		/* the submission queue is drained before the workers exit */
+		int stop;
+		util_atomic_load_explicit32(&svc->stop, &stop,
+			memory_order_acquire);
+		if (stop)
+			break;
+
+		if (spins < DATA_MOVER_SHM_SPINS) {
+			spins++;
+			WAIT();
+		} else {
+			nanosleep(&idle, NULL);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * data_mover_shm_pin -- (internal) binds the worker thread to the cpu
+ */
+static int
+data_mover_shm_pin(os_thread_t *worker, unsigned cpu)
+{
+	os_cpu_set_t set;
+
+	/* the platform cpu set can be smaller than the os_cpu_set_t */
+	memset(&set, 0, sizeof(set));
+	os_cpu_zero(&set);
+	os_cpu_set(cpu, &set);
+
+	return os_thread_setaffinity_np(worker, sizeof(set), &set);
+}
+
+/*
+ * data_mover_shm_service_stop -- (internal) stops the service, the workers
+ * exit once the submission queue is drained
+ */
+static void
+data_mover_shm_service_stop(struct data_mover_shm_service *svc, size_t n)
+{
+	/* the clients perform the new operations on their own */
+	util_atomic_store_explicit32(&svc->seg->running, 0,
+		memory_order_release);
+	util_atomic_store_explicit32(&svc->stop, 1, memory_order_release);
+
+	for (size_t i = 0; i < n; i++)
+		os_thread_join(&svc->workers[i], NULL);
+}
+
+/*
+ * data_mover_shm_service_new -- creates the service performing the memory
+ * operations of the clients, with its segment in the new file
+ *
+ * The segment has a data area of data_size bytes and nslots descriptors,
+ * rounded up to a power of two. The i-th of the nthreads workers is bound
+ * to the cpu cpus[i % ncpus], unless ncpus is 0.
+ */
+struct data_mover_shm_service *
+data_mover_shm_service_new(const char *path, size_t data_size,
+	unsigned nslots, size_t nthreads, const unsigned *cpus, size_t ncpus)
+{
+	COMPILE_ERROR_ON(sizeof(struct data_mover_shm_desc) !=
+		DATA_MOVER_SHM_CACHELINE);
+
+	if (nthreads == 0 || nslots == 0 || nslots > (1U << 31)) {
+		errno = EINVAL;
+		return NULL;
+	}
+	while (!util_is_pow2(nslots))
+		nslots += nslots & -nslots;
+
+	uint64_t off = ALIGN_UP(sizeof(struct data_mover_shm_segment),
+		(size_t)DATA_MOVER_SHM_CACHELINE);
+	uint64_t free_off = off;
+	off += ALIGN_UP(ringbuf_size(nslots), (size_t)DATA_MOVER_SHM_CACHELINE);
+	uint64_t sq_off = off;
+	off += ALIGN_UP(ringbuf_size(nslots), (size_t)DATA_MOVER_SHM_CACHELINE);
+	uint64_t descs_off = off;
+	off += (uint64_t)nslots * sizeof(struct data_mover_shm_desc);
+	uint64_t data_off = ALIGN_UP(off, (uint64_t)DATA_MOVER_SHM_PAGE);
+	uint64_t size = data_off + data_size;
+
+	struct data_mover_shm_service *svc =
+		malloc(sizeof(struct data_mover_shm_service));
+	if (svc == NULL)
+		return NULL;
+
+	svc->path = strdup(path);
+	if (svc->path == NULL)
+		goto err_free;
+
+	svc->workers = malloc(nthreads * sizeof(os_thread_t));
+	if (svc->workers == NULL)
+		goto err_path;
+
+	/* a segment left behind by another service isn't taken over */
+	int fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0)
+		goto err_workers;
+
+	if (ftruncate(fd, (off_t)size) != 0) {
+		close(fd);
+		goto err_unlink;
+	}
+
+	void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+		goto err_unlink;
+
+	/* the file is zeroed, so are the descriptors */
+	char *base = addr;
+	struct data_mover_shm_segment *seg = addr;
+	seg->version = DATA_MOVER_SHM_VERSION;
+	seg->size = size;
+	seg->free_off = free_off;
+	seg->sq_off = sq_off;
+	seg->descs_off = descs_off;
+	seg->data_off = data_off;
+	seg->data_size = data_size;
+	seg->nslots = nslots;
+	seg->running = 1;
+
+	struct ringbuf *free_queue = ringbuf_init(base + free_off, nslots);
+	for (uintptr_t i = 1; i <= nslots; i++) {
+		int ret = ringbuf_tryenqueue(free_queue, (void *)i);
+		ASSERTeq(ret, 0);
+	}
+
+	svc->seg = seg;
+	svc->sq = ringbuf_init(base + sq_off, nslots);
+	svc->descs = (struct data_mover_shm_desc *)(base + descs_off);
+	svc->data = base + data_off;
+	svc->size = size;
+	svc->data_size = data_size;
+	svc->nslots = nslots;
+	svc->nworkers = nthreads;
+	svc->stop = 0;
+
+	size_t i;
+	for (i = 0; i < nthreads; i++) {
+		if (os_thread_create(&svc->workers[i], NULL,
+				data_mover_shm_worker, svc) != 0)
+			goto err_threads;
+		if (ncpus != 0 && data_mover_shm_pin(&svc->workers[i],
+				cpus[i % ncpus]) != 0) {
+			i++;
+			goto err_threads;
+		}
+	}
+
+	/* the clients can map the segment from now on */
+	util_atomic_store_explicit64(&seg->magic, DATA_MOVER_SHM_MAGIC,
+		memory_order_release);
+
+	return svc;
+
+err_threads:
+	data_mover_shm_service_stop(svc, i);
+	munmap(addr, size);
+err_unlink:
+	unlink(path);
+err_workers:
+	free(svc->workers);
+err_path:
+	free(svc->path);
+err_free:
+	free(svc);
+	return NULL;
+}
+
+/*
+ * data_mover_shm_service_delete -- stops the service and removes its
+ * segment, all the operations of its clients have to be complete
+ *
+ * The clients, which still map the segment, perform their new operations
+ * on their own.
+ */
+void
+data_mover_shm_service_delete(struct data_mover_shm_service *svc)
+{
+	data_mover_shm_service_stop(svc, svc->nworkers);
+
+	unlink(svc->path);
+	munmap(svc->seg, svc->size);
+	free(svc->workers);
+	free(svc->path);
+	free(svc);
+}
+
+/*
+ * data_mover_shm_offset -- (internal) returns the offset of the range in
+ * the data area, or -1 if it doesn't lie within it
+ */
+static int64_t
+data_mover_shm_offset(struct data_mover_shm *shm, const void *addr, size_t n)
+{
+	uintptr_t base = (uintptr_t)shm->data;
+	uintptr_t p = (uintptr_t)addr;
+	if (p < base ||
+	    !data_mover_shm_in_data(shm->seg->data_size, p - base, n))
+		return -1;
+
+	return (int64_t)(p - base);
+}
+
+/*
+ * data_mover_shm_desc_init -- (internal) fills in the descriptor of
+ * the operation, returns -1 if the service can't perform it
+ */
+static int
+data_mover_shm_desc_init(struct data_mover_shm *shm,
+	const struct vdm_operation *operation, struct data_mover_shm_desc *desc)
+{
+	int64_t dest;
+	int64_t src = 0;
+	size_t n;
+
+	memset(desc, 0, sizeof(*desc));
+	switch (operation->type) {
+		case VDM_OPERATION_MEMCPY: {
+			const struct vdm_operation_data_memcpy *mdata =
+				&operation->data.memcpy;
+			n = mdata->n;
+			dest = data_mover_shm_offset(shm, mdata->dest, n);
+			src = data_mover_shm_offset(shm, mdata->src, n);
+			desc->flags = mdata->flags;
+		} break;
+		case VDM_OPERATION_MEMMOVE: {
+			const struct vdm_operation_data_memmove *mdata =
+				&operation->data.memmove;
+			n = mdata->n;
+			dest = data_mover_shm_offset(shm, mdata->dest, n);
+			src = data_mover_shm_offset(shm, mdata->src, n);
+			desc->flags = mdata->flags;
+		} break;
+		case VDM_OPERATION_MEMSET: {
+			const struct vdm_operation_data_memset *mdata =
+				&operation->data.memset;
+			n = mdata->n;
+			dest = data_mover_shm_offset(shm, mdata->str, n);
+			desc->flags = mdata->flags;
+			desc->c = mdata->c;
+		} break;
+		case VDM_OPERATION_FLUSH: {
+			const struct vdm_operation_data_flush *mdata =
+				&operation->data.flush;
+			n = mdata->n;
+			dest = data_mover_shm_offset(shm, mdata->dest, n);
+		} break;
+		default:
+			return -1;
+	}
+
+	if (dest < 0 || src < 0 || n == 0)
+		return -1;
+
+	desc->type = operation->type;
+	desc->dest = (uint64_t)dest;
+	desc->src = (uint64_t)src;
+	desc->n = n;
+
+	return 0;
+}
+
+/*
+ * data_mover_shm_operation_new -- creates a new shm operation
+ */
+static void *
+data_mover_shm_operation_new(struct vdm *vdm,
+	const enum vdm_operation_type type)
+{
+	SUPPRESS_UNUSED(type);
+
+	struct data_mover_shm *shm = (struct data_mover_shm *)vdm;
+	struct data_mover_shm_data *sdata = membuf_alloc(shm->membuf,
+		sizeof(struct data_mover_shm_data));
+	if (sdata == NULL)
+		return NULL;
+
+	sdata->shm = shm;
+	sdata->in_membuf = 1;
+
+	return sdata;
+}
+
+/*
+ * data_mover_shm_operation_init -- creates a new shm operation
+ * in the storage provided by the caller
+ */
+static void *
+data_mover_shm_operation_init(struct vdm *vdm,
+	const enum vdm_operation_type type, void *storage)
+{
+	SUPPRESS_UNUSED(type);
+
+	struct data_mover_shm_data *sdata = storage;
+	sdata->shm = (struct data_mover_shm *)vdm;
+	sdata->in_membuf = 0;
+
+	return sdata;
+}
+
+/*
+ * data_mover_shm_operation_delete -- deletes a shm operation
+ */
+static void
+data_mover_shm_operation_delete(void *data,
+	const struct vdm_operation *operation,
+	struct vdm_operation_output *output)
+{
+	struct data_mover_shm_data *sdata = data;
+
+	if (sdata->cpu_data != NULL) {
+		struct vdm *sync = data_mover_sync_get_vdm(sdata->shm->dms);
+		sync->op_delete(sdata->cpu_data, operation, output);
+	} else {
+		*output = sdata->output;
+		output->type = operation->type;
+	}
+
+	if (sdata->in_membuf)
+		membuf_free(data);
+}
+
+/*
+ * data_mover_shm_operation_check -- checks the completion flag of
+ * the descriptor of the operation, frees the descriptor once it's set
+ */
+static enum future_state
+data_mover_shm_operation_check(void *data,
+	const struct vdm_operation *operation)
+{
+	SUPPRESS_UNUSED(operation);
+
+	struct data_mover_shm_data *sdata = data;
+	struct data_mover_shm *shm = sdata->shm;
+	if (sdata->desc == 0)
+		return FUTURE_STATE_COMPLETE;
+
+	struct data_mover_shm_desc *desc = &shm->descs[sdata->desc - 1];
+	uint64_t complete;
+	util_atomic_load_explicit64(&desc->complete, &complete,
+		memory_order_acquire);
+	if (!complete)
+		return FUTURE_STATE_RUNNING;
+
+	sdata->output.result = (enum vdm_operation_result)desc->result;
+	int ret = ringbuf_tryenqueue(shm->free,
+		(void *)(uintptr_t)sdata->desc);
+	ASSERTeq(ret, 0);
+	sdata->desc = 0;
+
+	return FUTURE_STATE_COMPLETE;
+}
+
+/*
+ * data_mover_shm_operation_start -- submits the operation to the service,
+ * returns -1 if there is no free descriptor, or performs it on the cpu
+ */
+static int
+data_mover_shm_operation_start(void *data,
+	const struct vdm_operation *operation, struct future_notifier *n)
+{
+	struct data_mover_shm_data *sdata = data;
+	struct data_mover_shm *shm = sdata->shm;
+	struct vdm_operation_output *output = &sdata->output;
+
+	if (n)
+		n->notifier_used = FUTURE_NOTIFIER_NONE;
+	sdata->cpu_data = NULL;
+	sdata->desc = 0;
+	output->result = VDM_SUCCESS;
+
+	uint32_t running;
+	util_atomic_load_explicit32(&shm->seg->running, &running,
+		memory_order_acquire);
+
+	struct data_mover_shm_desc desc;
+	if (!running || data_mover_shm_desc_init(shm, operation, &desc) != 0) {
+		struct vdm *sync = data_mover_sync_get_vdm(shm->dms);
+		sdata->cpu_data = sync->op_new(sync, operation->type);
+		if (sdata->cpu_data == NULL) {
+			output->result = VDM_ERROR_OUT_OF_MEMORY;
+			return 0;
+		}
+
+		return sync->op_start(sdata->cpu_data, operation, NULL);
+	}
+
+	switch (operation->type) {
+		case VDM_OPERATION_MEMCPY:
+			output->output.memcpy.dest =
+				operation->data.memcpy.dest;
+			break;
+		case VDM_OPERATION_MEMMOVE:
+			output->output.memmove.dest =
+				operation->data.memmove.dest;
+			break;
+		case VDM_OPERATION_MEMSET:
+			output->output.memset.str = operation->data.memset.str;
+			break;
+		default:
+			output->output.flush.unused = 0;
+	}
+
+	uintptr_t index = (uintptr_t)ringbuf_trydequeue(shm->free);
+	if (index == 0)
+		return -1;
+
+	/* published to the service by the release of the submission */
+	sdata->desc = (uint32_t)index;
+	shm->descs[index - 1] = desc;
+
+	/* the queue has a slot for every descriptor */
+	int ret = ringbuf_tryenqueue(shm->sq, (void *)index);
+	ASSERTeq(ret, 0);
+
+	if (n) {
+		n->notifier_used = FUTURE_NOTIFIER_POLLER;
+		n->poller.ptr_to_monitor = &shm->descs[index - 1].complete;
+	}
+
+	return 0;
+}
+
+/*
+ * data_mover_shm_has_property -- the operations of the shm mover
+ * are asynchronous
+ */
+static int
+data_mover_shm_has_property(void *fut, enum future_property property)
+{
+	SUPPRESS_UNUSED(fut);
+
+	return property == FUTURE_PROPERTY_ASYNC;
+}
+
+static struct vdm data_mover_shm_vdm = {
+	.op_new = data_mover_shm_operation_new,
+	.op_delete = data_mover_shm_operation_delete,
+	.op_check = data_mover_shm_operation_check,
+	.op_start = data_mover_shm_operation_start,
+	.capabilities = SUPPORTED_FLAGS,
+	.has_property = data_mover_shm_has_property,
+	.op_init = data_mover_shm_operation_init,
+	.op_storage_size = ALIGN_UP(sizeof(struct data_mover_shm_data),
+		(size_t)VDM_OP_STORAGE_ALIGN),
+};
+
+/*
+ * data_mover_shm_map -- (internal) maps the segment of the service,
+ * returns NULL if it isn't one
+ */
+static struct data_mover_shm_segment *
+data_mover_shm_map(const char *path)
+{
+	int fd = open(path, O_RDWR);
+	if (fd < 0)
+		return NULL;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return NULL;
+	}
+	if ((size_t)st.st_size < sizeof(struct data_mover_shm_segment)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	size_t size = (size_t)st.st_size;
+	void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+		return NULL;
+
+	struct data_mover_shm_segment *seg = addr;
+	uint64_t magic;
+	util_atomic_load_explicit64(&seg->magic, &magic, memory_order_acquire);
+	if (magic != DATA_MOVER_SHM_MAGIC ||
+	    seg->version != DATA_MOVER_SHM_VERSION || seg->size != size) {
+		munmap(addr, size);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return seg;
+}
+
+/*
+ * data_mover_shm_new -- creates a new shm data mover, which submits
+ * the operations to the service of the segment in the given file
+ */
+struct data_mover_shm *
+data_mover_shm_new(const char *path)
+{
+	struct data_mover_shm *shm = malloc(sizeof(struct data_mover_shm));
+	if (shm == NULL)
+		return NULL;
+
+	shm->base = data_mover_shm_vdm;
+	shm->seg = data_mover_shm_map(path);
+	if (shm->seg == NULL)
+		goto err_free;
+
+	char *base = (char *)shm->seg;
+	shm->free = (struct ringbuf *)(base + shm->seg->free_off);
+	shm->sq = (struct ringbuf *)(base + shm->seg->sq_off);
+	shm->descs = (struct data_mover_shm_desc *)(base +
+		shm->seg->descs_off);
+	shm->data = base + shm->seg->data_off;
+
+	shm->membuf = membuf_new(shm, 0, MEMBUF_PAGES_NORMAL);
+	if (shm->membuf == NULL)
+		goto err_unmap;
+
+	shm->dms = data_mover_sync_new();
+	if (shm->dms == NULL)
+		goto err_membuf;
+
+	return shm;
+
+err_membuf:
+	membuf_delete(shm->membuf);
+err_unmap:
+	munmap(shm->seg, shm->seg->size);
+err_free:
+	free(shm);
+	return NULL;
+}
+
+/*
+ * data_mover_shm_get_data -- returns the data area of the segment, whose
+ * operations are performed by the service
+ */
+void *
+data_mover_shm_get_data(struct data_mover_shm *shm, size_t *size)
+{
+	*size = shm->seg->data_size;
+
+	return shm->data;
+}
+
+/*
+ * data_mover_shm_get_vdm -- returns the vdm operations for the shm mover
+ */
+struct vdm *
+data_mover_shm_get_vdm(struct data_mover_shm *shm)
+{
+	return &shm->base;
+}
+
+/*
+ * data_mover_shm_get_membuf_stats -- returns the statistics of the buffers
+ * the operations are allocated from
+ */
+void
+data_mover_shm_get_membuf_stats(struct data_mover_shm *shm,
+	struct vdm_membuf_stats *stats)
+{
+	membuf_get_stats(shm->membuf, stats);
+}
+
+/*
+ * data_mover_shm_delete -- deletes a shm data mover, all its operations
+ * have to be complete
+ */
+void
+data_mover_shm_delete(struct data_mover_shm *shm)
+{
+	data_mover_sync_delete(shm->dms);
+	membuf_delete(shm->membuf);
+	munmap(shm->seg, shm->seg->size);
+	free(shm);
+}
@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * data_mover_shm_none.c -- shm data mover stubs for the platforms without
+ * the shared file mappings, neither the service nor the mover can be created
+ */
+
+#include <errno.h>
+#include <stddef.h>
+
+#include "libminiasync/data_mover_shm.h"
+#include "core/util.h"
+
+struct data_mover_shm_service *
+data_mover_shm_service_new(const char *path, size_t data_size,
+	unsigned nslots, size_t nthreads, const unsigned *cpus, size_t ncpus)
+{
+	SUPPRESS_UNUSED(path, data_size, nslots, nthreads, cpus, ncpus);
+
+	errno = ENOTSUP;
+	return NULL;
+}
+
+void
+data_mover_shm_service_delete(struct data_mover_shm_service *svc)
+{
+	SUPPRESS_UNUSED(svc);
+}
+
+struct data_mover_shm *
+data_mover_shm_new(const char *path)
+{
+	SUPPRESS_UNUSED(path);
+
+	errno = ENOTSUP;
+	return NULL;
+}
+
+void *
+data_mover_shm_get_data(struct data_mover_shm *shm, size_t *size)
+{
+	SUPPRESS_UNUSED(shm);
+
+	*size = 0;
+	return NULL;
+}
+
+struct vdm *
+data_mover_shm_get_vdm(struct data_mover_shm *shm)
+{
+	SUPPRESS_UNUSED(shm);
+
+	return NULL;
+}
+
+void
+data_mover_shm_get_membuf_stats(struct data_mover_shm *shm,
+	struct vdm_membuf_stats *stats)
+{
+	SUPPRESS_UNUSED(shm, stats);
+}
+
+void
+data_mover_shm_delete(struct data_mover_shm *shm)
+{
+	SUPPRESS_UNUSED(shm);
+}
@@ -8,10 +8,17 @@
 #endif
 
 #include "libminiasync/vdm.h"
+#include "core/fileops.h"
 #include "core/membuf.h"
+#include "core/memops.h"
 #include "core/out.h"
+#include "core/tracepoint.h"
 
-#define SUPPORTED_FLAGS 0
+#ifdef MEMOPS_FLUSH_SUPPORTED
+#define SUPPORTED_FLAGS (VDM_F_MEM_DURABLE | VDM_F_NO_CACHE_HINT)
+#else
+#define SUPPORTED_FLAGS VDM_F_NO_CACHE_HINT
+#endif
 
 struct data_mover_sync {
 	struct vdm base; /* must be first */
@@ -21,8 +28,20 @@ struct data_mover_sync {
 
 struct data_mover_sync_data {
 	int complete;
+	int in_membuf; /* allocated by op_new, not in the caller's storage */
+	struct vdm_operation_output output; /* of the operations with results */
 };
 
+/*
+ * sync_memops_flags -- (internal) translates the vdm operation flags
+ */
+static unsigned
+sync_memops_flags(uint64_t flags)
+{
+	return ((flags & VDM_F_MEM_DURABLE) ? MEMOPS_F_DURABLE : 0) |
+		((flags & VDM_F_NO_CACHE_HINT) ? MEMOPS_F_NO_CACHE : 0);
+}
+
 /*
  * sync_operation_check -- always returns COMPLETE because sync mover operations
  * are complete immediately after starting.
@@ -56,6 +75,28 @@ sync_operation_new(struct vdm *vdm, const enum vdm_operation_type type)
 		return NULL;
 
 	sync_data->complete = 0;
+	sync_data->in_membuf = 1;
+	sync_data->output.result = VDM_SUCCESS;
+	TRACEPOINT(sync_op_new, sync_data, type);
+
+	return sync_data;
+}
+
+/*
+ * sync_operation_init -- creates a new sync operation in the storage
+ * provided by the caller
+ */
+static void *
+sync_operation_init(struct vdm *vdm, const enum vdm_operation_type type,
+	void *storage)
+{
+	SUPPRESS_UNUSED(vdm, type);
+
+	struct data_mover_sync_data *sync_data = storage;
+	sync_data->complete = 0;
+	sync_data->in_membuf = 0;
+	sync_data->output.result = VDM_SUCCESS;
+	TRACEPOINT(sync_op_new, sync_data, type);
 
 	return sync_data;
 }
@@ -67,6 +108,8 @@ static void
 sync_operation_delete(void *data, const struct vdm_operation *operation,
 	struct vdm_operation_output *output)
 {
+	struct data_mover_sync_data *sync_data = data;
+	TRACEPOINT(sync_op_delete, sync_data);
 	output->result = VDM_SUCCESS;
 
 	switch (operation->type) {
@@ -85,11 +128,33 @@ sync_operation_delete(void *data, const struct vdm_operation *operation,
 			output->output.memset.str =
 				operation->data.memset.str;
 			break;
+		case VDM_OPERATION_FLUSH:
+			output->type = VDM_OPERATION_FLUSH;
+			output->output.flush.unused = 0;
+			break;
+		case VDM_OPERATION_MEMCPY_V:
+			output->type = VDM_OPERATION_MEMCPY_V;
+			output->output.memcpy_v.n =
+				vdm_memcpy_v_size(&operation->data.memcpy_v);
+			break;
+		case VDM_OPERATION_COMPARE:
+		case VDM_OPERATION_COMPARE_PATTERN:
+		case VDM_OPERATION_CRC32C:
+		case VDM_OPERATION_DUALCAST:
+		case VDM_OPERATION_DELTA_CREATE:
+		case VDM_OPERATION_DELTA_APPLY:
+		case VDM_OPERATION_MEMFILL:
+		case VDM_OPERATION_PREAD:
+		case VDM_OPERATION_PWRITE:
+			*output = sync_data->output;
+			output->type = operation->type;
+			break;
 		default:
 			ASSERT(0);
 	}
 
-	membuf_free(data);
+	if (sync_data->in_membuf)
+		membuf_free(data);
 }
 
 /*
@@ -101,40 +166,145 @@ sync_operation_start(void *data, const struct vdm_operation *operation,
 {
 	struct data_mover_sync_data *sync_data =
 		(struct data_mover_sync_data *)data;
+	TRACEPOINT(sync_op_start, sync_data, operation->type,
+		vdm_operation_size(operation));
 
 	if (n)
 		n->notifier_used = FUTURE_NOTIFIER_NONE;
 
 	switch (operation->type) {
-		case VDM_OPERATION_MEMCPY:
-			memcpy(operation->data.memcpy.dest,
-				operation->data.memcpy.src,
-				operation->data.memcpy.n);
-			break;
-		case VDM_OPERATION_MEMMOVE:
-			memmove(operation->data.memcpy.dest,
-				operation->data.memcpy.src,
-				operation->data.memcpy.n);
+		case VDM_OPERATION_MEMCPY: {
+			const struct vdm_operation_data_memcpy *mdata =
+				&operation->data.memcpy;
+			memops_memcpy(mdata->dest, mdata->src, mdata->n,
+				sync_memops_flags(mdata->flags));
+		} break;
+		case VDM_OPERATION_MEMMOVE: {
+			const struct vdm_operation_data_memmove *mdata =
+				&operation->data.memmove;
+			memops_memmove(mdata->dest, mdata->src, mdata->n,
+				sync_memops_flags(mdata->flags));
+		} break;
+		case VDM_OPERATION_MEMSET: {
+			const struct vdm_operation_data_memset *mdata =
+				&operation->data.memset;
+			memops_memset(mdata->str, mdata->c, mdata->n,
+				sync_memops_flags(mdata->flags));
+		} break;
+		case VDM_OPERATION_FLUSH:
+			memops_flush(operation->data.flush.dest,
+				operation->data.flush.n);
 			break;
-		case VDM_OPERATION_MEMSET:
-			memset(operation->data.memset.str,
-				operation->data.memset.c,
-				operation->data.memset.n);
+		case VDM_OPERATION_MEMCPY_V: {
+			const struct vdm_operation_data_memcpy_v *mdata =
+				&operation->data.memcpy_v;
+			unsigned flags = sync_memops_flags(mdata->flags);
+			for (size_t i = 0; i < mdata->cnt; ++i) {
+				size_t len = mdata->src[i].iov_len;
+				if (mdata->dest[i].iov_len < len)
+					len = mdata->dest[i].iov_len;
+				memops_memcpy(mdata->dest[i].iov_base,
+					mdata->src[i].iov_base, len, flags);
+			}
+		} break;
+		case VDM_OPERATION_COMPARE: {
+			const struct vdm_operation_data_compare *mdata =
+				&operation->data.compare;
+			struct vdm_operation_output_compare *out =
+				&sync_data->output.output.compare;
+			out->offset = memops_compare(mdata->src1, mdata->src2,
+				mdata->n);
+			out->result = out->offset != mdata->n;
+		} break;
+		case VDM_OPERATION_COMPARE_PATTERN: {
+			const struct vdm_operation_data_compare_pattern *mdata =
+				&operation->data.compare_pattern;
+			struct vdm_operation_output_compare_pattern *out =
+				&sync_data->output.output.compare_pattern;
+			out->offset = memops_compare_pattern(mdata->src,
+				mdata->pattern, mdata->n);
+			out->result = out->offset != mdata->n;
+		} break;
+		case VDM_OPERATION_CRC32C: {
+			const struct vdm_operation_data_crc32c *mdata =
+				&operation->data.crc32c;
+			sync_data->output.output.crc32c.crc = memops_crc32c(
+				mdata->seed, mdata->src, mdata->n);
+		} break;
+		case VDM_OPERATION_DUALCAST: {
+			const struct vdm_operation_data_dualcast *mdata =
+				&operation->data.dualcast;
+			unsigned flags = sync_memops_flags(mdata->flags);
+			memops_memcpy(mdata->dest1, mdata->src, mdata->n,
+				flags);
+			memops_memcpy(mdata->dest2, mdata->src, mdata->n,
+				flags);
+			sync_data->output.output.dualcast.dest1 = mdata->dest1;
+			sync_data->output.output.dualcast.dest2 = mdata->dest2;
+		} break;
+		case VDM_OPERATION_DELTA_CREATE: {
+			const struct vdm_operation_data_delta_create *mdata =
+				&operation->data.delta_create;
+			struct vdm_operation_output_delta_create *out =
+				&sync_data->output.output.delta_create;
+			int ret = memops_delta_create(mdata->original,
+				mdata->modified, mdata->n, mdata->delta,
+				mdata->delta_max, &out->delta_size);
+			if (ret < 0)
+				sync_data->output.result =
+					VDM_ERROR_JOB_CORRUPTED;
+			else
+				out->result = (enum vdm_delta_result)ret;
+		} break;
+		case VDM_OPERATION_DELTA_APPLY: {
+			const struct vdm_operation_data_delta_apply *mdata =
+				&operation->data.delta_apply;
+			if (memops_delta_apply(mdata->dest, mdata->n,
+					mdata->delta, mdata->delta_size,
+					sync_memops_flags(mdata->flags)) != 0)
+				sync_data->output.result =
+					VDM_ERROR_JOB_CORRUPTED;
+			sync_data->output.output.delta_apply.dest = mdata->dest;
+		} break;
+		case VDM_OPERATION_MEMFILL: {
+			const struct vdm_operation_data_memfill *mdata =
+				&operation->data.memfill;
+			if (memops_memfill(mdata->dest, mdata->pattern,
+					mdata->pattern_len, mdata->n,
+					sync_memops_flags(mdata->flags)) != 0)
+				sync_data->output.result =
+					VDM_ERROR_JOB_CORRUPTED;
+			sync_data->output.output.memfill.dest = mdata->dest;
+		} break;
+		case VDM_OPERATION_PREAD:
+		case VDM_OPERATION_PWRITE:
+			fileops_perform(operation, &sync_data->output);
 			break;
-		case VDM_OPERATION_FLUSH:
-			printf("flush operation not implemented "
-						"for sync data mover");
-			exit(1);
 		default:
 			ASSERT(0);
 	}
 
+	TRACEPOINT(sync_op_complete, sync_data);
 	util_atomic_store_explicit32(&sync_data->complete,
 		1, memory_order_release);
 
 	return 0;
 }
 
+/*
+ * sync_operation_start_cb -- perform a synchronous memory operation
+ * and call the function, before returning
+ */
+static int
+sync_operation_start_cb(void *data, const struct vdm_operation *operation,
+	vdm_complete_fn fn, void *arg)
+{
+	sync_operation_start(data, operation, NULL);
+	fn(arg);
+
+	return 0;
+}
+
 static struct vdm data_mover_sync_vdm = {
 	.op_new = sync_operation_new,
 	.op_delete = sync_operation_delete,
@@ -142,6 +312,10 @@ static struct vdm data_mover_sync_vdm = {
 	.op_start = sync_operation_start,
 	.capabilities = SUPPORTED_FLAGS,
 	.has_property = NULL,
+	.op_init = sync_operation_init,
+	.op_storage_size = ALIGN_UP(sizeof(struct data_mover_sync_data),
+		(size_t)VDM_OP_STORAGE_ALIGN),
+	.op_start_cb = sync_operation_start_cb,
 };
 
 /*
@@ -154,8 +328,14 @@ data_mover_sync_new(void)
 	if (dms == NULL)
 		return NULL;
 
+	COMPILE_ERROR_ON(MEMOPS_DELTA_EQUAL != VDM_DELTA_EQUAL);
+	COMPILE_ERROR_ON(MEMOPS_DELTA_CREATED != VDM_DELTA_CREATED);
+	COMPILE_ERROR_ON(MEMOPS_DELTA_OVERFLOW != VDM_DELTA_OVERFLOW);
+	COMPILE_ERROR_ON(MEMOPS_DELTA_MAX_SIZE != VDM_DELTA_MAX_SIZE);
+	COMPILE_ERROR_ON(MEMOPS_FILL_MAX_PATTERN != VDM_MEMFILL_MAX_PATTERN);
+
 	dms->base = data_mover_sync_vdm;
-	dms->membuf = membuf_new(dms);
+	dms->membuf = membuf_new(dms, 0, MEMBUF_PAGES_NORMAL);
 	if (dms->membuf == NULL)
 		goto membuf_failed;
 
@@ -175,6 +355,17 @@ data_mover_sync_get_vdm(struct data_mover_sync *dms)
 	return &dms->base;
 }
 
+/*
+ * data_mover_sync_get_membuf_stats -- returns the statistics of the buffers
+ * the operations are allocated from
+ */
+void
+data_mover_sync_get_membuf_stats(struct data_mover_sync *dms,
+	struct vdm_membuf_stats *stats)
+{
+	membuf_get_stats(dms->membuf, stats);
+}
+
 /*
  * data_mover_sync_delete -- deletes a synchronous data mover
  */
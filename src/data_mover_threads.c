@@ -8,17 +8,34 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include "core/fileops.h"
 #include "core/membuf.h"
+#include "core/memops.h"
+#include "core/os.h"
 #include "core/out.h"
 #include "libminiasync/data_mover_threads.h"
 #include "core/util.h"
+#include "core/eventcount.h"
 #include "core/os_thread.h"
 #include "core/ringbuf.h"
+#include "core/spscring.h"
+#include "core/tracepoint.h"
 
 #define DATA_MOVER_THREADS_DEFAULT_NTHREADS 12
 #define DATA_MOVER_THREADS_DEFAULT_RINGBUF_SIZE 128
+#define DATA_MOVER_THREADS_DEFAULT_IDLE_TIMEOUT 1000000000ULL /* 1s */
+#define DATA_MOVER_THREADS_BATCH_SIZE 8 /* operations taken from a queue */
+#define DATA_MOVER_THREADS_SUBMIT_BATCH_SIZE 64 /* queued at once */
+/* pieces the low priority operations are paced in */
+#define DATA_MOVER_THREADS_LOW_CHUNK_SIZE (64 * 1024)
+#define DATA_MOVER_THREADS_NSEC_IN_SEC 1000000000ULL
 
-#define SUPPORTED_FLAGS 0
+#ifdef MEMOPS_FLUSH_SUPPORTED
+#define SUPPORTED_FLAGS (VDM_F_MEM_DURABLE | VDM_F_NO_CACHE_HINT | \
+	VDM_F_PRIORITY_LOW)
+#else
+#define SUPPORTED_FLAGS (VDM_F_NO_CACHE_HINT | VDM_F_PRIORITY_LOW)
+#endif
 
 struct data_mover_threads_op_fns {
 	memcpy_fn op_memcpy;
@@ -26,31 +43,180 @@ struct data_mover_threads_op_fns {
 	memset_fn op_memset;
 };
 
+struct data_mover_threads_data;
+
+/*
+ * Every worker has a queue of its own, submitting threads are assigned to
+ * the queues round-robin. Idle workers steal from the queues of the other
+ * workers before going to sleep. The queues of the workers which are not
+ * running are drained by stealing only.
+ */
+struct data_mover_threads_worker {
+	struct data_mover_threads *dmt;
+	struct ringbuf *buf;
+	os_thread_t thread;
+	size_t id;
+	int started; /* the thread was created and not joined yet */
+	int exited; /* the thread has retired and can be joined */
+
+	/*
+	 * Operations taken from the worker's own queue at once, performed
+	 * before looking at the queues again. Stealing takes one at a time.
+	 */
+	void *batch[DATA_MOVER_THREADS_BATCH_SIZE];
+	size_t nbatch;
+	size_t next_batch;
+
+	uint64_t low_chunk; /* of the low priority operation taken last */
+	uint64_t low_wait; /* until the bandwidth limit lets it take one */
+};
+
+/*
+ * With shared completions, the poller futures of the operations submitted
+ * through one queue monitor a single counter of operations, which are
+ * complete but weren't collected by the polling thread yet. It remains zero
+ * until at least one of those futures can make progress, so that the runtime
+ * can monitor one cache line instead of the complete flags of all of them.
+ */
+struct data_mover_threads_completions {
+	union {
+		uint64_t ncompleted;
+		uint64_t padding[8];
+	} u;
+};
+
 struct data_mover_threads {
 	struct vdm base; /* must be first */
 
 	struct data_mover_threads_op_fns op_fns;
-	struct ringbuf *buf;
-	size_t nthreads;
-	os_thread_t *threads;
+	size_t nthreads; /* the maximum number of running workers */
+	size_t min_threads; /* idle workers retire down to this number */
+	size_t nqueues; /* at least one, even without workers */
+	struct data_mover_threads_worker *workers;
 	struct membuf *membuf;
+	size_t membuf_max_buffers; /* 0 - the default of membuf */
+	int membuf_node; /* NUMA node of the buffers of membuf */
 	enum future_notifier_type desired_notifier;
+	size_t chunk_size; /* larger operations are split, 0 - disabled */
+	size_t inline_threshold; /* smaller operations run in the caller */
+	int shared_completion; /* poller futures monitor the queue counter */
+	struct data_mover_threads_completions *completions; /* one per queue */
+
+	os_tls_key_t queue_key; /* queue of the submitting thread, plus one */
+	uint64_t next_queue;
+
+	/*
+	 * With lanes, each of the first nlanes submitting threads gets
+	 * a single-producer/single-consumer queue of its own, drained only
+	 * by the worker lane % nthreads. The other threads submit to
+	 * the shared queues.
+	 */
+	struct spscring **lanes;
+	uint64_t nlanes;
+	uint64_t next_lane;
+	os_tls_key_t lane_key; /* lane of the submitting thread, plus one */
+	struct eventcount work_event; /* new operations for idle workers */
+	uint64_t spin_count; /* polls of the queues before parking */
+	int stopping;
+
+	/*
+	 * The workers are started when more operations are queued than there
+	 * are idle workers, and retire after idling for idle_timeout. Both
+	 * happen under the pool lock. Queued operations are counted only if
+	 * the number of running workers can change.
+	 */
+	os_mutex_t pool_lock;
+	uint64_t nrunning;
+	uint64_t nidle; /* looking for operations or asleep */
+	uint64_t nqueued;
+	uint64_t idle_timeout;
+
+	/*
+	 * Operations submitted while all the queues were full, in FIFO order.
+	 * The workers move them to the queues as they make room.
+	 */
+	os_mutex_t overflow_lock;
+	struct data_mover_threads_data *overflow_head;
+	struct data_mover_threads_data **overflow_tail;
+	uint64_t noverflow;
+
+	/*
+	 * Operations with VDM_F_PRIORITY_LOW, in FIFO order. The workers take
+	 * them only when the other queues are empty, one chunk at a time.
+	 * With the bandwidth limit, each chunk pays for its bytes from
+	 * a token bucket, which may go into debt by a chunk at most.
+	 */
+	os_mutex_t low_lock;
+	struct data_mover_threads_data *low_head;
+	struct data_mover_threads_data **low_tail;
+	uint64_t nlow;
+	uint64_t low_rate; /* bytes per second, 0 - unlimited */
+	uint64_t low_burst; /* bytes the bucket holds at most */
+	int64_t low_tokens;
+	uint64_t low_refill; /* the time the tokens were last added at */
 };
 
 struct data_mover_threads_data {
+	struct data_mover_threads *dmt;
+	int in_membuf; /* allocated by op_new, not in the caller's storage */
 	enum future_notifier_type desired_notifier;
-	struct future_notifier notifier;
+	union {
+		struct future_notifier notifier; /* unless desired is NONE */
+		struct {
+			vdm_complete_fn fn; /* called once complete, or NULL */
+			void *arg;
+		} callback; /* if the desired notifier is NONE */
+	} u;
 	uint64_t complete;
-	uint64_t started;
+	uint64_t started; /* FUTURE_STATE_RUNNING, plus the bits below */
+	uint64_t *ncompleted; /* shared completion counter, if any */
+	/* in the overflow queue, or in the low priority list */
+	struct data_mover_threads_data *next_overflow;
+
+	/*
+	 * An operation split into chunks is queued to several workers, which
+	 * take the chunks until none are left. The last worker to let go of
+	 * the operation completes it.
+	 */
+	size_t size; /* bytes the operation works on, in all fragments */
+	size_t chunk_size;
+	uint64_t nchunks;
+	uint64_t next_chunk;
+	uint64_t nrefs;
 
 	struct vdm_operation op;
+	struct vdm_operation_output output; /* of the operations with results */
 };
 
+/* the cancellation was requested, the work not taken yet is dropped */
+#define DATA_MOVER_THREADS_CANCEL_REQUESTED (1ULL << 8)
+/* at least a part of the work was dropped, the operation failed */
+#define DATA_MOVER_THREADS_CANCEL_DROPPED (1ULL << 9)
+/* the operation is queued to the low priority list */
+#define DATA_MOVER_THREADS_PRIORITY_LOW (1ULL << 10)
+
+/* the operations in the caller's storage mustn't share cache lines either */
+#define DATA_MOVER_THREADS_DATA_SIZE \
+	ALIGN_UP(sizeof(struct data_mover_threads_data), \
+	(size_t)MEMBUF_CACHELINE_SIZE)
+
+/*
+ * std_memops_flags -- (internal) translates the vdm operation flags
+ */
+static unsigned
+std_memops_flags(unsigned flags)
+{
+	return ((flags & VDM_F_MEM_DURABLE) ? MEMOPS_F_DURABLE : 0) |
+		((flags & VDM_F_NO_CACHE_HINT) ? MEMOPS_F_NO_CACHE : 0);
+}
+
 /*
  * Standard implementation of memcpy used if none was specified by the user.
+ * Large copies and the ones with VDM_F_NO_CACHE_HINT bypass the cache.
  */
 void *std_memcpy(void *dst, const void *src, size_t n, unsigned flags) {
-	return memcpy(dst, src, n);
+	memops_memcpy(dst, src, n, std_memops_flags(flags));
+	return dst;
 }
 
 void data_mover_threads_set_memcpy_fn(struct data_mover_threads *dmt,
@@ -60,9 +226,11 @@ void data_mover_threads_set_memcpy_fn(struct data_mover_threads *dmt,
 
 /*
  * Standard implementation of memmove used if none was specified by the user.
+ * Moves between disjoint buffers bypass the cache like copies.
  */
 void *std_memmove(void *dst, const void *src, size_t n, unsigned flags) {
-	return memmove(dst, src, n);
+	memops_memmove(dst, src, n, std_memops_flags(flags));
+	return dst;
 }
 
 void data_mover_threads_set_memmove_fn(struct data_mover_threads *dmt,
@@ -72,9 +240,11 @@ void data_mover_threads_set_memmove_fn(struct data_mover_threads *dmt,
 
 /*
  * Standard implementation of memset used if none was specified by the user.
+ * Large fills and the ones with VDM_F_NO_CACHE_HINT bypass the cache.
  */
 void *std_memset(void *str, int c, size_t n, unsigned flags) {
-	return memset(str, c, n);
+	memops_memset(str, c, n, std_memops_flags(flags));
+	return str;
 }
 
 void data_mover_threads_set_memset_fn(struct data_mover_threads *dmt,
@@ -82,6 +252,156 @@ void data_mover_threads_set_memset_fn(struct data_mover_threads *dmt,
 	dmt->op_fns.op_memset = op_memset;
 }
 
+/*
+ * data_mover_threads_set_chunk_size -- sets the size of chunks, into which
+ * the larger operations are split, 0 disables splitting
+ */
+void
+data_mover_threads_set_chunk_size(struct data_mover_threads *dmt,
+	size_t chunk_size)
+{
+	dmt->chunk_size = chunk_size;
+}
+
+/*
+ * data_mover_threads_set_inline_threshold -- sets the size, below which
+ * the operations are performed synchronously when started, 0 disables it
+ */
+void
+data_mover_threads_set_inline_threshold(struct data_mover_threads *dmt,
+	size_t threshold)
+{
+	dmt->inline_threshold = threshold;
+}
+
+/*
+ * data_mover_threads_set_spin_count -- sets the number of times an idle
+ * worker polls the queues before it goes to sleep, 0 disables spinning
+ */
+void
+data_mover_threads_set_spin_count(struct data_mover_threads *dmt,
+	uint64_t spin_count)
+{
+	util_atomic_store_explicit64(&dmt->spin_count, spin_count,
+		memory_order_relaxed);
+}
+
+/*
+ * data_mover_threads_set_shared_completion -- makes the poller futures of
+ * the operations submitted by one thread monitor a shared counter
+ */
+void
+data_mover_threads_set_shared_completion(struct data_mover_threads *dmt,
+	int shared)
+{
+	dmt->shared_completion = shared;
+}
+
+/*
+ * data_mover_threads_set_lanes -- gives each of the first nlanes threads
+ * submitting operations to the mover a lane of lane_size entries, has to be
+ * called before any operation is started
+ */
+int
+data_mover_threads_set_lanes(struct data_mover_threads *dmt, size_t nlanes,
+	size_t lane_size)
+{
+	/* the worker of a lane has to be always running */
+	if (dmt->lanes != NULL || dmt->nthreads == 0 ||
+	    dmt->min_threads != dmt->nthreads)
+		return -1;
+
+	if (nlanes == 0)
+		return 0;
+
+	struct spscring **lanes = malloc(sizeof(struct spscring *) * nlanes);
+	if (lanes == NULL)
+		return -1;
+
+	size_t i;
+	for (i = 0; i < nlanes; ++i) {
+		lanes[i] = spscring_new((unsigned)lane_size);
+		if (lanes[i] == NULL)
+			goto lane_failed;
+	}
+
+	dmt->lanes = lanes;
+	/* the workers only look at the lanes once they're created */
+	util_atomic_store_explicit64(&dmt->nlanes, nlanes,
+		memory_order_release);
+
+	return 0;
+
+lane_failed:
+	while (i-- > 0)
+		spscring_delete(lanes[i]);
+	free(lanes);
+	return -1;
+}
+
+/*
+ * data_mover_threads_set_membuf -- replaces the buffers the operations are
+ * allocated from with ones of the given size and pages, has to be called
+ * before any operation is started
+ */
+int
+data_mover_threads_set_membuf(struct data_mover_threads *dmt, size_t size,
+	enum data_mover_threads_pages pages)
+{
+	enum membuf_pages membuf_pages;
+	switch (pages) {
+		case DATA_MOVER_THREADS_PAGES_NORMAL:
+			membuf_pages = MEMBUF_PAGES_NORMAL;
+			break;
+		case DATA_MOVER_THREADS_PAGES_TRANSPARENT_HUGE:
+			membuf_pages = MEMBUF_PAGES_TRANSPARENT_HUGE;
+			break;
+		case DATA_MOVER_THREADS_PAGES_HUGETLB:
+			membuf_pages = MEMBUF_PAGES_HUGETLB;
+			break;
+		default:
+			return -1;
+	}
+
+	struct membuf *membuf = membuf_new(dmt, size, membuf_pages);
+	if (membuf == NULL)
+		return -1;
+	if (dmt->membuf_max_buffers != 0)
+		membuf_set_max_threadbufs(membuf, dmt->membuf_max_buffers);
+	membuf_set_node(membuf, dmt->membuf_node);
+
+	membuf_delete(dmt->membuf);
+	dmt->membuf = membuf;
+
+	return 0;
+}
+
+/*
+ * data_mover_threads_set_membuf_node -- sets the NUMA node the buffers
+ * the operations are allocated from prefer
+ */
+void
+data_mover_threads_set_membuf_node(struct data_mover_threads *dmt, int node)
+{
+	COMPILE_ERROR_ON(DATA_MOVER_THREADS_NODE_ANY != MEMBUF_NODE_ANY);
+	COMPILE_ERROR_ON(DATA_MOVER_THREADS_NODE_LOCAL != MEMBUF_NODE_LOCAL);
+
+	dmt->membuf_node = node;
+	membuf_set_node(dmt->membuf, node);
+}
+
+/*
+ * data_mover_threads_set_membuf_limit -- sets the number of buffers each
+ * thread starting operations can allocate them from
+ */
+void
+data_mover_threads_set_membuf_limit(struct data_mover_threads *dmt,
+	size_t max_buffers)
+{
+	dmt->membuf_max_buffers = max_buffers == 0 ? 1 : max_buffers;
+	membuf_set_max_threadbufs(dmt->membuf, dmt->membuf_max_buffers);
+}
+
 static struct data_mover_threads_op_fns op_fns_default = {
 	.op_memcpy = std_memcpy,
 	.op_memmove = std_memmove,
@@ -89,50 +409,714 @@ static struct data_mover_threads_op_fns op_fns_default = {
 };
 
 /*
- * data_mover_threads_do_operation -- implementation of the various
- * operations supported by this data mover
+ * data_mover_threads_do_chunk -- implementation of the various
+ * operations supported by this data mover, performed on n bytes at offset
  */
 static void
-data_mover_threads_do_operation(struct data_mover_threads_data *data,
-				struct data_mover_threads *dmt)
+data_mover_threads_do_chunk(struct data_mover_threads_data *data,
+	struct data_mover_threads *dmt, size_t offset, size_t n)
 {
 	switch (data->op.type) {
 		case VDM_OPERATION_MEMCPY: {
 			struct vdm_operation_data_memcpy *mdata
 				= &data->op.data.memcpy;
 			memcpy_fn op_memcpy = dmt->op_fns.op_memcpy;
-			op_memcpy(mdata->dest,
-				mdata->src, mdata->n, (unsigned)mdata->flags);
+			op_memcpy((char *)mdata->dest + offset,
+				(char *)mdata->src + offset, n,
+				(unsigned)mdata->flags);
 		} break;
 		case VDM_OPERATION_MEMMOVE: {
 			struct vdm_operation_data_memmove *mdata
 				= &data->op.data.memmove;
 			memmove_fn op_memmove = dmt->op_fns.op_memmove;
-			op_memmove(mdata->dest,
-				mdata->src, mdata->n, (unsigned)mdata->flags);
+			op_memmove((char *)mdata->dest + offset,
+				(char *)mdata->src + offset, n,
+				(unsigned)mdata->flags);
 		} break;
 		case VDM_OPERATION_MEMSET: {
 			struct vdm_operation_data_memset *mdata
 				= &data->op.data.memset;
 			memset_fn op_memset = dmt->op_fns.op_memset;
-			op_memset(mdata->str,
-				mdata->c, mdata->n, (unsigned)mdata->flags);
+			op_memset((char *)mdata->str + offset,
+				mdata->c, n, (unsigned)mdata->flags);
 		} break;
-		case VDM_OPERATION_FLUSH:
-			printf("flush operation not implemented "
-					"for threads data mover");
-			exit(1);
+		case VDM_OPERATION_FLUSH: {
+			struct vdm_operation_data_flush *mdata
+				= &data->op.data.flush;
+			memops_flush((char *)mdata->dest + offset, n);
+		} break;
+		case VDM_OPERATION_MEMCPY_V: {
+			struct vdm_operation_data_memcpy_v *mdata
+				= &data->op.data.memcpy_v;
+			memcpy_fn op_memcpy = dmt->op_fns.op_memcpy;
+			/* the chunk is a range of the concatenated fragments */
+			for (size_t i = 0; i < mdata->cnt && n > 0; ++i) {
+				size_t len = mdata->src[i].iov_len;
+				if (mdata->dest[i].iov_len < len)
+					len = mdata->dest[i].iov_len;
+				if (offset >= len) {
+					offset -= len;
+					continue;
+				}
+				len -= offset;
+				if (len > n)
+					len = n;
+				op_memcpy((char *)mdata->dest[i].iov_base +
+					offset, (char *)mdata->src[i].iov_base +
+					offset, len, (unsigned)mdata->flags);
+				offset = 0;
+				n -= len;
+			}
+		} break;
+		case VDM_OPERATION_DUALCAST: {
+			struct vdm_operation_data_dualcast *mdata
+				= &data->op.data.dualcast;
+			memcpy_fn op_memcpy = dmt->op_fns.op_memcpy;
+			op_memcpy((char *)mdata->dest1 + offset,
+				(const char *)mdata->src + offset, n,
+				(unsigned)mdata->flags);
+			op_memcpy((char *)mdata->dest2 + offset,
+				(const char *)mdata->src + offset, n,
+				(unsigned)mdata->flags);
+		} break;
+		/* the operations with results are never split */
+		case VDM_OPERATION_COMPARE: {
+			struct vdm_operation_data_compare *mdata
+				= &data->op.data.compare;
+			struct vdm_operation_output_compare *out =
+				&data->output.output.compare;
+			out->offset = memops_compare(mdata->src1, mdata->src2,
+				n);
+			out->result = out->offset != n;
+		} break;
+		case VDM_OPERATION_COMPARE_PATTERN: {
+			struct vdm_operation_data_compare_pattern *mdata
+				= &data->op.data.compare_pattern;
+			struct vdm_operation_output_compare_pattern *out =
+				&data->output.output.compare_pattern;
+			out->offset = memops_compare_pattern(mdata->src,
+				mdata->pattern, n);
+			out->result = out->offset != n;
+		} break;
+		case VDM_OPERATION_CRC32C: {
+			struct vdm_operation_data_crc32c *mdata
+				= &data->op.data.crc32c;
+			data->output.output.crc32c.crc = memops_crc32c(
+				mdata->seed, mdata->src, n);
+		} break;
+		case VDM_OPERATION_DELTA_CREATE: {
+			struct vdm_operation_data_delta_create *mdata
+				= &data->op.data.delta_create;
+			struct vdm_operation_output_delta_create *out =
+				&data->output.output.delta_create;
+			int ret = memops_delta_create(mdata->original,
+				mdata->modified, n, mdata->delta,
+				mdata->delta_max, &out->delta_size);
+			if (ret < 0)
+				data->output.result = VDM_ERROR_JOB_CORRUPTED;
+			else
+				out->result = (enum vdm_delta_result)ret;
+		} break;
+		case VDM_OPERATION_DELTA_APPLY: {
+			struct vdm_operation_data_delta_apply *mdata
+				= &data->op.data.delta_apply;
+			if (memops_delta_apply(mdata->dest, mdata->n,
+					mdata->delta, n,
+					std_memops_flags(
+					(unsigned)mdata->flags)) != 0)
+				data->output.result = VDM_ERROR_JOB_CORRUPTED;
+		} break;
+		case VDM_OPERATION_MEMFILL: {
+			struct vdm_operation_data_memfill *mdata
+				= &data->op.data.memfill;
+			/* the chunk starts in the middle of the pattern */
+			const char *p = mdata->pattern;
+			char rotated[VDM_MEMFILL_MAX_PATTERN];
+			if (util_is_pow2(mdata->pattern_len) &&
+			    mdata->pattern_len <= VDM_MEMFILL_MAX_PATTERN &&
+			    offset % mdata->pattern_len != 0) {
+				size_t phase = offset % mdata->pattern_len;
+				memcpy(rotated, p + phase,
+					mdata->pattern_len - phase);
+				memcpy(rotated + mdata->pattern_len - phase, p,
+					phase);
+				p = rotated;
+			}
+			if (memops_memfill((char *)mdata->dest + offset, p,
+					mdata->pattern_len, n, std_memops_flags(
+					(unsigned)mdata->flags)) != 0)
+				data->output.result = VDM_ERROR_JOB_CORRUPTED;
+		} break;
+		case VDM_OPERATION_PREAD:
+		case VDM_OPERATION_PWRITE:
+			fileops_perform(&data->op, &data->output);
+			break;
 		default:
 			ASSERT(0); /* unreachable */
 			break;
 	}
+}
+
+/*
+ * data_mover_threads_complete -- (internal) marks the operation as complete
+ */
+static void
+data_mover_threads_complete(struct data_mover_threads_data *data)
+{
+	/* the operation can't be touched after it's marked as complete */
+	TRACEPOINT(threads_op_complete, data);
 
 	if (data->desired_notifier == FUTURE_NOTIFIER_WAKER) {
-		FUTURE_WAKER_WAKE(&data->notifier.waker);
+		FUTURE_WAKER_WAKE(&data->u.notifier.waker);
+	}
+	/* the operation can be deleted as soon as it's complete */
+	vdm_complete_fn complete_fn = NULL;
+	void *complete_arg = NULL;
+	if (data->desired_notifier == FUTURE_NOTIFIER_NONE) {
+		complete_fn = data->u.callback.fn;
+		complete_arg = data->u.callback.arg;
+	}
+
+	/* counted first, the completion can be collected right away */
+	if (data->ncompleted != NULL)
+		util_fetch_and_add64(data->ncompleted, 1);
+	util_atomic_store_explicit64(&data->complete, 1, memory_order_release);
+
+	if (complete_fn != NULL)
+		complete_fn(complete_arg);
+}
+
+/*
+ * data_mover_threads_release -- (internal) drops a reference to the split
+ * operation, the last one completes it
+ */
+static void
+data_mover_threads_release(struct data_mover_threads_data *data)
+{
+	if (util_fetch_and_sub64(&data->nrefs, 1) == 1)
+		data_mover_threads_complete(data);
+}
+
+/*
+ * data_mover_threads_dropped -- (internal) returns 1 and notes it down,
+ * if the work taken by the worker has to be dropped, because
+ * the cancellation of the operation was requested
+ */
+static int
+data_mover_threads_dropped(struct data_mover_threads_data *data)
+{
+	uint64_t started;
+	util_atomic_load_explicit64(&data->started, &started,
+		memory_order_relaxed);
+	if (!(started & DATA_MOVER_THREADS_CANCEL_REQUESTED))
+		return 0;
+
+	util_fetch_and_or64(&data->started, DATA_MOVER_THREADS_CANCEL_DROPPED);
+
+	return 1;
+}
+
+/*
+ * data_mover_threads_chunk_length -- (internal) returns the number of bytes
+ * of the chunk of the operation
+ */
+static size_t
+data_mover_threads_chunk_length(const struct data_mover_threads_data *data,
+	uint64_t chunk)
+{
+	size_t offset = (size_t)chunk * data->chunk_size;
+
+	return data->size - offset < data->chunk_size ?
+		data->size - offset : data->chunk_size;
+}
+
+/*
+ * data_mover_threads_do_operation -- performs the operation, or the chunks
+ * of the split operation that are not taken by other workers yet
+ */
+static void
+data_mover_threads_do_operation(struct data_mover_threads_data *data,
+				struct data_mover_threads *dmt)
+{
+	if (data->nchunks == 1) {
+		if (!data_mover_threads_dropped(data))
+			data_mover_threads_do_chunk(data, dmt, 0, data->size);
+		data_mover_threads_complete(data);
+		return;
+	}
+
+	for (;;) {
+		uint64_t chunk = util_fetch_and_add64(&data->next_chunk, 1);
+		if (chunk >= data->nchunks)
+			break;
+		/* the chunks not taken yet are dropped by the other workers */
+		if (data_mover_threads_dropped(data))
+			break;
+
+		data_mover_threads_do_chunk(data, dmt,
+			(size_t)chunk * data->chunk_size,
+			data_mover_threads_chunk_length(data, chunk));
+	}
+
+	data_mover_threads_release(data);
+}
+
+/*
+ * data_mover_threads_do_low -- (internal) performs the chunk of the low
+ * priority operation, which the worker has taken
+ */
+static void
+data_mover_threads_do_low(struct data_mover_threads_data *data,
+	struct data_mover_threads *dmt, uint64_t chunk)
+{
+	if (!data_mover_threads_dropped(data))
+		data_mover_threads_do_chunk(data, dmt,
+			(size_t)chunk * data->chunk_size,
+			data_mover_threads_chunk_length(data, chunk));
+
+	data_mover_threads_release(data);
+}
+
+/*
+ * data_mover_threads_enqueue_bulk -- (internal) places the n operations in
+ * the queues with free space, starting from the given one, returns the number
+ * of the first operations placed
+ */
+static size_t
+data_mover_threads_enqueue_bulk(struct data_mover_threads *dmt, size_t queue,
+	void **ops, size_t n)
+{
+	int elastic = dmt->min_threads != dmt->nthreads;
+	/* counted in advance, so that the dequeue can't be counted first */
+	if (elastic)
+		util_fetch_and_add64(&dmt->nqueued, n);
+
+	size_t nqueued = 0;
+	for (size_t i = 0; i < dmt->nqueues && nqueued < n; ++i) {
+		struct ringbuf *buf =
+			dmt->workers[(queue + i) % dmt->nqueues].buf;
+		nqueued += ringbuf_enqueue_bulk(buf, ops + nqueued,
+			n - nqueued);
+	}
+
+	if (elastic && nqueued < n)
+		util_fetch_and_sub64(&dmt->nqueued, n - nqueued);
+
+	if (nqueued == 1)
+		eventcount_notify_one(&dmt->work_event);
+	else if (nqueued > 1)
+		eventcount_notify_all(&dmt->work_event);
+
+	return nqueued;
+}
+
+/*
+ * data_mover_threads_enqueue -- (internal) places the operation in the first
+ * queue with free space, starting from the given one
+ */
+static int
+data_mover_threads_enqueue(struct data_mover_threads *dmt, size_t queue,
+	struct data_mover_threads_data *op)
+{
+	void *ops[] = {op};
+
+	return data_mover_threads_enqueue_bulk(dmt, queue, ops, 1) == 1 ?
+		0 : -1;
+}
+
+/*
+ * data_mover_threads_overflow_flush -- (internal) moves the operations from
+ * the overflow queue to the worker queues until they're full, has to be
+ * called with the overflow lock held
+ */
+static void
+data_mover_threads_overflow_flush(struct data_mover_threads *dmt,
+	size_t queue)
+{
+	void *ops[DATA_MOVER_THREADS_BATCH_SIZE];
+	while (dmt->overflow_head != NULL) {
+		size_t n = 0;
+		struct data_mover_threads_data *op;
+		for (op = dmt->overflow_head;
+		    op != NULL && n < DATA_MOVER_THREADS_BATCH_SIZE;
+		    op = op->next_overflow)
+			ops[n++] = op;
+
+		/* once enqueued, the operations can complete at any time */
+		size_t nqueued = data_mover_threads_enqueue_bulk(dmt, queue,
+			ops, n);
+		if (nqueued == 0)
+			break;
+
+		dmt->overflow_head = nqueued < n ? ops[nqueued] : op;
+		util_fetch_and_sub64(&dmt->noverflow, nqueued);
+		if (nqueued < n)
+			break;
+	}
+
+	if (dmt->overflow_head == NULL)
+		dmt->overflow_tail = &dmt->overflow_head;
+}
+
+/*
+ * data_mover_threads_overflow_push -- (internal) queues the operation, which
+ * didn't fit into any of the worker queues
+ */
+static void
+data_mover_threads_overflow_push(struct data_mover_threads *dmt,
+	size_t queue, struct data_mover_threads_data *op)
+{
+	os_mutex_lock(&dmt->overflow_lock);
+	op->next_overflow = NULL;
+	*dmt->overflow_tail = op;
+	dmt->overflow_tail = &op->next_overflow;
+	util_fetch_and_add64(&dmt->noverflow, 1);
+
+	/* the workers might have emptied the queues meanwhile */
+	data_mover_threads_overflow_flush(dmt, queue);
+	os_mutex_unlock(&dmt->overflow_lock);
+}
+
+/*
+ * data_mover_threads_overflow_pending -- (internal) returns the number of
+ * operations in the overflow queue
+ */
+static uint64_t
+data_mover_threads_overflow_pending(struct data_mover_threads *dmt)
+{
+	uint64_t noverflow;
+	util_atomic_load_explicit64(&dmt->noverflow, &noverflow,
+		memory_order_acquire);
+
+	return noverflow;
+}
+
+/*
+ * data_mover_threads_now -- (internal) returns the time of the monotonic
+ * clock in nanoseconds
+ */
+static uint64_t
+data_mover_threads_now(void)
+{
+	struct timespec ts;
+	os_clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * DATA_MOVER_THREADS_NSEC_IN_SEC +
+		(uint64_t)ts.tv_nsec;
+}
+
+/*
+ * data_mover_threads_low_push -- (internal) appends the low priority
+ * operation to its list
+ */
+static void
+data_mover_threads_low_push(struct data_mover_threads *dmt,
+	struct data_mover_threads_data *tdata)
+{
+	/* every chunk holds a reference, the last one completes it */
+	tdata->nrefs = tdata->nchunks;
+	tdata->next_chunk = 0;
+	tdata->next_overflow = NULL;
+
+	if (dmt->min_threads != dmt->nthreads)
+		util_fetch_and_add64(&dmt->nqueued, 1);
+
+	os_mutex_lock(&dmt->low_lock);
+	*dmt->low_tail = tdata;
+	dmt->low_tail = &tdata->next_overflow;
+	util_fetch_and_add64(&dmt->nlow, 1);
+	os_mutex_unlock(&dmt->low_lock);
+
+	eventcount_notify_one(&dmt->work_event);
+}
+
+/*
+ * data_mover_threads_low_refill -- (internal) adds the tokens for the time
+ * since the last refill to the bucket, has to be called with the low lock
+ */
+static void
+data_mover_threads_low_refill(struct data_mover_threads *dmt, uint64_t now)
+{
+	double tokens = (double)(now - dmt->low_refill) *
+		(double)dmt->low_rate / (double)DATA_MOVER_THREADS_NSEC_IN_SEC;
+	/* the fraction of a token is added later, with the time it took */
+	if (tokens < 1.0)
+		return;
+
+	dmt->low_refill = now;
+	tokens += (double)dmt->low_tokens;
+	dmt->low_tokens = tokens < (double)dmt->low_burst ?
+		(int64_t)tokens : (int64_t)dmt->low_burst;
+}
+
+/*
+ * data_mover_threads_low_pending -- (internal) returns the number of low
+ * priority operations with chunks left to take
+ */
+static uint64_t
+data_mover_threads_low_pending(struct data_mover_threads *dmt)
+{
+	uint64_t nlow;
+	util_atomic_load_explicit64(&dmt->nlow, &nlow, memory_order_acquire);
+
+	return nlow;
+}
+
+/*
+ * data_mover_threads_find_low -- (internal) takes a chunk of the first
+ * low priority operation, unless the bandwidth limit is used up, in which
+ * case the time until the bucket has tokens again is noted in the worker
+ */
+static struct data_mover_threads_data *
+data_mover_threads_find_low(struct data_mover_threads_worker *worker)
+{
+	struct data_mover_threads *dmt = worker->dmt;
+
+	worker->low_wait = 0;
+	if (data_mover_threads_low_pending(dmt) == 0)
+		return NULL;
+
+	os_mutex_lock(&dmt->low_lock);
+	struct data_mover_threads_data *tdata = dmt->low_head;
+	if (tdata == NULL)
+		goto out;
+
+	/*
+	 * The chunks of the canceled operation are dropped right away, and
+	 * the list is drained without the limit once the mover is deleted.
+	 */
+	uint64_t started;
+	util_atomic_load_explicit64(&tdata->started, &started,
+		memory_order_relaxed);
+	int stopping;
+	util_atomic_load_explicit32(&dmt->stopping, &stopping,
+		memory_order_acquire);
+	int paced = dmt->low_rate != 0 && !stopping &&
+		!(started & DATA_MOVER_THREADS_CANCEL_REQUESTED);
+	if (paced) {
+		data_mover_threads_low_refill(dmt, data_mover_threads_now());
+		if (dmt->low_tokens <= 0) {
+			double wait = (double)(1 - dmt->low_tokens) *
+				(double)DATA_MOVER_THREADS_NSEC_IN_SEC /
+				(double)dmt->low_rate;
+			worker->low_wait = (uint64_t)wait + 1;
+			tdata = NULL;
+			goto out;
+		}
+	}
+
+	uint64_t chunk = tdata->next_chunk++;
+	if (tdata->next_chunk == tdata->nchunks) {
+		dmt->low_head = tdata->next_overflow;
+		if (dmt->low_head == NULL)
+			dmt->low_tail = &dmt->low_head;
+		util_fetch_and_sub64(&dmt->nlow, 1);
+		if (dmt->min_threads != dmt->nthreads)
+			util_fetch_and_sub64(&dmt->nqueued, 1);
+	}
+	if (paced)
+		dmt->low_tokens -= (int64_t)data_mover_threads_chunk_length(
+			tdata, chunk);
+	worker->low_chunk = chunk;
+
+out:
+	os_mutex_unlock(&dmt->low_lock);
+	return tdata;
+}
+
+/*
+ * data_mover_threads_find -- (internal) takes an operation from the worker's
+ * batch, its lanes, a new batch from its own queue or, if it's empty, steals
+ * one from the neighbours, and then a chunk of a low priority one
+ */
+static struct data_mover_threads_data *
+data_mover_threads_find(struct data_mover_threads_worker *worker)
+{
+	struct data_mover_threads *dmt = worker->dmt;
+	int elastic = dmt->min_threads != dmt->nthreads;
+
+	if (worker->next_batch < worker->nbatch)
+		return worker->batch[worker->next_batch++];
+
+	uint64_t nlanes;
+	util_atomic_load_explicit64(&dmt->nlanes, &nlanes,
+		memory_order_acquire);
+	for (uint64_t l = worker->id; l < nlanes; l += dmt->nthreads) {
+		void *tdata = spscring_trydequeue(dmt->lanes[l]);
+		if (tdata != NULL)
+			return tdata;
+	}
+
+	/*
+	 * Operations in the batch can't be stolen, so a worker takes only
+	 * its share of the queue, a few operations still run in parallel.
+	 */
+	size_t nbatch = ringbuf_count(worker->buf) / dmt->nqueues;
+	if (nbatch > DATA_MOVER_THREADS_BATCH_SIZE)
+		nbatch = DATA_MOVER_THREADS_BATCH_SIZE;
+	worker->nbatch = ringbuf_dequeue_bulk(worker->buf, worker->batch,
+		nbatch == 0 ? 1 : nbatch);
+	if (worker->nbatch != 0) {
+		if (elastic)
+			util_fetch_and_sub64(&dmt->nqueued, worker->nbatch);
+		worker->next_batch = 1;
+		return worker->batch[0];
+	}
+
+	for (size_t i = 1; i < dmt->nqueues; ++i) {
+		struct ringbuf *buf =
+			dmt->workers[(worker->id + i) % dmt->nqueues].buf;
+		struct data_mover_threads_data *tdata =
+			ringbuf_trydequeue(buf);
+		if (tdata != NULL) {
+			if (elastic)
+				util_fetch_and_sub64(&dmt->nqueued, 1);
+			return tdata;
+		}
+	}
+
+	return data_mover_threads_find_low(worker);
+}
+
+/*
+ * data_mover_threads_retire -- (internal) retires the idle worker, unless
+ * the pool is at its minimum size or an operation has just been submitted,
+ * which is then returned
+ */
+static struct data_mover_threads_data *
+data_mover_threads_retire(struct data_mover_threads_worker *worker)
+{
+	struct data_mover_threads *dmt = worker->dmt;
+	struct data_mover_threads_data *tdata = NULL;
+
+	os_mutex_lock(&dmt->pool_lock);
+
+	uint64_t nrunning;
+	util_atomic_load_explicit64(&dmt->nrunning, &nrunning,
+		memory_order_acquire);
+	if (nrunning <= dmt->min_threads)
+		goto out;
+
+	/*
+	 * Pairs with the check in data_mover_threads_grow, either this
+	 * worker sees the new operation or its submitter sees it retired.
+	 */
+	util_fetch_and_sub64(&dmt->nidle, 1);
+	util_fetch_and_sub64(&dmt->nrunning, 1);
+	tdata = data_mover_threads_find(worker);
+	if (tdata != NULL || data_mover_threads_overflow_pending(dmt) != 0 ||
+	    data_mover_threads_low_pending(dmt) != 0) {
+		util_fetch_and_add64(&dmt->nrunning, 1);
+		util_fetch_and_add64(&dmt->nidle, 1);
+		goto out;
+	}
+
+	/* the slot can be reused as soon as the lock is released */
+	util_atomic_store_explicit32(&worker->exited, 1,
+		memory_order_release);
+
+out:
+	os_mutex_unlock(&dmt->pool_lock);
+	return tdata;
+}
+
+/*
+ * data_mover_threads_idle_wait -- (internal) waits for new operations,
+ * returns NULL if the worker should exit
+ */
+static struct data_mover_threads_data *
+data_mover_threads_idle_wait(struct data_mover_threads_worker *worker)
+{
+	struct data_mover_threads *dmt = worker->dmt;
+	struct data_mover_threads_data *tdata;
+
+	/*
+	 * Back-to-back operations are usually picked up while spinning,
+	 * without the cost of parking the worker and waking it up again.
+	 */
+	uint64_t spin_count;
+	util_atomic_load_explicit64(&dmt->spin_count, &spin_count,
+		memory_order_relaxed);
+	int stopping = 0;
+	for (uint64_t i = 0; i < spin_count && !stopping; ++i) {
+		WAIT();
+		if ((tdata = data_mover_threads_find(worker)) != NULL)
+			return tdata;
+		util_atomic_load_explicit32(&dmt->stopping, &stopping,
+			memory_order_relaxed);
+	}
+
+	for (;;) {
+		uint32_t key = eventcount_prepare(&dmt->work_event);
+
+		tdata = data_mover_threads_find(worker);
+		if (tdata != NULL) {
+			eventcount_cancel(&dmt->work_event);
+			return tdata;
+		}
+
+		/* the queues are drained before the workers exit */
+		util_atomic_load_explicit32(&dmt->stopping, &stopping,
+			memory_order_acquire);
+		if (stopping) {
+			eventcount_cancel(&dmt->work_event);
+			/* the paced chunks are taken without the limit now */
+			if (data_mover_threads_low_pending(dmt) == 0)
+				return NULL;
+			continue;
+		}
+
+		/* the low priority operations wait for the bucket to refill */
+		if (worker->low_wait != 0) {
+			struct timespec timeout;
+			timeout.tv_sec = (time_t)(worker->low_wait /
+				DATA_MOVER_THREADS_NSEC_IN_SEC);
+			timeout.tv_nsec = (long)(worker->low_wait %
+				DATA_MOVER_THREADS_NSEC_IN_SEC);
+			eventcount_wait(&dmt->work_event, key, &timeout);
+			continue;
+		}
+
+		if (dmt->min_threads == dmt->nthreads) {
+			eventcount_wait(&dmt->work_event, key, NULL);
+			continue;
+		}
+
+		uint64_t idle_timeout;
+		util_atomic_load_explicit64(&dmt->idle_timeout, &idle_timeout,
+			memory_order_relaxed);
+		struct timespec timeout;
+		timeout.tv_sec = (time_t)(idle_timeout / 1000000000ULL);
+		timeout.tv_nsec = (long)(idle_timeout % 1000000000ULL);
+		if (eventcount_wait(&dmt->work_event, key, &timeout) != 0 &&
+		    (tdata = data_mover_threads_retire(worker)) != NULL)
+			return tdata;
+		if (worker->exited)
+			return NULL;
 	}
-	util_atomic_store_explicit64(&data->complete, 1, memory_order_release);
 }
 
+/*
+ * data_mover_threads_idle -- (internal) puts the worker to sleep until new
+ * operations are queued, returns NULL if the worker should exit
+ */
+static struct data_mover_threads_data *
+data_mover_threads_idle(struct data_mover_threads_worker *worker)
+{
+	struct data_mover_threads *dmt = worker->dmt;
+
+	util_fetch_and_add64(&dmt->nidle, 1);
+	struct data_mover_threads_data *tdata =
+		data_mover_threads_idle_wait(worker);
+	/* the retiring worker is no longer counted */
+	if (!worker->exited)
+		util_fetch_and_sub64(&dmt->nidle, 1);
+
+	return tdata;
+}
+
+static void data_mover_threads_grow(struct data_mover_threads *dmt);
+
 /*
  * data_mover_threads_loop -- loop that is executed by every worker
  * thread of the mover
@@ -140,20 +1124,45 @@ data_mover_threads_do_operation(struct data_mover_threads_data *data,
 static void *
 data_mover_threads_loop(void *arg)
 {
-	struct data_mover_threads *dmt_threads = arg;
-	struct ringbuf *buf = dmt_threads->buf;
+	struct data_mover_threads_worker *worker = arg;
+	struct data_mover_threads *dmt_threads = worker->dmt;
 	struct data_mover_threads_data *tdata;
 
 	while (1) {
-		/*
-		 * Worker thread is trying to dequeue from ringbuffer,
-		 * if he fails, he's waiting until something is added to
-		 * the ringbuffer.
-		 */
-		if ((tdata = ringbuf_dequeue(buf)) == NULL)
+		tdata = data_mover_threads_find(worker);
+		if (tdata == NULL &&
+		    (tdata = data_mover_threads_idle(worker)) == NULL)
 			return NULL;
 
-		data_mover_threads_do_operation(tdata, dmt_threads);
+		TRACEPOINT(threads_worker_dequeue, worker->id, tdata);
+
+		/* the rest of the queued operations may need another worker */
+		data_mover_threads_grow(dmt_threads);
+
+		uint64_t started;
+		util_atomic_load_explicit64(&tdata->started, &started,
+			memory_order_relaxed);
+		if (started & DATA_MOVER_THREADS_PRIORITY_LOW)
+			data_mover_threads_do_low(tdata, dmt_threads,
+				worker->low_chunk);
+		else
+			data_mover_threads_do_operation(tdata, dmt_threads);
+		TRACEPOINT(threads_worker_done, worker->id, tdata);
+
+		/*
+		 * The queue had room before the operation was dequeued,
+		 * so a submitter that found all of them full and queued
+		 * an operation in the overflow queue is always seen here.
+		 * The barrier orders freeing the slot before the check,
+		 * it pairs with the one in counting the overflow.
+		 */
+		util_synchronize();
+		if (data_mover_threads_overflow_pending(dmt_threads) != 0) {
+			os_mutex_lock(&dmt_threads->overflow_lock);
+			data_mover_threads_overflow_flush(dmt_threads,
+				worker->id);
+			os_mutex_unlock(&dmt_threads->overflow_lock);
+		}
 	}
 }
 
@@ -183,6 +1192,23 @@ data_mover_threads_operation_check(void *data,
 	return FUTURE_STATE_IDLE;
 }
 
+/*
+ * data_mover_threads_operation_prepare -- (internal) initializes a new
+ * thread operation
+ */
+static void
+data_mover_threads_operation_prepare(struct data_mover_threads *dmt,
+	struct data_mover_threads_data *op)
+{
+	op->dmt = dmt;
+	op->complete = 0;
+	op->started = 0;
+	op->ncompleted = NULL;
+	op->u.callback.fn = NULL;
+	op->output.result = VDM_SUCCESS;
+	op->desired_notifier = dmt->desired_notifier;
+}
+
 /*
  * data_mover_threads_operation_new -- create a new thread operation that uses
  * wakers
@@ -196,15 +1222,41 @@ data_mover_threads_operation_new(struct vdm *vdm,
 	struct data_mover_threads *dmt_threads =
 		(struct data_mover_threads *)vdm;
 
+	/*
+	 * The workers write to the operations, which the submitter polls,
+	 * they mustn't share cache lines.
+	 */
 	struct data_mover_threads_data *op =
-		membuf_alloc(dmt_threads->membuf,
-		sizeof(struct data_mover_threads_data));
+		membuf_alloc_aligned(dmt_threads->membuf,
+		DATA_MOVER_THREADS_DATA_SIZE, MEMBUF_CACHELINE_SIZE);
 	if (op == NULL)
 		return NULL;
 
-	op->complete = 0;
-	op->started = 0;
-	op->desired_notifier = dmt_threads->desired_notifier;
+	data_mover_threads_operation_prepare(dmt_threads, op);
+	op->in_membuf = 1;
+	TRACEPOINT(threads_op_new, op, type);
+
+	return op;
+}
+
+/*
+ * data_mover_threads_operation_init -- create a new thread operation
+ * in the storage provided by the caller
+ */
+static void *
+data_mover_threads_operation_init(struct vdm *vdm,
+	const enum vdm_operation_type type, void *storage)
+{
+	SUPPRESS_UNUSED(type);
+
+	struct data_mover_threads *dmt_threads =
+		(struct data_mover_threads *)vdm;
+	struct data_mover_threads_data *op = storage;
+	ASSERTeq((uintptr_t)op % VDM_OP_STORAGE_ALIGN, 0);
+
+	data_mover_threads_operation_prepare(dmt_threads, op);
+	op->in_membuf = 0;
+	TRACEPOINT(threads_op_new, op, type);
 
 	return op;
 }
@@ -217,6 +1269,8 @@ data_mover_threads_operation_delete(void *data,
 	const struct vdm_operation *operation,
 	struct vdm_operation_output *output)
 {
+	struct data_mover_threads_data *tdata = data;
+	TRACEPOINT(threads_op_delete, tdata);
 	output->result = VDM_SUCCESS;
 	switch (operation->type) {
 		case VDM_OPERATION_MEMCPY:
@@ -234,44 +1288,450 @@ data_mover_threads_operation_delete(void *data,
 			output->output.memset.str =
 				operation->data.memset.str;
 			break;
+		case VDM_OPERATION_FLUSH:
+			output->type = VDM_OPERATION_FLUSH;
+			output->output.flush.unused = 0;
+			break;
+		case VDM_OPERATION_MEMCPY_V:
+			output->type = VDM_OPERATION_MEMCPY_V;
+			output->output.memcpy_v.n =
+				vdm_memcpy_v_size(&operation->data.memcpy_v);
+			break;
+		case VDM_OPERATION_DUALCAST:
+			output->type = VDM_OPERATION_DUALCAST;
+			output->output.dualcast.dest1 =
+				operation->data.dualcast.dest1;
+			output->output.dualcast.dest2 =
+				operation->data.dualcast.dest2;
+			break;
+		case VDM_OPERATION_DELTA_APPLY:
+			output->type = VDM_OPERATION_DELTA_APPLY;
+			output->result = tdata->output.result;
+			output->output.delta_apply.dest =
+				operation->data.delta_apply.dest;
+			break;
+		case VDM_OPERATION_MEMFILL:
+			output->type = VDM_OPERATION_MEMFILL;
+			output->result = tdata->output.result;
+			output->output.memfill.dest =
+				operation->data.memfill.dest;
+			break;
+		case VDM_OPERATION_COMPARE:
+		case VDM_OPERATION_COMPARE_PATTERN:
+		case VDM_OPERATION_CRC32C:
+		case VDM_OPERATION_DELTA_CREATE:
+		case VDM_OPERATION_PREAD:
+		case VDM_OPERATION_PWRITE:
+			*output = tdata->output;
+			output->type = operation->type;
+			break;
 		default:
 			ASSERT(0);
 	}
 
-	membuf_free(data);
+	uint64_t started;
+	util_atomic_load_explicit64(&tdata->started, &started,
+		memory_order_relaxed);
+	if (started & DATA_MOVER_THREADS_CANCEL_DROPPED)
+		output->result = VDM_ERROR_CANCELED;
+
+	if (tdata->ncompleted != NULL)
+		util_fetch_and_sub64(tdata->ncompleted, 1);
+
+	if (tdata->in_membuf)
+		membuf_free(data);
 }
 
 /*
- * data_mover_threads_operation_start -- start a memory operation using threads
+ * data_mover_threads_queue -- (internal) returns the queue, to which
+ * the calling thread submits its operations
+ */
+static size_t
+data_mover_threads_queue(struct data_mover_threads *dmt)
+{
+	uintptr_t queue = (uintptr_t)os_tls_get(dmt->queue_key);
+	if (queue == 0) {
+		queue = util_fetch_and_add64(&dmt->next_queue, 1) %
+			dmt->nqueues + 1;
+		os_tls_set(dmt->queue_key, (void *)queue);
+	}
+
+	return (size_t)queue - 1;
+}
+
+/*
+ * data_mover_threads_lane -- (internal) returns the lane of the calling
+ * thread, or NULL if it has none
+ */
+static struct spscring *
+data_mover_threads_lane(struct data_mover_threads *dmt)
+{
+	if (dmt->nlanes == 0)
+		return NULL;
+
+	uintptr_t lane = (uintptr_t)os_tls_get(dmt->lane_key);
+	if (lane == 0) {
+		lane = util_fetch_and_add64(&dmt->next_lane, 1) + 1;
+		/* the threads without a lane are remembered as well */
+		if (lane > dmt->nlanes)
+			lane = UINTPTR_MAX;
+		os_tls_set(dmt->lane_key, (void *)lane);
+	}
+
+	return lane == UINTPTR_MAX ? NULL : dmt->lanes[lane - 1];
+}
+
+/*
+ * data_mover_threads_split -- (internal) decides into how many chunks
+ * of chunk_size the operation is split, 0 disables splitting
+ */
+static void
+data_mover_threads_split(struct data_mover_threads_data *tdata,
+	size_t chunk_size)
+{
+	tdata->nchunks = 1;
+	tdata->chunk_size = tdata->size;
+
+	size_t size = tdata->size;
+	if (chunk_size == 0 || size <= chunk_size)
+		return;
+
+	/* the results of the chunks would have to be merged */
+	switch (tdata->op.type) {
+		case VDM_OPERATION_COMPARE:
+		case VDM_OPERATION_COMPARE_PATTERN:
+		case VDM_OPERATION_CRC32C:
+		case VDM_OPERATION_DELTA_CREATE:
+		case VDM_OPERATION_DELTA_APPLY:
+		/* the transferred bytes would have to be summed up */
+		case VDM_OPERATION_PREAD:
+		case VDM_OPERATION_PWRITE:
+			return;
+		/* an invalid pattern fails the whole operation */
+		case VDM_OPERATION_MEMFILL:
+			if (!util_is_pow2(tdata->op.data.memfill.pattern_len) ||
+			    tdata->op.data.memfill.pattern_len >
+			    VDM_MEMFILL_MAX_PATTERN)
+				return;
+			break;
+		default:
+			break;
+	}
+
+	/* chunks of overlapping memmove would overwrite each other's source */
+	if (tdata->op.type == VDM_OPERATION_MEMMOVE) {
+		uintptr_t dest = (uintptr_t)tdata->op.data.memmove.dest;
+		uintptr_t src = (uintptr_t)tdata->op.data.memmove.src;
+		if (dest < src + size && src < dest + size)
+			return;
+	}
+
+	tdata->chunk_size = chunk_size;
+	tdata->nchunks = size / chunk_size + (size % chunk_size != 0);
+	tdata->next_chunk = 0;
+}
+
+/*
+ * data_mover_threads_submit_split -- (internal) queues the split operation
+ * to as many workers as there are chunks, at most to all of them
+ */
+static void
+data_mover_threads_submit_split(struct data_mover_threads *dmt,
+	size_t queue, struct data_mover_threads_data *tdata)
+{
+	uint64_t nentries = tdata->nchunks < dmt->nthreads ?
+		tdata->nchunks : dmt->nthreads;
+
+	/* the submitter's reference, the workers can't complete it early */
+	tdata->nrefs = 1;
+
+	uint64_t nqueued = 0;
+	if (data_mover_threads_overflow_pending(dmt) == 0) {
+		for (; nqueued < nentries; ++nqueued) {
+			util_fetch_and_add64(&tdata->nrefs, 1);
+			if (data_mover_threads_enqueue(dmt,
+					queue + (size_t)nqueued, tdata) != 0) {
+				util_fetch_and_sub64(&tdata->nrefs, 1);
+				break;
+			}
+		}
+	}
+
+	/* the operation can only be in the overflow queue once */
+	if (nqueued == 0) {
+		util_fetch_and_add64(&tdata->nrefs, 1);
+		data_mover_threads_overflow_push(dmt, queue, tdata);
+	}
+
+	data_mover_threads_release(tdata);
+}
+
+/*
+ * data_mover_threads_start -- (internal) starts the thread of the worker,
+ * has to be called with the pool lock held or before the mover is used
  */
 static int
-data_mover_threads_operation_start(void *data,
-	const struct vdm_operation *operation, struct future_notifier *n)
+data_mover_threads_start(struct data_mover_threads_worker *worker)
+{
+	/* the previous thread of the slot has retired */
+	if (worker->started) {
+		os_thread_join(&worker->thread, NULL);
+		worker->started = 0;
+	}
+
+	worker->exited = 0;
+	if (os_thread_create(&worker->thread, NULL,
+			data_mover_threads_loop, worker) != 0)
+		return -1;
+	worker->started = 1;
+
+	return 0;
+}
+
+/*
+ * data_mover_threads_grow -- (internal) starts one more worker if there
+ * are more queued operations than idle workers, unless the pool is at its
+ * maximum size
+ */
+static void
+data_mover_threads_grow(struct data_mover_threads *dmt)
+{
+	if (dmt->min_threads == dmt->nthreads)
+		return;
+
+	/* the operations have been counted with a full barrier */
+	uint64_t nrunning;
+	uint64_t nqueued;
+	uint64_t nidle;
+	util_atomic_load_explicit64(&dmt->nrunning, &nrunning,
+		memory_order_acquire);
+	util_atomic_load_explicit64(&dmt->nqueued, &nqueued,
+		memory_order_acquire);
+	util_atomic_load_explicit64(&dmt->nidle, &nidle, memory_order_acquire);
+	if (nrunning >= dmt->nthreads ||
+	    nqueued + data_mover_threads_overflow_pending(dmt) <= nidle)
+		return;
+
+	os_mutex_lock(&dmt->pool_lock);
+
+	util_atomic_load_explicit64(&dmt->nrunning, &nrunning,
+		memory_order_acquire);
+	for (size_t i = 0; nrunning < dmt->nthreads && i < dmt->nthreads;
+			++i) {
+		struct data_mover_threads_worker *worker = &dmt->workers[i];
+		int exited;
+		util_atomic_load_explicit32(&worker->exited, &exited,
+			memory_order_acquire);
+		if (worker->started && !exited)
+			continue;
+
+		util_fetch_and_add64(&dmt->nrunning, 1);
+		if (data_mover_threads_start(worker) != 0)
+			util_fetch_and_sub64(&dmt->nrunning, 1);
+		break;
+	}
+
+	os_mutex_unlock(&dmt->pool_lock);
+}
+
+/*
+ * data_mover_threads_prepare -- (internal) prepares the operation for
+ * the submission, returns 1 if it was already performed inline or queued
+ * in chunks and 0 if it has to be queued yet
+ */
+static int
+data_mover_threads_prepare(struct data_mover_threads *dmt,
+	struct data_mover_threads_data *tdata,
+	const struct vdm_operation *operation, struct future_notifier *n,
+	size_t queue)
 {
-	struct data_mover_threads_data *tdata =
-		(struct data_mover_threads_data *)data;
 	memcpy(&tdata->op, operation, sizeof(*operation));
+	tdata->size = vdm_operation_size(operation);
+	TRACEPOINT(threads_op_start, tdata, operation->type, tdata->size);
+	int low = (vdm_operation_flags(operation) & VDM_F_PRIORITY_LOW) != 0;
+	/* before it's queued, a complete operation can be deleted right away */
+	util_atomic_store_explicit64(&tdata->started, FUTURE_STATE_RUNNING |
+		(low ? DATA_MOVER_THREADS_PRIORITY_LOW : 0),
+		memory_order_release);
+
+	/*
+	 * Handing a tiny operation over to a worker costs more than itself,
+	 * but the low priority ones are always paced by the workers.
+	 */
+	int inl = !low && tdata->size < dmt->inline_threshold;
 
 	if (n) {
 		n->notifier_used = tdata->desired_notifier;
-		tdata->notifier = *n;
+		if (tdata->desired_notifier != FUTURE_NOTIFIER_NONE)
+			tdata->u.notifier = *n;
 		if (tdata->desired_notifier == FUTURE_NOTIFIER_POLLER) {
-			n->poller.ptr_to_monitor = &tdata->complete;
+			if (dmt->shared_completion && !inl)
+				tdata->ncompleted = &dmt->
+					completions[queue].u.ncompleted;
+			n->poller.ptr_to_monitor = tdata->ncompleted != NULL ?
+				tdata->ncompleted : &tdata->complete;
 		}
 	} else {
 		tdata->desired_notifier = FUTURE_NOTIFIER_NONE;
 	}
 
-	struct data_mover_threads *dmt_threads = membuf_ptr_user_data(tdata);
+	if (inl) {
+		tdata->nchunks = 1;
+		data_mover_threads_do_chunk(tdata, dmt, 0, tdata->size);
+		if (n)
+			n->notifier_used = FUTURE_NOTIFIER_NONE;
+		vdm_complete_fn complete_fn = tdata->desired_notifier ==
+			FUTURE_NOTIFIER_NONE ? tdata->u.callback.fn : NULL;
+		void *complete_arg = tdata->u.callback.arg;
+		util_atomic_store_explicit64(&tdata->complete, 1,
+			memory_order_release);
+		if (complete_fn != NULL)
+			complete_fn(complete_arg);
+		return 1;
+	}
+
+	if (low) {
+		data_mover_threads_split(tdata,
+			DATA_MOVER_THREADS_LOW_CHUNK_SIZE);
+		data_mover_threads_low_push(dmt, tdata);
+		return 1;
+	}
+
+	data_mover_threads_split(tdata, dmt->nthreads < 2 ?
+		0 : dmt->chunk_size);
+	if (tdata->nchunks > 1) {
+		data_mover_threads_submit_split(dmt, queue, tdata);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * data_mover_threads_operation_start -- start a memory operation using threads
+ */
+static int
+data_mover_threads_operation_start(void *data,
+	const struct vdm_operation *operation, struct future_notifier *n)
+{
+	struct data_mover_threads_data *tdata =
+		(struct data_mover_threads_data *)data;
+	struct data_mover_threads *dmt_threads = tdata->dmt;
+	size_t queue = data_mover_threads_queue(dmt_threads);
+
+	if (data_mover_threads_prepare(dmt_threads, tdata, operation, n,
+			queue)) {
+		data_mover_threads_grow(dmt_threads);
+		return 0;
+	}
 
-	if (ringbuf_tryenqueue(dmt_threads->buf, tdata) == 0) {
-		util_atomic_store_explicit64(&tdata->started,
-			FUTURE_STATE_RUNNING, memory_order_release);
+	/*
+	 * The operation is accepted even if the queues are full, so that
+	 * bursts don't make the callers retry the submission. New operations
+	 * are queued behind the ones already waiting in the overflow queue.
+	 */
+	struct spscring *lane = data_mover_threads_lane(dmt_threads);
+	if (data_mover_threads_overflow_pending(dmt_threads) != 0) {
+		data_mover_threads_overflow_push(dmt_threads, queue, tdata);
+	} else if (lane != NULL && spscring_tryenqueue(lane, tdata) == 0) {
+		/* any of the workers can be asleep, not only the lane's */
+		eventcount_notify_all(&dmt_threads->work_event);
+	} else if (data_mover_threads_enqueue(dmt_threads, queue,
+	    tdata) != 0) {
+		data_mover_threads_overflow_push(dmt_threads, queue, tdata);
 	}
+	data_mover_threads_grow(dmt_threads);
+
+	return 0;
+}
+
+/*
+ * data_mover_threads_operation_start_cb -- start a memory operation using
+ * threads, the function is called by the thread, which completes it
+ */
+static int
+data_mover_threads_operation_start_cb(void *data,
+	const struct vdm_operation *operation, vdm_complete_fn fn, void *arg)
+{
+	struct data_mover_threads_data *tdata = data;
+	tdata->u.callback.fn = fn;
+	tdata->u.callback.arg = arg;
+
+	return data_mover_threads_operation_start(data, operation, NULL);
+}
+
+/*
+ * data_mover_threads_operation_cancel -- requests the cancellation of
+ * the thread operation, the workers drop the work they haven't taken yet,
+ * including the operations still waiting in the queues
+ */
+static int
+data_mover_threads_operation_cancel(void *data,
+	const struct vdm_operation *operation)
+{
+	SUPPRESS_UNUSED(operation);
+
+	struct data_mover_threads_data *tdata = data;
+
+	uint64_t complete;
+	util_atomic_load_explicit64(&tdata->complete, &complete,
+		memory_order_acquire);
+	if (complete)
+		return -1;
+
+	util_fetch_and_or64(&tdata->started,
+		DATA_MOVER_THREADS_CANCEL_REQUESTED);
 
 	return 0;
 }
 
+/*
+ * data_mover_threads_queue_batch -- (internal) queues the prepared
+ * operations with one bulk enqueue, the ones which don't fit the queues
+ * are placed in the overflow queue
+ */
+static void
+data_mover_threads_queue_batch(struct data_mover_threads *dmt, size_t queue,
+	void **ops, size_t n)
+{
+	size_t nqueued = 0;
+	if (data_mover_threads_overflow_pending(dmt) == 0)
+		nqueued = data_mover_threads_enqueue_bulk(dmt, queue, ops, n);
+
+	for (size_t i = nqueued; i < n; ++i)
+		data_mover_threads_overflow_push(dmt, queue, ops[i]);
+}
+
+/*
+ * data_mover_threads_operation_start_batch -- start the memory operations
+ * using threads, queueing them together
+ */
+static size_t
+data_mover_threads_operation_start_batch(struct vdm *vdm, void *data[],
+	const struct vdm_operation *operations[], size_t n)
+{
+	struct data_mover_threads *dmt_threads =
+		(struct data_mover_threads *)vdm;
+	size_t queue = data_mover_threads_queue(dmt_threads);
+
+	void *ops[DATA_MOVER_THREADS_SUBMIT_BATCH_SIZE];
+	size_t nops = 0;
+	for (size_t i = 0; i < n; ++i) {
+		if (!data_mover_threads_prepare(dmt_threads, data[i],
+				operations[i], NULL, queue))
+			ops[nops++] = data[i];
+		if (nops == DATA_MOVER_THREADS_SUBMIT_BATCH_SIZE) {
+			data_mover_threads_queue_batch(dmt_threads, queue,
+				ops, nops);
+			nops = 0;
+		}
+	}
+	data_mover_threads_queue_batch(dmt_threads, queue, ops, nops);
+	data_mover_threads_grow(dmt_threads);
+
+	return n;
+}
+
 int
 has_property_dmt(void *fut, enum future_property property)
 {
@@ -287,8 +1747,30 @@ static struct vdm data_mover_threads_vdm = {
 	.op_start = data_mover_threads_operation_start,
 	.capabilities = SUPPORTED_FLAGS,
 	.has_property = has_property_dmt,
+	.op_start_batch = data_mover_threads_operation_start_batch,
+	.op_init = data_mover_threads_operation_init,
+	.op_storage_size = DATA_MOVER_THREADS_DATA_SIZE,
+	.op_start_cb = data_mover_threads_operation_start_cb,
+	.op_cancel = data_mover_threads_operation_cancel,
 };
 
+/*
+ * data_mover_threads_pin -- (internal) binds the worker thread to the cpu
+ */
+static int
+data_mover_threads_pin(struct data_mover_threads_worker *worker,
+	unsigned cpu)
+{
+	os_cpu_set_t set;
+
+	/* the platform cpu set can be smaller than the os_cpu_set_t */
+	memset(&set, 0, sizeof(set));
+	os_cpu_zero(&set);
+	os_cpu_set(cpu, &set);
+
+	return os_thread_setaffinity_np(&worker->thread, sizeof(set), &set);
+}
+
 /*
  * data_mover_threads_new -- creates a new data mover instance that's uses
  * worker threads for memory operations
@@ -297,6 +1779,22 @@ struct data_mover_threads *
 data_mover_threads_new(size_t nthreads, size_t ringbuf_size,
 	enum future_notifier_type desired_notifier)
 {
+	return data_mover_threads_new_cpus(nthreads, ringbuf_size,
+		desired_notifier, NULL, 0);
+}
+
+/*
+ * data_mover_threads_create -- (internal) creates a new data mover instance
+ * with min_threads running workers out of nthreads, the i-th of the initial
+ * ones bound to the cpu cpus[i % ncpus]
+ */
+static struct data_mover_threads *
+data_mover_threads_create(size_t min_threads, size_t nthreads,
+	size_t ringbuf_size, enum future_notifier_type desired_notifier,
+	const unsigned *cpus, size_t ncpus)
+{
+	COMPILE_ERROR_ON(VDM_OP_STORAGE_ALIGN % MEMBUF_CACHELINE_SIZE != 0);
+
 	struct data_mover_threads *dmt_threads =
 		malloc(sizeof(struct data_mover_threads));
 	if (dmt_threads == NULL)
@@ -305,42 +1803,190 @@ data_mover_threads_new(size_t nthreads, size_t ringbuf_size,
 	dmt_threads->desired_notifier = desired_notifier;
 	dmt_threads->base = data_mover_threads_vdm;
 	dmt_threads->op_fns = op_fns_default;
+	dmt_threads->chunk_size = 0;
+	dmt_threads->inline_threshold = 0;
+	dmt_threads->shared_completion = 0;
+
+	/* select the copy kernels now, rather than in the first operation */
+	memops_best();
+
+	dmt_threads->nthreads = nthreads;
+	dmt_threads->min_threads = min_threads < nthreads ?
+		min_threads : nthreads;
+	dmt_threads->nqueues = nthreads == 0 ? 1 : nthreads;
+	dmt_threads->next_queue = 0;
+	dmt_threads->stopping = 0;
+	dmt_threads->spin_count = 0;
+
+	/* the worker which parked last has the warmest cache */
+	if (eventcount_init_lifo(&dmt_threads->work_event) != 0)
+		goto workers_failed;
+
+	dmt_threads->workers = malloc(sizeof(struct data_mover_threads_worker) *
+		dmt_threads->nqueues);
+	if (dmt_threads->workers == NULL)
+		goto event_failed;
 
-	dmt_threads->buf = ringbuf_new((unsigned)ringbuf_size);
-	if (dmt_threads->buf == NULL)
+	dmt_threads->completions = util_aligned_malloc(
+		sizeof(struct data_mover_threads_completions),
+		sizeof(struct data_mover_threads_completions) *
+		dmt_threads->nqueues);
+	if (dmt_threads->completions == NULL)
+		goto completions_failed;
+	for (size_t q = 0; q < dmt_threads->nqueues; q++)
+		dmt_threads->completions[q].u.ncompleted = 0;
+
+	size_t nbufs;
+	for (nbufs = 0; nbufs < dmt_threads->nqueues; nbufs++) {
+		struct data_mover_threads_worker *worker =
+			&dmt_threads->workers[nbufs];
+		worker->dmt = dmt_threads;
+		worker->id = nbufs;
+		worker->started = 0;
+		worker->exited = 0;
+		worker->nbatch = 0;
+		worker->next_batch = 0;
+		worker->buf = ringbuf_new((unsigned)ringbuf_size);
+		if (worker->buf == NULL)
+			goto ringbuf_failed;
+	}
+
+	if (os_tls_key_create(&dmt_threads->queue_key, NULL) != 0)
 		goto ringbuf_failed;
 
-	dmt_threads->membuf = membuf_new(dmt_threads);
+	if (os_tls_key_create(&dmt_threads->lane_key, NULL) != 0)
+		goto lane_key_failed;
+	dmt_threads->lanes = NULL;
+	dmt_threads->nlanes = 0;
+	dmt_threads->next_lane = 0;
+
+	dmt_threads->membuf = membuf_new(dmt_threads, 0,
+		MEMBUF_PAGES_NORMAL);
 	if (dmt_threads->membuf == NULL)
 		goto membuf_failed;
+	dmt_threads->membuf_max_buffers = 0;
+	dmt_threads->membuf_node = MEMBUF_NODE_LOCAL;
 
-	dmt_threads->nthreads = nthreads;
-	dmt_threads->threads = malloc(sizeof(os_thread_t) *
-		dmt_threads->nthreads);
-	if (dmt_threads->threads == NULL)
-		goto threads_array_failed;
+	os_mutex_init(&dmt_threads->overflow_lock);
+	dmt_threads->overflow_head = NULL;
+	dmt_threads->overflow_tail = &dmt_threads->overflow_head;
+	dmt_threads->noverflow = 0;
+
+	os_mutex_init(&dmt_threads->low_lock);
+	dmt_threads->low_head = NULL;
+	dmt_threads->low_tail = &dmt_threads->low_head;
+	dmt_threads->nlow = 0;
+	dmt_threads->low_rate = 0;
+	dmt_threads->low_burst = 0;
+	dmt_threads->low_tokens = 0;
+	dmt_threads->low_refill = 0;
+
+	os_mutex_init(&dmt_threads->pool_lock);
+	dmt_threads->nrunning = dmt_threads->min_threads;
+	dmt_threads->nidle = 0;
+	dmt_threads->nqueued = 0;
+	dmt_threads->idle_timeout = DATA_MOVER_THREADS_DEFAULT_IDLE_TIMEOUT;
 
 	size_t i;
-	for (i = 0; i < dmt_threads->nthreads; i++) {
-		os_thread_create(&dmt_threads->threads[i],
-			NULL, data_mover_threads_loop, dmt_threads);
+	for (i = 0; i < dmt_threads->min_threads; i++)
+		data_mover_threads_start(&dmt_threads->workers[i]);
+
+	for (i = 0; ncpus != 0 && i < dmt_threads->min_threads; i++) {
+		if (data_mover_threads_pin(&dmt_threads->workers[i],
+		    cpus[i % ncpus]) != 0) {
+			data_mover_threads_delete(dmt_threads);
+			return NULL;
+		}
 	}
 
 	return dmt_threads;
 
-threads_array_failed:
-	membuf_delete(dmt_threads->membuf);
-
 membuf_failed:
-	ringbuf_delete(dmt_threads->buf);
+	os_tls_key_delete(dmt_threads->lane_key);
+
+lane_key_failed:
+	os_tls_key_delete(dmt_threads->queue_key);
 
 ringbuf_failed:
+	while (nbufs-- > 0)
+		ringbuf_delete(dmt_threads->workers[nbufs].buf);
+	util_aligned_free(dmt_threads->completions);
+
+completions_failed:
+	free(dmt_threads->workers);
+
+event_failed:
+	eventcount_fini(&dmt_threads->work_event);
+
+workers_failed:
 	free(dmt_threads);
 
 data_failed:
 	return NULL;
 }
 
+/*
+ * data_mover_threads_new_cpus -- creates a new data mover instance, whose
+ * i-th worker thread is bound to the cpu cpus[i % ncpus]
+ */
+struct data_mover_threads *
+data_mover_threads_new_cpus(size_t nthreads, size_t ringbuf_size,
+	enum future_notifier_type desired_notifier,
+	const unsigned *cpus, size_t ncpus)
+{
+	return data_mover_threads_create(nthreads, nthreads, ringbuf_size,
+		desired_notifier, cpus, ncpus);
+}
+
+/*
+ * data_mover_threads_new_elastic -- creates a new data mover instance, which
+ * runs between min_threads and max_threads worker threads, depending on load
+ */
+struct data_mover_threads *
+data_mover_threads_new_elastic(size_t min_threads, size_t max_threads,
+	size_t ringbuf_size, enum future_notifier_type desired_notifier)
+{
+	return data_mover_threads_create(min_threads, max_threads,
+		ringbuf_size, desired_notifier, NULL, 0);
+}
+
+/*
+ * data_mover_threads_set_idle_timeout -- sets the time in nanoseconds after
+ * which an idle worker of an elastic mover retires
+ */
+void
+data_mover_threads_set_idle_timeout(struct data_mover_threads *dmt,
+	uint64_t timeout)
+{
+	util_atomic_store_explicit64(&dmt->idle_timeout, timeout,
+		memory_order_relaxed);
+}
+
+/*
+ * data_mover_threads_set_bandwidth_limit -- limits the rate, at which
+ * the low priority operations move the data, to bytes_per_sec with bursts
+ * of up to burst bytes, a rate of 0 removes the limit
+ */
+void
+data_mover_threads_set_bandwidth_limit(struct data_mover_threads *dmt,
+	uint64_t bytes_per_sec, uint64_t burst)
+{
+	if (burst == 0)
+		burst = DATA_MOVER_THREADS_LOW_CHUNK_SIZE;
+	if (burst > INT64_MAX)
+		burst = INT64_MAX;
+
+	os_mutex_lock(&dmt->low_lock);
+	dmt->low_rate = bytes_per_sec;
+	dmt->low_burst = burst;
+	dmt->low_tokens = (int64_t)burst;
+	dmt->low_refill = data_mover_threads_now();
+	os_mutex_unlock(&dmt->low_lock);
+
+	/* the workers waiting for the tokens may go on right away */
+	eventcount_notify_all(&dmt->work_event);
+}
+
 /*
  * data_mover_threads_default -- creates a new data mover instance with
  * default parameters
@@ -362,6 +2008,17 @@ data_mover_threads_get_vdm(struct data_mover_threads *dmt)
 	return &dmt->base;
 }
 
+/*
+ * data_mover_threads_get_membuf_stats -- returns the statistics of
+ * the buffers the operations are allocated from
+ */
+void
+data_mover_threads_get_membuf_stats(struct data_mover_threads *dmt,
+	struct vdm_membuf_stats *stats)
+{
+	membuf_get_stats(dmt->membuf, stats);
+}
+
 /*
  * data_mover_threads_delete -- perform necessary cleanup after threads mover.
  * Releases all memory and closes all created threads.
@@ -369,12 +2026,33 @@ data_mover_threads_get_vdm(struct data_mover_threads *dmt)
 void
 data_mover_threads_delete(struct data_mover_threads *dmt)
 {
-	ringbuf_stop(dmt->buf);
+	/* the workers move the overflowing operations to their queues */
+	while (data_mover_threads_overflow_pending(dmt) != 0)
+		WAIT();
+
+	util_atomic_store_explicit32(&dmt->stopping, 1, memory_order_release);
+	eventcount_notify_all(&dmt->work_event);
+	/* and the paced low priority ones no longer wait for the bucket */
+	while (data_mover_threads_low_pending(dmt) != 0)
+		WAIT();
+	/* no workers are started, as no operations are submitted anymore */
 	for (size_t i = 0; i < dmt->nthreads; i++) {
-		os_thread_join(&dmt->threads[i], NULL);
+		if (dmt->workers[i].started)
+			os_thread_join(&dmt->workers[i].thread, NULL);
 	}
-	free(dmt->threads);
+	for (size_t i = 0; i < dmt->nqueues; i++)
+		ringbuf_delete(dmt->workers[i].buf);
+	util_aligned_free(dmt->completions);
+	free(dmt->workers);
+	for (uint64_t i = 0; i < dmt->nlanes; i++)
+		spscring_delete(dmt->lanes[i]);
+	free(dmt->lanes);
+	os_tls_key_delete(dmt->lane_key);
+	os_tls_key_delete(dmt->queue_key);
+	os_mutex_destroy(&dmt->overflow_lock);
+	os_mutex_destroy(&dmt->low_lock);
+	os_mutex_destroy(&dmt->pool_lock);
+	eventcount_fini(&dmt->work_event);
 	membuf_delete(dmt->membuf);
-	ringbuf_delete(dmt->buf);
 	free(dmt);
 }
@@ -0,0 +1,513 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * data_mover_trace.c -- virtual data mover, which hands the operations over
+ * to another data mover and measures how long they spend in each phase
+ *
+ * An operation is queued from op_new to op_start, executed until the data
+ * mover completes it and reaped once op_check notices the completion.
+ * The completion time is only known, if the data mover can call a function
+ * when it completes the operation, see op_start_cb. For the other ones
+ * the execution lasts until the operation is reaped.
+ */
+
+#include "core/util.h"
+#ifdef _WIN32
+#pragma warning(disable : 4127)
+#endif
+
+#include "libminiasync/data_mover_trace.h"
+#include "libminiasync/runtime.h"
+#include "core/membuf.h"
+#include "core/out.h"
+
+struct data_mover_trace {
+	struct vdm base; /* must be first */
+
+	struct vdm *vdm;
+	struct membuf *membuf;
+	data_mover_trace_hook hook;
+	void *hook_arg;
+
+	uint64_t histograms[DATA_MOVER_TRACE_TYPES]
+		[DATA_MOVER_TRACE_SIZE_BUCKETS][DATA_MOVER_TRACE_PHASES]
+		[DATA_MOVER_TRACE_LATENCY_BUCKETS];
+};
+
+struct data_mover_trace_data {
+	void *data; /* of the operation of the traced data mover */
+	struct data_mover_trace_record record;
+
+	/* the operations started with a completion callback */
+	int callback;
+	uint64_t complete;
+	struct future_waker waker; /* the waker of the notifier, if used */
+	vdm_complete_fn fn; /* of the caller, if started by op_start_cb */
+	void *arg;
+};
+
+static const char *data_mover_trace_type_names[] = {
+	"memcpy",
+	"memmove",
+	"memset",
+	"flush",
+	"memcpy_v",
+	"compare",
+	"compare_pattern",
+	"crc32c",
+	"dualcast",
+	"delta_create",
+	"delta_apply",
+	"memfill",
+	"pread",
+	"pwrite",
+};
+
+static const char *data_mover_trace_phase_names[] = {
+	"queue",
+	"execute",
+	"reap",
+};
+
+/*
+ * data_mover_trace_latency_bucket -- (internal) returns the histogram bucket
+ * of the latency of ns nanoseconds
+ */
+static size_t
+data_mover_trace_latency_bucket(uint64_t ns)
+{
+	if (ns == 0)
+		return 0;
+
+	size_t bucket = util_mssb_index64(ns);
+
+	return bucket < DATA_MOVER_TRACE_LATENCY_BUCKETS ?
+		bucket : DATA_MOVER_TRACE_LATENCY_BUCKETS - 1;
+}
+
+/*
+ * data_mover_trace_count -- (internal) counts the latency of the phase
+ * of the operation
+ */
+static void
+data_mover_trace_count(struct data_mover_trace *dmtr,
+	const struct data_mover_trace_record *record,
+	enum data_mover_trace_phase phase, uint64_t from, uint64_t to)
+{
+	size_t size_bucket = data_mover_trace_size_bucket(record->size);
+	uint64_t ns = to > from ? to - from : 0;
+	uint64_t *bucket = &dmtr->histograms[record->type][size_bucket][phase]
+		[data_mover_trace_latency_bucket(ns)];
+
+	util_fetch_and_add64(bucket, 1);
+}
+
+/*
+ * data_mover_trace_complete -- (internal) notes down the completion
+ * of the operation, called by the thread of the traced data mover,
+ * which completed it
+ */
+static void
+data_mover_trace_complete(void *arg)
+{
+	struct data_mover_trace_data *tdata = arg;
+	tdata->record.completed = runtime_clock_now();
+
+	/* the operation can be deleted as soon as it's complete */
+	vdm_complete_fn fn = tdata->fn;
+	void *fn_arg = tdata->arg;
+
+	if (tdata->waker.wake != NULL)
+		FUTURE_WAKER_WAKE(&tdata->waker);
+	util_atomic_store_explicit64(&tdata->complete, 1, memory_order_release);
+
+	if (fn != NULL)
+		fn(fn_arg);
+}
+
+/*
+ * data_mover_trace_operation_new -- create a new traced operation
+ */
+static void *
+data_mover_trace_operation_new(struct vdm *vdm,
+	const enum vdm_operation_type type)
+{
+	struct data_mover_trace *dmtr = (struct data_mover_trace *)vdm;
+	ASSERT(type < DATA_MOVER_TRACE_TYPES);
+
+	struct data_mover_trace_data *tdata = membuf_alloc(dmtr->membuf,
+		sizeof(struct data_mover_trace_data));
+	if (tdata == NULL)
+		return NULL;
+
+	uint64_t now = runtime_clock_now();
+	tdata->data = dmtr->vdm->op_new(dmtr->vdm, type);
+	if (tdata->data == NULL) {
+		membuf_free(tdata);
+		return NULL;
+	}
+
+	tdata->record.type = type;
+	tdata->record.size = 0;
+	tdata->record.created = now;
+	tdata->record.started = 0;
+	tdata->record.completed = 0;
+	tdata->record.reaped = 0;
+	tdata->callback = 0;
+	tdata->complete = 0;
+	tdata->waker.wake = NULL;
+	tdata->fn = NULL;
+
+	return tdata;
+}
+
+/*
+ * data_mover_trace_operation_delete -- delete a traced operation, counting
+ * the latencies of its phases
+ */
+static void
+data_mover_trace_operation_delete(void *data,
+	const struct vdm_operation *operation,
+	struct vdm_operation_output *output)
+{
+	struct data_mover_trace_data *tdata = data;
+	struct data_mover_trace *dmtr = membuf_ptr_user_data(tdata);
+	struct data_mover_trace_record *record = &tdata->record;
+
+	dmtr->vdm->op_delete(tdata->data, operation, output);
+
+	/* operations deleted before they were reaped aren't counted */
+	if (record->reaped != 0) {
+		data_mover_trace_count(dmtr, record, DATA_MOVER_TRACE_QUEUE,
+			record->created, record->started);
+		uint64_t completed = record->completed != 0 ?
+			record->completed : record->reaped;
+		data_mover_trace_count(dmtr, record, DATA_MOVER_TRACE_EXECUTE,
+			record->started, completed);
+		if (record->completed != 0)
+			data_mover_trace_count(dmtr, record,
+				DATA_MOVER_TRACE_REAP, completed,
+				record->reaped);
+
+		if (dmtr->hook != NULL)
+			dmtr->hook(record, dmtr->hook_arg);
+	}
+
+	membuf_free(tdata);
+}
+
+/*
+ * data_mover_trace_operation_check -- checks the status of the operation
+ * in the traced data mover, noting down when it's reaped
+ */
+static enum future_state
+data_mover_trace_operation_check(void *data,
+	const struct vdm_operation *operation)
+{
+	struct data_mover_trace_data *tdata = data;
+	struct data_mover_trace *dmtr = membuf_ptr_user_data(tdata);
+
+	enum future_state state;
+	if (tdata->callback) {
+		uint64_t complete;
+		util_atomic_load_explicit64(&tdata->complete, &complete,
+			memory_order_acquire);
+		state = complete ? FUTURE_STATE_COMPLETE :
+			FUTURE_STATE_RUNNING;
+	} else {
+		state = dmtr->vdm->op_check(tdata->data, operation);
+	}
+
+	if (state == FUTURE_STATE_COMPLETE && tdata->record.reaped == 0)
+		tdata->record.reaped = runtime_clock_now();
+
+	return state;
+}
+
+/*
+ * data_mover_trace_operation_start -- starts the operation in the traced
+ * data mover, with a completion callback, if it supports them
+ */
+static int
+data_mover_trace_operation_start(void *data,
+	const struct vdm_operation *operation, struct future_notifier *n)
+{
+	struct data_mover_trace_data *tdata = data;
+	struct data_mover_trace *dmtr = membuf_ptr_user_data(tdata);
+	struct vdm *vdm = dmtr->vdm;
+
+	tdata->record.size = vdm_operation_size(operation);
+	tdata->record.started = runtime_clock_now();
+
+	if (vdm->op_start_cb == NULL)
+		return vdm->op_start(tdata->data, operation, n);
+
+	/* the completion callback wakes the future up instead of the mover */
+	if (n) {
+		n->notifier_used = FUTURE_NOTIFIER_WAKER;
+		tdata->waker = n->waker;
+	}
+	tdata->callback = 1;
+	if (vdm->op_start_cb(tdata->data, operation, data_mover_trace_complete,
+			tdata) == 0)
+		return 0;
+
+	/* a router can select a data mover without completion callbacks */
+	tdata->callback = 0;
+	tdata->waker.wake = NULL;
+	if (tdata->fn != NULL)
+		return -1;
+
+	return vdm->op_start(tdata->data, operation, n);
+}
+
+/*
+ * data_mover_trace_operation_start_cb -- starts the operation in the traced
+ * data mover, which calls the function once it's complete
+ */
+static int
+data_mover_trace_operation_start_cb(void *data,
+	const struct vdm_operation *operation, vdm_complete_fn fn, void *arg)
+{
+	struct data_mover_trace_data *tdata = data;
+	struct data_mover_trace *dmtr = membuf_ptr_user_data(tdata);
+	if (dmtr->vdm->op_start_cb == NULL)
+		return -1;
+
+	tdata->fn = fn;
+	tdata->arg = arg;
+	if (data_mover_trace_operation_start(data, operation, NULL) != 0) {
+		tdata->fn = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * data_mover_trace_operation_cancel -- requests the cancellation
+ * of the operation in the traced data mover
+ */
+static int
+data_mover_trace_operation_cancel(void *data,
+	const struct vdm_operation *operation)
+{
+	struct data_mover_trace_data *tdata = data;
+	struct data_mover_trace *dmtr = membuf_ptr_user_data(tdata);
+	if (dmtr->vdm->op_cancel == NULL)
+		return -1;
+
+	return dmtr->vdm->op_cancel(tdata->data, operation);
+}
+
+/*
+ * data_mover_trace_has_property -- returns if the traced data mover
+ * has the property
+ */
+static int
+data_mover_trace_has_property(void *fut, enum future_property property)
+{
+	struct vdm_operation_future *future = fut;
+	struct data_mover_trace *dmtr =
+		(struct data_mover_trace *)future->data.vdm;
+	struct vdm *vdm = dmtr->vdm;
+	if (vdm->has_property == NULL)
+		return 0;
+
+	/*
+	 * The traced data mover can look at its own vdm in the future, which
+	 * can be a compact one, sharing only the prefix up to the vdm.
+	 */
+	struct vdm_compact_future traced;
+	memcpy(&traced, fut, sizeof(traced));
+	traced.data.vdm = vdm;
+
+	return vdm->has_property(&traced, property);
+}
+
+static struct vdm data_mover_trace_vdm = {
+	.op_new = data_mover_trace_operation_new,
+	.op_delete = data_mover_trace_operation_delete,
+	.op_check = data_mover_trace_operation_check,
+	.op_start = data_mover_trace_operation_start,
+	.capabilities = 0,
+	.has_property = data_mover_trace_has_property,
+	.op_start_cb = data_mover_trace_operation_start_cb,
+	.op_cancel = data_mover_trace_operation_cancel,
+};
+
+/*
+ * data_mover_trace_new -- creates a new data mover, which traces
+ * the operations of vdm
+ */
+struct data_mover_trace *
+data_mover_trace_new(struct vdm *vdm)
+{
+	COMPILE_ERROR_ON(ARRAY_SIZE(data_mover_trace_type_names) !=
+		DATA_MOVER_TRACE_TYPES);
+	COMPILE_ERROR_ON(ARRAY_SIZE(data_mover_trace_phase_names) !=
+		DATA_MOVER_TRACE_PHASES);
+
+	if (vdm == NULL)
+		return NULL;
+
+	struct data_mover_trace *dmtr =
+		malloc(sizeof(struct data_mover_trace));
+	if (dmtr == NULL)
+		return NULL;
+
+	dmtr->base = data_mover_trace_vdm;
+	dmtr->base.capabilities = vdm->capabilities;
+	dmtr->vdm = vdm;
+	dmtr->hook = NULL;
+	dmtr->hook_arg = NULL;
+	memset(dmtr->histograms, 0, sizeof(dmtr->histograms));
+	dmtr->membuf = membuf_new(dmtr, 0, MEMBUF_PAGES_NORMAL);
+	if (dmtr->membuf == NULL)
+		goto membuf_failed;
+
+	return dmtr;
+
+membuf_failed:
+	free(dmtr);
+	return NULL;
+}
+
+/*
+ * data_mover_trace_get_vdm -- returns the vdm operations for the tracer
+ */
+struct vdm *
+data_mover_trace_get_vdm(struct data_mover_trace *dmtr)
+{
+	return &dmtr->base;
+}
+
+/*
+ * data_mover_trace_set_hook -- sets the function called with the record
+ * of every reaped operation, when it's deleted, has to be called before
+ * any operation is created
+ */
+void
+data_mover_trace_set_hook(struct data_mover_trace *dmtr,
+	data_mover_trace_hook hook, void *arg)
+{
+	dmtr->hook = hook;
+	dmtr->hook_arg = arg;
+}
+
+/*
+ * data_mover_trace_size_bucket -- returns the histogram bucket
+ * of the operations of size bytes, bucket 0 is for the ones smaller
+ * than 256 bytes, each next one for 4 times larger ones
+ */
+size_t
+data_mover_trace_size_bucket(size_t size)
+{
+	if (size < 256)
+		return 0;
+
+	size_t bucket = (size_t)(util_mssb_index64(size) - 8) / 2 + 1;
+
+	return bucket < DATA_MOVER_TRACE_SIZE_BUCKETS ?
+		bucket : DATA_MOVER_TRACE_SIZE_BUCKETS - 1;
+}
+
+/*
+ * data_mover_trace_get_histogram -- copies the latency histogram
+ * of the phase of the operations of the type and size bucket
+ */
+void
+data_mover_trace_get_histogram(struct data_mover_trace *dmtr,
+	enum vdm_operation_type type, size_t size_bucket,
+	enum data_mover_trace_phase phase,
+	uint64_t counts[DATA_MOVER_TRACE_LATENCY_BUCKETS])
+{
+	ASSERT(type < DATA_MOVER_TRACE_TYPES);
+	ASSERT(size_bucket < DATA_MOVER_TRACE_SIZE_BUCKETS);
+	ASSERT(phase < DATA_MOVER_TRACE_PHASES);
+
+	for (size_t i = 0; i < DATA_MOVER_TRACE_LATENCY_BUCKETS; ++i) {
+		util_atomic_load_explicit64(
+			&dmtr->histograms[type][size_bucket][phase][i],
+			&counts[i], memory_order_relaxed);
+	}
+}
+
+/*
+ * data_mover_trace_dump_histogram -- (internal) writes the non-empty buckets
+ * of the histogram of the phase of the operations of the type and size bucket
+ */
+static int
+data_mover_trace_dump_histogram(struct data_mover_trace *dmtr, FILE *stream,
+	size_t type, size_t size_bucket, size_t phase)
+{
+	uint64_t counts[DATA_MOVER_TRACE_LATENCY_BUCKETS];
+	data_mover_trace_get_histogram(dmtr, (enum vdm_operation_type)type,
+		size_bucket, (enum data_mover_trace_phase)phase, counts);
+
+	size_t min_size = size_bucket == 0 ? 0 :
+		(size_t)64 << (2 * size_bucket);
+	for (size_t i = 0; i < DATA_MOVER_TRACE_LATENCY_BUCKETS; ++i) {
+		if (counts[i] == 0)
+			continue;
+
+		uint64_t min_ns = i == 0 ? 0 : (uint64_t)1 << i;
+		if (fprintf(stream, "%s,%zu,%s,%llu,%llu\n",
+				data_mover_trace_type_names[type], min_size,
+				data_mover_trace_phase_names[phase],
+				(unsigned long long)min_ns,
+				(unsigned long long)counts[i]) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * data_mover_trace_dump -- writes the non-empty buckets of the histograms
+ * to the stream as comma separated values, returns -1 if writing fails
+ */
+int
+data_mover_trace_dump(struct data_mover_trace *dmtr, FILE *stream)
+{
+	if (fprintf(stream, "type,min_size,phase,min_ns,count\n") < 0)
+		return -1;
+
+	for (size_t t = 0; t < DATA_MOVER_TRACE_TYPES; ++t) {
+		for (size_t s = 0; s < DATA_MOVER_TRACE_SIZE_BUCKETS; ++s) {
+			for (size_t p = 0; p < DATA_MOVER_TRACE_PHASES; ++p) {
+				if (data_mover_trace_dump_histogram(dmtr,
+						stream, t, s, p) != 0)
+					return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * data_mover_trace_reset -- clears the histograms
+ */
+void
+data_mover_trace_reset(struct data_mover_trace *dmtr)
+{
+	uint64_t *counts = &dmtr->histograms[0][0][0][0];
+	size_t n = sizeof(dmtr->histograms) / sizeof(*counts);
+
+	for (size_t i = 0; i < n; ++i)
+		util_atomic_store_explicit64(&counts[i], 0,
+			memory_order_relaxed);
+}
+
+/*
+ * data_mover_trace_delete -- deletes the tracer, the traced data mover
+ * is left intact
+ */
+void
+data_mover_trace_delete(struct data_mover_trace *dmtr)
+{
+	membuf_delete(dmtr->membuf);
+	free(dmtr);
+}
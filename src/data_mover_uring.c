@@ -0,0 +1,694 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * data_mover_uring.c -- data mover performing the file operations
+ * with io_uring
+ *
+ * The file operations are submitted to the submission queue of the ring,
+ * shared by all the threads, and their completions are reaped from its
+ * completion queue by whichever thread polls any of the futures, or,
+ * if the futures are meant to be woken, by the thread of the mover blocked
+ * on the ring. No thread is dedicated to any of the operations.
+ *
+ * The memory operations are performed on the cpu, by the synchronous data
+ * mover, so that the mover can perform any vdm operation.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/fs.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#include "libminiasync/vdm.h"
+#include "libminiasync/data_mover_sync.h"
+#include "libminiasync/data_mover_uring.h"
+#include "core/membuf.h"
+#include "core/os_thread.h"
+#include "core/out.h"
+#include "core/util.h"
+
+#define SUPPORTED_FLAGS (VDM_F_MEM_DURABLE | VDM_F_NO_CACHE_HINT)
+
+/* the length of a single read or write of the ring */
+#define DATA_MOVER_URING_MAX_RW ((size_t)1 << 30)
+
+/* the user data of the request waking the thread of the mover */
+#define DATA_MOVER_URING_STOP 0
+
+struct data_mover_uring {
+	struct vdm base; /* must be first */
+	struct membuf *membuf;
+	struct data_mover_sync *dms; /* performs the memory operations */
+	enum future_notifier_type desired_notifier;
+
+	int fd;
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	os_mutex_t sq_lock; /* serializes the submissions */
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_array;
+	unsigned sq_mask;
+	unsigned sq_entries;
+
+	os_mutex_t cq_lock; /* serializes the reaping of the completions */
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	struct io_uring_cqe *cqes;
+	unsigned cq_mask;
+	unsigned cq_entries;
+	unsigned inflight; /* the completion queue never overflows */
+
+	struct iovec *bufs; /* registered with the ring */
+	size_t nbufs;
+
+	os_thread_t reaper; /* unless the desired notifier is NONE */
+	int stop;
+};
+
+struct data_mover_uring_data {
+	struct data_mover_uring *dmu;
+	int in_membuf;
+	void *cpu_data; /* of the memory operation, performed on the cpu */
+	int submitted; /* the request was placed in the submission queue */
+	uint64_t complete; /* the request is complete, monitored by pollers */
+	int32_t res;
+	size_t done;
+	struct future_notifier notifier;
+	struct vdm_operation_output output;
+};
+
+/*
+ * data_mover_uring_enter -- (internal) the io_uring_enter system call
+ */
+static int
+data_mover_uring_enter(struct data_mover_uring *dmu, unsigned to_submit,
+	unsigned min_complete, unsigned flags)
+{
+	return (int)syscall(__NR_io_uring_enter, dmu->fd, to_submit,
+		min_complete, flags, NULL, 0);
+}
+
+/*
+ * data_mover_uring_is_file_op -- (internal) returns if the operation
+ * is performed by the ring
+ */
+static int
+data_mover_uring_is_file_op(const struct vdm_operation *operation)
+{
+	return operation->type == VDM_OPERATION_PREAD ||
+		operation->type == VDM_OPERATION_PWRITE;
+}
+
+/*
+ * data_mover_uring_buf_index -- (internal) returns the registered buffer,
+ * which holds the whole range, or -1 if there is none
+ */
+static int
+data_mover_uring_buf_index(struct data_mover_uring *dmu, const void *buf,
+	size_t len)
+{
+	uintptr_t start = (uintptr_t)buf;
+	for (size_t i = 0; i < dmu->nbufs; ++i) {
+		uintptr_t base = (uintptr_t)dmu->bufs[i].iov_base;
+		if (start >= base &&
+		    start + len <= base + dmu->bufs[i].iov_len)
+			return (int)i;
+	}
+
+	return -1;
+}
+
+/*
+ * data_mover_uring_sqe_init -- (internal) prepares the request transferring
+ * what remains of the file operation
+ */
+static void
+data_mover_uring_sqe_init(struct data_mover_uring_data *udata,
+	const struct vdm_operation *operation, struct io_uring_sqe *sqe)
+{
+	const struct vdm_operation_data_pread *mdata = &operation->data.pread;
+	size_t len = mdata->n - udata->done;
+	if (len > DATA_MOVER_URING_MAX_RW)
+		len = DATA_MOVER_URING_MAX_RW;
+	const char *buf = (const char *)mdata->buf + udata->done;
+
+	int write = operation->type == VDM_OPERATION_PWRITE;
+	COMPILE_ERROR_ON(offsetof(struct vdm_operation_data_pread, buf) !=
+		offsetof(struct vdm_operation_data_pwrite, buf));
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+	int index = data_mover_uring_buf_index(udata->dmu, buf, len);
+	if (index >= 0) {
+		sqe->opcode = write ? IORING_OP_WRITE_FIXED :
+			IORING_OP_READ_FIXED;
+		sqe->buf_index = (uint16_t)index;
+	}
+	sqe->fd = mdata->fd;
+	sqe->off = mdata->offset + udata->done;
+	sqe->addr = (uintptr_t)buf;
+	sqe->len = (uint32_t)len;
+	if (write && (mdata->flags & VDM_F_MEM_DURABLE))
+		sqe->rw_flags = RWF_DSYNC;
+	sqe->user_data = (uintptr_t)udata;
+}
+
+/*
+ * data_mover_uring_submit -- (internal) places the request of the operation
+ * in the submission queue, returns -1 if the ring is full
+ */
+static int
+data_mover_uring_submit(struct data_mover_uring_data *udata,
+	const struct vdm_operation *operation)
+{
+	struct data_mover_uring *dmu = udata->dmu;
+
+	util_atomic_store_explicit64(&udata->complete, 0,
+		memory_order_relaxed);
+
+	/* the completion is counted before it can be reaped */
+	if (util_fetch_and_add32(&dmu->inflight, 1) >= dmu->cq_entries) {
+		util_fetch_and_sub32(&dmu->inflight, 1);
+		return -1;
+	}
+
+	os_mutex_lock(&dmu->sq_lock);
+
+	unsigned tail = *dmu->sq_tail;
+	unsigned head;
+	util_atomic_load_explicit32(dmu->sq_head, &head,
+		memory_order_acquire);
+	if (tail - head == dmu->sq_entries) {
+		os_mutex_unlock(&dmu->sq_lock);
+		util_fetch_and_sub32(&dmu->inflight, 1);
+		return -1;
+	}
+
+	unsigned index = tail & dmu->sq_mask;
+	data_mover_uring_sqe_init(udata, operation, &dmu->sqes[index]);
+	dmu->sq_array[index] = index;
+	util_atomic_store_explicit32(dmu->sq_tail, tail + 1,
+		memory_order_release);
+	udata->submitted = 1;
+
+	/* the requests left in the queue by a failed call are submitted too */
+	data_mover_uring_enter(dmu, tail + 1 - head, 0, 0);
+
+	os_mutex_unlock(&dmu->sq_lock);
+
+	return 0;
+}
+
+/*
+ * data_mover_uring_reap -- (internal) marks the operations, whose requests
+ * are in the completion queue, as complete
+ */
+static void
+data_mover_uring_reap(struct data_mover_uring *dmu)
+{
+	unsigned head = *dmu->cq_head;
+	unsigned tail;
+	util_atomic_load_explicit32(dmu->cq_tail, &tail, memory_order_acquire);
+
+	for (; head != tail; ++head) {
+		struct io_uring_cqe *cqe = &dmu->cqes[head & dmu->cq_mask];
+		util_fetch_and_sub32(&dmu->inflight, 1);
+		if (cqe->user_data == DATA_MOVER_URING_STOP)
+			continue;
+
+		struct data_mover_uring_data *udata =
+			(struct data_mover_uring_data *)(uintptr_t)
+			cqe->user_data;
+		udata->res = cqe->res;
+
+		/* the complete operation can be deleted right away */
+		int wake = udata->notifier.notifier_used ==
+			FUTURE_NOTIFIER_WAKER;
+		struct future_waker waker = udata->notifier.waker;
+		util_atomic_store_explicit64(&udata->complete, 1,
+			memory_order_release);
+		if (wake)
+			FUTURE_WAKER_WAKE(&waker);
+	}
+
+	util_atomic_store_explicit32(dmu->cq_head, head, memory_order_release);
+}
+
+/*
+ * data_mover_uring_reaper -- (internal) the thread waiting for
+ * the completions, to wake the futures
+ */
+static void *
+data_mover_uring_reaper(void *arg)
+{
+	struct data_mover_uring *dmu = arg;
+
+	int stop = 0;
+	while (!stop) {
+		if (data_mover_uring_enter(dmu, 0, 1,
+				IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+			break;
+
+		os_mutex_lock(&dmu->cq_lock);
+		data_mover_uring_reap(dmu);
+		os_mutex_unlock(&dmu->cq_lock);
+
+		util_atomic_load_explicit32(&dmu->stop, &stop,
+			memory_order_acquire);
+	}
+
+	return NULL;
+}
+
+/*
+ * data_mover_uring_operation_new -- creates a new uring operation
+ */
+static void *
+data_mover_uring_operation_new(struct vdm *vdm,
+	const enum vdm_operation_type type)
+{
+	SUPPRESS_UNUSED(type);
+
+	struct data_mover_uring *dmu = (struct data_mover_uring *)vdm;
+	struct data_mover_uring_data *udata = membuf_alloc(dmu->membuf,
+		sizeof(struct data_mover_uring_data));
+	if (udata == NULL)
+		return NULL;
+
+	udata->dmu = dmu;
+	udata->in_membuf = 1;
+
+	return udata;
+}
+
+/*
+ * data_mover_uring_operation_init -- creates a new uring operation
+ * in the storage provided by the caller
+ */
+static void *
+data_mover_uring_operation_init(struct vdm *vdm,
+	const enum vdm_operation_type type, void *storage)
+{
+	SUPPRESS_UNUSED(type);
+
+	struct data_mover_uring_data *udata = storage;
+	udata->dmu = (struct data_mover_uring *)vdm;
+	udata->in_membuf = 0;
+
+	return udata;
+}
+
+/*
+ * data_mover_uring_operation_delete -- deletes a uring operation
+ */
+static void
+data_mover_uring_operation_delete(void *data,
+	const struct vdm_operation *operation,
+	struct vdm_operation_output *output)
+{
+	struct data_mover_uring_data *udata = data;
+
+	if (udata->cpu_data != NULL) {
+		struct vdm *sync = data_mover_sync_get_vdm(udata->dmu->dms);
+		sync->op_delete(udata->cpu_data, operation, output);
+	} else {
+		*output = udata->output;
+		output->type = operation->type;
+	}
+
+	if (udata->in_membuf)
+		membuf_free(data);
+}
+
+/*
+ * data_mover_uring_operation_check -- checks the completion of the request
+ * of the operation, submits what remains of a short transfer
+ */
+static enum future_state
+data_mover_uring_operation_check(void *data,
+	const struct vdm_operation *operation)
+{
+	struct data_mover_uring_data *udata = data;
+	struct data_mover_uring *dmu = udata->dmu;
+
+	if (!data_mover_uring_is_file_op(operation) ||
+	    udata->output.result != VDM_SUCCESS)
+		return FUTURE_STATE_COMPLETE;
+
+	/* the ring was full when the rest of the operation was submitted */
+	if (!udata->submitted) {
+		data_mover_uring_submit(udata, operation);
+		return FUTURE_STATE_RUNNING;
+	}
+
+	uint64_t complete;
+	util_atomic_load_explicit64(&udata->complete, &complete,
+		memory_order_acquire);
+	if (!complete && os_mutex_trylock(&dmu->cq_lock) == 0) {
+		data_mover_uring_reap(dmu);
+		os_mutex_unlock(&dmu->cq_lock);
+		util_atomic_load_explicit64(&udata->complete, &complete,
+			memory_order_acquire);
+	}
+	if (!complete)
+		return FUTURE_STATE_RUNNING;
+
+	udata->submitted = 0;
+	COMPILE_ERROR_ON(offsetof(struct vdm_operation_output_pread, n) !=
+		offsetof(struct vdm_operation_output_pwrite, n));
+	struct vdm_operation_output_pread *out = &udata->output.output.pread;
+	if (udata->res < 0) {
+		udata->output.result = VDM_ERROR_IO;
+		out->error = -udata->res;
+		return FUTURE_STATE_COMPLETE;
+	}
+
+	/* a read stops short at the end of the file */
+	udata->done += (size_t)udata->res;
+	out->n = udata->done;
+	if (udata->res == 0 || udata->done == operation->data.pread.n)
+		return FUTURE_STATE_COMPLETE;
+
+	data_mover_uring_submit(udata, operation);
+
+	return FUTURE_STATE_RUNNING;
+}
+
+/*
+ * data_mover_uring_operation_start -- submits the file operation to the ring,
+ * returns -1 if it's full, or performs the memory operation
+ */
+static int
+data_mover_uring_operation_start(void *data,
+	const struct vdm_operation *operation, struct future_notifier *n)
+{
+	struct data_mover_uring_data *udata = data;
+	struct data_mover_uring *dmu = udata->dmu;
+
+	if (n)
+		n->notifier_used = FUTURE_NOTIFIER_NONE;
+	udata->cpu_data = NULL;
+	udata->output.result = VDM_SUCCESS;
+
+	if (!data_mover_uring_is_file_op(operation)) {
+		struct vdm *sync = data_mover_sync_get_vdm(dmu->dms);
+		udata->cpu_data = sync->op_new(sync, operation->type);
+		if (udata->cpu_data == NULL) {
+			udata->output.result = VDM_ERROR_OUT_OF_MEMORY;
+			return 0;
+		}
+
+		return sync->op_start(udata->cpu_data, operation, NULL);
+	}
+
+	udata->notifier.notifier_used = FUTURE_NOTIFIER_NONE;
+	if (n && dmu->desired_notifier != FUTURE_NOTIFIER_NONE) {
+		n->notifier_used = dmu->desired_notifier;
+		udata->notifier = *n;
+		if (dmu->desired_notifier == FUTURE_NOTIFIER_POLLER)
+			n->poller.ptr_to_monitor = &udata->complete;
+	}
+
+	udata->done = 0;
+	udata->output.output.pread.n = 0;
+	udata->output.output.pread.error = 0;
+	udata->submitted = 0;
+
+	if (data_mover_uring_submit(udata, operation) != 0) {
+		if (n)
+			n->notifier_used = FUTURE_NOTIFIER_NONE;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * data_mover_uring_has_property -- the file operations of the uring mover
+ * are asynchronous
+ */
+static int
+data_mover_uring_has_property(void *fut, enum future_property property)
+{
+	SUPPRESS_UNUSED(fut);
+
+	return property == FUTURE_PROPERTY_ASYNC;
+}
+
+static struct vdm data_mover_uring_vdm = {
+	.op_new = data_mover_uring_operation_new,
+	.op_delete = data_mover_uring_operation_delete,
+	.op_check = data_mover_uring_operation_check,
+	.op_start = data_mover_uring_operation_start,
+	.capabilities = SUPPORTED_FLAGS,
+	.has_property = data_mover_uring_has_property,
+	.op_init = data_mover_uring_operation_init,
+	.op_storage_size = ALIGN_UP(sizeof(struct data_mover_uring_data),
+		(size_t)VDM_OP_STORAGE_ALIGN),
+};
+
+/*
+ * data_mover_uring_map -- (internal) maps the queues of the ring,
+ * returns -1 on failure
+ */
+static int
+data_mover_uring_map(struct data_mover_uring *dmu,
+	const struct io_uring_params *p)
+{
+	dmu->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+	dmu->cq_ring_size = p->cq_off.cqes +
+		p->cq_entries * sizeof(struct io_uring_cqe);
+	int single = (p->features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (single) {
+		if (dmu->cq_ring_size > dmu->sq_ring_size)
+			dmu->sq_ring_size = dmu->cq_ring_size;
+		dmu->cq_ring_size = dmu->sq_ring_size;
+	}
+
+	dmu->sq_ring = mmap(NULL, dmu->sq_ring_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, dmu->fd, IORING_OFF_SQ_RING);
+	if (dmu->sq_ring == MAP_FAILED)
+		return -1;
+
+	dmu->cq_ring = dmu->sq_ring;
+	if (!single) {
+		dmu->cq_ring = mmap(NULL, dmu->cq_ring_size,
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			dmu->fd, IORING_OFF_CQ_RING);
+		if (dmu->cq_ring == MAP_FAILED)
+			goto err_sq;
+	}
+
+	dmu->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+	dmu->sqes = mmap(NULL, dmu->sqes_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, dmu->fd, IORING_OFF_SQES);
+	if (dmu->sqes == MAP_FAILED)
+		goto err_cq;
+
+	char *sq = dmu->sq_ring;
+	dmu->sq_head = (unsigned *)(sq + p->sq_off.head);
+	dmu->sq_tail = (unsigned *)(sq + p->sq_off.tail);
+	dmu->sq_array = (unsigned *)(sq + p->sq_off.array);
+	dmu->sq_mask = *(unsigned *)(sq + p->sq_off.ring_mask);
+	dmu->sq_entries = p->sq_entries;
+
+	char *cq = dmu->cq_ring;
+	dmu->cq_head = (unsigned *)(cq + p->cq_off.head);
+	dmu->cq_tail = (unsigned *)(cq + p->cq_off.tail);
+	dmu->cqes = (struct io_uring_cqe *)(cq + p->cq_off.cqes);
+	dmu->cq_mask = *(unsigned *)(cq + p->cq_off.ring_mask);
+	dmu->cq_entries = p->cq_entries;
+
+	return 0;
+
+err_cq:
+	if (dmu->cq_ring != dmu->sq_ring)
+		munmap(dmu->cq_ring, dmu->cq_ring_size);
+err_sq:
+	munmap(dmu->sq_ring, dmu->sq_ring_size);
+	return -1;
+}
+
+/*
+ * data_mover_uring_unmap -- (internal) unmaps the queues of the ring
+ */
+static void
+data_mover_uring_unmap(struct data_mover_uring *dmu)
+{
+	munmap(dmu->sqes, dmu->sqes_size);
+	if (dmu->cq_ring != dmu->sq_ring)
+		munmap(dmu->cq_ring, dmu->cq_ring_size);
+	munmap(dmu->sq_ring, dmu->sq_ring_size);
+}
+
+/*
+ * data_mover_uring_new -- creates a new uring data mover with a ring
+ * of at least the given number of entries
+ */
+struct data_mover_uring *
+data_mover_uring_new(unsigned entries,
+	enum future_notifier_type desired_notifier)
+{
+	struct data_mover_uring *dmu = malloc(sizeof(struct data_mover_uring));
+	if (dmu == NULL)
+		return NULL;
+
+	dmu->base = data_mover_uring_vdm;
+	dmu->desired_notifier = desired_notifier;
+	dmu->inflight = 0;
+	dmu->bufs = NULL;
+	dmu->nbufs = 0;
+	dmu->stop = 0;
+
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	dmu->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+	if (dmu->fd < 0)
+		goto err_free;
+
+	if (data_mover_uring_map(dmu, &p) != 0)
+		goto err_close;
+
+	dmu->membuf = membuf_new(dmu, 0, MEMBUF_PAGES_NORMAL);
+	if (dmu->membuf == NULL)
+		goto err_unmap;
+
+	dmu->dms = data_mover_sync_new();
+	if (dmu->dms == NULL)
+		goto err_membuf;
+
+	os_mutex_init(&dmu->sq_lock);
+	os_mutex_init(&dmu->cq_lock);
+
+	if (desired_notifier != FUTURE_NOTIFIER_NONE &&
+	    os_thread_create(&dmu->reaper, NULL, data_mover_uring_reaper,
+			dmu) != 0)
+		goto err_locks;
+
+	return dmu;
+
+err_locks:
+	os_mutex_destroy(&dmu->cq_lock);
+	os_mutex_destroy(&dmu->sq_lock);
+	data_mover_sync_delete(dmu->dms);
+err_membuf:
+	membuf_delete(dmu->membuf);
+err_unmap:
+	data_mover_uring_unmap(dmu);
+err_close:
+	close(dmu->fd);
+err_free:
+	free(dmu);
+	return NULL;
+}
+
+/*
+ * data_mover_uring_register_buffers -- registers the buffers with the ring,
+ * the file operations on them don't pin their pages every time
+ */
+int
+data_mover_uring_register_buffers(struct data_mover_uring *dmu,
+	const struct vdm_iov *bufs, size_t cnt)
+{
+	if (dmu->nbufs != 0 || cnt == 0 || cnt > UINT16_MAX) {
+		errno = dmu->nbufs != 0 ? EBUSY : EINVAL;
+		return -1;
+	}
+
+	struct iovec *iov = malloc(cnt * sizeof(*iov));
+	if (iov == NULL)
+		return -1;
+	for (size_t i = 0; i < cnt; ++i) {
+		iov[i].iov_base = bufs[i].iov_base;
+		iov[i].iov_len = bufs[i].iov_len;
+	}
+
+	if (syscall(__NR_io_uring_register, dmu->fd, IORING_REGISTER_BUFFERS,
+			iov, (unsigned)cnt) != 0) {
+		free(iov);
+		return -1;
+	}
+
+	dmu->bufs = iov;
+	dmu->nbufs = cnt;
+
+	return 0;
+}
+
+/*
+ * data_mover_uring_get_vdm -- returns the vdm operations for the uring mover
+ */
+struct vdm *
+data_mover_uring_get_vdm(struct data_mover_uring *dmu)
+{
+	return &dmu->base;
+}
+
+/*
+ * data_mover_uring_get_membuf_stats -- returns the statistics of the buffers
+ * the operations are allocated from
+ */
+void
+data_mover_uring_get_membuf_stats(struct data_mover_uring *dmu,
+	struct vdm_membuf_stats *stats)
+{
+	membuf_get_stats(dmu->membuf, stats);
+}
+
+/*
+ * data_mover_uring_stop -- (internal) wakes the thread of the mover
+ * with a no-op request, for it to exit
+ */
+static void
+data_mover_uring_stop(struct data_mover_uring *dmu)
+{
+	util_atomic_store_explicit32(&dmu->stop, 1, memory_order_release);
+
+	os_mutex_lock(&dmu->sq_lock);
+	unsigned tail = *dmu->sq_tail;
+	unsigned index = tail & dmu->sq_mask;
+	struct io_uring_sqe *sqe = &dmu->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_NOP;
+	sqe->user_data = DATA_MOVER_URING_STOP;
+	dmu->sq_array[index] = index;
+	util_fetch_and_add32(&dmu->inflight, 1);
+	util_atomic_store_explicit32(dmu->sq_tail, tail + 1,
+		memory_order_release);
+	data_mover_uring_enter(dmu, 1, 0, 0);
+	os_mutex_unlock(&dmu->sq_lock);
+}
+
+/*
+ * data_mover_uring_delete -- deletes a uring data mover, all its operations
+ * have to be complete
+ */
+void
+data_mover_uring_delete(struct data_mover_uring *dmu)
+{
+	if (dmu->desired_notifier != FUTURE_NOTIFIER_NONE) {
+		data_mover_uring_stop(dmu);
+		os_thread_join(&dmu->reaper, NULL);
+	}
+
+	os_mutex_destroy(&dmu->cq_lock);
+	os_mutex_destroy(&dmu->sq_lock);
+	data_mover_sync_delete(dmu->dms);
+	membuf_delete(dmu->membuf);
+	data_mover_uring_unmap(dmu);
+	close(dmu->fd);
+	free(dmu->bufs);
+	free(dmu);
+}
@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * data_mover_uring_none.c -- uring data mover stubs for the platforms
+ * without io_uring, the mover can't be created
+ */
+
+#include <errno.h>
+#include <stddef.h>
+
+#include "libminiasync/data_mover_uring.h"
+#include "core/util.h"
+
+struct data_mover_uring *
+data_mover_uring_new(unsigned entries,
+	enum future_notifier_type desired_notifier)
+{
+	SUPPRESS_UNUSED(entries, desired_notifier);
+
+	errno = ENOTSUP;
+	return NULL;
+}
+
+int
+data_mover_uring_register_buffers(struct data_mover_uring *dmu,
+	const struct vdm_iov *bufs, size_t cnt)
+{
+	SUPPRESS_UNUSED(dmu, bufs, cnt);
+
+	errno = ENOTSUP;
+	return -1;
+}
+
+struct vdm *
+data_mover_uring_get_vdm(struct data_mover_uring *dmu)
+{
+	SUPPRESS_UNUSED(dmu);
+
+	return NULL;
+}
+
+void
+data_mover_uring_get_membuf_stats(struct data_mover_uring *dmu,
+	struct vdm_membuf_stats *stats)
+{
+	SUPPRESS_UNUSED(dmu, stats);
+}
+
+void
+data_mover_uring_delete(struct data_mover_uring *dmu)
+{
+	SUPPRESS_UNUSED(dmu);
+}
@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * future_arena.c -- per-thread allocator of the futures, backed by membuf
+ *
+ * The size classes of membuf are multiples of a cache line up to 4KB,
+ * which covers the futures of the data movers and most of the composed
+ * ones. Each future starts at a cache line, so that the futures polled
+ * by different threads don't share them.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "libminiasync/future_arena.h"
+#include "core/membuf.h"
+
+struct future_arena {
+	struct membuf *membuf;
+};
+
+/*
+ * future_arena_new -- creates a new arena, with per-thread buffers of
+ * the given size (0 for the default)
+ */
+struct future_arena *
+future_arena_new(size_t buffer_size)
+{
+	struct future_arena *arena = malloc(sizeof(struct future_arena));
+	if (arena == NULL)
+		return NULL;
+
+	arena->membuf = membuf_new(arena, buffer_size, MEMBUF_PAGES_NORMAL);
+	if (arena->membuf == NULL)
+		goto membuf_failed;
+
+	return arena;
+
+membuf_failed:
+	free(arena);
+	return NULL;
+}
+
+/*
+ * future_arena_alloc -- allocates the memory for a future of the given size
+ * from the buffer of the calling thread, returns NULL if it's exhausted
+ */
+void *
+future_arena_alloc(struct future_arena *arena, size_t size)
+{
+	return membuf_alloc_aligned(arena->membuf, size,
+		MEMBUF_CACHELINE_SIZE);
+}
+
+/*
+ * future_arena_dup -- copies the future, e.g. the one returned by value
+ * by its constructor, into the arena
+ */
+void *
+future_arena_dup(struct future_arena *arena, const void *fut, size_t size)
+{
+	void *copy = future_arena_alloc(arena, size);
+	if (copy == NULL)
+		return NULL;
+
+	memcpy(copy, fut, size);
+
+	return copy;
+}
+
+/*
+ * future_arena_free -- frees the future, which can be done by any thread
+ */
+void
+future_arena_free(void *fut)
+{
+	membuf_free(fut);
+}
+
+/*
+ * future_arena_get_stats -- reads the statistics of the buffers of the arena
+ */
+void
+future_arena_get_stats(struct future_arena *arena,
+	struct vdm_membuf_stats *stats)
+{
+	membuf_get_stats(arena->membuf, stats);
+}
+
+/*
+ * future_arena_delete -- releases all the futures of the arena at once,
+ * together with the arena
+ */
+void
+future_arena_delete(struct future_arena *arena)
+{
+	membuf_delete(arena->membuf);
+	free(arena);
+}
@@ -0,0 +1,1328 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * hashmap.c -- concurrent hashmap with incremental resizing
+ *
+ * A bucket takes a cache line and holds a few slots, whose keys are compared
+ * without touching the values. The keys are placed by linear probing over
+ * the buckets, and a lookup stops at the first bucket with an empty slot.
+ * A removed key leaves a tombstone in its slot unless the bucket already has
+ * an empty one, so that the probing doesn't stop short of the keys placed
+ * further. The tombstones are reused by the insertions, and dropped when
+ * the table is rehashed.
+ *
+ * A table gets rehashed once its keys and tombstones take 3/4 of the slots,
+ * into a table twice the size if the keys take a half of them, and into one
+ * of the same size otherwise, compacting the tombstones away. The old table
+ * is kept until all of its buckets are moved into the new one, a few by each
+ * operation on the shard, and the lookups search both of them until then.
+ *
+ * The values are reference counted, so that they can be copied out of
+ * the map by a data mover outside of the lock of the shard, while they are
+ * removed or replaced concurrently.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/util.h"
+#include "libminiasync/hashmap.h"
+
+#define HASHMAP_CACHELINE_SIZE 64
+#define HASHMAP_BUCKET_SLOTS 3
+/* the top bits of the hash select the shard */
+#define HASHMAP_SHARDS_BITS 6
+#define HASHMAP_NSHARDS (1U << HASHMAP_SHARDS_BITS)
+/* buckets of the old table moved by each operation on the shard */
+#define HASHMAP_MIGRATE_STEP 8
+
+enum hashmap_slot_state {
+	HASHMAP_SLOT_EMPTY,
+	HASHMAP_SLOT_PRESENT,
+	HASHMAP_SLOT_TOMBSTONE,
+};
+
+struct hashmap_bucket {
+	uint64_t keys[HASHMAP_BUCKET_SLOTS];
+	struct hashmap_value *values[HASHMAP_BUCKET_SLOTS];
+	uint8_t states[HASHMAP_BUCKET_SLOTS];
+	uint8_t padding[HASHMAP_CACHELINE_SIZE - HASHMAP_BUCKET_SLOTS *
+		(sizeof(uint64_t) + sizeof(void *) + sizeof(uint8_t))];
+};
+
+struct hashmap_table {
+	struct hashmap_bucket *buckets; /* aligned to a cache line */
+	void *addr; /* of the allocated buckets */
+	size_t nbuckets; /* power of two */
+	size_t nentries;
+	size_t ntombstones;
+};
+
+struct hashmap_shard {
+	uint32_t lock;
+	struct hashmap_table *table;
+	struct hashmap_table *old; /* being moved into the table, or NULL */
+	size_t migrated; /* buckets of the old table moved so far */
+};
+
+struct hashmap {
+	/* the shards don't share the cache lines of their locks */
+	union {
+		struct hashmap_shard shard;
+		uint64_t padding[HASHMAP_CACHELINE_SIZE / sizeof(uint64_t)];
+	} shards[HASHMAP_NSHARDS];
+};
+
+/* the data of a value directly follows its header */
+struct hashmap_value {
+	uint64_t refs;
+	size_t size;
+};
+
+#define HASHMAP_VALUE_ADDR(_value) ((void *)((_value) + 1))
+
+/*
+ * hashmap_hash -- (internal) hashes the key with the MurmurHash3 64-bit
+ * finalizer
+ */
+static uint64_t
+hashmap_hash(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+
+	return key;
+}
+
+/*
+ * hashmap_shard_index -- (internal) returns the index of the shard of the hash
+ */
+static unsigned
+hashmap_shard_index(uint64_t hash)
+{
+	return (unsigned)(hash >> (64 - HASHMAP_SHARDS_BITS));
+}
+
+/*
+ * hashmap_shard -- (internal) returns the shard of the hash
+ */
+static struct hashmap_shard *
+hashmap_shard(struct hashmap *hm, uint64_t hash)
+{
+	return &hm->shards[hashmap_shard_index(hash)].shard;
+}
+
+/*
+ * hashmap_shard_trylock -- (internal) locks the shard, returns 0 if it's
+ * locked by another thread
+ */
+static int
+hashmap_shard_trylock(struct hashmap_shard *shard)
+{
+	return util_bool_compare_and_swap32(&shard->lock, 0, 1);
+}
+
+/*
+ * hashmap_shard_lock -- (internal) locks the shard, waiting for the other
+ * threads
+ */
+static void
+hashmap_shard_lock(struct hashmap_shard *shard)
+{
+	while (!hashmap_shard_trylock(shard))
+		WAIT();
+}
+
+/*
+ * hashmap_shard_unlock -- (internal) unlocks the shard
+ */
+static void
+hashmap_shard_unlock(struct hashmap_shard *shard)
+{
+	util_atomic_store_explicit32(&shard->lock, 0, memory_order_release);
+}
+
+/*
+ * hashmap_value_release -- (internal) drops a reference to the value,
+ * freeing it with the last one
+ */
+static void
+hashmap_value_release(struct hashmap_value *value)
+{
+	if (util_fetch_and_sub64(&value->refs, 1) == 1)
+		free(value);
+}
+
+/*
+ * hashmap_table_new -- (internal) allocates a table of empty buckets
+ *
+ * The zeroed memory of the large tables is usually mapped on first touch,
+ * so that allocating them doesn't stall the operation starting the resize.
+ */
+static struct hashmap_table *
+hashmap_table_new(size_t nbuckets)
+{
+	COMPILE_ERROR_ON(sizeof(struct hashmap_bucket) !=
+		HASHMAP_CACHELINE_SIZE);
+	COMPILE_ERROR_ON(HASHMAP_SLOT_EMPTY != 0);
+
+	struct hashmap_table *table = malloc(sizeof(struct hashmap_table));
+	if (table == NULL)
+		return NULL;
+
+	table->addr = calloc(1, nbuckets * sizeof(struct hashmap_bucket) +
+		HASHMAP_CACHELINE_SIZE - 1);
+	if (table->addr == NULL)
+		goto addr_failed;
+
+	table->buckets = (struct hashmap_bucket *)ALIGN_UP(
+		(uintptr_t)table->addr, (uintptr_t)HASHMAP_CACHELINE_SIZE);
+	table->nbuckets = nbuckets;
+	table->nentries = 0;
+	table->ntombstones = 0;
+
+	return table;
+
+addr_failed:
+	free(table);
+	return NULL;
+}
+
+/*
+ * hashmap_table_delete -- (internal) deletes the table, releasing its values
+ * if asked to
+ */
+static void
+hashmap_table_delete(struct hashmap_table *table, int release)
+{
+	for (size_t i = 0; release && i < table->nbuckets; i++) {
+		struct hashmap_bucket *bucket = &table->buckets[i];
+		for (unsigned s = 0; s < HASHMAP_BUCKET_SLOTS; s++) {
+			if (bucket->states[s] == HASHMAP_SLOT_PRESENT)
+				hashmap_value_release(bucket->values[s]);
+		}
+	}
+
+	free(table->addr);
+	free(table);
+}
+
+/*
+ * hashmap_table_find -- (internal) returns the bucket holding the key,
+ * with the index of its slot, or NULL if the table doesn't hold the key
+ */
+static struct hashmap_bucket *
+hashmap_table_find(struct hashmap_table *table, uint64_t key, uint64_t hash,
+	unsigned *slot)
+{
+	size_t mask = table->nbuckets - 1;
+	size_t index = hash & mask;
+
+	for (size_t n = 0; n < table->nbuckets; n++) {
+		struct hashmap_bucket *bucket = &table->buckets[index];
+		int empty = 0;
+		for (unsigned s = 0; s < HASHMAP_BUCKET_SLOTS; s++) {
+			if (bucket->states[s] == HASHMAP_SLOT_PRESENT &&
+				bucket->keys[s] == key) {
+				*slot = s;
+				return bucket;
+			}
+			empty |= bucket->states[s] == HASHMAP_SLOT_EMPTY;
+		}
+
+		/* the key would have been placed in this bucket */
+		if (empty)
+			return NULL;
+
+		index = (index + 1) & mask;
+	}
+
+	return NULL;
+}
+
+/*
+ * hashmap_table_place -- (internal) places the key, which the table doesn't
+ * hold, in the first free slot of its probe sequence
+ *
+ * The table must have a free slot.
+ */
+static void
+hashmap_table_place(struct hashmap_table *table, uint64_t key,
+	uint64_t hash, struct hashmap_value *value)
+{
+	size_t mask = table->nbuckets - 1;
+	size_t index = hash & mask;
+
+	for (;;) {
+		struct hashmap_bucket *bucket = &table->buckets[index];
+		for (unsigned s = 0; s < HASHMAP_BUCKET_SLOTS; s++) {
+			if (bucket->states[s] == HASHMAP_SLOT_PRESENT)
+				continue;
+
+			if (bucket->states[s] == HASHMAP_SLOT_TOMBSTONE)
+				table->ntombstones--;
+			bucket->keys[s] = key;
+			bucket->values[s] = value;
+			bucket->states[s] = HASHMAP_SLOT_PRESENT;
+			table->nentries++;
+			return;
+		}
+
+		index = (index + 1) & mask;
+	}
+}
+
+/*
+ * hashmap_table_clear -- (internal) clears the slot of the bucket, returns
+ * the value it held
+ */
+static struct hashmap_value *
+hashmap_table_clear(struct hashmap_table *table,
+	struct hashmap_bucket *bucket, unsigned slot)
+{
+	int empty = 0;
+	for (unsigned s = 0; s < HASHMAP_BUCKET_SLOTS; s++)
+		empty |= bucket->states[s] == HASHMAP_SLOT_EMPTY;
+
+	/* the probing stops at this bucket anyway if it has an empty slot */
+	if (empty) {
+		bucket->states[slot] = HASHMAP_SLOT_EMPTY;
+	} else {
+		bucket->states[slot] = HASHMAP_SLOT_TOMBSTONE;
+		table->ntombstones++;
+	}
+	table->nentries--;
+
+	return bucket->values[slot];
+}
+
+/*
+ * hashmap_shard_migrate -- (internal) moves up to n buckets of the old table
+ * of the shard into the new one
+ *
+ * The moved slots are turned into the tombstones, so that the lookups in
+ * the old table still reach the buckets which are not moved yet.
+ */
+static void
+hashmap_shard_migrate(struct hashmap_shard *shard, size_t n)
+{
+	struct hashmap_table *old = shard->old;
+	if (old == NULL)
+		return;
+
+	size_t end = old->nbuckets - shard->migrated > n ?
+		shard->migrated + n : old->nbuckets;
+	for (size_t i = shard->migrated; i < end; i++) {
+		struct hashmap_bucket *bucket = &old->buckets[i];
+		for (unsigned s = 0; s < HASHMAP_BUCKET_SLOTS; s++) {
+			if (bucket->states[s] != HASHMAP_SLOT_PRESENT)
+				continue;
+
+			uint64_t key = bucket->keys[s];
+			hashmap_table_place(shard->table, key,
+				hashmap_hash(key), bucket->values[s]);
+			bucket->states[s] = HASHMAP_SLOT_TOMBSTONE;
+			old->nentries--;
+		}
+	}
+	shard->migrated = end;
+
+	if (end == old->nbuckets) {
+		hashmap_table_delete(old, 0);
+		shard->old = NULL;
+	}
+}
+
+/*
+ * hashmap_shard_find -- (internal) looks the key up in both the tables of
+ * the shard
+ */
+static struct hashmap_bucket *
+hashmap_shard_find(struct hashmap_shard *shard, uint64_t key, uint64_t hash,
+	struct hashmap_table **table, unsigned *slot)
+{
+	struct hashmap_bucket *bucket;
+
+	*table = shard->table;
+	if ((bucket = hashmap_table_find(*table, key, hash, slot)) != NULL)
+		return bucket;
+
+	*table = shard->old;
+	if (*table == NULL)
+		return NULL;
+
+	return hashmap_table_find(*table, key, hash, slot);
+}
+
+/*
+ * hashmap_shard_reserve -- (internal) makes room for another key in the table
+ * of the shard, starting a resize if needed
+ */
+static int
+hashmap_shard_reserve(struct hashmap_shard *shard)
+{
+	struct hashmap_table *table = shard->table;
+	size_t nslots = table->nbuckets * HASHMAP_BUCKET_SLOTS;
+	if ((table->nentries + table->ntombstones + 1) * 4 <= nslots * 3)
+		return 0;
+
+	/*
+	 * The table can fill up before the previous resize is done, if the keys
+	 * are inserted faster than the old table is moved, so the new table
+	 * is sized to take the keys of both.
+	 */
+	struct hashmap_table *old = shard->old;
+	size_t nentries = table->nentries + (old ? old->nentries : 0);
+	size_t nbuckets = table->nbuckets;
+	while (nentries * 2 >= nbuckets * HASHMAP_BUCKET_SLOTS)
+		nbuckets *= 2;
+
+	struct hashmap_table *new_table = hashmap_table_new(nbuckets);
+	if (new_table == NULL)
+		return nentries < nslots ? 0 : -1;
+
+	/* the rest of the old table goes straight into the new one */
+	if (old != NULL) {
+		shard->table = new_table;
+		hashmap_shard_migrate(shard, SIZE_MAX);
+	}
+
+	shard->old = table;
+	shard->table = new_table;
+	shard->migrated = 0;
+	hashmap_shard_migrate(shard, HASHMAP_MIGRATE_STEP);
+
+	return 0;
+}
+
+/*
+ * hashmap_shard_insert -- (internal) inserts the key into the locked shard,
+ * unless it's already there
+ */
+static enum hashmap_result
+hashmap_shard_insert(struct hashmap_shard *shard, uint64_t key, uint64_t hash,
+	struct hashmap_value *value)
+{
+	struct hashmap_table *table;
+	unsigned slot;
+	if (hashmap_shard_find(shard, key, hash, &table, &slot) != NULL)
+		return HASHMAP_ERROR_KEY_EXISTS;
+
+	if (hashmap_shard_reserve(shard) != 0)
+		return HASHMAP_ERROR_OUT_OF_MEMORY;
+
+	hashmap_table_place(shard->table, key, hash, value);
+
+	return HASHMAP_SUCCESS;
+}
+
+/*
+ * hashmap_shard_acquire -- (internal) returns the value of the key in
+ * the locked shard with a reference taken, or NULL if it's not there
+ */
+static struct hashmap_value *
+hashmap_shard_acquire(struct hashmap_shard *shard, uint64_t key,
+	uint64_t hash)
+{
+	struct hashmap_table *table;
+	unsigned slot;
+	struct hashmap_bucket *bucket =
+		hashmap_shard_find(shard, key, hash, &table, &slot);
+	if (bucket == NULL)
+		return NULL;
+
+	struct hashmap_value *value = bucket->values[slot];
+	util_fetch_and_add64(&value->refs, 1);
+
+	return value;
+}
+
+/*
+ * hashmap_new -- creates a new hashmap, sized for the given number of keys
+ */
+struct hashmap *
+hashmap_new(size_t capacity)
+{
+	struct hashmap *hm = util_aligned_malloc(HASHMAP_CACHELINE_SIZE,
+		sizeof(struct hashmap));
+	if (hm == NULL)
+		return NULL;
+
+	/* the tables start half full */
+	size_t nslots = capacity / HASHMAP_NSHARDS * 2;
+	size_t nbuckets = 1;
+	while (nbuckets * HASHMAP_BUCKET_SLOTS < nslots)
+		nbuckets <<= 1;
+
+	unsigned i;
+	for (i = 0; i < HASHMAP_NSHARDS; i++) {
+		struct hashmap_shard *shard = &hm->shards[i].shard;
+		shard->lock = 0;
+		shard->old = NULL;
+		shard->migrated = 0;
+		if ((shard->table = hashmap_table_new(nbuckets)) == NULL)
+			goto table_failed;
+	}
+
+	return hm;
+
+table_failed:
+	while (i-- > 0)
+		hashmap_table_delete(hm->shards[i].shard.table, 0);
+	util_aligned_free(hm);
+	return NULL;
+}
+
+/*
+ * hashmap_delete -- deletes the hashmap, with all of its values
+ */
+void
+hashmap_delete(struct hashmap *hm)
+{
+	for (unsigned i = 0; i < HASHMAP_NSHARDS; i++) {
+		struct hashmap_shard *shard = &hm->shards[i].shard;
+		hashmap_table_delete(shard->table, 1);
+		if (shard->old != NULL)
+			hashmap_table_delete(shard->old, 1);
+	}
+
+	util_aligned_free(hm);
+}
+
+/*
+ * hashmap_length -- returns the number of keys in the hashmap
+ */
+size_t
+hashmap_length(struct hashmap *hm)
+{
+	size_t length = 0;
+	for (unsigned i = 0; i < HASHMAP_NSHARDS; i++) {
+		struct hashmap_shard *shard = &hm->shards[i].shard;
+		hashmap_shard_lock(shard);
+		length += shard->table->nentries;
+		if (shard->old != NULL)
+			length += shard->old->nentries;
+		hashmap_shard_unlock(shard);
+	}
+
+	return length;
+}
+
+/*
+ * hashmap_foreach -- calls the callback for each key of the hashmap, with
+ * the shard of the key locked
+ */
+void
+hashmap_foreach(struct hashmap *hm, hashmap_cb cb, void *arg)
+{
+	for (unsigned i = 0; i < HASHMAP_NSHARDS; i++) {
+		struct hashmap_shard *shard = &hm->shards[i].shard;
+		hashmap_shard_lock(shard);
+
+		struct hashmap_table *tables[] = {shard->table, shard->old};
+		for (unsigned t = 0; t < 2 && tables[t] != NULL; t++) {
+			struct hashmap_table *table = tables[t];
+			for (size_t b = 0; b < table->nbuckets; b++) {
+				struct hashmap_bucket *bucket =
+					&table->buckets[b];
+				for (unsigned s = 0; s < HASHMAP_BUCKET_SLOTS;
+					s++) {
+					if (bucket->states[s] !=
+						HASHMAP_SLOT_PRESENT)
+						continue;
+
+					struct hashmap_value *value =
+						bucket->values[s];
+					cb(bucket->keys[s],
+						HASHMAP_VALUE_ADDR(value),
+						value->size, arg);
+				}
+			}
+		}
+
+		hashmap_shard_unlock(shard);
+	}
+}
+
+/*
+ * hashmap_value_new_impl -- allocates a value, which the data mover copies
+ * the data into
+ */
+static enum future_state
+hashmap_value_new_impl(struct future_context *ctx,
+	struct future_notifier *notifier)
+{
+	if (notifier)
+		notifier->notifier_used = FUTURE_NOTIFIER_NONE;
+
+	struct hashmap_value_new_data *data = future_context_get_data(ctx);
+	struct hashmap_value_new_output *output =
+		future_context_get_output(ctx);
+
+	struct hashmap_value *value =
+		malloc(sizeof(struct hashmap_value) + data->size);
+	if (value != NULL) {
+		value->refs = 1;
+		value->size = data->size;
+		output->addr = HASHMAP_VALUE_ADDR(value);
+	}
+	output->value = value;
+
+	return FUTURE_STATE_COMPLETE;
+}
+
+/*
+ * hashmap_insert_impl -- inserts the copied value, unless the key is
+ * already in the hashmap
+ */
+static enum future_state
+hashmap_insert_impl(struct future_context *ctx,
+	struct future_notifier *notifier)
+{
+	if (notifier)
+		notifier->notifier_used = FUTURE_NOTIFIER_NONE;
+
+	struct hashmap_insert_data *data = future_context_get_data(ctx);
+	struct hashmap_insert_output *output = future_context_get_output(ctx);
+
+	uint64_t hash = hashmap_hash(data->key);
+	struct hashmap_shard *shard = hashmap_shard(data->hm, hash);
+	if (!hashmap_shard_trylock(shard))
+		return FUTURE_STATE_RUNNING;
+
+	hashmap_shard_migrate(shard, HASHMAP_MIGRATE_STEP);
+	output->result = hashmap_shard_insert(shard, data->key, hash,
+		data->value);
+	hashmap_shard_unlock(shard);
+
+	if (output->result != HASHMAP_SUCCESS)
+		hashmap_value_release(data->value);
+
+	return FUTURE_STATE_COMPLETE;
+}
+
+/*
+ * hashmap_acquire_impl -- looks the key up, and takes a reference to its
+ * value
+ */
+static enum future_state
+hashmap_acquire_impl(struct future_context *ctx,
+	struct future_notifier *notifier)
+{
+	if (notifier)
+		notifier->notifier_used = FUTURE_NOTIFIER_NONE;
+
+	struct hashmap_acquire_data *data = future_context_get_data(ctx);
+	struct hashmap_acquire_output *output =
+		future_context_get_output(ctx);
+
+	uint64_t hash = hashmap_hash(data->key);
+	struct hashmap_shard *shard = hashmap_shard(data->hm, hash);
+	if (!hashmap_shard_trylock(shard))
+		return FUTURE_STATE_RUNNING;
+
+	hashmap_shard_migrate(shard, HASHMAP_MIGRATE_STEP);
+	struct hashmap_value *value =
+		hashmap_shard_acquire(shard, data->key, hash);
+	hashmap_shard_unlock(shard);
+
+	if (value != NULL) {
+		output->value = value;
+		output->addr = HASHMAP_VALUE_ADDR(value);
+		output->size = value->size;
+	}
+
+	return FUTURE_STATE_COMPLETE;
+}
+
+/*
+ * hashmap_release_impl -- drops the reference to the copied value
+ */
+static enum future_state
+hashmap_release_impl(struct future_context *ctx,
+	struct future_notifier *notifier)
+{
+	if (notifier)
+		notifier->notifier_used = FUTURE_NOTIFIER_NONE;
+
+	struct hashmap_release_data *data = future_context_get_data(ctx);
+
+	hashmap_value_release(data->value);
+
+	return FUTURE_STATE_COMPLETE;
+}
+
+/*
+ * hashmap_remove_impl -- removes the key, the value is freed once it's not
+ * being copied out anymore
+ */
+static enum future_state
+hashmap_remove_impl(struct future_context *ctx,
+	struct future_notifier *notifier)
+{
+	if (notifier)
+		notifier->notifier_used = FUTURE_NOTIFIER_NONE;
+
+	struct hashmap_remove_data *data = future_context_get_data(ctx);
+	struct hashmap_remove_output *output = future_context_get_output(ctx);
+
+	uint64_t hash = hashmap_hash(data->key);
+	struct hashmap_shard *shard = hashmap_shard(data->hm, hash);
+	if (!hashmap_shard_trylock(shard))
+		return FUTURE_STATE_RUNNING;
+
+	hashmap_shard_migrate(shard, HASHMAP_MIGRATE_STEP);
+
+	struct hashmap_table *table;
+	unsigned slot;
+	struct hashmap_value *value = NULL;
+	struct hashmap_bucket *bucket =
+		hashmap_shard_find(shard, data->key, hash, &table, &slot);
+	if (bucket != NULL)
+		value = hashmap_table_clear(table, bucket, slot);
+
+	hashmap_shard_unlock(shard);
+
+	if (value != NULL) {
+		hashmap_value_release(value);
+		output->result = HASHMAP_SUCCESS;
+	} else {
+		output->result = HASHMAP_ERROR_KEY_NOT_FOUND;
+	}
+
+	return FUTURE_STATE_COMPLETE;
+}
+
+/*
+ * hashmap_copy_result -- (internal) returns the result of the operation
+ * whose value was copied by the data mover
+ */
+static enum hashmap_result
+hashmap_copy_result(struct vdm_operation_future *copy)
+{
+	switch (copy->output.result) {
+		case VDM_SUCCESS:
+			return HASHMAP_SUCCESS;
+		case VDM_ERROR_OUT_OF_MEMORY:
+			return HASHMAP_ERROR_OUT_OF_MEMORY;
+		default:
+			return HASHMAP_ERROR_COPY;
+	}
+}
+
+/*
+ * value_new_to_copy_map -- copies into the allocated value, or nothing if it
+ * could not be allocated
+ */
+static void
+value_new_to_copy_map(struct future_context *value_new_ctx,
+	struct future_context *copy_ctx, void *arg)
+{
+	struct hashmap_value_new_output *value_new_output =
+		future_context_get_output(value_new_ctx);
+	struct vdm_operation_data *copy_data =
+		future_context_get_data(copy_ctx);
+	struct vdm_operation_data_memcpy *memcpy_data =
+		&copy_data->operation.data.memcpy;
+
+	if (value_new_output->value == NULL) {
+		/* the operation is still started, to be deleted */
+		memcpy_data->dest = memcpy_data->src;
+		memcpy_data->n = 0;
+	} else {
+		memcpy_data->dest = value_new_output->addr;
+	}
+}
+
+/*
+ * insert_init -- initializes the insertion of the copied value, or completes
+ * it right away if the value wasn't allocated or copied
+ */
+static void
+insert_init(void *future, struct future_context *put_ctx, void *arg)
+{
+	struct hashmap_put_data *data = future_context_get_data(put_ctx);
+	struct hashmap_value *value = data->value_new.fut.output.value;
+
+	struct hashmap_insert_future fut;
+	fut.data.hm = arg;
+	fut.data.key = data->insert.fut.data.key;
+	fut.data.value = value;
+	fut.output.result = value == NULL ? HASHMAP_ERROR_OUT_OF_MEMORY :
+		hashmap_copy_result(&data->copy.fut);
+
+	if (fut.output.result == HASHMAP_SUCCESS) {
+		FUTURE_INIT(&fut, hashmap_insert_impl);
+	} else {
+		if (value != NULL)
+			hashmap_value_release(value);
+		FUTURE_INIT_COMPLETE(&fut);
+	}
+
+	memcpy(future, &fut, sizeof(fut));
+}
+
+/*
+ * insert_to_output_map -- maps the result of the insertion to the output of
+ * the put future
+ */
+static void
+insert_to_output_map(struct future_context *insert_ctx,
+	struct future_context *put_ctx, void *arg)
+{
+	struct hashmap_insert_output *insert_output =
+		future_context_get_output(insert_ctx);
+	struct hashmap_put_output *put_output =
+		future_context_get_output(put_ctx);
+
+	put_output->result = insert_output->result;
+}
+
+/*
+ * hashmap_put -- creates a future inserting the key with a copy of the value,
+ * made by the data mover
+ */
+struct hashmap_put_future
+hashmap_put(struct vdm *vdm, struct hashmap *hm, uint64_t key,
+	const void *value, size_t size)
+{
+	struct hashmap_put_future chain;
+
+	struct hashmap_value_new_future value_new;
+	value_new.data.size = size;
+	value_new.output.value = NULL;
+	value_new.output.addr = NULL;
+	FUTURE_INIT(&value_new, hashmap_value_new_impl);
+
+	FUTURE_CHAIN_ENTRY_INIT(&chain.data.value_new, value_new,
+		value_new_to_copy_map, NULL);
+	FUTURE_CHAIN_ENTRY_INIT(&chain.data.copy,
+		vdm_memcpy(vdm, NULL, (void *)value, size, 0), NULL, NULL);
+	/* the key waits in the insert future until it's initialized */
+	chain.data.insert.fut.data.key = key;
+	FUTURE_CHAIN_ENTRY_LAZY_INIT(&chain.data.insert, insert_init, hm,
+		insert_to_output_map, NULL);
+	chain.output.result = HASHMAP_SUCCESS;
+
+	FUTURE_CHAIN_INIT(&chain);
+
+	return chain;
+}
+
+/*
+ * acquire_to_copy_map -- copies the acquired value into the buffer, or
+ * nothing if the key wasn't found
+ */
+static void
+acquire_to_copy_map(struct future_context *acquire_ctx,
+	struct future_context *copy_ctx, void *arg)
+{
+	struct hashmap_acquire_output *acquire_output =
+		future_context_get_output(acquire_ctx);
+	struct vdm_operation_data *copy_data =
+		future_context_get_data(copy_ctx);
+	struct vdm_operation_data_memcpy *memcpy_data =
+		&copy_data->operation.data.memcpy;
+	size_t buf_size = (size_t)(uintptr_t)arg;
+
+	if (acquire_output->value == NULL) {
+		/* the operation is still started, to be deleted */
+		memcpy_data->src = memcpy_data->dest;
+		memcpy_data->n = 0;
+	} else {
+		memcpy_data->src = acquire_output->addr;
+		memcpy_data->n = acquire_output->size < buf_size ?
+			acquire_output->size : buf_size;
+	}
+}
+
+/*
+ * release_init -- initializes the release of the copied value, or completes
+ * it right away if the key wasn't found
+ */
+static void
+release_init(void *future, struct future_context *get_ctx, void *arg)
+{
+	struct hashmap_get_data *data = future_context_get_data(get_ctx);
+
+	struct hashmap_release_future fut;
+	fut.data.value = data->acquire.fut.output.value;
+	fut.output.unused = 0;
+	if (fut.data.value != NULL) {
+		FUTURE_INIT(&fut, hashmap_release_impl);
+	} else {
+		FUTURE_INIT_COMPLETE(&fut);
+	}
+
+	memcpy(future, &fut, sizeof(fut));
+}
+
+/*
+ * release_to_output_map -- maps the results of the entries to the output of
+ * the get future
+ */
+static void
+release_to_output_map(struct future_context *release_ctx,
+	struct future_context *get_ctx, void *arg)
+{
+	struct hashmap_get_data *data = future_context_get_data(get_ctx);
+	struct hashmap_get_output *output = future_context_get_output(get_ctx);
+	struct hashmap_acquire_output *acquire_output =
+		&data->acquire.fut.output;
+
+	if (acquire_output->value == NULL) {
+		output->result = HASHMAP_ERROR_KEY_NOT_FOUND;
+		return;
+	}
+
+	output->result = hashmap_copy_result(&data->copy.fut);
+	output->size = acquire_output->size;
+	if (output->result == HASHMAP_SUCCESS) {
+		output->copy_size =
+			data->copy.fut.data.operation.data.memcpy.n;
+	}
+}
+
+/*
+ * hashmap_get -- creates a future copying the value of the key into
+ * the buffer, up to its size, by the data mover
+ */
+struct hashmap_get_future
+hashmap_get(struct vdm *vdm, struct hashmap *hm, uint64_t key, void *buf,
+	size_t size)
+{
+	struct hashmap_get_future chain;
+
+	struct hashmap_acquire_future acquire;
+	acquire.data.hm = hm;
+	acquire.data.key = key;
+	acquire.output.value = NULL;
+	acquire.output.addr = NULL;
+	acquire.output.size = 0;
+	FUTURE_INIT(&acquire, hashmap_acquire_impl);
+
+	FUTURE_CHAIN_ENTRY_INIT(&chain.data.acquire, acquire,
+		acquire_to_copy_map, (void *)(uintptr_t)size);
+	FUTURE_CHAIN_ENTRY_INIT(&chain.data.copy,
+		vdm_memcpy(vdm, buf, NULL, 0, 0), NULL, NULL);
+	FUTURE_CHAIN_ENTRY_LAZY_INIT(&chain.data.release, release_init, NULL,
+		release_to_output_map, NULL);
+	chain.output.result = HASHMAP_SUCCESS;
+	chain.output.size = 0;
+	chain.output.copy_size = 0;
+
+	FUTURE_CHAIN_INIT(&chain);
+
+	return chain;
+}
+
+/*
+ * hashmap_remove -- creates a future removing the key
+ */
+struct hashmap_remove_future
+hashmap_remove(struct hashmap *hm, uint64_t key)
+{
+	struct hashmap_remove_future future;
+	future.data.hm = hm;
+	future.data.key = key;
+	future.output.result = HASHMAP_SUCCESS;
+
+	FUTURE_INIT(&future, hashmap_remove_impl);
+
+	return future;
+}
+
+/*
+ * The batched operations look the keys up shard by shard, each shard locked
+ * once for all of its keys, with the home buckets of the keys prefetched
+ * before the first of them is probed. The values are copied by the data
+ * mover in a single submission, after the lookups for the gets, and before
+ * the insertions for the puts.
+ */
+enum hashmap_batch_stage {
+	HASHMAP_BATCH_LOOKUP, /* the values of the keys to get are acquired */
+	HASHMAP_BATCH_COPY,
+	HASHMAP_BATCH_INSERT, /* the copied values are inserted */
+};
+
+struct hashmap_batch_op {
+	uint64_t hash;
+	struct hashmap_value *value; /* referenced, or NULL */
+	struct vdm_operation_future copy;
+};
+
+struct hashmap_batch {
+	enum hashmap_batch_stage stage;
+	uint64_t pending; /* shards whose keys are yet to be looked up */
+	size_t begins[HASHMAP_NSHARDS]; /* of the keys of each shard in order */
+	size_t *order; /* the indexes of the keys, grouped by their shard */
+	struct vdm_operation_future **copies;
+	size_t ncopies;
+	struct hashmap_batch_op ops[];
+};
+
+typedef void (*hashmap_batch_fn)(struct hashmap_shard *shard,
+	struct hashmap_batch_entry *entry, struct hashmap_batch_op *op);
+
+/*
+ * hashmap_batch_new -- (internal) allocates the state of the batched
+ * operation, with its keys grouped by their shard
+ */
+static struct hashmap_batch *
+hashmap_batch_new(struct hashmap_batch_data *data)
+{
+	COMPILE_ERROR_ON(HASHMAP_NSHARDS > 64);
+
+	size_t n = data->n;
+	struct hashmap_batch *batch = malloc(sizeof(struct hashmap_batch) +
+		n * (sizeof(struct hashmap_batch_op) +
+		sizeof(struct vdm_operation_future *) + sizeof(size_t)));
+	if (batch == NULL)
+		return NULL;
+
+	batch->copies = (struct vdm_operation_future **)&batch->ops[n];
+	batch->order = (size_t *)&batch->copies[n];
+	batch->ncopies = 0;
+	batch->stage = HASHMAP_BATCH_LOOKUP;
+	batch->pending = 0;
+	memset(batch->begins, 0, sizeof(batch->begins));
+
+	for (size_t i = 0; i < n; i++) {
+		struct hashmap_batch_op *op = &batch->ops[i];
+		op->hash = hashmap_hash(data->entries[i].key);
+		op->value = NULL;
+		data->entries[i].result = HASHMAP_SUCCESS;
+		data->entries[i].value_size = 0;
+
+		unsigned s = hashmap_shard_index(op->hash);
+		batch->begins[s]++;
+		batch->pending |= 1ULL << s;
+	}
+
+	/* a stable counting sort, which keeps the keys of a shard in order */
+	for (unsigned s = 1; s < HASHMAP_NSHARDS; s++)
+		batch->begins[s] += batch->begins[s - 1];
+	for (size_t i = n; i-- > 0; ) {
+		unsigned s = hashmap_shard_index(batch->ops[i].hash);
+		batch->order[--batch->begins[s]] = i;
+	}
+
+	return batch;
+}
+
+/*
+ * hashmap_batch_lookup -- (internal) calls fn for each key of the batch,
+ * with its shard locked, returns 0 once all the shards are done
+ *
+ * The shards locked by the other threads are skipped, and retried by
+ * the next call.
+ */
+static int
+hashmap_batch_lookup(struct hashmap_batch_data *data, hashmap_batch_fn fn)
+{
+	struct hashmap_batch *batch = data->batch;
+
+	uint64_t pending = batch->pending;
+	while (pending != 0) {
+		unsigned s = util_lssb_index64(pending);
+		pending &= pending - 1;
+
+		struct hashmap_shard *shard = &data->hm->shards[s].shard;
+		if (!hashmap_shard_trylock(shard))
+			continue;
+
+		hashmap_shard_migrate(shard, HASHMAP_MIGRATE_STEP);
+
+		size_t begin = batch->begins[s];
+		size_t end = s + 1 < HASHMAP_NSHARDS ?
+			batch->begins[s + 1] : data->n;
+		struct hashmap_table *table = shard->table;
+		struct hashmap_table *old = shard->old;
+		for (size_t i = begin; i < end; i++) {
+			uint64_t hash = batch->ops[batch->order[i]].hash;
+			util_prefetch(&table->buckets[hash &
+				(table->nbuckets - 1)]);
+			if (old != NULL) {
+				util_prefetch(&old->buckets[hash &
+					(old->nbuckets - 1)]);
+			}
+		}
+
+		for (size_t i = begin; i < end; i++) {
+			size_t k = batch->order[i];
+			fn(shard, &data->entries[k], &batch->ops[k]);
+		}
+
+		hashmap_shard_unlock(shard);
+		batch->pending &= ~(1ULL << s);
+	}
+
+	return batch->pending != 0;
+}
+
+/*
+ * hashmap_batch_copy -- (internal) submits the copies of the batch to
+ * the data mover at once
+ */
+static void
+hashmap_batch_copy(struct hashmap_batch_data *data)
+{
+	struct hashmap_batch *batch = data->batch;
+
+	/* the ones which could not be started are started by their polling */
+	vdm_submit_batch(data->vdm, batch->copies, batch->ncopies);
+	batch->stage = HASHMAP_BATCH_COPY;
+}
+
+/*
+ * hashmap_batch_copied -- (internal) polls the copies of the batch, returns 0
+ * once all of them are complete
+ */
+static int
+hashmap_batch_copied(struct hashmap_batch *batch)
+{
+	int running = 0;
+	for (size_t i = 0; i < batch->ncopies; i++) {
+		running |= future_poll(FUTURE_AS_RUNNABLE(batch->copies[i]),
+			NULL) != FUTURE_STATE_COMPLETE;
+	}
+
+	return running;
+}
+
+/*
+ * hashmap_batch_complete -- (internal) counts the succeeded keys of the batch
+ * and frees its state
+ */
+static enum future_state
+hashmap_batch_complete(struct hashmap_batch_data *data,
+	struct hashmap_batch_output *output)
+{
+	output->nsucceeded = 0;
+	struct hashmap_batch_entry *entries = data->entries;
+	for (size_t i = 0; i < data->n; i++)
+		output->nsucceeded += entries[i].result == HASHMAP_SUCCESS;
+
+	free(data->batch);
+	data->batch = NULL;
+
+	return FUTURE_STATE_COMPLETE;
+}
+
+/*
+ * hashmap_batch_start -- (internal) allocates the state of the batch, or
+ * fails all of its keys if it could not be allocated
+ */
+static int
+hashmap_batch_start(struct hashmap_batch_data *data)
+{
+	if ((data->batch = hashmap_batch_new(data)) != NULL)
+		return 0;
+
+	for (size_t i = 0; i < data->n; i++) {
+		data->entries[i].result = HASHMAP_ERROR_OUT_OF_MEMORY;
+		data->entries[i].value_size = 0;
+	}
+
+	return -1;
+}
+
+/*
+ * get_batch_acquire -- acquires the value of the key to get
+ */
+static void
+get_batch_acquire(struct hashmap_shard *shard,
+	struct hashmap_batch_entry *entry, struct hashmap_batch_op *op)
+{
+	op->value = hashmap_shard_acquire(shard, entry->key, op->hash);
+}
+
+/*
+ * hashmap_get_batch_impl -- looks all the keys up, then copies their values
+ * into the buffers
+ */
+static enum future_state
+hashmap_get_batch_impl(struct future_context *ctx,
+	struct future_notifier *notifier)
+{
+	if (notifier)
+		notifier->notifier_used = FUTURE_NOTIFIER_NONE;
+
+	struct hashmap_batch_data *data = future_context_get_data(ctx);
+	struct hashmap_batch_output *output = future_context_get_output(ctx);
+
+	if (data->batch == NULL && hashmap_batch_start(data) != 0) {
+		output->nsucceeded = 0;
+		return FUTURE_STATE_COMPLETE;
+	}
+
+	struct hashmap_batch *batch = data->batch;
+	if (batch->stage == HASHMAP_BATCH_LOOKUP) {
+		if (hashmap_batch_lookup(data, get_batch_acquire) != 0)
+			return FUTURE_STATE_RUNNING;
+
+		for (size_t i = 0; i < data->n; i++) {
+			struct hashmap_batch_entry *entry = &data->entries[i];
+			struct hashmap_batch_op *op = &batch->ops[i];
+			if (op->value == NULL)
+				continue;
+
+			size_t n = op->value->size < entry->size ?
+				op->value->size : entry->size;
+			op->copy = vdm_memcpy(data->vdm, entry->buf,
+				HASHMAP_VALUE_ADDR(op->value), n, 0);
+			batch->copies[batch->ncopies++] = &op->copy;
+		}
+		hashmap_batch_copy(data);
+	}
+
+	if (hashmap_batch_copied(batch) != 0)
+		return FUTURE_STATE_RUNNING;
+
+	for (size_t i = 0; i < data->n; i++) {
+		struct hashmap_batch_entry *entry = &data->entries[i];
+		struct hashmap_batch_op *op = &batch->ops[i];
+		if (op->value == NULL) {
+			entry->result = HASHMAP_ERROR_KEY_NOT_FOUND;
+			continue;
+		}
+
+		entry->result = hashmap_copy_result(&op->copy);
+		entry->value_size = op->value->size;
+		hashmap_value_release(op->value);
+	}
+
+	return hashmap_batch_complete(data, output);
+}
+
+/*
+ * put_batch_insert -- inserts the copied value of the key to put
+ */
+static void
+put_batch_insert(struct hashmap_shard *shard,
+	struct hashmap_batch_entry *entry, struct hashmap_batch_op *op)
+{
+	if (op->value == NULL)
+		return;
+
+	/* the resize has to keep up with the keys of the batch */
+	hashmap_shard_migrate(shard, HASHMAP_MIGRATE_STEP);
+	entry->result = hashmap_shard_insert(shard, entry->key, op->hash,
+		op->value);
+	if (entry->result != HASHMAP_SUCCESS)
+		hashmap_value_release(op->value);
+}
+
+/*
+ * hashmap_put_batch_impl -- copies all the values, then inserts them with
+ * their keys
+ */
+static enum future_state
+hashmap_put_batch_impl(struct future_context *ctx,
+	struct future_notifier *notifier)
+{
+	if (notifier)
+		notifier->notifier_used = FUTURE_NOTIFIER_NONE;
+
+	struct hashmap_batch_data *data = future_context_get_data(ctx);
+	struct hashmap_batch_output *output = future_context_get_output(ctx);
+
+	if (data->batch == NULL) {
+		if (hashmap_batch_start(data) != 0) {
+			output->nsucceeded = 0;
+			return FUTURE_STATE_COMPLETE;
+		}
+
+		struct hashmap_batch *batch = data->batch;
+		for (size_t i = 0; i < data->n; i++) {
+			struct hashmap_batch_entry *entry = &data->entries[i];
+			struct hashmap_batch_op *op = &batch->ops[i];
+			op->value = malloc(sizeof(struct hashmap_value) +
+				entry->size);
+			if (op->value == NULL) {
+				entry->result = HASHMAP_ERROR_OUT_OF_MEMORY;
+				continue;
+			}
+
+			op->value->refs = 1;
+			op->value->size = entry->size;
+			op->copy = vdm_memcpy(data->vdm,
+				HASHMAP_VALUE_ADDR(op->value), entry->buf,
+				entry->size, 0);
+			batch->copies[batch->ncopies++] = &op->copy;
+		}
+		hashmap_batch_copy(data);
+	}
+
+	struct hashmap_batch *batch = data->batch;
+	if (batch->stage == HASHMAP_BATCH_COPY) {
+		if (hashmap_batch_copied(batch) != 0)
+			return FUTURE_STATE_RUNNING;
+
+		for (size_t i = 0; i < data->n; i++) {
+			struct hashmap_batch_entry *entry = &data->entries[i];
+			struct hashmap_batch_op *op = &batch->ops[i];
+			if (op->value == NULL)
+				continue;
+
+			entry->result = hashmap_copy_result(&op->copy);
+			if (entry->result != HASHMAP_SUCCESS) {
+				hashmap_value_release(op->value);
+				op->value = NULL;
+			}
+		}
+		batch->stage = HASHMAP_BATCH_INSERT;
+	}
+
+	if (hashmap_batch_lookup(data, put_batch_insert) != 0)
+		return FUTURE_STATE_RUNNING;
+
+	return hashmap_batch_complete(data, output);
+}
+
+/*
+ * hashmap_batch_init -- (internal) initializes the future of a batched
+ * operation
+ */
+static struct hashmap_batch_future
+hashmap_batch_init(struct vdm *vdm, struct hashmap *hm,
+	struct hashmap_batch_entry *entries, size_t n, future_task_fn task)
+{
+	struct hashmap_batch_future future;
+	future.data.vdm = vdm;
+	future.data.hm = hm;
+	future.data.entries = entries;
+	future.data.n = n;
+	future.data.batch = NULL;
+	future.output.nsucceeded = 0;
+
+	FUTURE_INIT(&future, task);
+
+	return future;
+}
+
+/*
+ * hashmap_put_batch -- creates a future inserting the keys of the entries
+ * with copies of their values, made by the data mover in a single batch
+ */
+struct hashmap_batch_future
+hashmap_put_batch(struct vdm *vdm, struct hashmap *hm,
+	struct hashmap_batch_entry *entries, size_t n)
+{
+	return hashmap_batch_init(vdm, hm, entries, n, hashmap_put_batch_impl);
+}
+
+/*
+ * hashmap_get_batch -- creates a future copying the values of the keys of
+ * the entries into their buffers, by the data mover in a single batch
+ */
+struct hashmap_batch_future
+hashmap_get_batch(struct vdm *vdm, struct hashmap *hm,
+	struct hashmap_batch_entry *entries, size_t n)
+{
+	return hashmap_batch_init(vdm, hm, entries, n, hashmap_get_batch_impl);
+}
@@ -15,7 +15,14 @@
 #include "libminiasync/vdm.h"
 #include "libminiasync/data_mover_threads.h"
 #include "libminiasync/data_mover_sync.h"
+#include "libminiasync/data_mover_router.h"
+#include "libminiasync/data_mover_trace.h"
+#include "libminiasync/data_mover_dsa.h"
+#include "libminiasync/data_mover_uring.h"
+#include "libminiasync/data_mover_shm.h"
 #include "libminiasync/runtime.h"
+#include "libminiasync/future_arena.h"
+#include "libminiasync/hashmap.h"
 
 #ifdef __cplusplus
 extern "C" {
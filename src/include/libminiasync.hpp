@@ -0,0 +1,601 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * libminiasync.hpp -- header-only C++ layer over libminiasync (C++17)
+ *
+ * The futures are composed as templates, instead of the chain entries laid
+ * out in memory by the C macros. Every composed future is a class, whose
+ * layout is known at the compile time, and whose poll() is an inline member
+ * function calling the poll() of its parts directly. Only the C futures at
+ * the leaves, e.g. the ones of the virtual data movers, are polled through
+ * their task function pointers, so the compiler can flatten a whole pipeline
+ * into a single state machine.
+ *
+ * A C++ future is any class with the following members:
+ * - enum future_state poll(struct future_notifier *notifier), which has
+ *   the semantics of future_poll(), and is safe to call once it's complete,
+ * - output(), which returns the output, once the future is complete.
+ *
+ * The C futures are wrapped with wrap(), composed sequentially with then(),
+ * concurrently with join(), and the result is handed over to the runtime
+ * with runnable. If the compiler supports C++20 coroutines, the futures can
+ * also be awaited by the coroutines of the task<T> type, which are futures
+ * themselves, and so can the vdm_operation_future returned by the virtual
+ * data mover operations.
+ */
+
+#ifndef LIBMINIASYNC_HPP
+#define LIBMINIASYNC_HPP 1
+
+#include <array>
+#include <cstddef>
+#include <exception>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L &&\
+	__has_include(<coroutine>)
+#include <coroutine>
+#define MINIASYNC_HAS_COROUTINES 1
+#endif
+
+#include "libminiasync.h"
+
+namespace miniasync
+{
+
+/*
+ * c_future -- a C future, defined with the FUTURE() macro, polled with
+ * future_poll()
+ */
+template <typename F>
+class c_future {
+public:
+	using future_type = F;
+	using output_type = decltype(F::output);
+
+	explicit c_future(const F &fut) noexcept : fut(fut)
+	{
+	}
+
+	enum future_state
+	poll(struct future_notifier *notifier) noexcept
+	{
+		return future_poll(FUTURE_AS_RUNNABLE(&fut), notifier);
+	}
+
+	output_type &
+	output() noexcept
+	{
+		return fut.output;
+	}
+
+	F &
+	get() noexcept
+	{
+		return fut;
+	}
+
+private:
+	F fut;
+};
+
+/*
+ * wrap -- wraps the C future, e.g. the one returned by vdm_memcpy()
+ */
+template <typename F>
+c_future<F>
+wrap(const F &fut) noexcept
+{
+	return c_future<F>(fut);
+}
+
+/*
+ * ready_future -- a future complete from the start, with the given output
+ */
+template <typename T>
+class ready_future {
+public:
+	using output_type = T;
+
+	explicit ready_future(T value) : value(std::move(value))
+	{
+	}
+
+	enum future_state
+	poll(struct future_notifier *notifier) noexcept
+	{
+		(void) notifier;
+		return FUTURE_STATE_COMPLETE;
+	}
+
+	T &
+	output() noexcept
+	{
+		return value;
+	}
+
+private:
+	T value;
+};
+
+/*
+ * ready -- creates a future complete with the given output, e.g. to end
+ * a chain with a value computed from the outputs of the previous futures
+ */
+template <typename T>
+ready_future<std::decay_t<T>>
+ready(T &&value)
+{
+	return ready_future<std::decay_t<T>>(std::forward<T>(value));
+}
+
+/*
+ * chain_future -- polls the first future until it's complete, and then
+ * the future created from its output by the given function
+ *
+ * Both futures share the storage, only one of them exists at a time.
+ */
+template <typename A, typename Fn>
+class chain_future {
+public:
+	using input_type = decltype(std::declval<A &>().output());
+	using next_type = std::invoke_result_t<Fn &, input_type>;
+
+	chain_future(A first, Fn fn) :
+		state(std::in_place_index<0>, std::move(first)),
+		fn(std::move(fn))
+	{
+	}
+
+	enum future_state
+	poll(struct future_notifier *notifier)
+	{
+		A *first = std::get_if<0>(&state);
+		if (first != nullptr) {
+			if (first->poll(notifier) != FUTURE_STATE_COMPLETE)
+				return FUTURE_STATE_RUNNING;
+
+			next_type next = fn(first->output());
+			state.template emplace<1>(std::move(next));
+		}
+
+		return std::get_if<1>(&state)->poll(notifier);
+	}
+
+	decltype(auto)
+	output() noexcept
+	{
+		return std::get_if<1>(&state)->output();
+	}
+
+private:
+	std::variant<A, next_type> state;
+	Fn fn;
+};
+
+/*
+ * then -- chains the future with the function creating the next future
+ * from its output
+ */
+template <typename A, typename Fn>
+chain_future<std::decay_t<A>, std::decay_t<Fn>>
+then(A &&first, Fn &&fn)
+{
+	return chain_future<std::decay_t<A>, std::decay_t<Fn>>(
+		std::forward<A>(first), std::forward<Fn>(fn));
+}
+
+/*
+ * join_future -- polls all the futures together, until all of them are
+ * complete, the output is the tuple of the references to their outputs
+ */
+template <typename... Fs>
+class join_future {
+public:
+	explicit join_future(Fs... futs) : futs(std::move(futs)...)
+	{
+		done.fill(false);
+	}
+
+	enum future_state
+	poll(struct future_notifier *notifier)
+	{
+		/* each future gets the notifier the join was polled with */
+		struct future_notifier polled;
+		struct future_notifier joined;
+		if (notifier != nullptr)
+			polled = *notifier;
+
+		int running = 0;
+		poll_all(notifier, polled, joined, running,
+			std::index_sequence_for<Fs...>{});
+
+		if (running == 0)
+			return FUTURE_STATE_COMPLETE;
+
+		if (notifier != nullptr)
+			*notifier = joined;
+
+		return FUTURE_STATE_RUNNING;
+	}
+
+	auto
+	output() noexcept
+	{
+		return outputs(std::index_sequence_for<Fs...>{});
+	}
+
+	template <std::size_t I>
+	auto &
+	get() noexcept
+	{
+		return std::get<I>(futs);
+	}
+
+private:
+	template <std::size_t I>
+	void
+	poll_one(struct future_notifier *notifier,
+		const struct future_notifier &polled,
+		struct future_notifier &joined, int &running)
+	{
+		if (done[I])
+			return;
+
+		struct future_notifier entry_notifier;
+		if (notifier != nullptr)
+			entry_notifier = polled;
+
+		if (std::get<I>(futs).poll(notifier != nullptr ?
+				&entry_notifier : nullptr) ==
+				FUTURE_STATE_COMPLETE) {
+			done[I] = true;
+			return;
+		}
+
+		if (notifier != nullptr)
+			future_join_notifier(&joined, &entry_notifier,
+				running == 0);
+		running++;
+	}
+
+	template <std::size_t... Is>
+	void
+	poll_all(struct future_notifier *notifier,
+		const struct future_notifier &polled,
+		struct future_notifier &joined, int &running,
+		std::index_sequence<Is...>)
+	{
+		(poll_one<Is>(notifier, polled, joined, running), ...);
+	}
+
+	template <std::size_t... Is>
+	auto
+	outputs(std::index_sequence<Is...>) noexcept
+	{
+		return std::forward_as_tuple(std::get<Is>(futs).output()...);
+	}
+
+	std::tuple<Fs...> futs;
+	std::array<bool, sizeof...(Fs)> done;
+};
+
+/*
+ * join -- joins the futures, which don't depend on each other
+ */
+template <typename... Fs>
+join_future<std::decay_t<Fs>...>
+join(Fs &&...futs)
+{
+	return join_future<std::decay_t<Fs>...>(std::forward<Fs>(futs)...);
+}
+
+/*
+ * runnable -- a C future, which polls the C++ future, to be handed over to
+ * the runtime, e.g. runtime_wait(r, fut.get())
+ *
+ * The C++ future is kept in the data of the C future, which has no output.
+ */
+template <typename T>
+class runnable {
+public:
+	static_assert(alignof(T) <= alignof(struct future),
+		"the data of a future has to follow its context");
+
+	explicit runnable(T fut) : data(std::move(fut))
+	{
+		base.task = &runnable::task;
+		base.has_property = future_has_property_default;
+		base.context.state = FUTURE_STATE_IDLE;
+		base.context.data_size = sizeof(T);
+		base.context.output_size = 0;
+		base.context.resume_offset = 0;
+		base.context.properties = 0;
+	}
+
+	runnable(const runnable &) = delete;
+	runnable &operator=(const runnable &) = delete;
+
+	struct future *
+	get() noexcept
+	{
+		return &base;
+	}
+
+	enum future_state
+	state() const noexcept
+	{
+		return base.context.state;
+	}
+
+	decltype(auto)
+	output() noexcept
+	{
+		return data.output();
+	}
+
+private:
+	static enum future_state
+	task(struct future_context *context, struct future_notifier *notifier)
+	{
+		T *fut = static_cast<T *>(future_context_get_data(context));
+		return fut->poll(notifier);
+	}
+
+	struct future base;
+	T data;
+};
+
+#ifdef MINIASYNC_HAS_COROUTINES
+
+namespace detail
+{
+
+/*
+ * awaited -- the future a coroutine is suspended on, polled by its task
+ */
+struct awaited {
+	void *fut = nullptr;
+	enum future_state (*poll)(void *fut,
+		struct future_notifier *notifier) = nullptr;
+};
+
+} /* namespace detail */
+
+/*
+ * awaiter -- suspends the coroutine of a task until the future is complete,
+ * the future is kept in the frame of the coroutine
+ */
+template <typename F>
+class awaiter {
+public:
+	explicit awaiter(F fut) : fut(std::move(fut))
+	{
+	}
+
+	bool
+	await_ready() const noexcept
+	{
+		/* the future is polled by the task, with its notifier */
+		return false;
+	}
+
+	template <typename P>
+	void
+	await_suspend(std::coroutine_handle<P> handle) noexcept
+	{
+		detail::awaited &current = handle.promise().current;
+		current.fut = &fut;
+		current.poll = &awaiter::poll;
+	}
+
+	decltype(auto)
+	await_resume() noexcept
+	{
+		return fut.output();
+	}
+
+private:
+	static enum future_state
+	poll(void *fut, struct future_notifier *notifier)
+	{
+		return static_cast<F *>(fut)->poll(notifier);
+	}
+
+	F fut;
+};
+
+template <typename T = void>
+class task;
+
+namespace detail
+{
+
+template <typename T>
+using task_output = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+template <typename T>
+struct task_promise_base {
+	awaited current;
+	std::optional<task_output<T>> value;
+
+	std::suspend_always
+	initial_suspend() const noexcept
+	{
+		return {};
+	}
+
+	std::suspend_always
+	final_suspend() const noexcept
+	{
+		return {};
+	}
+
+	void
+	unhandled_exception() const noexcept
+	{
+		std::terminate();
+	}
+
+	task<T> get_return_object() noexcept;
+};
+
+template <typename T>
+struct task_promise : task_promise_base<T> {
+	void
+	return_value(T value)
+	{
+		this->value.emplace(std::move(value));
+	}
+};
+
+template <>
+struct task_promise<void> : task_promise_base<void> {
+	void
+	return_void() noexcept
+	{
+		this->value.emplace();
+	}
+};
+
+} /* namespace detail */
+
+/*
+ * task -- a coroutine, which is a future completing with the value it
+ * returns, started on its first poll
+ *
+ * Each poll resumes the coroutine until it's suspended on a future which
+ * is not complete yet, which is polled with the notifier of the task.
+ */
+template <typename T>
+class task {
+public:
+	using promise_type = detail::task_promise<T>;
+	using output_type = detail::task_output<T>;
+
+	explicit task(std::coroutine_handle<promise_type> handle) noexcept :
+		handle(handle)
+	{
+	}
+
+	task(task &&other) noexcept :
+		handle(std::exchange(other.handle, nullptr))
+	{
+	}
+
+	task &
+	operator=(task &&other) noexcept
+	{
+		if (this != &other) {
+			if (handle)
+				handle.destroy();
+			handle = std::exchange(other.handle, nullptr);
+		}
+		return *this;
+	}
+
+	~task()
+	{
+		if (handle)
+			handle.destroy();
+	}
+
+	enum future_state
+	poll(struct future_notifier *notifier)
+	{
+		if (handle.done())
+			return FUTURE_STATE_COMPLETE;
+
+		detail::awaited &current = handle.promise().current;
+		for (;;) {
+			if (current.poll != nullptr) {
+				if (current.poll(current.fut, notifier) !=
+						FUTURE_STATE_COMPLETE)
+					return FUTURE_STATE_RUNNING;
+				current.poll = nullptr;
+			}
+
+			handle.resume();
+			if (handle.done())
+				return FUTURE_STATE_COMPLETE;
+		}
+	}
+
+	output_type &
+	output() noexcept
+	{
+		return *handle.promise().value;
+	}
+
+	awaiter<task>
+	operator co_await() && noexcept
+	{
+		return awaiter<task>(std::move(*this));
+	}
+
+private:
+	std::coroutine_handle<promise_type> handle;
+};
+
+template <typename T>
+task<T>
+detail::task_promise_base<T>::get_return_object() noexcept
+{
+	return task<T>(std::coroutine_handle<task_promise<T>>::from_promise(
+		static_cast<task_promise<T> &>(*this)));
+}
+
+template <typename F>
+awaiter<c_future<F>>
+operator co_await(c_future<F> &&fut) noexcept
+{
+	return awaiter<c_future<F>>(std::move(fut));
+}
+
+template <typename T>
+awaiter<ready_future<T>>
+operator co_await(ready_future<T> &&fut)
+{
+	return awaiter<ready_future<T>>(std::move(fut));
+}
+
+template <typename A, typename Fn>
+awaiter<chain_future<A, Fn>>
+operator co_await(chain_future<A, Fn> &&fut)
+{
+	return awaiter<chain_future<A, Fn>>(std::move(fut));
+}
+
+template <typename... Fs>
+awaiter<join_future<Fs...>>
+operator co_await(join_future<Fs...> &&fut)
+{
+	return awaiter<join_future<Fs...>>(std::move(fut));
+}
+
+#endif /* MINIASYNC_HAS_COROUTINES */
+
+} /* namespace miniasync */
+
+#ifdef MINIASYNC_HAS_COROUTINES
+
+/*
+ * operator co_await -- awaits the operation of a virtual data mover, e.g.
+ * co_await vdm_memcpy(vdm, dest, src, n, 0), within a miniasync::task
+ */
+inline miniasync::awaiter<miniasync::c_future<struct vdm_operation_future>>
+operator co_await(struct vdm_operation_future &&fut) noexcept
+{
+	return miniasync::awaiter<
+		miniasync::c_future<struct vdm_operation_future>>(
+		miniasync::wrap(fut));
+}
+
+#endif /* MINIASYNC_HAS_COROUTINES */
+
+#endif /* LIBMINIASYNC_HPP */
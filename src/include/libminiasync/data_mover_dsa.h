@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2022, Intel Corporation */
+
+#ifndef DATA_MOVER_DSA_H
+#define DATA_MOVER_DSA_H
+
+#include "vdm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct data_mover_dsa;
+
+struct data_mover_dsa *data_mover_dsa_new(const char *wq_path);
+
+struct vdm *data_mover_dsa_get_vdm(struct data_mover_dsa *dsa);
+
+void data_mover_dsa_get_membuf_stats(struct data_mover_dsa *dsa,
+	struct vdm_membuf_stats *stats);
+
+void data_mover_dsa_delete(struct data_mover_dsa *dsa);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* DATA_MOVER_DSA_H */
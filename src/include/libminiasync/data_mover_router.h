@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2022, Intel Corporation */
+
+#ifndef DATA_MOVER_ROUTER_H
+#define DATA_MOVER_ROUTER_H
+
+#include "vdm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DATA_MOVER_ROUTER_MAX_ROUTES 8
+
+struct data_mover_router;
+
+struct data_mover_router *data_mover_router_new(void);
+
+int data_mover_router_add(struct data_mover_router *dmr, struct vdm *vdm,
+	size_t min_size, size_t max_inflight);
+
+struct vdm *data_mover_router_get_vdm(struct data_mover_router *dmr);
+
+size_t data_mover_router_get_inflight(struct data_mover_router *dmr,
+	struct vdm *vdm);
+
+void data_mover_router_get_membuf_stats(struct data_mover_router *dmr,
+	struct vdm_membuf_stats *stats);
+
+void data_mover_router_delete(struct data_mover_router *dmr);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* DATA_MOVER_ROUTER_H */
@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2022, Intel Corporation */
+
+#ifndef DATA_MOVER_SHM_H
+#define DATA_MOVER_SHM_H
+
+#include "vdm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct data_mover_shm_service;
+
+struct data_mover_shm_service *data_mover_shm_service_new(const char *path,
+	size_t data_size, unsigned nslots, size_t nthreads,
+	const unsigned *cpus, size_t ncpus);
+void data_mover_shm_service_delete(struct data_mover_shm_service *svc);
+
+struct data_mover_shm;
+
+struct data_mover_shm *data_mover_shm_new(const char *path);
+void *data_mover_shm_get_data(struct data_mover_shm *shm, size_t *size);
+struct vdm *data_mover_shm_get_vdm(struct data_mover_shm *shm);
+void data_mover_shm_get_membuf_stats(struct data_mover_shm *shm,
+	struct vdm_membuf_stats *stats);
+void data_mover_shm_delete(struct data_mover_shm *shm);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* DATA_MOVER_SHM_H */
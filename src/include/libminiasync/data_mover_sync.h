@@ -16,6 +16,9 @@ struct data_mover_sync *data_mover_sync_new(void);
 
 struct vdm *data_mover_sync_get_vdm(struct data_mover_sync *dms);
 
+void data_mover_sync_get_membuf_stats(struct data_mover_sync *dms,
+	struct vdm_membuf_stats *stats);
+
 void data_mover_sync_delete(struct data_mover_sync *dms);
 
 #ifdef __cplusplus
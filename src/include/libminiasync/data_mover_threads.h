@@ -20,8 +20,16 @@ typedef void *(*memset_fn)(void *str, int c, size_t n,
 struct data_mover_threads;
 struct data_mover_threads *data_mover_threads_new(size_t nthreads,
 	size_t ringbuf_size, enum future_notifier_type desired_notifier);
+struct data_mover_threads *data_mover_threads_new_cpus(size_t nthreads,
+	size_t ringbuf_size, enum future_notifier_type desired_notifier,
+	const unsigned *cpus, size_t ncpus);
+struct data_mover_threads *data_mover_threads_new_elastic(size_t min_threads,
+	size_t max_threads, size_t ringbuf_size,
+	enum future_notifier_type desired_notifier);
 struct data_mover_threads *data_mover_threads_default();
 struct vdm *data_mover_threads_get_vdm(struct data_mover_threads *dmt);
+void data_mover_threads_get_membuf_stats(struct data_mover_threads *dmt,
+	struct vdm_membuf_stats *stats);
 void data_mover_threads_delete(struct data_mover_threads *dmt);
 void data_mover_threads_set_memcpy_fn(struct data_mover_threads *dmt,
 	memcpy_fn op_memcpy);
@@ -29,6 +37,37 @@ void data_mover_threads_set_memmove_fn(struct data_mover_threads *dmt,
 	memmove_fn op_memmove);
 void data_mover_threads_set_memset_fn(struct data_mover_threads *dmt,
 	memset_fn op_memset);
+void data_mover_threads_set_chunk_size(struct data_mover_threads *dmt,
+	size_t chunk_size);
+void data_mover_threads_set_inline_threshold(struct data_mover_threads *dmt,
+	size_t threshold);
+void data_mover_threads_set_spin_count(struct data_mover_threads *dmt,
+	uint64_t spin_count);
+void data_mover_threads_set_idle_timeout(struct data_mover_threads *dmt,
+	uint64_t timeout);
+void data_mover_threads_set_bandwidth_limit(struct data_mover_threads *dmt,
+	uint64_t bytes_per_sec, uint64_t burst);
+void data_mover_threads_set_shared_completion(struct data_mover_threads *dmt,
+	int shared);
+int data_mover_threads_set_lanes(struct data_mover_threads *dmt, size_t nlanes,
+	size_t lane_size);
+
+enum data_mover_threads_pages {
+	DATA_MOVER_THREADS_PAGES_NORMAL,
+	DATA_MOVER_THREADS_PAGES_TRANSPARENT_HUGE,
+	DATA_MOVER_THREADS_PAGES_HUGETLB,
+};
+
+int data_mover_threads_set_membuf(struct data_mover_threads *dmt, size_t size,
+	enum data_mover_threads_pages pages);
+void data_mover_threads_set_membuf_limit(struct data_mover_threads *dmt,
+	size_t max_buffers);
+
+#define DATA_MOVER_THREADS_NODE_ANY (-1)
+#define DATA_MOVER_THREADS_NODE_LOCAL (-2)
+
+void data_mover_threads_set_membuf_node(struct data_mover_threads *dmt,
+	int node);
 
 #ifdef __cplusplus
 }
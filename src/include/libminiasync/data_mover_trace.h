@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2022, Intel Corporation */
+
+#ifndef DATA_MOVER_TRACE_H
+#define DATA_MOVER_TRACE_H
+
+#include <stdio.h>
+#include "vdm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the histograms are kept for each type, size bucket and phase */
+#define DATA_MOVER_TRACE_TYPES (VDM_OPERATION_PWRITE + 1)
+#define DATA_MOVER_TRACE_SIZE_BUCKETS 8
+/* bucket i counts the latencies of [2^i, 2^(i+1)) nanoseconds */
+#define DATA_MOVER_TRACE_LATENCY_BUCKETS 32
+
+enum data_mover_trace_phase {
+	DATA_MOVER_TRACE_QUEUE, /* from op_new to op_start */
+	DATA_MOVER_TRACE_EXECUTE, /* from op_start to the completion */
+	DATA_MOVER_TRACE_REAP, /* from the completion to op_check noticing it */
+
+	DATA_MOVER_TRACE_PHASES
+};
+
+/* the timestamps are in the nanoseconds of runtime_clock_now() */
+struct data_mover_trace_record {
+	enum vdm_operation_type type;
+	size_t size;
+	uint64_t created;
+	uint64_t started;
+	uint64_t completed; /* 0 - the data mover can't report it */
+	uint64_t reaped;
+};
+
+typedef void (*data_mover_trace_hook)(
+	const struct data_mover_trace_record *record, void *arg);
+
+struct data_mover_trace;
+
+struct data_mover_trace *data_mover_trace_new(struct vdm *vdm);
+
+struct vdm *data_mover_trace_get_vdm(struct data_mover_trace *dmtr);
+
+void data_mover_trace_set_hook(struct data_mover_trace *dmtr,
+	data_mover_trace_hook hook, void *arg);
+
+size_t data_mover_trace_size_bucket(size_t size);
+
+void data_mover_trace_get_histogram(struct data_mover_trace *dmtr,
+	enum vdm_operation_type type, size_t size_bucket,
+	enum data_mover_trace_phase phase,
+	uint64_t counts[DATA_MOVER_TRACE_LATENCY_BUCKETS]);
+
+int data_mover_trace_dump(struct data_mover_trace *dmtr, FILE *stream);
+
+void data_mover_trace_reset(struct data_mover_trace *dmtr);
+
+void data_mover_trace_delete(struct data_mover_trace *dmtr);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* DATA_MOVER_TRACE_H */
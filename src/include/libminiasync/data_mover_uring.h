@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2022, Intel Corporation */
+
+#ifndef DATA_MOVER_URING_H
+#define DATA_MOVER_URING_H
+
+#include "vdm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct data_mover_uring;
+
+struct data_mover_uring *data_mover_uring_new(unsigned entries,
+	enum future_notifier_type desired_notifier);
+int data_mover_uring_register_buffers(struct data_mover_uring *dmu,
+	const struct vdm_iov *bufs, size_t cnt);
+struct vdm *data_mover_uring_get_vdm(struct data_mover_uring *dmu);
+void data_mover_uring_get_membuf_stats(struct data_mover_uring *dmu,
+	struct vdm_membuf_stats *stats);
+void data_mover_uring_delete(struct data_mover_uring *dmu);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* DATA_MOVER_URING_H */
@@ -56,6 +56,27 @@
  * a `map` function to map the state of the just-completed future onto the next
  * future state. Applications can use the map function of the last future in
  * a chain to map its output to the output of the entire chain.
+ *
+ * An entry whose output is just passed on can be bound instead to a field of
+ * the data of the next future, or of the output of the chain for the last
+ * entry. The output is then copied into that field by the chain itself,
+ * without calling any map function.
+ *
+ * Futures that don't depend on each other can be composed into a "join"
+ * future instead. Its entries are laid out like the ones of a chain, but
+ * they are all started on the first poll and polled together, until all
+ * of them are complete. The map function of each entry maps the state of
+ * its future onto the state of the join future.
+ *
+ * The "select" future also polls all its entries together, but only the
+ * first one to complete is mapped onto the state of the select future.
+ * The other ones are canceled, if they can be, and polled until complete.
+ *
+ * The "loop" future performs its only entry again and again, initializing
+ * it in place each time, until the entry's `again` function says it's done.
+ *
+ * Chains whose entries are known only at run time can be built in an arena,
+ * a buffer provided by the application, by appending the futures to it.
  */
 
 #ifndef FUTURE_H
@@ -63,6 +84,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #if defined(__x86_64__) || defined(__amd64__) || defined(_M_X64) || \
 	defined(_M_AMD64)
@@ -88,9 +110,14 @@ struct future_context {
 	size_t data_size;
 	size_t output_size;
 	enum future_state state;
-	uint32_t padding;
+	/* offset of the data of the chain futures they resume polling at */
+	uint32_t resume_offset : 24;
+	/* properties known so far, see future_has_property() */
+	uint32_t properties : 8;
 };
 
+#define FUTURE_RESUME_OFFSET_MAX ((((size_t)1) << 24) - 1)
+
 typedef void (*future_waker_wake_fn)(void *data);
 
 struct future_waker {
@@ -98,6 +125,9 @@ struct future_waker {
 	future_waker_wake_fn wake;
 };
 
+/*
+ * The monitored value has to remain zero until the future can make progress.
+ */
 struct future_poller {
 	uint64_t *ptr_to_monitor;
 };
@@ -119,6 +149,18 @@ enum future_property {
 	FUTURE_PROPERTY_ASYNC,
 };
 
+/*
+ * The properties of a future are cached in its context, in two bits each:
+ * one set once the property is known, and one set if the property is set.
+ * The properties of the futures composed of others are updated when they
+ * are polled, as their running entries change.
+ */
+#define FUTURE_PROPERTY_KNOWN(_property)\
+((uint32_t)1 << (2 * (unsigned)(_property)))
+#define FUTURE_PROPERTY_SET(_property)\
+((uint32_t)1 << (2 * (unsigned)(_property) + 1))
+#define FUTURE_PROPERTIES_KNOWN_MASK ((uint32_t)0x55)
+
 static inline void *
 future_context_get_data(struct future_context *context)
 {
@@ -166,7 +208,8 @@ do {\
 	(_futurep)->base.context.data_size = sizeof((_futurep)->data);\
 	(_futurep)->base.context.output_size =\
 		sizeof((_futurep)->output);\
-	(_futurep)->base.context.padding = 0;\
+	(_futurep)->base.context.resume_offset = 0;\
+	(_futurep)->base.context.properties = 0;\
 } while (0)
 
 #define FUTURE_INIT(_futurep, _taskfn)\
@@ -180,7 +223,8 @@ do {\
 	(_futurep)->base.context.data_size = sizeof((_futurep)->data);\
 	(_futurep)->base.context.output_size =\
 		sizeof((_futurep)->output);\
-	(_futurep)->base.context.padding = 0;\
+	(_futurep)->base.context.resume_offset = 0;\
+	(_futurep)->base.context.properties = 0;\
 } while (0)
 
 #define FUTURE_AS_RUNNABLE(futurep) (&(futurep)->base)
@@ -204,8 +248,9 @@ struct future_chain_entry {
 
 #define FUTURE_CHAIN_FLAG_ENTRY_LAST		(((uint64_t)1) << 0)
 #define FUTURE_CHAIN_FLAG_ENTRY_PROCESSED	(((uint64_t)1) << 1)
+#define FUTURE_CHAIN_FLAG_ENTRY_BOUND		(((uint64_t)1) << 2)
 #define FUTURE_CHAIN_VALID_FLAGS (FUTURE_CHAIN_FLAG_ENTRY_LAST |\
-	FUTURE_CHAIN_FLAG_ENTRY_PROCESSED)
+	FUTURE_CHAIN_FLAG_ENTRY_PROCESSED | FUTURE_CHAIN_FLAG_ENTRY_BOUND)
 
 enum future_chain_entry_type {
 	FUTURE_CHAIN_ENTRY_REGULAR = 1,
@@ -256,6 +301,29 @@ do {\
 		FUTURE_CHAIN_ENTRY_LAST ? FUTURE_CHAIN_FLAG_ENTRY_LAST : 0);\
 } while (0)
 
+/*
+ * The offset of the bound field is kept in place of the map argument, so that
+ * the binding remains valid when the chain is moved.
+ */
+#define _FUTURE_CHAIN_ENTRY_BIND(_entry, _fieldp, _basep)\
+do {\
+	(void) sizeof(char[sizeof(*(_fieldp)) ==\
+		sizeof((_entry)->fut.output) ? 1 : -1]);\
+	(_entry)->map = NULL;\
+	(_entry)->map_arg = (void *)(uintptr_t)\
+		((char *)(_fieldp) - (char *)(_basep));\
+	(_entry)->flags = (void *)((uintptr_t)(_entry)->flags |\
+		FUTURE_CHAIN_FLAG_ENTRY_BOUND);\
+} while (0)
+
+#define FUTURE_CHAIN_ENTRY_BIND(_entry, _next, _field)\
+_FUTURE_CHAIN_ENTRY_BIND((_entry), &(_next)->fut.data._field,\
+	&(_next)->fut.data)
+
+#define FUTURE_CHAIN_ENTRY_BIND_OUTPUT(_entry, _futurep, _field)\
+_FUTURE_CHAIN_ENTRY_BIND((_entry), &(_futurep)->output._field,\
+	&(_futurep)->output)
+
 #define FUTURE_CHAIN_ENTRY_HAS_FLAG(_entry, _flag)\
 (((_entry)->flags & (_flag)) == (_flag))
 
@@ -268,6 +336,9 @@ FUTURE_CHAIN_ENTRY_HAS_FLAG(_entry, FUTURE_CHAIN_FLAG_ENTRY_PROCESSED)
 #define FUTURE_CHAIN_ENTRY_IS_INITIALIZED(_entry)\
 ((_entry)->init == NULL)
 
+#define FUTURE_CHAIN_ENTRY_IS_BOUND(_entry)\
+FUTURE_CHAIN_ENTRY_HAS_FLAG(_entry, FUTURE_CHAIN_FLAG_ENTRY_BOUND)
+
 /*
  * TODO: Notifiers have to be copied into the state of the future, so we might
  * consider just passing it by copy here... Needs to be evaluated for
@@ -286,12 +357,40 @@ future_poll(struct future *fut, struct future_notifier *notifier)
 /*
  * future_has_property -- returns 1 if a property is set and 0 otherwise.
  * It's an abstract implementation, which works for both regular and
- * chained futures.
+ * chained futures. The has_property function of the future is called only
+ * if the property isn't cached in its context yet.
  */
 static inline int
 future_has_property(struct future *fut, enum future_property property)
 {
-	return fut->has_property(fut, property);
+	uint32_t properties = fut->context.properties;
+	if (properties & FUTURE_PROPERTY_KNOWN(property))
+		return (properties & FUTURE_PROPERTY_SET(property)) != 0;
+
+	int ret = fut->has_property(fut, property);
+	if (ret >= 0)
+		fut->context.properties |= FUTURE_PROPERTY_KNOWN(property) |
+			(ret ? FUTURE_PROPERTY_SET(property) : 0);
+
+	return ret;
+}
+
+/*
+ * future_properties_any -- (internal) merges the cached properties of
+ * a running entry into the ones of a join or select future, which has
+ * a property if any of its running entries has it
+ */
+static inline uint32_t
+future_properties_any(uint32_t merged, uint32_t entry, int first)
+{
+	if (first)
+		return entry;
+
+	/* a property is set only if it's known */
+	uint32_t set = (merged | entry) & ~FUTURE_PROPERTIES_KNOWN_MASK;
+	uint32_t known = merged & entry & FUTURE_PROPERTIES_KNOWN_MASK;
+
+	return known | (set >> 1) | set;
 }
 
 #define FUTURE_BUSY_POLL(_futurep)\
@@ -331,47 +430,94 @@ get_next_future_chain_entry(struct future_context *ctx,
 	return next;
 }
 
+/*
+ * future_chain_resume_entry -- returns the entry of the chain the polling
+ * was left at, all the entries before it are processed
+ */
+static inline struct future_chain_entry *
+future_chain_resume_entry(struct future_context *ctx, size_t *used_data)
+{
+	uint8_t *data = (uint8_t *)future_context_get_data(ctx);
+
+	*used_data = ctx->resume_offset;
+
+	return (struct future_chain_entry *)(data + *used_data);
+}
+
+/*
+ * future_chain_entry_map -- maps the state of the completed entry onto
+ * the state of the next entry, or of the chain or join future if there is
+ * no next entry
+ */
+static inline void
+future_chain_entry_map(struct future_chain_entry *entry,
+		struct future_chain_entry *next, struct future_context *ctx)
+{
+	struct future_context *entry_ctx = &entry->future.context;
+
+	if (FUTURE_CHAIN_ENTRY_IS_BOUND(entry)) {
+		uint8_t *base = (uint8_t *)(next ?
+			future_context_get_data(&next->future.context) :
+			future_context_get_output(ctx));
+		memcpy(base + (uintptr_t)entry->map_arg,
+			future_context_get_output(entry_ctx),
+			entry_ctx->output_size);
+	} else {
+		entry->map(entry_ctx, next ? &next->future.context : ctx,
+			entry->map_arg);
+	}
+}
+
 static inline enum future_state
 async_chain_impl(struct future_context *ctx, struct future_notifier *notifier)
 {
 	uint8_t *data = (uint8_t *)future_context_get_data(ctx);
 
-	struct future_chain_entry *entry = (struct future_chain_entry *)(data);
-	size_t used_data = 0;
+	size_t used_data;
+	struct future_chain_entry *entry =
+		future_chain_resume_entry(ctx, &used_data);
 
 	/*
-	 * This will iterate to the first non-complete future in the chain
+	 * This will iterate to the first non-complete future in the chain,
+	 * starting from the one the previous poll was left at,
 	 * and then call poll it once.
 	 * Futures must be laid out sequentially in memory for this to work.
 	 */
 	while (entry != NULL) {
+		/* the entries past 16 MiB of data are reached by walking */
+		if (used_data <= FUTURE_RESUME_OFFSET_MAX)
+			ctx->resume_offset = (uint32_t)used_data;
+
 		struct future_chain_entry *next =
 			get_next_future_chain_entry(ctx, entry,
 						data, &used_data);
 		if (!FUTURE_CHAIN_ENTRY_IS_PROCESSED(entry)) {
 			if (future_poll(&entry->future, notifier) ==
 			    FUTURE_STATE_COMPLETE) {
-				if (entry->map) {
+				if (entry->map ||
+				    FUTURE_CHAIN_ENTRY_IS_BOUND(entry)) {
 					if (next && next->init) {
 						next->init(&next->future, ctx,
 							next->init_arg);
 						next->init = NULL;
 					}
-					entry->map(&entry->future.context,
-							next ?
-							&next->future.context
-							: ctx,
-							entry->map_arg);
+					future_chain_entry_map(entry, next,
+						ctx);
 				}
 				entry->flags |=
 					FUTURE_CHAIN_FLAG_ENTRY_PROCESSED;
 			} else {
+				/* the chain has the properties of the entry */
+				ctx->properties =
+					entry->future.context.properties;
 				return FUTURE_STATE_RUNNING;
 			}
 		}
 		entry = next;
 	}
 
+	ctx->properties = 0;
+
 	return FUTURE_STATE_COMPLETE;
 }
 
@@ -391,17 +537,17 @@ future_chain_has_property(void *future, enum future_property property)
 	struct future *fut = (struct future *)future;
 	struct future_context *ctx = &fut->context;
 	uint8_t *data = (uint8_t *)future_context_get_data(ctx);
-	struct future_chain_entry *entry = (struct future_chain_entry *)(data);
 
-	size_t used_data = 0;
+	size_t used_data;
+	struct future_chain_entry *entry =
+		future_chain_resume_entry(ctx, &used_data);
 
 	while (entry != NULL) {
 		struct future_chain_entry *next =
 			get_next_future_chain_entry(ctx, entry,
 						data, &used_data);
 		if (!FUTURE_CHAIN_ENTRY_IS_PROCESSED(entry)) {
-			if ((entry->future.has_property(&entry->future,
-						property)))
+			if (future_has_property(&entry->future, property) > 0)
 				return 1;
 			return 0;
 		}
@@ -414,6 +560,596 @@ future_chain_has_property(void *future, enum future_property property)
 #define FUTURE_CHAIN_INIT(_futurep)\
 FUTURE_INIT_EXT((_futurep), async_chain_impl, future_chain_has_property)
 
+#define FUTURE_JOIN_ENTRY(_future_type, _name)\
+FUTURE_CHAIN_ENTRY(_future_type, _name)
+
+#define FUTURE_JOIN_ENTRY_LAST(_future_type, _name)\
+FUTURE_CHAIN_ENTRY_LAST(_future_type, _name)
+
+#define FUTURE_JOIN_ENTRY_INIT(_entry, _fut, _map, _map_arg)\
+FUTURE_CHAIN_ENTRY_INIT((_entry), (_fut), (_map), (_map_arg))
+
+#define FUTURE_JOIN_ENTRY_LAZY_INIT(_entry, _init, _init_arg, _map, _map_arg)\
+FUTURE_CHAIN_ENTRY_LAZY_INIT((_entry), (_init), (_init_arg), (_map),\
+	(_map_arg))
+
+#define FUTURE_JOIN_ENTRY_BIND_OUTPUT(_entry, _futurep, _field)\
+FUTURE_CHAIN_ENTRY_BIND_OUTPUT((_entry), (_futurep), _field)
+
+/*
+ * future_join_notifier -- merges the notifier used by a running entry of
+ * the join future into the notifier of the join future, which can be
+ * relied on only if all the running entries can
+ */
+static inline void
+future_join_notifier(struct future_notifier *joined,
+		const struct future_notifier *entry, int first)
+{
+	if (first) {
+		*joined = *entry;
+		return;
+	}
+
+	switch (entry->notifier_used) {
+		case FUTURE_NOTIFIER_NONE:
+			joined->notifier_used = FUTURE_NOTIFIER_NONE;
+			break;
+		case FUTURE_NOTIFIER_WAKER:
+			/* the other entries are monitored or busy polled */
+			break;
+		case FUTURE_NOTIFIER_POLLER:
+			if (joined->notifier_used == FUTURE_NOTIFIER_WAKER) {
+				joined->notifier_used = FUTURE_NOTIFIER_POLLER;
+				joined->poller = entry->poller;
+			} else if (joined->notifier_used ==
+					FUTURE_NOTIFIER_POLLER &&
+				    joined->poller.ptr_to_monitor !=
+					entry->poller.ptr_to_monitor) {
+				/* only one address can be monitored */
+				joined->notifier_used = FUTURE_NOTIFIER_NONE;
+			}
+			break;
+	}
+}
+
+static inline enum future_state
+async_join_impl(struct future_context *ctx, struct future_notifier *notifier)
+{
+	uint8_t *data = (uint8_t *)future_context_get_data(ctx);
+
+	struct future_chain_entry *entry = (struct future_chain_entry *)(data);
+	size_t used_data = 0;
+	int running = 0;
+	uint32_t properties = 0;
+
+	/* each entry gets the notifier the join future was polled with */
+	struct future_notifier polled;
+	struct future_notifier joined;
+	if (notifier != NULL)
+		polled = *notifier;
+
+	while (entry != NULL) {
+		struct future_chain_entry *next =
+			get_next_future_chain_entry(ctx, entry,
+						data, &used_data);
+		if (!FUTURE_CHAIN_ENTRY_IS_PROCESSED(entry)) {
+			struct future_notifier entry_notifier;
+			if (notifier != NULL)
+				entry_notifier = polled;
+
+			if (future_poll(&entry->future, notifier != NULL ?
+			    &entry_notifier : NULL) ==
+			    FUTURE_STATE_COMPLETE) {
+				if (entry->map ||
+				    FUTURE_CHAIN_ENTRY_IS_BOUND(entry))
+					future_chain_entry_map(entry, NULL,
+						ctx);
+				entry->flags |=
+					FUTURE_CHAIN_FLAG_ENTRY_PROCESSED;
+			} else {
+				if (notifier != NULL)
+					future_join_notifier(&joined,
+						&entry_notifier, running == 0);
+				properties = future_properties_any(properties,
+					entry->future.context.properties,
+					running == 0);
+				running++;
+			}
+		}
+		entry = next;
+	}
+
+	ctx->properties = properties;
+	if (running == 0)
+		return FUTURE_STATE_COMPLETE;
+
+	if (notifier != NULL)
+		*notifier = joined;
+
+	return FUTURE_STATE_RUNNING;
+}
+
+static inline int
+future_join_has_property(void *future, enum future_property property)
+{
+	struct future *fut = (struct future *)future;
+	struct future_context *ctx = &fut->context;
+	uint8_t *data = (uint8_t *)future_context_get_data(ctx);
+	struct future_chain_entry *entry = (struct future_chain_entry *)(data);
+
+	size_t used_data = 0;
+	int running = 0;
+
+	/* the property is set if any of the running entries has it */
+	while (entry != NULL) {
+		struct future_chain_entry *next =
+			get_next_future_chain_entry(ctx, entry,
+						data, &used_data);
+		if (!FUTURE_CHAIN_ENTRY_IS_PROCESSED(entry)) {
+			if (future_has_property(&entry->future, property) > 0)
+				return 1;
+			running++;
+		}
+		entry = next;
+	}
+
+	return running ? 0 : -1;
+}
+
+#define FUTURE_JOIN_INIT(_futurep)\
+FUTURE_INIT_EXT((_futurep), async_join_impl, future_join_has_property)
+
+/*
+ * Requests the cancellation of the future, which has to be polled until
+ * complete anyway, returns -1 if it can't be canceled.
+ */
+typedef int (*future_cancel_fn)(void *future);
+
+struct future_select_entry {
+	future_map_fn map;
+	void *map_arg;
+	future_cancel_fn cancel;
+	uint64_t flags;
+	struct future future;
+};
+
+/* the first entry to complete, the chain flags are also used */
+#define FUTURE_SELECT_FLAG_ENTRY_WON		(((uint64_t)1) << 2)
+#define FUTURE_SELECT_FLAG_ENTRY_CANCELED	(((uint64_t)1) << 3)
+
+#define FUTURE_SELECT_ENTRY(_future_type, _name)\
+struct {\
+	future_map_fn map;\
+	void *map_arg;\
+	future_cancel_fn cancel;\
+	_future_entry_type_regular *flags;\
+	_future_type fut;\
+} _name
+
+#define FUTURE_SELECT_ENTRY_LAST(_future_type, _name)\
+struct {\
+	future_map_fn map;\
+	void *map_arg;\
+	future_cancel_fn cancel;\
+	_future_entry_type_last *flags;\
+	_future_type fut;\
+} _name
+
+#define FUTURE_SELECT_ENTRY_INIT(_entry, _fut, _map, _map_arg, _cancel)\
+do {\
+	(_entry)->fut = (_fut);\
+	(_entry)->map = (_map);\
+	(_entry)->map_arg = (_map_arg);\
+	(_entry)->cancel = (_cancel);\
+	(_entry)->flags = (void *)(sizeof(*(_entry)->flags) ==\
+		FUTURE_CHAIN_ENTRY_LAST ? FUTURE_CHAIN_FLAG_ENTRY_LAST : 0);\
+} while (0)
+
+static inline struct future_select_entry *
+get_next_future_select_entry(struct future_context *ctx,
+		struct future_select_entry *entry, uint8_t *data,
+		size_t *used_data)
+{
+#define _MINIASYNC_PTRSIZE sizeof(void *)
+#define _MINIASYNC_ALIGN_UP(size)\
+	(((size) + _MINIASYNC_PTRSIZE - 1) & ~(_MINIASYNC_PTRSIZE - 1))
+
+	/* laid out like the chain entries, see get_next_future_chain_entry */
+	*used_data += _MINIASYNC_ALIGN_UP(
+			sizeof(struct future_select_entry) +
+			future_context_get_size(&entry->future.context));
+	struct future_select_entry *next = NULL;
+	if (!FUTURE_CHAIN_ENTRY_IS_LAST(entry) &&
+		*used_data != ctx->data_size) {
+		next = (struct future_select_entry *)(data + *used_data);
+	}
+
+#undef _MINIASYNC_PTRSIZE
+#undef _MINIASYNC_ALIGN_UP
+
+	return next;
+}
+
+/*
+ * future_select_poll_entries -- (internal) polls the entries of the select
+ * future which aren't complete yet, sets *won if one of them won just now,
+ * returns the number of the running ones
+ */
+static inline int
+future_select_poll_entries(struct future_context *ctx,
+		struct future_notifier *notifier, int *won)
+{
+	uint8_t *data = (uint8_t *)future_context_get_data(ctx);
+
+	struct future_select_entry *entry =
+		(struct future_select_entry *)(data);
+	size_t used_data = 0;
+	int running = 0;
+	int complete = 0;
+	uint32_t properties = 0;
+	struct future_select_entry *first = NULL;
+
+	/* each entry gets the notifier the select future was polled with */
+	struct future_notifier polled;
+	struct future_notifier joined;
+	if (notifier != NULL)
+		polled = *notifier;
+
+	while (entry != NULL) {
+		struct future_select_entry *next =
+			get_next_future_select_entry(ctx, entry,
+						data, &used_data);
+		if (FUTURE_CHAIN_ENTRY_HAS_FLAG(entry,
+		    FUTURE_SELECT_FLAG_ENTRY_WON))
+			complete = 1;
+		if (!FUTURE_CHAIN_ENTRY_IS_PROCESSED(entry)) {
+			struct future_notifier entry_notifier;
+			if (notifier != NULL)
+				entry_notifier = polled;
+
+			if (future_poll(&entry->future, notifier != NULL ?
+			    &entry_notifier : NULL) ==
+			    FUTURE_STATE_COMPLETE) {
+				entry->flags |=
+					FUTURE_CHAIN_FLAG_ENTRY_PROCESSED;
+				if (first == NULL)
+					first = entry;
+			} else {
+				if (notifier != NULL)
+					future_join_notifier(&joined,
+						&entry_notifier, running == 0);
+				properties = future_properties_any(properties,
+					entry->future.context.properties,
+					running == 0);
+				running++;
+			}
+		}
+		entry = next;
+	}
+	ctx->properties = properties;
+
+	/* the winner might be further than the entries completed just now */
+	if (!complete && first != NULL) {
+		if (first->map)
+			first->map(&first->future.context, ctx,
+				first->map_arg);
+		first->flags |= FUTURE_SELECT_FLAG_ENTRY_WON;
+		*won = 1;
+	}
+
+	if (running != 0 && notifier != NULL)
+		*notifier = joined;
+
+	return running;
+}
+
+/*
+ * future_select_cancel_entries -- (internal) requests the cancellation of
+ * the entries which aren't complete yet, returns the number of the ones
+ * canceled just now
+ */
+static inline int
+future_select_cancel_entries(struct future_context *ctx)
+{
+	uint8_t *data = (uint8_t *)future_context_get_data(ctx);
+	struct future_select_entry *entry =
+		(struct future_select_entry *)(data);
+
+	size_t used_data = 0;
+	int canceled = 0;
+
+	while (entry != NULL) {
+		struct future_select_entry *next =
+			get_next_future_select_entry(ctx, entry,
+						data, &used_data);
+		if (!FUTURE_CHAIN_ENTRY_IS_PROCESSED(entry) &&
+		    !FUTURE_CHAIN_ENTRY_HAS_FLAG(entry,
+			FUTURE_SELECT_FLAG_ENTRY_CANCELED) &&
+		    entry->cancel != NULL &&
+		    entry->cancel(&entry->future) == 0) {
+			entry->flags |= FUTURE_SELECT_FLAG_ENTRY_CANCELED;
+			canceled++;
+		}
+		entry = next;
+	}
+
+	return canceled;
+}
+
+/*
+ * future_select_cancel -- requests the cancellation of all the entries of
+ * the select future which aren't complete yet, returns -1 if none of them
+ * could be canceled
+ *
+ * The select future has to be polled until complete anyway. If none of its
+ * entries completed before the cancellation, the first one to complete,
+ * canceled or not, is still the winner.
+ */
+static inline int
+future_select_cancel(void *future)
+{
+	struct future *fut = (struct future *)future;
+
+	return future_select_cancel_entries(&fut->context) ? 0 : -1;
+}
+
+static inline enum future_state
+async_select_impl(struct future_context *ctx, struct future_notifier *notifier)
+{
+	struct future_notifier polled;
+	if (notifier != NULL)
+		polled = *notifier;
+
+	int won = 0;
+	int running = future_select_poll_entries(ctx, notifier, &won);
+
+	/* the canceled losers might be complete already */
+	if (won && running != 0 && future_select_cancel_entries(ctx) != 0) {
+		if (notifier != NULL)
+			*notifier = polled;
+		running = future_select_poll_entries(ctx, notifier, &won);
+	}
+
+	return running ? FUTURE_STATE_RUNNING : FUTURE_STATE_COMPLETE;
+}
+
+static inline int
+future_select_has_property(void *future, enum future_property property)
+{
+	struct future *fut = (struct future *)future;
+	struct future_context *ctx = &fut->context;
+	uint8_t *data = (uint8_t *)future_context_get_data(ctx);
+	struct future_select_entry *entry =
+		(struct future_select_entry *)(data);
+
+	size_t used_data = 0;
+	int running = 0;
+
+	/* the property is set if any of the running entries has it */
+	while (entry != NULL) {
+		struct future_select_entry *next =
+			get_next_future_select_entry(ctx, entry,
+						data, &used_data);
+		if (!FUTURE_CHAIN_ENTRY_IS_PROCESSED(entry)) {
+			if (future_has_property(&entry->future, property) > 0)
+				return 1;
+			running++;
+		}
+		entry = next;
+	}
+
+	return running ? 0 : -1;
+}
+
+/*
+ * future_select_winner -- returns the index of the entry of the select
+ * future which completed first, or -1 if none of them is complete yet
+ */
+static inline int
+future_select_winner(struct future *fut)
+{
+	struct future_context *ctx = &fut->context;
+	uint8_t *data = (uint8_t *)future_context_get_data(ctx);
+	struct future_select_entry *entry =
+		(struct future_select_entry *)(data);
+
+	size_t used_data = 0;
+
+	for (int i = 0; entry != NULL; ++i) {
+		if (FUTURE_CHAIN_ENTRY_HAS_FLAG(entry,
+		    FUTURE_SELECT_FLAG_ENTRY_WON))
+			return i;
+		entry = get_next_future_select_entry(ctx, entry,
+			data, &used_data);
+	}
+
+	return -1;
+}
+
+#define FUTURE_SELECT_INIT(_futurep)\
+FUTURE_INIT_EXT((_futurep), async_select_impl, future_select_has_property)
+
+/*
+ * Returns nonzero if the entry of the loop future has to be performed
+ * again, once it's complete.
+ */
+typedef int (*future_loop_fn)(struct future_context *entry,
+			struct future_context *loop_fut, void *arg);
+
+struct future_loop_entry {
+	future_init_fn init;
+	void *init_arg;
+	future_loop_fn again;
+	void *again_arg;
+	uint64_t flags;
+	struct future future;
+};
+
+/* the future of the entry is initialized */
+#define FUTURE_LOOP_FLAG_ENTRY_ARMED	(((uint64_t)1) << 0)
+
+/* the entry has to be the first member of the data of the loop future */
+#define FUTURE_LOOP_ENTRY(_future_type, _name)\
+struct {\
+	future_init_fn init;\
+	void *init_arg;\
+	future_loop_fn again;\
+	void *again_arg;\
+	uint64_t flags;\
+	_future_type fut;\
+} _name
+
+#define FUTURE_LOOP_ENTRY_INIT(_entry, _init, _init_arg, _again, _again_arg)\
+do {\
+	(_entry)->init = (_init);\
+	(_entry)->init_arg = (_init_arg);\
+	(_entry)->again = (_again);\
+	(_entry)->again_arg = (_again_arg);\
+	(_entry)->flags = 0;\
+} while (0)
+
+/*
+ * future_loop_arm -- (internal) initializes the future of the entry of
+ * the loop future, unless it's already initialized
+ */
+static inline struct future_loop_entry *
+future_loop_arm(struct future_context *ctx)
+{
+	struct future_loop_entry *entry =
+		(struct future_loop_entry *)future_context_get_data(ctx);
+
+	if (!(entry->flags & FUTURE_LOOP_FLAG_ENTRY_ARMED)) {
+		entry->init(&entry->future, ctx, entry->init_arg);
+		entry->flags |= FUTURE_LOOP_FLAG_ENTRY_ARMED;
+	}
+
+	return entry;
+}
+
+static inline enum future_state
+async_loop_impl(struct future_context *ctx, struct future_notifier *notifier)
+{
+	struct future_loop_entry *entry = future_loop_arm(ctx);
+
+	if (future_poll(&entry->future, notifier) != FUTURE_STATE_COMPLETE) {
+		ctx->properties = entry->future.context.properties;
+		return FUTURE_STATE_RUNNING;
+	}
+
+	/* the future of the next iteration might have other properties */
+	ctx->properties = 0;
+	if (!entry->again(&entry->future.context, ctx, entry->again_arg))
+		return FUTURE_STATE_COMPLETE;
+
+	/*
+	 * The next iteration is started on the next poll, so that the futures
+	 * the entry might wait for, like the holders of a lock, can progress.
+	 */
+	entry->flags &= ~FUTURE_LOOP_FLAG_ENTRY_ARMED;
+	if (notifier != NULL)
+		notifier->notifier_used = FUTURE_NOTIFIER_NONE;
+
+	return FUTURE_STATE_RUNNING;
+}
+
+static inline int
+future_loop_has_property(void *future, enum future_property property)
+{
+	struct future *fut = (struct future *)future;
+	struct future_loop_entry *entry = future_loop_arm(&fut->context);
+
+	return future_has_property(&entry->future, property);
+}
+
+#define FUTURE_LOOP_INIT(_futurep)\
+FUTURE_INIT_EXT((_futurep), async_loop_impl, future_loop_has_property)
+
+/*
+ * The arena holds a chain future, followed by the entries appended to it.
+ * The chain future has no output, the map function of its last entry has to
+ * store the results elsewhere, e.g. in the place pointed by its argument.
+ */
+struct future_chain_arena {
+	struct future *chain;
+	size_t size; /* of the arena */
+};
+
+/*
+ * future_chain_arena_init -- places an empty chain future at the beginning
+ * of the arena of size bytes, aligned to a pointer, returns -1 if it's too
+ * small
+ */
+static inline int
+future_chain_arena_init(struct future_chain_arena *arena, void *buf,
+		size_t size)
+{
+	if (size < sizeof(struct future))
+		return -1;
+
+	struct future *chain = (struct future *)buf;
+	chain->task = async_chain_impl;
+	chain->has_property = future_chain_has_property;
+	chain->context.state = FUTURE_STATE_IDLE;
+	chain->context.data_size = 0;
+	chain->context.output_size = 0;
+	chain->context.resume_offset = 0;
+	chain->context.properties = 0;
+
+	arena->chain = chain;
+	arena->size = size;
+
+	return 0;
+}
+
+/*
+ * future_chain_arena_append -- copies the future of fut_size bytes into
+ * a new entry at the end of the chain in the arena, returns the copy,
+ * or NULL if the arena is full
+ *
+ * The entries can be appended only until the chain is polled.
+ */
+static inline void *
+future_chain_arena_append(struct future_chain_arena *arena, const void *fut,
+		size_t fut_size, future_map_fn map, void *map_arg)
+{
+#define _MINIASYNC_PTRSIZE sizeof(void *)
+#define _MINIASYNC_ALIGN_UP(size)\
+	(((size) + _MINIASYNC_PTRSIZE - 1) & ~(_MINIASYNC_PTRSIZE - 1))
+
+	struct future_context *ctx = &arena->chain->context;
+	const struct future *f = (const struct future *)fut;
+
+	/* laid out like the chain entries, see get_next_future_chain_entry */
+	size_t entry_size = _MINIASYNC_ALIGN_UP(
+			sizeof(struct future_chain_entry) +
+			future_context_get_size(
+				(struct future_context *)&f->context));
+	size_t used = sizeof(struct future) + ctx->data_size;
+
+#undef _MINIASYNC_PTRSIZE
+#undef _MINIASYNC_ALIGN_UP
+
+	if (offsetof(struct future_chain_entry, future) + fut_size >
+			entry_size || entry_size > arena->size - used)
+		return NULL;
+
+	struct future_chain_entry *entry =
+		(struct future_chain_entry *)((uint8_t *)arena->chain + used);
+	entry->map = map;
+	entry->map_arg = map_arg;
+	entry->init = NULL;
+	entry->init_arg = NULL;
+	entry->flags = 0;
+	memcpy(&entry->future, fut, fut_size);
+	ctx->data_size += entry_size;
+
+	return &entry->future;
+}
+
+#define FUTURE_CHAIN_ARENA_APPEND(_arena, _futurep, _map, _map_arg)\
+future_chain_arena_append((_arena), (_futurep), sizeof(*(_futurep)),\
+	(_map), (_map_arg))
+
 #ifdef __cplusplus
 }
 #endif
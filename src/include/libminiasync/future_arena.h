@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * future_arena.h -- per-thread allocator of the futures kept on the heap
+ *
+ * Futures are allocated linearly from the buffer of the allocating thread,
+ * and the freed ones are reused by the futures of the same size class,
+ * so that the futures created and retired in large numbers don't go
+ * through the system allocator. All of them are released at once when
+ * the arena is deleted.
+ */
+
+#ifndef FUTURE_ARENA_H
+#define FUTURE_ARENA_H 1
+
+#include "future.h"
+#include "vdm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct future_arena;
+
+struct future_arena *future_arena_new(size_t buffer_size);
+
+void *future_arena_alloc(struct future_arena *arena, size_t size);
+
+void *future_arena_dup(struct future_arena *arena, const void *fut,
+	size_t size);
+
+#define FUTURE_ARENA_DUP(_arena, _futurep)\
+future_arena_dup((_arena), (_futurep), sizeof(*(_futurep)))
+
+void future_arena_free(void *fut);
+
+void future_arena_get_stats(struct future_arena *arena,
+	struct vdm_membuf_stats *stats);
+
+void future_arena_delete(struct future_arena *arena);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* FUTURE_ARENA_H */
@@ -0,0 +1,182 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright 2022, Intel Corporation */
+
+/*
+ * hashmap.h -- concurrent hashmap of the values copied in and out of it
+ * by a data mover
+ *
+ * The keys are split into shards by their hash, and each shard is an open
+ * addressing table of cache line sized buckets behind its own lock. A shard
+ * which gets too full is resized incrementally: every operation on it moves
+ * a few buckets of the old table into the new one, so that no operation
+ * rehashes the whole table at once.
+ */
+
+#ifndef HASHMAP_H
+#define HASHMAP_H 1
+
+#include "future.h"
+#include "vdm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct hashmap;
+struct hashmap_value;
+
+enum hashmap_result {
+	HASHMAP_SUCCESS,
+	HASHMAP_ERROR_KEY_EXISTS,
+	HASHMAP_ERROR_KEY_NOT_FOUND,
+	HASHMAP_ERROR_OUT_OF_MEMORY,
+	HASHMAP_ERROR_COPY, /* the data mover failed to copy the value */
+};
+
+struct hashmap *hashmap_new(size_t capacity);
+
+void hashmap_delete(struct hashmap *hm);
+
+size_t hashmap_length(struct hashmap *hm);
+
+typedef void (*hashmap_cb)(uint64_t key, const void *value, size_t size,
+	void *arg);
+
+void hashmap_foreach(struct hashmap *hm, hashmap_cb cb, void *arg);
+
+/* the futures below are the entries of the chains of the operations */
+struct hashmap_value_new_data {
+	size_t size;
+};
+
+struct hashmap_value_new_output {
+	struct hashmap_value *value; /* NULL if it could not be allocated */
+	void *addr; /* of the data of the value */
+};
+
+FUTURE(hashmap_value_new_future, struct hashmap_value_new_data,
+	struct hashmap_value_new_output);
+
+struct hashmap_insert_data {
+	struct hashmap *hm;
+	uint64_t key;
+	struct hashmap_value *value;
+};
+
+struct hashmap_insert_output {
+	enum hashmap_result result;
+};
+
+FUTURE(hashmap_insert_future, struct hashmap_insert_data,
+	struct hashmap_insert_output);
+
+struct hashmap_acquire_data {
+	struct hashmap *hm;
+	uint64_t key;
+};
+
+struct hashmap_acquire_output {
+	struct hashmap_value *value; /* referenced, NULL if not found */
+	void *addr;
+	size_t size;
+};
+
+FUTURE(hashmap_acquire_future, struct hashmap_acquire_data,
+	struct hashmap_acquire_output);
+
+struct hashmap_release_data {
+	struct hashmap_value *value;
+};
+
+struct hashmap_release_output {
+	uint64_t unused; /* avoid compiled empty struct error */
+};
+
+FUTURE(hashmap_release_future, struct hashmap_release_data,
+	struct hashmap_release_output);
+
+struct hashmap_put_data {
+	FUTURE_CHAIN_ENTRY(struct hashmap_value_new_future, value_new);
+	FUTURE_CHAIN_ENTRY(struct vdm_operation_future, copy);
+	FUTURE_CHAIN_ENTRY_LAST(struct hashmap_insert_future, insert);
+};
+
+struct hashmap_put_output {
+	enum hashmap_result result;
+};
+
+FUTURE(hashmap_put_future, struct hashmap_put_data,
+	struct hashmap_put_output);
+
+struct hashmap_get_data {
+	FUTURE_CHAIN_ENTRY(struct hashmap_acquire_future, acquire);
+	FUTURE_CHAIN_ENTRY(struct vdm_operation_future, copy);
+	FUTURE_CHAIN_ENTRY_LAST(struct hashmap_release_future, release);
+};
+
+struct hashmap_get_output {
+	enum hashmap_result result;
+	size_t size; /* of the value */
+	size_t copy_size; /* copied into the buffer */
+};
+
+FUTURE(hashmap_get_future, struct hashmap_get_data,
+	struct hashmap_get_output);
+
+struct hashmap_remove_data {
+	struct hashmap *hm;
+	uint64_t key;
+};
+
+struct hashmap_remove_output {
+	enum hashmap_result result;
+};
+
+FUTURE(hashmap_remove_future, struct hashmap_remove_data,
+	struct hashmap_remove_output);
+
+/* a key of the batched operations, with the result of its operation */
+struct hashmap_batch_entry {
+	uint64_t key;
+	void *buf; /* the value to put, or the buffer to get it into */
+	size_t size; /* of the value to put, or of the buffer */
+	enum hashmap_result result;
+	size_t value_size; /* of the got value */
+};
+
+struct hashmap_batch;
+
+struct hashmap_batch_data {
+	struct vdm *vdm;
+	struct hashmap *hm;
+	struct hashmap_batch_entry *entries;
+	size_t n;
+	struct hashmap_batch *batch; /* the state, from the first poll on */
+};
+
+struct hashmap_batch_output {
+	size_t nsucceeded;
+};
+
+FUTURE(hashmap_batch_future, struct hashmap_batch_data,
+	struct hashmap_batch_output);
+
+struct hashmap_put_future hashmap_put(struct vdm *vdm, struct hashmap *hm,
+	uint64_t key, const void *value, size_t size);
+
+struct hashmap_get_future hashmap_get(struct vdm *vdm, struct hashmap *hm,
+	uint64_t key, void *buf, size_t size);
+
+struct hashmap_remove_future hashmap_remove(struct hashmap *hm,
+	uint64_t key);
+
+struct hashmap_batch_future hashmap_put_batch(struct vdm *vdm,
+	struct hashmap *hm, struct hashmap_batch_entry *entries, size_t n);
+
+struct hashmap_batch_future hashmap_get_batch(struct vdm *vdm,
+	struct hashmap *hm, struct hashmap_batch_entry *entries, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* HASHMAP_H */
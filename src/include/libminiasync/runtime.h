@@ -12,12 +12,22 @@
  *
  * This implementation also provides a simple waker for futures that support it.
  * This means that the runtime will context switch if no futures can
- * make progress. There's no support for multi-threaded task scheduling.
+ * make progress.
+ *
+ * The runtime also drives the readiness futures of file descriptors, so that
+ * the threads waiting for them block in the kernel's readiness interface.
+ *
+ * Futures can also be spawned onto a pool of executor threads, which poll
+ * them in the background. Each executor has its own queue of futures and
+ * steals work from the other executors when it runs out of its own.
  */
 
 #ifndef RUNTIME_H
 #define RUNTIME_H 1
 
+#include <stdint.h>
+#include <time.h>
+
 #include "future.h"
 
 #ifdef __cplusplus
@@ -26,14 +36,145 @@ extern "C" {
 
 struct runtime;
 
+/* instruction used by the runtime to wait between polling spins */
+enum runtime_pause_kind {
+	RUNTIME_PAUSE_CPU,	/* spin-loop hint (pause/yield instruction) */
+	RUNTIME_PAUSE_YIELD,	/* yield the processor to the OS scheduler */
+	RUNTIME_PAUSE_TPAUSE,	/* timed pause, if supported by the CPU */
+};
+
+/* never go to sleep, spin until the futures complete */
+#define RUNTIME_SPIN_FOREVER UINT64_MAX
+
+struct runtime_policy {
+	/* number of polling spins before the runtime goes to sleep */
+	uint64_t spins_before_sleep;
+	enum runtime_pause_kind pause;
+	/*
+	 * Upper bound of the number of pauses between subsequent spins.
+	 * The number doubles with every spin that makes no progress.
+	 */
+	unsigned max_backoff;
+	/* how long the runtime sleeps if it's not woken up */
+	struct timespec sleep_timeout;
+	/* tune the number of spins based on the observed completion latency */
+	int adaptive;
+	/* collect the statistics returned by runtime_get_stats() */
+	int stats;
+};
+
+void runtime_policy_default(struct runtime_policy *policy);
+
+/*
+ * Bucket 0 of a histogram counts zeros, bucket i counts values in
+ * [2^(i-1), 2^i) and the last bucket also counts all larger values.
+ */
+#define RUNTIME_STATS_BUCKETS 32
+
+struct runtime_stats {
+	uint64_t waits; /* calls to the wait functions */
+	uint64_t spins; /* polling spins of the wait functions */
+	uint64_t polls; /* polls of futures, including the spawned ones */
+	uint64_t completions; /* futures completed while polled */
+	uint64_t wakes; /* wakers fired */
+	uint64_t sleeps; /* times the waiting thread went to sleep */
+	uint64_t sleep_timeouts; /* sleeps which were not ended by a wake */
+	uint64_t timers_fired; /* expired timers of the timer futures */
+	uint64_t steals; /* spawned futures taken from another executor */
+	/* spins of the wait functions preceding every sleep */
+	uint64_t spins_before_sleep[RUNTIME_STATS_BUCKETS];
+	/* nanoseconds from firing a waker to polling the woken future */
+	uint64_t wake_latency[RUNTIME_STATS_BUCKETS];
+};
+
+int runtime_get_stats(struct runtime *runtime, struct runtime_stats *stats);
+void runtime_reset_stats(struct runtime *runtime);
+
 struct runtime *runtime_new(void);
+struct runtime *runtime_new_ex(const struct runtime_policy *policy);
 void runtime_delete(struct runtime *runtime);
 
 void runtime_wait_multiple(struct runtime *runtime, struct future *futs[],
 			size_t nfuts);
 
+size_t runtime_wait_some(struct runtime *runtime, struct future *futs[],
+			size_t nfuts, size_t min_count, size_t *out_indices);
+
+size_t runtime_wait_any(struct runtime *runtime, struct future *futs[],
+			size_t nfuts);
+
 void runtime_wait(struct runtime *runtime, struct future *fut);
 
+/* timer futures, all times are in nanoseconds of the monotonic clock */
+
+uint64_t runtime_clock_now(void);
+
+struct runtime_timer;
+
+struct runtime_sleep_data {
+	struct runtime *runtime;
+	uint64_t deadline;
+	struct runtime_timer *timer;
+};
+
+struct runtime_sleep_output {
+	uint64_t time; /* clock value observed at completion */
+};
+
+FUTURE(runtime_sleep_future, struct runtime_sleep_data,
+	struct runtime_sleep_output);
+
+struct runtime_sleep_future runtime_sleep_until(struct runtime *runtime,
+			uint64_t deadline);
+struct runtime_sleep_future runtime_sleep_for(struct runtime *runtime,
+			uint64_t duration);
+int runtime_sleep_cancel(void *future);
+
+struct runtime_timeout_data {
+	struct runtime *runtime;
+	struct future *fut;
+	uint64_t deadline;
+	struct runtime_timer *timer;
+};
+
+struct runtime_timeout_output {
+	int timed_out; /* the deadline passed before the future completed */
+};
+
+FUTURE(runtime_timeout_future, struct runtime_timeout_data,
+	struct runtime_timeout_output);
+
+struct runtime_timeout_future runtime_timeout(struct runtime *runtime,
+			struct future *fut, uint64_t deadline);
+
+/* readiness futures of the file descriptors, driven by the runtime */
+
+#define RUNTIME_FD_READABLE (1U << 0)
+#define RUNTIME_FD_WRITABLE (1U << 1)
+#define RUNTIME_FD_ERROR (1U << 2) /* output only, error or hang up */
+
+struct runtime_fd_data {
+	struct runtime *runtime;
+	int fd;
+	unsigned events;
+	uint64_t watch; /* registration in the runtime's reactor */
+};
+
+struct runtime_fd_output {
+	unsigned events; /* ready events */
+	int error; /* errno value if the readiness can't be awaited */
+};
+
+FUTURE(runtime_fd_future, struct runtime_fd_data, struct runtime_fd_output);
+
+struct runtime_fd_future runtime_fd_ready(struct runtime *runtime, int fd,
+			unsigned events);
+
+int runtime_executors_start(struct runtime *runtime, size_t nthreads);
+int runtime_spawn(struct runtime *runtime, struct future *fut);
+int runtime_spawn_owned(struct runtime *runtime, struct future *fut);
+void runtime_wait_spawned(struct runtime *runtime);
+
 #ifdef __cplusplus
 }
 #endif
@@ -22,6 +22,8 @@
 #ifndef VDM_H
 #define VDM_H 1
 
+#include <string.h>
+
 #include "future.h"
 
 #ifdef __cplusplus
@@ -35,12 +37,24 @@ enum vdm_operation_type {
 	VDM_OPERATION_MEMMOVE,
 	VDM_OPERATION_MEMSET,
 	VDM_OPERATION_FLUSH,
+	VDM_OPERATION_MEMCPY_V,
+	VDM_OPERATION_COMPARE,
+	VDM_OPERATION_COMPARE_PATTERN,
+	VDM_OPERATION_CRC32C,
+	VDM_OPERATION_DUALCAST,
+	VDM_OPERATION_DELTA_CREATE,
+	VDM_OPERATION_DELTA_APPLY,
+	VDM_OPERATION_MEMFILL,
+	VDM_OPERATION_PREAD,
+	VDM_OPERATION_PWRITE,
 };
 
 enum vdm_operation_result {
 	VDM_SUCCESS,
 	VDM_ERROR_OUT_OF_MEMORY,
 	VDM_ERROR_JOB_CORRUPTED,
+	VDM_ERROR_CANCELED, /* the operation wasn't performed, or not whole */
+	VDM_ERROR_IO, /* the file operation failed, with the error of output */
 };
 
 struct vdm_operation_data_memcpy {
@@ -70,6 +84,109 @@ struct vdm_operation_data_flush {
 	uint64_t flags;
 };
 
+/* a fragment of a vectored operation */
+struct vdm_iov {
+	void *iov_base;
+	size_t iov_len;
+};
+
+/*
+ * The fragment arrays are not copied, they have to remain valid until
+ * the operation is complete.
+ */
+struct vdm_operation_data_memcpy_v {
+	const struct vdm_iov *dest;
+	const struct vdm_iov *src;
+	size_t cnt;
+	uint64_t flags;
+};
+
+struct vdm_operation_data_compare {
+	const void *src1;
+	const void *src2;
+	size_t n;
+	uint64_t flags;
+};
+
+/* the 8 bytes of the pattern are compared in their memory order */
+struct vdm_operation_data_compare_pattern {
+	const void *src;
+	uint64_t pattern;
+	size_t n;
+	uint64_t flags;
+};
+
+struct vdm_operation_data_crc32c {
+	const void *src;
+	size_t n;
+	uint32_t seed; /* the checksum to continue, 0 for a new one */
+	uint64_t flags;
+};
+
+struct vdm_operation_data_dualcast {
+	void *dest1;
+	void *dest2;
+	const void *src;
+	size_t n;
+	uint64_t flags;
+};
+
+/*
+ * A delta record consists of 10-byte entries, the 2-byte little endian
+ * index of an 8-byte word, which differs, followed by the modified word.
+ * The compared buffers are a multiple of 8 bytes, at most 512 KiB long.
+ */
+#define VDM_DELTA_ENTRY_SIZE 10
+#define VDM_DELTA_MAX_SIZE (1U << 19)
+
+struct vdm_operation_data_delta_create {
+	const void *original;
+	const void *modified;
+	void *delta;
+	uint32_t n;
+	uint32_t delta_max; /* size of the delta record buffer */
+	uint64_t flags;
+};
+
+struct vdm_operation_data_delta_apply {
+	void *dest;
+	const void *delta;
+	size_t delta_size;
+	size_t n; /* size of the destination, the entries have to fit it */
+	uint64_t flags;
+};
+
+/* the pattern length of the fill is a power of two, up to a cache line */
+#define VDM_MEMFILL_MAX_PATTERN 64
+
+struct vdm_operation_data_memfill {
+	void *dest;
+	const void *pattern; /* has to stay valid until the fill completes */
+	size_t pattern_len;
+	size_t n;
+	uint64_t flags;
+};
+
+/*
+ * The file operations transfer n bytes at the offset of the file, the file
+ * descriptor has to stay open until the operation completes.
+ */
+struct vdm_operation_data_pread {
+	int fd;
+	void *buf;
+	size_t n;
+	uint64_t offset;
+	uint64_t flags;
+};
+
+struct vdm_operation_data_pwrite {
+	int fd;
+	const void *buf;
+	size_t n;
+	uint64_t offset;
+	uint64_t flags;
+};
+
 /* sized so that sizeof(vdm_operation_data) is 64 */
 #define VDM_OPERATION_DATA_MAX_SIZE (40)
 
@@ -79,6 +196,16 @@ struct vdm_operation {
 		struct vdm_operation_data_memmove memmove;
 		struct vdm_operation_data_memset memset;
 		struct vdm_operation_data_flush flush;
+		struct vdm_operation_data_memcpy_v memcpy_v;
+		struct vdm_operation_data_compare compare;
+		struct vdm_operation_data_compare_pattern compare_pattern;
+		struct vdm_operation_data_crc32c crc32c;
+		struct vdm_operation_data_dualcast dualcast;
+		struct vdm_operation_data_delta_create delta_create;
+		struct vdm_operation_data_delta_apply delta_apply;
+		struct vdm_operation_data_memfill memfill;
+		struct vdm_operation_data_pread pread;
+		struct vdm_operation_data_pwrite pwrite;
 		uint8_t data[VDM_OPERATION_DATA_MAX_SIZE];
 	} data;
 	enum vdm_operation_type type;
@@ -107,6 +234,58 @@ struct vdm_operation_output_flush {
 	uint64_t unused;
 };
 
+struct vdm_operation_output_memcpy_v {
+	size_t n; /* bytes copied in all the fragments */
+};
+
+struct vdm_operation_output_compare {
+	int result; /* 0 - equal, 1 - different */
+	size_t offset; /* of the first differing byte, n if equal */
+};
+
+struct vdm_operation_output_compare_pattern {
+	int result; /* 0 - matches the pattern, 1 - doesn't */
+	size_t offset; /* of the first differing byte, n if it matches */
+};
+
+struct vdm_operation_output_crc32c {
+	uint32_t crc;
+};
+
+struct vdm_operation_output_dualcast {
+	void *dest1;
+	void *dest2;
+};
+
+enum vdm_delta_result {
+	VDM_DELTA_EQUAL, /* no differences, the record is empty */
+	VDM_DELTA_CREATED, /* the record holds all the differences */
+	VDM_DELTA_OVERFLOW, /* not all the differences fit the record */
+};
+
+struct vdm_operation_output_delta_create {
+	enum vdm_delta_result result;
+	size_t delta_size;
+};
+
+struct vdm_operation_output_delta_apply {
+	void *dest;
+};
+
+struct vdm_operation_output_memfill {
+	void *dest;
+};
+
+struct vdm_operation_output_pread {
+	size_t n; /* bytes read, fewer only at the end of the file */
+	int error; /* errno of the failed read, with VDM_ERROR_IO */
+};
+
+struct vdm_operation_output_pwrite {
+	size_t n; /* bytes written */
+	int error; /* errno of the failed write, with VDM_ERROR_IO */
+};
+
 struct vdm_operation_output {
 	enum vdm_operation_type type;
 	enum vdm_operation_result result;
@@ -115,6 +294,16 @@ struct vdm_operation_output {
 		struct vdm_operation_output_memmove memmove;
 		struct vdm_operation_output_memset memset;
 		struct vdm_operation_output_flush flush;
+		struct vdm_operation_output_memcpy_v memcpy_v;
+		struct vdm_operation_output_compare compare;
+		struct vdm_operation_output_compare_pattern compare_pattern;
+		struct vdm_operation_output_crc32c crc32c;
+		struct vdm_operation_output_dualcast dualcast;
+		struct vdm_operation_output_delta_create delta_create;
+		struct vdm_operation_output_delta_apply delta_apply;
+		struct vdm_operation_output_memfill memfill;
+		struct vdm_operation_output_pread pread;
+		struct vdm_operation_output_pwrite pwrite;
 	} output;
 };
 
@@ -131,6 +320,34 @@ typedef enum future_state (*vdm_operation_check)(void *data,
 typedef void (*vdm_operation_delete)(void *data,
 	const struct vdm_operation *operation,
 	struct vdm_operation_output *output);
+/*
+ * Starts the n operations without notifiers, returns how many of them,
+ * from the first one, were started.
+ */
+typedef size_t (*vdm_operation_start_batch)(struct vdm *vdm, void *data[],
+	const struct vdm_operation *operations[], size_t n);
+/*
+ * Creates the operation like vdm_operation_new, but in the storage provided
+ * by the caller, of op_storage_size bytes aligned to VDM_OP_STORAGE_ALIGN.
+ */
+typedef void *(*vdm_operation_init)(struct vdm *vdm,
+	const enum vdm_operation_type type, void *storage);
+/* called once the operation is complete, by the thread which completed it */
+typedef void (*vdm_complete_fn)(void *arg);
+/*
+ * Starts the operation like vdm_operation_start, without a notifier,
+ * and calls fn(arg) once it's complete.
+ */
+typedef int (*vdm_operation_start_cb)(void *data,
+	const struct vdm_operation *operation, vdm_complete_fn fn, void *arg);
+
+/*
+ * Requests the cancellation of the started operation, which isn't complete
+ * yet, returns -1 if it can't be canceled. The operation completes anyway,
+ * with VDM_ERROR_CANCELED, if any of its work was dropped.
+ */
+typedef int (*vdm_operation_cancel)(void *data,
+	const struct vdm_operation *operation);
 
 struct vdm {
 	vdm_operation_new op_new;
@@ -139,6 +356,31 @@ struct vdm {
 	vdm_operation_check op_check;
 	unsigned capabilities;
 	future_has_property_fn has_property;
+	vdm_operation_start_batch op_start_batch; /* optional, can be NULL */
+	vdm_operation_init op_init; /* optional, can be NULL */
+	size_t op_storage_size; /* a multiple of VDM_OP_STORAGE_ALIGN */
+	vdm_operation_start_cb op_start_cb; /* optional, can be NULL */
+	vdm_operation_cancel op_cancel; /* optional, can be NULL */
+};
+
+/* the alignment of the storage of the operations provided by the caller */
+#define VDM_OP_STORAGE_ALIGN 64
+
+/*
+ * Statistics of the buffers, from which the data movers allocate
+ * the descriptors of the started operations.
+ */
+struct vdm_membuf_stats {
+	uint64_t buffers; /* per-thread buffers, including unused ones */
+	uint64_t buffer_size; /* usable bytes of each buffer */
+	uint64_t bytes_allocated; /* taken by operations not collected yet */
+	uint64_t bytes_available; /* left for operations, in all buffers */
+	uint64_t bytes_reusable; /* freed, reusable only by the same size */
+	uint64_t max_bytes_allocated; /* taken in the fullest buffer */
+	uint64_t collections; /* times the freed operations were collected */
+	uint64_t collected; /* freed operations taken over for reuse */
+	uint64_t resets; /* exhausted buffers started over, once empty */
+	uint64_t failures; /* operations that couldn't be allocated */
 };
 
 struct vdm *vdm_synchronous_new(void);
@@ -179,7 +421,10 @@ vdm_operation_impl(struct future_context *context, struct future_notifier *n)
 
 #define VDM_F_MEM_DURABLE		(1U << 0)
 #define VDM_F_NO_CACHE_HINT		(1U << 1)
-#define VDM_F_VALID_FLAGS	(VDM_F_MEM_DURABLE | VDM_F_NO_CACHE_HINT)
+/* a background operation, which yields to the others */
+#define VDM_F_PRIORITY_LOW		(1U << 2)
+#define VDM_F_VALID_FLAGS	(VDM_F_MEM_DURABLE | VDM_F_NO_CACHE_HINT | \
+	VDM_F_PRIORITY_LOW)
 
 /*
  * vdm_is_supported -- returns if the given flag or feature is supported
@@ -187,7 +432,7 @@ vdm_operation_impl(struct future_context *context, struct future_notifier *n)
 static inline int
 vdm_is_supported(struct vdm *vdm, unsigned capability)
 {
-	return (vdm->capabilities && capability) == capability;
+	return (vdm->capabilities & capability) == capability;
 }
 
 /*
@@ -198,8 +443,10 @@ static inline void
 vdm_set_has_property_fn(struct vdm_operation_future *future,
 		int(*has_property)(void *future, enum future_property property))
 {
-	if (has_property != NULL)
+	if (has_property != NULL) {
 		future->base.has_property = has_property;
+		future->base.context.properties = 0;
+	}
 }
 
 /*
@@ -227,11 +474,181 @@ vdm_generic_operation(struct vdm *vdm, struct vdm_operation_future *future)
 }
 
 /*
- * vdm_memcpy -- instantiates a new memcpy vdm operation and returns a new
- * future to represent that operation
+ * vdm_op_storage_size -- returns the size of the storage, which the caller
+ * has to provide for an operation, or 0 if the data mover allocates all
+ * the operations itself
+ */
+static inline size_t
+vdm_op_storage_size(struct vdm *vdm)
+{
+	return vdm->op_init != NULL ? vdm->op_storage_size : 0;
+}
+
+/*
+ * vdm_generic_operation_storage -- creates a new vdm future for a given
+ * generic operation, in the storage provided by the caller, if not NULL
+ *
+ * The storage has to stay intact until the future is complete. It's left
+ * unused if the data mover can't create the operations in it.
+ */
+static inline void
+vdm_generic_operation_storage(struct vdm *vdm,
+	struct vdm_operation_future *future, void *storage)
+{
+	if (storage == NULL || vdm->op_init == NULL) {
+		vdm_generic_operation(vdm, future);
+		return;
+	}
+
+	future->data.vdm = vdm;
+	if ((future->data.data = vdm->op_init(vdm,
+			future->data.operation.type, storage)) == NULL) {
+		future->output.result = VDM_ERROR_OUT_OF_MEMORY;
+		FUTURE_INIT_COMPLETE(future);
+	} else {
+		FUTURE_INIT(future, vdm_operation_impl);
+	}
+	vdm_set_has_property_fn(future, vdm->has_property);
+}
+
+/* the futures are handed over to the data mover in groups of this size */
+#define VDM_SUBMIT_BATCH_SIZE 16
+
+/*
+ * vdm_submit_batch -- starts the data mover operations of the n idle
+ * futures together, returns the number of the started ones
+ *
+ * The operations are started in order, without notifiers, and the started
+ * futures only have to be polled until they complete. If the data mover
+ * doesn't have a batched submission routine, they are started one by one.
+ */
+static inline size_t
+vdm_submit_batch(struct vdm *vdm, struct vdm_operation_future *futs[],
+	size_t n)
+{
+	struct vdm_operation_future *batch[VDM_SUBMIT_BATCH_SIZE];
+	void *data[VDM_SUBMIT_BATCH_SIZE];
+	const struct vdm_operation *operations[VDM_SUBMIT_BATCH_SIZE];
+
+	size_t nstarted = 0;
+	size_t i = 0;
+	while (i < n) {
+		size_t nbatch = 0;
+		for (; i < n && nbatch < VDM_SUBMIT_BATCH_SIZE; ++i) {
+			struct vdm_operation_future *fut = futs[i];
+			if (fut->base.context.state != FUTURE_STATE_IDLE)
+				continue;
+			batch[nbatch] = fut;
+			data[nbatch] = fut->data.data;
+			operations[nbatch] = &fut->data.operation;
+			nbatch++;
+		}
+
+		size_t nbatch_started = 0;
+		if (vdm->op_start_batch != NULL) {
+			nbatch_started = vdm->op_start_batch(vdm, data,
+				operations, nbatch);
+		} else {
+			while (nbatch_started < nbatch &&
+			    vdm->op_start(data[nbatch_started],
+			    operations[nbatch_started], NULL) == 0)
+				nbatch_started++;
+		}
+
+		for (size_t j = 0; j < nbatch_started; ++j)
+			batch[j]->base.context.state = FUTURE_STATE_RUNNING;
+
+		nstarted += nbatch_started;
+		if (nbatch_started != nbatch)
+			break;
+	}
+
+	return nstarted;
+}
+
+/*
+ * vdm_start_with_callback -- starts the data mover operation of the idle
+ * future and calls fn(arg) once it's complete, returns -1 if the future
+ * isn't idle or the data mover doesn't support completion callbacks
+ *
+ * The function is called by the thread, which completed the operation,
+ * possibly before this one returns. The future has to be polled afterwards
+ * to collect the output, which can be done by the callback itself, but
+ * the future can't be accessed by anyone else until the callback is called.
+ */
+static inline int
+vdm_start_with_callback(struct vdm_operation_future *fut, vdm_complete_fn fn,
+	void *arg)
+{
+	struct vdm *vdm = fut->data.vdm;
+	if (fut->base.context.state != FUTURE_STATE_IDLE ||
+	    vdm->op_start_cb == NULL)
+		return -1;
+
+	/* the callback can poll the future before op_start_cb returns */
+	fut->base.context.state = FUTURE_STATE_RUNNING;
+	if (vdm->op_start_cb(fut->data.data, &fut->data.operation,
+			fn, arg) != 0) {
+		fut->base.context.state = FUTURE_STATE_IDLE;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * vdm_cancel -- cancels the data mover operation of the future, returns -1
+ * if it's already complete or the data mover can't cancel it once started
+ *
+ * An idle future is completed right away, without starting its operation.
+ * A started one has to be polled until it's complete, as usual, which takes
+ * as long as the part of the operation the data mover couldn't drop. Either
+ * way, the result is VDM_ERROR_CANCELED, unless the whole operation was
+ * performed before the cancellation reached it.
+ */
+static inline int
+vdm_cancel(struct vdm_operation_future *fut)
+{
+	struct vdm *vdm = fut->data.vdm;
+
+	switch (fut->base.context.state) {
+		case FUTURE_STATE_IDLE: {
+			/* the output of the operation is left as initialized */
+			struct vdm_operation_output output;
+			vdm->op_delete(fut->data.data, &fut->data.operation,
+				&output);
+			fut->output.result = VDM_ERROR_CANCELED;
+			fut->base.context.state = FUTURE_STATE_COMPLETE;
+			return 0;
+		}
+		case FUTURE_STATE_RUNNING:
+			if (vdm->op_cancel == NULL)
+				return -1;
+			return vdm->op_cancel(fut->data.data,
+				&fut->data.operation);
+		default:
+			return -1;
+	}
+}
+
+/*
+ * vdm_future_cancel -- cancels the data mover operation of the future like
+ * vdm_cancel, in the form of the cancel function of the select futures
+ */
+static inline int
+vdm_future_cancel(void *future)
+{
+	return vdm_cancel((struct vdm_operation_future *)future);
+}
+
+/*
+ * vdm_memcpy_storage -- instantiates a new memcpy vdm operation in the storage
+ * provided by the caller and returns a new future to represent that
+ * operation
  */
 static inline struct vdm_operation_future
-vdm_memcpy(struct vdm *vdm, void *dest, void *src, size_t n, uint64_t flags)
+vdm_memcpy_storage(struct vdm *vdm, void *storage,
+	void *dest, void *src, size_t n, uint64_t flags)
 {
 	struct vdm_operation_future future;
 	future.data.operation.type = VDM_OPERATION_MEMCPY;
@@ -244,16 +661,28 @@ vdm_memcpy(struct vdm *vdm, void *dest, void *src, size_t n, uint64_t flags)
 	future.output.result = VDM_SUCCESS;
 	future.output.output.memcpy.dest = NULL;
 
-	vdm_generic_operation(vdm, &future);
+	vdm_generic_operation_storage(vdm, &future, storage);
 	return future;
 }
 
 /*
- * vdm_memmove -- instantiates a new memmove vdm operation and returns a new
+ * vdm_memcpy -- instantiates a new memcpy vdm operation and returns a new
  * future to represent that operation
  */
 static inline struct vdm_operation_future
-vdm_memmove(struct vdm *vdm, void *dest, void *src, size_t n, uint64_t flags)
+vdm_memcpy(struct vdm *vdm, void *dest, void *src, size_t n, uint64_t flags)
+{
+	return vdm_memcpy_storage(vdm, NULL, dest, src, n, flags);
+}
+
+/*
+ * vdm_memmove_storage -- instantiates a new memmove vdm operation in
+ * the storage provided by the caller and returns a new future to represent
+ * that operation
+ */
+static inline struct vdm_operation_future
+vdm_memmove_storage(struct vdm *vdm, void *storage,
+	void *dest, void *src, size_t n, uint64_t flags)
 {
 	struct vdm_operation_future future;
 	future.data.operation.type = VDM_OPERATION_MEMMOVE;
@@ -266,16 +695,28 @@ vdm_memmove(struct vdm *vdm, void *dest, void *src, size_t n, uint64_t flags)
 	future.output.result = VDM_SUCCESS;
 	future.output.output.memmove.dest = NULL;
 
-	vdm_generic_operation(vdm, &future);
+	vdm_generic_operation_storage(vdm, &future, storage);
 	return future;
 }
 
 /*
- * vdm_memset -- instantiates a new memset vdm operation and returns a new
+ * vdm_memmove -- instantiates a new memmove vdm operation and returns a new
  * future to represent that operation
  */
 static inline struct vdm_operation_future
-vdm_memset(struct vdm *vdm, void *str, int c, size_t n, uint64_t flags)
+vdm_memmove(struct vdm *vdm, void *dest, void *src, size_t n, uint64_t flags)
+{
+	return vdm_memmove_storage(vdm, NULL, dest, src, n, flags);
+}
+
+/*
+ * vdm_memset_storage -- instantiates a new memset vdm operation in the storage
+ * provided by the caller and returns a new future to represent that
+ * operation
+ */
+static inline struct vdm_operation_future
+vdm_memset_storage(struct vdm *vdm, void *storage,
+	void *str, int c, size_t n, uint64_t flags)
 {
 	struct vdm_operation_future future;
 	future.data.operation.type = VDM_OPERATION_MEMSET;
@@ -288,16 +729,28 @@ vdm_memset(struct vdm *vdm, void *str, int c, size_t n, uint64_t flags)
 	future.output.result = VDM_SUCCESS;
 	future.output.output.memset.str = NULL;
 
-	vdm_generic_operation(vdm, &future);
+	vdm_generic_operation_storage(vdm, &future, storage);
 	return future;
 }
 
 /*
- * vdm_flush -- instantiates a new flush vdm operation and returns a new
+ * vdm_memset -- instantiates a new memset vdm operation and returns a new
  * future to represent that operation
  */
 static inline struct vdm_operation_future
-vdm_flush(struct vdm *vdm, void *dest, size_t n, uint64_t flags)
+vdm_memset(struct vdm *vdm, void *str, int c, size_t n, uint64_t flags)
+{
+	return vdm_memset_storage(vdm, NULL, str, c, n, flags);
+}
+
+/*
+ * vdm_flush_storage -- instantiates a new flush vdm operation in the storage
+ * provided by the caller and returns a new future to represent that
+ * operation
+ */
+static inline struct vdm_operation_future
+vdm_flush_storage(struct vdm *vdm, void *storage,
+	void *dest, size_t n, uint64_t flags)
 {
 	struct vdm_operation_future future;
 	future.data.operation.type = VDM_OPERATION_FLUSH;
@@ -308,10 +761,571 @@ vdm_flush(struct vdm *vdm, void *dest, size_t n, uint64_t flags)
 	future.output.type = VDM_OPERATION_FLUSH;
 	future.output.result = VDM_SUCCESS;
 
+	vdm_generic_operation_storage(vdm, &future, storage);
+	return future;
+}
+
+/*
+ * vdm_flush -- instantiates a new flush vdm operation and returns a new
+ * future to represent that operation
+ */
+static inline struct vdm_operation_future
+vdm_flush(struct vdm *vdm, void *dest, size_t n, uint64_t flags)
+{
+	return vdm_flush_storage(vdm, NULL, dest, n, flags);
+}
+
+/*
+ * vdm_memcpy_v_size -- returns the number of bytes copied by the vectored
+ * memcpy, the shorter of each pair of fragments
+ */
+static inline size_t
+vdm_memcpy_v_size(const struct vdm_operation_data_memcpy_v *mdata)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < mdata->cnt; ++i) {
+		size_t len = mdata->src[i].iov_len;
+		if (mdata->dest[i].iov_len < len)
+			len = mdata->dest[i].iov_len;
+		n += len;
+	}
+
+	return n;
+}
+
+/*
+ * vdm_memcpy_v -- instantiates a new vectored memcpy vdm operation, which
+ * copies the cnt src fragments to the dest fragments with the same indices,
+ * and returns a new future to represent that operation
+ */
+static inline struct vdm_operation_future
+vdm_memcpy_v(struct vdm *vdm, const struct vdm_iov *dest,
+	const struct vdm_iov *src, size_t cnt, uint64_t flags)
+{
+	struct vdm_operation_future future;
+	future.data.operation.type = VDM_OPERATION_MEMCPY_V;
+	future.data.operation.data.memcpy_v.dest = dest;
+	future.data.operation.data.memcpy_v.flags = flags;
+	future.data.operation.data.memcpy_v.cnt = cnt;
+	future.data.operation.data.memcpy_v.src = src;
+	future.data.operation.padding = 0;
+	future.output.type = VDM_OPERATION_MEMCPY_V;
+	future.output.result = VDM_SUCCESS;
+	future.output.output.memcpy_v.n = 0;
+
+	vdm_generic_operation(vdm, &future);
+	return future;
+}
+
+/*
+ * vdm_compare -- instantiates a new compare vdm operation and returns a new
+ * future to represent that operation
+ */
+static inline struct vdm_operation_future
+vdm_compare(struct vdm *vdm, const void *src1, const void *src2, size_t n,
+	uint64_t flags)
+{
+	struct vdm_operation_future future;
+	future.data.operation.type = VDM_OPERATION_COMPARE;
+	future.data.operation.data.compare.src1 = src1;
+	future.data.operation.data.compare.src2 = src2;
+	future.data.operation.data.compare.flags = flags;
+	future.data.operation.data.compare.n = n;
+	future.data.operation.padding = 0;
+	future.output.type = VDM_OPERATION_COMPARE;
+	future.output.result = VDM_SUCCESS;
+	future.output.output.compare.result = 0;
+	future.output.output.compare.offset = 0;
+
+	vdm_generic_operation(vdm, &future);
+	return future;
+}
+
+/*
+ * vdm_compare_pattern -- instantiates a new compare pattern vdm operation
+ * and returns a new future to represent that operation
+ */
+static inline struct vdm_operation_future
+vdm_compare_pattern(struct vdm *vdm, const void *src, uint64_t pattern,
+	size_t n, uint64_t flags)
+{
+	struct vdm_operation_future future;
+	future.data.operation.type = VDM_OPERATION_COMPARE_PATTERN;
+	future.data.operation.data.compare_pattern.src = src;
+	future.data.operation.data.compare_pattern.pattern = pattern;
+	future.data.operation.data.compare_pattern.flags = flags;
+	future.data.operation.data.compare_pattern.n = n;
+	future.data.operation.padding = 0;
+	future.output.type = VDM_OPERATION_COMPARE_PATTERN;
+	future.output.result = VDM_SUCCESS;
+	future.output.output.compare_pattern.result = 0;
+	future.output.output.compare_pattern.offset = 0;
+
+	vdm_generic_operation(vdm, &future);
+	return future;
+}
+
+/*
+ * vdm_crc32c -- instantiates a new CRC-32C vdm operation and returns a new
+ * future to represent that operation
+ */
+static inline struct vdm_operation_future
+vdm_crc32c(struct vdm *vdm, const void *src, size_t n, uint32_t seed,
+	uint64_t flags)
+{
+	struct vdm_operation_future future;
+	future.data.operation.type = VDM_OPERATION_CRC32C;
+	future.data.operation.data.crc32c.src = src;
+	future.data.operation.data.crc32c.seed = seed;
+	future.data.operation.data.crc32c.flags = flags;
+	future.data.operation.data.crc32c.n = n;
+	future.data.operation.padding = 0;
+	future.output.type = VDM_OPERATION_CRC32C;
+	future.output.result = VDM_SUCCESS;
+	future.output.output.crc32c.crc = 0;
+
+	vdm_generic_operation(vdm, &future);
+	return future;
+}
+
+/*
+ * vdm_dualcast -- instantiates a new dualcast vdm operation, which copies
+ * the source to both destinations, and returns a new future to represent
+ * that operation
+ */
+static inline struct vdm_operation_future
+vdm_dualcast(struct vdm *vdm, void *dest1, void *dest2, const void *src,
+	size_t n, uint64_t flags)
+{
+	struct vdm_operation_future future;
+	future.data.operation.type = VDM_OPERATION_DUALCAST;
+	future.data.operation.data.dualcast.dest1 = dest1;
+	future.data.operation.data.dualcast.dest2 = dest2;
+	future.data.operation.data.dualcast.src = src;
+	future.data.operation.data.dualcast.flags = flags;
+	future.data.operation.data.dualcast.n = n;
+	future.data.operation.padding = 0;
+	future.output.type = VDM_OPERATION_DUALCAST;
+	future.output.result = VDM_SUCCESS;
+	future.output.output.dualcast.dest1 = NULL;
+	future.output.output.dualcast.dest2 = NULL;
+
+	vdm_generic_operation(vdm, &future);
+	return future;
+}
+
+/*
+ * vdm_delta_create -- instantiates a new delta record create vdm operation
+ * and returns a new future to represent that operation
+ */
+static inline struct vdm_operation_future
+vdm_delta_create(struct vdm *vdm, const void *original, const void *modified,
+	uint32_t n, void *delta, uint32_t delta_max, uint64_t flags)
+{
+	struct vdm_operation_future future;
+	future.data.operation.type = VDM_OPERATION_DELTA_CREATE;
+	future.data.operation.data.delta_create.original = original;
+	future.data.operation.data.delta_create.modified = modified;
+	future.data.operation.data.delta_create.delta = delta;
+	future.data.operation.data.delta_create.delta_max = delta_max;
+	future.data.operation.data.delta_create.flags = flags;
+	future.data.operation.data.delta_create.n = n;
+	future.data.operation.padding = 0;
+	future.output.type = VDM_OPERATION_DELTA_CREATE;
+	future.output.result = VDM_SUCCESS;
+	future.output.output.delta_create.result = VDM_DELTA_EQUAL;
+	future.output.output.delta_create.delta_size = 0;
+
+	vdm_generic_operation(vdm, &future);
+	return future;
+}
+
+/*
+ * vdm_delta_apply -- instantiates a new delta record apply vdm operation
+ * and returns a new future to represent that operation
+ */
+static inline struct vdm_operation_future
+vdm_delta_apply(struct vdm *vdm, void *dest, size_t n, const void *delta,
+	size_t delta_size, uint64_t flags)
+{
+	struct vdm_operation_future future;
+	future.data.operation.type = VDM_OPERATION_DELTA_APPLY;
+	future.data.operation.data.delta_apply.dest = dest;
+	future.data.operation.data.delta_apply.delta = delta;
+	future.data.operation.data.delta_apply.delta_size = delta_size;
+	future.data.operation.data.delta_apply.flags = flags;
+	future.data.operation.data.delta_apply.n = n;
+	future.data.operation.padding = 0;
+	future.output.type = VDM_OPERATION_DELTA_APPLY;
+	future.output.result = VDM_SUCCESS;
+	future.output.output.delta_apply.dest = NULL;
+
+	vdm_generic_operation(vdm, &future);
+	return future;
+}
+
+/*
+ * vdm_memfill -- instantiates a new memfill vdm operation, which fills
+ * the destination with the pattern of pattern_len bytes, repeated from
+ * its beginning, and returns a new future to represent that operation
+ */
+static inline struct vdm_operation_future
+vdm_memfill(struct vdm *vdm, void *dest, const void *pattern,
+	size_t pattern_len, size_t n, uint64_t flags)
+{
+	struct vdm_operation_future future;
+	future.data.operation.type = VDM_OPERATION_MEMFILL;
+	future.data.operation.data.memfill.dest = dest;
+	future.data.operation.data.memfill.pattern = pattern;
+	future.data.operation.data.memfill.pattern_len = pattern_len;
+	future.data.operation.data.memfill.flags = flags;
+	future.data.operation.data.memfill.n = n;
+	future.data.operation.padding = 0;
+	future.output.type = VDM_OPERATION_MEMFILL;
+	future.output.result = VDM_SUCCESS;
+	future.output.output.memfill.dest = NULL;
+
+	vdm_generic_operation(vdm, &future);
+	return future;
+}
+
+/*
+ * vdm_pread -- instantiates a new pread vdm operation, which reads n bytes
+ * of the file at the offset into the buffer, and returns a new future
+ * to represent that operation
+ */
+static inline struct vdm_operation_future
+vdm_pread(struct vdm *vdm, int fd, void *buf, size_t n, uint64_t offset,
+	uint64_t flags)
+{
+	struct vdm_operation_future future;
+	future.data.operation.type = VDM_OPERATION_PREAD;
+	future.data.operation.data.pread.fd = fd;
+	future.data.operation.data.pread.buf = buf;
+	future.data.operation.data.pread.n = n;
+	future.data.operation.data.pread.offset = offset;
+	future.data.operation.data.pread.flags = flags;
+	future.data.operation.padding = 0;
+	future.output.type = VDM_OPERATION_PREAD;
+	future.output.result = VDM_SUCCESS;
+	future.output.output.pread.n = 0;
+	future.output.output.pread.error = 0;
+
+	vdm_generic_operation(vdm, &future);
+	return future;
+}
+
+/*
+ * vdm_pwrite -- instantiates a new pwrite vdm operation, which writes n bytes
+ * of the buffer to the file at the offset, and returns a new future
+ * to represent that operation
+ */
+static inline struct vdm_operation_future
+vdm_pwrite(struct vdm *vdm, int fd, const void *buf, size_t n,
+	uint64_t offset, uint64_t flags)
+{
+	struct vdm_operation_future future;
+	future.data.operation.type = VDM_OPERATION_PWRITE;
+	future.data.operation.data.pwrite.fd = fd;
+	future.data.operation.data.pwrite.buf = buf;
+	future.data.operation.data.pwrite.n = n;
+	future.data.operation.data.pwrite.offset = offset;
+	future.data.operation.data.pwrite.flags = flags;
+	future.data.operation.padding = 0;
+	future.output.type = VDM_OPERATION_PWRITE;
+	future.output.result = VDM_SUCCESS;
+	future.output.output.pwrite.n = 0;
+	future.output.output.pwrite.error = 0;
+
 	vdm_generic_operation(vdm, &future);
 	return future;
 }
 
+/*
+ * vdm_operation_size -- returns the number of bytes the operation works on
+ */
+static inline size_t
+vdm_operation_size(const struct vdm_operation *op)
+{
+	switch (op->type) {
+		case VDM_OPERATION_MEMCPY:
+			return op->data.memcpy.n;
+		case VDM_OPERATION_MEMMOVE:
+			return op->data.memmove.n;
+		case VDM_OPERATION_MEMSET:
+			return op->data.memset.n;
+		case VDM_OPERATION_FLUSH:
+			return op->data.flush.n;
+		case VDM_OPERATION_MEMCPY_V:
+			return vdm_memcpy_v_size(&op->data.memcpy_v);
+		case VDM_OPERATION_COMPARE:
+			return op->data.compare.n;
+		case VDM_OPERATION_COMPARE_PATTERN:
+			return op->data.compare_pattern.n;
+		case VDM_OPERATION_CRC32C:
+			return op->data.crc32c.n;
+		case VDM_OPERATION_DUALCAST:
+			return op->data.dualcast.n;
+		case VDM_OPERATION_DELTA_CREATE:
+			return op->data.delta_create.n;
+		case VDM_OPERATION_DELTA_APPLY:
+			/* the entries are spread over the buffer */
+			return op->data.delta_apply.delta_size;
+		case VDM_OPERATION_MEMFILL:
+			return op->data.memfill.n;
+		case VDM_OPERATION_PREAD:
+			return op->data.pread.n;
+		case VDM_OPERATION_PWRITE:
+			return op->data.pwrite.n;
+		default:
+			return 0;
+	}
+}
+
+/*
+ * vdm_operation_flags -- returns the flags of the operation
+ */
+static inline uint64_t
+vdm_operation_flags(const struct vdm_operation *op)
+{
+	switch (op->type) {
+		case VDM_OPERATION_MEMCPY:
+			return op->data.memcpy.flags;
+		case VDM_OPERATION_MEMMOVE:
+			return op->data.memmove.flags;
+		case VDM_OPERATION_MEMSET:
+			return op->data.memset.flags;
+		case VDM_OPERATION_FLUSH:
+			return op->data.flush.flags;
+		case VDM_OPERATION_MEMCPY_V:
+			return op->data.memcpy_v.flags;
+		case VDM_OPERATION_COMPARE:
+			return op->data.compare.flags;
+		case VDM_OPERATION_COMPARE_PATTERN:
+			return op->data.compare_pattern.flags;
+		case VDM_OPERATION_CRC32C:
+			return op->data.crc32c.flags;
+		case VDM_OPERATION_DUALCAST:
+			return op->data.dualcast.flags;
+		case VDM_OPERATION_DELTA_CREATE:
+			return op->data.delta_create.flags;
+		case VDM_OPERATION_DELTA_APPLY:
+			return op->data.delta_apply.flags;
+		case VDM_OPERATION_MEMFILL:
+			return op->data.memfill.flags;
+		case VDM_OPERATION_PREAD:
+			return op->data.pread.flags;
+		case VDM_OPERATION_PWRITE:
+			return op->data.pwrite.flags;
+		default:
+			return 0;
+	}
+}
+
+/*
+ * A compact future only keeps what's needed to poll it, so that it fits
+ * a single cache line. The operation, its descriptor in the data mover
+ * and, once the operation completes, its output live in a slot provided
+ * by the caller, which is touched only when the operation starts
+ * and completes.
+ */
+struct vdm_compact_data {
+	void *slot;
+	struct vdm *vdm; /* at the same offset as in vdm_operation_data */
+};
+
+struct vdm_compact_output {
+	enum vdm_operation_type type;
+	enum vdm_operation_result result;
+};
+
+FUTURE(vdm_compact_future,
+	struct vdm_compact_data, struct vdm_compact_output);
+
+/*
+ * vdm_compact_descriptor_size -- (internal) returns the size of the part
+ * of the slot, which holds the descriptor of the operation or, if the data
+ * mover allocates it, the pointer to it
+ */
+static inline size_t
+vdm_compact_descriptor_size(struct vdm *vdm)
+{
+	size_t size = vdm_op_storage_size(vdm);
+
+	return size != 0 ? size : VDM_OP_STORAGE_ALIGN;
+}
+
+/*
+ * vdm_compact_slot_size -- returns the size of the slot of a compact
+ * future, a multiple of VDM_OP_STORAGE_ALIGN
+ */
+static inline size_t
+vdm_compact_slot_size(struct vdm *vdm)
+{
+	size_t size = sizeof(struct vdm_operation);
+	if (size < sizeof(struct vdm_operation_output))
+		size = sizeof(struct vdm_operation_output);
+	size = (size + VDM_OP_STORAGE_ALIGN - 1) &
+		~((size_t)VDM_OP_STORAGE_ALIGN - 1);
+
+	return vdm_compact_descriptor_size(vdm) + size;
+}
+
+/*
+ * vdm_compact_operation_ptr -- (internal) returns the operation,
+ * or the output of the complete one, in the slot
+ */
+static inline void *
+vdm_compact_operation_ptr(struct vdm_compact_data *cdata)
+{
+	return (char *)cdata->slot + vdm_compact_descriptor_size(cdata->vdm);
+}
+
+/*
+ * vdm_compact_operation_data -- (internal) returns the descriptor
+ * of the operation in the slot
+ */
+static inline void *
+vdm_compact_operation_data(struct vdm_compact_data *cdata)
+{
+	if (cdata->vdm->op_init != NULL)
+		return cdata->slot;
+
+	return *(void **)cdata->slot;
+}
+
+/*
+ * vdm_compact_impl -- the poll implementation for a compact vdm operation,
+ * with the same lifecycle as vdm_operation_impl
+ */
+static inline enum future_state
+vdm_compact_impl(struct future_context *context, struct future_notifier *n)
+{
+	struct vdm_compact_data *cdata =
+		(struct vdm_compact_data *)future_context_get_data(context);
+	struct vdm *vdm = cdata->vdm;
+	struct vdm_operation *operation =
+		(struct vdm_operation *)vdm_compact_operation_ptr(cdata);
+	void *data = vdm_compact_operation_data(cdata);
+
+	if (context->state == FUTURE_STATE_IDLE) {
+		if (vdm->op_start(data, operation, n) != 0) {
+			return FUTURE_STATE_IDLE;
+		}
+	}
+
+	enum future_state state = vdm->op_check(data, operation);
+
+	if (state == FUTURE_STATE_COMPLETE) {
+		struct vdm_compact_output *coutput =
+			(struct vdm_compact_output *)
+				future_context_get_output(context);
+		struct vdm_operation_output output;
+		output.type = operation->type;
+		output.result = VDM_SUCCESS;
+		vdm->op_delete(data, operation, &output);
+
+		/* the operation is no longer needed, the output replaces it */
+		memcpy(operation, &output, sizeof(output));
+		coutput->type = output.type;
+		coutput->result = output.result;
+	}
+
+	return state;
+}
+
+/*
+ * vdm_compact_operation -- instantiates a new compact future for a copy
+ * of the given operation, in the slot of vdm_compact_slot_size() bytes
+ * aligned to VDM_OP_STORAGE_ALIGN, which has to stay intact until
+ * the output is no longer needed
+ */
+static inline struct vdm_compact_future
+vdm_compact_operation(struct vdm *vdm, void *slot,
+	const struct vdm_operation *operation)
+{
+	struct vdm_compact_future future;
+	future.data.slot = slot;
+	future.data.vdm = vdm;
+	future.output.type = operation->type;
+	future.output.result = VDM_SUCCESS;
+	memcpy(vdm_compact_operation_ptr(&future.data), operation,
+		sizeof(*operation));
+
+	void *data;
+	if (vdm->op_init != NULL) {
+		data = vdm->op_init(vdm, operation->type, slot);
+	} else {
+		data = vdm->op_new(vdm, operation->type);
+		*(void **)slot = data;
+	}
+
+	if (data == NULL) {
+		struct vdm_operation_output output;
+		output.type = operation->type;
+		output.result = VDM_ERROR_OUT_OF_MEMORY;
+		memcpy(vdm_compact_operation_ptr(&future.data), &output,
+			sizeof(output));
+		future.output.result = VDM_ERROR_OUT_OF_MEMORY;
+		FUTURE_INIT_COMPLETE(&future);
+	} else {
+		FUTURE_INIT(&future, vdm_compact_impl);
+		if (vdm->has_property != NULL)
+			future.base.has_property = vdm->has_property;
+	}
+
+	return future;
+}
+
+/*
+ * vdm_compact_memcpy -- instantiates a new compact future of a memcpy
+ * operation, in the slot provided by the caller
+ */
+static inline struct vdm_compact_future
+vdm_compact_memcpy(struct vdm *vdm, void *slot, void *dest, void *src,
+	size_t n, uint64_t flags)
+{
+	struct vdm_operation operation;
+	operation.type = VDM_OPERATION_MEMCPY;
+	operation.data.memcpy.dest = dest;
+	operation.data.memcpy.flags = flags;
+	operation.data.memcpy.n = n;
+	operation.data.memcpy.src = src;
+	operation.padding = 0;
+
+	return vdm_compact_operation(vdm, slot, &operation);
+}
+
+/*
+ * vdm_compact_memset -- instantiates a new compact future of a memset
+ * operation, in the slot provided by the caller
+ */
+static inline struct vdm_compact_future
+vdm_compact_memset(struct vdm *vdm, void *slot, void *str, int c, size_t n,
+	uint64_t flags)
+{
+	struct vdm_operation operation;
+	operation.type = VDM_OPERATION_MEMSET;
+	operation.data.memset.str = str;
+	operation.data.memset.flags = flags;
+	operation.data.memset.n = n;
+	operation.data.memset.c = c;
+	operation.padding = 0;
+
+	return vdm_compact_operation(vdm, slot, &operation);
+}
+
+/*
+ * vdm_compact_output -- returns the full output of the complete compact
+ * future, kept in its slot
+ */
+static inline struct vdm_operation_output *
+vdm_compact_output(struct vdm_compact_future *future)
+{
+	return (struct vdm_operation_output *)
+		vdm_compact_operation_ptr(&future->data);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,140 +1,2252 @@
 // SPDX-License-Identifier: BSD-3-Clause
 /* Copyright 2021-2022, Intel Corporation */
 
+#include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "libminiasync/runtime.h"
-#include "core/os_thread.h"
+#include "libminiasync/future_arena.h"
+#include "core/cpu.h"
+#include "core/eventcount.h"
+#include "core/membuf.h"
 #include "core/os.h"
+#include "core/os_thread.h"
+#include "core/reactor.h"
+#include "core/timerwheel.h"
+#include "core/tracepoint.h"
 #include "core/util.h"
 
-struct runtime_waker_data {
-	os_cond_t *cond;
-	os_mutex_t *lock;
+#define RUNTIME_SLOTS_PER_CHUNK 256
+#define RUNTIME_DEQUE_INITIAL_CAPACITY 64
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(_M_X64) || \
+	defined(_M_AMD64)
+#define RUNTIME_HAS_WAITPKG 1
+/*
+ * Upper bound of a single umwait, the runtime rechecks all futures
+ * (and eventually goes to sleep) after this many TSC cycles.
+ */
+#define RUNTIME_UMWAIT_TSC_CYCLES 100000ULL
+/* duration of a single RUNTIME_PAUSE_TPAUSE pause */
+#define RUNTIME_TPAUSE_TSC_CYCLES 1000ULL
+#endif
+
+#define RUNTIME_DEFAULT_SPINS_BEFORE_SLEEP 1000
+#define RUNTIME_DEFAULT_SLEEP_TIMEOUT_NSEC 1000000 /* 1ms */
+
+/* resolution of the timer wheel */
+#define RUNTIME_TIMER_TICK_NSEC 1000ULL
+#define RUNTIME_NSEC_IN_SEC 1000000000ULL
+
+/* bounds of the spin budget tuned by the adaptive policy */
+#define RUNTIME_ADAPTIVE_MIN_SPINS 16
+#define RUNTIME_ADAPTIVE_MAX_SPINS (1ULL << 20)
+
+/* reactor reports handled at once */
+#define RUNTIME_REACTOR_EVENTS 64
+#define RUNTIME_WATCHES_INITIAL_CAPACITY 16
+
+/* key of a watch, generation in the upper half and index in the lower one */
+#define RUNTIME_WATCH_INDEX_BITS 32
+#define RUNTIME_WATCH_INDEX_MASK ((1ULL << RUNTIME_WATCH_INDEX_BITS) - 1)
+#define RUNTIME_WATCH_GEN_MASK 0x7FFFFFFFU
+
+struct runtime;
+struct runtime_waiter;
+
+/*
+ * Each future polled by the runtime is assigned a slot, whose address is
+ * used as the waker data. Slots are never moved or freed before the runtime
+ * is deleted, so that a waker fired late (e.g., for a future abandoned by
+ * the caller) always points to valid memory.
+ */
+struct runtime_slot {
+	struct runtime_waiter *waiter;
+	struct runtime_slot *next_ready; /* link in the ready queue */
+	uint64_t woken; /* 1 - slot is on the ready queue, 0 - it's not */
+	size_t index; /* position of the slot in the slots array */
+	int parked; /* future waits for its waker, don't poll it */
+	int async; /* cached FUTURE_PROPERTY_ASYNC of the future */
+	uint64_t *ptr_to_monitor; /* last address reported by the poller */
+	uint64_t woken_at; /* time of the last wake, if stats are enabled */
+};
+
+struct runtime_slot_chunk {
+	struct runtime_slot_chunk *next;
+	struct runtime_slot slots[RUNTIME_SLOTS_PER_CHUNK];
+};
+
+/*
+ * Scheduling state of a call waiting for the futures. Each of the threads
+ * waiting on the runtime at once takes its own waiter, which is kept for
+ * the later calls once the wait is over.
+ */
+struct runtime_waiter {
+	struct runtime *runtime;
+	struct runtime_waiter *next; /* all the waiters of the runtime */
+	struct runtime_waiter *next_free;
+
+	/* wakes up the thread sleeping in runtime_wait_multiple() */
+	struct eventcount wakeup;
+
+	uint64_t spin_budget; /* current number of spins before sleep */
+	uint64_t spin_latency; /* average number of spins until progress */
+
+	/* lock-free stack of slots whose futures were woken up */
+	struct runtime_slot *ready;
+
+	struct runtime_slot_chunk *chunks;
+	struct runtime_slot **slots;
+	size_t nslots;
+
+	size_t *order; /* polling order, async futures first */
+	size_t *order_tmp;
+	size_t norder;
+};
+
+enum runtime_task_state {
+	RUNTIME_TASK_QUEUED,
+	RUNTIME_TASK_POLLING,
+	RUNTIME_TASK_NOTIFIED, /* woken up while being polled */
+	RUNTIME_TASK_PARKED,
+};
+
+#define RUNTIME_TASK_F_MEMBUF (1U << 0) /* allocated from the tasks membuf */
+#define RUNTIME_TASK_F_OWNED (1U << 1) /* the future is freed on completion */
+
+/*
+ * A spawned future, together with its scheduling state. Tasks are owned by
+ * the executors and freed once the future completes.
+ */
+struct runtime_task {
+	struct future *fut;
+	struct runtime *runtime;
+	size_t home; /* deque the task is pushed to when woken up */
+	uint64_t state;
+	uint64_t woken_at; /* time of the last wake, if stats are enabled */
+	unsigned flags;
+};
+
+/* the per-thread buffers of the tasks, the spawning threads allocate from */
+#define RUNTIME_TASKS_BUFFER_SIZE ((size_t)1 << 16)
+
+/*
+ * Double-ended queue of tasks. The owning executor pops tasks from the head
+ * and re-queues them at the tail, other executors steal from the tail.
+ */
+struct runtime_deque {
+	os_mutex_t lock;
+	struct runtime_task **tasks;
+	size_t capacity; /* power of two */
+	size_t head;
+	size_t tail;
+};
+
+/*
+ * Timer of a sleep or timeout future, allocated when the future is first
+ * polled and freed when it completes.
+ */
+struct runtime_timer {
+	struct timerwheel_entry entry;
+	struct future_waker waker;
+};
+
+/*
+ * Registration of an fd future in the reactor. Watches are reused, the key
+ * carries a generation, so that late reports for a previous registration
+ * are ignored.
+ */
+struct runtime_watch {
+	struct future_waker waker;
+	uint64_t key; /* key of the registration, 0 if the watch is free */
+	size_t next_free;
+	uint32_t gen;
+	int fd;
+	int handle; /* descriptor armed in the reactor */
+	unsigned revents; /* reported events */
 };
 
+struct runtime_executor {
+	struct runtime *runtime;
+	struct runtime_deque deque;
+	os_thread_t thread;
+	size_t id;
+};
+
+struct runtime {
+	struct runtime_policy policy;
+	struct runtime_stats *stats; /* NULL if disabled */
+
+	os_mutex_t waiters_lock;
+	struct runtime_waiter *waiters;
+	struct runtime_waiter *free_waiters; /* not taken by any call */
+
+	int waitpkg; /* umonitor/umwait are available */
+
+	/* executors driving the spawned futures */
+	struct runtime_executor *executors;
+	size_t nexecutors;
+	os_tls_key_t executor_key;
+	uint64_t next_executor; /* round-robin target for foreign spawns */
+	int stopping;
+	struct eventcount exec_event; /* new work for the idle executors */
+
+	struct membuf *tasks; /* of the spawned futures */
+	uint64_t nspawned; /* spawned futures not yet complete */
+	struct eventcount spawn_event; /* all spawned futures completed */
+
+	/* timers of the sleep and timeout futures, in ticks */
+	os_mutex_t timers_lock;
+	struct timerwheel timers;
+	uint64_t timers_next; /* earliest expiration, UINT64_MAX if none */
+
+	/* readiness of the descriptors awaited by the fd futures */
+	os_mutex_t reactor_lock;
+	struct reactor *reactor; /* created on first use */
+	struct runtime_watch *watches;
+	size_t watches_capacity;
+	size_t watches_free; /* head of the free list, SIZE_MAX if empty */
+	uint64_t nwatches; /* armed watches */
+	int reactor_owner; /* a thread waits in the reactor */
+	int reactor_blocked; /* the owner blocks, it needs an interrupt */
+};
+
+/*
+ * runtime_stats_add -- (internal) adds the value to the counter
+ */
+static inline void
+runtime_stats_add(uint64_t *counter, uint64_t value)
+{
+	if (value != 0)
+		util_fetch_and_add64(counter, value);
+}
+
+/*
+ * runtime_stats_record -- (internal) counts the value in the histogram
+ */
+static inline void
+runtime_stats_record(uint64_t *histogram, uint64_t value)
+{
+	unsigned bucket = value == 0 ? 0 : util_mssb_index64(value) + 1U;
+	if (bucket >= RUNTIME_STATS_BUCKETS)
+		bucket = RUNTIME_STATS_BUCKETS - 1;
+
+	util_fetch_and_add64(&histogram[bucket], 1);
+}
+
+/*
+ * runtime_stats_wake_latency -- (internal) records the latency of the wake,
+ * whose time was stored at woken_at
+ */
+static inline void
+runtime_stats_wake_latency(struct runtime_stats *stats, uint64_t *woken_at)
+{
+	uint64_t time;
+	util_atomic_load_explicit64(woken_at, &time, memory_order_acquire);
+	if (time == 0)
+		return;
+
+	util_atomic_store_explicit64(woken_at, 0, memory_order_relaxed);
+	uint64_t now = runtime_clock_now();
+	runtime_stats_record(stats->wake_latency, now > time ? now - time : 0);
+}
+
+/*
+ * runtime_reactor_interrupt -- (internal) makes the thread blocked in
+ * the reactor return, has to be called after the condition it waits for
+ * is changed
+ */
+static void
+runtime_reactor_interrupt(struct runtime *runtime)
+{
+	/* pairs with the barrier in runtime_block() */
+	util_synchronize();
+
+	int blocked;
+	util_atomic_load_explicit32(&runtime->reactor_blocked, &blocked,
+		memory_order_relaxed);
+	if (blocked &&
+	    util_bool_compare_and_swap32(&runtime->reactor_blocked, 1, 0))
+		reactor_interrupt(runtime->reactor);
+}
+
+/*
+ * runtime_waker_wake -- puts the slot of the woken future on the ready queue
+ * and notifies the sleeping runtime thread
+ */
 static void
 runtime_waker_wake(void *fdata)
 {
-	struct runtime_waker_data *data = fdata;
-	os_mutex_lock(data->lock);
-	os_cond_signal(data->cond);
-	os_mutex_unlock(data->lock);
+	struct runtime_slot *slot = fdata;
+	struct runtime_waiter *waiter = slot->waiter;
+	struct runtime *runtime = waiter->runtime;
+	TRACEPOINT(runtime_wake, runtime, slot);
+
+	if (runtime->stats != NULL) {
+		util_fetch_and_add64(&runtime->stats->wakes, 1);
+		util_atomic_store_explicit64(&slot->woken_at,
+			runtime_clock_now(), memory_order_release);
+	}
+
+	/* the slot is already on the ready queue */
+	if (!util_bool_compare_and_swap64(&slot->woken, 0, 1))
+		return;
+
+	struct runtime_slot *head;
+	do {
+		util_atomic_load_explicit64(&waiter->ready, &head,
+			memory_order_acquire);
+		slot->next_ready = head;
+	} while (!util_bool_compare_and_swap64(&waiter->ready, head, slot));
+
+	eventcount_notify_one(&waiter->wakeup);
+	runtime_reactor_interrupt(runtime);
 }
 
-struct runtime {
-	os_cond_t cond;
-	os_mutex_t lock;
+/*
+ * runtime_policy_default -- fills the policy with the defaults used by
+ * runtime_new()
+ */
+void
+runtime_policy_default(struct runtime_policy *policy)
+{
+	policy->spins_before_sleep = RUNTIME_DEFAULT_SPINS_BEFORE_SLEEP;
+	policy->pause = RUNTIME_PAUSE_CPU;
+	policy->max_backoff = 1;
+	policy->sleep_timeout =
+		(struct timespec){0, RUNTIME_DEFAULT_SLEEP_TIMEOUT_NSEC};
+	policy->adaptive = 0;
+	policy->stats = 0;
+}
 
-	uint64_t spins_before_sleep;
-	struct timespec cond_wait_time;
-};
+/*
+ * runtime_adaptive_max_spins -- (internal) returns the maximum spin
+ * budget of the adaptive policy
+ */
+static uint64_t
+runtime_adaptive_max_spins(struct runtime *runtime)
+{
+	return runtime->policy.spins_before_sleep < RUNTIME_ADAPTIVE_MAX_SPINS ?
+		runtime->policy.spins_before_sleep : RUNTIME_ADAPTIVE_MAX_SPINS;
+}
 
 struct runtime *
 runtime_new(void)
 {
+	return runtime_new_ex(NULL);
+}
+
+struct runtime *
+runtime_new_ex(const struct runtime_policy *policy)
+{
+	struct runtime_policy defaults;
+	if (policy == NULL) {
+		runtime_policy_default(&defaults);
+		policy = &defaults;
+	}
+
+	switch (policy->pause) {
+		case RUNTIME_PAUSE_CPU:
+		case RUNTIME_PAUSE_YIELD:
+		case RUNTIME_PAUSE_TPAUSE:
+			break;
+		default:
+			return NULL;
+	}
+	if (policy->max_backoff == 0 ||
+	    policy->sleep_timeout.tv_sec < 0 ||
+	    policy->sleep_timeout.tv_nsec < 0 ||
+	    policy->sleep_timeout.tv_nsec >= 1000000000L)
+		return NULL;
+
 	struct runtime *runtime = malloc(sizeof(struct runtime));
 	if (runtime == NULL)
 		return NULL;
 
-	os_cond_init(&runtime->cond);
-	os_mutex_init(&runtime->lock);
-	runtime->spins_before_sleep = 1000;
-	runtime->cond_wait_time = (struct timespec){0, 1000000};
+	runtime->stats = NULL;
+	if (policy->stats) {
+		runtime->stats = calloc(1, sizeof(struct runtime_stats));
+		if (runtime->stats == NULL) {
+			free(runtime);
+			return NULL;
+		}
+	}
+
+	runtime->policy = *policy;
+	os_mutex_init(&runtime->waiters_lock);
+	runtime->waiters = NULL;
+	runtime->free_waiters = NULL;
+
+#ifdef RUNTIME_HAS_WAITPKG
+	runtime->waitpkg = is_cpu_waitpkg_present();
+#else
+	runtime->waitpkg = 0;
+#endif
+
+	runtime->executors = NULL;
+	runtime->nexecutors = 0;
+	runtime->next_executor = 0;
+	runtime->stopping = 0;
+	eventcount_init(&runtime->exec_event);
+	runtime->nspawned = 0;
+	eventcount_init(&runtime->spawn_event);
+
+	os_mutex_init(&runtime->timers_lock);
+	timerwheel_init(&runtime->timers,
+		runtime_clock_now() / RUNTIME_TIMER_TICK_NSEC);
+	runtime->timers_next = UINT64_MAX;
+
+	os_mutex_init(&runtime->reactor_lock);
+	runtime->reactor = NULL;
+	runtime->watches = NULL;
+	runtime->watches_capacity = 0;
+	runtime->watches_free = SIZE_MAX;
+	runtime->nwatches = 0;
+	runtime->reactor_owner = 0;
+	runtime->reactor_blocked = 0;
 
 	return runtime;
 }
 
+static void runtime_executors_stop(struct runtime *runtime);
+
 void
 runtime_delete(struct runtime *runtime)
 {
+	runtime_executors_stop(runtime);
+
+	/* timers of the futures that were never completed */
+	struct timerwheel_entry *timers =
+		timerwheel_advance(&runtime->timers, UINT64_MAX);
+	while (timers != NULL) {
+		struct timerwheel_entry *next = timers->next;
+		free(timers);
+		timers = next;
+	}
+	os_mutex_destroy(&runtime->timers_lock);
+
+	/* watches of the fd futures that were never completed */
+	for (size_t i = 0; i < runtime->watches_capacity; ++i) {
+		struct runtime_watch *watch = &runtime->watches[i];
+		if (watch->key != 0)
+			reactor_disarm(runtime->reactor, watch->fd,
+				watch->handle);
+	}
+	free(runtime->watches);
+	if (runtime->reactor != NULL)
+		reactor_delete(runtime->reactor);
+	os_mutex_destroy(&runtime->reactor_lock);
+
+	for (struct runtime_waiter *w = runtime->waiters; w != NULL; ) {
+		struct runtime_waiter *next = w->next;
+		for (struct runtime_slot_chunk *c = w->chunks; c != NULL; ) {
+			struct runtime_slot_chunk *next_chunk = c->next;
+			free(c);
+			c = next_chunk;
+		}
+		free(w->slots);
+		free(w->order);
+		free(w->order_tmp);
+		free(w);
+		w = next;
+	}
+	os_mutex_destroy(&runtime->waiters_lock);
+	free(runtime->stats);
 	free(runtime);
 }
 
-static void
-runtime_sleep(struct runtime *runtime)
+/*
+ * runtime_clock_now -- returns the current time of the monotonic clock
+ * in nanoseconds
+ */
+uint64_t
+runtime_clock_now(void)
 {
-	os_mutex_lock(&runtime->lock);
 	struct timespec ts;
-	os_clock_gettime(CLOCK_REALTIME, &ts);
-	static const size_t nsec_in_sec = 1000000000ULL;
-	ts.tv_nsec += runtime->cond_wait_time.tv_nsec;
-	uint64_t secs = (uint64_t)ts.tv_nsec / nsec_in_sec;
-	ts.tv_nsec -= (long)(secs * nsec_in_sec);
-	ts.tv_sec += (long)(runtime->cond_wait_time.tv_sec + (long)secs);
+	os_clock_gettime(CLOCK_MONOTONIC, &ts);
 
-	os_cond_timedwait(&runtime->cond, &runtime->lock, &ts);
-	os_mutex_unlock(&runtime->lock);
+	return (uint64_t)ts.tv_sec * RUNTIME_NSEC_IN_SEC + (uint64_t)ts.tv_nsec;
 }
 
-int
-future_compare_async(const void *first_fut, const void *second_fut)
-{
-	enum future_property property = FUTURE_PROPERTY_ASYNC;
-	struct future *fut1 = *(struct future **)first_fut;
-	struct future *fut2 = *(struct future **)second_fut;
-
-	if (future_has_property(fut1, property) ==
-			future_has_property(fut2, property))
-				return 0;
-	if (future_has_property(fut1, property) >
-			future_has_property(fut2, property))
-				return -1;
+/*
+ * runtime_timers_update -- (internal) publishes the earliest expiration
+ * time of the timers, has to be called with the timers lock held
+ */
+static void
+runtime_timers_update(struct runtime *runtime)
+{
+	uint64_t next;
+	if (!timerwheel_next(&runtime->timers, &next))
+		next = UINT64_MAX;
+	util_atomic_store_explicit64(&runtime->timers_next, next,
+		memory_order_release);
+}
+
+/*
+ * runtime_timers_process -- (internal) fires the wakers of the expired
+ * timers
+ */
+static void
+runtime_timers_process(struct runtime *runtime)
+{
+	uint64_t next;
+	util_atomic_load_explicit64(&runtime->timers_next, &next,
+		memory_order_acquire);
+	if (next == UINT64_MAX)
+		return;
+
+	uint64_t now = runtime_clock_now() / RUNTIME_TIMER_TICK_NSEC;
+	if (now < next)
+		return;
+
+	os_mutex_lock(&runtime->timers_lock);
+	struct timerwheel_entry *expired =
+		timerwheel_advance(&runtime->timers, now);
+	while (expired != NULL) {
+		struct runtime_timer *timer = (struct runtime_timer *)expired;
+		expired = expired->next;
+		/* under the lock, the future can't free the timer meanwhile */
+		FUTURE_WAKER_WAKE(&timer->waker);
+		if (runtime->stats != NULL)
+			util_fetch_and_add64(&runtime->stats->timers_fired, 1);
+	}
+	runtime_timers_update(runtime);
+	os_mutex_unlock(&runtime->timers_lock);
+}
+
+/*
+ * runtime_timers_timeout -- (internal) shortens the timeout, so that it
+ * doesn't extend past the earliest timer. Returns 0 if a timer has
+ * already expired.
+ */
+static int
+runtime_timers_timeout(struct runtime *runtime,
+	const struct timespec **timeout, struct timespec *buf)
+{
+	uint64_t next;
+	util_atomic_load_explicit64(&runtime->timers_next, &next,
+		memory_order_acquire);
+	if (next == UINT64_MAX)
+		return 1;
+
+	uint64_t now = runtime_clock_now();
+	if (next <= now / RUNTIME_TIMER_TICK_NSEC)
+		return 0;
+
+	uint64_t rel = next * RUNTIME_TIMER_TICK_NSEC - now;
+	if (*timeout != NULL && (uint64_t)(*timeout)->tv_sec <
+			rel / RUNTIME_NSEC_IN_SEC)
+		return 1;
+	if (*timeout != NULL && (uint64_t)(*timeout)->tv_sec ==
+			rel / RUNTIME_NSEC_IN_SEC &&
+	    (uint64_t)(*timeout)->tv_nsec <= rel % RUNTIME_NSEC_IN_SEC)
+		return 1;
+
+	buf->tv_sec = (time_t)(rel / RUNTIME_NSEC_IN_SEC);
+	buf->tv_nsec = (long)(rel % RUNTIME_NSEC_IN_SEC);
+	*timeout = buf;
+
 	return 1;
 }
 
-void
-runtime_wait_multiple(struct runtime *runtime, struct future *futs[],
-						size_t nfuts)
+/*
+ * runtime_timer_arm -- (internal) makes sure that the timer, allocated if
+ * necessary, fires the notifier's waker at the deadline. Returns -1 if
+ * the waker can't be used.
+ */
+static int
+runtime_timer_arm(struct runtime *runtime, struct runtime_timer **timerp,
+	uint64_t deadline, struct future_notifier *notifier)
 {
-	struct runtime_waker_data waker_data;
-	waker_data.cond = &runtime->cond;
-	waker_data.lock = &runtime->lock;
+	if (notifier == NULL)
+		return -1;
 
-	struct future_notifier notifier;
-	notifier.waker = (struct future_waker){&waker_data, runtime_waker_wake};
-	notifier.poller.ptr_to_monitor = NULL;
-	size_t ndone = 0;
+	struct runtime_timer *timer = *timerp;
+	if (timer == NULL) {
+		timer = malloc(sizeof(struct runtime_timer));
+		if (timer == NULL)
+			return -1;
+		timer->entry.next = NULL;
+		timer->entry.pprev = NULL;
+		*timerp = timer;
+	}
 
-	for (;;) {
-		for (uint64_t i = 0; i < runtime->spins_before_sleep; ++i) {
-			qsort(futs, nfuts, sizeof(struct future *),
-					future_compare_async);
-			for (uint64_t f = 0; f < nfuts; ++f) {
-				struct future *fut = futs[f];
-				if (fut->context.state == FUTURE_STATE_COMPLETE)
-					continue;
-
-				if (future_poll(fut, &notifier) ==
-				    FUTURE_STATE_COMPLETE) {
-					ndone++;
-				}
-				switch (notifier.notifier_used) {
-					case FUTURE_NOTIFIER_POLLER:
-					/*
-					 * TODO: if this is the only future
-					 * being polled, use umwait/umonitor
-					 * for power-optimized polling.
-					 */
-					break;
-					case FUTURE_NOTIFIER_WAKER:
-					case FUTURE_NOTIFIER_NONE:
-					/* nothing to do for wakers or none */
-					break;
-				};
-			}
+	os_mutex_lock(&runtime->timers_lock);
+	timer->waker = notifier->waker;
+	if (!timerwheel_entry_inserted(&timer->entry)) {
+		/* round up, so that the timer never fires early */
+		uint64_t expires = deadline / RUNTIME_TIMER_TICK_NSEC +
+			(deadline % RUNTIME_TIMER_TICK_NSEC != 0);
+		timerwheel_insert(&runtime->timers, &timer->entry, expires);
+		runtime_timers_update(runtime);
+	}
+	os_mutex_unlock(&runtime->timers_lock);
 
-			if (ndone == nfuts)
-				return;
+	return 0;
+}
 
-			WAIT();
+/*
+ * runtime_timer_cancel -- (internal) removes and frees the timer
+ */
+static void
+runtime_timer_cancel(struct runtime *runtime, struct runtime_timer **timerp)
+{
+	struct runtime_timer *timer = *timerp;
+	if (timer == NULL)
+		return;
+
+	os_mutex_lock(&runtime->timers_lock);
+	timerwheel_remove(&runtime->timers, &timer->entry);
+	runtime_timers_update(runtime);
+	os_mutex_unlock(&runtime->timers_lock);
+
+	free(timer);
+	*timerp = NULL;
+}
+
+/*
+ * runtime_sleep_task -- (internal) task of the sleep future
+ */
+static enum future_state
+runtime_sleep_task(struct future_context *context,
+	struct future_notifier *notifier)
+{
+	struct runtime_sleep_data *data = future_context_get_data(context);
+	struct runtime_sleep_output *output =
+		future_context_get_output(context);
+
+	uint64_t now = runtime_clock_now();
+	if (now >= data->deadline) {
+		runtime_timer_cancel(data->runtime, &data->timer);
+		output->time = now;
+		return FUTURE_STATE_COMPLETE;
+	}
+
+	if (runtime_timer_arm(data->runtime, &data->timer, data->deadline,
+			notifier) == 0)
+		notifier->notifier_used = FUTURE_NOTIFIER_WAKER;
+
+	return FUTURE_STATE_RUNNING;
+}
+
+/*
+ * runtime_sleep_has_property -- (internal) sleeping doesn't use the CPU
+ */
+static int
+runtime_sleep_has_property(void *future, enum future_property property)
+{
+	SUPPRESS_UNUSED(future);
+
+	return property == FUTURE_PROPERTY_ASYNC;
+}
+
+/*
+ * runtime_sleep_until -- creates a future, which completes once the clock
+ * reaches the deadline
+ */
+struct runtime_sleep_future
+runtime_sleep_until(struct runtime *runtime, uint64_t deadline)
+{
+	struct runtime_sleep_future fut = {.output.time = 0};
+	fut.data.runtime = runtime;
+	fut.data.deadline = deadline;
+	fut.data.timer = NULL;
+	FUTURE_INIT_EXT(&fut, runtime_sleep_task, runtime_sleep_has_property);
+
+	return fut;
+}
+
+/*
+ * runtime_sleep_for -- creates a future, which completes after
+ * the duration, counted from now
+ */
+struct runtime_sleep_future
+runtime_sleep_for(struct runtime *runtime, uint64_t duration)
+{
+	return runtime_sleep_until(runtime, runtime_clock_now() + duration);
+}
+
+/*
+ * runtime_sleep_cancel -- removes the timer of the sleep future and
+ * completes it right away, returns -1 if it's already complete
+ */
+int
+runtime_sleep_cancel(void *future)
+{
+	struct runtime_sleep_future *fut = future;
+	if (FUTURE_STATE(fut) == FUTURE_STATE_COMPLETE)
+		return -1;
+
+	runtime_timer_cancel(fut->data.runtime, &fut->data.timer);
+	fut->output.time = runtime_clock_now();
+	fut->base.context.state = FUTURE_STATE_COMPLETE;
+
+	return 0;
+}
+
+/*
+ * runtime_timeout_task -- (internal) task of the timeout future
+ */
+static enum future_state
+runtime_timeout_task(struct future_context *context,
+	struct future_notifier *notifier)
+{
+	struct runtime_timeout_data *data = future_context_get_data(context);
+	struct runtime_timeout_output *output =
+		future_context_get_output(context);
+
+	if (future_poll(data->fut, notifier) == FUTURE_STATE_COMPLETE) {
+		runtime_timer_cancel(data->runtime, &data->timer);
+		output->timed_out = 0;
+		return FUTURE_STATE_COMPLETE;
+	}
+
+	/* the timeout has the properties of the wrapped future */
+	context->properties = data->fut->context.properties;
+
+	if (runtime_clock_now() >= data->deadline) {
+		runtime_timer_cancel(data->runtime, &data->timer);
+		output->timed_out = 1;
+		return FUTURE_STATE_COMPLETE;
+	}
+
+	/*
+	 * Futures that don't use the waker are polled anyway, they notice
+	 * the deadline on their own.
+	 */
+	if (notifier != NULL &&
+	    notifier->notifier_used == FUTURE_NOTIFIER_WAKER &&
+	    runtime_timer_arm(data->runtime, &data->timer, data->deadline,
+			notifier) != 0)
+		notifier->notifier_used = FUTURE_NOTIFIER_NONE;
+
+	return FUTURE_STATE_RUNNING;
+}
+
+/*
+ * runtime_timeout_has_property -- (internal) forwards the query to
+ * the wrapped future
+ */
+static int
+runtime_timeout_has_property(void *future, enum future_property property)
+{
+	struct runtime_timeout_future *fut = future;
+
+	return future_has_property(fut->data.fut, property);
+}
+
+/*
+ * runtime_timeout -- creates a future, which polls the given future until it
+ * completes or the deadline passes, whichever comes first
+ */
+struct runtime_timeout_future
+runtime_timeout(struct runtime *runtime, struct future *fut,
+	uint64_t deadline)
+{
+	struct runtime_timeout_future timeout = {.output.timed_out = 0};
+	timeout.data.runtime = runtime;
+	timeout.data.fut = fut;
+	timeout.data.deadline = deadline;
+	timeout.data.timer = NULL;
+	FUTURE_INIT_EXT(&timeout, runtime_timeout_task,
+		runtime_timeout_has_property);
+
+	return timeout;
+}
+
+/*
+ * runtime_reactor_dispatch -- (internal) fires the wakers of the reported
+ * watches
+ */
+static void
+runtime_reactor_dispatch(struct runtime *runtime,
+	const struct reactor_event *events, int nevents)
+{
+	os_mutex_lock(&runtime->reactor_lock);
+	for (int i = 0; i < nevents; ++i) {
+		size_t index = (size_t)(events[i].key &
+			RUNTIME_WATCH_INDEX_MASK);
+		if (index >= runtime->watches_capacity)
+			continue;
+
+		struct runtime_watch *watch = &runtime->watches[index];
+		/* the watch was freed, or reused for another future */
+		if (watch->key != events[i].key)
+			continue;
+
+		watch->revents |= events[i].events;
+		/* under the lock, the future can't free the watch meanwhile */
+		if (watch->waker.wake != NULL)
+			FUTURE_WAKER_WAKE(&watch->waker);
+	}
+	os_mutex_unlock(&runtime->reactor_lock);
+}
+
+/*
+ * runtime_reactor_acquire -- (internal) returns 1 if the calling thread
+ * became the only one waiting in the reactor. Returns 0 if there are no
+ * armed watches or the reactor is taken.
+ */
+static int
+runtime_reactor_acquire(struct runtime *runtime)
+{
+	uint64_t nwatches;
+	util_atomic_load_explicit64(&runtime->nwatches, &nwatches,
+		memory_order_acquire);
+	if (nwatches == 0)
+		return 0;
+
+	return util_bool_compare_and_swap32(&runtime->reactor_owner, 0, 1);
+}
+
+/*
+ * runtime_reactor_release -- (internal) lets the other threads wait in
+ * the reactor
+ */
+static void
+runtime_reactor_release(struct runtime *runtime)
+{
+	util_atomic_store_explicit32(&runtime->reactor_owner, 0,
+		memory_order_release);
+}
+
+/*
+ * runtime_reactor_process -- (internal) fires the wakers of the watches,
+ * whose descriptors are ready, without blocking
+ */
+static void
+runtime_reactor_process(struct runtime *runtime)
+{
+	if (!runtime_reactor_acquire(runtime))
+		return;
+
+	struct reactor_event events[RUNTIME_REACTOR_EVENTS];
+	struct timespec zero = {0, 0};
+	int nevents = reactor_wait(runtime->reactor, events,
+		RUNTIME_REACTOR_EVENTS, &zero);
+	if (nevents > 0)
+		runtime_reactor_dispatch(runtime, events, nevents);
+
+	runtime_reactor_release(runtime);
+}
+
+/*
+ * runtime_block -- (internal) works like eventcount_wait(), but blocks in
+ * the reactor if some descriptors are watched and no other thread waits
+ * there. Returns -1 on timeout.
+ */
+static int
+runtime_block(struct runtime *runtime, struct eventcount *ec, uint32_t key,
+	const struct timespec *timeout)
+{
+	if (!runtime_reactor_acquire(runtime)) {
+		uint64_t nwatches;
+		util_atomic_load_explicit64(&runtime->nwatches, &nwatches,
+			memory_order_acquire);
+		/*
+		 * The thread waiting in the reactor can leave it at any time,
+		 * come back to take its place.
+		 */
+		const struct timespec *max = &runtime->policy.sleep_timeout;
+		if (nwatches != 0 && (timeout == NULL ||
+		    timeout->tv_sec > max->tv_sec ||
+		    (timeout->tv_sec == max->tv_sec &&
+		    timeout->tv_nsec > max->tv_nsec)))
+			timeout = max;
+
+		return eventcount_wait(ec, key, timeout);
+	}
+
+	util_atomic_store_explicit32(&runtime->reactor_blocked, 1,
+		memory_order_relaxed);
+	/* pairs with the barrier in runtime_reactor_interrupt() */
+	util_synchronize();
+
+	uint32_t epoch;
+	int nevents = 0;
+	struct reactor_event events[RUNTIME_REACTOR_EVENTS];
+	util_atomic_load_explicit32(&ec->epoch, &epoch, memory_order_acquire);
+	if (epoch == key) {
+		nevents = reactor_wait(runtime->reactor, events,
+			RUNTIME_REACTOR_EVENTS, timeout);
+	}
+
+	util_atomic_store_explicit32(&runtime->reactor_blocked, 0,
+		memory_order_relaxed);
+	if (nevents > 0)
+		runtime_reactor_dispatch(runtime, events, nevents);
+	runtime_reactor_release(runtime);
+
+	eventcount_cancel(ec);
+	util_atomic_load_explicit32(&ec->epoch, &epoch, memory_order_acquire);
+
+	return nevents <= 0 && epoch == key ? -1 : 0;
+}
+
+/*
+ * runtime_watch_arm -- (internal) allocates a watch for the fd future and
+ * arms its descriptor, has to be called with the reactor lock held.
+ * Descriptors, which don't support polling, are reported as ready at once.
+ */
+static int
+runtime_watch_arm(struct runtime *runtime, struct runtime_fd_data *data,
+	struct future_notifier *notifier, unsigned *revents)
+{
+	if (runtime->reactor == NULL) {
+		runtime->reactor = reactor_new();
+		if (runtime->reactor == NULL)
+			return -1;
+	}
+
+	if (runtime->watches_free == SIZE_MAX) {
+		size_t capacity = runtime->watches_capacity == 0 ?
+			RUNTIME_WATCHES_INITIAL_CAPACITY :
+			runtime->watches_capacity * 2;
+		if (capacity > RUNTIME_WATCH_INDEX_MASK) {
+			errno = ENOMEM;
+			return -1;
+		}
+
+		struct runtime_watch *watches = realloc(runtime->watches,
+			sizeof(struct runtime_watch) * capacity);
+		if (watches == NULL)
+			return -1;
+
+		for (size_t i = runtime->watches_capacity; i < capacity; ++i) {
+			watches[i].key = 0;
+			watches[i].gen = 0;
+			watches[i].next_free = i + 1 == capacity ?
+				SIZE_MAX : i + 1;
 		}
-		runtime_sleep(runtime);
+		runtime->watches_free = runtime->watches_capacity;
+		runtime->watches = watches;
+		runtime->watches_capacity = capacity;
+	}
+
+	size_t index = runtime->watches_free;
+	struct runtime_watch *watch = &runtime->watches[index];
+	uint32_t gen = (watch->gen + 1) & RUNTIME_WATCH_GEN_MASK;
+	if (gen == 0)
+		gen = 1;
+	uint64_t key = (uint64_t)gen << RUNTIME_WATCH_INDEX_BITS | index;
+
+	if (reactor_arm(runtime->reactor, data->fd, data->events, key,
+			&watch->handle) != 0) {
+		if (errno != EPERM)
+			return -1;
+
+		/* e.g., regular files, which are always ready */
+		*revents = data->events;
+		return 0;
 	}
+
+	runtime->watches_free = watch->next_free;
+	watch->gen = gen;
+	watch->key = key;
+	watch->fd = data->fd;
+	watch->revents = 0;
+	watch->waker.data = NULL;
+	watch->waker.wake = NULL;
+	if (notifier != NULL)
+		watch->waker = notifier->waker;
+	data->watch = key;
+
+	/* the reactor has to be visible to the threads seeing the watch */
+	util_fetch_and_add64(&runtime->nwatches, 1);
+
+	return 0;
 }
 
-void
-runtime_wait(struct runtime *runtime, struct future *fut)
+/*
+ * runtime_watch_free -- (internal) disarms and frees the watch of the fd
+ * future, has to be called with the reactor lock held
+ */
+static void
+runtime_watch_free(struct runtime *runtime, struct runtime_fd_data *data)
 {
-	runtime_wait_multiple(runtime, &fut, 1);
+	size_t index = (size_t)(data->watch & RUNTIME_WATCH_INDEX_MASK);
+	struct runtime_watch *watch = &runtime->watches[index];
+
+	reactor_disarm(runtime->reactor, watch->fd, watch->handle);
+	watch->key = 0;
+	watch->next_free = runtime->watches_free;
+	runtime->watches_free = index;
+	data->watch = 0;
+
+	util_fetch_and_sub64(&runtime->nwatches, 1);
+}
+
+/*
+ * runtime_watch_poll -- (internal) arms the watch of the fd future on
+ * the first poll and collects the reported events on the next ones
+ */
+static int
+runtime_watch_poll(struct runtime *runtime, struct runtime_fd_data *data,
+	struct future_notifier *notifier, unsigned *revents)
+{
+	/* nobody else might be driving the reactor */
+	if (notifier == NULL)
+		runtime_reactor_process(runtime);
+
+	int ret = 0;
+	*revents = 0;
+
+	os_mutex_lock(&runtime->reactor_lock);
+	if (data->watch == 0) {
+		ret = runtime_watch_arm(runtime, data, notifier, revents);
+	} else {
+		size_t index = (size_t)(data->watch & RUNTIME_WATCH_INDEX_MASK);
+		struct runtime_watch *watch = &runtime->watches[index];
+		*revents = watch->revents;
+		if (*revents != 0)
+			runtime_watch_free(runtime, data);
+		else if (notifier != NULL)
+			watch->waker = notifier->waker;
+	}
+	os_mutex_unlock(&runtime->reactor_lock);
+
+	return ret;
+}
+
+/*
+ * runtime_fd_task -- (internal) task of the fd future
+ */
+static enum future_state
+runtime_fd_task(struct future_context *context,
+	struct future_notifier *notifier)
+{
+	struct runtime_fd_data *data = future_context_get_data(context);
+	struct runtime_fd_output *output = future_context_get_output(context);
+
+	/* without a waker, there's no point in arming the descriptor */
+	unsigned revents = 0;
+	int ret = notifier == NULL && data->watch == 0 ?
+		reactor_check(data->fd, data->events, &revents) :
+		runtime_watch_poll(data->runtime, data, notifier, &revents);
+	if (ret != 0) {
+		output->events = 0;
+		output->error = errno;
+		return FUTURE_STATE_COMPLETE;
+	}
+
+	if (revents != 0) {
+		output->events = revents;
+		output->error = 0;
+		return FUTURE_STATE_COMPLETE;
+	}
+
+	if (notifier != NULL)
+		notifier->notifier_used = FUTURE_NOTIFIER_WAKER;
+
+	return FUTURE_STATE_RUNNING;
+}
+
+/*
+ * runtime_fd_has_property -- (internal) waiting for a descriptor doesn't
+ * use the CPU
+ */
+static int
+runtime_fd_has_property(void *future, enum future_property property)
+{
+	SUPPRESS_UNUSED(future);
+
+	return property == FUTURE_PROPERTY_ASYNC;
+}
+
+/*
+ * runtime_fd_ready -- creates a future, which completes once the file
+ * descriptor is ready for any of the events
+ */
+struct runtime_fd_future
+runtime_fd_ready(struct runtime *runtime, int fd, unsigned events)
+{
+	COMPILE_ERROR_ON(RUNTIME_FD_READABLE != REACTOR_READABLE);
+	COMPILE_ERROR_ON(RUNTIME_FD_WRITABLE != REACTOR_WRITABLE);
+	COMPILE_ERROR_ON(RUNTIME_FD_ERROR != REACTOR_ERROR);
+
+	struct runtime_fd_future fut = {.output.events = 0};
+	fut.data.runtime = runtime;
+	fut.data.fd = fd;
+	fut.data.events = events & (RUNTIME_FD_READABLE | RUNTIME_FD_WRITABLE);
+	fut.data.watch = 0;
+	FUTURE_INIT_EXT(&fut, runtime_fd_task, runtime_fd_has_property);
+
+	return fut;
+}
+
+/*
+ * runtime_waiter_acquire -- (internal) takes a waiter not used by any other
+ * call, or creates a new one
+ */
+static struct runtime_waiter *
+runtime_waiter_acquire(struct runtime *runtime)
+{
+	os_mutex_lock(&runtime->waiters_lock);
+	struct runtime_waiter *waiter = runtime->free_waiters;
+	if (waiter != NULL)
+		runtime->free_waiters = waiter->next_free;
+	os_mutex_unlock(&runtime->waiters_lock);
+	if (waiter != NULL)
+		return waiter;
+
+	waiter = malloc(sizeof(struct runtime_waiter));
+	if (waiter == NULL)
+		return NULL;
+
+	waiter->runtime = runtime;
+	waiter->next_free = NULL;
+	eventcount_init(&waiter->wakeup);
+	waiter->spin_budget = runtime->policy.spins_before_sleep;
+	if (runtime->policy.adaptive) {
+		waiter->spin_budget = runtime_adaptive_max_spins(runtime);
+		waiter->spin_latency = waiter->spin_budget / 2;
+	} else {
+		waiter->spin_latency = 0;
+	}
+	waiter->ready = NULL;
+	waiter->chunks = NULL;
+	waiter->slots = NULL;
+	waiter->nslots = 0;
+	waiter->order = NULL;
+	waiter->order_tmp = NULL;
+	waiter->norder = 0;
+
+	os_mutex_lock(&runtime->waiters_lock);
+	waiter->next = runtime->waiters;
+	runtime->waiters = waiter;
+	os_mutex_unlock(&runtime->waiters_lock);
+
+	return waiter;
+}
+
+/*
+ * runtime_waiter_release -- (internal) keeps the waiter for the later calls
+ */
+static void
+runtime_waiter_release(struct runtime_waiter *waiter)
+{
+	struct runtime *runtime = waiter->runtime;
+
+	os_mutex_lock(&runtime->waiters_lock);
+	waiter->next_free = runtime->free_waiters;
+	runtime->free_waiters = waiter;
+	os_mutex_unlock(&runtime->waiters_lock);
+}
+
+/*
+ * runtime_reserve -- (internal) makes sure that the waiter has at least
+ * nfuts slots and enough space for the polling order arrays
+ */
+static int
+runtime_reserve(struct runtime_waiter *waiter, size_t nfuts)
+{
+	if (nfuts > waiter->norder) {
+		size_t *order = realloc(waiter->order, sizeof(size_t) * nfuts);
+		if (order == NULL)
+			return -1;
+		waiter->order = order;
+
+		size_t *order_tmp = realloc(waiter->order_tmp,
+			sizeof(size_t) * nfuts);
+		if (order_tmp == NULL)
+			return -1;
+		waiter->order_tmp = order_tmp;
+
+		waiter->norder = nfuts;
+	}
+
+	if (nfuts <= waiter->nslots)
+		return 0;
+
+	size_t nslots = ALIGN_UP(nfuts, (size_t)RUNTIME_SLOTS_PER_CHUNK);
+	struct runtime_slot **slots = realloc(waiter->slots,
+		sizeof(struct runtime_slot *) * nslots);
+	if (slots == NULL)
+		return -1;
+	waiter->slots = slots;
+
+	while (waiter->nslots < nslots) {
+		struct runtime_slot_chunk *chunk =
+			malloc(sizeof(struct runtime_slot_chunk));
+		if (chunk == NULL)
+			return -1;
+
+		for (size_t i = 0; i < RUNTIME_SLOTS_PER_CHUNK; ++i) {
+			struct runtime_slot *slot = &chunk->slots[i];
+			slot->waiter = waiter;
+			slot->next_ready = NULL;
+			slot->woken = 0;
+			slot->index = waiter->nslots;
+			slot->parked = 0;
+			slot->async = 0;
+			slot->ptr_to_monitor = NULL;
+			slot->woken_at = 0;
+			waiter->slots[waiter->nslots++] = slot;
+		}
+		chunk->next = waiter->chunks;
+		waiter->chunks = chunk;
+	}
+
+	return 0;
+}
+
+/*
+ * runtime_drain_ready -- (internal) unparks all futures that were woken up
+ * since the last call, returns the number of drained slots
+ */
+static size_t
+runtime_drain_ready(struct runtime_waiter *waiter, size_t nfuts)
+{
+	struct runtime_slot *head;
+	do {
+		util_atomic_load_explicit64(&waiter->ready, &head,
+			memory_order_acquire);
+	} while (head != NULL &&
+		!util_bool_compare_and_swap64(&waiter->ready, head, NULL));
+
+	size_t ndrained = 0;
+	while (head != NULL) {
+		/* the link can be overwritten once the slot is unmarked */
+		struct runtime_slot *next = head->next_ready;
+		util_atomic_store_explicit64(&head->woken, 0,
+			memory_order_release);
+
+		/* ignore late wakes of slots not used by the current call */
+		if (head->index < nfuts) {
+			head->parked = 0;
+			ndrained++;
+		}
+		head = next;
+	}
+
+	return ndrained;
+}
+
+/*
+ * runtime_partition -- (internal) stable partition of the polling order,
+ * so that asynchronous futures are polled first
+ */
+static void
+runtime_partition(struct runtime_waiter *waiter, size_t norder)
+{
+	size_t *order = waiter->order;
+	size_t *tmp = waiter->order_tmp;
+	size_t nasync = 0;
+	size_t nsync = 0;
+
+	for (size_t i = 0; i < norder; ++i) {
+		if (waiter->slots[order[i]]->async)
+			order[nasync++] = order[i];
+		else
+			tmp[nsync++] = order[i];
+	}
+	memcpy(order + nasync, tmp, nsync * sizeof(size_t));
+}
+
+/*
+ * runtime_sleep -- (internal) blocks until one of the futures is woken up.
+ * If some futures can't wake the runtime up, it sleeps no longer than
+ * the policy's sleep timeout.
+ */
+static void
+runtime_sleep(struct runtime_waiter *waiter, int indefinitely)
+{
+	struct runtime *runtime = waiter->runtime;
+	uint32_t key = eventcount_prepare(&waiter->wakeup);
+
+	struct runtime_slot *ready;
+	util_atomic_load_explicit64(&waiter->ready, &ready,
+		memory_order_acquire);
+	if (ready != NULL) {
+		/* some futures were woken up in the meantime */
+		eventcount_cancel(&waiter->wakeup);
+		return;
+	}
+
+	struct timespec ts;
+	const struct timespec *timeout =
+		indefinitely ? NULL : &runtime->policy.sleep_timeout;
+	if (!runtime_timers_timeout(runtime, &timeout, &ts)) {
+		/* a timer is due */
+		eventcount_cancel(&waiter->wakeup);
+		return;
+	}
+
+	TRACEPOINT(runtime_sleep, runtime, indefinitely);
+	int ret = runtime_block(runtime, &waiter->wakeup, key, timeout);
+	TRACEPOINT(runtime_wakeup, runtime, ret);
+	if (runtime->stats != NULL) {
+		util_fetch_and_add64(&runtime->stats->sleeps, 1);
+		if (ret != 0)
+			util_fetch_and_add64(&runtime->stats->sleep_timeouts,
+				1);
+	}
+}
+
+/*
+ * runtime_pause_once -- (internal) executes a single pause of the kind
+ * selected by the runtime policy
+ */
+static void
+runtime_pause_once(struct runtime *runtime)
+{
+	switch (runtime->policy.pause) {
+		case RUNTIME_PAUSE_YIELD:
+			os_thread_yield();
+			return;
+		case RUNTIME_PAUSE_TPAUSE:
+#ifdef RUNTIME_HAS_WAITPKG
+			if (runtime->waitpkg) {
+				uint64_t deadline = cpu_rdtsc() +
+					RUNTIME_TPAUSE_TSC_CYCLES;
+				cpu_tpause(CPU_WAIT_C01, deadline);
+				return;
+			}
+#endif
+			/* fall back to the spin-loop hint */
+			WAIT();
+			return;
+		case RUNTIME_PAUSE_CPU:
+		default:
+			WAIT();
+			return;
+	}
+}
+
+/*
+ * runtime_pause -- (internal) waits a short while before the next spin.
+ * If all the futures left to poll monitor the same address, the wait is
+ * terminated early by a write to that address.
+ */
+static void
+runtime_pause(struct runtime *runtime, uint64_t *ptr_to_monitor,
+	unsigned backoff)
+{
+#ifdef RUNTIME_HAS_WAITPKG
+	if (ptr_to_monitor != NULL && runtime->waitpkg) {
+		cpu_umonitor(ptr_to_monitor);
+
+		uint64_t value;
+		util_atomic_load_explicit64(ptr_to_monitor, &value,
+			memory_order_acquire);
+		if (value == 0) {
+			cpu_umwait(CPU_WAIT_C01,
+				cpu_rdtsc() + RUNTIME_UMWAIT_TSC_CYCLES);
+		}
+		return;
+	}
+#else
+	SUPPRESS_UNUSED(ptr_to_monitor);
+#endif
+	for (unsigned i = 0; i < backoff; ++i)
+		runtime_pause_once(runtime);
+}
+
+/*
+ * runtime_adapt_progress -- (internal) updates the adaptive spin budget
+ * after a future made progress following nspins idle spins
+ */
+static void
+runtime_adapt_progress(struct runtime_waiter *waiter, uint64_t nspins)
+{
+	struct runtime *runtime = waiter->runtime;
+	if (!runtime->policy.adaptive)
+		return;
+
+	uint64_t max = runtime_adaptive_max_spins(runtime);
+	if (nspins > max)
+		nspins = max;
+
+	/* moving average of the observed latency, spin twice as long */
+	waiter->spin_latency = (waiter->spin_latency * 7 + nspins) / 8;
+	uint64_t budget = waiter->spin_latency * 2;
+	if (budget < RUNTIME_ADAPTIVE_MIN_SPINS)
+		budget = RUNTIME_ADAPTIVE_MIN_SPINS;
+	waiter->spin_budget = budget < max ? budget : max;
+}
+
+/*
+ * runtime_adapt_sleep -- (internal) updates the spin budget of the adaptive
+ * policy after the whole budget was spent without any progress
+ */
+static void
+runtime_adapt_sleep(struct runtime_waiter *waiter)
+{
+	struct runtime *runtime = waiter->runtime;
+	if (!runtime->policy.adaptive)
+		return;
+
+	/* spinning didn't pay off, give up the core sooner next time */
+	waiter->spin_latency /= 2;
+	waiter->spin_budget /= 2;
+	if (waiter->spin_budget < RUNTIME_ADAPTIVE_MIN_SPINS)
+		waiter->spin_budget = RUNTIME_ADAPTIVE_MIN_SPINS;
+	if (waiter->spin_budget > runtime_adaptive_max_spins(runtime))
+		waiter->spin_budget = runtime_adaptive_max_spins(runtime);
+}
+
+/*
+ * runtime_wait_busy -- (internal) fallback used when the runtime cannot
+ * allocate its scheduling state, polls all futures in order until at least
+ * min_count of them are complete
+ */
+static void
+runtime_wait_busy(struct future *futs[], size_t nfuts, size_t min_count)
+{
+	for (;;) {
+		size_t ndone = 0;
+		for (size_t f = 0; f < nfuts; ++f) {
+			if (future_poll(futs[f], NULL) ==
+			    FUTURE_STATE_COMPLETE)
+				ndone++;
+		}
+		if (ndone >= min_count)
+			return;
+		WAIT();
+	}
+}
+
+/*
+ * runtime_wait_waiter -- (internal) polls the futures with the scheduling
+ * state of the waiter until at least min_count of them are complete
+ */
+static void
+runtime_wait_waiter(struct runtime_waiter *waiter, struct future *futs[],
+	size_t nfuts, size_t min_count)
+{
+	struct runtime *runtime = waiter->runtime;
+
+	/* discard wakes left over from the previous calls */
+	runtime_drain_ready(waiter, 0);
+
+	/*
+	 * The polling order only holds the pending futures, completed ones
+	 * are dropped from it while polling.
+	 */
+	size_t ndone = 0;
+	size_t npending = 0;
+	size_t *order = waiter->order;
+	for (size_t f = 0; f < nfuts; ++f) {
+		struct runtime_slot *slot = waiter->slots[f];
+		slot->parked = 0;
+		slot->async = 0;
+		slot->ptr_to_monitor = NULL;
+		if (futs[f]->context.state == FUTURE_STATE_COMPLETE) {
+			ndone++;
+			continue;
+		}
+		slot->async = future_has_property(futs[f],
+			FUTURE_PROPERTY_ASYNC) > 0;
+		order[npending++] = f;
+	}
+	runtime_partition(waiter, npending);
+
+	struct future_notifier notifier;
+	notifier.waker.wake = runtime_waker_wake;
+	notifier.padding = 0;
+
+	struct runtime_stats *stats = runtime->stats;
+	if (stats != NULL)
+		util_fetch_and_add64(&stats->waits, 1);
+
+	/* counted locally, flushed to the stats before sleeping */
+	uint64_t nrun = 0; /* spins since the last sleep */
+	uint64_t npolls = 0;
+	uint64_t ncompleted = 0;
+
+	uint64_t nspins = 0; /* idle spins since the last progress */
+	unsigned backoff = 1;
+	int slept = 0;
+	while (ndone < min_count) {
+		nrun++;
+		runtime_timers_process(runtime);
+		runtime_reactor_process(runtime);
+		size_t progress = runtime_drain_ready(waiter, nfuts);
+
+		int reorder = 0;
+		size_t npolled = 0;
+		uint64_t *monitored = NULL; /* shared by all polled futures */
+		size_t nkept = 0;
+		for (size_t o = 0; o < npending; ++o) {
+			size_t f = order[o];
+			struct future *fut = futs[f];
+			struct runtime_slot *slot = waiter->slots[f];
+			/* completed through another entry of the array */
+			if (fut->context.state == FUTURE_STATE_COMPLETE) {
+				ndone++;
+				progress++;
+				continue;
+			}
+			order[nkept++] = f;
+			if (slot->parked)
+				continue;
+
+			if (stats != NULL)
+				runtime_stats_wake_latency(stats,
+					&slot->woken_at);
+
+			notifier.waker.data = slot;
+			notifier.poller.ptr_to_monitor = NULL;
+			notifier.notifier_used = FUTURE_NOTIFIER_NONE;
+			enum future_state state = future_poll(fut, &notifier);
+			npolls++;
+			if (state == FUTURE_STATE_COMPLETE) {
+				ndone++;
+				ncompleted++;
+				progress++;
+				nkept--;
+				continue;
+			}
+
+			switch (notifier.notifier_used) {
+				case FUTURE_NOTIFIER_POLLER:
+				/*
+				 * Futures report the address only when
+				 * started, remember it for later spins.
+				 */
+				slot->ptr_to_monitor =
+					notifier.poller.ptr_to_monitor;
+				break;
+				case FUTURE_NOTIFIER_WAKER:
+				/*
+				 * Don't poll the future again until its waker
+				 * fires. Futures that failed to start are
+				 * still polled.
+				 */
+				slot->ptr_to_monitor = NULL;
+				if (state == FUTURE_STATE_RUNNING)
+					slot->parked = 1;
+				break;
+				case FUTURE_NOTIFIER_NONE:
+				/* nothing to do for none */
+				break;
+			};
+
+			if (!slot->parked) {
+				if (npolled++ == 0)
+					monitored = slot->ptr_to_monitor;
+				else if (slot->ptr_to_monitor != monitored)
+					monitored = NULL;
+			}
+
+			/* chained futures can change their property */
+			int async = future_has_property(fut,
+				FUTURE_PROPERTY_ASYNC) > 0;
+			if (async != slot->async) {
+				slot->async = async;
+				reorder = 1;
+			}
+		}
+		npending = nkept;
+
+		if (progress != 0) {
+			/* the latency is unknown if the runtime slept */
+			if (!slept)
+				runtime_adapt_progress(waiter, nspins);
+			nspins = 0;
+			backoff = 1;
+			slept = 0;
+		}
+
+		if (ndone >= min_count)
+			break;
+
+		if (reorder)
+			runtime_partition(waiter, npending);
+
+		if (nspins < waiter->spin_budget) {
+			/*
+			 * Power-optimized polling is only possible if every
+			 * future left to poll monitors the same address.
+			 */
+			TRACEPOINT(runtime_spin, runtime, npolled, nspins);
+			runtime_pause(runtime, monitored, backoff);
+			nspins++;
+			unsigned max_backoff = runtime->policy.max_backoff;
+			backoff = backoff > max_backoff / 2 ?
+				max_backoff : backoff * 2;
+		} else {
+			if (stats != NULL) {
+				runtime_stats_add(&stats->spins, nrun);
+				runtime_stats_add(&stats->polls, npolls);
+				runtime_stats_add(&stats->completions,
+					ncompleted);
+				runtime_stats_record(stats->spins_before_sleep,
+					nrun);
+				nrun = npolls = ncompleted = 0;
+			}
+
+			runtime_adapt_sleep(waiter);
+			/* only parked futures left, nothing to poll for */
+			runtime_sleep(waiter, npolled == 0);
+			nspins = 0;
+			backoff = 1;
+			slept = 1;
+		}
+	}
+
+	if (stats != NULL) {
+		runtime_stats_add(&stats->spins, nrun);
+		runtime_stats_add(&stats->polls, npolls);
+		runtime_stats_add(&stats->completions, ncompleted);
+	}
+}
+
+/*
+ * runtime_wait_count -- (internal) polls the futures until at least
+ * min_count of them are complete
+ */
+static void
+runtime_wait_count(struct runtime *runtime, struct future *futs[],
+	size_t nfuts, size_t min_count)
+{
+	struct runtime_waiter *waiter = runtime_waiter_acquire(runtime);
+	if (waiter == NULL) {
+		runtime_wait_busy(futs, nfuts, min_count);
+		return;
+	}
+
+	if (runtime_reserve(waiter, nfuts) != 0)
+		runtime_wait_busy(futs, nfuts, min_count);
+	else
+		runtime_wait_waiter(waiter, futs, nfuts, min_count);
+
+	runtime_waiter_release(waiter);
+}
+
+void
+runtime_wait_multiple(struct runtime *runtime, struct future *futs[],
+						size_t nfuts)
+{
+	runtime_wait_count(runtime, futs, nfuts, nfuts);
+}
+
+/*
+ * runtime_wait_some -- waits until at least min_count of the futures are
+ * complete, stores the indices of all complete futures in out_indices (if
+ * not NULL) and returns their number
+ */
+size_t
+runtime_wait_some(struct runtime *runtime, struct future *futs[],
+	size_t nfuts, size_t min_count, size_t *out_indices)
+{
+	if (min_count > nfuts)
+		min_count = nfuts;
+
+	runtime_wait_count(runtime, futs, nfuts, min_count);
+
+	size_t ndone = 0;
+	for (size_t f = 0; f < nfuts; ++f) {
+		if (futs[f]->context.state != FUTURE_STATE_COMPLETE)
+			continue;
+		if (out_indices != NULL)
+			out_indices[ndone] = f;
+		ndone++;
+	}
+
+	return ndone;
+}
+
+/*
+ * runtime_wait_any -- waits until at least one of the futures is complete
+ * and returns the lowest index of a complete future, or nfuts if the array
+ * is empty
+ */
+size_t
+runtime_wait_any(struct runtime *runtime, struct future *futs[],
+	size_t nfuts)
+{
+	runtime_wait_count(runtime, futs, nfuts, nfuts != 0);
+
+	for (size_t f = 0; f < nfuts; ++f) {
+		if (futs[f]->context.state == FUTURE_STATE_COMPLETE)
+			return f;
+	}
+
+	return nfuts;
+}
+
+void
+runtime_wait(struct runtime *runtime, struct future *fut)
+{
+	runtime_wait_multiple(runtime, &fut, 1);
+}
+
+/*
+ * runtime_deque_init -- (internal) initializes an empty deque
+ */
+static int
+runtime_deque_init(struct runtime_deque *deque)
+{
+	deque->tasks = malloc(sizeof(struct runtime_task *) *
+		RUNTIME_DEQUE_INITIAL_CAPACITY);
+	if (deque->tasks == NULL)
+		return -1;
+
+	deque->capacity = RUNTIME_DEQUE_INITIAL_CAPACITY;
+	deque->head = 0;
+	deque->tail = 0;
+	os_mutex_init(&deque->lock);
+
+	return 0;
+}
+
+/*
+ * runtime_deque_fini -- (internal) frees the deque
+ */
+static void
+runtime_deque_fini(struct runtime_deque *deque)
+{
+	os_mutex_destroy(&deque->lock);
+	free(deque->tasks);
+}
+
+/*
+ * runtime_deque_push -- (internal) appends the task at the tail of the deque,
+ * growing it if necessary
+ */
+static int
+runtime_deque_push(struct runtime_deque *deque, struct runtime_task *task)
+{
+	os_mutex_lock(&deque->lock);
+	if (deque->tail - deque->head == deque->capacity) {
+		size_t capacity = deque->capacity * 2;
+		struct runtime_task **tasks =
+			malloc(sizeof(struct runtime_task *) * capacity);
+		if (tasks == NULL) {
+			os_mutex_unlock(&deque->lock);
+			return -1;
+		}
+		for (size_t i = deque->head; i != deque->tail; ++i) {
+			tasks[i & (capacity - 1)] =
+				deque->tasks[i & (deque->capacity - 1)];
+		}
+		free(deque->tasks);
+		deque->tasks = tasks;
+		deque->capacity = capacity;
+	}
+	deque->tasks[deque->tail++ & (deque->capacity - 1)] = task;
+	os_mutex_unlock(&deque->lock);
+
+	return 0;
+}
+
+/*
+ * runtime_deque_pop -- (internal) takes the task from the head of the deque
+ */
+static struct runtime_task *
+runtime_deque_pop(struct runtime_deque *deque)
+{
+	struct runtime_task *task = NULL;
+
+	os_mutex_lock(&deque->lock);
+	if (deque->head != deque->tail)
+		task = deque->tasks[deque->head++ & (deque->capacity - 1)];
+	os_mutex_unlock(&deque->lock);
+
+	return task;
+}
+
+/*
+ * runtime_deque_steal -- (internal) takes the task from the tail of the deque
+ */
+static struct runtime_task *
+runtime_deque_steal(struct runtime_deque *deque)
+{
+	struct runtime_task *task = NULL;
+
+	/* don't fight with the owner over a contended deque */
+	if (os_mutex_trylock(&deque->lock) != 0)
+		return NULL;
+	if (deque->head != deque->tail)
+		task = deque->tasks[--deque->tail & (deque->capacity - 1)];
+	os_mutex_unlock(&deque->lock);
+
+	return task;
+}
+
+/*
+ * runtime_executors_notify -- (internal) wakes up an idle executor, if any
+ */
+static void
+runtime_executors_notify(struct runtime *runtime)
+{
+	eventcount_notify_one(&runtime->exec_event);
+	runtime_reactor_interrupt(runtime);
+}
+
+/*
+ * runtime_task_push -- (internal) queues the task on its home executor
+ */
+static void
+runtime_task_push(struct runtime_task *task)
+{
+	struct runtime *runtime = task->runtime;
+	struct runtime_deque *deque = &runtime->executors[task->home].deque;
+
+	/* grow failed, busy-wait until the executor makes some room */
+	while (runtime_deque_push(deque, task) != 0)
+		WAIT();
+
+	runtime_executors_notify(runtime);
+}
+
+/*
+ * runtime_task_woken -- (internal) accounts the wake of the task
+ */
+static void
+runtime_task_woken(struct runtime_task *task)
+{
+	struct runtime_stats *stats = task->runtime->stats;
+	if (stats == NULL)
+		return;
+
+	util_fetch_and_add64(&stats->wakes, 1);
+	util_atomic_store_explicit64(&task->woken_at, runtime_clock_now(),
+		memory_order_release);
+}
+
+/*
+ * runtime_task_wake -- waker of the spawned futures, re-queues parked tasks
+ */
+static void
+runtime_task_wake(void *fdata)
+{
+	struct runtime_task *task = fdata;
+
+	for (;;) {
+		uint64_t state;
+		util_atomic_load_explicit64(&task->state, &state,
+			memory_order_acquire);
+		switch (state) {
+			case RUNTIME_TASK_PARKED:
+				if (util_bool_compare_and_swap64(&task->state,
+						RUNTIME_TASK_PARKED,
+						RUNTIME_TASK_QUEUED)) {
+					runtime_task_woken(task);
+					runtime_task_push(task);
+					return;
+				}
+				break;
+			case RUNTIME_TASK_POLLING:
+				if (util_bool_compare_and_swap64(&task->state,
+						RUNTIME_TASK_POLLING,
+						RUNTIME_TASK_NOTIFIED)) {
+					runtime_task_woken(task);
+					return;
+				}
+				break;
+			default:
+				/* already queued or notified */
+				return;
+		}
+	}
+}
+
+/*
+ * runtime_task_free -- (internal) frees the task, wherever it came from
+ */
+static void
+runtime_task_free(struct runtime_task *task)
+{
+	if (task->flags & RUNTIME_TASK_F_MEMBUF)
+		membuf_free(task);
+	else
+		free(task);
+}
+
+/*
+ * runtime_task_complete -- (internal) retires the task of a completed future
+ */
+static void
+runtime_task_complete(struct runtime_task *task)
+{
+	struct runtime *runtime = task->runtime;
+	if (task->flags & RUNTIME_TASK_F_OWNED)
+		future_arena_free(task->fut);
+	runtime_task_free(task);
+
+	if (util_fetch_and_sub64(&runtime->nspawned, 1) == 1)
+		eventcount_notify_all(&runtime->spawn_event);
+}
+
+/*
+ * runtime_executor_poll -- (internal) polls the task once and decides
+ * whether it should be re-queued or parked until woken up
+ */
+static void
+runtime_executor_poll(struct runtime_executor *executor,
+	struct runtime_task *task)
+{
+	util_atomic_store_explicit64(&task->state, RUNTIME_TASK_POLLING,
+		memory_order_release);
+	task->home = executor->id;
+
+	struct future_notifier notifier;
+	notifier.waker = (struct future_waker){task, runtime_task_wake};
+	notifier.poller.ptr_to_monitor = NULL;
+	notifier.notifier_used = FUTURE_NOTIFIER_NONE;
+	notifier.padding = 0;
+
+	struct runtime_stats *stats = executor->runtime->stats;
+	if (stats != NULL)
+		runtime_stats_wake_latency(stats, &task->woken_at);
+
+	enum future_state state = future_poll(task->fut, &notifier);
+	if (stats != NULL) {
+		util_fetch_and_add64(&stats->polls, 1);
+		if (state == FUTURE_STATE_COMPLETE)
+			util_fetch_and_add64(&stats->completions, 1);
+	}
+	if (state == FUTURE_STATE_COMPLETE) {
+		runtime_task_complete(task);
+		return;
+	}
+
+	if (notifier.notifier_used == FUTURE_NOTIFIER_WAKER &&
+	    state == FUTURE_STATE_RUNNING &&
+	    util_bool_compare_and_swap64(&task->state,
+			RUNTIME_TASK_POLLING, RUNTIME_TASK_PARKED))
+		return;
+
+	util_atomic_store_explicit64(&task->state, RUNTIME_TASK_QUEUED,
+		memory_order_release);
+	while (runtime_deque_push(&executor->deque, task) != 0)
+		WAIT();
+}
+
+/*
+ * runtime_executor_find -- (internal) returns a task from the executor's own
+ * deque or, if it's empty, a task stolen from one of the other executors
+ */
+static struct runtime_task *
+runtime_executor_find(struct runtime_executor *executor)
+{
+	struct runtime *runtime = executor->runtime;
+
+	struct runtime_task *task = runtime_deque_pop(&executor->deque);
+	if (task != NULL)
+		return task;
+
+	for (size_t i = 1; i < runtime->nexecutors; ++i) {
+		struct runtime_executor *victim = &runtime->executors[
+			(executor->id + i) % runtime->nexecutors];
+		task = runtime_deque_steal(&victim->deque);
+		if (task != NULL) {
+			if (runtime->stats != NULL)
+				util_fetch_and_add64(&runtime->stats->steals,
+					1);
+			return task;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * runtime_executor_idle -- (internal) puts the executor to sleep until new
+ * work is queued, returns NULL if the executor should exit
+ */
+static struct runtime_task *
+runtime_executor_idle(struct runtime_executor *executor)
+{
+	struct runtime *runtime = executor->runtime;
+
+	for (;;) {
+		runtime_timers_process(runtime);
+		runtime_reactor_process(runtime);
+		uint32_t key = eventcount_prepare(&runtime->exec_event);
+
+		int stopping;
+		util_atomic_load_explicit32(&runtime->stopping, &stopping,
+			memory_order_acquire);
+		if (stopping) {
+			eventcount_cancel(&runtime->exec_event);
+			return NULL;
+		}
+
+		struct runtime_task *task = runtime_executor_find(executor);
+		if (task != NULL) {
+			eventcount_cancel(&runtime->exec_event);
+			return task;
+		}
+
+		struct timespec ts;
+		const struct timespec *timeout = NULL;
+		if (!runtime_timers_timeout(runtime, &timeout, &ts)) {
+			eventcount_cancel(&runtime->exec_event);
+			continue;
+		}
+		runtime_block(runtime, &runtime->exec_event, key, timeout);
+	}
+}
+
+/*
+ * runtime_executor_loop -- loop that is executed by every executor thread
+ */
+static void *
+runtime_executor_loop(void *arg)
+{
+	struct runtime_executor *executor = arg;
+	struct runtime *runtime = executor->runtime;
+
+	os_tls_set(runtime->executor_key, executor);
+
+	for (;;) {
+		struct runtime_task *task = NULL;
+		for (uint64_t i = 0; task == NULL &&
+		    i < runtime->policy.spins_before_sleep; ++i) {
+			runtime_timers_process(runtime);
+			runtime_reactor_process(runtime);
+			task = runtime_executor_find(executor);
+			if (task != NULL)
+				break;
+
+			int stopping;
+			util_atomic_load_explicit32(&runtime->stopping,
+				&stopping, memory_order_acquire);
+			if (stopping)
+				break;
+			runtime_pause_once(runtime);
+		}
+
+		if (task == NULL &&
+		    (task = runtime_executor_idle(executor)) == NULL)
+			return NULL;
+
+		runtime_executor_poll(executor, task);
+	}
+}
+
+/*
+ * runtime_executors_start -- creates nthreads executor threads that
+ * drive the futures passed to runtime_spawn()
+ */
+int
+runtime_executors_start(struct runtime *runtime, size_t nthreads)
+{
+	if (runtime->executors != NULL || nthreads == 0)
+		return -1;
+
+	struct runtime_executor *executors =
+		malloc(sizeof(struct runtime_executor) * nthreads);
+	if (executors == NULL)
+		return -1;
+
+	size_t ninit;
+	for (ninit = 0; ninit < nthreads; ++ninit) {
+		if (runtime_deque_init(&executors[ninit].deque) != 0)
+			goto deque_failed;
+		executors[ninit].runtime = runtime;
+		executors[ninit].id = ninit;
+	}
+
+	runtime->tasks = membuf_new(runtime, RUNTIME_TASKS_BUFFER_SIZE,
+		MEMBUF_PAGES_NORMAL);
+	if (runtime->tasks == NULL)
+		goto deque_failed;
+
+	if (os_tls_key_create(&runtime->executor_key, NULL) != 0)
+		goto key_failed;
+
+	runtime->stopping = 0;
+	runtime->executors = executors;
+	runtime->nexecutors = nthreads;
+
+	size_t nstarted;
+	for (nstarted = 0; nstarted < nthreads; ++nstarted) {
+		if (os_thread_create(&executors[nstarted].thread, NULL,
+				runtime_executor_loop,
+				&executors[nstarted]) != 0)
+			goto thread_failed;
+	}
+
+	return 0;
+
+thread_failed:
+	util_atomic_store_explicit32(&runtime->stopping, 1,
+		memory_order_release);
+	eventcount_notify_all(&runtime->exec_event);
+	for (size_t i = 0; i < nstarted; ++i)
+		os_thread_join(&executors[i].thread, NULL);
+	os_tls_key_delete(runtime->executor_key);
+	runtime->executors = NULL;
+	runtime->nexecutors = 0;
+
+key_failed:
+	membuf_delete(runtime->tasks);
+	runtime->tasks = NULL;
+
+deque_failed:
+	for (size_t i = 0; i < ninit; ++i)
+		runtime_deque_fini(&executors[i].deque);
+	free(executors);
+
+	return -1;
+}
+
+/*
+ * runtime_executors_stop -- (internal) waits for the spawned futures and
+ * terminates the executor threads
+ */
+static void
+runtime_executors_stop(struct runtime *runtime)
+{
+	if (runtime->executors == NULL)
+		return;
+
+	runtime_wait_spawned(runtime);
+
+	util_atomic_store_explicit32(&runtime->stopping, 1,
+		memory_order_release);
+	eventcount_notify_all(&runtime->exec_event);
+	runtime_reactor_interrupt(runtime);
+
+	for (size_t i = 0; i < runtime->nexecutors; ++i) {
+		os_thread_join(&runtime->executors[i].thread, NULL);
+		runtime_deque_fini(&runtime->executors[i].deque);
+	}
+	os_tls_key_delete(runtime->executor_key);
+	free(runtime->executors);
+	runtime->executors = NULL;
+	runtime->nexecutors = 0;
+	membuf_delete(runtime->tasks);
+	runtime->tasks = NULL;
+}
+
+/*
+ * runtime_spawn_task -- (internal) hands the future over to the executors,
+ * in a task allocated from the buffer of the spawning thread, if possible
+ */
+static int
+runtime_spawn_task(struct runtime *runtime, struct future *fut,
+	unsigned flags)
+{
+	struct runtime_task *task = membuf_alloc(runtime->tasks,
+		sizeof(struct runtime_task));
+	if (task != NULL) {
+		flags |= RUNTIME_TASK_F_MEMBUF;
+	} else {
+		task = malloc(sizeof(struct runtime_task));
+		if (task == NULL)
+			return -1;
+	}
+
+	task->fut = fut;
+	task->runtime = runtime;
+	task->state = RUNTIME_TASK_QUEUED;
+	task->woken_at = 0;
+	task->flags = flags;
+
+	/* futures spawned by an executor stay local to it */
+	struct runtime_executor *self = os_tls_get(runtime->executor_key);
+	if (self != NULL && self->runtime == runtime) {
+		task->home = self->id;
+	} else {
+		task->home = util_fetch_and_add64(&runtime->next_executor, 1)
+			% runtime->nexecutors;
+	}
+
+	util_fetch_and_add64(&runtime->nspawned, 1);
+	if (runtime_deque_push(&runtime->executors[task->home].deque,
+			task) != 0) {
+		util_fetch_and_sub64(&runtime->nspawned, 1);
+		runtime_task_free(task);
+		return -1;
+	}
+	runtime_executors_notify(runtime);
+
+	return 0;
+}
+
+/*
+ * runtime_spawn -- hands the future over to the executors, which poll it
+ * until it completes
+ */
+int
+runtime_spawn(struct runtime *runtime, struct future *fut)
+{
+	if (runtime->executors == NULL)
+		return -1;
+
+	if (fut->context.state == FUTURE_STATE_COMPLETE)
+		return 0;
+
+	return runtime_spawn_task(runtime, fut, 0);
+}
+
+/*
+ * runtime_spawn_owned -- hands the future allocated from a future arena
+ * over to the executors, which free it once it completes
+ */
+int
+runtime_spawn_owned(struct runtime *runtime, struct future *fut)
+{
+	if (runtime->executors == NULL)
+		return -1;
+
+	if (fut->context.state == FUTURE_STATE_COMPLETE) {
+		future_arena_free(fut);
+		return 0;
+	}
+
+	return runtime_spawn_task(runtime, fut, RUNTIME_TASK_F_OWNED);
+}
+
+/*
+ * runtime_wait_spawned -- blocks until all the spawned futures complete
+ */
+void
+runtime_wait_spawned(struct runtime *runtime)
+{
+	for (;;) {
+		uint32_t key = eventcount_prepare(&runtime->spawn_event);
+
+		uint64_t nspawned;
+		util_atomic_load_explicit64(&runtime->nspawned, &nspawned,
+			memory_order_acquire);
+		if (nspawned == 0) {
+			eventcount_cancel(&runtime->spawn_event);
+			return;
+		}
+
+		eventcount_wait(&runtime->spawn_event, key, NULL);
+	}
+}
+
+/*
+ * runtime_get_stats -- copies the statistics collected by the runtime,
+ * returns -1 if the runtime doesn't collect them
+ */
+int
+runtime_get_stats(struct runtime *runtime, struct runtime_stats *stats)
+{
+	if (runtime->stats == NULL) {
+		memset(stats, 0, sizeof(*stats));
+		return -1;
+	}
+
+	uint64_t *dst = (uint64_t *)stats;
+	uint64_t *src = (uint64_t *)runtime->stats;
+	for (size_t i = 0; i < sizeof(*stats) / sizeof(uint64_t); ++i)
+		util_atomic_load_explicit64(&src[i], &dst[i],
+			memory_order_relaxed);
+
+	return 0;
+}
+
+/*
+ * runtime_reset_stats -- zeroes the statistics collected by the runtime
+ */
+void
+runtime_reset_stats(struct runtime *runtime)
+{
+	if (runtime->stats == NULL)
+		return;
+
+	uint64_t *counters = (uint64_t *)runtime->stats;
+	for (size_t i = 0; i < sizeof(*runtime->stats) / sizeof(uint64_t); ++i)
+		util_atomic_store_explicit64(&counters[i], 0,
+			memory_order_relaxed);
 }
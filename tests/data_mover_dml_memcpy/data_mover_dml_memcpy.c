@@ -56,6 +56,152 @@ test_dml_hw_path_flag_memcpy()
 	return dml_memcpy(DATA_MOVER_DML_HARDWARE, 0);
 }
 
+/*
+ * test_dml_submit_batch -- test the memcpy operations submitted together,
+ * as the tasks of the batch jobs
+ */
+static int
+test_dml_submit_batch(size_t nops, size_t size)
+{
+	struct data_mover_dml *dmd =
+		data_mover_dml_new(DATA_MOVER_DML_SOFTWARE);
+	if (dmd == NULL)
+		return 1;
+	struct runtime *r = runtime_new();
+
+	int ret = test_submit_batch(r, data_mover_dml_get_vdm(dmd), nops,
+		size);
+
+	runtime_delete(r);
+	data_mover_dml_delete(dmd);
+
+	return ret;
+}
+
+/*
+ * test_dml_nodes -- test the memcpy operations spread over the devices
+ * of the selected NUMA nodes
+ */
+static int
+test_dml_nodes(void)
+{
+	struct data_mover_dml *dmd =
+		data_mover_dml_new(DATA_MOVER_DML_SOFTWARE);
+	if (dmd == NULL)
+		return 1;
+
+	int invalid[] = {0, -1};
+	UT_ASSERTeq(data_mover_dml_set_nodes(dmd, invalid, 2), -1);
+	int nodes[DATA_MOVER_DML_MAX_NODES + 1] = {0};
+	UT_ASSERTeq(data_mover_dml_set_nodes(dmd, nodes,
+		DATA_MOVER_DML_MAX_NODES + 1), -1);
+	UT_ASSERTeq(data_mover_dml_set_nodes(dmd, nodes, 2), 0);
+
+	struct runtime *r = runtime_new();
+	int ret = test_submit_batch(r, data_mover_dml_get_vdm(dmd), 8, 4096);
+
+	runtime_delete(r);
+	data_mover_dml_delete(dmd);
+
+	return ret;
+}
+
+/*
+ * test_dml_cpu_threshold -- test the memcpy operations performed on the cpu,
+ * below the threshold, alone and among the ones submitted together
+ */
+static int
+test_dml_cpu_threshold(void)
+{
+	struct data_mover_dml *dmd =
+		data_mover_dml_new(DATA_MOVER_DML_SOFTWARE);
+	if (dmd == NULL)
+		return 1;
+
+	UT_ASSERTeq(data_mover_dml_set_cpu_threshold(dmd, 1024), 1024);
+
+	struct runtime *r = runtime_new();
+	struct vdm *vdm = data_mover_dml_get_vdm(dmd);
+	int ret = test_submit_batch(r, vdm, 8, 64) ||
+		test_submit_batch(r, vdm, 8, 4096);
+
+	data_mover_dml_set_cpu_threshold(dmd,
+		DATA_MOVER_DML_CPU_THRESHOLD_AUTO);
+	ret = ret || test_submit_batch(r, vdm, 8, 256);
+
+	runtime_delete(r);
+	data_mover_dml_delete(dmd);
+
+	return ret;
+}
+
+/*
+ * test_dml_fault_policy -- test the memcpy operations, with the pages
+ * touched beforehand or faulted in by the device
+ */
+static int
+test_dml_fault_policy(enum data_mover_dml_fault_policy policy)
+{
+	struct data_mover_dml *dmd =
+		data_mover_dml_new(DATA_MOVER_DML_SOFTWARE);
+	if (dmd == NULL)
+		return 1;
+
+	data_mover_dml_set_fault_policy(dmd, policy);
+
+	struct runtime *r = runtime_new();
+	struct vdm *vdm = data_mover_dml_get_vdm(dmd);
+	int ret = test_submit_batch(r, vdm, 1, 3 * 4096) ||
+		test_submit_batch(r, vdm, 8, 4096);
+
+	runtime_delete(r);
+	data_mover_dml_delete(dmd);
+
+	return ret;
+}
+
+/*
+ * test_dml_waker -- test the large memcpy operations, whose futures are
+ * woken by the waker thread, among the smaller polled ones
+ */
+static int
+test_dml_waker(void)
+{
+	struct data_mover_dml *dmd =
+		data_mover_dml_new(DATA_MOVER_DML_SOFTWARE);
+	if (dmd == NULL)
+		return 1;
+
+	UT_ASSERTeq(data_mover_dml_set_waker_threshold(dmd, 1 << 16), 0);
+
+	size_t size = 1 << 20;
+	char *src = malloc(size);
+	char *dest = malloc(size);
+	UT_ASSERTne(src, NULL);
+	UT_ASSERTne(dest, NULL);
+	memset(src, 0xab, size);
+	memset(dest, 0, size);
+
+	struct runtime *r = runtime_new();
+	struct vdm *vdm = data_mover_dml_get_vdm(dmd);
+	struct vdm_operation_future futs[2];
+	futs[0] = vdm_memcpy(vdm, dest, src, size, 0);
+	futs[1] = vdm_memcpy(vdm, dest, src, 4096, 0);
+	struct future *fs[] = {
+		FUTURE_AS_RUNNABLE(&futs[0]), FUTURE_AS_RUNNABLE(&futs[1]),
+	};
+	runtime_wait_multiple(r, fs, 2);
+
+	int ret = memcmp(dest, src, size) != 0;
+
+	runtime_delete(r);
+	data_mover_dml_delete(dmd);
+	free(dest);
+	free(src);
+
+	return ret;
+}
+
 /*
  * test_supported_flags -- test if data_mover_threads support correct flags
  */
@@ -95,6 +241,16 @@ main(void)
 		UT_LOG_SKIP("test_dml_hw_path_flag_memmove");
 	}
 
+	ret = test_dml_submit_batch(1, 4096) ||
+		test_dml_submit_batch(40, 4096) ||
+		test_dml_nodes() ||
+		test_dml_cpu_threshold() ||
+		test_dml_fault_policy(DATA_MOVER_DML_FAULT_PREFAULT) ||
+		test_dml_fault_policy(DATA_MOVER_DML_FAULT_BLOCK) ||
+		test_dml_waker();
+	if (ret)
+		return ret;
+
 	ret = test_supported_flags();
 	if (ret)
 		return ret;
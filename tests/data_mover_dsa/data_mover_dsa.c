@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdlib.h>
+#include <string.h>
+#include "libminiasync.h"
+#include "test_helpers.h"
+
+/* larger than the largest transfer of a work queue, by default */
+#define TEST_LARGE ((size_t)4 << 20)
+#define TEST_SMALL 4096
+
+/*
+ * test_dsa_memmove -- moves a buffer larger than the largest transfer onto
+ * itself, to the higher addresses, which are copied from the end
+ */
+static int
+test_dsa_memmove(struct runtime *r, struct vdm *vdm)
+{
+	size_t shift = 100;
+	char *buf = malloc(TEST_LARGE + shift);
+	if (buf == NULL)
+		UT_FATAL("out of memory");
+	for (size_t i = 0; i < TEST_LARGE; ++i)
+		buf[i] = (char)(i % 251);
+
+	struct vdm_operation_future fut = vdm_memmove(vdm, buf + shift, buf,
+		TEST_LARGE, 0);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+
+	int ret = 0;
+	for (size_t i = 0; i < TEST_LARGE; ++i) {
+		if (buf[i + shift] != (char)(i % 251)) {
+			ret = 1;
+			break;
+		}
+	}
+	free(buf);
+
+	return ret;
+}
+
+int
+main(void)
+{
+	UT_ASSERTeq(data_mover_dsa_new("/dev/dsa/nonexistent"), NULL);
+
+	struct data_mover_dsa *dsa = data_mover_dsa_new(NULL);
+	if (dsa == NULL) {
+		UT_LOG_SKIP("data_mover_dsa");
+		return 0;
+	}
+
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+	struct vdm *vdm = data_mover_dsa_get_vdm(dsa);
+
+	int ret = test_dsa_memmove(r, vdm) ||
+		test_check_ops(r, vdm, TEST_SMALL) ||
+		test_memfill(r, vdm, TEST_SMALL) ||
+		test_memcpy_v(r, vdm, 16, TEST_SMALL, 0) ||
+		test_storage(r, vdm, 16, TEST_SMALL) ||
+		test_submit_batch(r, vdm, 16, TEST_SMALL);
+
+	runtime_delete(r);
+	data_mover_dsa_delete(dsa);
+
+	return ret;
+}
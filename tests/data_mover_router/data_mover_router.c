@@ -0,0 +1,358 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdlib.h>
+#include <string.h>
+#include "libminiasync.h"
+#include "test_helpers.h"
+
+#define TEST_SMALL 100
+#define TEST_LARGE (64 * 1024)
+#define TEST_THRESHOLD 4096
+#define TEST_NOPS 4
+
+struct test_movers {
+	struct runtime *r;
+	struct data_mover_sync *dms;
+	struct data_mover_threads *dmt;
+	struct data_mover_router *dmr;
+};
+
+/*
+ * test_movers_new -- creates the sync and threads movers and a router
+ * without any routes
+ */
+static void
+test_movers_new(struct test_movers *m)
+{
+	m->r = runtime_new();
+	m->dms = data_mover_sync_new();
+	m->dmt = data_mover_threads_new(2, 128, FUTURE_NOTIFIER_WAKER);
+	m->dmr = data_mover_router_new();
+	if (!m->r || !m->dms || !m->dmt || !m->dmr)
+		UT_FATAL("cannot create the data movers");
+}
+
+/*
+ * test_movers_delete -- deletes the router and the data movers
+ */
+static void
+test_movers_delete(struct test_movers *m)
+{
+	data_mover_router_delete(m->dmr);
+	data_mover_threads_delete(m->dmt);
+	data_mover_sync_delete(m->dms);
+	runtime_delete(m->r);
+}
+
+/*
+ * test_router_no_routes -- the operations of a router without routes
+ * fail right away
+ */
+static void
+test_router_no_routes(void)
+{
+	struct data_mover_router *dmr = data_mover_router_new();
+	UT_ASSERTne(dmr, NULL);
+
+	char src[TEST_SMALL] = {1};
+	char dst[TEST_SMALL];
+	struct vdm_operation_future fut = vdm_memcpy(
+		data_mover_router_get_vdm(dmr), dst, src, sizeof(src), 0);
+	UT_ASSERTeq(fut.base.context.state, FUTURE_STATE_COMPLETE);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_ERROR_OUT_OF_MEMORY);
+
+	UT_ASSERTeq(data_mover_router_add(dmr, NULL, 0, 0), -1);
+
+	data_mover_router_delete(dmr);
+}
+
+/*
+ * test_router_size -- the small operations are routed to the sync mover
+ * and the large ones to the threads mover
+ */
+static void
+test_router_size(void)
+{
+	struct test_movers m;
+	test_movers_new(&m);
+	struct vdm *sync_vdm = data_mover_sync_get_vdm(m.dms);
+	struct vdm *threads_vdm = data_mover_threads_get_vdm(m.dmt);
+	UT_ASSERTeq(data_mover_router_add(m.dmr, sync_vdm, 0, 0), 0);
+	UT_ASSERTeq(data_mover_router_add(m.dmr, threads_vdm,
+		TEST_THRESHOLD, 0), 0);
+	struct vdm *vdm = data_mover_router_get_vdm(m.dmr);
+
+	char *src = malloc(TEST_LARGE);
+	char *dst = malloc(TEST_LARGE);
+	if (!src || !dst)
+		UT_FATAL("out of memory");
+	memset(src, 7, TEST_LARGE);
+	memset(dst, 0, TEST_LARGE);
+
+	struct vdm_operation_future futs[2];
+	futs[0] = vdm_memcpy(vdm, dst, src, TEST_SMALL, 0);
+	futs[1] = vdm_memcpy(vdm, dst + TEST_SMALL, src + TEST_SMALL,
+		TEST_LARGE - TEST_SMALL, 0);
+	struct vdm_operation_future *pfuts[] = {&futs[0], &futs[1]};
+	UT_ASSERTeq(vdm_submit_batch(vdm, pfuts, 2), 2);
+
+	UT_ASSERTeq(data_mover_router_get_inflight(m.dmr, sync_vdm), 1);
+	UT_ASSERTeq(data_mover_router_get_inflight(m.dmr, threads_vdm), 1);
+
+	struct future *runnables[] = {
+		FUTURE_AS_RUNNABLE(&futs[0]), FUTURE_AS_RUNNABLE(&futs[1])
+	};
+	runtime_wait_multiple(m.r, runnables, 2);
+	UT_ASSERTeq(FUTURE_OUTPUT(&futs[0])->output.memcpy.dest, dst);
+	UT_ASSERTeq(FUTURE_OUTPUT(&futs[1])->output.memcpy.dest,
+		dst + TEST_SMALL);
+	UT_ASSERTeq(memcmp(dst, src, TEST_LARGE), 0);
+
+	UT_ASSERTeq(data_mover_router_get_inflight(m.dmr, sync_vdm), 0);
+	UT_ASSERTeq(data_mover_router_get_inflight(m.dmr, threads_vdm), 0);
+
+	/* polled futures are routed when they're started too */
+	memset(dst, 0, TEST_LARGE);
+	futs[0] = vdm_memcpy(vdm, dst, src, TEST_LARGE, 0);
+	runtime_wait(m.r, FUTURE_AS_RUNNABLE(&futs[0]));
+	UT_ASSERTeq(FUTURE_OUTPUT(&futs[0])->result, VDM_SUCCESS);
+	UT_ASSERTeq(memcmp(dst, src, TEST_LARGE), 0);
+
+	free(dst);
+	free(src);
+	test_movers_delete(&m);
+}
+
+/*
+ * test_router_inflight -- the operations over the limit of the threads
+ * mover are routed to the sync mover
+ */
+static void
+test_router_inflight(void)
+{
+	struct test_movers m;
+	test_movers_new(&m);
+	struct vdm *sync_vdm = data_mover_sync_get_vdm(m.dms);
+	struct vdm *threads_vdm = data_mover_threads_get_vdm(m.dmt);
+	UT_ASSERTeq(data_mover_router_add(m.dmr, threads_vdm,
+		TEST_THRESHOLD, 2), 0);
+	UT_ASSERTeq(data_mover_router_add(m.dmr, sync_vdm, 0, 0), 0);
+	struct vdm *vdm = data_mover_router_get_vdm(m.dmr);
+
+	char *src = malloc(TEST_LARGE * TEST_NOPS);
+	char *dst = malloc(TEST_LARGE * TEST_NOPS);
+	if (!src || !dst)
+		UT_FATAL("out of memory");
+	memset(src, 3, TEST_LARGE * TEST_NOPS);
+	memset(dst, 0, TEST_LARGE * TEST_NOPS);
+
+	struct vdm_operation_future futs[TEST_NOPS];
+	struct vdm_operation_future *pfuts[TEST_NOPS];
+	struct future *runnables[TEST_NOPS];
+	for (size_t i = 0; i < TEST_NOPS; ++i) {
+		futs[i] = vdm_memcpy(vdm, dst + i * TEST_LARGE,
+			src + i * TEST_LARGE, TEST_LARGE, 0);
+		pfuts[i] = &futs[i];
+		runnables[i] = FUTURE_AS_RUNNABLE(&futs[i]);
+	}
+	UT_ASSERTeq(vdm_submit_batch(vdm, pfuts, TEST_NOPS), TEST_NOPS);
+
+	UT_ASSERTeq(data_mover_router_get_inflight(m.dmr, threads_vdm), 2);
+	UT_ASSERTeq(data_mover_router_get_inflight(m.dmr, sync_vdm),
+		TEST_NOPS - 2);
+
+	runtime_wait_multiple(m.r, runnables, TEST_NOPS);
+	UT_ASSERTeq(memcmp(dst, src, TEST_LARGE * TEST_NOPS), 0);
+
+	free(dst);
+	free(src);
+	test_movers_delete(&m);
+}
+
+static struct vdm *test_plain_parent;
+
+/*
+ * test_plain_operation_new -- creates the operation in the data mover,
+ * which the plain one is a copy of
+ */
+static void *
+test_plain_operation_new(struct vdm *vdm, const enum vdm_operation_type type)
+{
+	(void) vdm;
+
+	return test_plain_parent->op_new(test_plain_parent, type);
+}
+
+/*
+ * test_router_flags -- the operations are routed to a data mover, which
+ * supports their flags, whatever their size
+ */
+static void
+test_router_flags(void)
+{
+	struct test_movers m;
+	test_movers_new(&m);
+	struct vdm *sync_vdm = data_mover_sync_get_vdm(m.dms);
+
+	/* the same mover, but without any capabilities */
+	struct vdm plain_vdm = *sync_vdm;
+	plain_vdm.op_new = test_plain_operation_new;
+	plain_vdm.capabilities = 0;
+	test_plain_parent = sync_vdm;
+
+	UT_ASSERTeq(data_mover_router_add(m.dmr, &plain_vdm, 0, 0), 0);
+	UT_ASSERTeq(data_mover_router_add(m.dmr, sync_vdm, TEST_LARGE, 0), 0);
+	struct vdm *vdm = data_mover_router_get_vdm(m.dmr);
+	UT_ASSERT(vdm_is_supported(vdm, VDM_F_NO_CACHE_HINT));
+
+	char src[TEST_SMALL];
+	char dst[TEST_SMALL];
+	memset(src, 5, sizeof(src));
+
+	struct vdm_operation_future futs[2];
+	futs[0] = vdm_memcpy(vdm, dst, src, sizeof(src), VDM_F_NO_CACHE_HINT);
+	futs[1] = vdm_memcpy(vdm, dst, src, sizeof(src), 0);
+	struct vdm_operation_future *pfuts[] = {&futs[0], &futs[1]};
+	UT_ASSERTeq(vdm_submit_batch(vdm, pfuts, 2), 2);
+
+	UT_ASSERTeq(data_mover_router_get_inflight(m.dmr, sync_vdm), 1);
+	UT_ASSERTeq(data_mover_router_get_inflight(m.dmr, &plain_vdm), 1);
+
+	struct future *runnables[] = {
+		FUTURE_AS_RUNNABLE(&futs[0]), FUTURE_AS_RUNNABLE(&futs[1])
+	};
+	runtime_wait_multiple(m.r, runnables, 2);
+	UT_ASSERTeq(memcmp(dst, src, sizeof(src)), 0);
+
+	test_movers_delete(&m);
+}
+
+static int callback_done;
+
+/*
+ * test_callback_poll -- collects the output of the completed future
+ */
+static void
+test_callback_poll(void *arg)
+{
+	struct vdm_operation_future *fut = arg;
+
+	callback_done = future_poll(FUTURE_AS_RUNNABLE(fut), NULL) ==
+		FUTURE_STATE_COMPLETE;
+}
+
+/*
+ * test_router_callback -- the completion callbacks are passed to the data
+ * mover selected for the operation
+ */
+static void
+test_router_callback(void)
+{
+	struct test_movers m;
+	test_movers_new(&m);
+	UT_ASSERTeq(data_mover_router_add(m.dmr,
+		data_mover_sync_get_vdm(m.dms), 0, 0), 0);
+	struct vdm *vdm = data_mover_router_get_vdm(m.dmr);
+
+	char src[TEST_SMALL];
+	char dst[TEST_SMALL];
+	memset(src, 9, sizeof(src));
+
+	callback_done = 0;
+	struct vdm_operation_future fut = vdm_memcpy(vdm, dst, src,
+		sizeof(src), 0);
+	UT_ASSERTeq(vdm_start_with_callback(&fut, test_callback_poll, &fut), 0);
+	UT_ASSERTeq(callback_done, 1);
+	UT_ASSERTeq(memcmp(dst, src, sizeof(src)), 0);
+	UT_ASSERTeq(data_mover_router_get_inflight(m.dmr,
+		data_mover_sync_get_vdm(m.dms)), 0);
+
+	test_movers_delete(&m);
+}
+
+/*
+ * test_router_batch -- the batched submission through the router
+ */
+static int
+test_router_batch(void)
+{
+	struct test_movers m;
+	test_movers_new(&m);
+	UT_ASSERTeq(data_mover_router_add(m.dmr,
+		data_mover_sync_get_vdm(m.dms), 0, 0), 0);
+	UT_ASSERTeq(data_mover_router_add(m.dmr,
+		data_mover_threads_get_vdm(m.dmt), TEST_THRESHOLD, 0), 0);
+
+	int ret = test_submit_batch(m.r, data_mover_router_get_vdm(m.dmr),
+		40, 1024);
+
+	test_movers_delete(&m);
+
+	return ret;
+}
+
+/*
+ * test_router_compact -- the compact futures of a data mover, which doesn't
+ * support the caller's storage, keep the pointers to the operations
+ */
+static int
+test_router_compact(void)
+{
+	struct test_movers m;
+	test_movers_new(&m);
+	UT_ASSERTeq(data_mover_router_add(m.dmr,
+		data_mover_sync_get_vdm(m.dms), 0, 0), 0);
+	UT_ASSERTeq(data_mover_router_add(m.dmr,
+		data_mover_threads_get_vdm(m.dmt), TEST_THRESHOLD, 0), 0);
+
+	int ret = test_compact(m.r, data_mover_router_get_vdm(m.dmr), 40,
+		TEST_THRESHOLD);
+
+	test_movers_delete(&m);
+
+	return ret;
+}
+
+/*
+ * test_router_property -- the properties of the futures are those of
+ * the data movers of the routes, also when they are wrapped in another one
+ */
+static void
+test_router_property(void)
+{
+	struct test_movers m;
+	test_movers_new(&m);
+	struct data_mover_trace *dmtr = data_mover_trace_new(
+		data_mover_threads_get_vdm(m.dmt));
+	UT_ASSERTne(dmtr, NULL);
+	UT_ASSERTeq(data_mover_router_add(m.dmr,
+		data_mover_trace_get_vdm(dmtr), 0, 0), 0);
+
+	char src[TEST_SMALL];
+	char dst[TEST_SMALL];
+	memset(src, 3, sizeof(src));
+
+	struct vdm_operation_future fut = vdm_memcpy(
+		data_mover_router_get_vdm(m.dmr), dst, src, sizeof(src), 0);
+	UT_ASSERTeq(future_has_property(FUTURE_AS_RUNNABLE(&fut),
+		FUTURE_PROPERTY_ASYNC), 1);
+	runtime_wait(m.r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(memcmp(dst, src, sizeof(src)), 0);
+
+	test_movers_delete(&m);
+	data_mover_trace_delete(dmtr);
+}
+
+int
+main(void)
+{
+	test_router_no_routes();
+	test_router_size();
+	test_router_inflight();
+	test_router_flags();
+	test_router_callback();
+	test_router_property();
+
+	return test_router_batch() || test_router_compact();
+}
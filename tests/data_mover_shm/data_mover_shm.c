@@ -0,0 +1,248 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "libminiasync.h"
+#include "test_helpers.h"
+
+#define TEST_DATA_SIZE (1024 * 1024)
+#define TEST_NSLOTS 8
+#define TEST_NOPS 32
+#define TEST_OP_SIZE 4096
+
+/* the offsets of the queue of the submissions in the header of the segment */
+#define TEST_SEG_SQ_OFF 32
+#define TEST_SEG_DESCS_OFF 40
+
+/*
+ * test_shm_memops -- performs the memory operations of the data area
+ * by the service, more of them than there are descriptors
+ */
+static int
+test_shm_memops(struct runtime *r, struct data_mover_shm *shm)
+{
+	struct vdm *vdm = data_mover_shm_get_vdm(shm);
+	size_t size;
+	char *data = data_mover_shm_get_data(shm, &size);
+	UT_ASSERTeq(size, TEST_DATA_SIZE);
+
+	char *src = data;
+	char *dst = data + TEST_NOPS * TEST_OP_SIZE;
+	for (size_t i = 0; i < TEST_NOPS * TEST_OP_SIZE; ++i)
+		src[i] = (char)(i % 251);
+	memset(dst, 0, TEST_NOPS * TEST_OP_SIZE);
+
+	struct vdm_operation_future futs[TEST_NOPS];
+	struct future *pfuts[TEST_NOPS];
+	for (size_t i = 0; i < TEST_NOPS; ++i) {
+		futs[i] = vdm_memcpy(vdm, dst + i * TEST_OP_SIZE,
+			src + i * TEST_OP_SIZE, TEST_OP_SIZE, 0);
+		pfuts[i] = FUTURE_AS_RUNNABLE(&futs[i]);
+	}
+	runtime_wait_multiple(r, pfuts, TEST_NOPS);
+	for (size_t i = 0; i < TEST_NOPS; ++i) {
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->result, VDM_SUCCESS);
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->type,
+			VDM_OPERATION_MEMCPY);
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->output.memcpy.dest,
+			dst + i * TEST_OP_SIZE);
+	}
+	int ret = memcmp(src, dst, TEST_NOPS * TEST_OP_SIZE) != 0;
+
+	/* the service reports the completion to the poller of the future */
+	struct vdm_operation_future fut = vdm_memmove(vdm, src + 1, src,
+		TEST_OP_SIZE, 0);
+	struct future_notifier n;
+	future_poll(FUTURE_AS_RUNNABLE(&fut), &n);
+	UT_ASSERT(n.notifier_used == FUTURE_NOTIFIER_POLLER ||
+		FUTURE_STATE(&fut) == FUTURE_STATE_COMPLETE);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->output.memmove.dest, src + 1);
+	ret |= memcmp(src + 1, dst, TEST_OP_SIZE) != 0;
+
+	fut = vdm_memset(vdm, dst, 7, TEST_OP_SIZE, VDM_F_MEM_DURABLE);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->output.memset.str, dst);
+	for (size_t i = 0; i < TEST_OP_SIZE; ++i)
+		ret |= dst[i] != 7;
+
+	fut = vdm_flush(vdm, dst, TEST_OP_SIZE, 0);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->type, VDM_OPERATION_FLUSH);
+
+	return ret;
+}
+
+/*
+ * test_shm_fallback -- the operations outside of the data area
+ * are performed on the cpu of the client
+ */
+static int
+test_shm_fallback(struct runtime *r, struct data_mover_shm *shm)
+{
+	struct vdm *vdm = data_mover_shm_get_vdm(shm);
+	size_t size;
+	char *data = data_mover_shm_get_data(shm, &size);
+
+	char buf[100];
+	memset(buf, 0, sizeof(buf));
+	memset(data, 3, sizeof(buf));
+
+	/* the source is in the data area, but the destination isn't */
+	struct vdm_operation_future fut = vdm_memcpy(vdm, buf, data,
+		sizeof(buf), 0);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->output.memcpy.dest, buf);
+	int ret = memcmp(buf, data, sizeof(buf)) != 0;
+
+	/* the range which runs past the end of the data area */
+	fut = vdm_memset(vdm, data + size - 10, 5, 10, 0);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	fut = vdm_memset(vdm, buf, 5, sizeof(buf), 0);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	ret |= memcmp(buf, data + size - 10, 10) != 0;
+
+	return ret;
+}
+
+/*
+ * test_shm_child -- the client of another process copies the data,
+ * which the parent then reads from its own mapping of the segment
+ */
+static int
+test_shm_child(const char *path, struct data_mover_shm *shm)
+{
+	size_t size;
+	char *data = data_mover_shm_get_data(shm, &size);
+	memset(data, 0, 2 * TEST_OP_SIZE);
+
+	pid_t pid = fork();
+	UT_ASSERT(pid >= 0);
+	if (pid == 0) {
+		struct runtime *r = runtime_new();
+		struct data_mover_shm *cshm = data_mover_shm_new(path);
+		if (r == NULL || cshm == NULL)
+			_exit(1);
+
+		/* the child maps the segment at its own address */
+		char *cdata = data_mover_shm_get_data(cshm, &size);
+		struct vdm *vdm = data_mover_shm_get_vdm(cshm);
+		struct vdm_operation_future fut = vdm_memset(vdm, cdata, 9,
+			TEST_OP_SIZE, 0);
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+		int failed = FUTURE_OUTPUT(&fut)->result != VDM_SUCCESS;
+		fut = vdm_memcpy(vdm, cdata + TEST_OP_SIZE, cdata,
+			TEST_OP_SIZE, 0);
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+		failed |= FUTURE_OUTPUT(&fut)->result != VDM_SUCCESS;
+
+		data_mover_shm_delete(cshm);
+		runtime_delete(r);
+		_exit(failed);
+	}
+
+	int status;
+	UT_ASSERTeq(waitpid(pid, &status, 0), pid);
+	UT_ASSERT(WIFEXITED(status));
+	UT_ASSERTeq(WEXITSTATUS(status), 0);
+
+	int ret = 0;
+	for (size_t i = 0; i < 2 * TEST_OP_SIZE; ++i)
+		ret |= data[i] != 9;
+
+	return ret;
+}
+
+/*
+ * test_shm_corrupt_sq -- a client overwrites the queue of the submissions,
+ * whose read position comes first, and the service keeps running
+ */
+static int
+test_shm_corrupt_sq(const char *path)
+{
+	int fd = open(path, O_RDWR);
+	UT_ASSERT(fd >= 0);
+	struct stat st;
+	UT_ASSERTeq(fstat(fd, &st), 0);
+	char *base = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED, fd, 0);
+	UT_ASSERTne(base, MAP_FAILED);
+	close(fd);
+
+	uint64_t sq_off;
+	uint64_t descs_off;
+	memcpy(&sq_off, base + TEST_SEG_SQ_OFF, sizeof(sq_off));
+	memcpy(&descs_off, base + TEST_SEG_DESCS_OFF, sizeof(descs_off));
+	UT_ASSERT(sq_off < descs_off && descs_off <= (uint64_t)st.st_size);
+	char *sq = base + sq_off;
+	size_t sq_size = descs_off - sq_off;
+
+	/* the sequence numbers of the slots run ahead of the read position */
+	memset(sq, 0x7f, sq_size);
+	uint64_t pos = 1ULL << 36;
+	memcpy(sq, &pos, sizeof(pos));
+	usleep(10000);
+
+	/* the positions and the indexes are outside of the ring */
+	memset(sq, 0xff, sq_size);
+	usleep(10000);
+
+	munmap(base, (size_t)st.st_size);
+
+	return 0;
+}
+
+int
+main(void)
+{
+	const char *dir = getenv("TMPDIR");
+	char path[256];
+	snprintf(path, sizeof(path), "%s/miniasync_shm_%d",
+		dir ? dir : "/tmp", (int)getpid());
+
+	unsigned cpus[] = {0};
+	struct data_mover_shm_service *svc = data_mover_shm_service_new(path,
+		TEST_DATA_SIZE, TEST_NSLOTS, 2, cpus, 1);
+	if (svc == NULL) {
+		UT_LOG_SKIP("data_mover_shm");
+		return 0;
+	}
+
+	/* the segment can't be created twice */
+	UT_ASSERTeq(data_mover_shm_service_new(path, TEST_DATA_SIZE,
+		TEST_NSLOTS, 1, NULL, 0), NULL);
+
+	struct runtime *r = runtime_new();
+	struct data_mover_shm *shm = data_mover_shm_new(path);
+	UT_ASSERTne(r, NULL);
+	UT_ASSERTne(shm, NULL);
+
+	int ret = test_shm_memops(r, shm) ||
+		test_shm_fallback(r, shm) ||
+		test_shm_child(path, shm);
+
+	data_mover_shm_delete(shm);
+	runtime_delete(r);
+
+	ret |= test_shm_corrupt_sq(path);
+	data_mover_shm_service_delete(svc);
+
+	/* the file of the segment is removed with the service */
+	UT_ASSERTeq(access(path, F_OK), -1);
+
+	return ret;
+}
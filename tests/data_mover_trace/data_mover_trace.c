@@ -0,0 +1,222 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdlib.h>
+#include <string.h>
+#include "libminiasync.h"
+#include "test_helpers.h"
+
+#define TEST_SIZE 4096
+#define TEST_NOPS 16
+
+struct test_hook_stats {
+	size_t nrecords;
+	size_t nunordered; /* records with the timestamps out of order */
+	size_t nwithout_completion;
+};
+
+/*
+ * test_hook -- checks the timestamps of the record of the reaped operation
+ */
+static void
+test_hook(const struct data_mover_trace_record *record, void *arg)
+{
+	struct test_hook_stats *stats = arg;
+	stats->nrecords++;
+
+	if (record->completed == 0) {
+		stats->nwithout_completion++;
+		if (record->created > record->started ||
+		    record->started > record->reaped)
+			stats->nunordered++;
+	} else if (record->created > record->started ||
+	    record->started > record->completed ||
+	    record->completed > record->reaped) {
+		stats->nunordered++;
+	}
+
+	UT_ASSERTeq(record->type, VDM_OPERATION_MEMCPY);
+	UT_ASSERTeq(record->size, TEST_SIZE);
+}
+
+/*
+ * test_histogram_total -- returns the number of the latencies counted
+ * in the histogram of the phase of the traced memcpy operations
+ */
+static uint64_t
+test_histogram_total(struct data_mover_trace *dmtr,
+	enum data_mover_trace_phase phase)
+{
+	uint64_t counts[DATA_MOVER_TRACE_LATENCY_BUCKETS];
+	data_mover_trace_get_histogram(dmtr, VDM_OPERATION_MEMCPY,
+		data_mover_trace_size_bucket(TEST_SIZE), phase, counts);
+
+	uint64_t total = 0;
+	for (size_t i = 0; i < DATA_MOVER_TRACE_LATENCY_BUCKETS; ++i)
+		total += counts[i];
+
+	return total;
+}
+
+/*
+ * test_trace_run -- performs the memcpy operations with the traced vdm
+ */
+static void
+test_trace_run(struct vdm *vdm)
+{
+	struct runtime *r = runtime_new();
+	char *src = malloc(TEST_SIZE * TEST_NOPS);
+	char *dst = malloc(TEST_SIZE * TEST_NOPS);
+	if (!r || !src || !dst)
+		UT_FATAL("out of memory");
+	memset(src, 0x11, TEST_SIZE * TEST_NOPS);
+	memset(dst, 0, TEST_SIZE * TEST_NOPS);
+
+	struct vdm_operation_future futs[TEST_NOPS];
+	struct future *runnables[TEST_NOPS];
+	for (size_t i = 0; i < TEST_NOPS; ++i) {
+		futs[i] = vdm_memcpy(vdm, dst + i * TEST_SIZE,
+			src + i * TEST_SIZE, TEST_SIZE, 0);
+		runnables[i] = FUTURE_AS_RUNNABLE(&futs[i]);
+	}
+	runtime_wait_multiple(r, runnables, TEST_NOPS);
+
+	for (size_t i = 0; i < TEST_NOPS; ++i) {
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->result, VDM_SUCCESS);
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->output.memcpy.dest,
+			dst + i * TEST_SIZE);
+	}
+	UT_ASSERTeq(memcmp(dst, src, TEST_SIZE * TEST_NOPS), 0);
+
+	free(dst);
+	free(src);
+	runtime_delete(r);
+}
+
+/*
+ * test_trace_threads -- all the phases of the operations of the threads
+ * mover are measured
+ */
+static void
+test_trace_threads(void)
+{
+	struct data_mover_threads *dmt = data_mover_threads_new(2, 128,
+		FUTURE_NOTIFIER_WAKER);
+	UT_ASSERTne(dmt, NULL);
+	struct data_mover_trace *dmtr = data_mover_trace_new(
+		data_mover_threads_get_vdm(dmt));
+	UT_ASSERTne(dmtr, NULL);
+	struct test_hook_stats stats = {0, 0, 0};
+	data_mover_trace_set_hook(dmtr, test_hook, &stats);
+
+	struct vdm *vdm = data_mover_trace_get_vdm(dmtr);
+	UT_ASSERTeq(vdm->capabilities,
+		data_mover_threads_get_vdm(dmt)->capabilities);
+	test_trace_run(vdm);
+
+	UT_ASSERTeq(stats.nrecords, TEST_NOPS);
+	UT_ASSERTeq(stats.nunordered, 0);
+	UT_ASSERTeq(stats.nwithout_completion, 0);
+	UT_ASSERTeq(test_histogram_total(dmtr, DATA_MOVER_TRACE_QUEUE),
+		TEST_NOPS);
+	UT_ASSERTeq(test_histogram_total(dmtr, DATA_MOVER_TRACE_EXECUTE),
+		TEST_NOPS);
+	UT_ASSERTeq(test_histogram_total(dmtr, DATA_MOVER_TRACE_REAP),
+		TEST_NOPS);
+
+	FILE *f = tmpfile();
+	UT_ASSERTne(f, NULL);
+	UT_ASSERTeq(data_mover_trace_dump(dmtr, f), 0);
+	rewind(f);
+	char line[128];
+	UT_ASSERTne(fgets(line, sizeof(line), f), NULL);
+	UT_ASSERTeq(strcmp(line, "type,min_size,phase,min_ns,count\n"), 0);
+	UT_ASSERTne(fgets(line, sizeof(line), f), NULL);
+	UT_ASSERTeq(strncmp(line, "memcpy,4096,queue,", 18), 0);
+	fclose(f);
+
+	data_mover_trace_reset(dmtr);
+	UT_ASSERTeq(test_histogram_total(dmtr, DATA_MOVER_TRACE_EXECUTE), 0);
+
+	data_mover_trace_delete(dmtr);
+	data_mover_threads_delete(dmt);
+}
+
+static struct vdm *test_plain_parent;
+
+/*
+ * test_plain_operation_new -- creates the operation in the data mover,
+ * which the plain one is a copy of
+ */
+static void *
+test_plain_operation_new(struct vdm *vdm, const enum vdm_operation_type type)
+{
+	(void) vdm;
+
+	return test_plain_parent->op_new(test_plain_parent, type);
+}
+
+/*
+ * test_trace_no_callback -- the operations of a data mover, which can't
+ * report their completion, are executed until they're reaped
+ */
+static void
+test_trace_no_callback(void)
+{
+	struct data_mover_sync *dms = data_mover_sync_new();
+	UT_ASSERTne(dms, NULL);
+
+	/* the same mover, but without the completion callbacks */
+	struct vdm plain_vdm = *data_mover_sync_get_vdm(dms);
+	plain_vdm.op_new = test_plain_operation_new;
+	plain_vdm.op_start_cb = NULL;
+	test_plain_parent = data_mover_sync_get_vdm(dms);
+
+	struct data_mover_trace *dmtr = data_mover_trace_new(&plain_vdm);
+	UT_ASSERTne(dmtr, NULL);
+	struct test_hook_stats stats = {0, 0, 0};
+	data_mover_trace_set_hook(dmtr, test_hook, &stats);
+
+	test_trace_run(data_mover_trace_get_vdm(dmtr));
+
+	UT_ASSERTeq(stats.nrecords, TEST_NOPS);
+	UT_ASSERTeq(stats.nunordered, 0);
+	UT_ASSERTeq(stats.nwithout_completion, TEST_NOPS);
+	UT_ASSERTeq(test_histogram_total(dmtr, DATA_MOVER_TRACE_EXECUTE),
+		TEST_NOPS);
+	UT_ASSERTeq(test_histogram_total(dmtr, DATA_MOVER_TRACE_REAP), 0);
+
+	data_mover_trace_delete(dmtr);
+	data_mover_sync_delete(dms);
+}
+
+/*
+ * test_trace_size_buckets -- each size bucket is for 4 times larger
+ * operations than the previous one
+ */
+static void
+test_trace_size_buckets(void)
+{
+	UT_ASSERTeq(data_mover_trace_size_bucket(0), 0);
+	UT_ASSERTeq(data_mover_trace_size_bucket(255), 0);
+	UT_ASSERTeq(data_mover_trace_size_bucket(256), 1);
+	UT_ASSERTeq(data_mover_trace_size_bucket(1023), 1);
+	UT_ASSERTeq(data_mover_trace_size_bucket(1024), 2);
+	UT_ASSERTeq(data_mover_trace_size_bucket(TEST_SIZE), 3);
+	UT_ASSERTeq(data_mover_trace_size_bucket(1 << 20),
+		DATA_MOVER_TRACE_SIZE_BUCKETS - 1);
+	UT_ASSERTeq(data_mover_trace_size_bucket(SIZE_MAX),
+		DATA_MOVER_TRACE_SIZE_BUCKETS - 1);
+}
+
+int
+main(void)
+{
+	UT_ASSERTeq(data_mover_trace_new(NULL), NULL);
+
+	test_trace_size_buckets();
+	test_trace_threads();
+	test_trace_no_callback();
+
+	return 0;
+}
@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libminiasync.h"
+#include "test_helpers.h"
+
+#define TEST_SIZE (256 * 1024)
+#define TEST_NOPS 8
+
+/*
+ * test_file_ops -- writes the file in pieces, reads it back and reads past
+ * its end with the data mover
+ */
+static int
+test_file_ops(struct runtime *r, struct vdm *vdm)
+{
+	FILE *f = tmpfile();
+	UT_ASSERTne(f, NULL);
+	int fd = fileno(f);
+
+	char *src = malloc(TEST_SIZE);
+	char *dst = malloc(TEST_SIZE);
+	if (src == NULL || dst == NULL)
+		UT_FATAL("out of memory");
+	for (size_t i = 0; i < TEST_SIZE; ++i)
+		src[i] = (char)(i % 251);
+	memset(dst, 0, TEST_SIZE);
+
+	size_t piece = TEST_SIZE / TEST_NOPS;
+	struct vdm_operation_future futs[TEST_NOPS];
+	struct future *pfuts[TEST_NOPS];
+	for (size_t i = 0; i < TEST_NOPS; ++i) {
+		futs[i] = vdm_pwrite(vdm, fd, src + i * piece, piece,
+			i * piece, i == 0 ? VDM_F_MEM_DURABLE : 0);
+		pfuts[i] = FUTURE_AS_RUNNABLE(&futs[i]);
+	}
+	runtime_wait_multiple(r, pfuts, TEST_NOPS);
+	for (size_t i = 0; i < TEST_NOPS; ++i) {
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->result, VDM_SUCCESS);
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->type,
+			VDM_OPERATION_PWRITE);
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->output.pwrite.n, piece);
+	}
+
+	struct vdm_operation_future fut = vdm_pread(vdm, fd, dst, TEST_SIZE,
+		0, 0);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->type, VDM_OPERATION_PREAD);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->output.pread.n, TEST_SIZE);
+	int ret = memcmp(src, dst, TEST_SIZE) != 0;
+
+	/* the read stops short at the end of the file */
+	fut = vdm_pread(vdm, fd, dst, TEST_SIZE, TEST_SIZE - 100, 0);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->output.pread.n, 100);
+
+	/* the failure of the file operation is reported with its errno */
+	fut = vdm_pread(vdm, -1, dst, TEST_SIZE, 0, 0);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_ERROR_IO);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->output.pread.error, EBADF);
+
+	free(dst);
+	free(src);
+	fclose(f);
+
+	return ret;
+}
+
+/*
+ * test_uring_registered -- reads the file into and writes it from
+ * the buffers registered with the ring
+ */
+static int
+test_uring_registered(struct runtime *r, struct data_mover_uring *dmu)
+{
+	FILE *f = tmpfile();
+	UT_ASSERTne(f, NULL);
+	int fd = fileno(f);
+
+	char *bufs = malloc(2 * TEST_SIZE);
+	if (bufs == NULL)
+		UT_FATAL("out of memory");
+	struct vdm_iov iov = {bufs, 2 * TEST_SIZE};
+	UT_ASSERTeq(data_mover_uring_register_buffers(dmu, &iov, 1), 0);
+	/* the buffers can be registered only once */
+	UT_ASSERTeq(data_mover_uring_register_buffers(dmu, &iov, 1), -1);
+
+	struct vdm *vdm = data_mover_uring_get_vdm(dmu);
+	memset(bufs, 0xab, TEST_SIZE);
+	memset(bufs + TEST_SIZE, 0, TEST_SIZE);
+	struct vdm_operation_future fut = vdm_pwrite(vdm, fd, bufs,
+		TEST_SIZE, 0, 0);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+
+	fut = vdm_pread(vdm, fd, bufs + TEST_SIZE, TEST_SIZE, 0, 0);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->output.pread.n, TEST_SIZE);
+	int ret = memcmp(bufs, bufs + TEST_SIZE, TEST_SIZE) != 0;
+
+	free(bufs);
+	fclose(f);
+
+	return ret;
+}
+
+/*
+ * test_uring_memcpy -- the memory operations of the uring mover
+ * are performed on the cpu
+ */
+static int
+test_uring_memcpy(struct runtime *r, struct vdm *vdm)
+{
+	char src[100];
+	char dst[100];
+	memset(src, 7, sizeof(src));
+	memset(dst, 0, sizeof(dst));
+
+	struct vdm_operation_future fut = vdm_memcpy(vdm, dst, src,
+		sizeof(src), 0);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->output.memcpy.dest, dst);
+
+	return memcmp(src, dst, sizeof(src)) != 0;
+}
+
+/*
+ * test_uring -- tests the uring mover, which wakes the futures
+ * with the notifier
+ */
+static int
+test_uring(struct runtime *r, enum future_notifier_type notifier)
+{
+	struct data_mover_uring *dmu = data_mover_uring_new(4, notifier);
+	if (dmu == NULL) {
+		UT_LOG_SKIP("data_mover_uring");
+		return 0;
+	}
+
+	struct vdm *vdm = data_mover_uring_get_vdm(dmu);
+	int ret = test_file_ops(r, vdm) ||
+		test_uring_memcpy(r, vdm) ||
+		test_uring_registered(r, dmu);
+
+	data_mover_uring_delete(dmu);
+
+	return ret;
+}
+
+int
+main(void)
+{
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+
+	/* the other data movers perform the file operations on the cpu */
+	struct data_mover_sync *dms = data_mover_sync_new();
+	struct data_mover_threads *dmt = data_mover_threads_new(2, 128,
+		FUTURE_NOTIFIER_WAKER);
+	UT_ASSERTne(dms, NULL);
+	UT_ASSERTne(dmt, NULL);
+
+	int ret = test_file_ops(r, data_mover_sync_get_vdm(dms)) ||
+		test_file_ops(r, data_mover_threads_get_vdm(dmt)) ||
+		test_uring(r, FUTURE_NOTIFIER_NONE) ||
+		test_uring(r, FUTURE_NOTIFIER_WAKER) ||
+		test_uring(r, FUTURE_NOTIFIER_POLLER);
+
+	data_mover_threads_delete(dmt);
+	data_mover_sync_delete(dms);
+	runtime_delete(r);
+
+	return ret;
+}
@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "core/eventcount.h"
+#include "core/util.h"
+#include "os_thread.h"
+#include "test_helpers.h"
+
+#define TEST_NTHREADS 4
+#define TEST_NEVENTS 10000
+
+struct test_counter {
+	struct eventcount ec;
+	uint64_t value;
+};
+
+/*
+ * counter_wait -- waits until the counter reaches the given value
+ */
+void
+counter_wait(struct test_counter *c, uint64_t value)
+{
+	for (;;) {
+		uint32_t key = eventcount_prepare(&c->ec);
+
+		uint64_t current;
+		util_atomic_load_explicit64(&c->value, &current,
+			memory_order_acquire);
+		if (current >= value) {
+			eventcount_cancel(&c->ec);
+			return;
+		}
+
+		eventcount_wait(&c->ec, key, NULL);
+	}
+}
+
+void *
+counter_waiter_thread(void *arg)
+{
+	struct test_counter *c = arg;
+	for (uint64_t i = 1; i <= TEST_NEVENTS; ++i)
+		counter_wait(c, i);
+
+	return NULL;
+}
+
+/*
+ * test_eventcount_mt -- waiters never miss the last notification
+ */
+void
+test_eventcount_mt(void)
+{
+	struct test_counter c;
+	eventcount_init(&c.ec);
+	c.value = 0;
+
+	os_thread_t threads[TEST_NTHREADS];
+	for (int i = 0; i < TEST_NTHREADS; ++i) {
+		UT_ASSERTeq(os_thread_create(&threads[i], NULL,
+			counter_waiter_thread, &c), 0);
+	}
+
+	for (int i = 0; i < TEST_NEVENTS; ++i) {
+		util_fetch_and_add64(&c.value, 1);
+		eventcount_notify_all(&c.ec);
+	}
+
+	for (int i = 0; i < TEST_NTHREADS; ++i)
+		os_thread_join(&threads[i], NULL);
+
+	UT_ASSERTeq(c.ec.nwaiters, 0);
+}
+
+/*
+ * test_eventcount_timeout -- waiting without a notification times out
+ */
+void
+test_eventcount_timeout(void)
+{
+	struct eventcount ec;
+	eventcount_init(&ec);
+
+	struct timespec timeout = {0, 1000000};
+	uint32_t key = eventcount_prepare(&ec);
+	while (eventcount_wait(&ec, key, &timeout) == 0)
+		key = eventcount_prepare(&ec); /* spurious wakeup */
+	UT_ASSERTeq(ec.nwaiters, 0);
+
+	/* a notification before the wait makes it return immediately */
+	key = eventcount_prepare(&ec);
+	eventcount_notify_one(&ec);
+	UT_ASSERTeq(eventcount_wait(&ec, key, NULL), 0);
+
+	/* no waiters, the notification doesn't change the epoch */
+	uint32_t epoch = ec.epoch;
+	eventcount_notify_all(&ec);
+	UT_ASSERTeq(ec.epoch, epoch);
+}
+
+int
+main(void)
+{
+	test_eventcount_timeout();
+	test_eventcount_mt();
+
+	return 0;
+}
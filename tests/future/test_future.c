@@ -190,12 +190,16 @@ test_chained_future()
 {
 	struct up_down_fut fut = async_up_down(TEST_MAX_COUNT);
 	UT_ASSERTeq(FUTURE_STATE(&fut), FUTURE_STATE_IDLE);
+	UT_ASSERTeq(fut.base.context.resume_offset, 0);
 
 	for (int i = 0; i < TEST_MAX_COUNT * 2; ++i) {
 		future_poll(FUTURE_AS_RUNNABLE(&fut), FAKE_NOTIFIER);
 	}
 
 	UT_ASSERTeq(FUTURE_STATE(&fut), FUTURE_STATE_COMPLETE);
+	/* the polling was resumed at the last entry */
+	UT_ASSERTeq(fut.base.context.resume_offset,
+		offsetof(struct up_down_data, down));
 
 	struct up_down_output *output = FUTURE_OUTPUT(&fut);
 	UT_ASSERTeq(output->result_sum, 2);
@@ -312,6 +316,466 @@ test_lazy_init()
 	UT_ASSERTeq(mud_data->up_down.fut.data.up.fut.data.counter, 5 * 5);
 }
 
+struct mul_down_data {
+	FUTURE_CHAIN_ENTRY(struct multiply_fut, mul);
+	FUTURE_CHAIN_ENTRY_LAST(struct countdown_fut, down);
+};
+
+struct mul_down_output {
+	int result;
+};
+
+FUTURE(mul_down_fut, struct mul_down_data, struct mul_down_output);
+
+void
+countdown_init(void *future, struct future_context *chain_fut, void *arg)
+{
+	struct countdown_fut fut = async_countdown(0);
+	memcpy(future, &fut, sizeof(fut));
+}
+
+struct mul_down_fut
+async_mul_down(int a, int b)
+{
+	struct mul_down_fut fut = {.output.result = 0};
+	FUTURE_CHAIN_ENTRY_INIT(&fut.data.mul, async_multiply(a, b),
+		NULL, NULL);
+	FUTURE_CHAIN_ENTRY_BIND(&fut.data.mul, &fut.data.down, counter);
+	FUTURE_CHAIN_ENTRY_LAZY_INIT(&fut.data.down, countdown_init, NULL,
+		NULL, NULL);
+	FUTURE_CHAIN_ENTRY_BIND_OUTPUT(&fut.data.down, &fut, result);
+	FUTURE_CHAIN_INIT(&fut);
+
+	return fut;
+}
+
+struct mul_join_data {
+	FUTURE_JOIN_ENTRY(struct multiply_fut, first);
+	FUTURE_JOIN_ENTRY_LAST(struct multiply_fut, second);
+};
+
+struct mul_join_output {
+	int first;
+	int second;
+};
+
+FUTURE(mul_join_fut, struct mul_join_data, struct mul_join_output);
+
+void
+test_chain_bind()
+{
+	struct mul_down_fut moved = async_mul_down(2, 3);
+	UT_ASSERT((uintptr_t)moved.data.mul.flags &
+		FUTURE_CHAIN_FLAG_ENTRY_BOUND);
+	UT_ASSERT((uintptr_t)moved.data.down.flags &
+		FUTURE_CHAIN_FLAG_ENTRY_BOUND);
+
+	/* the bindings don't depend on where the chain is */
+	struct mul_down_fut fut;
+	memcpy(&fut, &moved, sizeof(fut));
+	memset(&moved, 0, sizeof(moved));
+
+	int polls = 0;
+	while (future_poll(FUTURE_AS_RUNNABLE(&fut), FAKE_NOTIFIER) !=
+		FUTURE_STATE_COMPLETE)
+		polls++;
+
+	/* the output of 'mul' was bound after 'down' was initialized */
+	UT_ASSERTeq(polls, 2 * 3 - 1);
+	UT_ASSERTeq(fut.data.down.fut.data.counter, 0);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, 1);
+
+	struct mul_join_fut join = {.output = {0, 0}};
+	FUTURE_JOIN_ENTRY_INIT(&join.data.first, async_multiply(2, 3),
+		NULL, NULL);
+	FUTURE_JOIN_ENTRY_BIND_OUTPUT(&join.data.first, &join, first);
+	FUTURE_JOIN_ENTRY_INIT(&join.data.second, async_multiply(4, 5),
+		NULL, NULL);
+	FUTURE_JOIN_ENTRY_BIND_OUTPUT(&join.data.second, &join, second);
+	FUTURE_JOIN_INIT(&join);
+
+	FUTURE_BUSY_POLL(&join);
+	UT_ASSERTeq(FUTURE_OUTPUT(&join)->first, 6);
+	UT_ASSERTeq(FUTURE_OUTPUT(&join)->second, 20);
+}
+
+struct steps_data {
+	int steps;
+	int polls;
+	enum future_notifier_type notifier_used;
+	uint64_t *ptr_to_monitor;
+};
+
+struct steps_output {
+	int polls;
+};
+
+FUTURE(steps_fut, struct steps_data, struct steps_output);
+
+enum future_state
+steps_task(struct future_context *context, struct future_notifier *notifier)
+{
+	struct steps_data *data = future_context_get_data(context);
+	if (++data->polls == data->steps) {
+		struct steps_output *output =
+			future_context_get_output(context);
+		output->polls = data->polls;
+		return FUTURE_STATE_COMPLETE;
+	}
+
+	if (notifier != NULL) {
+		UT_ASSERTeq(notifier->notifier_used, FUTURE_NOTIFIER_NONE);
+		notifier->notifier_used = data->notifier_used;
+		notifier->poller.ptr_to_monitor = data->ptr_to_monitor;
+	}
+
+	return FUTURE_STATE_RUNNING;
+}
+
+struct steps_fut
+async_steps(int steps, enum future_notifier_type notifier_used,
+	uint64_t *ptr_to_monitor)
+{
+	struct steps_fut fut = {.output.polls = 0};
+	FUTURE_INIT(&fut, steps_task);
+	fut.data.steps = steps;
+	fut.data.polls = 0;
+	fut.data.notifier_used = notifier_used;
+	fut.data.ptr_to_monitor = ptr_to_monitor;
+
+	return fut;
+}
+
+struct steps_join_data {
+	FUTURE_JOIN_ENTRY(struct steps_fut, first);
+	FUTURE_JOIN_ENTRY_LAST(struct steps_fut, second);
+	int steps;
+};
+
+struct steps_join_output {
+	int polls;
+};
+
+FUTURE(steps_join_fut, struct steps_join_data, struct steps_join_output);
+
+void
+steps_to_join_map(struct future_context *lhs, struct future_context *rhs,
+	void *arg)
+{
+	UT_ASSERTeq(arg, FAKE_MAP_ARG);
+
+	struct steps_output *output = future_context_get_output(lhs);
+	struct steps_join_output *join_output = future_context_get_output(rhs);
+	join_output->polls += output->polls;
+}
+
+void
+steps_init(void *future, struct future_context *join_fut, void *arg)
+{
+	struct steps_join_data *data = future_context_get_data(join_fut);
+	struct steps_fut fut = async_steps(data->steps,
+		(enum future_notifier_type)(uintptr_t)arg, NULL);
+	memcpy(future, &fut, sizeof(fut));
+}
+
+struct steps_join_fut
+async_steps_join(int first, enum future_notifier_type first_used,
+	int second, enum future_notifier_type second_used,
+	uint64_t *ptr_to_monitor)
+{
+	struct steps_join_fut fut = {.output.polls = 0};
+	fut.data.steps = second;
+	FUTURE_JOIN_ENTRY_INIT(&fut.data.first,
+		async_steps(first, first_used, ptr_to_monitor),
+		steps_to_join_map, FAKE_MAP_ARG);
+	FUTURE_JOIN_ENTRY_LAZY_INIT(&fut.data.second,
+		steps_init, (void *)(uintptr_t)second_used,
+		steps_to_join_map, FAKE_MAP_ARG);
+	FUTURE_JOIN_INIT(&fut);
+
+	return fut;
+}
+
+/*
+ * test_join_notifier -- polls the join future until it's complete, checking
+ * the notifier it reports after each poll
+ */
+static void
+test_join_notifier(int first, enum future_notifier_type first_used,
+	int second, enum future_notifier_type second_used,
+	enum future_notifier_type joined_used)
+{
+	uint64_t monitored = 0;
+	struct steps_join_fut fut = async_steps_join(first, first_used,
+		second, second_used, &monitored);
+
+	int polls = 0;
+	struct future_notifier notifier;
+	enum future_state state;
+	do {
+		memset(&notifier, 0, sizeof(notifier));
+		notifier.notifier_used = FUTURE_NOTIFIER_NONE;
+		state = future_poll(FUTURE_AS_RUNNABLE(&fut), &notifier);
+		polls++;
+
+		/* all the entries are started on the first poll */
+		UT_ASSERTeq(fut.data.first.fut.data.polls,
+			polls < first ? polls : first);
+		UT_ASSERTeq(fut.data.second.fut.data.polls,
+			polls < second ? polls : second);
+
+		if (state == FUTURE_STATE_COMPLETE)
+			break;
+
+		/* only the running entries are taken into account */
+		if (polls >= first)
+			UT_ASSERTeq(notifier.notifier_used, second_used);
+		else if (polls >= second)
+			UT_ASSERTeq(notifier.notifier_used, first_used);
+		else
+			UT_ASSERTeq(notifier.notifier_used, joined_used);
+		if (notifier.notifier_used == FUTURE_NOTIFIER_POLLER)
+			UT_ASSERTeq(notifier.poller.ptr_to_monitor,
+				&monitored);
+	} while (1);
+
+	UT_ASSERTeq(polls, first > second ? first : second);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->polls, first + second);
+	UT_ASSERTeq(future_has_property(FUTURE_AS_RUNNABLE(&fut),
+		FUTURE_PROPERTY_ASYNC), -1);
+}
+
+void
+test_join_future()
+{
+	test_join_notifier(3, FUTURE_NOTIFIER_WAKER,
+		5, FUTURE_NOTIFIER_WAKER, FUTURE_NOTIFIER_WAKER);
+	test_join_notifier(5, FUTURE_NOTIFIER_WAKER,
+		3, FUTURE_NOTIFIER_NONE, FUTURE_NOTIFIER_NONE);
+	test_join_notifier(4, FUTURE_NOTIFIER_POLLER,
+		4, FUTURE_NOTIFIER_WAKER, FUTURE_NOTIFIER_POLLER);
+	test_join_notifier(2, FUTURE_NOTIFIER_NONE,
+		6, FUTURE_NOTIFIER_WAKER, FUTURE_NOTIFIER_NONE);
+
+	/* without a notifier */
+	struct steps_join_fut fut = async_steps_join(4, FUTURE_NOTIFIER_WAKER,
+		2, FUTURE_NOTIFIER_WAKER, NULL);
+	UT_ASSERTeq(future_has_property(FUTURE_AS_RUNNABLE(&fut),
+		FUTURE_PROPERTY_ASYNC), 0);
+	FUTURE_BUSY_POLL(&fut);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->polls, 4 + 2);
+}
+
+struct steps_select_data {
+	FUTURE_SELECT_ENTRY(struct steps_fut, slow);
+	FUTURE_SELECT_ENTRY(struct steps_fut, fast);
+	FUTURE_SELECT_ENTRY_LAST(struct steps_fut, stubborn);
+	int canceled;
+};
+
+struct steps_select_output {
+	int polls;
+};
+
+FUTURE(steps_select_fut, struct steps_select_data,
+	struct steps_select_output);
+
+void
+steps_to_select_map(struct future_context *lhs, struct future_context *rhs,
+	void *arg)
+{
+	UT_ASSERTeq(arg, FAKE_MAP_ARG);
+
+	struct steps_output *output = future_context_get_output(lhs);
+	struct steps_select_output *select_output =
+		future_context_get_output(rhs);
+	UT_ASSERTeq(select_output->polls, 0);
+	select_output->polls = output->polls;
+}
+
+int
+steps_cancel(void *future)
+{
+	struct steps_fut *fut = future;
+	/* completes on the next poll */
+	fut->data.steps = fut->data.polls + 1;
+
+	return 0;
+}
+
+/*
+ * test_select_future -- the first entry to complete is mapped onto
+ * the select future, the other ones are canceled and polled until complete
+ */
+void
+test_select_future()
+{
+	struct steps_select_fut fut = {.output.polls = 0};
+	FUTURE_SELECT_ENTRY_INIT(&fut.data.slow,
+		async_steps(100, FUTURE_NOTIFIER_WAKER, NULL),
+		steps_to_select_map, FAKE_MAP_ARG, steps_cancel);
+	FUTURE_SELECT_ENTRY_INIT(&fut.data.fast,
+		async_steps(3, FUTURE_NOTIFIER_WAKER, NULL),
+		steps_to_select_map, FAKE_MAP_ARG, steps_cancel);
+	/* can't be canceled */
+	FUTURE_SELECT_ENTRY_INIT(&fut.data.stubborn,
+		async_steps(6, FUTURE_NOTIFIER_WAKER, NULL),
+		steps_to_select_map, FAKE_MAP_ARG, NULL);
+	FUTURE_SELECT_INIT(&fut);
+
+	struct future *runnable = FUTURE_AS_RUNNABLE(&fut);
+	UT_ASSERTeq(future_select_winner(runnable), -1);
+	UT_ASSERTeq(future_has_property(runnable, FUTURE_PROPERTY_ASYNC), 0);
+
+	int polls = 0;
+	struct future_notifier notifier;
+	do {
+		memset(&notifier, 0, sizeof(notifier));
+		notifier.notifier_used = FUTURE_NOTIFIER_NONE;
+		polls++;
+	} while (future_poll(runnable, &notifier) != FUTURE_STATE_COMPLETE);
+
+	/*
+	 * The stubborn entry isn't canceled, it's polled twice when the fast
+	 * one wins, together with the canceled slow one.
+	 */
+	UT_ASSERTeq(polls, 5);
+	UT_ASSERTeq(fut.data.stubborn.fut.data.polls, 6);
+	UT_ASSERTeq(future_select_winner(runnable), 1);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->polls, 3);
+	/* the slow entry completed on the poll after the cancellation */
+	UT_ASSERTeq(fut.data.slow.fut.data.polls, 4);
+	UT_ASSERTeq(FUTURE_STATE(&fut.data.slow.fut), FUTURE_STATE_COMPLETE);
+	UT_ASSERTeq(FUTURE_STATE(&fut.data.stubborn.fut),
+		FUTURE_STATE_COMPLETE);
+	UT_ASSERTeq(future_has_property(runnable, FUTURE_PROPERTY_ASYNC), -1);
+
+	/* canceled before the first poll, the first entry wins */
+	fut.output.polls = 0;
+	FUTURE_SELECT_ENTRY_INIT(&fut.data.slow,
+		async_steps(100, FUTURE_NOTIFIER_WAKER, NULL),
+		steps_to_select_map, FAKE_MAP_ARG, steps_cancel);
+	FUTURE_SELECT_ENTRY_INIT(&fut.data.fast,
+		async_steps(50, FUTURE_NOTIFIER_WAKER, NULL),
+		steps_to_select_map, FAKE_MAP_ARG, steps_cancel);
+	FUTURE_SELECT_ENTRY_INIT(&fut.data.stubborn,
+		async_steps(2, FUTURE_NOTIFIER_WAKER, NULL),
+		steps_to_select_map, FAKE_MAP_ARG, NULL);
+	FUTURE_SELECT_INIT(&fut);
+	UT_ASSERTeq(future_select_cancel(runnable), 0);
+	FUTURE_BUSY_POLL(&fut);
+	UT_ASSERTeq(future_select_winner(runnable), 0);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->polls, 1);
+	UT_ASSERTeq(future_select_cancel(runnable), -1);
+}
+
+struct steps_loop_data {
+	FUTURE_LOOP_ENTRY(struct steps_fut, steps);
+	int attempts;
+	int max_attempts;
+};
+
+struct steps_loop_output {
+	int polls;
+};
+
+FUTURE(steps_loop_fut, struct steps_loop_data, struct steps_loop_output);
+
+void
+steps_loop_init(void *future, struct future_context *loop_fut, void *arg)
+{
+	UT_ASSERTeq(arg, FAKE_MAP_ARG);
+
+	struct steps_loop_data *data = future_context_get_data(loop_fut);
+	data->attempts++;
+	struct steps_fut fut = async_steps(data->attempts,
+		FUTURE_NOTIFIER_NONE, NULL);
+	memcpy(future, &fut, sizeof(fut));
+}
+
+int
+steps_loop_again(struct future_context *entry,
+	struct future_context *loop_fut, void *arg)
+{
+	UT_ASSERTeq(arg, FAKE_MAP_ARG);
+
+	struct steps_loop_data *data = future_context_get_data(loop_fut);
+	struct steps_output *output = future_context_get_output(entry);
+	struct steps_loop_output *loop_output =
+		future_context_get_output(loop_fut);
+	loop_output->polls += output->polls;
+
+	return data->attempts < data->max_attempts;
+}
+
+/*
+ * test_loop_future -- the entry of the loop future is initialized in place
+ * and performed again, until it's done
+ */
+void
+test_loop_future()
+{
+	struct steps_loop_fut fut = {.output.polls = 0};
+	FUTURE_LOOP_ENTRY_INIT(&fut.data.steps, steps_loop_init,
+		FAKE_MAP_ARG, steps_loop_again, FAKE_MAP_ARG);
+	fut.data.attempts = 0;
+	fut.data.max_attempts = 4;
+	FUTURE_LOOP_INIT(&fut);
+
+	int polls = 0;
+	while (future_poll(FUTURE_AS_RUNNABLE(&fut), NULL) !=
+			FUTURE_STATE_COMPLETE)
+		polls++;
+
+	UT_ASSERTeq(fut.data.attempts, 4);
+	/* each attempt takes one more poll than the previous one */
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->polls, 1 + 2 + 3 + 4);
+	UT_ASSERTeq(polls + 1, 1 + 2 + 3 + 4);
+}
+
+/*
+ * sum_polls_map -- sums the polls of the chain entries
+ */
+void
+sum_polls_map(struct future_context *lhs, struct future_context *rhs,
+	void *arg)
+{
+	struct steps_output *output = future_context_get_output(lhs);
+	*(int *)arg += output->polls;
+}
+
+/*
+ * test_chain_arena -- the chains built in an arena perform their entries
+ * in the order they were appended
+ */
+void
+test_chain_arena()
+{
+	uint64_t buf[64];
+	struct future_chain_arena arena;
+	UT_ASSERTeq(future_chain_arena_init(&arena, buf, 8), -1);
+	UT_ASSERTeq(future_chain_arena_init(&arena, buf, sizeof(buf)), 0);
+
+	int polls = 0;
+	size_t nentries = 0;
+	for (int steps = 1; ; ++steps) {
+		struct steps_fut fut = async_steps(steps,
+			FUTURE_NOTIFIER_NONE, NULL);
+		struct steps_fut *entry = FUTURE_CHAIN_ARENA_APPEND(&arena,
+			&fut, sum_polls_map, &polls);
+		if (entry == NULL)
+			break;
+		UT_ASSERTeq(entry->data.steps, steps);
+		nentries++;
+	}
+	UT_ASSERT(nentries > 1);
+
+	while (future_poll(arena.chain, NULL) != FUTURE_STATE_COMPLETE)
+		;
+	UT_ASSERTeq(polls, (int)(nentries * (nentries + 1) / 2));
+	UT_ASSERTeq(arena.chain->context.state, FUTURE_STATE_COMPLETE);
+}
+
 int
 main(void)
 {
@@ -319,6 +783,11 @@ main(void)
 	test_chained_future();
 	test_completed_future();
 	test_lazy_init();
+	test_chain_bind();
+	test_join_future();
+	test_select_future();
+	test_loop_future();
+	test_chain_arena();
 
 	return 0;
 }
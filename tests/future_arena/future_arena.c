@@ -0,0 +1,200 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "libminiasync.h"
+#include "core/util.h"
+#include "test_helpers.h"
+
+#define TEST_NTHREADS 4
+#define TEST_NFUTURES 10000
+#define TEST_MAX_COUNT 20
+#define TEST_BUFFER_SIZE ((size_t)1 << 16)
+#define TEST_CACHELINE_SIZE 64
+
+struct countup_data {
+	uint64_t *ncompleted; /* bumped when the future completes */
+	int counter;
+	int max_count;
+};
+
+struct countup_output {
+	int result;
+};
+
+FUTURE(countup_fut, struct countup_data, struct countup_output);
+
+enum future_state
+countup_task(struct future_context *context,
+	struct future_notifier *notifier)
+{
+	struct countup_data *data = future_context_get_data(context);
+	if (++data->counter < data->max_count)
+		return FUTURE_STATE_RUNNING;
+
+	struct countup_output *output = future_context_get_output(context);
+	output->result = 1;
+	util_fetch_and_add64(data->ncompleted, 1);
+
+	return FUTURE_STATE_COMPLETE;
+}
+
+struct countup_fut
+async_countup(uint64_t *ncompleted, int max_count)
+{
+	struct countup_fut fut = {.output.result = 0};
+	FUTURE_INIT(&fut, countup_task);
+	fut.data.ncompleted = ncompleted;
+	fut.data.counter = 0;
+	fut.data.max_count = max_count;
+
+	return fut;
+}
+
+/*
+ * test_alloc_free -- allocates, copies and frees the futures on the calling
+ * thread, reusing the freed ones
+ */
+void
+test_alloc_free(void)
+{
+	struct future_arena *arena = future_arena_new(TEST_BUFFER_SIZE);
+	UT_ASSERTne(arena, NULL);
+
+	uint64_t ncompleted = 0;
+	struct countup_fut fut = async_countup(&ncompleted, 1);
+	struct countup_fut *copy = FUTURE_ARENA_DUP(arena, &fut);
+	UT_ASSERTne(copy, NULL);
+	uintptr_t misalign = (uintptr_t)copy % TEST_CACHELINE_SIZE;
+	UT_ASSERTeq(misalign, 0);
+	UT_ASSERTeq(FUTURE_DATA(copy)->max_count, 1);
+
+	FUTURE_BUSY_POLL(copy);
+	UT_ASSERTeq(FUTURE_OUTPUT(copy)->result, 1);
+	UT_ASSERTeq(ncompleted, 1);
+
+	void *other = future_arena_alloc(arena, sizeof(fut));
+	UT_ASSERTne(other, NULL);
+	UT_ASSERTne(other, copy);
+	misalign = (uintptr_t)other % TEST_CACHELINE_SIZE;
+	UT_ASSERTeq(misalign, 0);
+
+	struct vdm_membuf_stats stats;
+	future_arena_get_stats(arena, &stats);
+	UT_ASSERTeq(stats.buffers, 1);
+	UT_ASSERT(stats.buffer_size <= TEST_BUFFER_SIZE);
+	UT_ASSERT(stats.bytes_allocated >= 2 * sizeof(fut));
+
+	future_arena_free(copy);
+	future_arena_free(other);
+
+	/* the freed futures are taken over by the allocations of their size */
+	for (int i = 0; i < TEST_NFUTURES; ++i) {
+		void *f = future_arena_alloc(arena, sizeof(fut));
+		UT_ASSERTne(f, NULL);
+		future_arena_free(f);
+	}
+	future_arena_get_stats(arena, &stats);
+	UT_ASSERTeq(stats.buffers, 1);
+	UT_ASSERTeq(stats.failures, 0);
+
+	future_arena_delete(arena);
+}
+
+/*
+ * test_alloc_large -- the allocations larger than half of the buffer take
+ * a buffer of their own, and the ones larger than the buffer fail
+ */
+void
+test_alloc_large(void)
+{
+	struct future_arena *arena = future_arena_new(TEST_BUFFER_SIZE);
+	UT_ASSERTne(arena, NULL);
+
+	struct vdm_membuf_stats stats;
+	future_arena_get_stats(arena, &stats);
+	size_t size = stats.buffer_size / 4 * 3;
+
+	void *first = future_arena_alloc(arena, size);
+	UT_ASSERTne(first, NULL);
+	void *second = future_arena_alloc(arena, size);
+	UT_ASSERTne(second, NULL);
+	future_arena_get_stats(arena, &stats);
+	UT_ASSERTeq(stats.buffers, 2);
+
+	/* the freed entry is reused */
+	future_arena_free(first);
+	first = future_arena_alloc(arena, size);
+	UT_ASSERTne(first, NULL);
+	future_arena_get_stats(arena, &stats);
+	UT_ASSERTeq(stats.buffers, 2);
+	UT_ASSERTeq(stats.failures, 0);
+
+	UT_ASSERTeq(future_arena_alloc(arena, stats.buffer_size + 1), NULL);
+	future_arena_get_stats(arena, &stats);
+	UT_ASSERTeq(stats.buffers, 2);
+	UT_ASSERTeq(stats.failures, 1);
+
+	future_arena_free(first);
+	future_arena_free(second);
+	future_arena_delete(arena);
+}
+
+/*
+ * test_spawn_owned -- spawns futures allocated from an arena, which are
+ * freed by the executors once they complete
+ */
+void
+test_spawn_owned(void)
+{
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+	struct future_arena *arena = future_arena_new(0);
+	UT_ASSERTne(arena, NULL);
+
+	uint64_t ncompleted = 0;
+	struct countup_fut fut = async_countup(&ncompleted, TEST_MAX_COUNT);
+	struct countup_fut *owned = FUTURE_ARENA_DUP(arena, &fut);
+	UT_ASSERTne(owned, NULL);
+
+	/* spawning requires running executors, and keeps the future if fails */
+	UT_ASSERTeq(runtime_spawn_owned(r, FUTURE_AS_RUNNABLE(owned)), -1);
+	future_arena_free(owned);
+
+	UT_ASSERTeq(runtime_executors_start(r, TEST_NTHREADS), 0);
+
+	for (int i = 0; i < TEST_NFUTURES; ++i) {
+		owned = FUTURE_ARENA_DUP(arena, &fut);
+		UT_ASSERTne(owned, NULL);
+		UT_ASSERTeq(runtime_spawn_owned(r,
+			FUTURE_AS_RUNNABLE(owned)), 0);
+	}
+
+	/* an already complete future is freed right away */
+	struct countup_fut done = async_countup(&ncompleted, 1);
+	FUTURE_BUSY_POLL(&done);
+	owned = FUTURE_ARENA_DUP(arena, &done);
+	UT_ASSERTne(owned, NULL);
+	UT_ASSERTeq(runtime_spawn_owned(r, FUTURE_AS_RUNNABLE(owned)), 0);
+
+	runtime_wait_spawned(r);
+	UT_ASSERTeq(ncompleted, TEST_NFUTURES + 1);
+
+	struct vdm_membuf_stats stats;
+	future_arena_get_stats(arena, &stats);
+	UT_ASSERTeq(stats.failures, 0);
+
+	runtime_delete(r);
+	future_arena_delete(arena);
+}
+
+int
+main(void)
+{
+	test_alloc_free();
+	test_alloc_large();
+	test_spawn_owned();
+
+	return 0;
+}
@@ -0,0 +1,197 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <cstdlib>
+#include <cstring>
+#include "libminiasync.hpp"
+#include "test_helpers.h"
+
+#define TEST_MAX_COUNT 10
+#define TEST_BUF_SIZE 4096
+
+struct countup_data {
+	int counter;
+	int max_count;
+};
+
+struct countup_output {
+	int result;
+};
+
+FUTURE(countup_fut, struct countup_data, struct countup_output);
+
+static enum future_state
+countup_task(struct future_context *context,
+	struct future_notifier *notifier)
+{
+	if (notifier != NULL)
+		notifier->notifier_used = FUTURE_NOTIFIER_NONE;
+
+	struct countup_data *data =
+		(struct countup_data *)future_context_get_data(context);
+	if (++data->counter != data->max_count)
+		return FUTURE_STATE_RUNNING;
+
+	struct countup_output *output =
+		(struct countup_output *)future_context_get_output(context);
+	output->result = data->counter;
+
+	return FUTURE_STATE_COMPLETE;
+}
+
+static struct countup_fut
+async_countup(int max_count)
+{
+	struct countup_fut fut;
+	FUTURE_INIT(&fut, countup_task);
+	fut.data.counter = 0;
+	fut.data.max_count = max_count;
+	fut.output.result = 0;
+
+	return fut;
+}
+
+/*
+ * test_then -- chains the C futures, and ends the chain with a value
+ */
+static void
+test_then()
+{
+	auto fut = miniasync::then(miniasync::wrap(async_countup(2)),
+		[](countup_output &out) {
+			return miniasync::then(
+				miniasync::wrap(async_countup(out.result * 2)),
+				[](countup_output &out) {
+					return miniasync::ready(out.result + 1);
+				});
+		});
+
+	int polls = 0;
+	while (fut.poll(NULL) != FUTURE_STATE_COMPLETE)
+		polls++;
+
+	/* each future completes in the poll the next one is started in */
+	UT_ASSERTeq(polls, 1 + 3);
+	UT_ASSERTeq(fut.output(), 5);
+
+	/* polling a complete future does nothing */
+	UT_ASSERTeq(fut.poll(NULL), FUTURE_STATE_COMPLETE);
+	UT_ASSERTeq(fut.output(), 5);
+}
+
+/*
+ * test_join_runtime -- joins the copies of two buffers, and waits for them
+ * on the runtime
+ */
+static void
+test_join_runtime(struct runtime *r, struct vdm *vdm)
+{
+	char *src = (char *)malloc(TEST_BUF_SIZE * 2);
+	char *dst = (char *)malloc(TEST_BUF_SIZE * 2);
+	UT_ASSERTne(src, NULL);
+	UT_ASSERTne(dst, NULL);
+	memset(src, 'a', TEST_BUF_SIZE);
+	memset(src + TEST_BUF_SIZE, 'b', TEST_BUF_SIZE);
+
+	auto copies = miniasync::join(
+		miniasync::wrap(vdm_memcpy(vdm, dst, src, TEST_BUF_SIZE, 0)),
+		miniasync::wrap(vdm_memcpy(vdm, dst + TEST_BUF_SIZE,
+			src + TEST_BUF_SIZE, TEST_BUF_SIZE, 0)),
+		miniasync::wrap(async_countup(TEST_MAX_COUNT)));
+
+	miniasync::runnable<decltype(copies)> fut(std::move(copies));
+	UT_ASSERTeq(fut.state(), FUTURE_STATE_IDLE);
+	runtime_wait(r, fut.get());
+	UT_ASSERTeq(fut.state(), FUTURE_STATE_COMPLETE);
+
+	auto [first, second, count] = fut.output();
+	UT_ASSERTeq(first.result, VDM_SUCCESS);
+	UT_ASSERTeq(second.result, VDM_SUCCESS);
+	UT_ASSERTeq(count.result, TEST_MAX_COUNT);
+	UT_ASSERTeq(memcmp(src, dst, TEST_BUF_SIZE * 2), 0);
+
+	free(dst);
+	free(src);
+}
+
+#ifdef MINIASYNC_HAS_COROUTINES
+
+static miniasync::task<int>
+count_twice(int max_count)
+{
+	countup_output first = co_await miniasync::wrap(
+		async_countup(max_count));
+	countup_output second = co_await miniasync::wrap(
+		async_countup(max_count));
+
+	co_return first.result + second.result;
+}
+
+static miniasync::task<>
+copy_and_count(struct vdm *vdm, char *dst, const char *src, size_t n,
+	int *result)
+{
+	vdm_operation_output out =
+		co_await vdm_memcpy(vdm, dst, (void *)src, n, 0);
+	UT_ASSERTeq(out.result, VDM_SUCCESS);
+	UT_ASSERTeq(out.output.memcpy.dest, dst);
+
+	*result = co_await count_twice(TEST_MAX_COUNT);
+
+	auto [a, b] = co_await miniasync::join(
+		miniasync::wrap(async_countup(1)),
+		miniasync::wrap(async_countup(2)));
+	*result += a.result + b.result;
+}
+
+/*
+ * test_coroutines -- awaits the futures of a virtual data mover, the C
+ * futures and the other tasks within a task
+ */
+static void
+test_coroutines(struct runtime *r, struct vdm *vdm)
+{
+	char *src = (char *)malloc(TEST_BUF_SIZE);
+	char *dst = (char *)malloc(TEST_BUF_SIZE);
+	UT_ASSERTne(src, NULL);
+	UT_ASSERTne(dst, NULL);
+	memset(src, 'c', TEST_BUF_SIZE);
+
+	int result = 0;
+	miniasync::runnable<miniasync::task<>> fut(
+		copy_and_count(vdm, dst, src, TEST_BUF_SIZE, &result));
+
+	/* the task is started on its first poll */
+	UT_ASSERTeq(result, 0);
+	runtime_wait(r, fut.get());
+
+	UT_ASSERTeq(fut.state(), FUTURE_STATE_COMPLETE);
+	UT_ASSERTeq(result, TEST_MAX_COUNT * 2 + 1 + 2);
+	UT_ASSERTeq(memcmp(src, dst, TEST_BUF_SIZE), 0);
+
+	free(dst);
+	free(src);
+}
+
+#endif /* MINIASYNC_HAS_COROUTINES */
+
+int
+main(void)
+{
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+	struct data_mover_threads *dmt = data_mover_threads_default();
+	UT_ASSERTne(dmt, NULL);
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	test_then();
+	test_join_runtime(r, vdm);
+#ifdef MINIASYNC_HAS_COROUTINES
+	test_coroutines(r, vdm);
+#endif
+
+	data_mover_threads_delete(dmt);
+	runtime_delete(r);
+
+	return 0;
+}
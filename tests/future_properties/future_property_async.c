@@ -12,7 +12,7 @@
 #define TEST_MAX_COUNT 20
 #define FAKE_MAP_ARG ((void *)((uintptr_t)(0xFEEDCAFE)))
 
-static uint64_t results[12];
+static uint64_t results[14];
 static uint64_t results_index = 0;
 
 struct countup_data {
@@ -273,12 +273,67 @@ test_change_flag_future()
 	runtime_delete(r);
 }
 
+static int property_calls;
+
+int
+future_counted_async_property(void *fut, enum future_property property)
+{
+	property_calls++;
+	return future_async_property(fut, property);
+}
+
+int
+future_counted_sync_property(void *fut, enum future_property property)
+{
+	property_calls++;
+	return 0;
+}
+
+/*
+ * test_cached_property -- tests if the properties are cached, and updated
+ * when a chained future advances to its next entry
+ */
+void
+test_cached_property()
+{
+	struct chained_up_fut fut =
+		countup_chained_sync_async(TEST_MAX_COUNT, 0, 0);
+	fut.data.up1.fut.base.has_property = future_counted_sync_property;
+	fut.data.up2.fut.base.has_property = future_counted_async_property;
+	struct future *chain = FUTURE_AS_RUNNABLE(&fut);
+
+	UT_ASSERTeq(future_has_property(chain, FUTURE_PROPERTY_ASYNC), 0);
+	UT_ASSERTeq(future_has_property(chain, FUTURE_PROPERTY_ASYNC), 0);
+	UT_ASSERTeq(property_calls, 1);
+
+	/* the first entry keeps the cached property of the chain */
+	for (int i = 0; i < TEST_MAX_COUNT - 1; ++i)
+		future_poll(chain, NULL);
+	UT_ASSERTeq(future_has_property(chain, FUTURE_PROPERTY_ASYNC), 0);
+	UT_ASSERTeq(property_calls, 1);
+
+	/* the second entry is polled once the first one completes */
+	future_poll(chain, NULL);
+	UT_ASSERTeq(future_has_property(chain, FUTURE_PROPERTY_ASYNC), 1);
+	UT_ASSERTeq(future_has_property(chain, FUTURE_PROPERTY_ASYNC), 1);
+	UT_ASSERTeq(property_calls, 2);
+	future_poll(chain, NULL);
+	UT_ASSERTeq(future_has_property(chain, FUTURE_PROPERTY_ASYNC), 1);
+	UT_ASSERTeq(property_calls, 2);
+
+	/* complete chained futures have no properties */
+	while (future_poll(chain, NULL) != FUTURE_STATE_COMPLETE)
+		;
+	UT_ASSERTeq(future_has_property(chain, FUTURE_PROPERTY_ASYNC), -1);
+}
+
 int
 main(void)
 {
 	test_basic_futures();
 	test_chained_future();
 	test_change_flag_future();
+	test_cached_property();
 
 	return 0;
 }
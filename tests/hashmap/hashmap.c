@@ -0,0 +1,495 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libminiasync.h"
+#include "core/util.h"
+#include "os_thread.h"
+#include "test_helpers.h"
+
+#define TEST_NKEYS 100000
+#define TEST_NCHURN 300000
+#define TEST_NTHREADS 4
+#define TEST_NTHREAD_KEYS 20000
+#define TEST_NSHARED_KEYS 64
+#define TEST_NBATCH 256
+#define TEST_NBATCH_ROUNDS 64
+#define TEST_NBATCH_GROW 30000
+
+/*
+ * test_put -- puts the key with its value, returns the result
+ */
+static enum hashmap_result
+test_put(struct vdm *vdm, struct hashmap *hm, uint64_t key, uint64_t value)
+{
+	struct hashmap_put_future fut =
+		hashmap_put(vdm, hm, key, &value, sizeof(value));
+	FUTURE_BUSY_POLL(&fut);
+
+	return FUTURE_OUTPUT(&fut)->result;
+}
+
+/*
+ * test_get -- gets the value of the key, returns the result
+ */
+static enum hashmap_result
+test_get(struct vdm *vdm, struct hashmap *hm, uint64_t key, uint64_t *value)
+{
+	*value = 0;
+	struct hashmap_get_future fut =
+		hashmap_get(vdm, hm, key, value, sizeof(*value));
+	FUTURE_BUSY_POLL(&fut);
+
+	struct hashmap_get_output *output = FUTURE_OUTPUT(&fut);
+	if (output->result == HASHMAP_SUCCESS) {
+		UT_ASSERTeq(output->size, sizeof(*value));
+		UT_ASSERTeq(output->copy_size, sizeof(*value));
+	}
+
+	return output->result;
+}
+
+/*
+ * test_remove -- removes the key, returns the result
+ */
+static enum hashmap_result
+test_remove(struct hashmap *hm, uint64_t key)
+{
+	struct hashmap_remove_future fut = hashmap_remove(hm, key);
+	FUTURE_BUSY_POLL(&fut);
+
+	return FUTURE_OUTPUT(&fut)->result;
+}
+
+/*
+ * sum_values -- sums up the values of the keys
+ */
+static void
+sum_values(uint64_t key, const void *value, size_t size, void *arg)
+{
+	UT_ASSERTeq(size, sizeof(uint64_t));
+	UT_ASSERTeq(*(const uint64_t *)value, key * 2);
+	*(uint64_t *)arg += key;
+}
+
+/*
+ * test_grow -- the hashmap created without a capacity grows to take all
+ * the keys, which can be removed and put again
+ */
+void
+test_grow(struct vdm *vdm)
+{
+	struct hashmap *hm = hashmap_new(0);
+	UT_ASSERTne(hm, NULL);
+
+	/* the key 0 is valid */
+	for (uint64_t key = 0; key < TEST_NKEYS; key++)
+		UT_ASSERTeq(test_put(vdm, hm, key, key * 2), HASHMAP_SUCCESS);
+	UT_ASSERTeq(hashmap_length(hm), TEST_NKEYS);
+	UT_ASSERTeq(test_put(vdm, hm, 7, 0), HASHMAP_ERROR_KEY_EXISTS);
+
+	uint64_t value;
+	for (uint64_t key = 0; key < TEST_NKEYS; key++) {
+		UT_ASSERTeq(test_get(vdm, hm, key, &value), HASHMAP_SUCCESS);
+		UT_ASSERTeq(value, key * 2);
+	}
+	UT_ASSERTeq(test_get(vdm, hm, TEST_NKEYS, &value),
+		HASHMAP_ERROR_KEY_NOT_FOUND);
+
+	for (uint64_t key = 1; key < TEST_NKEYS; key += 2)
+		UT_ASSERTeq(test_remove(hm, key), HASHMAP_SUCCESS);
+	UT_ASSERTeq(test_remove(hm, 1), HASHMAP_ERROR_KEY_NOT_FOUND);
+	UT_ASSERTeq(hashmap_length(hm), TEST_NKEYS / 2);
+
+	for (uint64_t key = 0; key < TEST_NKEYS; key++) {
+		UT_ASSERTeq(test_get(vdm, hm, key, &value), key % 2 ?
+			HASHMAP_ERROR_KEY_NOT_FOUND : HASHMAP_SUCCESS);
+	}
+
+	for (uint64_t key = 1; key < TEST_NKEYS; key += 2)
+		UT_ASSERTeq(test_put(vdm, hm, key, key * 2), HASHMAP_SUCCESS);
+
+	uint64_t sum = 0;
+	hashmap_foreach(hm, sum_values, &sum);
+	UT_ASSERTeq(sum, (uint64_t)TEST_NKEYS * (TEST_NKEYS - 1) / 2);
+
+	hashmap_delete(hm);
+}
+
+/*
+ * test_churn -- the tombstones left by the removed keys don't stop
+ * the lookups of the other keys, and are compacted away
+ */
+void
+test_churn(struct vdm *vdm)
+{
+	struct hashmap *hm = hashmap_new(1000);
+	UT_ASSERTne(hm, NULL);
+
+	/* a sliding window of 1000 keys */
+	uint64_t value;
+	for (uint64_t key = 0; key < TEST_NCHURN; key++) {
+		UT_ASSERTeq(test_put(vdm, hm, key, key * 2), HASHMAP_SUCCESS);
+		if (key < 1000)
+			continue;
+
+		UT_ASSERTeq(test_remove(hm, key - 1000), HASHMAP_SUCCESS);
+		UT_ASSERTeq(test_get(vdm, hm, key - 999, &value),
+			HASHMAP_SUCCESS);
+		UT_ASSERTeq(value, (key - 999) * 2);
+	}
+	UT_ASSERTeq(hashmap_length(hm), 1000);
+
+	uint64_t sum = 0;
+	hashmap_foreach(hm, sum_values, &sum);
+	UT_ASSERTeq(sum, (uint64_t)(TEST_NCHURN - 1000) * 1000 + 999 * 500);
+
+	hashmap_delete(hm);
+}
+
+/*
+ * test_truncated -- the value is copied up to the size of the buffer
+ */
+void
+test_truncated(struct vdm *vdm)
+{
+	struct hashmap *hm = hashmap_new(0);
+	UT_ASSERTne(hm, NULL);
+
+	char value[] = "0123456789";
+	struct hashmap_put_future put =
+		hashmap_put(vdm, hm, 1, value, sizeof(value));
+	FUTURE_BUSY_POLL(&put);
+	UT_ASSERTeq(FUTURE_OUTPUT(&put)->result, HASHMAP_SUCCESS);
+
+	/* the value is copied, not referenced */
+	value[0] = 'x';
+
+	char buf[4];
+	struct hashmap_get_future get = hashmap_get(vdm, hm, 1, buf,
+		sizeof(buf));
+	FUTURE_BUSY_POLL(&get);
+	UT_ASSERTeq(FUTURE_OUTPUT(&get)->result, HASHMAP_SUCCESS);
+	UT_ASSERTeq(FUTURE_OUTPUT(&get)->size, sizeof(value));
+	UT_ASSERTeq(FUTURE_OUTPUT(&get)->copy_size, sizeof(buf));
+	UT_ASSERTeq(memcmp(buf, "0123", sizeof(buf)), 0);
+
+	hashmap_delete(hm);
+}
+
+/*
+ * test_batch -- the batched puts and gets match the ones of single keys,
+ * including the duplicated, missing and truncated ones
+ */
+void
+test_batch(struct vdm *vdm)
+{
+	struct hashmap *hm = hashmap_new(0);
+	UT_ASSERTne(hm, NULL);
+
+	static struct hashmap_batch_entry entries[TEST_NBATCH];
+	static uint64_t values[TEST_NBATCH];
+
+	for (uint64_t round = 0; round < TEST_NBATCH_ROUNDS; round++) {
+		for (size_t i = 0; i < TEST_NBATCH; i++) {
+			/* the last key of each batch is the first one again */
+			uint64_t key = i == TEST_NBATCH - 1 ?
+				round * TEST_NBATCH : round * TEST_NBATCH + i;
+			values[i] = key * 2 + (i == TEST_NBATCH - 1);
+			entries[i].key = key;
+			entries[i].buf = &values[i];
+			entries[i].size = sizeof(values[i]);
+		}
+
+		struct hashmap_batch_future put =
+			hashmap_put_batch(vdm, hm, entries, TEST_NBATCH);
+		FUTURE_BUSY_POLL(&put);
+		UT_ASSERTeq(FUTURE_OUTPUT(&put)->nsucceeded, TEST_NBATCH - 1);
+		for (size_t i = 0; i < TEST_NBATCH - 1; i++)
+			UT_ASSERTeq(entries[i].result, HASHMAP_SUCCESS);
+		UT_ASSERTeq(entries[TEST_NBATCH - 1].result,
+			HASHMAP_ERROR_KEY_EXISTS);
+	}
+
+	uint64_t nkeys = (uint64_t)(TEST_NBATCH - 1) * TEST_NBATCH_ROUNDS;
+	UT_ASSERTeq(hashmap_length(hm), nkeys);
+
+	uint64_t sum = 0;
+	hashmap_foreach(hm, sum_values, &sum);
+	uint64_t expected = 0;
+	for (uint64_t round = 0; round < TEST_NBATCH_ROUNDS; round++) {
+		for (uint64_t i = 0; i < TEST_NBATCH - 1; i++)
+			expected += round * TEST_NBATCH + i;
+	}
+	UT_ASSERTeq(sum, expected);
+
+	/*
+	 * The odd keys were never put, and neither were the even ones of
+	 * the rounds past the last one. The first key is got twice.
+	 */
+	for (size_t i = 0; i < TEST_NBATCH; i++) {
+		values[i] = 0;
+		entries[i].key = (uint64_t)(i / 2) * TEST_NBATCH +
+			(i % 2 ? TEST_NBATCH - 1 : 1);
+		entries[i].buf = &values[i];
+		entries[i].size = sizeof(values[i]);
+	}
+	entries[2].key = entries[0].key;
+
+	struct hashmap_batch_future get =
+		hashmap_get_batch(vdm, hm, entries, TEST_NBATCH);
+	FUTURE_BUSY_POLL(&get);
+	UT_ASSERTeq(FUTURE_OUTPUT(&get)->nsucceeded, TEST_NBATCH_ROUNDS);
+	for (size_t i = 0; i < TEST_NBATCH; i++) {
+		if (i % 2 || i / 2 >= TEST_NBATCH_ROUNDS) {
+			UT_ASSERTeq(entries[i].result,
+				HASHMAP_ERROR_KEY_NOT_FOUND);
+			UT_ASSERTeq(values[i], 0);
+			continue;
+		}
+
+		UT_ASSERTeq(entries[i].result, HASHMAP_SUCCESS);
+		UT_ASSERTeq(entries[i].value_size, sizeof(uint64_t));
+		UT_ASSERTeq(values[i], entries[i].key * 2);
+	}
+
+	/* the values are copied up to the size of the buffers */
+	char buf[4];
+	entries[0].key = 1;
+	entries[0].buf = buf;
+	entries[0].size = sizeof(buf);
+	get = hashmap_get_batch(vdm, hm, entries, 1);
+	FUTURE_BUSY_POLL(&get);
+	UT_ASSERTeq(FUTURE_OUTPUT(&get)->nsucceeded, 1);
+	UT_ASSERTeq(entries[0].value_size, sizeof(uint64_t));
+	uint64_t value = 2;
+	UT_ASSERTeq(memcmp(buf, &value, sizeof(buf)), 0);
+
+	/* an empty batch completes right away */
+	get = hashmap_get_batch(vdm, hm, entries, 0);
+	FUTURE_BUSY_POLL(&get);
+	UT_ASSERTeq(FUTURE_OUTPUT(&get)->nsucceeded, 0);
+
+	hashmap_delete(hm);
+}
+
+/*
+ * test_batch_grow -- a single batch of many more keys than the hashmap
+ * created without a capacity can hold grows it while it's inserted
+ */
+void
+test_batch_grow(struct vdm *vdm)
+{
+	struct hashmap *hm = hashmap_new(0);
+	UT_ASSERTne(hm, NULL);
+
+	struct hashmap_batch_entry *entries =
+		malloc(TEST_NBATCH_GROW * sizeof(*entries));
+	uint64_t *values = malloc(TEST_NBATCH_GROW * sizeof(*values));
+	UT_ASSERTne(entries, NULL);
+	UT_ASSERTne(values, NULL);
+
+	for (size_t i = 0; i < TEST_NBATCH_GROW; i++) {
+		values[i] = i * 2;
+		entries[i].key = i;
+		entries[i].buf = &values[i];
+		entries[i].size = sizeof(values[i]);
+	}
+
+	struct hashmap_batch_future put =
+		hashmap_put_batch(vdm, hm, entries, TEST_NBATCH_GROW);
+	FUTURE_BUSY_POLL(&put);
+	UT_ASSERTeq(FUTURE_OUTPUT(&put)->nsucceeded, TEST_NBATCH_GROW);
+	UT_ASSERTeq(hashmap_length(hm), TEST_NBATCH_GROW);
+
+	uint64_t sum = 0;
+	hashmap_foreach(hm, sum_values, &sum);
+	UT_ASSERTeq(sum, (uint64_t)TEST_NBATCH_GROW * (TEST_NBATCH_GROW - 1) / 2);
+
+	memset(values, 0, TEST_NBATCH_GROW * sizeof(*values));
+	struct hashmap_batch_future get =
+		hashmap_get_batch(vdm, hm, entries, TEST_NBATCH_GROW);
+	FUTURE_BUSY_POLL(&get);
+	UT_ASSERTeq(FUTURE_OUTPUT(&get)->nsucceeded, TEST_NBATCH_GROW);
+	for (size_t i = 0; i < TEST_NBATCH_GROW; i++)
+		UT_ASSERTeq(values[i], i * 2);
+
+	free(values);
+	free(entries);
+	hashmap_delete(hm);
+}
+
+struct test_worker {
+	struct hashmap *hm;
+	struct vdm *vdm;
+	uint64_t id;
+};
+
+/*
+ * worker_thread -- puts, gets and removes the keys of its own, while racing
+ * with the other threads for the shared ones
+ */
+static void *
+worker_thread(void *arg)
+{
+	struct test_worker *w = arg;
+	uint64_t base = (w->id + 1) * TEST_NTHREAD_KEYS * 2;
+
+	uint64_t value;
+	for (uint64_t i = 0; i < TEST_NTHREAD_KEYS; i++) {
+		uint64_t key = base + i;
+		UT_ASSERTeq(test_put(w->vdm, w->hm, key, key * 2),
+			HASHMAP_SUCCESS);
+
+		/* either of the threads puts and removes a shared key */
+		uint64_t shared = i % TEST_NSHARED_KEYS;
+		if (test_put(w->vdm, w->hm, shared, shared * 2) ==
+			HASHMAP_SUCCESS)
+			test_remove(w->hm, shared);
+		enum hashmap_result ret = test_get(w->vdm, w->hm, shared,
+			&value);
+		UT_ASSERT(ret == HASHMAP_ERROR_KEY_NOT_FOUND ||
+			(ret == HASHMAP_SUCCESS && value == shared * 2));
+
+		if (i % 2) {
+			UT_ASSERTeq(test_remove(w->hm, key - 1),
+				HASHMAP_SUCCESS);
+		}
+	}
+
+	for (uint64_t i = 0; i < TEST_NTHREAD_KEYS; i++) {
+		UT_ASSERTeq(test_get(w->vdm, w->hm, base + i, &value),
+			i % 2 ? HASHMAP_SUCCESS : HASHMAP_ERROR_KEY_NOT_FOUND);
+	}
+
+	return NULL;
+}
+
+/*
+ * test_concurrent -- the threads operate on the hashmap concurrently, while
+ * it's resized
+ */
+void
+test_concurrent(struct vdm *vdm)
+{
+	struct hashmap *hm = hashmap_new(0);
+	UT_ASSERTne(hm, NULL);
+
+	os_thread_t threads[TEST_NTHREADS];
+	struct test_worker workers[TEST_NTHREADS];
+	for (int i = 0; i < TEST_NTHREADS; ++i) {
+		workers[i].hm = hm;
+		workers[i].vdm = vdm;
+		workers[i].id = (uint64_t)i;
+		UT_ASSERTeq(os_thread_create(&threads[i], NULL,
+			worker_thread, &workers[i]), 0);
+	}
+
+	for (int i = 0; i < TEST_NTHREADS; ++i)
+		os_thread_join(&threads[i], NULL);
+
+	/* the shared keys are all removed by then */
+	UT_ASSERTeq(hashmap_length(hm),
+		(size_t)TEST_NTHREADS * TEST_NTHREAD_KEYS / 2);
+
+	hashmap_delete(hm);
+}
+
+/*
+ * batch_worker_thread -- puts and gets its own keys in batches, spread over
+ * the shards locked by the other threads
+ */
+static void *
+batch_worker_thread(void *arg)
+{
+	struct test_worker *w = arg;
+
+	struct hashmap_batch_entry entries[TEST_NBATCH];
+	uint64_t values[TEST_NBATCH];
+	for (uint64_t round = 0; round < TEST_NBATCH_ROUNDS; round++) {
+		uint64_t base = (round * TEST_NTHREADS + w->id) * TEST_NBATCH;
+		for (size_t i = 0; i < TEST_NBATCH; i++) {
+			values[i] = (base + i) * 2;
+			entries[i].key = base + i;
+			entries[i].buf = &values[i];
+			entries[i].size = sizeof(values[i]);
+		}
+
+		struct hashmap_batch_future put =
+			hashmap_put_batch(w->vdm, w->hm, entries, TEST_NBATCH);
+		FUTURE_BUSY_POLL(&put);
+		UT_ASSERTeq(FUTURE_OUTPUT(&put)->nsucceeded, TEST_NBATCH);
+
+		memset(values, 0, sizeof(values));
+		struct hashmap_batch_future get =
+			hashmap_get_batch(w->vdm, w->hm, entries, TEST_NBATCH);
+		FUTURE_BUSY_POLL(&get);
+		UT_ASSERTeq(FUTURE_OUTPUT(&get)->nsucceeded, TEST_NBATCH);
+		for (size_t i = 0; i < TEST_NBATCH; i++)
+			UT_ASSERTeq(values[i], (base + i) * 2);
+	}
+
+	return NULL;
+}
+
+/*
+ * test_batch_concurrent -- the threads put and get the batches of keys
+ * concurrently, while the hashmap is resized
+ */
+void
+test_batch_concurrent(struct vdm *vdm)
+{
+	struct hashmap *hm = hashmap_new(0);
+	UT_ASSERTne(hm, NULL);
+
+	os_thread_t threads[TEST_NTHREADS];
+	struct test_worker workers[TEST_NTHREADS];
+	for (int i = 0; i < TEST_NTHREADS; ++i) {
+		workers[i].hm = hm;
+		workers[i].vdm = vdm;
+		workers[i].id = (uint64_t)i;
+		UT_ASSERTeq(os_thread_create(&threads[i], NULL,
+			batch_worker_thread, &workers[i]), 0);
+	}
+
+	for (int i = 0; i < TEST_NTHREADS; ++i)
+		os_thread_join(&threads[i], NULL);
+
+	UT_ASSERTeq(hashmap_length(hm),
+		(size_t)TEST_NTHREADS * TEST_NBATCH_ROUNDS * TEST_NBATCH);
+
+	hashmap_delete(hm);
+}
+
+int
+main(void)
+{
+	struct data_mover_sync *dms = data_mover_sync_new();
+	UT_ASSERTne(dms, NULL);
+	struct vdm *sync_mover = data_mover_sync_get_vdm(dms);
+
+	test_grow(sync_mover);
+	test_churn(sync_mover);
+	test_truncated(sync_mover);
+	test_concurrent(sync_mover);
+	test_batch(sync_mover);
+	test_batch_grow(sync_mover);
+	test_batch_concurrent(sync_mover);
+
+	struct data_mover_threads *dmt = data_mover_threads_default();
+	UT_ASSERTne(dmt, NULL);
+	struct vdm *thread_mover = data_mover_threads_get_vdm(dmt);
+
+	test_truncated(thread_mover);
+	test_concurrent(thread_mover);
+	test_batch(thread_mover);
+	test_batch_grow(thread_mover);
+	test_batch_concurrent(thread_mover);
+
+	data_mover_threads_delete(dmt);
+	data_mover_sync_delete(dms);
+
+	return 0;
+}
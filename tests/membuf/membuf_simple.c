@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "core/membuf.h"
 #include "os_thread.h"
 #include "test_helpers.h"
@@ -24,10 +25,11 @@ membuf_alloc_thread(void *arg)
 }
 
 void
-membuf_test_mt_reuse()
+membuf_test_mt_reuse(int node)
 {
-	struct membuf *mbuf = membuf_new(NULL);
+	struct membuf *mbuf = membuf_new(NULL, 0, MEMBUF_PAGES_NORMAL);
 	UT_ASSERTne(mbuf, NULL);
+	membuf_set_node(mbuf, node);
 
 	os_thread_t th1;
 	os_thread_create(&th1, NULL, membuf_alloc_thread, mbuf);
@@ -44,9 +46,9 @@ membuf_test_mt_reuse()
 }
 
 void
-membuf_test_st_reuse()
+membuf_test_st_reuse(size_t size, enum membuf_pages pages)
 {
-	struct membuf *mbuf = membuf_new(TEST_USER_DATA);
+	struct membuf *mbuf = membuf_new(TEST_USER_DATA, size, pages);
 	UT_ASSERTne(mbuf, NULL);
 
 	struct test_entry **entries =
@@ -104,11 +106,215 @@ membuf_test_st_reuse()
 	free(entries);
 }
 
+/*
+ * membuf_test_pinned -- an entry which is never freed doesn't prevent
+ * the reuse of the ones allocated after it
+ */
+void
+membuf_test_pinned()
+{
+	struct membuf *mbuf = membuf_new(TEST_USER_DATA, 0,
+		MEMBUF_PAGES_NORMAL);
+	UT_ASSERTne(mbuf, NULL);
+
+	struct test_entry *pinned =
+		membuf_alloc(mbuf, sizeof(struct test_entry));
+	UT_ASSERTne(pinned, NULL);
+
+	/* allocates many times the size of the buffer */
+	struct test_entry *entries[16];
+	for (int i = 0; i < MAX_TEST_ENTRIES; ++i) {
+		struct test_entry *entry =
+			membuf_alloc(mbuf, sizeof(struct test_entry));
+		UT_ASSERTne(entry, NULL);
+		UT_ASSERTne(entry, pinned);
+		UT_ASSERTeq(membuf_ptr_user_data(entry), TEST_USER_DATA);
+
+		/* free them out of order */
+		entries[i % 16] = entry;
+		if (i % 16 == 15) {
+			for (int j = 15; j >= 0; --j)
+				membuf_free(entries[j]);
+		}
+	}
+
+	membuf_free(pinned);
+
+	membuf_delete(mbuf);
+}
+
+/*
+ * membuf_test_fill -- allocates entries until the membuf is exhausted,
+ * returns their number
+ */
+static int
+membuf_test_fill(struct membuf *mbuf, struct test_entry **entries)
+{
+	int i;
+	for (i = 0; i < MAX_TEST_ENTRIES; ++i) {
+		entries[i] = membuf_alloc(mbuf, sizeof(struct test_entry));
+		if (entries[i] == NULL)
+			break;
+		UT_ASSERTeq(membuf_ptr_user_data(entries[i]), TEST_USER_DATA);
+	}
+
+	/* if this triggers, increase MAX_TEST_ENTRIES */
+	UT_ASSERTne(i, MAX_TEST_ENTRIES);
+
+	return i;
+}
+
+/*
+ * membuf_test_chain -- a thread allocates from up to the maximum number
+ * of buffers
+ */
+void
+membuf_test_chain()
+{
+	struct test_entry **entries =
+		malloc(sizeof(struct test_entry *) * MAX_TEST_ENTRIES);
+	UT_ASSERTne(entries, NULL);
+
+	struct membuf *mbuf = membuf_new(TEST_USER_DATA, 0,
+		MEMBUF_PAGES_NORMAL);
+	UT_ASSERTne(mbuf, NULL);
+	membuf_set_max_threadbufs(mbuf, 1);
+	int per_tbuf = membuf_test_fill(mbuf, entries);
+	UT_ASSERTne(per_tbuf, 0);
+	membuf_delete(mbuf);
+
+	mbuf = membuf_new(TEST_USER_DATA, 0, MEMBUF_PAGES_NORMAL);
+	UT_ASSERTne(mbuf, NULL);
+	membuf_set_max_threadbufs(mbuf, 3);
+	int n = membuf_test_fill(mbuf, entries);
+	UT_ASSERTeq(n, per_tbuf * 3);
+
+	/* the drained buffers are released and chained again */
+	for (int i = 0; i < n; ++i)
+		membuf_free(entries[i]);
+	UT_ASSERTeq(membuf_test_fill(mbuf, entries), n);
+
+	membuf_delete(mbuf);
+	free(entries);
+}
+
+/*
+ * membuf_test_stats -- the statistics follow allocations, collections
+ * and failures
+ */
+void
+membuf_test_stats()
+{
+	struct test_entry **entries =
+		malloc(sizeof(struct test_entry *) * MAX_TEST_ENTRIES);
+	UT_ASSERTne(entries, NULL);
+
+	struct membuf *mbuf = membuf_new(TEST_USER_DATA, 0,
+		MEMBUF_PAGES_NORMAL);
+	UT_ASSERTne(mbuf, NULL);
+	membuf_set_max_threadbufs(mbuf, 2);
+
+	struct vdm_membuf_stats stats;
+	membuf_get_stats(mbuf, &stats);
+	UT_ASSERTeq(stats.buffers, 0);
+	UT_ASSERTeq(stats.bytes_allocated, 0);
+
+	int n = membuf_test_fill(mbuf, entries);
+	membuf_get_stats(mbuf, &stats);
+	UT_ASSERTeq(stats.buffers, 2);
+	UT_ASSERTeq(stats.failures, 1);
+	UT_ASSERT(stats.bytes_allocated >=
+		(size_t)n * sizeof(struct test_entry));
+	UT_ASSERTeq(stats.bytes_allocated + stats.bytes_available,
+		2 * stats.buffer_size);
+	UT_ASSERT(stats.max_bytes_allocated >= stats.bytes_allocated / 2);
+	UT_ASSERTeq(stats.collections, 0);
+
+	uint64_t entry_size = stats.bytes_allocated / (uint64_t)n;
+	for (int i = 0; i < n; ++i)
+		membuf_free(entries[i]);
+
+	/*
+	 * The freed entries are collected by the next allocation, which also
+	 * releases the drained second buffer.
+	 */
+	entries[0] = membuf_alloc(mbuf, sizeof(struct test_entry));
+	UT_ASSERTne(entries[0], NULL);
+	membuf_get_stats(mbuf, &stats);
+	UT_ASSERTeq(stats.buffers, 1);
+	UT_ASSERTeq(stats.bytes_allocated, entry_size);
+	UT_ASSERTeq(stats.collections, 2);
+	UT_ASSERTeq(stats.collected, (uint64_t)n);
+	UT_ASSERTeq(stats.failures, 1);
+	UT_ASSERT(stats.bytes_reusable > 0);
+
+	membuf_free(entries[0]);
+	membuf_delete(mbuf);
+	free(entries);
+}
+
+/*
+ * membuf_test_aligned -- aligned entries don't share cache lines and can be
+ * reused by entries of different alignments
+ */
+void
+membuf_test_aligned()
+{
+	struct membuf *mbuf = membuf_new(TEST_USER_DATA, 0,
+		MEMBUF_PAGES_NORMAL);
+	UT_ASSERTne(mbuf, NULL);
+
+	size_t alignments[] = {1, 8, 32, MEMBUF_CACHELINE_SIZE, 256, 4096};
+	size_t nalignments = sizeof(alignments) / sizeof(alignments[0]);
+	void *entries[64];
+	for (int round = 0; round < 4; ++round) {
+		for (size_t i = 0; i < 64; ++i) {
+			size_t alignment = alignments[
+				(i + (size_t)round) % nalignments];
+			entries[i] = membuf_alloc_aligned(mbuf, 40, alignment);
+			UT_ASSERTne(entries[i], NULL);
+			uintptr_t misalignment =
+				(uintptr_t)entries[i] % alignment;
+			UT_ASSERTeq(misalignment, 0);
+			UT_ASSERTeq(membuf_ptr_user_data(entries[i]),
+				TEST_USER_DATA);
+			memset(entries[i], 0xff, 40);
+		}
+
+		for (size_t i = 1; i < 64; ++i) {
+			uintptr_t line = (uintptr_t)entries[i] /
+				MEMBUF_CACHELINE_SIZE;
+			uintptr_t prev = (uintptr_t)entries[i - 1] /
+				MEMBUF_CACHELINE_SIZE;
+			UT_ASSERTne(line, prev);
+		}
+
+		for (size_t i = 0; i < 64; ++i)
+			membuf_free(entries[i]);
+	}
+
+	UT_ASSERTeq(membuf_alloc_aligned(mbuf, 1, 3), NULL);
+	UT_ASSERTeq(membuf_alloc_aligned(mbuf, 1, 1 << 16), NULL);
+
+	membuf_delete(mbuf);
+}
+
 int
 main(int argc, char *argv[])
 {
-	membuf_test_st_reuse();
-	membuf_test_mt_reuse();
+	membuf_test_st_reuse(0, MEMBUF_PAGES_NORMAL);
+	membuf_test_st_reuse(1 << 16, MEMBUF_PAGES_NORMAL);
+	/* not a power of two, rounded up to 8MB */
+	membuf_test_st_reuse(5 << 20, MEMBUF_PAGES_TRANSPARENT_HUGE);
+	/* falls back to the transparent huge pages, if none are reserved */
+	membuf_test_st_reuse(1 << 22, MEMBUF_PAGES_HUGETLB);
+	membuf_test_mt_reuse(MEMBUF_NODE_LOCAL);
+	membuf_test_mt_reuse(MEMBUF_NODE_ANY);
+	membuf_test_mt_reuse(0);
+	membuf_test_pinned();
+	membuf_test_chain();
+	membuf_test_stats();
+	membuf_test_aligned();
 
 	return 0;
 }
@@ -6,6 +6,8 @@
 #include <time.h>
 #include "libminiasync.h"
 #include "core/os.h"
+#include "core/os_thread.h"
+#include "core/util.h"
 #include "test_helpers.h"
 
 enum test_type {SEQUENCE, SINGLE_CHAR};
@@ -116,6 +118,681 @@ cleanup:
 	return ret;
 }
 
+/*
+ * test_threads_memcpy_overflow -- a burst of operations much larger than
+ * the ring buffer is accepted at once and completes
+ */
+int
+test_threads_memcpy_overflow(unsigned memcpy_count, size_t ringbuf_size)
+{
+	int ret = 0;
+	struct runtime *r = runtime_new();
+	struct data_mover_threads *dmt = data_mover_threads_new(2,
+		ringbuf_size, FUTURE_NOTIFIER_WAKER);
+	if (dmt == NULL) {
+		runtime_delete(r);
+		return 1;
+	}
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	size_t size = 1 << 10;
+	char *src = malloc(memcpy_count * size);
+	char *dst = malloc(memcpy_count * size);
+	struct vdm_operation_future *memcpy_futures =
+		malloc(memcpy_count * sizeof(struct vdm_operation_future));
+	struct future **futures =
+		malloc(memcpy_count * sizeof(struct future *));
+	if (src == NULL || dst == NULL || memcpy_futures == NULL ||
+	    futures == NULL)
+		UT_FATAL("out of memory");
+
+	for (unsigned i = 0; i < memcpy_count; i++) {
+		memset(src + i * size, (int)i, size);
+		memcpy_futures[i] = vdm_memcpy(vdm, dst + i * size,
+			src + i * size, size, 0);
+		futures[i] = FUTURE_AS_RUNNABLE(&memcpy_futures[i]);
+	}
+
+	/* the first poll starts every operation, none of them stays idle */
+	for (unsigned i = 0; i < memcpy_count; i++) {
+		future_poll(futures[i], NULL);
+		UT_ASSERTne(FUTURE_STATE(&memcpy_futures[i]),
+			FUTURE_STATE_IDLE);
+	}
+
+	runtime_wait_multiple(r, futures, memcpy_count);
+	if (memcmp(src, dst, memcpy_count * size) != 0) {
+		fprintf(stderr, "Memcpy overflow result is wrong!\n");
+		ret = 1;
+	}
+
+	free(futures);
+	free(memcpy_futures);
+	free(dst);
+	free(src);
+
+	runtime_delete(r);
+	data_mover_threads_delete(dmt);
+	return ret;
+}
+
+static uint64_t memcpy_calls;
+
+/*
+ * counting_memcpy -- memcpy counting its calls
+ */
+static void *
+counting_memcpy(void *dst, const void *src, size_t n, unsigned flags)
+{
+	util_fetch_and_add64(&memcpy_calls, 1);
+	return memcpy(dst, src, n);
+}
+
+/*
+ * test_threads_split -- large operations are split into chunks executed
+ * by several workers
+ */
+int
+test_threads_split(size_t size, size_t chunk_size)
+{
+	int ret = 0;
+	struct runtime *r = runtime_new();
+	struct data_mover_threads *dmt = data_mover_threads_new(4, 2,
+		FUTURE_NOTIFIER_WAKER);
+	if (dmt == NULL) {
+		runtime_delete(r);
+		return 1;
+	}
+	data_mover_threads_set_chunk_size(dmt, chunk_size);
+	data_mover_threads_set_memcpy_fn(dmt, counting_memcpy);
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+	memcpy_calls = 0;
+
+	char *src = malloc(size);
+	char *dst = malloc(size);
+	char *str = malloc(size);
+	if (src == NULL || dst == NULL || str == NULL)
+		UT_FATAL("out of memory");
+	for (size_t i = 0; i < size; i++)
+		src[i] = (char)(i % 253);
+
+	/* more chunks than the queues can hold at once */
+	struct vdm_operation_future futs[2];
+	futs[0] = vdm_memcpy(vdm, dst, src, size, 0);
+	futs[1] = vdm_memset(vdm, str, 0x5A, size, 0);
+	struct future *runnables[] = {
+		FUTURE_AS_RUNNABLE(&futs[0]),
+		FUTURE_AS_RUNNABLE(&futs[1]),
+	};
+	runtime_wait_multiple(r, runnables, 2);
+
+	UT_ASSERTeq(memcpy_calls, (size + chunk_size - 1) / chunk_size);
+	if (memcmp(src, dst, size) != 0) {
+		fprintf(stderr, "Memcpy split result is wrong!\n");
+		ret = 1;
+	}
+	for (size_t i = 0; i < size; i++) {
+		if (str[i] != 0x5A) {
+			fprintf(stderr, "Memset split result is wrong!\n");
+			ret = 1;
+			break;
+		}
+	}
+
+	free(str);
+	free(dst);
+	free(src);
+	runtime_delete(r);
+	data_mover_threads_delete(dmt);
+	return ret;
+}
+
+/*
+ * test_threads_inline -- operations below the threshold complete on
+ * the first poll, in the calling thread
+ */
+int
+test_threads_inline(size_t threshold)
+{
+	struct data_mover_threads *dmt = data_mover_threads_new(2, 16,
+		FUTURE_NOTIFIER_WAKER);
+	if (dmt == NULL)
+		return 1;
+	data_mover_threads_set_inline_threshold(dmt, threshold);
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	char src[64];
+	char dst[64];
+	for (size_t n = 1; n < threshold && n <= sizeof(src); n++) {
+		memset(src, (int)n, n);
+		memset(dst, 0, n);
+
+		struct vdm_operation_future fut =
+			vdm_memcpy(vdm, dst, src, n, 0);
+		UT_ASSERTeq(future_poll(FUTURE_AS_RUNNABLE(&fut), NULL),
+			FUTURE_STATE_COMPLETE);
+		UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+		UT_ASSERTeq(FUTURE_OUTPUT(&fut)->output.memcpy.dest, dst);
+		UT_ASSERTeq(memcmp(src, dst, n), 0);
+
+		fut = vdm_memset(vdm, dst, 0x7F, n, 0);
+		UT_ASSERTeq(future_poll(FUTURE_AS_RUNNABLE(&fut), NULL),
+			FUTURE_STATE_COMPLETE);
+		UT_ASSERTeq(dst[n - 1], 0x7F);
+	}
+
+	data_mover_threads_delete(dmt);
+	return 0;
+}
+
+/*
+ * test_threads_cpus -- workers bound to the given cpus execute
+ * operations, binding to a nonexistent cpu fails
+ */
+int
+test_threads_cpus(size_t nthreads)
+{
+	unsigned cpus[] = {0};
+	struct data_mover_threads *dmt = data_mover_threads_new_cpus(nthreads,
+		16, FUTURE_NOTIFIER_WAKER, cpus, 1);
+	if (dmt == NULL)
+		return 1;
+	struct runtime *r = runtime_new();
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	char src[256];
+	char dst[256];
+	memset(src, 0x5A, sizeof(src));
+	memset(dst, 0, sizeof(dst));
+
+	struct vdm_operation_future fut =
+		vdm_memcpy(vdm, dst, src, sizeof(src), 0);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(memcmp(src, dst, sizeof(src)), 0);
+
+	runtime_delete(r);
+	data_mover_threads_delete(dmt);
+
+	unsigned bad_cpus[] = {0, 1U << 20};
+	dmt = data_mover_threads_new_cpus(2, 16, FUTURE_NOTIFIER_WAKER,
+		bad_cpus, 2);
+	UT_ASSERTeq(dmt, NULL);
+
+	return 0;
+}
+
+/*
+ * test_threads_spin -- workers spinning before they go to sleep process
+ * the operations submitted while spinning and while asleep
+ */
+int
+test_threads_spin(uint64_t spin_count)
+{
+	struct data_mover_threads *dmt = data_mover_threads_new(2, 16,
+		FUTURE_NOTIFIER_WAKER);
+	if (dmt == NULL)
+		return 1;
+	data_mover_threads_set_spin_count(dmt, spin_count);
+	struct runtime *r = runtime_new();
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	char src[128];
+	char dst[128];
+	for (unsigned i = 0; i < 1000; ++i) {
+		memset(src, (int)i, sizeof(src));
+
+		struct vdm_operation_future fut =
+			vdm_memcpy(vdm, dst, src, sizeof(src), 0);
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+		UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+		UT_ASSERTeq(memcmp(src, dst, sizeof(src)), 0);
+
+		/* let the workers give up spinning from time to time */
+		if (i % 100 == 0) {
+			struct runtime_sleep_future sleep =
+				runtime_sleep_for(r, 1000000);
+			runtime_wait(r, FUTURE_AS_RUNNABLE(&sleep));
+		}
+	}
+
+	runtime_delete(r);
+	data_mover_threads_delete(dmt);
+
+	return 0;
+}
+
+/*
+ * test_threads_shared_completion -- poller futures of the operations of one
+ * thread monitor the same counter, which drops back to zero once all of them
+ * are polled to completion
+ */
+int
+test_threads_shared_completion(unsigned nops, size_t chunk_size)
+{
+	struct data_mover_threads *dmt = data_mover_threads_new(4, 1024,
+		FUTURE_NOTIFIER_POLLER);
+	if (dmt == NULL)
+		return 1;
+	data_mover_threads_set_shared_completion(dmt, 1);
+	data_mover_threads_set_chunk_size(dmt, chunk_size);
+	struct runtime *r = runtime_new();
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	size_t size = 1 << 12;
+	char *src = malloc(size * nops);
+	char *dst = malloc(size * nops);
+	struct vdm_operation_future *futs = malloc(sizeof(*futs) * nops);
+	struct future **ptrs = malloc(sizeof(*ptrs) * nops);
+	UT_ASSERTne(src, NULL);
+	UT_ASSERTne(dst, NULL);
+	UT_ASSERTne(futs, NULL);
+	UT_ASSERTne(ptrs, NULL);
+
+	memset(dst, 0, size * nops);
+	uint64_t *monitored = NULL;
+	for (unsigned i = 0; i < nops; ++i) {
+		memset(src + size * i, (int)i, size);
+		futs[i] = vdm_memcpy(vdm, dst + size * i, src + size * i,
+			size, 0);
+		ptrs[i] = FUTURE_AS_RUNNABLE(&futs[i]);
+
+		struct future_notifier n;
+		n.notifier_used = FUTURE_NOTIFIER_NONE;
+		n.poller.ptr_to_monitor = NULL;
+		if (future_poll(ptrs[i], &n) == FUTURE_STATE_COMPLETE)
+			continue;
+		UT_ASSERTeq(n.notifier_used, FUTURE_NOTIFIER_POLLER);
+		if (monitored == NULL)
+			monitored = n.poller.ptr_to_monitor;
+		UT_ASSERTeq(n.poller.ptr_to_monitor, monitored);
+	}
+
+	runtime_wait_multiple(r, ptrs, nops);
+	for (unsigned i = 0; i < nops; ++i) {
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->result, VDM_SUCCESS);
+		UT_ASSERTeq(memcmp(src + size * i, dst + size * i, size), 0);
+	}
+	if (monitored != NULL)
+		UT_ASSERTeq(*monitored, 0);
+
+	free(ptrs);
+	free(futs);
+	free(dst);
+	free(src);
+	runtime_delete(r);
+	data_mover_threads_delete(dmt);
+
+	return 0;
+}
+
+/*
+ * test_threads_membuf -- more operations than fit into a default buffer can
+ * be in flight at once, when the buffers are large or many enough
+ */
+int
+test_threads_membuf(size_t membuf_size, enum data_mover_threads_pages pages,
+	size_t max_buffers, int node, unsigned nops)
+{
+	struct data_mover_threads *dmt = data_mover_threads_new(2, 1024,
+		FUTURE_NOTIFIER_NONE);
+	if (dmt == NULL)
+		return 1;
+	UT_ASSERTeq(data_mover_threads_set_membuf(dmt, (size_t)1 << 32, pages),
+		-1);
+	UT_ASSERTeq(data_mover_threads_set_membuf(dmt, membuf_size,
+		DATA_MOVER_THREADS_PAGES_HUGETLB + 1), -1);
+	data_mover_threads_set_membuf_limit(dmt, max_buffers);
+	data_mover_threads_set_membuf_node(dmt, node);
+	UT_ASSERTeq(data_mover_threads_set_membuf(dmt, membuf_size, pages), 0);
+	struct runtime *r = runtime_new();
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	size_t size = 64;
+	char *src = malloc(size * nops);
+	char *dst = malloc(size * nops);
+	struct vdm_operation_future *futs = malloc(sizeof(*futs) * nops);
+	struct future **ptrs = malloc(sizeof(*ptrs) * nops);
+	UT_ASSERTne(src, NULL);
+	UT_ASSERTne(dst, NULL);
+	UT_ASSERTne(futs, NULL);
+	UT_ASSERTne(ptrs, NULL);
+
+	memset(dst, 0, size * nops);
+	for (unsigned i = 0; i < nops; ++i) {
+		memset(src + size * i, (int)i, size);
+		futs[i] = vdm_memcpy(vdm, dst + size * i, src + size * i,
+			size, 0);
+		ptrs[i] = FUTURE_AS_RUNNABLE(&futs[i]);
+	}
+
+	runtime_wait_multiple(r, ptrs, nops);
+	for (unsigned i = 0; i < nops; ++i) {
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->result, VDM_SUCCESS);
+		UT_ASSERTeq(memcmp(src + size * i, dst + size * i, size), 0);
+	}
+
+	struct vdm_membuf_stats stats;
+	data_mover_threads_get_membuf_stats(dmt, &stats);
+	UT_ASSERTeq(stats.failures, 0);
+	UT_ASSERTin(stats.buffers, 1, max_buffers == 0 ? 1 : max_buffers);
+	UT_ASSERTeq(stats.bytes_allocated + stats.bytes_available,
+		stats.buffers * stats.buffer_size);
+
+	free(ptrs);
+	free(futs);
+	free(dst);
+	free(src);
+	runtime_delete(r);
+	data_mover_threads_delete(dmt);
+
+	return 0;
+}
+
+/*
+ * test_threads_memcpy_large -- copies large enough to bypass the cache
+ * are complete when the future is
+ */
+int
+test_threads_memcpy_large(size_t size)
+{
+	struct data_mover_threads *dmt = data_mover_threads_new(1, 16,
+		FUTURE_NOTIFIER_WAKER);
+	if (dmt == NULL)
+		return 1;
+	struct runtime *r = runtime_new();
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	char *src = malloc(size + 1);
+	char *dst = malloc(size + 1);
+	if (src == NULL || dst == NULL)
+		UT_FATAL("out of memory");
+	for (size_t i = 0; i < size + 1; ++i)
+		src[i] = (char)(i % 251);
+	memset(dst, 0, size + 1);
+
+	/* misaligned, to have an unaligned head and tail */
+	struct vdm_operation_future fut =
+		vdm_memcpy(vdm, dst + 1, src, size, 0);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(memcmp(dst + 1, src, size), 0);
+	UT_ASSERTeq(dst[0], 0);
+
+	free(src);
+	free(dst);
+	runtime_delete(r);
+	data_mover_threads_delete(dmt);
+
+	return 0;
+}
+
+#define TEST_ELASTIC_THREADS 4
+
+static uint64_t elastic_active;
+
+/*
+ * rendezvous_memcpy -- memcpy, which returns only once all the workers
+ * of the elastic mover run one at the same time
+ */
+static void *
+rendezvous_memcpy(void *dst, const void *src, size_t n, unsigned flags)
+{
+	uint64_t active = util_fetch_and_add64(&elastic_active, 1) + 1;
+	while (active % TEST_ELASTIC_THREADS != 0) {
+		os_thread_yield();
+		util_atomic_load64(&elastic_active, &active);
+	}
+	return memcpy(dst, src, n);
+}
+
+/*
+ * test_threads_elastic_round -- runs as many copies at the same time as
+ * the elastic mover can have workers
+ */
+static void
+test_threads_elastic_round(struct runtime *r, struct vdm *vdm)
+{
+	char src[TEST_ELASTIC_THREADS][64];
+	char dst[TEST_ELASTIC_THREADS][64];
+	struct vdm_operation_future futs[TEST_ELASTIC_THREADS];
+	struct future *pfuts[TEST_ELASTIC_THREADS];
+
+	for (int i = 0; i < TEST_ELASTIC_THREADS; ++i) {
+		memset(src[i], i + 1, sizeof(src[i]));
+		futs[i] = vdm_memcpy(vdm, dst[i], src[i], sizeof(src[i]), 0);
+		pfuts[i] = FUTURE_AS_RUNNABLE(&futs[i]);
+	}
+	runtime_wait_multiple(r, pfuts, TEST_ELASTIC_THREADS);
+
+	for (int i = 0; i < TEST_ELASTIC_THREADS; ++i)
+		UT_ASSERTeq(memcmp(dst[i], src[i], sizeof(src[i])), 0);
+}
+
+/*
+ * test_threads_elastic -- the elastic mover starts the workers needed by
+ * the copies, and starts them again after they have retired
+ */
+int
+test_threads_elastic(size_t min_threads)
+{
+	struct data_mover_threads *dmt = data_mover_threads_new_elastic(
+		min_threads, TEST_ELASTIC_THREADS, 16, FUTURE_NOTIFIER_WAKER);
+	if (dmt == NULL)
+		return 1;
+	data_mover_threads_set_idle_timeout(dmt, 10000000); /* 10ms */
+	data_mover_threads_set_memcpy_fn(dmt, rendezvous_memcpy);
+	/* the worker of a lane could retire */
+	UT_ASSERTeq(data_mover_threads_set_lanes(dmt, 1, 8), -1);
+	struct runtime *r = runtime_new();
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+	elastic_active = 0;
+
+	for (int round = 0; round < 3; ++round) {
+		test_threads_elastic_round(r, vdm);
+
+		/* give the workers the time to retire */
+		struct runtime_sleep_future sleep =
+			runtime_sleep_for(r, 100000000);
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&sleep));
+	}
+
+	runtime_delete(r);
+	data_mover_threads_delete(dmt);
+
+	return 0;
+}
+
+#define TEST_LOW_CHUNK_SIZE (64 * 1024)
+
+/*
+ * test_threads_priority -- the low priority copy is performed in chunks,
+ * paced by the bandwidth limit, and doesn't hold up the other operations
+ */
+int
+test_threads_priority(size_t min_threads, size_t size, uint64_t rate)
+{
+	struct data_mover_threads *dmt = data_mover_threads_new_elastic(
+		min_threads, 2, 16, FUTURE_NOTIFIER_WAKER);
+	if (dmt == NULL)
+		return 1;
+	data_mover_threads_set_memcpy_fn(dmt, counting_memcpy);
+	data_mover_threads_set_bandwidth_limit(dmt, rate, 0);
+	struct runtime *r = runtime_new();
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+	UT_ASSERT(vdm_is_supported(vdm, VDM_F_PRIORITY_LOW));
+	memcpy_calls = 0;
+
+	char *src = malloc(size);
+	char *dst = malloc(size);
+	if (src == NULL || dst == NULL)
+		UT_FATAL("out of memory");
+	for (size_t i = 0; i < size; i++)
+		src[i] = (char)(i % 253);
+	memset(dst, 0, size);
+	char small_src[64];
+	char small_dst[64];
+	memset(small_src, 7, sizeof(small_src));
+
+	uint64_t start = runtime_clock_now();
+	struct vdm_operation_future low = vdm_memcpy(vdm, dst, src, size,
+		VDM_F_PRIORITY_LOW);
+	future_poll(FUTURE_AS_RUNNABLE(&low), NULL);
+
+	struct vdm_operation_future fut = vdm_memcpy(vdm, small_dst,
+		small_src, sizeof(small_src), 0);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(memcmp(small_dst, small_src, sizeof(small_src)), 0);
+	/* the limit allows the first chunk only, in the time of a few more */
+	if (rate != 0) {
+		UT_ASSERTne(future_poll(FUTURE_AS_RUNNABLE(&low), NULL),
+			FUTURE_STATE_COMPLETE);
+	}
+
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&low));
+	uint64_t elapsed = runtime_clock_now() - start;
+	UT_ASSERTeq(FUTURE_OUTPUT(&low)->result, VDM_SUCCESS);
+	UT_ASSERTeq(memcmp(dst, src, size), 0);
+	UT_ASSERTeq(memcpy_calls, 1 + (size + TEST_LOW_CHUNK_SIZE - 1) /
+		TEST_LOW_CHUNK_SIZE);
+	/* the bucket holds a chunk at first and can go into debt by one */
+	if (rate != 0) {
+		uint64_t min = (uint64_t)(size - 2 * TEST_LOW_CHUNK_SIZE) *
+			1000000000ULL / rate;
+		UT_ASSERT(elapsed >= min);
+	}
+
+	free(src);
+	free(dst);
+	runtime_delete(r);
+	data_mover_threads_delete(dmt);
+
+	return 0;
+}
+
+/*
+ * test_threads_priority_delete -- the paced low priority copy is finished
+ * without the limit, when the mover is deleted
+ */
+int
+test_threads_priority_delete(size_t min_threads)
+{
+	struct data_mover_threads *dmt = data_mover_threads_new_elastic(
+		min_threads, 2, 16, FUTURE_NOTIFIER_WAKER);
+	if (dmt == NULL)
+		return 1;
+	data_mover_threads_set_memcpy_fn(dmt, counting_memcpy);
+	/* the copy would take 16 seconds at the limit */
+	data_mover_threads_set_bandwidth_limit(dmt, TEST_LOW_CHUNK_SIZE, 0);
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+	memcpy_calls = 0;
+
+	size_t size = 16 * TEST_LOW_CHUNK_SIZE;
+	char *src = malloc(size);
+	char *dst = malloc(size);
+	if (src == NULL || dst == NULL)
+		UT_FATAL("out of memory");
+	for (size_t i = 0; i < size; i++)
+		src[i] = (char)(i % 253);
+	memset(dst, 0, size);
+
+	uint64_t start = runtime_clock_now();
+	struct vdm_operation_future low = vdm_memcpy(vdm, dst, src, size,
+		VDM_F_PRIORITY_LOW);
+	future_poll(FUTURE_AS_RUNNABLE(&low), NULL);
+	data_mover_threads_delete(dmt);
+	uint64_t elapsed = runtime_clock_now() - start;
+
+	UT_ASSERTeq(memcmp(dst, src, size), 0);
+	UT_ASSERTeq(memcpy_calls, size / TEST_LOW_CHUNK_SIZE);
+	UT_ASSERT(elapsed < 8000000000ULL);
+
+	free(src);
+	free(dst);
+
+	return 0;
+}
+
+#define TEST_NSUBMITTERS 8
+#define TEST_SUBMITTER_NCOPIES 64
+#define TEST_SUBMITTER_SIZE 256
+
+struct test_submitter {
+	struct vdm *vdm;
+	char src[TEST_SUBMITTER_NCOPIES][TEST_SUBMITTER_SIZE];
+	char dst[TEST_SUBMITTER_NCOPIES][TEST_SUBMITTER_SIZE];
+};
+
+/*
+ * submitter_thread -- submits a batch of copies and waits for them
+ */
+static void *
+submitter_thread(void *arg)
+{
+	struct test_submitter *submitter = arg;
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+
+	struct vdm_operation_future copies[TEST_SUBMITTER_NCOPIES];
+	struct future *futs[TEST_SUBMITTER_NCOPIES];
+	for (int i = 0; i < TEST_SUBMITTER_NCOPIES; i++) {
+		copies[i] = vdm_memcpy(submitter->vdm, submitter->dst[i],
+			submitter->src[i], TEST_SUBMITTER_SIZE, 0);
+		futs[i] = FUTURE_AS_RUNNABLE(&copies[i]);
+	}
+	runtime_wait_multiple(r, futs, TEST_SUBMITTER_NCOPIES);
+
+	runtime_delete(r);
+	return NULL;
+}
+
+/*
+ * test_threads_memcpy_submitters -- threads submitting at the same time
+ * to the queues of different workers, the first nlanes ones to their lanes
+ */
+int
+test_threads_memcpy_submitters(size_t nthreads, size_t nlanes)
+{
+	struct data_mover_threads *dmt = data_mover_threads_new(nthreads,
+		16, FUTURE_NOTIFIER_WAKER);
+	if (dmt == NULL)
+		return 1;
+	if (nlanes != 0) {
+		/* lanes shorter than the bursts fall back to the queues */
+		UT_ASSERTeq(data_mover_threads_set_lanes(dmt, nlanes, 8), 0);
+		UT_ASSERTeq(data_mover_threads_set_lanes(dmt, nlanes, 8), -1);
+	}
+
+	struct test_submitter *submitters =
+		malloc(TEST_NSUBMITTERS * sizeof(struct test_submitter));
+	if (submitters == NULL)
+		UT_FATAL("out of memory");
+
+	os_thread_t threads[TEST_NSUBMITTERS];
+	for (int i = 0; i < TEST_NSUBMITTERS; i++) {
+		submitters[i].vdm = data_mover_threads_get_vdm(dmt);
+		memset(submitters[i].src, i + 1, sizeof(submitters[i].src));
+		memset(submitters[i].dst, 0, sizeof(submitters[i].dst));
+		UT_ASSERTeq(os_thread_create(&threads[i], NULL,
+			submitter_thread, &submitters[i]), 0);
+	}
+
+	int ret = 0;
+	for (int i = 0; i < TEST_NSUBMITTERS; i++) {
+		os_thread_join(&threads[i], NULL);
+		if (memcmp(submitters[i].src, submitters[i].dst,
+				sizeof(submitters[i].src)) != 0) {
+			fprintf(stderr, "Submitter nr. %d result is wrong!\n",
+				i);
+			ret = 1;
+		}
+	}
+
+	free(submitters);
+	data_mover_threads_delete(dmt);
+	return ret;
+}
+
 int
 main(void)
 {
@@ -125,5 +802,38 @@ main(void)
 		test_threads_memcpy_multiple(100, 10, 128, SINGLE_CHAR) ||
 		test_threads_memcpy_multiple(100, 10, 7, SEQUENCE) ||
 		test_threads_memcpy_multiple(100, 1, 1 << 10, SEQUENCE) ||
-		test_threads_memcpy_multiple(100, 10, 0, SEQUENCE);
+		test_threads_memcpy_multiple(100, 10, 0, SEQUENCE) ||
+		test_threads_memcpy_overflow(1000, 4) ||
+		test_threads_memcpy_overflow(100, 1) ||
+		test_threads_memcpy_submitters(1, 0) ||
+		test_threads_memcpy_submitters(3, 0) ||
+		test_threads_memcpy_submitters(3, 5) ||
+		test_threads_memcpy_submitters(2, TEST_NSUBMITTERS) ||
+		test_threads_split(1 << 20, 1 << 12) ||
+		test_threads_split((1 << 20) + 7, 1 << 16) ||
+		test_threads_inline(65) ||
+		test_threads_cpus(1) ||
+		test_threads_cpus(4) ||
+		test_threads_spin(0) ||
+		test_threads_spin(1 << 10) ||
+		test_threads_spin(UINT64_MAX) ||
+		test_threads_shared_completion(1000, 0) ||
+		test_threads_shared_completion(100, 1 << 10) ||
+		test_threads_membuf(1 << 16, DATA_MOVER_THREADS_PAGES_NORMAL,
+			1, DATA_MOVER_THREADS_NODE_LOCAL, 100) ||
+		test_threads_membuf(1 << 16, DATA_MOVER_THREADS_PAGES_NORMAL,
+			64, DATA_MOVER_THREADS_NODE_ANY, 10000) ||
+		test_threads_membuf(1 << 23,
+			DATA_MOVER_THREADS_PAGES_TRANSPARENT_HUGE, 1, 0,
+			30000) ||
+		test_threads_membuf(1 << 22, DATA_MOVER_THREADS_PAGES_HUGETLB,
+			0, DATA_MOVER_THREADS_NODE_LOCAL, 1000) ||
+		test_threads_memcpy_large((4 << 20) + 13) ||
+		test_threads_elastic(0) ||
+		test_threads_elastic(1) ||
+		test_threads_priority(2, (1 << 20) + 7, 0) ||
+		test_threads_priority(0, (1 << 20) + 7, 0) ||
+		test_threads_priority(2, 1 << 20, 8 << 20) ||
+		test_threads_priority_delete(2) ||
+		test_threads_priority_delete(0);
 }
@@ -4,8 +4,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include "libminiasync.h"
+#include "core/memops.h"
 #include "test_helpers.h"
 
+/* the durability needs the cache lines to be written back */
+#ifdef MEMOPS_FLUSH_SUPPORTED
+#define TEST_DURABLE 1
+#else
+#define TEST_DURABLE 0
+#endif
+
 /*
  * test_basic_memmove -- tests memmove vdm operation
  * with two, seperate, not overlapping buffers.
@@ -160,6 +168,230 @@ test_memmove_overlapping(size_t size)
 	return ret;
 }
 
+/*
+ * test_flags -- operations with the cache bypassing and the durability
+ * flags, and flushes, give the same results as the plain ones
+ */
+int
+test_flags(size_t size, uint64_t flags)
+{
+	struct data_mover_sync *dms = data_mover_sync_new();
+	if (dms == NULL)
+		return 1;
+	struct vdm *vdm = data_mover_sync_get_vdm(dms);
+	struct runtime *r = runtime_new();
+
+	char *src = malloc(size);
+	char *dst = malloc(size + 1);
+	if (src == NULL || dst == NULL)
+		UT_FATAL("out of memory");
+	for (size_t i = 0; i < size; ++i)
+		src[i] = (char)(i % 253);
+
+	struct vdm_operation_future fut =
+		vdm_memcpy(vdm, dst + 1, src, size, flags);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(memcmp(dst + 1, src, size), 0);
+
+	/* overlapping */
+	fut = vdm_memmove(vdm, dst, dst + 1, size, flags);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(memcmp(dst, src, size), 0);
+
+	fut = vdm_memset(vdm, dst, 0x11, size, flags);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(dst[0], 0x11);
+	UT_ASSERTeq(dst[size - 1], 0x11);
+	UT_ASSERTeq(dst[size], src[size - 1]);
+
+	fut = vdm_flush(vdm, dst, size, 0);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->type, VDM_OPERATION_FLUSH);
+
+	free(src);
+	free(dst);
+	runtime_delete(r);
+	data_mover_sync_delete(dms);
+
+	return 0;
+}
+
+/*
+ * test_sync_memcpy_v -- tests the vectored memcpy of the sync mover
+ */
+int
+test_sync_memcpy_v(size_t nfrags, size_t frag_size, uint64_t flags)
+{
+	struct data_mover_sync *dms = data_mover_sync_new();
+	if (dms == NULL)
+		return 1;
+	struct runtime *r = runtime_new();
+
+	int ret = test_memcpy_v(r, data_mover_sync_get_vdm(dms), nfrags,
+		frag_size, flags);
+
+	runtime_delete(r);
+	data_mover_sync_delete(dms);
+
+	return ret;
+}
+
+/*
+ * test_sync_check_ops -- tests the compare, checksum, dualcast and delta
+ * record operations of the sync mover
+ */
+int
+test_sync_check_ops(size_t n)
+{
+	struct data_mover_sync *dms = data_mover_sync_new();
+	if (dms == NULL)
+		return 1;
+	struct runtime *r = runtime_new();
+
+	int ret = test_check_ops(r, data_mover_sync_get_vdm(dms), n);
+
+	runtime_delete(r);
+	data_mover_sync_delete(dms);
+
+	return ret;
+}
+
+/*
+ * test_sync_memfill -- tests the memfill operations of the sync mover
+ */
+int
+test_sync_memfill(size_t n)
+{
+	struct data_mover_sync *dms = data_mover_sync_new();
+	if (dms == NULL)
+		return 1;
+	struct runtime *r = runtime_new();
+
+	int ret = test_memfill(r, data_mover_sync_get_vdm(dms), n);
+
+	runtime_delete(r);
+	data_mover_sync_delete(dms);
+
+	return ret;
+}
+
+/*
+ * test_sync_submit_batch -- tests the batched submission with the sync
+ * mover, which starts the operations one by one
+ */
+int
+test_sync_submit_batch(size_t nops, size_t size)
+{
+	struct data_mover_sync *dms = data_mover_sync_new();
+	if (dms == NULL)
+		return 1;
+	struct runtime *r = runtime_new();
+
+	int ret = test_submit_batch(r, data_mover_sync_get_vdm(dms), nops,
+		size);
+
+	runtime_delete(r);
+	data_mover_sync_delete(dms);
+
+	return ret;
+}
+
+/*
+ * test_sync_storage -- tests the operations of the sync mover created
+ * in the caller's storage, which leave its buffers unused
+ */
+int
+test_sync_storage(size_t nops, size_t size)
+{
+	struct data_mover_sync *dms = data_mover_sync_new();
+	if (dms == NULL)
+		return 1;
+	struct runtime *r = runtime_new();
+
+	int ret = test_storage(r, data_mover_sync_get_vdm(dms), nops, size);
+
+	struct vdm_membuf_stats stats;
+	data_mover_sync_get_membuf_stats(dms, &stats);
+	UT_ASSERTeq(stats.buffers, 0);
+
+	runtime_delete(r);
+	data_mover_sync_delete(dms);
+
+	return ret;
+}
+
+/*
+ * test_sync_compact -- tests the compact futures of the sync mover
+ */
+int
+test_sync_compact(size_t nops, size_t size)
+{
+	struct data_mover_sync *dms = data_mover_sync_new();
+	if (dms == NULL)
+		return 1;
+	struct runtime *r = runtime_new();
+
+	int ret = test_compact(r, data_mover_sync_get_vdm(dms), nops, size);
+
+	runtime_delete(r);
+	data_mover_sync_delete(dms);
+
+	return ret;
+}
+
+static int callback_done;
+
+/*
+ * test_callback_poll -- collects the output of the completed future
+ */
+static void
+test_callback_poll(void *arg)
+{
+	struct vdm_operation_future *fut = arg;
+
+	callback_done = future_poll(FUTURE_AS_RUNNABLE(fut), NULL) ==
+		FUTURE_STATE_COMPLETE;
+}
+
+/*
+ * test_sync_callback -- tests the completion callback, which the sync mover
+ * calls before the start returns
+ */
+int
+test_sync_callback(size_t size)
+{
+	struct data_mover_sync *dms = data_mover_sync_new();
+	if (dms == NULL)
+		return 1;
+
+	char *src = malloc(size);
+	char *dst = malloc(size);
+	if (!src || !dst)
+		UT_FATAL("out of memory");
+	memset(src, 0x66, size);
+	memset(dst, 0, size);
+
+	callback_done = 0;
+	struct vdm_operation_future fut = vdm_memmove(
+		data_mover_sync_get_vdm(dms), dst, src, size, 0);
+	UT_ASSERTeq(vdm_start_with_callback(&fut, test_callback_poll, &fut), 0);
+	UT_ASSERTeq(callback_done, 1);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->output.memmove.dest, dst);
+	UT_ASSERTeq(memcmp(dst, src, size), 0);
+	UT_ASSERTeq(vdm_start_with_callback(&fut, test_callback_poll, &fut),
+		-1);
+
+	free(dst);
+	free(src);
+	data_mover_sync_delete(dms);
+
+	return 0;
+}
+
 /*
  * test_supported_flags -- test if data_mover_sync support correct flags
  */
@@ -171,8 +403,8 @@ int test_supported_flags() {
 		return 1;
 	}
 	struct vdm *sync_mover = data_mover_sync_get_vdm(dms);
-	int ret = test_flag(sync_mover, VDM_F_MEM_DURABLE, 0);
-	ret += test_flag(sync_mover, VDM_F_NO_CACHE_HINT, 0);
+	int ret = test_flag(sync_mover, VDM_F_MEM_DURABLE, TEST_DURABLE);
+	ret += test_flag(sync_mover, VDM_F_NO_CACHE_HINT, 1);
 	data_mover_sync_delete(dms);
 	return ret;
 }
@@ -185,5 +417,21 @@ main(void)
 		test_memmove_overlapping(4) ||
 		test_memmove_overlapping(12) ||
 		test_memmove_overlapping(1024) ||
+		test_flags(100, 0) ||
+		test_flags(100, VDM_F_NO_CACHE_HINT) ||
+		test_flags(100, VDM_F_MEM_DURABLE) ||
+		test_flags((2 << 20) + 3, VDM_F_MEM_DURABLE) ||
+		test_flags((2 << 20) + 3,
+			VDM_F_MEM_DURABLE | VDM_F_NO_CACHE_HINT) ||
+		test_sync_memcpy_v(0, 64, 0) ||
+		test_sync_memcpy_v(200, 64, 0) ||
+		test_sync_memcpy_v(3, 4096, VDM_F_MEM_DURABLE) ||
+		test_sync_check_ops(4096) ||
+		test_sync_memfill(1000) ||
+		test_sync_memfill((1 << 20) + 5) ||
+		test_sync_submit_batch(40, 100) ||
+		test_sync_storage(20, 100) ||
+		test_sync_compact(20, 100) ||
+		test_sync_callback(4096) ||
 		test_supported_flags();
 }
@@ -6,8 +6,18 @@
 #include <time.h>
 #include "libminiasync.h"
 #include "core/os.h"
+#include "core/memops.h"
+#include "core/os_thread.h"
+#include "core/util.h"
 #include "test_helpers.h"
 
+/* the durability needs the cache lines to be written back */
+#ifdef MEMOPS_FLUSH_SUPPORTED
+#define TEST_DURABLE 1
+#else
+#define TEST_DURABLE 0
+#endif
+
 int
 test_thread_memmove_single(size_t str_len)
 {
@@ -141,6 +151,61 @@ test_thread_memmove_multiple(size_t str_len)
 	return ret;
 }
 
+/*
+ * test_thread_flags -- operations with the cache bypassing and the durability
+ * flags, and flushes, give the same results as the plain ones
+ */
+int
+test_thread_flags(size_t size, uint64_t flags)
+{
+	struct data_mover_threads *dmt = data_mover_threads_new(2, 16,
+		FUTURE_NOTIFIER_WAKER);
+	if (dmt == NULL)
+		return 1;
+	/* the chunks are flushed separately */
+	data_mover_threads_set_chunk_size(dmt, 1 << 16);
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+	struct runtime *r = runtime_new();
+
+	char *src = malloc(size);
+	char *dst = malloc(size + 1);
+	if (src == NULL || dst == NULL)
+		UT_FATAL("out of memory");
+	for (size_t i = 0; i < size; ++i)
+		src[i] = (char)(i % 253);
+
+	struct vdm_operation_future fut =
+		vdm_memcpy(vdm, dst + 1, src, size, flags);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(memcmp(dst + 1, src, size), 0);
+
+	/* overlapping */
+	fut = vdm_memmove(vdm, dst, dst + 1, size, flags);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(memcmp(dst, src, size), 0);
+
+	fut = vdm_memset(vdm, dst, 0x11, size, flags);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(dst[0], 0x11);
+	UT_ASSERTeq(dst[size - 1], 0x11);
+	UT_ASSERTeq(dst[size], src[size - 1]);
+
+	fut = vdm_flush(vdm, dst, size, 0);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->type, VDM_OPERATION_FLUSH);
+
+	free(src);
+	free(dst);
+	runtime_delete(r);
+	data_mover_threads_delete(dmt);
+
+	return 0;
+}
+
 /*
  * test_supported_flags -- test if data_mover_threads support correct flags
  */
@@ -152,7 +217,404 @@ int test_supported_flags() {
 		return 1;
 	}
 	struct vdm *thread_mover = data_mover_threads_get_vdm(dmt);
-	int ret = test_flag(thread_mover, VDM_F_MEM_DURABLE, 0);
+	int ret = test_flag(thread_mover, VDM_F_MEM_DURABLE, TEST_DURABLE);
+	ret += test_flag(thread_mover, VDM_F_NO_CACHE_HINT, 1);
+	data_mover_threads_delete(dmt);
+
+	return ret;
+}
+
+/*
+ * test_thread_memmove_split -- memmove split into chunks, the overlapping
+ * ones have to give the same result as a plain memmove
+ */
+int
+test_thread_memmove_split(size_t size, size_t chunk_size)
+{
+	int ret = 0;
+	struct runtime *r = runtime_new();
+	struct data_mover_threads *dmt = data_mover_threads_new(4, 128,
+		FUTURE_NOTIFIER_WAKER);
+	if (dmt == NULL) {
+		runtime_delete(r);
+		return 1;
+	}
+	data_mover_threads_set_chunk_size(dmt, chunk_size);
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	char *buf = malloc(size * 2);
+	char *expected = malloc(size * 2);
+	if (buf == NULL || expected == NULL)
+		UT_FATAL("out of memory");
+
+	/* disjoint, forward overlapping and backward overlapping moves */
+	size_t offsets[][2] = {{0, size}, {0, size / 3}, {size / 3, 0}};
+	for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+		for (size_t j = 0; j < size * 2; j++)
+			buf[j] = (char)(j % 251);
+		memcpy(expected, buf, size * 2);
+		memmove(expected + offsets[i][0], expected + offsets[i][1],
+			size);
+
+		struct vdm_operation_future fut = vdm_memmove(vdm,
+			buf + offsets[i][0], buf + offsets[i][1], size, 0);
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+		if (memcmp(buf, expected, size * 2) != 0) {
+			fprintf(stderr, "Memmove split nr. %zu result is "
+				"wrong!\n", i);
+			ret = 1;
+		}
+	}
+
+	free(expected);
+	free(buf);
+	runtime_delete(r);
+	data_mover_threads_delete(dmt);
+	return ret;
+}
+
+/*
+ * test_thread_memcpy_v -- tests the vectored memcpy of the threads mover,
+ * optionally split into chunks spanning several fragments
+ */
+int
+test_thread_memcpy_v(size_t nfrags, size_t frag_size, size_t chunk_size,
+	size_t inline_threshold)
+{
+	struct runtime *r = runtime_new();
+	struct data_mover_threads *dmt = data_mover_threads_new(4, 128,
+		FUTURE_NOTIFIER_WAKER);
+	if (dmt == NULL) {
+		runtime_delete(r);
+		return 1;
+	}
+	data_mover_threads_set_chunk_size(dmt, chunk_size);
+	data_mover_threads_set_inline_threshold(dmt, inline_threshold);
+
+	int ret = test_memcpy_v(r, data_mover_threads_get_vdm(dmt), nfrags,
+		frag_size, 0);
+
+	runtime_delete(r);
+	data_mover_threads_delete(dmt);
+
+	return ret;
+}
+
+/*
+ * test_thread_check_ops -- tests the compare, checksum, dualcast and delta
+ * record operations of the threads mover, the dualcast ones split
+ */
+int
+test_thread_check_ops(size_t n)
+{
+	struct runtime *r = runtime_new();
+	struct data_mover_threads *dmt = data_mover_threads_new(4, 128,
+		FUTURE_NOTIFIER_WAKER);
+	if (dmt == NULL) {
+		runtime_delete(r);
+		return 1;
+	}
+	data_mover_threads_set_chunk_size(dmt, 4096);
+
+	int ret = test_check_ops(r, data_mover_threads_get_vdm(dmt), n);
+
+	runtime_delete(r);
+	data_mover_threads_delete(dmt);
+
+	return ret;
+}
+
+/*
+ * test_thread_submit_batch -- tests the batched submission of the threads
+ * mover, the operations performed inline, queued and split among them
+ */
+int
+test_thread_submit_batch(size_t nops, size_t size)
+{
+	struct runtime *r = runtime_new();
+	struct data_mover_threads *dmt = data_mover_threads_new(4, 16,
+		FUTURE_NOTIFIER_WAKER);
+	if (dmt == NULL) {
+		runtime_delete(r);
+		return 1;
+	}
+	data_mover_threads_set_inline_threshold(dmt, 2 * size);
+	data_mover_threads_set_chunk_size(dmt, 16 * size);
+
+	int ret = test_submit_batch(r, data_mover_threads_get_vdm(dmt), nops,
+		size);
+
+	runtime_delete(r);
+	data_mover_threads_delete(dmt);
+
+	return ret;
+}
+
+/*
+ * test_thread_storage -- tests the operations of the threads mover created
+ * in the caller's storage, which leave its buffers unused
+ */
+int
+test_thread_storage(size_t nops, size_t size)
+{
+	struct runtime *r = runtime_new();
+	struct data_mover_threads *dmt = data_mover_threads_new(4, 128,
+		FUTURE_NOTIFIER_WAKER);
+	if (dmt == NULL) {
+		runtime_delete(r);
+		return 1;
+	}
+	data_mover_threads_set_inline_threshold(dmt, 256);
+
+	int ret = test_storage(r, data_mover_threads_get_vdm(dmt), nops,
+		size);
+
+	struct vdm_membuf_stats stats;
+	data_mover_threads_get_membuf_stats(dmt, &stats);
+	UT_ASSERTeq(stats.buffers, 0);
+
+	runtime_delete(r);
+	data_mover_threads_delete(dmt);
+
+	return ret;
+}
+
+/*
+ * test_thread_compact -- tests the compact futures of the threads mover
+ */
+int
+test_thread_compact(size_t nops, size_t size)
+{
+	struct runtime *r = runtime_new();
+	struct data_mover_threads *dmt = data_mover_threads_new(4, 128,
+		FUTURE_NOTIFIER_WAKER);
+	if (dmt == NULL) {
+		runtime_delete(r);
+		return 1;
+	}
+
+	int ret = test_compact(r, data_mover_threads_get_vdm(dmt), nops,
+		size);
+
+	runtime_delete(r);
+	data_mover_threads_delete(dmt);
+
+	return ret;
+}
+
+/*
+ * test_thread_memfill -- tests the memfill operations of the threads mover,
+ * split into the chunks, which don't start at the beginning of the pattern
+ */
+int
+test_thread_memfill(size_t n, size_t chunk_size)
+{
+	struct runtime *r = runtime_new();
+	struct data_mover_threads *dmt = data_mover_threads_new(4, 128,
+		FUTURE_NOTIFIER_WAKER);
+	if (dmt == NULL) {
+		runtime_delete(r);
+		return 1;
+	}
+	data_mover_threads_set_chunk_size(dmt, chunk_size);
+
+	int ret = test_memfill(r, data_mover_threads_get_vdm(dmt), n);
+
+	runtime_delete(r);
+	data_mover_threads_delete(dmt);
+
+	return ret;
+}
+
+static void *cancel_blocking_dst;
+static uint64_t cancel_blocked;
+static uint64_t cancel_released;
+
+/*
+ * test_cancel_memcpy -- copies the memory, blocking the worker copying
+ * to cancel_blocking_dst until the test releases it
+ */
+static void *
+test_cancel_memcpy(void *dst, const void *src, size_t n, unsigned flags)
+{
+	SUPPRESS_UNUSED(flags);
+
+	if (dst == cancel_blocking_dst) {
+		util_atomic_store_explicit64(&cancel_blocked, 1,
+			memory_order_release);
+		uint64_t released;
+		util_atomic_load64(&cancel_released, &released);
+		while (!released) {
+			os_thread_yield();
+			util_atomic_load64(&cancel_released, &released);
+		}
+	}
+
+	return memcpy(dst, src, n);
+}
+
+/*
+ * test_thread_cancel -- cancels the operations queued behind the one
+ * blocking the only worker, which are dropped without being performed
+ */
+int
+test_thread_cancel(size_t nops, size_t size)
+{
+	struct runtime *r = runtime_new();
+	struct data_mover_threads *dmt = data_mover_threads_new(1, 128,
+		FUTURE_NOTIFIER_WAKER);
+	if (dmt == NULL) {
+		runtime_delete(r);
+		return 1;
+	}
+	data_mover_threads_set_memcpy_fn(dmt, test_cancel_memcpy);
+	data_mover_threads_set_inline_threshold(dmt, 0);
+	data_mover_threads_set_chunk_size(dmt, size / 4);
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	struct vdm_operation_future *futs = malloc(nops * sizeof(*futs));
+	char *src = malloc(nops * size);
+	char *dst = malloc(nops * size);
+	if (!futs || !src || !dst)
+		UT_FATAL("out of memory");
+	memset(src, 0x55, nops * size);
+	memset(dst, 0, nops * size);
+
+	cancel_blocking_dst = dst;
+	cancel_blocked = 0;
+	cancel_released = 0;
+	struct vdm_operation_future blocking = vdm_memcpy(vdm, dst, src, size,
+		0);
+	UT_ASSERTeq(future_poll(FUTURE_AS_RUNNABLE(&blocking), NULL),
+		FUTURE_STATE_RUNNING);
+	uint64_t blocked;
+	util_atomic_load64(&cancel_blocked, &blocked);
+	while (!blocked) {
+		os_thread_yield();
+		util_atomic_load64(&cancel_blocked, &blocked);
+	}
+
+	/* the memcpy and the split memset operations wait in the queue */
+	for (size_t i = 1; i < nops; ++i) {
+		char *d = dst + i * size;
+		futs[i] = i % 2 ? vdm_memcpy(vdm, d, src + i * size, size, 0) :
+			vdm_memset(vdm, d, 0x66, size, 0);
+		UT_ASSERTeq(future_poll(FUTURE_AS_RUNNABLE(&futs[i]), NULL),
+			FUTURE_STATE_RUNNING);
+		UT_ASSERTeq(vdm_cancel(&futs[i]), 0);
+	}
+
+	/* an idle future completes right away */
+	futs[0] = vdm_memcpy(vdm, dst + size, src, size, 0);
+	UT_ASSERTeq(vdm_cancel(&futs[0]), 0);
+	UT_ASSERTeq(futs[0].base.context.state, FUTURE_STATE_COMPLETE);
+
+	/* the operation being performed isn't interrupted */
+	UT_ASSERTeq(vdm_cancel(&blocking), 0);
+	util_atomic_store_explicit64(&cancel_released, 1,
+		memory_order_release);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&blocking));
+	UT_ASSERTeq(FUTURE_OUTPUT(&blocking)->result, VDM_SUCCESS);
+	UT_ASSERTeq(vdm_cancel(&blocking), -1);
+
+	for (size_t i = 0; i < nops; ++i) {
+		runtime_wait(r, FUTURE_AS_RUNNABLE(&futs[i]));
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->result,
+			VDM_ERROR_CANCELED);
+	}
+
+	int ret = 0;
+	if (memcmp(dst, src, size) != 0) {
+		fprintf(stderr, "the blocking operation wasn't performed\n");
+		ret = 1;
+	}
+	for (size_t i = size; i < nops * size; ++i) {
+		if (dst[i] != 0) {
+			fprintf(stderr, "canceled operation wrote byte %zu\n",
+				i);
+			ret = 1;
+			break;
+		}
+	}
+
+	free(dst);
+	free(src);
+	free(futs);
+	runtime_delete(r);
+	data_mover_threads_delete(dmt);
+
+	return ret;
+}
+
+static uint64_t callbacks_done;
+
+/*
+ * test_callback_poll -- collects the output of the completed future
+ * and counts it
+ */
+static void
+test_callback_poll(void *arg)
+{
+	struct vdm_operation_future *fut = arg;
+
+	/* the future completes when it's polled the first time */
+	if (future_poll(FUTURE_AS_RUNNABLE(fut), NULL) ==
+			FUTURE_STATE_COMPLETE)
+		util_fetch_and_add64(&callbacks_done, 1);
+}
+
+/*
+ * test_thread_callback -- tests nops operations of size bytes, which are
+ * started with completion callbacks, without a runtime
+ */
+int
+test_thread_callback(size_t nops, size_t size)
+{
+	struct data_mover_threads *dmt = data_mover_threads_new(4, 128,
+		FUTURE_NOTIFIER_NONE);
+	if (dmt == NULL)
+		return 1;
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	struct vdm_operation_future *futs = malloc(nops * sizeof(*futs));
+	char *src = malloc(nops * size);
+	char *dst = malloc(nops * size);
+	if (!futs || !src || !dst)
+		UT_FATAL("out of memory");
+	memset(src, 0x55, nops * size);
+	memset(dst, 0, nops * size);
+
+	callbacks_done = 0;
+	for (size_t i = 0; i < nops; ++i) {
+		futs[i] = vdm_memmove(vdm, dst + i * size, src + i * size,
+			size, 0);
+		UT_ASSERTeq(vdm_start_with_callback(&futs[i],
+			test_callback_poll, &futs[i]), 0);
+	}
+
+	uint64_t done;
+	util_atomic_load64(&callbacks_done, &done);
+	while (done != nops) {
+		os_thread_yield();
+		util_atomic_load64(&callbacks_done, &done);
+	}
+
+	int ret = 0;
+	for (size_t i = 0; i < nops; ++i) {
+		UT_ASSERTeq(futs[i].base.context.state, FUTURE_STATE_COMPLETE);
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->result, VDM_SUCCESS);
+		/* only idle futures can be started */
+		UT_ASSERTeq(vdm_start_with_callback(&futs[i],
+			test_callback_poll, &futs[i]), -1);
+	}
+	if (memcmp(dst, src, nops * size) != 0) {
+		fprintf(stderr, "the callback operations weren't performed\n");
+		ret = 1;
+	}
+
+	free(dst);
+	free(src);
+	free(futs);
 	data_mover_threads_delete(dmt);
 
 	return ret;
@@ -168,5 +630,29 @@ main(void)
 		test_thread_memmove_multiple(10000000) ||
 		test_thread_memmove_multiple(30000000) ||
 		test_thread_memmove_multiple(50000000) ||
+		test_thread_memmove_split(1 << 20, 4096) ||
+		test_thread_memmove_split((1 << 20) + 123, 1000) ||
+		test_thread_flags(100, VDM_F_NO_CACHE_HINT) ||
+		test_thread_flags(100, VDM_F_MEM_DURABLE) ||
+		test_thread_flags((2 << 20) + 3, VDM_F_MEM_DURABLE) ||
+		test_thread_flags((2 << 20) + 3,
+			VDM_F_MEM_DURABLE | VDM_F_NO_CACHE_HINT) ||
+		test_thread_memcpy_v(0, 64, 0, 0) ||
+		test_thread_memcpy_v(200, 64, 0, 0) ||
+		test_thread_memcpy_v(200, 64, 0, 1 << 20) ||
+		test_thread_memcpy_v(100, 1000, 4096, 0) ||
+		test_thread_memcpy_v(7, 10000, 1500, 0) ||
+		test_thread_check_ops(4096) ||
+		test_thread_check_ops(100000) ||
+		test_thread_memfill(1000, 0) ||
+		test_thread_memfill(100003, 1000) ||
+		test_thread_cancel(16, 4096) ||
+		test_thread_submit_batch(1, 4096) ||
+		test_thread_submit_batch(100, 1024) ||
+		test_thread_callback(1, 100) ||
+		test_thread_callback(50, 1 << 16) ||
+		test_thread_storage(1, 100) ||
+		test_thread_storage(50, 4096) ||
+		test_thread_compact(1000, 512) ||
 		test_supported_flags();
 }
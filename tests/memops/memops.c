@@ -0,0 +1,287 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "core/memops.h"
+#include "test_helpers.h"
+
+#define TEST_BUF_SIZE (1 << 16)
+#define TEST_GUARD 0xA5
+
+/*
+ * test_guards -- checks that the bytes around [off, off + n) are intact
+ */
+static void
+test_guards(const unsigned char *buf, size_t off, size_t n)
+{
+	for (size_t i = 0; i < off; ++i)
+		UT_ASSERTeq(buf[i], TEST_GUARD);
+	for (size_t i = off + n; i < TEST_BUF_SIZE; ++i)
+		UT_ASSERTeq(buf[i], TEST_GUARD);
+}
+
+/*
+ * test_kernel -- copies and fills with the kernel, at every misalignment
+ * of the source and the destination and at sizes around a cache line
+ */
+static void
+test_kernel(const struct memops *ops, unsigned char *src,
+	unsigned char *dst)
+{
+	static const size_t sizes[] = {0, 1, 63, 64, 65, 127, 128, 200,
+		4096, 4099, TEST_BUF_SIZE - 128};
+
+	for (size_t i = 0; i < TEST_BUF_SIZE; ++i)
+		src[i] = (unsigned char)(i * 7 + 3);
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		size_t n = sizes[s];
+		for (size_t doff = 0; doff < 64; doff += 7) {
+			for (size_t soff = 0; soff < 64; soff += 13) {
+				memset(dst, TEST_GUARD, TEST_BUF_SIZE);
+				ops->memcpy_nt(dst + doff, src + soff, n);
+				UT_ASSERTeq(memcmp(dst + doff, src + soff, n),
+					0);
+				test_guards(dst, doff, n);
+			}
+
+			memset(dst, TEST_GUARD, TEST_BUF_SIZE);
+			ops->memset_nt(dst + doff, 0x3C, n);
+			for (size_t i = 0; i < n; ++i)
+				UT_ASSERTeq(dst[doff + i], 0x3C);
+			test_guards(dst, doff, n);
+		}
+	}
+}
+
+/*
+ * test_fill_check -- checks that [off, off + n) of dst holds the pattern
+ * of pattern_len bytes of src, repeated from off, and the rest is intact
+ */
+static void
+test_fill_check(const unsigned char *src, const unsigned char *dst,
+	size_t pattern_len, size_t off, size_t n)
+{
+	for (size_t i = 0; i < n; ++i) {
+		size_t pos = i % pattern_len;
+		UT_ASSERTeq(dst[off + i], src[pos]);
+	}
+	test_guards(dst, off, n);
+}
+
+/*
+ * test_kernel_memfill -- fills with the lines of every pattern width,
+ * at several misalignments and at sizes around a cache line
+ */
+static void
+test_kernel_memfill(const struct memops *ops, unsigned char *src,
+	unsigned char *dst)
+{
+	static const size_t sizes[] = {0, 1, 63, 64, 65, 200, 4099,
+		TEST_BUF_SIZE - 128};
+	unsigned char line[MEMOPS_FILL_LINE];
+
+	for (size_t i = 0; i < TEST_BUF_SIZE; ++i)
+		src[i] = (unsigned char)(i * 7 + 3);
+
+	for (size_t len = 1; len <= MEMOPS_FILL_MAX_PATTERN; len *= 2) {
+		for (size_t i = 0; i < MEMOPS_FILL_LINE; ++i)
+			line[i] = src[i % len];
+
+		for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+			for (size_t off = 0; off < 64; off += 13) {
+				memset(dst, TEST_GUARD, TEST_BUF_SIZE);
+				ops->memfill_nt(dst + off, line, sizes[s]);
+				test_fill_check(src, dst, len, off, sizes[s]);
+			}
+		}
+	}
+}
+
+/*
+ * test_routines -- the routines honor the flags and give the same results
+ * as the libc ones, whatever the path they take
+ */
+static void
+test_routines(unsigned char *src, unsigned char *dst)
+{
+	static const unsigned flags[] = {0, MEMOPS_F_NO_CACHE,
+		MEMOPS_F_DURABLE, MEMOPS_F_DURABLE | MEMOPS_F_NO_CACHE};
+	static const size_t sizes[] = {0, 1, 100,
+		MEMOPS_DURABLE_NT_THRESHOLD - 1, MEMOPS_DURABLE_NT_THRESHOLD,
+		MEMOPS_DURABLE_NT_THRESHOLD + 61, TEST_BUF_SIZE - 64};
+
+	for (size_t f = 0; f < sizeof(flags) / sizeof(flags[0]); ++f) {
+		for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+			size_t n = sizes[s];
+
+			memset(dst, TEST_GUARD, TEST_BUF_SIZE);
+			memops_memcpy(dst + 3, src, n, flags[f]);
+			UT_ASSERTeq(memcmp(dst + 3, src, n), 0);
+			test_guards(dst, 3, n);
+
+			memops_memmove(dst + 1, dst + 3, n, flags[f]);
+			UT_ASSERTeq(memcmp(dst + 1, src, n), 0);
+
+			memset(dst, TEST_GUARD, TEST_BUF_SIZE);
+			memops_memset(dst + 5, 0x3C, n, flags[f]);
+			for (size_t i = 0; i < n; ++i)
+				UT_ASSERTeq(dst[5 + i], 0x3C);
+			test_guards(dst, 5, n);
+
+			memops_flush(dst + 5, n);
+
+			for (size_t len = 1; len <= MEMOPS_FILL_MAX_PATTERN;
+					len *= 4) {
+				memset(dst, TEST_GUARD, TEST_BUF_SIZE);
+				UT_ASSERTeq(memops_memfill(dst + 7, src, len, n,
+					flags[f]), 0);
+				test_fill_check(src, dst, len, 7, n);
+			}
+		}
+
+		/* the pattern has to be a power of two up to a cache line */
+		UT_ASSERTeq(memops_memfill(dst, src, 0, 64, flags[f]), -1);
+		UT_ASSERTeq(memops_memfill(dst, src, 24, 64, flags[f]), -1);
+		UT_ASSERTeq(memops_memfill(dst, src, 128, 64, flags[f]), -1);
+	}
+}
+
+/*
+ * test_compare -- the compare kernels report the first differing byte
+ */
+static void
+test_compare(unsigned char *src, unsigned char *dst)
+{
+	static const size_t offsets[] = {0, 1, 7, 8, 4095, 4096, 4097,
+		TEST_BUF_SIZE - 1};
+
+	memset(src, 0x3C, TEST_BUF_SIZE);
+	memset(dst, 0x3C, TEST_BUF_SIZE);
+	UT_ASSERTeq(memops_compare(src, dst, TEST_BUF_SIZE), TEST_BUF_SIZE);
+	UT_ASSERTeq(memops_compare_pattern(src, 0x3C3C3C3C3C3C3C3CULL,
+		TEST_BUF_SIZE), TEST_BUF_SIZE);
+	UT_ASSERTeq(memops_compare(src, dst, 0), 0);
+
+	for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); ++i) {
+		size_t off = offsets[i];
+		dst[off] = 0x3D;
+		UT_ASSERTeq(memops_compare(src, dst, TEST_BUF_SIZE), off);
+		UT_ASSERTeq(memops_compare(src, dst, off), off);
+		UT_ASSERTeq(memops_compare_pattern(dst, 0x3C3C3C3C3C3C3C3CULL,
+			TEST_BUF_SIZE), off);
+		dst[off] = 0x3C;
+	}
+
+	/* the pattern starts over every 8 bytes, from the beginning */
+	uint64_t pattern = 0x0706050403020100ULL;
+	for (size_t i = 0; i < 203; ++i)
+		dst[i] = (unsigned char)(i % 8);
+	UT_ASSERTeq(memops_compare_pattern(dst, pattern, 203), 203);
+	UT_ASSERTeq(memops_compare_pattern(dst + 1, pattern, 202), 0);
+}
+
+/*
+ * test_crc32c -- the checksum matches the reference one, whether
+ * it's computed at once or in parts
+ */
+static void
+test_crc32c(unsigned char *src)
+{
+	UT_ASSERTeq(memops_crc32c(0, "123456789", 9), 0xE3069283U);
+	UT_ASSERTeq(memops_crc32c(0, src, 0), 0);
+
+	for (size_t i = 0; i < TEST_BUF_SIZE; ++i)
+		src[i] = (unsigned char)(i * 7 + 3);
+
+	uint32_t crc = memops_crc32c(0, src, 1001);
+	uint32_t part = memops_crc32c(0, src, 3);
+	part = memops_crc32c(part, src + 3, 500);
+	part = memops_crc32c(part, src + 503, 498);
+	UT_ASSERTeq(part, crc);
+}
+
+/*
+ * test_delta -- a delta record of the differences turns the original buffer
+ * into the modified one
+ */
+static void
+test_delta(unsigned char *src, unsigned char *dst)
+{
+	size_t n = 4096;
+	unsigned char delta[MEMOPS_DELTA_ENTRY_SIZE * 4];
+	size_t delta_size;
+
+	for (size_t i = 0; i < n; ++i)
+		src[i] = (unsigned char)(i * 7 + 3);
+	memcpy(dst, src, n);
+	UT_ASSERTeq(memops_delta_create(src, dst, n, delta, sizeof(delta),
+		&delta_size), MEMOPS_DELTA_EQUAL);
+	UT_ASSERTeq(delta_size, 0);
+
+	/* two changes in one word, one in the last word */
+	dst[0] ^= 1;
+	dst[5] ^= 1;
+	dst[801] ^= 1;
+	dst[n - 1] ^= 1;
+	UT_ASSERTeq(memops_delta_create(src, dst, n, delta, sizeof(delta),
+		&delta_size), MEMOPS_DELTA_CREATED);
+	UT_ASSERTeq(delta_size, MEMOPS_DELTA_ENTRY_SIZE * 3);
+
+	unsigned char *copy = malloc(n);
+	if (copy == NULL)
+		UT_FATAL("out of memory");
+	memcpy(copy, src, n);
+	UT_ASSERTeq(memops_delta_apply(copy, n, delta, delta_size, 0), 0);
+	UT_ASSERTeq(memcmp(copy, dst, n), 0);
+
+	/* the entries have to fit the buffer */
+	UT_ASSERTeq(memops_delta_apply(copy, n - 8, delta, delta_size, 0), -1);
+	UT_ASSERTeq(memops_delta_apply(copy, n, delta, delta_size - 1, 0), -1);
+	free(copy);
+
+	UT_ASSERTeq(memops_delta_create(src, dst, n, delta,
+		MEMOPS_DELTA_ENTRY_SIZE * 2, &delta_size),
+		MEMOPS_DELTA_OVERFLOW);
+	UT_ASSERTeq(delta_size, MEMOPS_DELTA_ENTRY_SIZE * 2);
+
+	UT_ASSERTeq(memops_delta_create(src, dst, n - 1, delta, sizeof(delta),
+		&delta_size), -1);
+}
+
+int
+main(void)
+{
+	unsigned char *src = malloc(TEST_BUF_SIZE);
+	unsigned char *dst = malloc(TEST_BUF_SIZE);
+	if (src == NULL || dst == NULL)
+		UT_FATAL("out of memory");
+
+	const struct memops *ops;
+	for (size_t i = 0; (ops = memops_get(i)) != NULL; ++i) {
+		if (!ops->is_supported()) {
+			printf("%s: not supported\n", ops->name);
+			continue;
+		}
+		test_kernel(ops, src, dst);
+		test_kernel_memfill(ops, src, dst);
+	}
+
+	test_routines(src, dst);
+	test_compare(src, dst);
+	test_crc32c(src);
+	test_delta(src, dst);
+
+	/* the best kernel is one of the supported ones */
+	ops = memops_best();
+	UT_ASSERTne(ops, NULL);
+	UT_ASSERT(ops->is_supported());
+	UT_ASSERTeq(memops_best(), ops);
+
+	free(src);
+	free(dst);
+
+	return 0;
+}
@@ -0,0 +1,20 @@
+# SPDX-License-Identifier: BSD-3-Clause
+# Copyright 2022, Intel Corporation
+
+# test for the non-temporal copy and fill kernels
+
+include(${SRC_DIR}/cmake/test_helpers.cmake)
+
+setup()
+
+execute(0 ${CMAKE_RUNTIME_OUTPUT_DIRECTORY}/${BUILD}/memops)
+execute_assert_pass(${CMAKE_RUNTIME_OUTPUT_DIRECTORY}/${BUILD}/memops)
+
+# the durable routines with and without writing back the cache lines
+set(ENV{MINIASYNC_NO_FLUSH} "1")
+execute(0 ${CMAKE_RUNTIME_OUTPUT_DIRECTORY}/${BUILD}/memops)
+set(ENV{MINIASYNC_NO_FLUSH} "0")
+execute(0 ${CMAKE_RUNTIME_OUTPUT_DIRECTORY}/${BUILD}/memops)
+unset(ENV{MINIASYNC_NO_FLUSH})
+
+cleanup()
@@ -0,0 +1,395 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "core/ringbuf.h"
+#include "core/util.h"
+#include "os_thread.h"
+#include "test_helpers.h"
+
+#define TEST_NTHREADS 4
+#define TEST_NITEMS 10000
+#define TEST_LENGTH 16
+#define TEST_BATCH 5
+
+/*
+ * test_ringbuf_try -- the try operations fail on a full and an empty buffer
+ * and keep the FIFO order across the laps
+ */
+void
+test_ringbuf_try(void)
+{
+	struct ringbuf *rbuf = ringbuf_new(TEST_LENGTH);
+	UT_ASSERTne(rbuf, NULL);
+	UT_ASSERTeq(ringbuf_trydequeue(rbuf), NULL);
+
+	uintptr_t next = 1;
+	for (int lap = 0; lap < 4; ++lap) {
+		uintptr_t first = next;
+		for (int i = 0; i < TEST_LENGTH; ++i, ++next)
+			UT_ASSERTeq(ringbuf_tryenqueue(rbuf, (void *)next), 0);
+		UT_ASSERTeq(ringbuf_tryenqueue(rbuf, (void *)next), -1);
+
+		for (int i = 0; i < TEST_LENGTH; ++i, ++first)
+			UT_ASSERTeq(ringbuf_trydequeue(rbuf), (void *)first);
+		UT_ASSERTeq(ringbuf_trydequeue(rbuf), NULL);
+	}
+
+	ringbuf_delete(rbuf);
+
+	/* a single slot is either free or filled */
+	rbuf = ringbuf_new(1);
+	UT_ASSERTne(rbuf, NULL);
+	for (int i = 0; i < 4; ++i) {
+		UT_ASSERTeq(ringbuf_tryenqueue(rbuf, (void *)next), 0);
+		UT_ASSERTeq(ringbuf_tryenqueue(rbuf, (void *)next), -1);
+		UT_ASSERTeq(ringbuf_trydequeue(rbuf), (void *)next);
+		UT_ASSERTeq(ringbuf_trydequeue(rbuf), NULL);
+	}
+	ringbuf_delete(rbuf);
+
+	/* an empty ring buffer is always full */
+	rbuf = ringbuf_new(0);
+	UT_ASSERTne(rbuf, NULL);
+	UT_ASSERTeq(ringbuf_tryenqueue(rbuf, (void *)next), -1);
+	UT_ASSERTeq(ringbuf_trydequeue(rbuf), NULL);
+	ringbuf_delete(rbuf);
+
+	UT_ASSERTeq(ringbuf_new(TEST_LENGTH + 1), NULL);
+}
+
+/*
+ * test_ringbuf_init -- the ring buffer placed in the caller's memory keeps
+ * working when the memory is seen at another address
+ */
+void
+test_ringbuf_init(void)
+{
+	size_t size = ringbuf_size(TEST_LENGTH);
+	UT_ASSERT(size > ringbuf_size(1));
+	void *addr = malloc(size);
+	void *moved = malloc(size);
+	UT_ASSERTne(addr, NULL);
+	UT_ASSERTne(moved, NULL);
+
+	UT_ASSERTeq(ringbuf_init(addr, TEST_LENGTH + 1), NULL);
+	struct ringbuf *rbuf = ringbuf_init(addr, TEST_LENGTH);
+	UT_ASSERTeq(rbuf, addr);
+	for (uintptr_t i = 1; i <= TEST_LENGTH; ++i)
+		UT_ASSERTeq(ringbuf_tryenqueue(rbuf, (void *)i), 0);
+	UT_ASSERTeq(ringbuf_tryenqueue(rbuf, (void *)1), -1);
+
+	memcpy(moved, addr, size);
+	rbuf = moved;
+	for (uintptr_t i = 1; i <= TEST_LENGTH; ++i)
+		UT_ASSERTeq(ringbuf_trydequeue(rbuf), (void *)i);
+	UT_ASSERTeq(ringbuf_trydequeue(rbuf), NULL);
+
+	free(moved);
+	free(addr);
+}
+
+struct test_consumer {
+	struct ringbuf *rbuf;
+	uint64_t *nremaining; /* items not claimed by any consumer yet */
+	uint64_t sum;
+	uint64_t count;
+};
+
+void *
+try_consumer_thread(void *arg)
+{
+	struct test_consumer *c = arg;
+	for (;;) {
+		uint64_t nremaining;
+		util_atomic_load_explicit64(c->nremaining, &nremaining,
+			memory_order_acquire);
+		if (nremaining == 0)
+			break;
+
+		void *data = ringbuf_trydequeue(c->rbuf);
+		if (data == NULL) {
+			os_thread_yield();
+			continue;
+		}
+		util_fetch_and_sub64(c->nremaining, 1);
+		c->sum += (uintptr_t)data;
+		c->count++;
+	}
+
+	return NULL;
+}
+
+void *
+try_producer_thread(void *arg)
+{
+	struct ringbuf *rbuf = arg;
+	for (uintptr_t i = 1; i <= TEST_NITEMS; ++i) {
+		while (ringbuf_tryenqueue(rbuf, (void *)i) != 0)
+			os_thread_yield();
+	}
+
+	return NULL;
+}
+
+/*
+ * test_ringbuf_try_mt -- every item enqueued by many producers is dequeued
+ * exactly once by many consumers
+ */
+void
+test_ringbuf_try_mt(void)
+{
+	struct ringbuf *rbuf = ringbuf_new(TEST_LENGTH);
+	UT_ASSERTne(rbuf, NULL);
+
+	uint64_t nremaining = (uint64_t)TEST_NTHREADS * TEST_NITEMS;
+	os_thread_t producers[TEST_NTHREADS];
+	os_thread_t consumers[TEST_NTHREADS];
+	struct test_consumer c[TEST_NTHREADS];
+	for (int i = 0; i < TEST_NTHREADS; ++i) {
+		c[i].rbuf = rbuf;
+		c[i].nremaining = &nremaining;
+		c[i].sum = 0;
+		c[i].count = 0;
+		UT_ASSERTeq(os_thread_create(&consumers[i], NULL,
+			try_consumer_thread, &c[i]), 0);
+		UT_ASSERTeq(os_thread_create(&producers[i], NULL,
+			try_producer_thread, rbuf), 0);
+	}
+
+	uint64_t sum = 0;
+	for (int i = 0; i < TEST_NTHREADS; ++i) {
+		os_thread_join(&producers[i], NULL);
+		os_thread_join(&consumers[i], NULL);
+		sum += c[i].sum;
+	}
+
+	uint64_t expected = (uint64_t)TEST_NTHREADS *
+		TEST_NITEMS * (TEST_NITEMS + 1) / 2;
+	UT_ASSERTeq(sum, expected);
+	UT_ASSERTeq(ringbuf_trydequeue(rbuf), NULL);
+
+	ringbuf_delete(rbuf);
+}
+
+void *
+blocking_consumer_thread(void *arg)
+{
+	struct test_consumer *c = arg;
+	void *data;
+	while ((data = ringbuf_dequeue(c->rbuf)) != NULL) {
+		c->sum += (uintptr_t)data;
+		c->count++;
+	}
+
+	return NULL;
+}
+
+void *
+blocking_producer_thread(void *arg)
+{
+	struct ringbuf *rbuf = arg;
+	for (uintptr_t i = 1; i <= TEST_NITEMS; ++i)
+		ringbuf_enqueue(rbuf, (void *)i);
+
+	return NULL;
+}
+
+/*
+ * test_ringbuf_blocking_mt -- the blocking operations wait for room and
+ * for items, stopping the buffer unblocks the consumers
+ */
+void
+test_ringbuf_blocking_mt(void)
+{
+	struct ringbuf *rbuf = ringbuf_new_blocking(TEST_LENGTH);
+	UT_ASSERTne(rbuf, NULL);
+
+	os_thread_t producers[TEST_NTHREADS];
+	os_thread_t consumers[TEST_NTHREADS];
+	struct test_consumer c[TEST_NTHREADS];
+	for (int i = 0; i < TEST_NTHREADS; ++i) {
+		c[i].rbuf = rbuf;
+		c[i].nremaining = NULL;
+		c[i].sum = 0;
+		c[i].count = 0;
+		UT_ASSERTeq(os_thread_create(&consumers[i], NULL,
+			blocking_consumer_thread, &c[i]), 0);
+		UT_ASSERTeq(os_thread_create(&producers[i], NULL,
+			blocking_producer_thread, rbuf), 0);
+	}
+
+	for (int i = 0; i < TEST_NTHREADS; ++i)
+		os_thread_join(&producers[i], NULL);
+	ringbuf_stop(rbuf);
+
+	uint64_t sum = 0;
+	uint64_t count = 0;
+	for (int i = 0; i < TEST_NTHREADS; ++i) {
+		os_thread_join(&consumers[i], NULL);
+		sum += c[i].sum;
+		count += c[i].count;
+	}
+
+	UT_ASSERTeq(count, (uint64_t)TEST_NTHREADS * TEST_NITEMS);
+	UT_ASSERTeq(sum, (uint64_t)TEST_NTHREADS *
+		TEST_NITEMS * (TEST_NITEMS + 1) / 2);
+
+	ringbuf_delete(rbuf);
+}
+
+/*
+ * test_ringbuf_bulk -- the bulk operations move as many values as fit and
+ * keep the FIFO order, also across the end of the slot array
+ */
+void
+test_ringbuf_bulk(void)
+{
+	struct ringbuf *rbuf = ringbuf_new(TEST_LENGTH);
+	UT_ASSERTne(rbuf, NULL);
+
+	void *items[TEST_LENGTH * 2];
+	void *out[TEST_LENGTH * 2];
+	for (uintptr_t i = 0; i < TEST_LENGTH * 2; ++i)
+		items[i] = (void *)(i + 1);
+
+	UT_ASSERTeq(ringbuf_dequeue_bulk(rbuf, out, TEST_LENGTH), 0);
+
+	/* only the free slots are reserved */
+	UT_ASSERTeq(ringbuf_enqueue_bulk(rbuf, items, 3), 3);
+	UT_ASSERTeq(ringbuf_enqueue_bulk(rbuf, items + 3, TEST_LENGTH * 2),
+		TEST_LENGTH - 3);
+	UT_ASSERTeq(ringbuf_enqueue_bulk(rbuf, items, 1), 0);
+	UT_ASSERTeq(ringbuf_tryenqueue(rbuf, items[0]), -1);
+
+	UT_ASSERTeq(ringbuf_dequeue_bulk(rbuf, out, 5), 5);
+	UT_ASSERTeq(ringbuf_trydequeue(rbuf), items[5]);
+	UT_ASSERTeq(ringbuf_dequeue_bulk(rbuf, out + 6, TEST_LENGTH * 2),
+		TEST_LENGTH - 6);
+	for (size_t i = 0; i < TEST_LENGTH; ++i) {
+		if (i != 5)
+			UT_ASSERTeq(out[i], items[i]);
+	}
+
+	/* the positions are no longer aligned to the slot array */
+	UT_ASSERTeq(ringbuf_enqueue_bulk(rbuf, items, 7), 7);
+	UT_ASSERTeq(ringbuf_dequeue_bulk(rbuf, out, 7), 7);
+	for (int lap = 0; lap < 4; ++lap) {
+		UT_ASSERTeq(ringbuf_enqueue_bulk(rbuf, items, TEST_LENGTH),
+			TEST_LENGTH);
+		UT_ASSERTeq(ringbuf_dequeue_bulk(rbuf, out, TEST_LENGTH),
+			TEST_LENGTH);
+		for (size_t i = 0; i < TEST_LENGTH; ++i)
+			UT_ASSERTeq(out[i], items[i]);
+	}
+	UT_ASSERTeq(ringbuf_dequeue_bulk(rbuf, out, 1), 0);
+
+	ringbuf_delete(rbuf);
+
+	rbuf = ringbuf_new(0);
+	UT_ASSERTne(rbuf, NULL);
+	UT_ASSERTeq(ringbuf_enqueue_bulk(rbuf, items, 4), 0);
+	UT_ASSERTeq(ringbuf_dequeue_bulk(rbuf, out, 4), 0);
+	ringbuf_delete(rbuf);
+}
+
+void *
+bulk_consumer_thread(void *arg)
+{
+	struct test_consumer *c = arg;
+	void *out[TEST_BATCH];
+	for (;;) {
+		uint64_t nremaining;
+		util_atomic_load_explicit64(c->nremaining, &nremaining,
+			memory_order_acquire);
+		if (nremaining == 0)
+			break;
+
+		size_t n = ringbuf_dequeue_bulk(c->rbuf, out, TEST_BATCH);
+		if (n == 0) {
+			os_thread_yield();
+			continue;
+		}
+		util_fetch_and_sub64(c->nremaining, n);
+		for (size_t i = 0; i < n; ++i)
+			c->sum += (uintptr_t)out[i];
+		c->count += n;
+	}
+
+	return NULL;
+}
+
+void *
+bulk_producer_thread(void *arg)
+{
+	struct ringbuf *rbuf = arg;
+	void *items[TEST_BATCH];
+	for (uintptr_t i = 1; i <= TEST_NITEMS; i += TEST_BATCH) {
+		size_t n = 0;
+		for (; n < TEST_BATCH && i + n <= TEST_NITEMS; ++n)
+			items[n] = (void *)(i + n);
+
+		size_t nqueued = 0;
+		while ((nqueued += ringbuf_enqueue_bulk(rbuf,
+		    items + nqueued, n - nqueued)) != n)
+			os_thread_yield();
+	}
+
+	return NULL;
+}
+
+/*
+ * test_ringbuf_bulk_mt -- every item enqueued in bulk by many producers is
+ * dequeued exactly once by many consumers, taking them in bulk or one by one
+ */
+void
+test_ringbuf_bulk_mt(void)
+{
+	struct ringbuf *rbuf = ringbuf_new(TEST_LENGTH);
+	UT_ASSERTne(rbuf, NULL);
+
+	uint64_t nremaining = (uint64_t)TEST_NTHREADS * TEST_NITEMS;
+	os_thread_t producers[TEST_NTHREADS];
+	os_thread_t consumers[TEST_NTHREADS];
+	struct test_consumer c[TEST_NTHREADS];
+	for (int i = 0; i < TEST_NTHREADS; ++i) {
+		c[i].rbuf = rbuf;
+		c[i].nremaining = &nremaining;
+		c[i].sum = 0;
+		c[i].count = 0;
+		void *(*consumer)(void *) = (i & 1) ?
+			bulk_consumer_thread : try_consumer_thread;
+		UT_ASSERTeq(os_thread_create(&consumers[i], NULL,
+			consumer, &c[i]), 0);
+		UT_ASSERTeq(os_thread_create(&producers[i], NULL,
+			bulk_producer_thread, rbuf), 0);
+	}
+
+	uint64_t sum = 0;
+	for (int i = 0; i < TEST_NTHREADS; ++i) {
+		os_thread_join(&producers[i], NULL);
+		os_thread_join(&consumers[i], NULL);
+		sum += c[i].sum;
+	}
+
+	UT_ASSERTeq(sum, (uint64_t)TEST_NTHREADS *
+		TEST_NITEMS * (TEST_NITEMS + 1) / 2);
+	UT_ASSERTeq(ringbuf_trydequeue(rbuf), NULL);
+
+	ringbuf_delete(rbuf);
+}
+
+int
+main(void)
+{
+	test_ringbuf_try();
+	test_ringbuf_init();
+	test_ringbuf_try_mt();
+	test_ringbuf_blocking_mt();
+	test_ringbuf_bulk();
+	test_ringbuf_bulk_mt();
+
+	return 0;
+}
@@ -0,0 +1,231 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "libminiasync.h"
+#include "core/os_thread.h"
+#include "test_helpers.h"
+
+#define TEST_MSEC ((uint64_t)1000000)
+#define TEST_NPIPES 16
+
+struct test_writer {
+	int fd;
+	uint64_t delay;
+};
+
+/*
+ * writer_thread -- writes a byte into the pipe after the delay
+ */
+void *
+writer_thread(void *arg)
+{
+	struct test_writer *writer = arg;
+	struct timespec ts = {0, (long)writer->delay};
+	nanosleep(&ts, NULL);
+
+	char c = 'x';
+	UT_ASSERTeq(write(writer->fd, &c, 1), 1);
+
+	return NULL;
+}
+
+/*
+ * test_fd_readable -- the runtime blocks until data arrives in the pipe
+ */
+void
+test_fd_readable(struct runtime *r)
+{
+	int fds[2];
+	UT_ASSERTeq(pipe(fds), 0);
+
+	struct runtime_fd_future fut =
+		runtime_fd_ready(r, fds[0], RUNTIME_FD_READABLE);
+	struct runtime_sleep_future sleep = runtime_sleep_for(r, TEST_MSEC);
+	struct future *futs[] = {
+		FUTURE_AS_RUNNABLE(&fut),
+		FUTURE_AS_RUNNABLE(&sleep),
+	};
+
+	/* nothing to read yet */
+	UT_ASSERTeq(runtime_wait_any(r, futs, 2), 1);
+	UT_ASSERTeq(FUTURE_STATE(&fut), FUTURE_STATE_RUNNING);
+
+	struct test_writer writer = {fds[1], 2 * TEST_MSEC};
+	os_thread_t thread;
+	UT_ASSERTeq(os_thread_create(&thread, NULL, writer_thread,
+		&writer), 0);
+
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->error, 0);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->events, RUNTIME_FD_READABLE);
+	os_thread_join(&thread, NULL);
+
+	/* ready already, busy polling without a notifier */
+	fut = runtime_fd_ready(r, fds[0], RUNTIME_FD_READABLE);
+	UT_ASSERTeq(future_poll(FUTURE_AS_RUNNABLE(&fut), NULL),
+		FUTURE_STATE_COMPLETE);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->events, RUNTIME_FD_READABLE);
+
+	/* the hang up is reported once the write end is closed */
+	char c;
+	UT_ASSERTeq(read(fds[0], &c, 1), 1);
+	close(fds[1]);
+	fut = runtime_fd_ready(r, fds[0], RUNTIME_FD_READABLE);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERT(FUTURE_OUTPUT(&fut)->events & RUNTIME_FD_ERROR);
+
+	close(fds[0]);
+}
+
+/*
+ * test_fd_multiple -- many descriptors, including two futures waiting for
+ * the same one, are awaited at once
+ */
+void
+test_fd_multiple(struct runtime *r)
+{
+	int fds[TEST_NPIPES][2];
+	struct runtime_fd_future futs[TEST_NPIPES + 2];
+	struct future *runnables[TEST_NPIPES + 2];
+	for (int i = 0; i < TEST_NPIPES; ++i) {
+		UT_ASSERTeq(pipe(fds[i]), 0);
+		futs[i] = runtime_fd_ready(r, fds[i][0], RUNTIME_FD_READABLE);
+		runnables[i] = FUTURE_AS_RUNNABLE(&futs[i]);
+	}
+	futs[TEST_NPIPES] = runtime_fd_ready(r, fds[0][0],
+		RUNTIME_FD_READABLE);
+	futs[TEST_NPIPES + 1] = runtime_fd_ready(r, fds[0][1],
+		RUNTIME_FD_WRITABLE);
+	for (int i = TEST_NPIPES; i < TEST_NPIPES + 2; ++i)
+		runnables[i] = FUTURE_AS_RUNNABLE(&futs[i]);
+
+	/* an empty pipe is writable */
+	UT_ASSERTeq(runtime_wait_any(r, runnables, TEST_NPIPES + 2),
+		TEST_NPIPES + 1);
+
+	struct test_writer writers[TEST_NPIPES];
+	os_thread_t threads[TEST_NPIPES];
+	for (int i = 0; i < TEST_NPIPES; ++i) {
+		writers[i].fd = fds[i][1];
+		writers[i].delay = (uint64_t)i * (TEST_MSEC / 4);
+		UT_ASSERTeq(os_thread_create(&threads[i], NULL,
+			writer_thread, &writers[i]), 0);
+	}
+
+	runtime_wait_multiple(r, runnables, TEST_NPIPES + 2);
+	for (int i = 0; i < TEST_NPIPES + 1; ++i) {
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->events,
+			RUNTIME_FD_READABLE);
+	}
+
+	for (int i = 0; i < TEST_NPIPES; ++i) {
+		os_thread_join(&threads[i], NULL);
+		close(fds[i][0]);
+		close(fds[i][1]);
+	}
+}
+
+/*
+ * test_fd_spawned -- the executors drive the spawned futures
+ */
+void
+test_fd_spawned(void)
+{
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+	UT_ASSERTeq(runtime_executors_start(r, 2), 0);
+
+	int fds[2];
+	UT_ASSERTeq(pipe(fds), 0);
+
+	struct runtime_fd_future fut =
+		runtime_fd_ready(r, fds[0], RUNTIME_FD_READABLE);
+	UT_ASSERTeq(runtime_spawn(r, FUTURE_AS_RUNNABLE(&fut)), 0);
+
+	struct test_writer writer = {fds[1], 2 * TEST_MSEC};
+	os_thread_t thread;
+	UT_ASSERTeq(os_thread_create(&thread, NULL, writer_thread,
+		&writer), 0);
+
+	runtime_wait_spawned(r);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->events, RUNTIME_FD_READABLE);
+
+	os_thread_join(&thread, NULL);
+	close(fds[0]);
+	close(fds[1]);
+	runtime_delete(r);
+}
+
+/*
+ * test_fd_errors -- descriptors, which can't be polled, and invalid ones
+ */
+void
+test_fd_errors(struct runtime *r)
+{
+	/* regular files are always ready */
+	int fd = open("/proc/self/exe", O_RDONLY);
+	UT_ASSERT(fd >= 0);
+	struct runtime_fd_future fut = runtime_fd_ready(r, fd,
+		RUNTIME_FD_READABLE);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->error, 0);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->events, RUNTIME_FD_READABLE);
+	close(fd);
+
+	fut = runtime_fd_ready(r, fd, RUNTIME_FD_READABLE);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->error, EBADF);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->events, 0);
+}
+
+/*
+ * test_fd_abandoned -- deleting the runtime disarms the watches of futures,
+ * which never completed
+ */
+void
+test_fd_abandoned(void)
+{
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+
+	int fds[2];
+	UT_ASSERTeq(pipe(fds), 0);
+
+	struct runtime_fd_future fut =
+		runtime_fd_ready(r, fds[0], RUNTIME_FD_READABLE);
+	struct runtime_fd_future dup =
+		runtime_fd_ready(r, fds[0], RUNTIME_FD_READABLE);
+	struct runtime_sleep_future sleep = runtime_sleep_for(r, TEST_MSEC);
+	struct future *futs[] = {
+		FUTURE_AS_RUNNABLE(&fut),
+		FUTURE_AS_RUNNABLE(&dup),
+		FUTURE_AS_RUNNABLE(&sleep),
+	};
+	UT_ASSERTeq(runtime_wait_any(r, futs, 3), 2);
+
+	runtime_delete(r);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+int
+main(void)
+{
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+
+	test_fd_readable(r);
+	test_fd_multiple(r);
+	test_fd_errors(r);
+
+	runtime_delete(r);
+
+	test_fd_spawned();
+	test_fd_abandoned();
+
+	return 0;
+}
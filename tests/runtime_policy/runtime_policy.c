@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdlib.h>
+#include <string.h>
+#include "libminiasync.h"
+#include "test_helpers.h"
+
+#define TEST_NCOUNTUPS 16
+#define TEST_MAX_COUNT 100
+#define TEST_NMEMCPY 16
+#define TEST_MEMCPY_SIZE 4096
+#define TEST_NITERS 10
+
+struct countup_data {
+	int counter;
+	int max_count;
+};
+
+struct countup_output {
+	int result;
+};
+
+FUTURE(countup_fut, struct countup_data, struct countup_output);
+
+enum future_state
+countup_task(struct future_context *context,
+	struct future_notifier *notifier)
+{
+	struct countup_data *data = future_context_get_data(context);
+	if (++data->counter != data->max_count)
+		return FUTURE_STATE_RUNNING;
+
+	struct countup_output *output = future_context_get_output(context);
+	output->result = 1;
+
+	return FUTURE_STATE_COMPLETE;
+}
+
+struct countup_fut
+async_countup(int max_count)
+{
+	struct countup_fut fut = {.output.result = 0};
+	FUTURE_INIT(&fut, countup_task);
+	fut.data.counter = 0;
+	fut.data.max_count = max_count;
+
+	return fut;
+}
+
+/*
+ * test_policy -- waits for a mix of countup and memcpy futures using
+ * a runtime created with the given policy
+ */
+void
+test_policy(const struct runtime_policy *policy, struct vdm *vdm)
+{
+	struct runtime *r = runtime_new_ex(policy);
+	UT_ASSERTne(r, NULL);
+
+	char *src = malloc(TEST_NMEMCPY * TEST_MEMCPY_SIZE);
+	char *dst = malloc(TEST_NMEMCPY * TEST_MEMCPY_SIZE);
+	UT_ASSERTne(src, NULL);
+	UT_ASSERTne(dst, NULL);
+
+	struct countup_fut countups[TEST_NCOUNTUPS];
+	struct vdm_operation_future memcpys[TEST_NMEMCPY];
+	struct future *futs[TEST_NCOUNTUPS + TEST_NMEMCPY];
+
+	for (int iter = 0; iter < TEST_NITERS; ++iter) {
+		size_t nfuts = 0;
+		for (int i = 0; i < TEST_NCOUNTUPS; ++i) {
+			countups[i] = async_countup(TEST_MAX_COUNT);
+			futs[nfuts++] = FUTURE_AS_RUNNABLE(&countups[i]);
+		}
+		for (int i = 0; i < TEST_NMEMCPY; ++i) {
+			memset(src + i * TEST_MEMCPY_SIZE, iter + i,
+				TEST_MEMCPY_SIZE);
+			memcpys[i] = vdm_memcpy(vdm,
+				dst + i * TEST_MEMCPY_SIZE,
+				src + i * TEST_MEMCPY_SIZE,
+				TEST_MEMCPY_SIZE, 0);
+			futs[nfuts++] = FUTURE_AS_RUNNABLE(&memcpys[i]);
+		}
+
+		runtime_wait_multiple(r, futs, nfuts);
+
+		for (int i = 0; i < TEST_NCOUNTUPS; ++i)
+			UT_ASSERTeq(FUTURE_OUTPUT(&countups[i])->result, 1);
+		for (int i = 0; i < TEST_NMEMCPY; ++i) {
+			UT_ASSERTeq(FUTURE_OUTPUT(&memcpys[i])->result,
+				VDM_SUCCESS);
+		}
+		UT_ASSERTeq(memcmp(src, dst,
+			TEST_NMEMCPY * TEST_MEMCPY_SIZE), 0);
+	}
+
+	free(dst);
+	free(src);
+	runtime_delete(r);
+}
+
+/*
+ * test_policy_invalid -- runtime_new_ex() rejects invalid policies
+ */
+void
+test_policy_invalid(void)
+{
+	struct runtime_policy policy;
+
+	runtime_policy_default(&policy);
+	policy.pause = (enum runtime_pause_kind)100;
+	UT_ASSERTeq(runtime_new_ex(&policy), NULL);
+
+	runtime_policy_default(&policy);
+	policy.max_backoff = 0;
+	UT_ASSERTeq(runtime_new_ex(&policy), NULL);
+
+	runtime_policy_default(&policy);
+	policy.sleep_timeout.tv_nsec = 1000000000L;
+	UT_ASSERTeq(runtime_new_ex(&policy), NULL);
+}
+
+int
+main(void)
+{
+	struct data_mover_threads *dmt = data_mover_threads_default();
+	UT_ASSERTne(dmt, NULL);
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	struct runtime_policy policy;
+
+	/* NULL policy is equal to the default one */
+	test_policy(NULL, vdm);
+
+	/* latency-critical, never go to sleep */
+	runtime_policy_default(&policy);
+	policy.spins_before_sleep = RUNTIME_SPIN_FOREVER;
+	policy.pause = RUNTIME_PAUSE_TPAUSE;
+	test_policy(&policy, vdm);
+
+	/* batch, give up the core almost immediately */
+	runtime_policy_default(&policy);
+	policy.spins_before_sleep = 0;
+	policy.pause = RUNTIME_PAUSE_YIELD;
+	policy.sleep_timeout = (struct timespec){0, 100000};
+	test_policy(&policy, vdm);
+
+	/* exponential backoff */
+	runtime_policy_default(&policy);
+	policy.max_backoff = 64;
+	test_policy(&policy, vdm);
+
+	/* adaptive spin budget */
+	runtime_policy_default(&policy);
+	policy.spins_before_sleep = 100000;
+	policy.max_backoff = 8;
+	policy.adaptive = 1;
+	test_policy(&policy, vdm);
+
+	test_policy_invalid();
+
+	data_mover_threads_delete(dmt);
+
+	return 0;
+}
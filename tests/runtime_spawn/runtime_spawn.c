@@ -0,0 +1,150 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdlib.h>
+#include <string.h>
+#include "libminiasync.h"
+#include "core/util.h"
+#include "test_helpers.h"
+
+#define TEST_NTHREADS 4
+#define TEST_NCOUNTUPS 1000
+#define TEST_MAX_COUNT 50
+#define TEST_NMEMCPY 64
+#define TEST_MEMCPY_SIZE 4096
+
+struct countup_data {
+	struct runtime *runtime;
+	struct countup_fut *child; /* spawned when first polled */
+	int counter;
+	int max_count;
+};
+
+struct countup_output {
+	int result;
+};
+
+FUTURE(countup_fut, struct countup_data, struct countup_output);
+
+enum future_state
+countup_task(struct future_context *context,
+	struct future_notifier *notifier)
+{
+	struct countup_data *data = future_context_get_data(context);
+	if (data->counter == 0 && data->child != NULL)
+		UT_ASSERTeq(runtime_spawn(data->runtime,
+			FUTURE_AS_RUNNABLE(data->child)), 0);
+
+	if (++data->counter != data->max_count)
+		return FUTURE_STATE_RUNNING;
+
+	struct countup_output *output = future_context_get_output(context);
+	output->result = 1;
+
+	return FUTURE_STATE_COMPLETE;
+}
+
+struct countup_fut
+async_countup(struct runtime *r, int max_count, struct countup_fut *child)
+{
+	struct countup_fut fut = {.output.result = 0};
+	FUTURE_INIT(&fut, countup_task);
+	fut.data.runtime = r;
+	fut.data.child = child;
+	fut.data.counter = 0;
+	fut.data.max_count = max_count;
+
+	return fut;
+}
+
+/*
+ * test_spawn_countup -- spawns futures that never use a notifier, half of
+ * them spawning another future from within an executor
+ */
+void
+test_spawn_countup(struct runtime *r)
+{
+	struct countup_fut *futs =
+		malloc(sizeof(struct countup_fut) * TEST_NCOUNTUPS);
+	UT_ASSERTne(futs, NULL);
+
+	for (int i = 0; i < TEST_NCOUNTUPS; i += 2) {
+		futs[i + 1] = async_countup(r, TEST_MAX_COUNT, NULL);
+		futs[i] = async_countup(r, TEST_MAX_COUNT, &futs[i + 1]);
+		UT_ASSERTeq(runtime_spawn(r, FUTURE_AS_RUNNABLE(&futs[i])), 0);
+	}
+
+	runtime_wait_spawned(r);
+
+	for (int i = 0; i < TEST_NCOUNTUPS; ++i) {
+		UT_ASSERTeq(FUTURE_STATE(&futs[i]), FUTURE_STATE_COMPLETE);
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->result, 1);
+		UT_ASSERTeq(FUTURE_DATA(&futs[i])->counter, TEST_MAX_COUNT);
+	}
+
+	free(futs);
+}
+
+/*
+ * test_spawn_memcpy -- spawns memcpy futures, which use the waker notifier
+ */
+void
+test_spawn_memcpy(struct runtime *r)
+{
+	struct data_mover_threads *dmt = data_mover_threads_default();
+	UT_ASSERTne(dmt, NULL);
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	char *src = malloc(TEST_NMEMCPY * TEST_MEMCPY_SIZE);
+	char *dst = malloc(TEST_NMEMCPY * TEST_MEMCPY_SIZE);
+	struct vdm_operation_future *futs =
+		malloc(sizeof(struct vdm_operation_future) * TEST_NMEMCPY);
+	UT_ASSERTne(src, NULL);
+	UT_ASSERTne(dst, NULL);
+	UT_ASSERTne(futs, NULL);
+
+	for (int i = 0; i < TEST_NMEMCPY; ++i) {
+		memset(src + i * TEST_MEMCPY_SIZE, i, TEST_MEMCPY_SIZE);
+		futs[i] = vdm_memcpy(vdm, dst + i * TEST_MEMCPY_SIZE,
+			src + i * TEST_MEMCPY_SIZE, TEST_MEMCPY_SIZE, 0);
+		UT_ASSERTeq(runtime_spawn(r, FUTURE_AS_RUNNABLE(&futs[i])), 0);
+	}
+
+	runtime_wait_spawned(r);
+
+	for (int i = 0; i < TEST_NMEMCPY; ++i) {
+		UT_ASSERTeq(FUTURE_STATE(&futs[i]), FUTURE_STATE_COMPLETE);
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->result, VDM_SUCCESS);
+	}
+	UT_ASSERTeq(memcmp(src, dst, TEST_NMEMCPY * TEST_MEMCPY_SIZE), 0);
+
+	free(futs);
+	free(dst);
+	free(src);
+	data_mover_threads_delete(dmt);
+}
+
+int
+main(void)
+{
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+
+	/* spawning requires running executors */
+	struct countup_fut fut = async_countup(r, 1, NULL);
+	UT_ASSERTeq(runtime_spawn(r, FUTURE_AS_RUNNABLE(&fut)), -1);
+
+	UT_ASSERTeq(runtime_executors_start(r, TEST_NTHREADS), 0);
+	UT_ASSERTeq(runtime_executors_start(r, TEST_NTHREADS), -1);
+
+	test_spawn_countup(r);
+	test_spawn_memcpy(r);
+
+	/* runtime_delete waits for the futures still being executed */
+	fut = async_countup(r, TEST_MAX_COUNT, NULL);
+	UT_ASSERTeq(runtime_spawn(r, FUTURE_AS_RUNNABLE(&fut)), 0);
+	runtime_delete(r);
+	UT_ASSERTeq(FUTURE_STATE(&fut), FUTURE_STATE_COMPLETE);
+
+	return 0;
+}
@@ -0,0 +1,113 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdlib.h>
+#include <string.h>
+#include "libminiasync.h"
+#include "test_helpers.h"
+
+#define TEST_NMEMCPY 32
+#define TEST_COPY_SIZE 4096
+#define TEST_NITERS 4
+#define TEST_SLEEP_NSEC 2000000 /* 2ms */
+
+/*
+ * histogram_sum -- returns the number of values counted in the histogram
+ */
+static uint64_t
+histogram_sum(const uint64_t *histogram)
+{
+	uint64_t sum = 0;
+	for (int i = 0; i < RUNTIME_STATS_BUCKETS; ++i)
+		sum += histogram[i];
+
+	return sum;
+}
+
+/*
+ * test_stats_disabled -- runtimes don't collect stats by default
+ */
+void
+test_stats_disabled(void)
+{
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+
+	struct runtime_stats stats;
+	UT_ASSERTeq(runtime_get_stats(r, &stats), -1);
+	UT_ASSERTeq(stats.waits, 0);
+
+	runtime_delete(r);
+}
+
+/*
+ * test_stats_enabled -- counters reflect the work done by the runtime
+ */
+void
+test_stats_enabled(void)
+{
+	struct runtime_policy policy;
+	runtime_policy_default(&policy);
+	policy.stats = 1;
+	struct runtime *r = runtime_new_ex(&policy);
+	UT_ASSERTne(r, NULL);
+
+	struct data_mover_threads *dmt = data_mover_threads_default();
+	UT_ASSERTne(dmt, NULL);
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	char *src = malloc(TEST_NMEMCPY * TEST_COPY_SIZE);
+	char *dst = malloc(TEST_NMEMCPY * TEST_COPY_SIZE);
+	UT_ASSERTne(src, NULL);
+	UT_ASSERTne(dst, NULL);
+	memset(src, 1, TEST_NMEMCPY * TEST_COPY_SIZE);
+
+	struct vdm_operation_future copies[TEST_NMEMCPY];
+	struct future *futs[TEST_NMEMCPY];
+	for (int iter = 0; iter < TEST_NITERS; ++iter) {
+		for (int i = 0; i < TEST_NMEMCPY; ++i) {
+			copies[i] = vdm_memcpy(vdm, dst + i * TEST_COPY_SIZE,
+				src + i * TEST_COPY_SIZE, TEST_COPY_SIZE, 0);
+			futs[i] = FUTURE_AS_RUNNABLE(&copies[i]);
+		}
+		runtime_wait_multiple(r, futs, TEST_NMEMCPY);
+	}
+
+	/* sleeping forces the runtime to sleep and fire a timer */
+	struct runtime_sleep_future sleep =
+		runtime_sleep_for(r, TEST_SLEEP_NSEC);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&sleep));
+
+	struct runtime_stats stats;
+	UT_ASSERTeq(runtime_get_stats(r, &stats), 0);
+	UT_ASSERTeq(stats.waits, TEST_NITERS + 1);
+	UT_ASSERTeq(stats.completions, TEST_NITERS * TEST_NMEMCPY + 1);
+	UT_ASSERT(stats.polls >= stats.completions);
+	UT_ASSERT(stats.spins >= stats.waits);
+	UT_ASSERT(stats.wakes >= 1);
+	UT_ASSERT(stats.sleeps >= 1);
+	UT_ASSERT(stats.sleep_timeouts <= stats.sleeps);
+	UT_ASSERTeq(stats.timers_fired, 1);
+	UT_ASSERTeq(stats.steals, 0);
+	UT_ASSERT(histogram_sum(stats.spins_before_sleep) >= stats.sleeps);
+	UT_ASSERT(histogram_sum(stats.wake_latency) <= stats.wakes);
+
+	runtime_reset_stats(r);
+	UT_ASSERTeq(runtime_get_stats(r, &stats), 0);
+	UT_ASSERTeq(stats.waits, 0);
+	UT_ASSERTeq(histogram_sum(stats.wake_latency), 0);
+
+	free(dst);
+	free(src);
+	data_mover_threads_delete(dmt);
+	runtime_delete(r);
+}
+
+int
+main(void)
+{
+	test_stats_disabled();
+	test_stats_enabled();
+
+	return 0;
+}
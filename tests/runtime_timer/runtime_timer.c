@@ -0,0 +1,248 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdlib.h>
+#include <string.h>
+#include "libminiasync.h"
+#include "test_helpers.h"
+
+#define TEST_MSEC ((uint64_t)1000000)
+#define TEST_NSLEEPS 16
+#define TEST_COPY_SIZE 4096
+
+/*
+ * test_sleep_single -- the runtime sleeps until the deadline
+ */
+void
+test_sleep_single(struct runtime *r)
+{
+	uint64_t start = runtime_clock_now();
+	struct runtime_sleep_future fut = runtime_sleep_for(r, 2 * TEST_MSEC);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+
+	UT_ASSERT(FUTURE_OUTPUT(&fut)->time >= start + 2 * TEST_MSEC);
+	UT_ASSERT(runtime_clock_now() >= start + 2 * TEST_MSEC);
+
+	/* deadline in the past completes right away */
+	fut = runtime_sleep_until(r, start);
+	UT_ASSERTeq(future_poll(FUTURE_AS_RUNNABLE(&fut), NULL),
+		FUTURE_STATE_COMPLETE);
+
+	/* busy polling without a notifier */
+	fut = runtime_sleep_for(r, TEST_MSEC);
+	FUTURE_BUSY_POLL(&fut);
+	UT_ASSERTeq(FUTURE_STATE(&fut), FUTURE_STATE_COMPLETE);
+}
+
+/*
+ * test_sleep_multiple -- sleep futures complete once their deadlines
+ * have passed
+ */
+void
+test_sleep_multiple(struct runtime *r)
+{
+	struct runtime_sleep_future sleeps[TEST_NSLEEPS];
+	struct future *futs[TEST_NSLEEPS];
+
+	uint64_t start = runtime_clock_now();
+	for (int i = 0; i < TEST_NSLEEPS; ++i) {
+		uint64_t deadline = start +
+			(uint64_t)(TEST_NSLEEPS - i) * (TEST_MSEC / 4);
+		sleeps[i] = runtime_sleep_until(r, deadline);
+		futs[i] = FUTURE_AS_RUNNABLE(&sleeps[i]);
+	}
+
+	/* under load more deadlines than the first one might have passed */
+	size_t first = runtime_wait_any(r, futs, TEST_NSLEEPS);
+	UT_ASSERT(first < TEST_NSLEEPS);
+	UT_ASSERTeq(FUTURE_STATE(&sleeps[first]), FUTURE_STATE_COMPLETE);
+	UT_ASSERT(FUTURE_OUTPUT(&sleeps[first])->time >=
+		FUTURE_DATA(&sleeps[first])->deadline);
+
+	runtime_wait_multiple(r, futs, TEST_NSLEEPS);
+	for (int i = 0; i < TEST_NSLEEPS; ++i) {
+		UT_ASSERT(FUTURE_OUTPUT(&sleeps[i])->time >=
+			FUTURE_DATA(&sleeps[i])->deadline);
+		UT_ASSERTeq(FUTURE_DATA(&sleeps[i])->timer, NULL);
+	}
+}
+
+/*
+ * test_timeout -- timeout futures report whether the deadline passed
+ */
+void
+test_timeout(struct runtime *r)
+{
+	/* the wrapped future takes too long */
+	struct runtime_sleep_future slow =
+		runtime_sleep_for(r, 1000 * TEST_MSEC);
+	struct runtime_timeout_future timeout = runtime_timeout(r,
+		FUTURE_AS_RUNNABLE(&slow), runtime_clock_now() + TEST_MSEC);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&timeout));
+	UT_ASSERTeq(FUTURE_OUTPUT(&timeout)->timed_out, 1);
+	UT_ASSERTeq(FUTURE_STATE(&slow), FUTURE_STATE_RUNNING);
+
+	/* the wrapped future completes on time */
+	struct data_mover_threads *dmt = data_mover_threads_default();
+	UT_ASSERTne(dmt, NULL);
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	char *src = malloc(TEST_COPY_SIZE);
+	char *dst = malloc(TEST_COPY_SIZE);
+	UT_ASSERTne(src, NULL);
+	UT_ASSERTne(dst, NULL);
+	memset(src, 7, TEST_COPY_SIZE);
+	memset(dst, 0, TEST_COPY_SIZE);
+
+	struct vdm_operation_future copy =
+		vdm_memcpy(vdm, dst, src, TEST_COPY_SIZE, 0);
+	timeout = runtime_timeout(r, FUTURE_AS_RUNNABLE(&copy),
+		runtime_clock_now() + 10000 * TEST_MSEC);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&timeout));
+	UT_ASSERTeq(FUTURE_OUTPUT(&timeout)->timed_out, 0);
+	UT_ASSERTeq(FUTURE_OUTPUT(&copy)->result, VDM_SUCCESS);
+	UT_ASSERTeq(memcmp(src, dst, TEST_COPY_SIZE), 0);
+	UT_ASSERTeq(FUTURE_DATA(&timeout)->timer, NULL);
+
+	free(dst);
+	free(src);
+	data_mover_threads_delete(dmt);
+}
+
+struct sleep_select_data {
+	FUTURE_SELECT_ENTRY(struct runtime_sleep_future, fast);
+	FUTURE_SELECT_ENTRY(struct runtime_sleep_future, slow);
+};
+
+struct sleep_select_output {
+	uint64_t time;
+};
+
+FUTURE(sleep_select_future, struct sleep_select_data,
+	struct sleep_select_output);
+
+struct copy_select_data {
+	FUTURE_SELECT_ENTRY(struct vdm_operation_future, copy);
+	FUTURE_SELECT_ENTRY(struct runtime_sleep_future, sleep);
+};
+
+struct copy_select_output {
+	int dummy;
+};
+
+FUTURE(copy_select_future, struct copy_select_data,
+	struct copy_select_output);
+
+/*
+ * sleep_to_select_map -- maps the time of the winning sleep
+ */
+static void
+sleep_to_select_map(struct future_context *lhs, struct future_context *rhs,
+	void *arg)
+{
+	struct runtime_sleep_output *output = future_context_get_output(lhs);
+	struct sleep_select_output *select_output =
+		future_context_get_output(rhs);
+	select_output->time = output->time;
+}
+
+/*
+ * test_select -- select futures complete once the first entry does,
+ * canceling the other ones
+ */
+void
+test_select(struct runtime *r)
+{
+	uint64_t start = runtime_clock_now();
+	struct sleep_select_future sleeps = {.output.time = 0};
+	FUTURE_SELECT_ENTRY_INIT(&sleeps.data.fast,
+		runtime_sleep_for(r, TEST_MSEC), sleep_to_select_map, NULL,
+		runtime_sleep_cancel);
+	FUTURE_SELECT_ENTRY_INIT(&sleeps.data.slow,
+		runtime_sleep_for(r, 10000 * TEST_MSEC), sleep_to_select_map,
+		NULL, runtime_sleep_cancel);
+	FUTURE_SELECT_INIT(&sleeps);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&sleeps));
+
+	UT_ASSERTeq(future_select_winner(FUTURE_AS_RUNNABLE(&sleeps)), 0);
+	UT_ASSERT(FUTURE_OUTPUT(&sleeps)->time >= start + TEST_MSEC);
+	UT_ASSERT(runtime_clock_now() < start + 10000 * TEST_MSEC);
+	UT_ASSERTeq(FUTURE_STATE(&sleeps.data.slow.fut),
+		FUTURE_STATE_COMPLETE);
+	UT_ASSERTeq(FUTURE_DATA(&sleeps.data.slow.fut)->timer, NULL);
+
+	/* the copy wins against the timeout */
+	struct data_mover_threads *dmt = data_mover_threads_default();
+	UT_ASSERTne(dmt, NULL);
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	char *src = malloc(TEST_COPY_SIZE);
+	char *dst = malloc(TEST_COPY_SIZE);
+	UT_ASSERTne(src, NULL);
+	UT_ASSERTne(dst, NULL);
+	memset(src, 9, TEST_COPY_SIZE);
+	memset(dst, 0, TEST_COPY_SIZE);
+
+	struct copy_select_future copy = {.output.dummy = 0};
+	FUTURE_SELECT_ENTRY_INIT(&copy.data.copy,
+		vdm_memcpy(vdm, dst, src, TEST_COPY_SIZE, 0), NULL, NULL,
+		vdm_future_cancel);
+	FUTURE_SELECT_ENTRY_INIT(&copy.data.sleep,
+		runtime_sleep_for(r, 10000 * TEST_MSEC), NULL, NULL,
+		runtime_sleep_cancel);
+	FUTURE_SELECT_INIT(&copy);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&copy));
+
+	UT_ASSERTeq(future_select_winner(FUTURE_AS_RUNNABLE(&copy)), 0);
+	UT_ASSERTeq(FUTURE_OUTPUT(&copy.data.copy.fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(memcmp(src, dst, TEST_COPY_SIZE), 0);
+	UT_ASSERTeq(FUTURE_DATA(&copy.data.sleep.fut)->timer, NULL);
+
+	free(dst);
+	free(src);
+	data_mover_threads_delete(dmt);
+}
+
+/*
+ * test_sleep_spawned -- executors fire the timers of spawned futures
+ */
+void
+test_sleep_spawned(struct runtime *r)
+{
+	struct runtime_sleep_future sleeps[TEST_NSLEEPS];
+
+	UT_ASSERTeq(runtime_executors_start(r, 2), 0);
+
+	uint64_t start = runtime_clock_now();
+	for (int i = 0; i < TEST_NSLEEPS; ++i) {
+		sleeps[i] = runtime_sleep_until(r,
+			start + (uint64_t)i * (TEST_MSEC / 4));
+		UT_ASSERTeq(runtime_spawn(r,
+			FUTURE_AS_RUNNABLE(&sleeps[i])), 0);
+	}
+	runtime_wait_spawned(r);
+
+	for (int i = 0; i < TEST_NSLEEPS; ++i) {
+		UT_ASSERTeq(FUTURE_STATE(&sleeps[i]), FUTURE_STATE_COMPLETE);
+		UT_ASSERT(FUTURE_OUTPUT(&sleeps[i])->time >=
+			FUTURE_DATA(&sleeps[i])->deadline);
+	}
+}
+
+int
+main(void)
+{
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+
+	test_sleep_single(r);
+	test_sleep_multiple(r);
+	test_timeout(r);
+	test_select(r);
+	test_sleep_spawned(r);
+
+	/* timers of the futures left running are freed with the runtime */
+	runtime_delete(r);
+
+	return 0;
+}
@@ -0,0 +1,272 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdlib.h>
+#include <string.h>
+#include "libminiasync.h"
+#include "core/os_thread.h"
+#include "test_helpers.h"
+
+#define TEST_NCOUNTUPS 8
+#define TEST_QUEUE_DEPTH 8
+#define TEST_NCOPIES 256
+#define TEST_COPY_SIZE 4096
+#define TEST_NWAITERS 4
+#define TEST_NROUNDS 64
+
+struct countup_data {
+	int counter;
+	int max_count;
+};
+
+struct countup_output {
+	int result;
+};
+
+FUTURE(countup_fut, struct countup_data, struct countup_output);
+
+enum future_state
+countup_task(struct future_context *context,
+	struct future_notifier *notifier)
+{
+	struct countup_data *data = future_context_get_data(context);
+	if (++data->counter != data->max_count)
+		return FUTURE_STATE_RUNNING;
+
+	struct countup_output *output = future_context_get_output(context);
+	output->result = 1;
+
+	return FUTURE_STATE_COMPLETE;
+}
+
+struct countup_fut
+async_countup(int max_count)
+{
+	struct countup_fut fut = {.output.result = 0};
+	FUTURE_INIT(&fut, countup_task);
+	fut.data.counter = 0;
+	fut.data.max_count = max_count;
+
+	return fut;
+}
+
+/*
+ * test_wait_countup -- futures complete in the order of their counts,
+ * polled uniformly by the runtime
+ */
+void
+test_wait_countup(struct runtime *r)
+{
+	struct countup_fut countups[TEST_NCOUNTUPS];
+	struct future *futs[TEST_NCOUNTUPS];
+	size_t indices[TEST_NCOUNTUPS];
+
+	/* futures with lower indices take longer to complete */
+	for (int i = 0; i < TEST_NCOUNTUPS; ++i) {
+		countups[i] = async_countup((TEST_NCOUNTUPS - i) * 10);
+		futs[i] = FUTURE_AS_RUNNABLE(&countups[i]);
+	}
+
+	UT_ASSERTeq(runtime_wait_any(r, futs, TEST_NCOUNTUPS),
+		TEST_NCOUNTUPS - 1);
+	UT_ASSERTeq(FUTURE_STATE(&countups[TEST_NCOUNTUPS - 2]),
+		FUTURE_STATE_RUNNING);
+
+	/* the already complete future counts towards min_count */
+	size_t ndone = runtime_wait_some(r, futs, TEST_NCOUNTUPS, 3, indices);
+	UT_ASSERTeq(ndone, 3);
+	for (size_t i = 0; i < ndone; ++i)
+		UT_ASSERTeq(indices[i], TEST_NCOUNTUPS - 3 + i);
+	UT_ASSERTeq(FUTURE_STATE(&countups[TEST_NCOUNTUPS - 4]),
+		FUTURE_STATE_RUNNING);
+
+	/* min_count is capped by the number of futures */
+	ndone = runtime_wait_some(r, futs, TEST_NCOUNTUPS,
+		TEST_NCOUNTUPS * 2, indices);
+	UT_ASSERTeq(ndone, TEST_NCOUNTUPS);
+	for (size_t i = 0; i < ndone; ++i) {
+		UT_ASSERTeq(indices[i], i);
+		UT_ASSERTeq(FUTURE_OUTPUT(&countups[i])->result, 1);
+	}
+
+	UT_ASSERTeq(runtime_wait_any(r, futs, 0), 0);
+	UT_ASSERTeq(runtime_wait_some(r, futs, 0, 1, NULL), 0);
+}
+
+/*
+ * test_wait_duplicate -- a future appearing twice in the array is counted
+ * for both of its entries, and is not polled after completion
+ */
+void
+test_wait_duplicate(struct runtime *r)
+{
+	struct countup_fut countups[2];
+	countups[0] = async_countup(10);
+	countups[1] = async_countup(20);
+	struct future *futs[] = {
+		FUTURE_AS_RUNNABLE(&countups[0]),
+		FUTURE_AS_RUNNABLE(&countups[1]),
+		FUTURE_AS_RUNNABLE(&countups[0]),
+	};
+
+	size_t indices[3];
+	UT_ASSERTeq(runtime_wait_some(r, futs, 3, 2, indices), 2);
+	UT_ASSERTeq(indices[0], 0);
+	UT_ASSERTeq(indices[1], 2);
+
+	runtime_wait_multiple(r, futs, 3);
+	UT_ASSERTeq(countups[0].data.counter, 10);
+	UT_ASSERTeq(countups[1].data.counter, 20);
+}
+
+/*
+ * test_wait_pipeline -- keeps a constant number of memcpy operations in
+ * flight, submitting a new one as soon as any of them completes
+ */
+void
+test_wait_pipeline(struct runtime *r)
+{
+	struct data_mover_threads *dmt = data_mover_threads_default();
+	UT_ASSERTne(dmt, NULL);
+	struct vdm *vdm = data_mover_threads_get_vdm(dmt);
+
+	char *src = malloc(TEST_NCOPIES * TEST_COPY_SIZE);
+	char *dst = malloc(TEST_NCOPIES * TEST_COPY_SIZE);
+	UT_ASSERTne(src, NULL);
+	UT_ASSERTne(dst, NULL);
+	for (int i = 0; i < TEST_NCOPIES; ++i)
+		memset(src + i * TEST_COPY_SIZE, i, TEST_COPY_SIZE);
+	memset(dst, 0xFF, TEST_NCOPIES * TEST_COPY_SIZE);
+
+	struct vdm_operation_future copies[TEST_QUEUE_DEPTH];
+	/* futures in flight, never moved while running */
+	struct vdm_operation_future *inflight[TEST_QUEUE_DEPTH];
+	struct future *futs[TEST_QUEUE_DEPTH];
+	size_t indices[TEST_QUEUE_DEPTH];
+
+	size_t nsubmitted = 0;
+	for (size_t i = 0; i < TEST_QUEUE_DEPTH; ++i) {
+		copies[i] = vdm_memcpy(vdm, dst + nsubmitted * TEST_COPY_SIZE,
+			src + nsubmitted * TEST_COPY_SIZE, TEST_COPY_SIZE, 0);
+		inflight[i] = &copies[i];
+		futs[i] = FUTURE_AS_RUNNABLE(&copies[i]);
+		nsubmitted++;
+	}
+
+	size_t ncompleted = 0;
+	size_t nfuts = TEST_QUEUE_DEPTH;
+	while (nfuts != 0) {
+		size_t ndone = runtime_wait_some(r, futs, nfuts, 1, indices);
+		UT_ASSERTne(ndone, 0);
+
+		/* replace the complete futures, starting from the last one */
+		for (size_t i = ndone; i-- > 0; ) {
+			size_t f = indices[i];
+			struct vdm_operation_future *fut = inflight[f];
+			UT_ASSERTeq(FUTURE_OUTPUT(fut)->result, VDM_SUCCESS);
+			ncompleted++;
+
+			if (nsubmitted == TEST_NCOPIES) {
+				nfuts--;
+				inflight[f] = inflight[nfuts];
+				futs[f] = futs[nfuts];
+				continue;
+			}
+			*fut = vdm_memcpy(vdm,
+				dst + nsubmitted * TEST_COPY_SIZE,
+				src + nsubmitted * TEST_COPY_SIZE,
+				TEST_COPY_SIZE, 0);
+			nsubmitted++;
+		}
+	}
+
+	UT_ASSERTeq(ncompleted, TEST_NCOPIES);
+	UT_ASSERTeq(memcmp(src, dst, TEST_NCOPIES * TEST_COPY_SIZE), 0);
+
+	free(dst);
+	free(src);
+	data_mover_threads_delete(dmt);
+}
+
+struct test_waiter {
+	struct runtime *r;
+	struct vdm *vdm;
+	char src[TEST_QUEUE_DEPTH * TEST_COPY_SIZE];
+	char dst[TEST_QUEUE_DEPTH * TEST_COPY_SIZE];
+};
+
+/*
+ * waiter_thread -- waits for the rounds of copies of growing number
+ * on the runtime shared with the other threads
+ */
+static void *
+waiter_thread(void *arg)
+{
+	struct test_waiter *w = arg;
+	struct vdm_operation_future copies[TEST_QUEUE_DEPTH];
+	struct future *futs[TEST_QUEUE_DEPTH];
+
+	for (size_t round = 0; round < TEST_NROUNDS; ++round) {
+		size_t nfuts = round % TEST_QUEUE_DEPTH + 1;
+		memset(w->src, (int)round, sizeof(w->src));
+		memset(w->dst, 0, sizeof(w->dst));
+		for (size_t i = 0; i < nfuts; ++i) {
+			copies[i] = vdm_memcpy(w->vdm,
+				w->dst + i * TEST_COPY_SIZE,
+				w->src + i * TEST_COPY_SIZE, TEST_COPY_SIZE, 0);
+			futs[i] = FUTURE_AS_RUNNABLE(&copies[i]);
+		}
+		runtime_wait_multiple(w->r, futs, nfuts);
+
+		for (size_t i = 0; i < nfuts; ++i)
+			UT_ASSERTeq(FUTURE_OUTPUT(&copies[i])->result,
+				VDM_SUCCESS);
+		UT_ASSERTeq(memcmp(w->src, w->dst, nfuts * TEST_COPY_SIZE), 0);
+	}
+
+	return NULL;
+}
+
+/*
+ * test_wait_concurrent -- several threads wait for their own futures
+ * on the same runtime at once
+ */
+void
+test_wait_concurrent(struct runtime *r)
+{
+	struct data_mover_threads *dmt = data_mover_threads_default();
+	UT_ASSERTne(dmt, NULL);
+
+	struct test_waiter *waiters =
+		malloc(TEST_NWAITERS * sizeof(struct test_waiter));
+	UT_ASSERTne(waiters, NULL);
+
+	os_thread_t threads[TEST_NWAITERS];
+	for (int i = 0; i < TEST_NWAITERS; ++i) {
+		waiters[i].r = r;
+		waiters[i].vdm = data_mover_threads_get_vdm(dmt);
+		UT_ASSERTeq(os_thread_create(&threads[i], NULL,
+			waiter_thread, &waiters[i]), 0);
+	}
+	for (int i = 0; i < TEST_NWAITERS; ++i)
+		os_thread_join(&threads[i], NULL);
+
+	free(waiters);
+	data_mover_threads_delete(dmt);
+}
+
+int
+main(void)
+{
+	struct runtime *r = runtime_new();
+	UT_ASSERTne(r, NULL);
+
+	test_wait_countup(r);
+	test_wait_duplicate(r);
+	test_wait_pipeline(r);
+	test_wait_concurrent(r);
+
+	runtime_delete(r);
+
+	return 0;
+}
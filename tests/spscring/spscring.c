@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "core/spscring.h"
+#include "core/util.h"
+#include "os_thread.h"
+#include "test_helpers.h"
+
+#define TEST_NITEMS 1000000
+#define TEST_LENGTH 8
+
+/*
+ * test_spscring_try -- the try operations fail on a full and an empty buffer
+ * and keep the FIFO order across the laps
+ */
+void
+test_spscring_try(void)
+{
+	UT_ASSERTeq(spscring_new(0), NULL);
+	UT_ASSERTeq(spscring_new(TEST_LENGTH + 1), NULL);
+
+	struct spscring *ring = spscring_new(TEST_LENGTH);
+	UT_ASSERTne(ring, NULL);
+	UT_ASSERTeq(spscring_length(ring), TEST_LENGTH);
+	UT_ASSERTeq(spscring_trydequeue(ring), NULL);
+
+	uintptr_t next = 1;
+	for (int lap = 0; lap < 4; ++lap) {
+		uintptr_t first = next;
+		for (int i = 0; i < TEST_LENGTH; ++i, ++next)
+			UT_ASSERTeq(spscring_tryenqueue(ring, (void *)next), 0);
+		UT_ASSERTeq(spscring_tryenqueue(ring, (void *)next), -1);
+
+		for (int i = 0; i < TEST_LENGTH; ++i, ++first)
+			UT_ASSERTeq(spscring_trydequeue(ring), (void *)first);
+		UT_ASSERTeq(spscring_trydequeue(ring), NULL);
+	}
+
+	spscring_delete(ring);
+
+	ring = spscring_new(1);
+	UT_ASSERTne(ring, NULL);
+	for (int i = 0; i < 4; ++i) {
+		UT_ASSERTeq(spscring_tryenqueue(ring, (void *)next), 0);
+		UT_ASSERTeq(spscring_tryenqueue(ring, (void *)next), -1);
+		UT_ASSERTeq(spscring_trydequeue(ring), (void *)next);
+		UT_ASSERTeq(spscring_trydequeue(ring), NULL);
+	}
+	spscring_delete(ring);
+}
+
+void *
+producer_thread(void *arg)
+{
+	struct spscring *ring = arg;
+	for (uintptr_t i = 1; i <= TEST_NITEMS; ++i) {
+		while (spscring_tryenqueue(ring, (void *)i) != 0)
+			os_thread_yield();
+	}
+
+	return NULL;
+}
+
+/*
+ * test_spscring_mt -- the consumer gets every item of the producer running
+ * in another thread exactly once, in order
+ */
+void
+test_spscring_mt(void)
+{
+	struct spscring *ring = spscring_new(TEST_LENGTH);
+	UT_ASSERTne(ring, NULL);
+
+	os_thread_t producer;
+	UT_ASSERTeq(os_thread_create(&producer, NULL, producer_thread, ring),
+		0);
+
+	for (uintptr_t i = 1; i <= TEST_NITEMS; ++i) {
+		void *data;
+		while ((data = spscring_trydequeue(ring)) == NULL)
+			os_thread_yield();
+		UT_ASSERTeq(data, (void *)i);
+	}
+
+	os_thread_join(&producer, NULL);
+	UT_ASSERTeq(spscring_trydequeue(ring), NULL);
+
+	spscring_delete(ring);
+}
+
+int
+main(void)
+{
+	test_spscring_try();
+	test_spscring_mt();
+
+	return 0;
+}
@@ -15,6 +15,8 @@
 #include <limits.h>
 #include <assert.h>
 #include <errno.h>
+#include <string.h>
+#include "libminiasync/runtime.h"
 #include "libminiasync/vdm.h"
 
 #define UT_ERR(...) do {\
@@ -30,6 +32,10 @@
 	abort();\
 } while (/*CONSTCOND*/0)
 
+#define UT_ASSERT(cnd) do if (!(cnd)) {\
+	UT_FATAL("ASSERT FAILED : " #cnd);\
+} while (/*CONSTCOND*/0)
+
 #define UT_ASSERTeq(x, y) do if ((x) != (y)) {\
 	UT_FATAL("ASSERT FAILED : " #x " (%llu) ≠ %llu",\
 		(unsigned long long)(x), (unsigned long long)(y));\
@@ -51,6 +57,9 @@
 	fprintf(stdout, "\n");\
 } while (/*CONSTCOND*/0)
 
+/* the helpers below rely on the implicit conversions of void pointers of C */
+#ifndef __cplusplus
+
 static inline int
 test_flag(struct vdm *vdm, unsigned flag, int expected_value)
 {
@@ -63,4 +72,433 @@ test_flag(struct vdm *vdm, unsigned flag, int expected_value)
 	}
 	return ret;
 }
+
+/*
+ * test_memcpy_v -- copies nfrags fragments of around frag_size bytes with
+ * a vectored memcpy, the pairs of fragments differ in length, the gaps
+ * between the destination fragments have to stay intact
+ */
+static inline int
+test_memcpy_v(struct runtime *r, struct vdm *vdm, size_t nfrags,
+	size_t frag_size, uint64_t flags)
+{
+	size_t stride = frag_size + 8;
+	char *src = malloc(nfrags * stride);
+	char *dst = malloc(nfrags * stride);
+	struct vdm_iov *src_iov = malloc(nfrags * sizeof(*src_iov));
+	struct vdm_iov *dst_iov = malloc(nfrags * sizeof(*dst_iov));
+	if (!src || !dst || !src_iov || !dst_iov)
+		UT_FATAL("out of memory");
+
+	for (size_t i = 0; i < nfrags * stride; ++i)
+		src[i] = (char)(i % 251);
+	memset(dst, 0x55, nfrags * stride);
+
+	size_t expected = 0;
+	for (size_t i = 0; i < nfrags; ++i) {
+		src_iov[i].iov_base = src + i * stride;
+		src_iov[i].iov_len = frag_size + i % 3;
+		dst_iov[i].iov_base = dst + i * stride;
+		dst_iov[i].iov_len = frag_size + i % 2;
+		expected += frag_size + (i % 2 < i % 3 ? i % 2 : i % 3);
+	}
+
+	struct vdm_operation_future fut =
+		vdm_memcpy_v(vdm, dst_iov, src_iov, nfrags, flags);
+	runtime_wait(r, FUTURE_AS_RUNNABLE(&fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->result, VDM_SUCCESS);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->type, VDM_OPERATION_MEMCPY_V);
+	UT_ASSERTeq(FUTURE_OUTPUT(&fut)->output.memcpy_v.n, expected);
+
+	int ret = 0;
+	for (size_t i = 0; i < nfrags; ++i) {
+		size_t len = src_iov[i].iov_len < dst_iov[i].iov_len ?
+			src_iov[i].iov_len : dst_iov[i].iov_len;
+		char *frag = dst + i * stride;
+		if (memcmp(frag, src + i * stride, len) != 0) {
+			fprintf(stderr, "fragment %zu wasn't copied\n", i);
+			ret = 1;
+		}
+		for (size_t j = len; j < stride; ++j) {
+			if (frag[j] != 0x55) {
+				fprintf(stderr, "gap after fragment %zu was "
+					"overwritten\n", i);
+				ret = 1;
+				break;
+			}
+		}
+	}
+
+	free(dst_iov);
+	free(src_iov);
+	free(dst);
+	free(src);
+
+	return ret;
+}
+
+/*
+ * test_vdm_wait -- runs the operation to completion and checks its type
+ */
+static inline struct vdm_operation_output *
+test_vdm_wait(struct runtime *r, struct vdm_operation_future *fut,
+	enum vdm_operation_type type)
+{
+	runtime_wait(r, FUTURE_AS_RUNNABLE(fut));
+	UT_ASSERTeq(FUTURE_OUTPUT(fut)->type, type);
+
+	return FUTURE_OUTPUT(fut);
+}
+
+/*
+ * test_check_ops -- tests the compare, checksum, dualcast and delta record
+ * operations of the data mover
+ */
+static inline int
+test_check_ops(struct runtime *r, struct vdm *vdm, size_t n)
+{
+	char *a = malloc(n);
+	char *b = malloc(n);
+	char *c = malloc(n);
+	size_t delta_max = VDM_DELTA_ENTRY_SIZE * 3;
+	char *delta = malloc(delta_max);
+	if (!a || !b || !c || !delta)
+		UT_FATAL("out of memory");
+
+	memset(a, 0x3C, n);
+	memset(b, 0x3C, n);
+
+	struct vdm_operation_future fut = vdm_compare(vdm, a, b, n, 0);
+	struct vdm_operation_output *out =
+		test_vdm_wait(r, &fut, VDM_OPERATION_COMPARE);
+	UT_ASSERTeq(out->result, VDM_SUCCESS);
+	UT_ASSERTeq(out->output.compare.result, 0);
+	UT_ASSERTeq(out->output.compare.offset, n);
+
+	b[n / 2] = 0x3D;
+	fut = vdm_compare(vdm, a, b, n, 0);
+	out = test_vdm_wait(r, &fut, VDM_OPERATION_COMPARE);
+	UT_ASSERTeq(out->output.compare.result, 1);
+	UT_ASSERTeq(out->output.compare.offset, n / 2);
+
+	fut = vdm_compare_pattern(vdm, a, 0x3C3C3C3C3C3C3C3CULL, n, 0);
+	out = test_vdm_wait(r, &fut, VDM_OPERATION_COMPARE_PATTERN);
+	UT_ASSERTeq(out->output.compare_pattern.result, 0);
+	UT_ASSERTeq(out->output.compare_pattern.offset, n);
+
+	fut = vdm_compare_pattern(vdm, b, 0x3C3C3C3C3C3C3C3CULL, n, 0);
+	out = test_vdm_wait(r, &fut, VDM_OPERATION_COMPARE_PATTERN);
+	UT_ASSERTeq(out->output.compare_pattern.result, 1);
+	UT_ASSERTeq(out->output.compare_pattern.offset, n / 2);
+
+	fut = vdm_crc32c(vdm, "123456789", 9, 0, 0);
+	out = test_vdm_wait(r, &fut, VDM_OPERATION_CRC32C);
+	UT_ASSERTeq(out->output.crc32c.crc, 0xE3069283U);
+
+	/* continued from the checksum of the first part */
+	fut = vdm_crc32c(vdm, "12345", 5, 0, 0);
+	out = test_vdm_wait(r, &fut, VDM_OPERATION_CRC32C);
+	fut = vdm_crc32c(vdm, "6789", 4, out->output.crc32c.crc, 0);
+	out = test_vdm_wait(r, &fut, VDM_OPERATION_CRC32C);
+	UT_ASSERTeq(out->output.crc32c.crc, 0xE3069283U);
+
+	memset(a, 0, n);
+	fut = vdm_dualcast(vdm, a, c, b, n, 0);
+	out = test_vdm_wait(r, &fut, VDM_OPERATION_DUALCAST);
+	UT_ASSERTeq(out->result, VDM_SUCCESS);
+	UT_ASSERTeq(out->output.dualcast.dest1, a);
+	UT_ASSERTeq(out->output.dualcast.dest2, c);
+	UT_ASSERTeq(memcmp(a, b, n), 0);
+	UT_ASSERTeq(memcmp(c, b, n), 0);
+
+	/* a, b and c are equal, b is modified in two places */
+	b[0] = 0x11;
+	b[n - 1] = 0x11;
+	fut = vdm_delta_create(vdm, a, b, (uint32_t)n, delta,
+		(uint32_t)delta_max, 0);
+	out = test_vdm_wait(r, &fut, VDM_OPERATION_DELTA_CREATE);
+	UT_ASSERTeq(out->result, VDM_SUCCESS);
+	UT_ASSERTeq(out->output.delta_create.result, VDM_DELTA_CREATED);
+	UT_ASSERTeq(out->output.delta_create.delta_size,
+		VDM_DELTA_ENTRY_SIZE * 2);
+
+	size_t delta_size = out->output.delta_create.delta_size;
+	fut = vdm_delta_apply(vdm, c, n, delta, delta_size, 0);
+	out = test_vdm_wait(r, &fut, VDM_OPERATION_DELTA_APPLY);
+	UT_ASSERTeq(out->result, VDM_SUCCESS);
+	UT_ASSERTeq(out->output.delta_apply.dest, c);
+	UT_ASSERTeq(memcmp(c, b, n), 0);
+
+	fut = vdm_delta_create(vdm, b, c, (uint32_t)n, delta,
+		(uint32_t)delta_max, 0);
+	out = test_vdm_wait(r, &fut, VDM_OPERATION_DELTA_CREATE);
+	UT_ASSERTeq(out->output.delta_create.result, VDM_DELTA_EQUAL);
+	UT_ASSERTeq(out->output.delta_create.delta_size, 0);
+
+	/* only multiples of 8 bytes can be compared */
+	fut = vdm_delta_create(vdm, a, b, (uint32_t)n - 1, delta,
+		(uint32_t)delta_max, 0);
+	out = test_vdm_wait(r, &fut, VDM_OPERATION_DELTA_CREATE);
+	UT_ASSERTeq(out->result, VDM_ERROR_JOB_CORRUPTED);
+
+	free(delta);
+	free(c);
+	free(b);
+	free(a);
+
+	return 0;
+}
+
+/*
+ * test_submit_batch -- submits nops memcpy operations of growing sizes,
+ * starting with size bytes, together and waits for all of them
+ */
+static inline int
+test_submit_batch(struct runtime *r, struct vdm *vdm, size_t nops,
+	size_t size)
+{
+	struct vdm_operation_future *futs = malloc(nops * sizeof(*futs));
+	struct vdm_operation_future **pfuts = malloc(nops * sizeof(*pfuts));
+	struct future **runnables = malloc(nops * sizeof(*runnables));
+	char **srcs = malloc(nops * sizeof(*srcs));
+	char **dsts = malloc(nops * sizeof(*dsts));
+	if (!futs || !pfuts || !runnables || !srcs || !dsts)
+		UT_FATAL("out of memory");
+
+	for (size_t i = 0; i < nops; ++i) {
+		size_t len = size * (i + 1);
+		srcs[i] = malloc(len);
+		dsts[i] = malloc(len);
+		if (!srcs[i] || !dsts[i])
+			UT_FATAL("out of memory");
+		memset(srcs[i], (int)(i + 1), len);
+		memset(dsts[i], 0, len);
+
+		futs[i] = vdm_memcpy(vdm, dsts[i], srcs[i], len, 0);
+		pfuts[i] = &futs[i];
+		runnables[i] = FUTURE_AS_RUNNABLE(&futs[i]);
+	}
+
+	size_t nstarted = vdm_submit_batch(vdm, pfuts, nops);
+	UT_ASSERTeq(nstarted, nops);
+	for (size_t i = 0; i < nops; ++i)
+		UT_ASSERTeq(futs[i].base.context.state, FUTURE_STATE_RUNNING);
+
+	/* all the futures are running already */
+	UT_ASSERTeq(vdm_submit_batch(vdm, pfuts, nops), 0);
+
+	runtime_wait_multiple(r, runnables, nops);
+
+	int ret = 0;
+	for (size_t i = 0; i < nops; ++i) {
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->result, VDM_SUCCESS);
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[i])->output.memcpy.dest,
+			dsts[i]);
+		if (memcmp(dsts[i], srcs[i], size * (i + 1)) != 0) {
+			fprintf(stderr, "operation %zu wasn't performed\n", i);
+			ret = 1;
+		}
+		free(dsts[i]);
+		free(srcs[i]);
+	}
+
+	free(dsts);
+	free(srcs);
+	free(runnables);
+	free(pfuts);
+	free(futs);
+
+	return ret;
+}
+
+/*
+ * test_storage -- performs nops memcpy and memset operations of size bytes
+ * in the storage provided by the caller, one slot each
+ */
+static inline int
+test_storage(struct runtime *r, struct vdm *vdm, size_t nops, size_t size)
+{
+	size_t slot = vdm_op_storage_size(vdm);
+	size_t slot_misalignment = slot % VDM_OP_STORAGE_ALIGN;
+	UT_ASSERTne(slot, 0);
+	UT_ASSERTeq(slot_misalignment, 0);
+
+	char *storage = malloc(2 * nops * slot + VDM_OP_STORAGE_ALIGN);
+	struct vdm_operation_future *futs = malloc(2 * nops * sizeof(*futs));
+	struct future **runnables = malloc(2 * nops * sizeof(*runnables));
+	char *src = malloc(nops * size);
+	char *dst = malloc(nops * size);
+	char *set = malloc(nops * size);
+	if (!storage || !futs || !runnables || !src || !dst || !set)
+		UT_FATAL("out of memory");
+
+	uintptr_t misalignment = (uintptr_t)storage % VDM_OP_STORAGE_ALIGN;
+	char *slots = misalignment == 0 ? storage :
+		storage + VDM_OP_STORAGE_ALIGN - misalignment;
+
+	memset(src, 0x11, nops * size);
+	memset(dst, 0, nops * size);
+	memset(set, 0, nops * size);
+	for (size_t i = 0; i < nops; ++i) {
+		futs[2 * i] = vdm_memcpy_storage(vdm, slots + 2 * i * slot,
+			dst + i * size, src + i * size, size, 0);
+		futs[2 * i + 1] = vdm_memset_storage(vdm,
+			slots + (2 * i + 1) * slot, set + i * size, 0x22, size,
+			0);
+	}
+	for (size_t i = 0; i < 2 * nops; ++i)
+		runnables[i] = FUTURE_AS_RUNNABLE(&futs[i]);
+
+	runtime_wait_multiple(r, runnables, 2 * nops);
+
+	int ret = 0;
+	for (size_t i = 0; i < nops; ++i) {
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[2 * i])->result, VDM_SUCCESS);
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[2 * i])->output.memcpy.dest,
+			dst + i * size);
+		UT_ASSERTeq(FUTURE_OUTPUT(&futs[2 * i + 1])->output.memset.str,
+			set + i * size);
+	}
+	for (size_t i = 0; i < nops * size; ++i) {
+		if (dst[i] != 0x11 || set[i] != 0x22) {
+			fprintf(stderr, "byte %zu wasn't written\n", i);
+			ret = 1;
+			break;
+		}
+	}
+
+	free(set);
+	free(dst);
+	free(src);
+	free(runnables);
+	free(futs);
+	free(storage);
+
+	return ret;
+}
+
+/*
+ * test_compact -- performs nops memcpy and memset operations of size bytes
+ * with compact futures, polled together
+ */
+static inline int
+test_compact(struct runtime *r, struct vdm *vdm, size_t nops, size_t size)
+{
+	/* the polled part of the future fits a cache line */
+	UT_ASSERT(sizeof(struct vdm_compact_future) <= 64);
+
+	size_t slot = vdm_compact_slot_size(vdm);
+	size_t slot_misalignment = slot % VDM_OP_STORAGE_ALIGN;
+	UT_ASSERTeq(slot_misalignment, 0);
+
+	char *slots_buf = malloc(2 * nops * slot + VDM_OP_STORAGE_ALIGN);
+	struct vdm_compact_future *futs = malloc(2 * nops * sizeof(*futs));
+	struct future **runnables = malloc(2 * nops * sizeof(*runnables));
+	char *src = malloc(nops * size);
+	char *dst = malloc(nops * size);
+	char *set = malloc(nops * size);
+	if (!slots_buf || !futs || !runnables || !src || !dst || !set)
+		UT_FATAL("out of memory");
+
+	uintptr_t misalignment = (uintptr_t)slots_buf % VDM_OP_STORAGE_ALIGN;
+	char *slots = misalignment == 0 ? slots_buf :
+		slots_buf + VDM_OP_STORAGE_ALIGN - misalignment;
+
+	memset(src, 0x33, nops * size);
+	memset(dst, 0, nops * size);
+	memset(set, 0, nops * size);
+	for (size_t i = 0; i < nops; ++i) {
+		futs[2 * i] = vdm_compact_memcpy(vdm, slots + 2 * i * slot,
+			dst + i * size, src + i * size, size, 0);
+		futs[2 * i + 1] = vdm_compact_memset(vdm,
+			slots + (2 * i + 1) * slot, set + i * size, 0x44, size,
+			0);
+	}
+	for (size_t i = 0; i < 2 * nops; ++i)
+		runnables[i] = FUTURE_AS_RUNNABLE(&futs[i]);
+
+	runtime_wait_multiple(r, runnables, 2 * nops);
+
+	int ret = 0;
+	for (size_t i = 0; i < nops; ++i) {
+		struct vdm_compact_future *cpy = &futs[2 * i];
+		struct vdm_compact_future *set_fut = &futs[2 * i + 1];
+		UT_ASSERTeq(FUTURE_OUTPUT(cpy)->result, VDM_SUCCESS);
+		UT_ASSERTeq(FUTURE_OUTPUT(cpy)->type, VDM_OPERATION_MEMCPY);
+		UT_ASSERTeq(FUTURE_OUTPUT(set_fut)->type, VDM_OPERATION_MEMSET);
+		UT_ASSERTeq(vdm_compact_output(cpy)->output.memcpy.dest,
+			dst + i * size);
+		UT_ASSERTeq(vdm_compact_output(set_fut)->output.memset.str,
+			set + i * size);
+	}
+	for (size_t i = 0; i < nops * size; ++i) {
+		if (dst[i] != 0x33 || set[i] != 0x44) {
+			fprintf(stderr, "byte %zu wasn't written\n", i);
+			ret = 1;
+			break;
+		}
+	}
+
+	free(set);
+	free(dst);
+	free(src);
+	free(runnables);
+	free(futs);
+	free(slots_buf);
+
+	return ret;
+}
+
+/*
+ * test_memfill -- fills n bytes with the patterns of every width, at an odd
+ * offset, and checks that a pattern of an invalid width is rejected
+ */
+static inline int
+test_memfill(struct runtime *r, struct vdm *vdm, size_t n)
+{
+	unsigned char pattern[VDM_MEMFILL_MAX_PATTERN];
+	unsigned char *buf = malloc(n + 2);
+	if (buf == NULL)
+		UT_FATAL("out of memory");
+
+	for (size_t i = 0; i < VDM_MEMFILL_MAX_PATTERN; ++i)
+		pattern[i] = (unsigned char)(i * 5 + 1);
+
+	int ret = 0;
+	for (size_t len = 1; len <= VDM_MEMFILL_MAX_PATTERN; len *= 2) {
+		memset(buf, 0, n + 2);
+		struct vdm_operation_future fut = vdm_memfill(vdm, buf + 1,
+			pattern, len, n, 0);
+		struct vdm_operation_output *out = test_vdm_wait(r, &fut,
+			VDM_OPERATION_MEMFILL);
+		UT_ASSERTeq(out->result, VDM_SUCCESS);
+		UT_ASSERTeq(out->output.memfill.dest, buf + 1);
+
+		for (size_t i = 0; i < n; ++i) {
+			size_t pos = i % len;
+			if (buf[i + 1] != pattern[pos]) {
+				fprintf(stderr, "byte %zu of pattern %zu\n",
+					i, len);
+				ret = 1;
+				break;
+			}
+		}
+		if (buf[0] != 0 || buf[n + 1] != 0) {
+			fprintf(stderr, "pattern %zu filled too much\n", len);
+			ret = 1;
+		}
+	}
+
+	struct vdm_operation_future fut = vdm_memfill(vdm, buf, pattern, 24,
+		n, 0);
+	UT_ASSERTeq(test_vdm_wait(r, &fut, VDM_OPERATION_MEMFILL)->result,
+		VDM_ERROR_JOB_CORRUPTED);
+
+	free(buf);
+
+	return ret;
+}
+
+#endif /* __cplusplus */
+
 #endif /* TEST_HELPERS_H */
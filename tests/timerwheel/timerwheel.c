@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2022, Intel Corporation */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "core/os.h"
+#include "core/timerwheel.h"
+#include "test_helpers.h"
+
+#define TEST_NENTRIES 1000
+#define TEST_NSTEPS 20000
+
+struct test_entry {
+	struct timerwheel_entry entry;
+	int expired;
+};
+
+/*
+ * test_random_time -- returns a random time after now, mixing short and
+ * long distances so that all levels of the wheel are used
+ */
+static uint64_t
+test_random_time(unsigned *seed, uint64_t now)
+{
+	unsigned bits = (unsigned)os_rand_r(seed) % 48;
+	uint64_t r = ((uint64_t)os_rand_r(seed) << 31) ^
+		(uint64_t)os_rand_r(seed);
+
+	return now + (r & ((1ULL << bits) - 1));
+}
+
+/*
+ * test_timerwheel_random -- compares the wheel with a trivial model
+ */
+void
+test_timerwheel_random(void)
+{
+	unsigned seed = 1234;
+	struct timerwheel *tw = malloc(sizeof(struct timerwheel));
+	struct test_entry *entries =
+		calloc(TEST_NENTRIES, sizeof(struct test_entry));
+	UT_ASSERTne(tw, NULL);
+	UT_ASSERTne(entries, NULL);
+
+	uint64_t now = 1000;
+	timerwheel_init(tw, now);
+
+	for (int step = 0; step < TEST_NSTEPS; ++step) {
+		struct test_entry *e =
+			&entries[(unsigned)os_rand_r(&seed) % TEST_NENTRIES];
+		switch (os_rand_r(&seed) % 3) {
+			case 0:
+			timerwheel_remove(tw, &e->entry);
+			timerwheel_insert(tw, &e->entry,
+				test_random_time(&seed, now));
+			break;
+			case 1:
+			timerwheel_remove(tw, &e->entry);
+			break;
+			default:
+			break;
+		}
+
+		uint64_t next;
+		int has_next = timerwheel_next(tw, &next);
+
+		/* the model: the earliest entry and the number of entries */
+		uint64_t nentries = 0;
+		uint64_t earliest = UINT64_MAX;
+		for (int i = 0; i < TEST_NENTRIES; ++i) {
+			if (!timerwheel_entry_inserted(&entries[i].entry))
+				continue;
+			nentries++;
+			if (entries[i].entry.expires < earliest)
+				earliest = entries[i].entry.expires;
+		}
+		UT_ASSERTeq(tw->nentries, nentries);
+		UT_ASSERTeq(has_next, nentries != 0);
+		if (has_next)
+			UT_ASSERT(next <= earliest);
+
+		/* advance either to the next expiration or a random time */
+		uint64_t to = has_next && os_rand_r(&seed) % 2 ?
+			next : test_random_time(&seed, now) / 2 + now / 2;
+		struct timerwheel_entry *expired = timerwheel_advance(tw, to);
+		if (to > now)
+			now = to;
+		UT_ASSERTeq(tw->now, now);
+
+		for (struct timerwheel_entry *x = expired; x != NULL;
+				x = x->next) {
+			UT_ASSERT(x->expires <= now);
+			UT_ASSERT(!timerwheel_entry_inserted(x));
+			((struct test_entry *)x)->expired = 1;
+		}
+		for (int i = 0; i < TEST_NENTRIES; ++i) {
+			struct test_entry *t = &entries[i];
+			if (timerwheel_entry_inserted(&t->entry))
+				UT_ASSERT(t->entry.expires > now);
+		}
+	}
+
+	free(entries);
+	free(tw);
+}
+
+/*
+ * test_timerwheel_past -- entries inserted in the past expire on the next
+ * advance
+ */
+void
+test_timerwheel_past(void)
+{
+	struct timerwheel *tw = malloc(sizeof(struct timerwheel));
+	UT_ASSERTne(tw, NULL);
+	timerwheel_init(tw, 100);
+
+	struct timerwheel_entry e;
+	timerwheel_insert(tw, &e, 50);
+	UT_ASSERT(timerwheel_entry_inserted(&e));
+
+	uint64_t next;
+	UT_ASSERTeq(timerwheel_next(tw, &next), 1);
+	UT_ASSERTeq(next, 100);
+
+	UT_ASSERTeq(timerwheel_advance(tw, 100), &e);
+	UT_ASSERT(!timerwheel_entry_inserted(&e));
+	UT_ASSERTeq(timerwheel_next(tw, &next), 0);
+	UT_ASSERTeq(tw->nentries, 0);
+
+	free(tw);
+}
+
+int
+main(void)
+{
+	test_timerwheel_past();
+	test_timerwheel_random();
+
+	return 0;
+}
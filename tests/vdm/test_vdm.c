@@ -165,6 +165,20 @@ test_too_many_ops(struct vdm *vdm)
 	UT_ASSERTeq(FUTURE_OUTPUT(&f)->result, VDM_SUCCESS);
 }
 
+void
+test_membuf_stats(struct data_mover_sync *sync)
+{
+	struct vdm_membuf_stats stats;
+	data_mover_sync_get_membuf_stats(sync, &stats);
+
+	/* test_too_many_ops() exhausted the buffers of this thread */
+	UT_ASSERTeq(stats.failures, 1);
+	UT_ASSERT(stats.buffers > 0);
+	UT_ASSERT(stats.max_bytes_allocated <= stats.buffer_size);
+	UT_ASSERTeq(stats.bytes_allocated + stats.bytes_available,
+		stats.buffers * stats.buffer_size);
+}
+
 int
 main(void)
 {
@@ -176,6 +190,7 @@ main(void)
 	test_strdup_fut(async_strdup(vdm, hello_world));
 	test_strdup_fut(async_lazy_strdup(vdm, hello_world));
 	test_too_many_ops(vdm);
+	test_membuf_stats(sync);
 
 	data_mover_sync_delete(sync);
 